@@ -0,0 +1,42 @@
+/* cpuloop.c
+ *    Benchmark: integer arithmetic and branches in registers, without
+ *    memory traffic nor system calls. Measures the interpreter.
+ *
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+ */
+
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+
+#define ITERATIONS 2000000
+
+int
+main()
+{
+  unsigned int i, x = 1, y = 0;
+
+  for (i = 0; i < ITERATIONS; i++) {
+    x = x * 1103515245 + 12345;
+    if (x & 0x100)
+      y += x >> 16;
+    else
+      y ^= x;
+  }
+
+  n_printf("cpuloop %d\n", (int) y);
+  Exit(0);
+  return 0;
+}
@@ -0,0 +1,60 @@
+/* manyfiles.c
+ *    Benchmark: create, open, write, close and remove many small
+ *    files. Measures the directory, the file headers and the buffer
+ *    cache.
+ *
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+ */
+
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+
+#define NUM_FILES 24
+#define ROUNDS    4
+
+int
+main()
+{
+  char name[16];
+  char data[64];
+  int r, i;
+  OpenFileId f;
+
+  n_memset(data, 'x', sizeof(data));
+  for (r = 0; r < ROUNDS; r++) {
+    for (i = 0; i < NUM_FILES; i++) {
+      n_snprintf(name, sizeof(name), "/f%d", i);
+      if (Create(name, sizeof(data)) < 0) {
+        PError("manyfiles: create");
+        Exit(1);
+      }
+      f = Open(name);
+      Write(data, sizeof(data), f);
+      Close(f);
+    }
+    for (i = 0; i < NUM_FILES; i++) {
+      n_snprintf(name, sizeof(name), "/f%d", i);
+      f = Open(name);
+      Read(data, sizeof(data), f);
+      Close(f);
+      Remove(name);
+    }
+  }
+
+  n_printf("manyfiles done\n");
+  Exit(0);
+  return 0;
+}
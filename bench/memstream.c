@@ -0,0 +1,46 @@
+/* memstream.c
+ *    Benchmark: sequential passes over an array larger than the
+ *    physical memory of the default configuration (NumPhysPages
+ *    pages of 128 bytes), so that every pass pages in and evicts.
+ *    Measures the MMU, the page fault path and the swap.
+ *
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+ */
+
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+
+#define WORDS  (256 * 1024 / sizeof(int))   /* 256 KB */
+#define PASSES 4
+
+int Data[WORDS];
+
+int
+main()
+{
+  unsigned int i, p;
+  int sum = 0;
+
+  for (p = 0; p < PASSES; p++)
+    for (i = 0; i < WORDS; i++) {
+      Data[i] += i + p;
+      sum += Data[i];
+    }
+
+  n_printf("memstream %d\n", sum);
+  Exit(0);
+  return 0;
+}
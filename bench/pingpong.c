@@ -0,0 +1,61 @@
+/* pingpong.c
+ *    Benchmark: two threads hand a token back and forth with a pair
+ *    of semaphores. Measures the system call path and the context
+ *    switches.
+ *
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+ */
+
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+
+#define ROUNDS 2000
+
+SemId Ping, Pong;
+
+void
+pong(int arg)
+{
+  int i;
+
+  for (i = 0; i < ROUNDS; i++) {
+    P(Ping);
+    V(Pong);
+  }
+  Exit(0);
+}
+
+int
+main()
+{
+  ThreadId t;
+  int i;
+
+  Ping = SemCreate("ping", 0);
+  Pong = SemCreate("pong", 0);
+  t = newThread("pong", (int) pong, 0);
+  for (i = 0; i < ROUNDS; i++) {
+    V(Ping);
+    P(Pong);
+  }
+  Join(t);
+  SemDestroy(Ping);
+  SemDestroy(Pong);
+
+  n_printf("pingpong done\n");
+  Exit(0);
+  return 0;
+}
@@ -0,0 +1,75 @@
+/* pmatmult.c
+ *    Benchmark: parallel matrix multiplication, the rows of the result
+ *    being shared out among worker threads. Run with NumHarts = 1, 2,
+ *    4... to plot the simulated-time speedup of the harts.
+ *
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+ */
+
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+
+#define DIM         48
+#define NUM_THREADS 8
+
+int A[DIM][DIM];
+int B[DIM][DIM];
+int C[DIM][DIM];
+
+void
+worker(int first)
+{
+  int i, j, k;
+
+  for (i = first; i < DIM; i += NUM_THREADS)
+    for (j = 0; j < DIM; j++) {
+      C[i][j] = 0;
+      for (k = 0; k < DIM; k++)
+        C[i][j] += A[i][k] * B[k][j];
+    }
+  Exit(0);
+}
+
+int
+main()
+{
+  ThreadId t[NUM_THREADS];
+  int i, j, sum;
+
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++) {
+      A[i][j] = i;
+      B[i][j] = j;
+    }
+
+  for (i = 0; i < NUM_THREADS; i++) {
+    t[i] = newThread("worker", (int) worker, i);
+    if (t[i] < 0) {
+      PError("pmatmult: newThread");
+      Exit(1);
+    }
+  }
+  for (i = 0; i < NUM_THREADS; i++)
+    Join(t[i]);
+
+  sum = 0;
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      sum += C[i][j];
+  n_printf("pmatmult %d\n", sum);
+  Exit(0);
+  return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Benchmark harness: run each guest workload of bench/ under a fixed
+# configuration and report the host wall time, the simulated time,
+# and the rates the interpreter and the kernel sustain (millions of
+# guest instructions, system calls and page faults per host second).
+#
+# Usage: bench/run-bench.sh [config] [workload...]
+#   config    Nachos configuration (default bench/bench.cfg)
+#   workload  programs of bench/ to run (default all)
+#
+# Run from the top directory, after make nachos and make -C bench.
+
+TOP=`dirname $0`/..
+cd $TOP || exit 1
+
+CFG=bench/bench.cfg
+if [ $# -gt 0 ] && [ -f "$1" ]; then
+  CFG=$1
+  shift
+fi
+WORKLOADS=${*:-"cpuloop memstream manyfiles seqio pingpong spawnjoin pmatmult"}
+
+TMP=`mktemp -d /tmp/nachos-bench.XXXXXX` || exit 1
+trap 'rm -rf $TMP' EXIT
+
+printf "%-10s %9s %12s %12s %8s %12s %10s\n" workload "host(s)" \
+  "sim cycles" instructions MIPS "syscalls/s" "faults/s"
+for w in $WORKLOADS; do
+  if [ ! -f bench/$w ]; then
+    echo "$w: not built (make -C bench)" >&2
+    continue
+  fi
+  cat $CFG > $TMP/$w.cfg
+  cat >> $TMP/$w.cfg <<END
+FileToCopy       = bench/$w /$w
+ProgramToRun     = /$w
+StatsExport      = CSV
+StatsFile        = $TMP/$w.csv
+END
+
+  start=`date +%s%N`
+  ./nachos -f $TMP/$w.cfg > $TMP/$w.out 2>&1
+  end=`date +%s%N`
+
+  # Per-process counters of the final snapshot (the last rows of the
+  # export), system calls from the statistics printed at exit
+  awk -F, -v ns=`expr $end - $start` -v w=$w \
+      -v calls=`awk '/ calls,/ { n += $2 } END { print n + 0 }' $TMP/$w.out` '
+    NR > 1 { rows[NR] = $0; last = $1 }
+    END {
+      for (r in rows) {
+        split(rows[r], f, ",")
+        if (f[1] == last) { instr += f[3]; faults += f[11] }
+      }
+      s = ns / 1e9
+      if (s == 0) s = 1e-9
+      printf "%-10s %9.3f %12d %12d %8.2f %12.0f %10.0f\n", w, s, last,
+             instr, instr / s / 1e6, calls / s, faults / s
+    }' $TMP/$w.csv
+done
@@ -0,0 +1,55 @@
+/* seqio.c
+ *    Benchmark: write a large file sequentially, then read it back.
+ *    Measures the file system data path and the disk model.
+ *
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+ */
+
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+
+#define FILE_SIZE  (64 * 1024)
+#define CHUNK_SIZE 1024
+
+char Buffer[CHUNK_SIZE];
+
+int
+main()
+{
+  OpenFileId f;
+  int i, sum = 0;
+
+  if (Create("/seqio", FILE_SIZE) < 0) {
+    PError("seqio: create");
+    Exit(1);
+  }
+  f = Open("/seqio");
+  for (i = 0; i < FILE_SIZE / CHUNK_SIZE; i++) {
+    n_memset(Buffer, i, CHUNK_SIZE);
+    Write(Buffer, CHUNK_SIZE, f);
+  }
+  Seek(0, f);
+  for (i = 0; i < FILE_SIZE / CHUNK_SIZE; i++) {
+    Read(Buffer, CHUNK_SIZE, f);
+    sum += Buffer[0];
+  }
+  Close(f);
+  Remove("/seqio");
+
+  n_printf("seqio %d\n", sum);
+  Exit(0);
+  return 0;
+}
@@ -0,0 +1,53 @@
+/* spawnjoin.c
+ *    Benchmark: create short-lived threads and wait for each of them.
+ *    Measures thread creation, termination and Join.
+ *
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+ */
+
+#include "userlib/syscall.h"
+#include "userlib/libnachos.h"
+
+#define NUM_THREADS 200
+
+int Counter;
+
+void
+worker(int arg)
+{
+  Counter += arg;
+  Exit(0);
+}
+
+int
+main()
+{
+  ThreadId t;
+  int i;
+
+  for (i = 0; i < NUM_THREADS; i++) {
+    t = newThread("worker", (int) worker, 1);
+    if (t < 0) {
+      PError("spawnjoin: newThread");
+      Exit(1);
+    }
+    Join(t);
+  }
+
+  n_printf("spawnjoin %d\n", Counter);
+  Exit(0);
+  return 0;
+}
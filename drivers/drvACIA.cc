@@ -30,7 +30,10 @@
 #include "kernel/msgerror.h"
 #include "kernel/synch.h"
 #include "kernel/system.h"   // for the ACIA object
+#include "kernel/scheduler.h"
+#include "kernel/thread.h"
 #include "machine/ACIA.h"
+#include "machine/interrupt.h"
 
 //-------------------------------------------------------------------------
 // DriverACIA::DriverACIA()
@@ -41,10 +44,27 @@
   reception interrupts.
   In the ACIA Busy Waiting mode, simply inittialize the ACIA
   working mode and create the semaphore.
+  In the ACIA Framed mode, create the locks of every port and allow
+  both interrupts.
   */
 //-------------------------------------------------------------------------
 
 DriverACIA::DriverACIA() {
+  if (g_cfg->ACIA == ACIA_FRAMED) {
+    int ports = g_machine->acia->NumPorts();
+    send_lock = new Lock *[ports];
+    receive_lock = new Lock *[ports];
+    sender = new Thread *[ports];
+    receiver = new Thread *[ports];
+    for (int p = 0; p < ports; p++) {
+      send_lock[p] = new Lock((char *) "ACIA send");
+      receive_lock[p] = new Lock((char *) "ACIA receive");
+      sender[p] = NULL;
+      receiver[p] = NULL;
+    }
+    g_machine->acia->SetWorkingMode(FRAMED | REC_INTERRUPT | SEND_INTERRUPT);
+    return;
+  }
   printf("**** Warning: contructor of the ACIA driver not implemented yet\n");
   exit(ERROR);
 }
@@ -52,11 +72,31 @@ DriverACIA::DriverACIA() {
 //-------------------------------------------------------------------------
 // DriverACIA::TtySend(char* buff)
 /*! Routine to send a message through the ACIA (Busy Waiting or Interrupt mode)
+  The Framed mode sends it through one of the ports of the ACIA.
  */
 //-------------------------------------------------------------------------
 
 int
-DriverACIA::TtySend(char *buff) {
+DriverACIA::TtySend(char *buff, int port) {
+  if (g_cfg->ACIA == ACIA_FRAMED) {
+    // Queue the whole message, terminator included, so that the
+    // receiver can split the byte stream back into messages.
+    int length = strlen(buff) + 1;
+    int queued = 0;
+    send_lock[port]->Acquire();
+    IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    while (true) {
+      queued +=
+          g_machine->acia->PutBytes(buff + queued, length - queued, port);
+      if (queued == length)
+        break;
+      sender[port] = g_current_thread;
+      g_current_thread->Sleep();
+    }
+    (void) g_machine->interrupt->SetStatus(oldLevel);
+    send_lock[port]->Release();
+    return length - 1;
+  }
   printf(
       "**** Warning: method Tty_Send of the ACIA driver not implemented yet\n");
   exit(ERROR);
@@ -66,12 +106,26 @@ DriverACIA::TtySend(char *buff) {
 //-------------------------------------------------------------------------
 // DriverACIA::TtyReceive(char* buff,int length)
 /*! Routine to reveive a message through the ACIA
-//  (Busy Waiting and Interrupt mode).
+//  (Busy Waiting and Interrupt mode), or from one of the ports of the
+//  ACIA (Framed mode).
   */
 //-------------------------------------------------------------------------
 
 int
-DriverACIA::TtyReceive(char *buff, int lg) {
+DriverACIA::TtyReceive(char *buff, int lg, int port) {
+  if (g_cfg->ACIA == ACIA_FRAMED) {
+    int length;
+    receive_lock[port]->Acquire();
+    IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    while ((length = g_machine->acia->GetMessage(buff, lg, port)) < 0) {
+      receiver[port] = g_current_thread;
+      g_current_thread->Sleep();
+    }
+    (void) g_machine->interrupt->SetStatus(oldLevel);
+    receive_lock[port]->Release();
+    buff[length] = '\0';
+    return length;
+  }
   printf("**** Warning: method Tty_Receive of the ACIA driver not implemented "
          "yet\n");
   exit(ERROR);
@@ -84,11 +138,20 @@ DriverACIA::TtyReceive(char *buff, int lg) {
   Used in the ACIA Interrupt mode only.
   Detects when it's the end of the message (if so, releases the send_sema
   semaphore), else sends the next character according to index ind_send.
+  In the ACIA Framed mode, acknowledged frames have made room in the
+  ACIA: wake up the sender waiting on the port.
   */
 //-------------------------------------------------------------------------
 
 void
-DriverACIA::InterruptSend() {
+DriverACIA::InterruptSend(int port) {
+  if (g_cfg->ACIA == ACIA_FRAMED) {
+    if (sender[port] != NULL) {
+      g_scheduler->ReadyToRun(sender[port]);
+      sender[port] = NULL;
+    }
+    return;
+  }
   printf("**** Warning: send interrupt handler not implemented yet\n");
   exit(ERROR);
 }
@@ -100,11 +163,20 @@ DriverACIA::InterruptSend() {
   Releases the receive_sema semaphore and disables reception
   interrupts when the last character of the message is received
   (character '\0').
+  In the ACIA Framed mode, data has been received: wake up the waiting
+  receiver of the port, which checks whether its message is complete.
   */
 //-------------------------------------------------------------------------
 
 void
-DriverACIA::InterruptReceive() {
+DriverACIA::InterruptReceive(int port) {
+  if (g_cfg->ACIA == ACIA_FRAMED) {
+    if (receiver[port] != NULL) {
+      g_scheduler->ReadyToRun(receiver[port]);
+      receiver[port] = NULL;
+    }
+    return;
+  }
   printf("**** Warning: receive interrupt handler not implemented yet\n");
   exit(ERROR);
 }
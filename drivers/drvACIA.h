@@ -34,6 +34,8 @@
 
 #include "kernel/synch.h"   // for the acces to the synchronisation's tools
 
+class Thread;
+
 #define BUFFER_SIZE 256   // size of emission and reception buffers
 
 /*! The class DriverACIA defines the handler of the ACIA. It is the
@@ -54,20 +56,28 @@ private:
   int ind_send;   //!< index in the emission buffer
   int ind_rec;    //!< index in the reception buffer
 
+  // ACIA Framed mode: the ACIA buffers whole messages, a thread only
+  // sleeps until there is room to queue its message or a message to read.
+  // Each port of the ACIA has its own locks and waiting threads.
+  Lock **send_lock;      //!< mutual exclusion between emission requests
+  Lock **receive_lock;   //!< mutual exclusion between reception requests
+  Thread **sender;       //!< thread waiting for room in the ACIA
+  Thread **receiver;     //!< thread waiting for a complete message
+
 public:
   //! Constructor. Driver initialization.
   DriverACIA();
 
-  //! Send a message through the ACIA
-  int TtySend(char *buff);
+  //! Send a message through a port of the ACIA
+  int TtySend(char *buff, int port = 0);
 
-  //! Receive a message using the ACIA
-  int TtyReceive(char *buff, int lg);
+  //! Receive a message from a port of the ACIA
+  int TtyReceive(char *buff, int lg, int port = 0);
 
   //! Emission interrupt handler. Used in the ACIA Interrupt mode only
-  void InterruptSend();
+  void InterruptSend(int port = 0);
 
   //! Reception interrupt handler. Used in the ACIA Interrupt mode only
-  void InterruptReceive();
+  void InterruptReceive(int port = 0);
 };
 #endif   // _ACIA_HDL
@@ -4,12 +4,13 @@
 //      The console is an asynchronous device (requests return
 //      immediately, and
 //	an interrupt happens later on).  This is a layer on top of
-//	the console providing a synchronous interface
-//      (requests wait until the request completes).
+//	the console providing a buffered interface: writes return once
+//	the string is buffered, reads return a complete line.
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the console can only
-//	handle one read operation and one write operation at a time,
+//	The buffers are shared with the interrupt handlers, so they are
+//	only accessed with interrupts disabled, and a waiting thread
+//	sleeps until a handler wakes it up.  And, because the console can
+//	only handle one read operation and one write operation at a time,
 //      use two locks to enforce mutual exclusion.
 //
  * -----------------------------------------------------
@@ -29,6 +30,8 @@
 */
 
 #include "drivers/drvConsole.h"
+#include "kernel/scheduler.h"
+#include "kernel/thread.h"
 #include "machine/interrupt.h"
 
 //----------------------------------------------------------------------
@@ -56,33 +59,65 @@ ConsolePut() {
 //-----------------------------------------------------------------
 // DriverConsole::DriverConsole
 /*!     Constructor.
-//      Initialize the console driver (lock and semaphore creation)
+//      Initialize the console driver (locks and buffers creation)
 */
 //-----------------------------------------------------------------
 DriverConsole::DriverConsole() {
-  get = new Semaphore((char *) "get", 0);
-  put = new Semaphore((char *) "put", 0);
   mutexget = new Lock((char *) "mutex get");
   mutexput = new Lock((char *) "mutex put");
+
+  outBuf = new char[CONSOLE_BUFFER_SIZE];
+  outHead = 0;
+  outCount = 0;
+  outBusy = false;
+  writer = NULL;
+
+  inBuf = new char[CONSOLE_BUFFER_SIZE];
+  inHead = 0;
+  inCount = 0;
+  inLines = 0;
+  line = new char[CONSOLE_LINE_SIZE];
+  lineLength = 0;
+  reader = NULL;
 }
 
 //-----------------------------------------------------------------
 // DriverConsole::~DriverConsole
 /*!     Destructor.
 //      De-allocate data structures needed by the console driver
-//      (semaphores, locks).
+//      (locks, buffers).
 */
 //-----------------------------------------------------------------
 DriverConsole::~DriverConsole() {
   delete mutexget;
   delete mutexput;
-  delete get;
-  delete put;
+  delete[] outBuf;
+  delete[] inBuf;
+  delete[] line;
+}
+
+//-----------------------------------------------------------------
+// DriverConsole::StartOutput
+/*!     Give the next buffered character to the console device, unless
+//      it is still busy with the previous one. Called with interrupts
+//      disabled.
+*/
+//-----------------------------------------------------------------
+void
+DriverConsole::StartOutput() {
+  if (outBusy || outCount == 0)
+    return;
+  char c = outBuf[outHead];
+  outHead = (outHead + 1) % CONSOLE_BUFFER_SIZE;
+  outCount--;
+  outBusy = true;
+  g_machine->console->PutChar(c);
 }
 
 //-----------------------------------------------------------------
 // DriverConsole::PutAChar
-/*!     Operate a V on the "write" semaphore to signal a char is written.
+/*!     The console device has output a character: send the next one,
+//      and wake up the writer waiting for room in the buffer.
 //      The method is called by the interrupt handler ConsolePut.
 */
 //-----------------------------------------------------------------
@@ -90,15 +125,21 @@ void
 DriverConsole::PutAChar() {
 
   IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
-  put->V();
+  outBusy = false;
+  StartOutput();
+  if (writer != NULL) {
+    g_scheduler->ReadyToRun(writer);
+    writer = NULL;
+  }
   (void) g_machine->interrupt->SetStatus(oldLevel);
 }
 
 //-----------------------------------------------------------------
 // DriverConsole::PutString
 /*!     Send a string to the console device using a lock to insure
-//      mutual exclusion. The method returns when all characters
-//      has been sent.
+//      mutual exclusion. The characters are copied into the output
+//      buffer, the method only waits when the buffer is full, and
+//      returns before the last characters are actually output.
 //
 //      \param buffer contains the data to send
 //      \param nbcar is the number of chars to send
@@ -108,19 +149,50 @@ void
 DriverConsole::PutString(char *buffer, int nbcar) {
 
   mutexput->Acquire();
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
 
   for (int i = 0; i < nbcar; i++) {
+    while (outCount == CONSOLE_BUFFER_SIZE) {
+      writer = g_current_thread;
+      g_current_thread->Sleep();
+    }
     g_current_thread->GetProcessOwner()->stat->incrNumCharWritten();
-    g_machine->console->PutChar(buffer[i]);
-    put->P();
+    outBuf[(outHead + outCount) % CONSOLE_BUFFER_SIZE] = buffer[i];
+    outCount++;
+    StartOutput();
   }
 
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+  mutexput->Release();
+}
+
+//-----------------------------------------------------------------
+// DriverConsole::Flush
+/*!     Wait until the characters buffered by PutString have all been
+//      output. Called before Nachos halts.
+*/
+//-----------------------------------------------------------------
+void
+DriverConsole::Flush() {
+
+  mutexput->Acquire();
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  while (outBusy || outCount > 0) {
+    writer = g_current_thread;
+    g_current_thread->Sleep();
+  }
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
   mutexput->Release();
 }
 
 //-----------------------------------------------------------------
 // DriverConsole::GetAChar
-/*!     Operate a V on the "read" semaphore to signal a char is read.
+/*!     A character has been typed: edit the current line with it, and
+//      move the line to the input buffer when it is complete, waking up
+//      the waiting reader. Once the line is full, the characters other
+//      than the end of line are ignored, so every line ends with '\n'.
 //      The method is called by the interrupt handler ConsoleGet.
 */
 //-----------------------------------------------------------------
@@ -128,18 +200,44 @@ void
 DriverConsole::GetAChar() {
 
   IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
-  get->V();
+  char c = g_machine->console->GetChar();
+
+  if (c == CONSOLE_ERASE || c == CONSOLE_DEL) {
+    if (lineLength > 0)
+      lineLength--;
+  } else if (c == CONSOLE_KILL)
+    lineLength = 0;
+  else if (c != '\n') {
+    if (lineLength < CONSOLE_LINE_SIZE - 1)
+      line[lineLength++] = c;
+  } else {
+    // The line is complete, drop it if there is no room for it
+    line[lineLength++] = c;
+    if (inCount + lineLength <= CONSOLE_BUFFER_SIZE) {
+      for (int i = 0; i < lineLength; i++)
+        inBuf[(inHead + inCount + i) % CONSOLE_BUFFER_SIZE] = line[i];
+      inCount += lineLength;
+      inLines++;
+    }
+    lineLength = 0;
+    if (reader != NULL) {
+      g_scheduler->ReadyToRun(reader);
+      reader = NULL;
+    }
+  }
   (void) g_machine->interrupt->SetStatus(oldLevel);
 }
 
 //-----------------------------------------------------------------
 // DriverConsole::GetString
 /*!     Receive a string from the console device using a lock to
-//      prevent from concurrent accesses. The method returns when
-//      all characters has been received.
+//      prevent from concurrent accesses. The method waits for a
+//      complete line, and returns at most nbcar characters of it (the
+//      rest of the line is returned by the next call).
 //
-//      \param buffer is the structure to fill
-/       \param size is the number max of char to be received
+//      \param buffer is the structure to fill, it must have room for
+//      nbcar + 1 chars
+//      \param size is the number max of char to be received
 */
 //-----------------------------------------------------------------
 void
@@ -149,16 +247,30 @@ DriverConsole::GetString(char *buffer, int nbcar) {
   int i;
 
   mutexget->Acquire();
-  g_machine->console->EnableInterrupt();
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  if (inLines == 0) {
+    g_machine->console->EnableInterrupt();
+    while (inLines == 0) {
+      reader = g_current_thread;
+      g_current_thread->Sleep();
+    }
+  }
 
   for (i = 0; ((i < nbcar) && (c != '\n')); i++) {
     g_current_thread->GetProcessOwner()->stat->incrNumCharRead();
-    get->P();
-    c = g_machine->console->GetChar();
+    c = inBuf[inHead];
+    inHead = (inHead + 1) % CONSOLE_BUFFER_SIZE;
+    inCount--;
     buffer[i] = c;
+    if (c == '\n')
+      inLines--;
   }
   buffer[i] = 0;
 
-  g_machine->console->DisableInterrupt();
+  // Stop polling the keyboard until the next reader
+  if (inLines == 0)
+    g_machine->console->DisableInterrupt();
+  (void) g_machine->interrupt->SetStatus(oldLevel);
   mutexget->Release();
 }
@@ -29,14 +29,27 @@ class DriverConsole;
 #include "machine/console.h"
 #include "utility/utility.h"
 
-/*! \brief Defines a "synchronous" console abstraction.
+// Size of the output ring buffer and of the buffer of input lines
+#define CONSOLE_BUFFER_SIZE 4096
+
+// Maximum length of the input line being edited
+#define CONSOLE_LINE_SIZE 256
+
+// Editing characters of the input line
+#define CONSOLE_ERASE  '\b'    // erase the last character (also DEL)
+#define CONSOLE_DEL    0x7f
+#define CONSOLE_KILL   0x15    // erase the whole line (^U)
+
+/*! \brief Defines a buffered console abstraction.
 //
 // As with other I/O devices, the console is an asynchronous device.
-// This class provides methods in order to preserve mutual exclusion
-// on the console device. Two operations can be called : the first one
-// writes a string to the console and the second one reads a string from
-// the console. They return only when the read or write operation is
-// completed.
+// Written strings are copied into a ring buffer, which the write
+// interrupt handler drains one character at a time: writers only wait
+// when the buffer is full. The read interrupt handler collects the
+// typed characters into a line, with erase and kill editing, and moves
+// the line to the input buffer once it is complete: readers only get
+// complete lines. Locks preserve mutual exclusion between readers and
+// between writers.
 */
 class DriverConsole {
 public:
@@ -46,14 +59,32 @@ public:
   // Write a buffer on the console
   void GetString(char *buffer, int nbcar);
   // Read characters from the console
+  void Flush();
+  // Wait until all the written characters are output
 
-  void GetAChar();   // Send a char to the console device
-  void PutAChar();   // Receive e char from the console
+  void GetAChar();   // Receive a char from the console device
+  void PutAChar();   // The console device is ready for the next char
 
 private:
+  void StartOutput();   // Send the next buffered char if the device is idle
+
   Lock *mutexget;         //!< Lock on read operations
   Lock *mutexput;         //!< Lock on write operations
-  Semaphore *get, *put;   //!< Semaphores to wait for interrupts
+
+  char *outBuf;           //!< Characters waiting to be output (ring)
+  int outHead;            //!< Index of the next char to output
+  int outCount;           //!< Number of chars in outBuf
+  bool outBusy;           //!< A char is being output by the device
+  Thread *writer;         //!< Thread waiting for room in outBuf or for
+                          //!< the output to drain, NULL if none
+
+  char *inBuf;            //!< Complete input lines (ring)
+  int inHead;             //!< Index of the next char to read
+  int inCount;            //!< Number of chars in inBuf
+  int inLines;            //!< Number of complete lines in inBuf
+  char *line;             //!< Line being edited
+  int lineLength;         //!< Number of chars in line
+  Thread *reader;         //!< Thread waiting for a line, NULL if none
 };
 
 void ConsoleGet();
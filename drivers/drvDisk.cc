@@ -7,10 +7,12 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	The requesting threads sleep until the interrupt handler wakes
+//	them up.  And, because the physical disk can only handle a few
+//	operations at a time (only one for a hard disk), the requests
+//	made while it is busy are queued, and served in an order reducing
+//	the seeks. A volume striped over several disks is served the
+//	same way, each disk with its own queue.
  * -----------------------------------------------------
  * This file is part of the Nachos-RiscV distribution
  * Copyright (c) 2022 University of Rennes 1.
@@ -28,43 +30,62 @@
 */
 
 #include "drivers/drvDisk.h"
+#include "kernel/scheduler.h"
+#include "kernel/system.h"
+#include "kernel/thread.h"
+#include "machine/machine.h"
+#include "utility/config.h"
 
 //----------------------------------------------------------------------
 // DiskRequestDone
 /*! 	Disk interrupt handler.  Need this to be a C routine, because
 //	C++ can't handle pointers to member functions.
+//
+//	\param req the request that completed (its tag)
 */
 //----------------------------------------------------------------------
 
 void
-DiskRequestDone() {
-  g_disk_driver->RequestDone();
+DiskRequestDone(int64_t req) {
+  g_disk_driver->RequestDone((DiskRequest *) req);
 }
 
 //----------------------------------------------------------------------
 // DiskSwapRequestDone
 /*! 	Disk Swap interrupt handler.  Need this to be a C routine, because
 //	C++ can't handle pointers to member functions.
+//
+//	\param req the request that completed (its tag)
 */
 //----------------------------------------------------------------------
 
 void
-DiskSwapRequestDone() {
-  g_swap_disk_driver->RequestDone();
+DiskSwapRequestDone(int64_t req) {
+  g_swap_disk_driver->RequestDone((DiskRequest *) req);
 }
 
 //----------------------------------------------------------------------
 // DriverDisk::DriverDisk
 /*! 	Constructor.
-//      Initialize the disk driver, in turn
-//	initializing the physical disk.
+//      Initialize the disk driver of a volume striped over a set of
+//	physical disks, by stripe units of g_cfg->StripeSectors sectors.
+//
+//	\param theName name of the driver, for debugging
+//	\param disks the disks of the volume
+//	\param numDisks the number of disks (1 for a plain disk)
 */
 //----------------------------------------------------------------------
 
-DriverDisk::DriverDisk(char *sem_name, char *lock_name, Disk *theDisk) {
-  semaphore = new Semaphore((char *) sem_name, 0);
-  lock = new Lock((char *) lock_name);
-  disk = theDisk;
+DriverDisk::DriverDisk(char *theName, Disk **disks, int numDisks) {
+  name = theName;
+  numMembers = numDisks;
+  stripe = g_cfg->StripeSectors;
+  members = new DiskMember[numMembers];
+  for (int i = 0; i < numMembers; i++) {
+    members[i].disk = disks[i];
+    members[i].inFlight = 0;
+    members[i].first = members[i].last = NULL;
+  }
 }
 
 //----------------------------------------------------------------------
@@ -75,8 +96,244 @@ DriverDisk::DriverDisk(char *sem_name, char *lock_name, Disk *theDisk) {
 //----------------------------------------------------------------------
 
 DriverDisk::~DriverDisk() {
-  delete lock;
-  delete semaphore;
+  for (int i = 0; i < numMembers; i++)
+    ASSERT(members[i].inFlight == 0);
+  delete[] members;
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::Submit
+/*! 	Send a request to the disk if it is idle, or queue it, and wait
+//	until the interrupt handler signals its completion.
+//
+//	The queue is shared with the interrupt handler, so it is only
+//	accessed with interrupts disabled.
+//
+//	\param req the request, filled in by the caller
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::Submit(DiskRequest *req) {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  req->waiter = g_current_thread;
+  Queue(req);
+
+  DEBUG('d', (char *) "[%s] req %d: wait irq\n", name, req->sector);
+  while (!req->done)
+    g_current_thread->Sleep();
+  DEBUG('d', (char *) "[%s] req %d: wait irq OK\n", name, req->sector);
+
+  g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::Queue
+/*! 	Send a request to the disks of the volume. Must be called with
+//	interrupts disabled.
+//
+//	\param req the request, filled in by the caller
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::Queue(DiskRequest *req) {
+  ASSERT(g_machine->interrupt->GetStatus() == INTERRUPTS_OFF);
+  req->done = false;
+  req->parent = NULL;
+  if (numMembers == 1) {
+    req->member = 0;
+    QueueOn(&members[0], req);
+  } else
+    Split(req);
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::MapSector
+/*! 	Find where a sector of the volume is stored: stripe unit u of the
+//	volume is stripe unit u / numMembers of disk u % numMembers.
+//
+//	\param sector the sector of the volume
+//	\param member where to put the index of the disk
+//	\param memberSector where to put the sector on that disk
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::MapSector(uint32_t sector, int *member, uint32_t *memberSector) {
+  uint32_t unit = sector / stripe;
+  *member = unit % numMembers;
+  *memberSector = (unit / numMembers) * stripe + sector % stripe;
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::Split
+/*! 	Queue a request to a striped volume as one request per disk it
+//	touches. The sectors of a run of the volume held by a disk are
+//	consecutive on that disk, so that each part is a single run.
+//
+//	\param req the request
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::Split(DiskRequest *req) {
+  int count[numMembers], offset[numMembers], next[numMembers];
+  uint32_t start[numMembers];
+  int member;
+  uint32_t sector;
+
+  for (int m = 0; m < numMembers; m++)
+    count[m] = 0;
+  for (int i = 0; i < req->count; i++) {
+    MapSector(req->sector + i, &member, &sector);
+    if (count[member]++ == 0)
+      start[member] = sector;
+  }
+
+  // Gather the buffers of each part, in sector order
+  req->parts = new DiskRequest[numMembers];
+  req->partData = new char *[req->count];
+  req->pending = 0;
+  for (int m = 0, n = 0; m < numMembers; n += count[m], m++) {
+    offset[m] = next[m] = n;
+    if (count[m] > 0)
+      req->pending++;
+  }
+  for (int i = 0; i < req->count; i++) {
+    MapSector(req->sector + i, &member, &sector);
+    req->partData[next[member]++] = req->data[i];
+  }
+
+  for (int m = 0; m < numMembers; m++) {
+    if (count[m] == 0)
+      continue;
+    DiskRequest *part = &req->parts[m];
+    part->sector = start[m];
+    part->count = count[m];
+    part->data = &req->partData[offset[m]];
+    part->writing = req->writing;
+    part->done = false;
+    part->waiter = NULL;
+    part->member = m;
+    part->parent = req;
+    QueueOn(&members[m], part);
+  }
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::QueueOn
+/*! 	Send a request to a disk if it accepts one more, or append it to
+//	the queue of the disk.
+//
+//	\param m the disk
+//	\param req the request, in the sectors of the disk
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::QueueOn(DiskMember *m, DiskRequest *req) {
+  req->bypassed = 0;
+  req->next = NULL;
+  if (m->inFlight < m->disk->MaxRequests())
+    Start(m, req);
+  else {
+    DEBUG('d', (char *) "[%s] queue req %d\n", name, req->sector);
+    if (m->last == NULL)
+      m->first = req;
+    else
+      m->last->next = req;
+    m->last = req;
+  }
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::Start
+/*! 	Send a request to a disk, which must accept one more. The
+//	request is the tag given back by the disk when it completes.
+//
+//	\param m the disk
+//	\param req the request
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::Start(DiskMember *m, DiskRequest *req) {
+  ASSERT(m->inFlight < m->disk->MaxRequests());
+  m->inFlight++;
+  if (req->writing)
+    m->disk->WriteRequest(req->sector, req->count, req->data, (int64_t) req);
+  else
+    m->disk->ReadRequest(req->sector, req->count, req->data, (int64_t) req);
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::PickNext
+/*! 	Remove from the queue of a disk the next request to send to it,
+//	according to the scheduling policy, from the sector where the
+//	disk head stands:
+//	  - DISK_FIFO serves the requests in arrival order,
+//	  - DISK_SSTF serves the nearest track first,
+//	  - DISK_CLOOK serves the requests in increasing sector order,
+//	    going back to the lowest sector after the highest one.
+//
+//	To avoid starvation, a request bypassed by DISK_MAX_BYPASS
+//	younger requests is served first.
+//
+//	\param m the disk
+//	\return the request, or NULL if the queue is empty
+*/
+//----------------------------------------------------------------------
+
+DiskRequest *
+DriverDisk::PickNext(DiskMember *m) {
+  if (m->first == NULL)
+    return NULL;
+
+  int head = m->disk->LastSector();
+  int headTrack = head / SECTORS_PER_TRACK;
+  DiskRequest *best = m->first;
+
+  if (m->first->bypassed < DISK_MAX_BYPASS) {
+    switch (g_cfg->DiskScheduling) {
+    case DISK_SSTF:
+      for (DiskRequest *r = m->first->next; r != NULL; r = r->next)
+        if (abs((int) r->sector / SECTORS_PER_TRACK - headTrack) <
+            abs((int) best->sector / SECTORS_PER_TRACK - headTrack))
+          best = r;
+      break;
+    case DISK_CLOOK: {
+      DiskRequest *lowest = NULL;
+      best = NULL;
+      for (DiskRequest *r = m->first; r != NULL; r = r->next) {
+        if ((int) r->sector >= head &&
+            (best == NULL || r->sector < best->sector))
+          best = r;
+        if (lowest == NULL || r->sector < lowest->sector)
+          lowest = r;
+      }
+      if (best == NULL)
+        best = lowest;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  // Unlink the request, the older ones have been bypassed once more
+  DiskRequest **ptr = &m->first;
+  DiskRequest *prev = NULL;
+  while (*ptr != best) {
+    (*ptr)->bypassed++;
+    prev = *ptr;
+    ptr = &(*ptr)->next;
+  }
+  *ptr = best->next;
+  if (m->last == best)
+    m->last = prev;
+  return best;
 }
 
 //----------------------------------------------------------------------
@@ -91,13 +348,7 @@ DriverDisk::~DriverDisk() {
 
 void
 DriverDisk::ReadSector(uint32_t sectorNumber, char *data) {
-  DEBUG('d', (char *) "[sdisk] rd req\n");
-  lock->Acquire();   // only one disk I/O at a time
-  disk->ReadRequest(sectorNumber, data);
-  DEBUG('d', (char *) "[sdisk] rd req: wait irq\n");
-  semaphore->P();   // wait for interrupt
-  DEBUG('d', (char *) "[sdisk] rd req: wait irq OK\n");
-  lock->Release();
+  ReadSectors(sectorNumber, 1, &data);
 }
 
 //----------------------------------------------------------------------
@@ -112,24 +363,158 @@ DriverDisk::ReadSector(uint32_t sectorNumber, char *data) {
 
 void
 DriverDisk::WriteSector(uint32_t sectorNumber, char *data) {
-  DEBUG('d', (char *) "[sdisk] wr req\n");
-  lock->Acquire();   // only one disk I/O at a time
-  disk->WriteRequest(sectorNumber, data);
-  DEBUG('d', (char *) "[sdisk] wr req: wait irq...\n");
-  semaphore->P();   // wait for interrupt
-  DEBUG('d', (char *) "[sdisk] wr req: wait irq OK\n");
-  lock->Release();
+  WriteSectors(sectorNumber, 1, &data);
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::ReadSectors
+/*! 	Read a run of consecutive disk sectors with a single request.
+//	Return only after the data has been read.
+//
+//	\param sectorNumber the first disk sector to read
+//	\param count the number of sectors
+//	\param data the buffers to hold the contents of the sectors
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::ReadSectors(uint32_t sectorNumber, int count, char **data) {
+  DiskRequest req;
+  DEBUG('d', (char *) "[%s] rd req, %d sectors\n", name, count);
+  req.sector = sectorNumber;
+  req.count = count;
+  req.data = data;
+  req.writing = false;
+  Submit(&req);
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::WriteSectors
+/*! 	Write a run of consecutive disk sectors with a single request.
+//	Return only after the data has been written.
+//
+//	\param sectorNumber the first disk sector to write
+//	\param count the number of sectors
+//	\param data the new contents of the sectors
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::WriteSectors(uint32_t sectorNumber, int count, char **data) {
+  DiskRequest req;
+  DEBUG('d', (char *) "[%s] wr req, %d sectors\n", name, count);
+  req.sector = sectorNumber;
+  req.count = count;
+  req.data = data;
+  req.writing = true;
+  Submit(&req);
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::ReadSectorsAsync
+/*! 	Read a run of consecutive disk sectors with a single request,
+//	without waiting for it: the handler of the request is called by
+//	the interrupt handler once the data has been read. The request
+//	must stay allocated until then.
+//
+//	\param req the request, with its sector, count, data, handler and
+//	arg fields filled in by the caller
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::ReadSectorsAsync(DiskRequest *req) {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  DEBUG('d', (char *) "[%s] async rd req, %d sectors\n", name, req->count);
+  req->writing = false;
+  req->waiter = NULL;
+  Queue(req);
+  g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::Sync
+/*! 	Make the sectors written so far reach the UNIX file holding the
+//	disk (see Disk::Sync).
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::Sync() {
+  for (int i = 0; i < numMembers; i++)
+    members[i].disk->Sync();
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::WriteImage
+/*! 	Write a run of consecutive sectors of the volume directly in the
+//	images of its disks, outside of the simulation (see
+//	Disk::WriteImage), one write per stripe unit.
+//
+//	\param sectorNumber the first sector to write
+//	\param count the number of sectors
+//	\param data the new contents of the sectors, count sectors
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::WriteImage(uint32_t sectorNumber, int count, char *data) {
+  int member;
+  uint32_t sector;
+  for (int i = 0, n; i < count; i += n) {
+    MapSector(sectorNumber + i, &member, &sector);
+    n = (numMembers == 1) ? count : stripe - (sectorNumber + i) % stripe;
+    if (n > count - i)
+      n = count - i;
+    members[member].disk->WriteImage(sector, n, data + i * g_cfg->SectorSize);
+  }
 }
 
 //----------------------------------------------------------------------
 // DriverDisk::RequestDone
-/*! 	Disk interrupt handler. Wake up any thread waiting for the disk
-//	request to finish.
+/*! 	Disk interrupt handler. Complete the request that finished, or
+//	the striped request it is the last part of, and send the next
+//	queued requests to its disk.
+//
+//	\param req the request that finished
+*/
+//----------------------------------------------------------------------
+
+void
+DriverDisk::RequestDone(DiskRequest *req) {
+  DiskMember *m = &members[req->member];
+  ASSERT(m->inFlight > 0);
+  DEBUG('d', (char *) "[%s] req %d done\n", name, req->sector);
+  m->inFlight--;
+
+  DiskRequest *parent = req->parent;
+  if (parent == NULL)
+    Complete(req);
+  else if (--parent->pending == 0) {
+    delete[] parent->parts;   // req included
+    delete[] parent->partData;
+    Complete(parent);
+  }
+
+  DiskRequest *next;
+  while (m->inFlight < m->disk->MaxRequests() && (next = PickNext(m)) != NULL)
+    Start(m, next);
+}
+
+//----------------------------------------------------------------------
+// DriverDisk::Complete
+/*! 	Wake up the thread waiting for a request that finished, or call
+//	its handler if it is asynchronous.
+//
+//	\param req the request
 */
 //----------------------------------------------------------------------
 
 void
-DriverDisk::RequestDone() {
-  DEBUG('d', (char *) "[sdisk] req done\n");
-  semaphore->V();
+DriverDisk::Complete(DiskRequest *req) {
+  req->done = true;
+  if (req->waiter != NULL)
+    g_scheduler->ReadyToRun(req->waiter);
+  else
+    (*req->handler)(req->arg);   // may free the request
 }
@@ -26,8 +26,47 @@
 #include "kernel/synch.h"
 #include "machine/disk.h"
 
-class Semaphore;
-class Lock;
+class Thread;
+
+//! Number of younger requests that may be served before an old one
+#define DISK_MAX_BYPASS 16
+
+/*! \brief Defines a request waiting in the queue of a disk driver
+*/
+class DiskRequest {
+public:
+  uint32_t sector;     //!< first sector to read or write
+  int count;           //!< number of consecutive sectors
+  char **data;         //!< buffers to read into or write from, one per
+                       //!< sector
+  bool writing;        //!< write (true) or read (false) request
+  bool done;           //!< set by the interrupt handler
+  int bypassed;        //!< younger requests served before this one
+  Thread *waiter;      //!< thread waiting for the request, NULL for an
+                       //!< asynchronous request
+  VoidFunctionPtr handler;   //!< called when an asynchronous request is
+                             //!< done, with interrupts disabled
+  int64_t arg;               //!< argument of the handler
+  DiskRequest *next;   //!< next request, in arrival order
+
+  // Striping (filled in by the driver)
+  int member;            //!< member disk serving the request
+  DiskRequest *parent;   //!< request of the volume this one is a part
+                         //!< of, NULL if none
+  DiskRequest *parts;    //!< requests to the member disks, one per member
+  char **partData;       //!< buffers of the parts
+  int pending;           //!< parts not done yet
+};
+
+/*! \brief Defines a disk of the volume of a disk driver
+*/
+class DiskMember {
+public:
+  Disk *disk;           //!< the disk
+  int inFlight;         //!< requests in progress on the disk
+  DiskRequest *first;   //!< queued requests, oldest first
+  DiskRequest *last;    //!< last queued request
+};
 
 /*! \brief Defines a "synchronous" disk abstraction.
 //
@@ -35,18 +74,30 @@ class Lock;
 // device -- requests to read or write portions of the disk (sectors)
 // return immediately, and an interrupt occurs later to signal that the
 // operation completed.  (Also, the physical characteristics of the
-// disk device assume that only one operation can be requested at a
-// time).
+// disk device limit the number of operations requested at a time: one
+// for a hard disk, SsdQueueDepth for an SSD).
 //
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
-// returning.
+// returning. The requests made while the disk is busy are queued, and
+// the interrupt handler sends the next one to the disk, chosen by the
+// disk scheduling policy (DISK_* in config.h) to reduce seeks. An SSD
+// is kept busy with up to its queue depth of requests, which complete
+// in any order.
+//
+// The driver may also serve a volume striped over several disks
+// (RAID-0): the sectors of the volume are dealt out to the disks by
+// stripes of g_cfg->StripeSectors sectors, and a request is split in
+// one request per disk it touches, all served in parallel, each disk
+// having its own queue. It completes with the last of its parts.
 */
 class DriverDisk {
 public:
-  DriverDisk(char *sem_name, char *lock_name, Disk *theDisk);
+  DriverDisk(char *name, Disk **disks, int numDisks);
   // Constructor. Initializes the disk
-  // driver by initializing the raw Disk.
+  // driver of the volume striped over
+  // numDisks raw disks (a single one if
+  // numDisks is 1).
   ~DriverDisk();   // Destructor. De-allocate the driver data
 
   void ReadSector(uint32_t sectorNumber, char *data);
@@ -55,20 +106,52 @@ public:
   // or written.
   void WriteSector(uint32_t sectorNumber, char *data);
 
-  void RequestDone();   // Called by the disk device interrupt
-                        // handler, to signal that the
-                        // current disk operation is complete.
+  void ReadSectors(uint32_t sectorNumber, int count, char **data);
+  // Read/write a run of consecutive
+  // sectors with a single disk request,
+  // data[i] being the buffer of sector
+  // sectorNumber + i.
+  void WriteSectors(uint32_t sectorNumber, int count, char **data);
+
+  void ReadSectorsAsync(DiskRequest *req);
+  // Queue a read request filled in by
+  // the caller (sector, count, data,
+  // handler, arg) and return at once,
+  // the handler is called when it is
+  // done.
+
+  void Sync();   // Make the written sectors reach the disk image
+
+  void WriteImage(uint32_t sectorNumber, int count, char *data);
+  // Write a run of sectors directly in
+  // the disk images (bulk import, see
+  // Disk::WriteImage)
+
+  void RequestDone(DiskRequest *req);   // Called by the disk device
+                                        // interrupt handler, to signal
+                                        // that a disk operation is
+                                        // complete.
 
 private:
-  Semaphore *semaphore; /*!< To synchronize requesting thread
-                             with the interrupt handler
-                        */
-  Lock *lock;           /*!< Mutual exclusion on the disk device
-                         */
-  Disk *disk;           /* The disk */
+  void Submit(DiskRequest *req);   // queue a request and wait for it
+  void Queue(DiskRequest *req);    // queue a request
+  void Split(DiskRequest *req);    // queue the parts of a striped request
+  void QueueOn(DiskMember *m, DiskRequest *req);   // queue on a disk
+  void Start(DiskMember *m, DiskRequest *req);     // send to a disk
+  DiskRequest *PickNext(DiskMember *m);   // remove the next request
+                                          // to serve
+  void Complete(DiskRequest *req);        // signal the end of a request
+  void MapSector(uint32_t sector, int *member, uint32_t *memberSector);
+  // disk and sector of a sector of
+  // the volume
+
+  char *name;              /*!< Name of the driver (debugging) */
+  DiskMember *members;     /*!< The disks of the volume */
+  int numMembers;          /*!< Number of disks */
+  int stripe;              /*!< Sectors of a stripe unit */
 };
 
-void DiskRequestDone();
-void DiskSwapRequestDone();
+void DiskRequestDone(int64_t req);
+void DiskSwapRequestDone(int64_t req);
 
 #endif   // SYNCHDISK_H
@@ -0,0 +1,577 @@
+/*! \file bufcache.cc
+//  \brief Routines of the sector buffer cache
+//
+//      Reads are served from memory when the sector is cached; on a
+//      miss, a buffer is taken with the clock algorithm and filled from
+//      the disk. Whole-sector writes only update the buffer in
+//      write-back mode, and the disk as well in write-through mode.
+//
+//      The metadata sectors written through the journal are cached
+//      clean, the journal writes them to the disk: a sector read from
+//      the disk takes the contents the journal holds for it, if any.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "filesys/bufcache.h"
+#include "drivers/drvDisk.h"
+#include "filesys/journal.h"
+#include "kernel/msgerror.h"
+#include "kernel/scheduler.h"
+#include "kernel/synch.h"
+#include "kernel/thread.h"
+#include "machine/machine.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+/*! 	Create an empty buffer cache.
+//
+//	\param theDriver the disk driver the sectors are read from
+//	\param size the number of buffers (0 disables the cache)
+//	\param back true for write-back mode, false for write-through
+*/
+//----------------------------------------------------------------------
+BufferCache::BufferCache(DriverDisk *theDriver, int size, bool back) {
+  driver = theDriver;
+  numBuffers = size;
+  writeBack = back;
+  hand = 0;
+  readsInFlight = 0;
+  drainer = NULL;
+
+  uint32_t numBuckets = 1;
+  while (numBuckets < 2 * (uint32_t) numBuffers)
+    numBuckets <<= 1;
+  hashMask = numBuckets - 1;
+  hashTable = new CacheBuffer *[numBuckets];
+  for (uint32_t i = 0; i < numBuckets; i++)
+    hashTable[i] = NULL;
+
+  buffers = new CacheBuffer[numBuffers];
+  data = new char[numBuffers * g_cfg->SectorSize];
+  for (int i = 0; i < numBuffers; i++) {
+    buffers[i].sector = INVALID_SECTOR;
+    buffers[i].data = &data[i * g_cfg->SectorSize];
+    buffers[i].valid = false;
+    buffers[i].dirty = false;
+    buffers[i].referenced = false;
+    buffers[i].pins = 0;
+    buffers[i].reading = false;
+    buffers[i].waiter = NULL;
+    buffers[i].lock = new Lock((char *) "buffer cache");
+    buffers[i].hashNext = NULL;
+  }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+/*! 	De-allocate the buffer cache. Dirty buffers are lost: Flush has
+//	to be called while threads can still wait for the disk.
+*/
+//----------------------------------------------------------------------
+BufferCache::~BufferCache() {
+  for (int i = 0; i < numBuffers; i++)
+    delete buffers[i].lock;
+  delete[] buffers;
+  delete[] data;
+  delete[] hashTable;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::HashInsert, HashRemove
+/*! 	Add or remove a buffer from the bucket of its sector.
+//
+//	\param buf the buffer
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::HashInsert(CacheBuffer *buf) {
+  CacheBuffer **bucket = &hashTable[buf->sector & hashMask];
+  buf->hashNext = *bucket;
+  *bucket = buf;
+}
+
+void
+BufferCache::HashRemove(CacheBuffer *buf) {
+  CacheBuffer **ptr = &hashTable[buf->sector & hashMask];
+  while (*ptr != buf) {
+    ASSERT(*ptr != NULL);
+    ptr = &(*ptr)->hashNext;
+  }
+  *ptr = buf->hashNext;
+  buf->hashNext = NULL;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Victim
+/*! 	Choose the buffer to reuse with the clock algorithm: the first
+//	buffer not pinned and not referenced since the last pass.
+//
+//	\return the buffer, or NULL if all buffers are pinned
+*/
+//----------------------------------------------------------------------
+CacheBuffer *
+BufferCache::Victim() {
+  for (int n = 0; n < 2 * numBuffers; n++) {
+    CacheBuffer *buf = &buffers[hand];
+    hand = (hand + 1) % numBuffers;
+    if (buf->pins > 0)
+      continue;
+    if (buf->referenced) {
+      buf->referenced = false;
+      continue;
+    }
+    return buf;
+  }
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+// FromJournal
+/*! 	Replace the contents of a sector read from the disk by the ones
+//	the metadata journal holds for it, not on the disk yet.
+//
+//	\param sectorNumber the sector
+//	\param data the contents read
+*/
+//----------------------------------------------------------------------
+static void
+FromJournal(uint32_t sectorNumber, char *data) {
+  if (g_journal != NULL)
+    g_journal->Overlay(sectorNumber, data);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Lookup
+/*! 	Find the buffer holding a sector in the hash table.
+//
+//	\param sectorNumber the sector
+//	\return the buffer, or NULL if the sector is not cached
+*/
+//----------------------------------------------------------------------
+CacheBuffer *
+BufferCache::Lookup(uint32_t sectorNumber) {
+  CacheBuffer *buf;
+  for (buf = hashTable[sectorNumber & hashMask]; buf != NULL;
+       buf = buf->hashNext)
+    if (buf->sector == (int32_t) sectorNumber)
+      break;
+  return buf;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetBuffer
+/*! 	Find the buffer holding a sector, or take one with the clock
+//	algorithm (writing its old contents back if dirty). The buffer is
+//	returned pinned and locked, its contents are not valid if it has
+//	just been taken.
+//
+//	Counts a hit or a miss in the statistics.
+//
+//	\param sectorNumber the sector
+//	\return the buffer, or NULL if all buffers are pinned
+*/
+//----------------------------------------------------------------------
+CacheBuffer *
+BufferCache::GetBuffer(uint32_t sectorNumber) {
+  CacheBuffer *buf = Lookup(sectorNumber);
+
+  if (buf != NULL) {
+    buf->pins++;
+    buf->lock->Acquire();   // wait for a read in progress
+    WaitRead(buf);
+    buf->referenced = true;
+    g_stats->incrCacheHits();
+    return buf;
+  }
+
+  g_stats->incrCacheMisses();
+  buf = Victim();
+  if (buf == NULL)
+    return NULL;
+
+  // Make the buffer hold the new sector before blocking, so that the
+  // threads looking for it wait on its lock
+  int32_t oldSector = buf->sector;
+  bool oldDirty = buf->valid && buf->dirty;
+  buf->pins++;
+  buf->lock->Acquire();
+  if (oldSector != INVALID_SECTOR)
+    HashRemove(buf);
+  buf->sector = sectorNumber;
+  buf->valid = false;
+  buf->dirty = false;
+  buf->referenced = true;
+  HashInsert(buf);
+
+  if (oldDirty)
+    driver->WriteSector(oldSector, buf->data);
+  return buf;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::PutBuffer
+/*! 	Release a buffer returned by GetBuffer.
+//
+//	\param buf the buffer
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::PutBuffer(CacheBuffer *buf) {
+  buf->lock->Release();
+  buf->pins--;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WaitRead
+/*! 	Wait until the read-ahead filling a buffer is done. Since the
+//	caller holds the lock of the buffer, it is the only thread that can
+//	be waiting for it.
+//
+//	\param buf the buffer, locked by the current thread
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::WaitRead(CacheBuffer *buf) {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  while (buf->reading) {
+    buf->waiter = g_current_thread;
+    g_current_thread->Sleep();
+  }
+  g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSector
+/*! 	Read the contents of a sector, from its buffer if cached.
+//
+//	\param sectorNumber the disk sector to read
+//	\param into the buffer to hold the contents of the disk sector
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::ReadSector(uint32_t sectorNumber, char *into) {
+  CacheBuffer *buf = (numBuffers > 0) ? GetBuffer(sectorNumber) : NULL;
+  if (buf == NULL) {
+    driver->ReadSector(sectorNumber, into);
+    FromJournal(sectorNumber, into);
+    return;
+  }
+  if (!buf->valid) {
+    driver->ReadSector(sectorNumber, buf->data);
+    FromJournal(sectorNumber, buf->data);
+    buf->valid = true;
+  }
+  memcpy(into, buf->data, g_cfg->SectorSize);
+  PutBuffer(buf);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSector
+/*! 	Write the contents of a sector into its buffer, and to the
+//	disk in write-through mode.
+//
+//	\param sectorNumber the disk sector to write
+//	\param from the new contents of the disk sector
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::WriteSector(uint32_t sectorNumber, char *from) {
+  CacheBuffer *buf = (numBuffers > 0) ? GetBuffer(sectorNumber) : NULL;
+  if (buf == NULL) {
+    driver->WriteSector(sectorNumber, from);
+    return;
+  }
+  memcpy(buf->data, from, g_cfg->SectorSize);
+  buf->valid = true;
+  if (writeBack)
+    buf->dirty = true;
+  else
+    driver->WriteSector(sectorNumber, buf->data);
+  PutBuffer(buf);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSectors
+/*! 	Read the contents of a run of consecutive sectors. The cached
+//	sectors are copied from their buffers, each run of missing
+//	sectors is read with a single disk request, then cached.
+//
+//	\param sectorNumber the first disk sector to read
+//	\param count the number of sectors
+//	\param into the buffer to hold the contents of the sectors
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::ReadSectors(uint32_t sectorNumber, int count, char *into) {
+  int size = g_cfg->SectorSize;
+  int i = 0;
+  while (i < count) {
+    if (Lookup(sectorNumber + i) != NULL) {
+      ReadSector(sectorNumber + i, &into[i * size]);
+      i++;
+      continue;
+    }
+
+    int n = 1;
+    while (i + n < count && Lookup(sectorNumber + i + n) == NULL)
+      n++;
+    char *bufs[n];
+    for (int k = 0; k < n; k++)
+      bufs[k] = &into[(i + k) * size];
+    driver->ReadSectors(sectorNumber + i, n, bufs);
+    for (int k = 0; k < n; k++)
+      FromJournal(sectorNumber + i + k, bufs[k]);
+
+    // Cache the sectors read, unless a thread cached them meanwhile:
+    // the buffer is then more recent than the disk
+    for (int k = 0; k < n && numBuffers > 0; k++) {
+      CacheBuffer *buf = GetBuffer(sectorNumber + i + k);
+      if (buf == NULL)
+        break;
+      if (buf->valid)
+        memcpy(bufs[k], buf->data, size);
+      else {
+        memcpy(buf->data, bufs[k], size);
+        buf->valid = true;
+      }
+      PutBuffer(buf);
+    }
+    i += n;
+  }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSectors
+/*! 	Write the contents of a run of consecutive sectors into their
+//	buffers. In write-through mode, the run is also written to the
+//	disk with a single request, while holding the buffers, so that
+//	the disk receives the writes in the same order as the cache.
+//
+//	\param sectorNumber the first disk sector to write
+//	\param count the number of sectors
+//	\param from the new contents of the sectors
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::WriteSectors(uint32_t sectorNumber, int count, char *from) {
+  int size = g_cfg->SectorSize;
+  if (writeBack) {
+    for (int i = 0; i < count; i++)
+      WriteSector(sectorNumber + i, &from[i * size]);
+    return;
+  }
+
+  // The buffers are taken in increasing sector order, so that two
+  // threads writing runs cannot deadlock
+  CacheBuffer *held[count];
+  char *bufs[count];
+  for (int i = 0; i < count; i++) {
+    bufs[i] = &from[i * size];
+    held[i] = (numBuffers > 0) ? GetBuffer(sectorNumber + i) : NULL;
+    if (held[i] != NULL) {
+      memcpy(held[i]->data, bufs[i], size);
+      held[i]->valid = true;
+    }
+  }
+  driver->WriteSectors(sectorNumber, count, bufs);
+  for (int i = 0; i < count; i++)
+    if (held[i] != NULL)
+      PutBuffer(held[i]);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteLogged
+/*! 	Cache the contents of a metadata sector written through the
+//	journal. The buffer is clean, even in write-back mode: the journal
+//	writes the sector to the disk.
+//
+//	\param sectorNumber the sector
+//	\param from the new contents of the sector
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::WriteLogged(uint32_t sectorNumber, char *from) {
+  CacheBuffer *buf = (numBuffers > 0) ? GetBuffer(sectorNumber) : NULL;
+  if (buf == NULL)
+    return;
+  memcpy(buf->data, from, g_cfg->SectorSize);
+  buf->valid = true;
+  buf->dirty = false;
+  PutBuffer(buf);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadAhead
+/*! 	Start reading a run of consecutive sectors into the cache, and
+//	return without waiting for the disk: each run of sectors missing
+//	from the cache is read with a single asynchronous request, into
+//	buffers that stay pinned until it is done. The threads needing
+//	these sectors meanwhile wait for the end of the request instead of
+//	reading them again.
+//
+//	Read-ahead is a hint: it uses at most half of the buffers, and
+//	stops at the first buffer that cannot be reused without writing it
+//	back (the caller would have to wait for the write).
+//
+//	\param sectorNumber the first sector to read
+//	\param count the number of sectors
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::ReadAhead(uint32_t sectorNumber, int count) {
+  if (count > numBuffers / 2)
+    count = numBuffers / 2;
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  int i = 0;
+  while (i < count) {
+    if (Lookup(sectorNumber + i) != NULL) {
+      i++;
+      continue;
+    }
+
+    // Take the buffers of the run of missing sectors
+    char **bufs = new char *[count - i];
+    int n = 0;
+    while (i + n < count && Lookup(sectorNumber + i + n) == NULL) {
+      CacheBuffer *buf = Victim();
+      if (buf == NULL || (buf->valid && buf->dirty))
+        break;
+      if (buf->sector != INVALID_SECTOR)
+        HashRemove(buf);
+      buf->sector = sectorNumber + i + n;
+      buf->valid = false;
+      buf->dirty = false;
+      buf->referenced = true;
+      buf->pins++;
+      buf->reading = true;
+      buf->waiter = NULL;
+      HashInsert(buf);
+      bufs[n++] = buf->data;
+    }
+    if (n == 0) {
+      delete[] bufs;
+      break;
+    }
+
+    DiskRequest *req = new DiskRequest;
+    req->sector = sectorNumber + i;
+    req->count = n;
+    req->data = bufs;
+    req->handler = ReadAheadDone;
+    req->arg = (int64_t) req;
+    readsInFlight++;
+    g_stats->incrReadAheads(n);
+    driver->ReadSectorsAsync(req);
+    i += n;
+    if (i < count && Lookup(sectorNumber + i) == NULL)
+      break;   // no buffer left to fill
+  }
+  g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadAheadDone
+/*! 	Disk interrupt handler of the read-ahead requests: the buffers
+//	read become valid and are unpinned, the threads waiting for them
+//	are woken up.
+//
+//	\param arg the request, allocated by ReadAhead
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::ReadAheadDone(int64_t arg) {
+  DiskRequest *req = (DiskRequest *) arg;
+  BufferCache *cache = g_buffer_cache;
+  for (int k = 0; k < req->count; k++) {
+    // the buffer whose contents were read into
+    CacheBuffer *buf =
+        &cache->buffers[(req->data[k] - cache->data) / g_cfg->SectorSize];
+    FromJournal(buf->sector, buf->data);
+    buf->valid = true;
+    buf->reading = false;
+    buf->pins--;
+    if (buf->waiter != NULL) {
+      g_scheduler->ReadyToRun(buf->waiter);
+      buf->waiter = NULL;
+    }
+  }
+  delete[] req->data;
+  delete req;
+
+  cache->readsInFlight--;
+  if (cache->readsInFlight == 0 && cache->drainer != NULL) {
+    g_scheduler->ReadyToRun(cache->drainer);
+    cache->drainer = NULL;
+  }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush
+/*! 	Write all the dirty buffers to the disk (write-back mode), and
+//	the disk image to its UNIX file. The read-ahead requests in
+//	progress are waited for first, so that the disk is idle once the
+//	cache is flushed.
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::Flush() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  while (readsInFlight > 0) {
+    drainer = g_current_thread;
+    g_current_thread->Sleep();
+  }
+  g_machine->interrupt->SetStatus(oldLevel);
+
+  for (int i = 0; i < numBuffers; i++) {
+    CacheBuffer *buf = &buffers[i];
+    if (!buf->valid || !buf->dirty)
+      continue;
+    buf->pins++;
+    buf->lock->Acquire();
+    if (buf->valid && buf->dirty) {
+      buf->dirty = false;
+      driver->WriteSector(buf->sector, buf->data);
+    }
+    PutBuffer(buf);
+  }
+  driver->Sync();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Discard
+/*! 	Forget the cached copies of a run of sectors, whose contents on
+//	the disk have been replaced without going through the cache (bulk
+//	import of files at boot). Their buffers are reused first.
+//
+//	\param sectorNumber the first sector
+//	\param count the number of sectors
+*/
+//----------------------------------------------------------------------
+void
+BufferCache::Discard(uint32_t sectorNumber, int count) {
+  for (int i = 0; i < count; i++) {
+    CacheBuffer *buf = Lookup(sectorNumber + i);
+    if (buf == NULL)
+      continue;
+    ASSERT(buf->pins == 0);
+    HashRemove(buf);
+    buf->sector = INVALID_SECTOR;
+    buf->valid = buf->dirty = buf->referenced = false;
+  }
+}
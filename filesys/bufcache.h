@@ -0,0 +1,134 @@
+/*! \file bufcache.h
+    \brief Data structures of the sector buffer cache
+
+        The buffer cache keeps recently used disk sectors in memory,
+        between the file system (OpenFile, FileHeader) and the disk
+        driver, so that sectors read again and again (file headers,
+        directories, free map) do not pay the disk latency each time.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef BUFCACHE_H
+#define BUFCACHE_H
+
+#include "kernel/copyright.h"
+#include "kernel/system.h"
+#include "utility/utility.h"
+
+class Lock;
+class Thread;
+
+/*! \brief Defines a buffer of the cache, holding one disk sector
+//
+// A buffer is pinned while a thread uses it, so that it cannot be
+// evicted, and its lock serializes the threads using it (in particular
+// while its contents are read from the disk). A buffer filled by an
+// asynchronous read-ahead stays pinned until the read is done, the
+// thread holding its lock meanwhile waits for the end of the read.
+*/
+class CacheBuffer {
+public:
+  int32_t sector;          //!< sector held, INVALID_SECTOR if none
+  char *data;              //!< contents of the sector
+  bool valid;              //!< data holds the contents of sector
+  bool dirty;              //!< data not written to disk yet (write-back)
+  bool referenced;         //!< used since the last pass of the clock
+  int pins;                //!< number of threads using the buffer
+  bool reading;            //!< a read-ahead is filling data
+  Thread *waiter;          //!< thread waiting for the end of the read-ahead
+  Lock *lock;              //!< serializes the threads using the buffer
+  CacheBuffer *hashNext;   //!< next buffer in the same hash bucket
+};
+
+/*! \brief Defines the sector buffer cache
+//
+// The sectors are found through a hash table indexed by sector number,
+// and the clock algorithm chooses the buffer to reuse among the ones
+// that are not pinned. In write-through mode, writes go to the disk at
+// once; in write-back mode, dirty buffers are written when evicted or
+// when Flush is called.
+*/
+class BufferCache {
+public:
+  //! Create a cache of numBuffers sectors in front of driver
+  BufferCache(DriverDisk *driver, int numBuffers, bool writeBack);
+
+  //! De-allocate the cache (Flush must have been called before)
+  ~BufferCache();
+
+  //! Read a sector, from the cache if present
+  void ReadSector(uint32_t sectorNumber, char *data);
+
+  //! Write a sector, through the cache
+  void WriteSector(uint32_t sectorNumber, char *data);
+
+  //! Read a run of consecutive sectors, missing ones in a single request
+  void ReadSectors(uint32_t sectorNumber, int count, char *data);
+
+  //! Write a run of consecutive sectors, through the cache
+  void WriteSectors(uint32_t sectorNumber, int count, char *data);
+
+  //! Cache a metadata sector written through the journal
+  void WriteLogged(uint32_t sectorNumber, char *data);
+
+  //! Start reading a run of consecutive sectors into the cache, without
+  //! waiting for the disk
+  void ReadAhead(uint32_t sectorNumber, int count);
+
+  //! Write all the dirty buffers to disk, and the disk to its UNIX file
+  void Flush();
+
+  //! Drop the cached copies of a run of sectors written behind the cache
+  void Discard(uint32_t sectorNumber, int count);
+
+private:
+  //! Find the buffer of a sector, NULL if not cached
+  CacheBuffer *Lookup(uint32_t sectorNumber);
+
+  //! Find or allocate the buffer of a sector, returned pinned and locked
+  CacheBuffer *GetBuffer(uint32_t sectorNumber);
+
+  //! Unlock and unpin a buffer returned by GetBuffer
+  void PutBuffer(CacheBuffer *buf);
+
+  //! Wait until the read-ahead filling a buffer is done
+  void WaitRead(CacheBuffer *buf);
+
+  //! Disk interrupt handler of the read-ahead requests
+  static void ReadAheadDone(int64_t arg);
+
+  //! Choose a buffer to reuse (clock algorithm), NULL if all are pinned
+  CacheBuffer *Victim();
+
+  //! Add and remove buffers from the hash table
+  void HashInsert(CacheBuffer *buf);
+  void HashRemove(CacheBuffer *buf);
+
+  DriverDisk *driver;       //!< disk driver the sectors come from
+  int numBuffers;           //!< number of buffers (0: no caching)
+  bool writeBack;           //!< write-back (true) or write-through mode
+  CacheBuffer *buffers;     //!< the buffers
+  char *data;               //!< storage of the buffers contents
+  CacheBuffer **hashTable;  //!< heads of the hash buckets
+  uint32_t hashMask;        //!< number of buckets - 1 (power of two)
+  int hand;                 //!< clock hand, index in buffers
+  int readsInFlight;        //!< read-ahead requests not done yet
+  Thread *drainer;          //!< thread waiting for them to be done
+};
+
+#endif   // BUFCACHE_H
@@ -0,0 +1,179 @@
+/*! \file dcache.cc
+//  \brief Routines of the path name lookup cache
+//
+//      Both successful and failed lookups are cached, so that opening
+//      a file by a deep path name, or checking that a name is free
+//      before creating it, needs no disk access when the entries are
+//      in the cache.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "filesys/dcache.h"
+#include "kernel/msgerror.h"
+#include "kernel/system.h"
+#include "utility/stats.h"
+
+//! Hash a (directory, name) pair into a bucket number
+static unsigned int
+HashDentry(int parent, char *name) {
+  unsigned int h = 2166136261u ^ (unsigned int) parent;
+  for (int i = 0; i < FILENAMEMAXLEN && name[i] != '\0'; i++)
+    h = (h ^ (unsigned char) name[i]) * 16777619u;
+  return h % (2 * DENTRY_CACHE_SIZE);
+}
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+//! 	Create an empty dentry cache.
+//----------------------------------------------------------------------
+DentryCache::DentryCache() {
+  for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+    entries[i].valid = false;
+    entries[i].referenced = false;
+    entries[i].hashNext = NULL;
+  }
+  for (int i = 0; i < 2 * DENTRY_CACHE_SIZE; i++)
+    hashTable[i] = NULL;
+  hand = 0;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::~DentryCache
+//! 	De-allocate the dentry cache.
+//----------------------------------------------------------------------
+DentryCache::~DentryCache() {}
+
+//----------------------------------------------------------------------
+// DentryCache::Find
+/*! 	Find the entry of a name in the hash table.
+//
+//	\param parent the sector of the directory header
+//	\param name the name in the directory
+//	\return the entry, NULL if the name is not cached
+*/
+//----------------------------------------------------------------------
+Dentry *
+DentryCache::Find(int parent, char *name) {
+  for (Dentry *d = hashTable[HashDentry(parent, name)]; d != NULL;
+       d = d->hashNext)
+    if (d->parent == parent && !strncmp(d->name, name, FILENAMEMAXLEN))
+      return d;
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Unlink
+/*! 	Remove a valid entry from its hash bucket, and invalidate it.
+//
+//	\param d the entry
+*/
+//----------------------------------------------------------------------
+void
+DentryCache::Unlink(Dentry *d) {
+  Dentry **ptr = &hashTable[HashDentry(d->parent, d->name)];
+  while (*ptr != d) {
+    ASSERT(*ptr != NULL);
+    ptr = &(*ptr)->hashNext;
+  }
+  *ptr = d->hashNext;
+  d->hashNext = NULL;
+  d->valid = false;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+/*! 	Look up a name in the cache.
+//
+//	\param parent the sector of the directory header
+//	\param name the name in the directory
+//	\param sector is set to the sector of the file header, or ERROR if
+//	the name is known not to exist
+//	\param isDir is set to true if the file is a directory
+//	\return true if the name is cached
+*/
+//----------------------------------------------------------------------
+bool
+DentryCache::Lookup(int parent, char *name, int *sector, bool *isDir) {
+  Dentry *d = Find(parent, name);
+  if (d == NULL) {
+    g_stats->incrDentryMisses();
+    return false;
+  }
+  g_stats->incrDentryHits();
+  d->referenced = true;
+  *sector = d->sector;
+  *isDir = d->isDir;
+  return true;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+/*! 	Remember the result of looking up a name, replacing the previous
+//	one if any. Called after each lookup in a directory and each
+//	change of a directory.
+//
+//	\param parent the sector of the directory header
+//	\param name the name in the directory
+//	\param sector the sector of the file header, ERROR if the name
+//	does not exist
+//	\param isDir true if the file is a directory
+*/
+//----------------------------------------------------------------------
+void
+DentryCache::Enter(int parent, char *name, int sector, bool isDir) {
+  Dentry *d = Find(parent, name);
+
+  if (d == NULL) {
+    // Take an entry with the clock algorithm
+    for (;;) {
+      d = &entries[hand];
+      hand = (hand + 1) % DENTRY_CACHE_SIZE;
+      if (!d->valid)
+        break;
+      if (!d->referenced) {
+        Unlink(d);
+        break;
+      }
+      d->referenced = false;
+    }
+    d->valid = true;
+    d->parent = parent;
+    strncpy(d->name, name, FILENAMEMAXLEN);
+    d->name[FILENAMEMAXLEN] = '\0';
+    unsigned int bucket = HashDentry(parent, d->name);
+    d->hashNext = hashTable[bucket];
+    hashTable[bucket] = d;
+  }
+
+  d->sector = sector;
+  d->isDir = isDir;
+  d->referenced = true;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::PurgeDirectory
+/*! 	Forget all the names looked up in a directory being removed, as
+//	its header sector may be reused by another directory.
+//
+//	\param parent the sector of the directory header
+*/
+//----------------------------------------------------------------------
+void
+DentryCache::PurgeDirectory(int parent) {
+  for (int i = 0; i < DENTRY_CACHE_SIZE; i++)
+    if (entries[i].valid && entries[i].parent == parent)
+      Unlink(&entries[i]);
+}
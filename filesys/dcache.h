@@ -0,0 +1,80 @@
+/*! \file dcache.h
+    \brief Data structures of the path name lookup cache
+
+        The dentry cache remembers the result of looking up a name in
+        a directory: the sector of the file header found, or the fact
+        that the name does not exist. Path names are then resolved
+        without reading the directories on the way in the common case.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "filesys/directory.h"
+#include "kernel/copyright.h"
+#include "utility/utility.h"
+
+//! Number of entries of the dentry cache
+#define DENTRY_CACHE_SIZE 256
+
+/*! \brief Defines an entry of the dentry cache
+*/
+class Dentry {
+public:
+  bool valid;                      //!< Does the entry hold a name?
+  bool referenced;                 //!< Used since the last pass of the clock
+  int parent;                      //!< Sector of the directory header
+  char name[FILENAMEMAXLEN + 1];   //!< Name looked up in the directory
+  int sector;                      //!< Sector of the file header, ERROR if
+                                   //!< the name does not exist
+  bool isDir;                      //!< Is the file a directory?
+  Dentry *hashNext;                //!< Next entry in the same hash bucket
+};
+
+/*! \brief Defines the dentry cache
+//
+// The entries are found through a hash table indexed by (directory,
+// name), and replaced with the clock algorithm. The file system keeps
+// them up to date when it adds or removes names. As the kernel is not
+// preemptive and the cache never blocks, no lock is needed.
+*/
+class DentryCache {
+public:
+  DentryCache();    //!< Create an empty cache
+  ~DentryCache();   //!< De-allocate the cache
+
+  //! Look a name up, return false if it is not cached
+  bool Lookup(int parent, char *name, int *sector, bool *isDir);
+
+  //! Remember the result of a lookup (sector ERROR if not found)
+  void Enter(int parent, char *name, int sector, bool isDir);
+
+  //! Forget the names of a directory being removed
+  void PurgeDirectory(int parent);
+
+private:
+  Dentry *Find(int parent, char *name);   //!< Find an entry, NULL if none
+  void Unlink(Dentry *d);                 //!< Remove an entry from its bucket
+
+  Dentry entries[DENTRY_CACHE_SIZE];           //!< The entries
+  Dentry *hashTable[2 * DENTRY_CACHE_SIZE];    //!< Heads of the buckets
+  int hand;                                    //!< Clock hand
+};
+
+#endif   // DCACHE_H
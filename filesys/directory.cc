@@ -1,20 +1,20 @@
 /*! \file directory.cc
 //  \brief Routines to manage a directory of file names.
 //
-//	The directory is a table of fixed length entries; each
+//	The directory is a hash table of fixed length entries; each
 //	entry represents a single file, and contains the file name,
 //	and the location of the file header on disk.  The fixed size
 //	of each directory entry means that we have the restriction
 //	of a fixed maximum size for file names.
 //
 //	The constructor initializes an empty directory of a certain size;
-//	we use ReadFrom/WriteBack to fetch the contents of the directory
+//	we use FetchFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
+//	Only the entries probed by a search are read, and only the
+//	modified ones are written.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//	Fixing this is one of the parts to the assignment.
+//	The table doubles when it becomes 3/4 full, so the directory
+//	can hold any number of files.
 //
  * -----------------------------------------------------
  * This file is part of the Nachos-RiscV distribution
@@ -39,6 +39,24 @@
 #include "utility/config.h"
 #include "utility/utility.h"
 
+//! Hash a file name (FNV-1a)
+static unsigned int
+HashName(char *name) {
+  unsigned int h = 2166136261u;
+  for (int i = 0; i < FILENAMEMAXLEN && name[i] != '\0'; i++)
+    h = (h ^ (unsigned char) name[i]) * 16777619u;
+  return h;
+}
+
+//! Bytes of the buffer of a table of size entries: the entries, then
+//! their loaded and dirty flags
+#define TableBytes(size)                                                       \
+  ((size) * (sizeof(DirectoryEntry) + 2 * sizeof(bool)))
+
+//! Offset in the directory file of entry i
+#define EntryOffset(i)                                                         \
+  ((int) (sizeof(DirectoryHeader) + (i) * sizeof(DirectoryEntry)))
+
 //----------------------------------------------------------------------
 // Directory::Directory
 /*! 	Initialize a directory; initially, the directory is completely
@@ -46,50 +64,219 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	\param size is the number of entries in the directory
+//	\param size is the number of entries in the directory (a power
+//	of two)
 */
 //----------------------------------------------------------------------
 Directory::Directory(int size) {
-  table = new DirectoryEntry[size];
-  tableSize = size;
-  for (int i = 0; i < tableSize; i++) {
-    table[i].inUse = false;
-  }
+  table = NULL;
+  loaded = dirty = NULL;
+  source = NULL;
+  Init(size);
 }
 
 //----------------------------------------------------------------------
 // Directory::~Directory
 //! 	De-allocate directory data structure.
 //----------------------------------------------------------------------
-Directory::~Directory() { delete[] table; }
+Directory::~Directory() {
+  if (table != NULL)
+    SlabFree(table, TableBytes(header.tableSize));
+  delete source;
+}
+
+//----------------------------------------------------------------------
+// Directory::Init
+/*! 	Allocate an empty table, whose entries are all known (loaded)
+//	and to be written back. The entries and their flags share one
+//	buffer of the slab caches: the temporary directories of the path
+//	lookups reuse the same buffers, without calling the host
+//	allocator.
+//
+//	\param size is the number of entries (a power of two)
+*/
+//----------------------------------------------------------------------
+void
+Directory::Init(int size) {
+  ASSERT(size > 0 && (size & (size - 1)) == 0);
+  if (table != NULL)
+    SlabFree(table, TableBytes(header.tableSize));
+  table = (DirectoryEntry *) SlabAlloc(TableBytes(size));
+  loaded = (bool *) (table + size);
+  dirty = loaded + size;
+  header.tableSize = size;
+  header.numUsed = header.numDeleted = 0;
+  for (int i = 0; i < size; i++) {
+    table[i].inUse = false;
+    table[i].deleted = false;
+    table[i].isDir = false;
+    loaded[i] = true;
+    dirty[i] = true;
+  }
+  headerDirty = true;
+  grown = false;
+}
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-/*! 	Read the contents of the directory from disk.
+/*! 	Read the header of the directory from disk. The entries are
+//	read when needed.
 //
-//	\param file is the file containing the directory contents
+//	\param dirFile is the file containing the directory contents
 */
 //----------------------------------------------------------------------
 void
-Directory::FetchFrom(OpenFile *file) {
-  (void) file->ReadAt((char *) table, tableSize * sizeof(DirectoryEntry), 0);
+Directory::FetchFrom(OpenFile *dirFile) {
+  DirectoryHeader hdr;
+  (void) dirFile->ReadAt((char *) &hdr, sizeof(DirectoryHeader), 0);
+
+  Init(hdr.tableSize);
+  header = hdr;
+  for (int i = 0; i < header.tableSize; i++)
+    loaded[i] = dirty[i] = false;
+  headerDirty = false;
+
+  // Keep our own handle, the caller may close its file before us
+  delete source;
+  source = new OpenFile(dirFile->GetSector());
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-/*! 	Write any modifications to the directory back to disk
+/*! 	Write any modifications to the directory back to disk: the
+//	header and the modified entries, consecutive ones with a single
+//	write.
 //
-//	\param file is the file to contain the new directory contents
+//	\param dirFile is the file to contain the new directory contents
 */
 //----------------------------------------------------------------------
 void
-Directory::WriteBack(OpenFile *file) {
-  (void) file->WriteAt((char *) table, tableSize * sizeof(DirectoryEntry), 0);
+Directory::WriteBack(OpenFile *dirFile) {
+  // Another file than the one fetched gets the whole directory
+  if (source == NULL || source->GetSector() != dirFile->GetSector()) {
+    LoadAll();
+    for (int i = 0; i < header.tableSize; i++)
+      dirty[i] = true;
+    headerDirty = true;
+  }
+
+  if (headerDirty)
+    (void) dirFile->WriteAt((char *) &header, sizeof(DirectoryHeader), 0);
+  headerDirty = false;
+
+  int i = 0;
+  while (i < header.tableSize) {
+    if (!dirty[i]) {
+      i++;
+      continue;
+    }
+    int n = 1;
+    while (i + n < header.tableSize && dirty[i + n])
+      n++;
+    (void) dirFile->WriteAt((char *) &table[i], n * sizeof(DirectoryEntry),
+                            EntryOffset(i));
+    for (int k = 0; k < n; k++)
+      dirty[i + k] = false;
+    i += n;
+  }
+
+  // The file may have grown: read it with an up to date header
+  if (grown && source != NULL) {
+    delete source;
+    source = new OpenFile(dirFile->GetSector());
+  }
+  grown = false;
+}
+
+//----------------------------------------------------------------------
+// Directory::Entry
+/*! 	Get an entry of the table, reading it from the disk the first
+//	time.
+//
+//	\param i the index of the entry
+//	\return the entry
+*/
+//----------------------------------------------------------------------
+DirectoryEntry *
+Directory::Entry(int i) {
+  if (!loaded[i]) {
+    (void) source->ReadAt((char *) &table[i], sizeof(DirectoryEntry),
+                        EntryOffset(i));
+    loaded[i] = true;
+  }
+  return &table[i];
+}
+
+//----------------------------------------------------------------------
+// Directory::LoadAll
+//! 	Read all the entries of the table not read yet.
+//----------------------------------------------------------------------
+void
+Directory::LoadAll() {
+  LoadRange(0, header.tableSize);
+}
+
+//----------------------------------------------------------------------
+// Directory::LoadRange
+/*! 	Read the entries of a range of the table not read yet, each run
+//	of consecutive ones with a single read.
+//
+//	\param first the index of the first entry of the range
+//	\param count the number of entries of the range
+*/
+//----------------------------------------------------------------------
+void
+Directory::LoadRange(int first, int count) {
+  int end = first + count;
+  int i = first;
+  while (i < end) {
+    if (loaded[i]) {
+      i++;
+      continue;
+    }
+    int n = 1;
+    while (i + n < end && !loaded[i + n])
+      n++;
+    (void) source->ReadAt((char *) &table[i], n * sizeof(DirectoryEntry),
+                        EntryOffset(i));
+    for (int k = 0; k < n; k++)
+      loaded[i + k] = true;
+    i += n;
+  }
+}
+
+//----------------------------------------------------------------------
+// Directory::Grow
+/*! 	Double the size of the table, inserting again the entries in use
+//	(the deleted ones are dropped). The whole table is written back.
+*/
+//----------------------------------------------------------------------
+void
+Directory::Grow() {
+  LoadAll();
+  int oldSize = header.tableSize;
+  DirectoryEntry *oldTable = table;
+  table = NULL;   // kept by Init
+  Init(2 * oldSize);
+  grown = true;
+
+  unsigned int mask = header.tableSize - 1;
+  for (int i = 0; i < oldSize; i++) {
+    if (!oldTable[i].inUse)
+      continue;
+    unsigned int j = HashName(oldTable[i].name) & mask;
+    while (table[j].inUse)
+      j = (j + 1) & mask;
+    table[j] = oldTable[i];
+    header.numUsed++;
+  }
+  SlabFree(oldTable, TableBytes(oldSize));
 }
 
 //----------------------------------------------------------------------
 // Directory::FindIndex
-/*! 	Look up file name in directory.
+/*! 	Look up file name in directory, probing the entries from the
+//	one given by the hash of the name, until a never used entry.
 //
 //      \return   its location in the table of directory entries,
 //                ERROR if the name isn't in the directory.
@@ -99,9 +286,15 @@ Directory::WriteBack(OpenFile *file) {
 //----------------------------------------------------------------------
 int
 Directory::FindIndex(char *name) {
-  for (int i = 0; i < tableSize; i++)
-    if (table[i].inUse && !strncmp(table[i].name, name, FILENAMEMAXLEN))
+  unsigned int mask = header.tableSize - 1;
+  unsigned int i = HashName(name) & mask;
+  for (int n = 0; n < header.tableSize; n++, i = (i + 1) & mask) {
+    DirectoryEntry *e = Entry(i);
+    if (!e->inUse && !e->deleted)
+      break;
+    if (e->inUse && !strncmp(e->name, name, FILENAMEMAXLEN))
       return i;
+  }
   return ERROR;   // name not in directory
 }
 
@@ -127,34 +320,50 @@ Directory::Find(char *name) {
 
 //----------------------------------------------------------------------
 // Directory::Add
-/*! 	Add a file into the directory.
+/*! 	Add a file into the directory, in the first free entry from the
+//	one given by the hash of the name.
 //
 //	\param name the name of the file being added
 //	\param newSector the disk sector containing the added file's header
+//	\param isDir true if the file is a directory
 //      \return NO_ERROR, ALREADY_IN_DIRECTORY or NOSPACE_IN_DIRECTORY.
 */
 //----------------------------------------------------------------------
 int
-Directory::Add(char *name, int newSector) {
+Directory::Add(char *name, int newSector, bool isDir) {
   if (FindIndex(name) != ERROR)
     return ALREADY_IN_DIRECTORY;
 
-  for (int i = 0; i < tableSize; i++) {
-    if (!table[i].inUse) {
-      table[i].inUse = true;
-      strncpy(table[i].name, name, FILENAMEMAXLEN);
-      table[i].sector = newSector;
+  if ((header.numUsed + header.numDeleted + 1) * 4 > header.tableSize * 3)
+    Grow();
+
+  unsigned int mask = header.tableSize - 1;
+  unsigned int i = HashName(name) & mask;
+  for (int n = 0; n < header.tableSize; n++, i = (i + 1) & mask) {
+    DirectoryEntry *e = Entry(i);
+    if (!e->inUse) {
+      if (e->deleted)
+        header.numDeleted--;
+      header.numUsed++;
+      e->inUse = true;
+      e->deleted = false;
+      strncpy(e->name, name, FILENAMEMAXLEN);
+      e->name[FILENAMEMAXLEN] = '\0';
+      e->sector = newSector;
+      e->isDir = isDir;
+      dirty[i] = headerDirty = true;
       return NO_ERROR;
     }
   }
 
-  // no space.  Fix when we have extensible files.
+  // no space (cannot happen, the table grows before getting full)
   return NOSPACE_IN_DIRECTORY;
 }
 
 //----------------------------------------------------------------------
 // Directory::Remove
-/*! 	Remove a file name from the directory.
+/*! 	Remove a file name from the directory. The entry is marked
+//	deleted, unless the search of a name cannot go past it.
 //
 //	\param name the file name to be removed
 //      \return NO_ERROR, or INEXIST_DIRECTORY_ERROR
@@ -165,7 +374,14 @@ Directory::Remove(char *name) {
   int i = FindIndex(name);
   if (i == ERROR)
     return INEXIST_DIRECTORY_ERROR;   // name not in directory
+
+  DirectoryEntry *next = Entry((i + 1) & (header.tableSize - 1));
   table[i].inUse = false;
+  table[i].deleted = (next->inUse || next->deleted);
+  header.numUsed--;
+  if (table[i].deleted)
+    header.numDeleted++;
+  dirty[i] = headerDirty = true;
   return NO_ERROR;
 }
 
@@ -182,7 +398,8 @@ void
 Directory::List(char *name, int depth) {
   Directory dir(g_cfg->NumDirEntries);
 
-  for (int i = 0; i < tableSize; i++) {
+  LoadAll();
+  for (int i = 0; i < header.tableSize; i++) {
     if (table[i].inUse) {
 
       /* Print a nice Tree branch dependent on the depth in the
@@ -213,6 +430,37 @@ Directory::List(char *name, int depth) {
   }
 }
 
+//----------------------------------------------------------------------
+// Directory::ReadEntries
+/*! 	Copy the entries in use of the table, from a given index. The
+//	table is read in chunks of count entries, so that only the
+//	entries gone through are read from the disk.
+//
+//	\param index the index of the first entry to look at, set to the
+//	index following the last entry copied (or to the size of the
+//	table at its end)
+//	\param entries the array receiving the entries
+//	\param count the maximum number of entries to copy
+//	\return the number of entries copied, 0 at the end of the table
+*/
+//----------------------------------------------------------------------
+int
+Directory::ReadEntries(int *index, DirectoryEntry *entries, int count) {
+  int copied = 0;
+  int i = (*index < 0) ? 0 : *index;
+  while (copied < count && i < header.tableSize) {
+    int n = count - copied;
+    if (n > header.tableSize - i)
+      n = header.tableSize - i;
+    LoadRange(i, n);
+    for (; copied < count && i < header.tableSize && loaded[i]; i++)
+      if (table[i].inUse)
+        entries[copied++] = table[i];
+  }
+  *index = i;
+  return copied;
+}
+
 //----------------------------------------------------------------------
 // Directory::Print
 /*! 	List all the file names in the directory, their FileHeader locations,
@@ -224,7 +472,8 @@ Directory::Print() {
   FileHeader hdr;
 
   printf("Directory contents:\n");
-  for (int i = 0; i < tableSize; i++) {
+  LoadAll();
+  for (int i = 0; i < header.tableSize; i++) {
     if (table[i].inUse) {
       printf("Name: %s, Sector: %" PRIu32 "\n", table[i].name, table[i].sector);
       hdr.FetchFrom(table[i].sector);
@@ -242,11 +491,36 @@ Directory::Print() {
 //----------------------------------------------------------------------
 bool
 Directory::empty() {
-  bool empti = true;
-  for (int i = 0; i < tableSize; i++) {
-    if (table[i].inUse) {
-      return false;
-    }
-  }
-  return empti;
+  return (header.numUsed == 0);
+}
+
+//----------------------------------------------------------------------
+// DirectoryStream::DirectoryStream
+/*! 	Open a directory to enumerate its entries, from the first one.
+//
+//	\param dirSector the sector of the header of the directory
+*/
+//----------------------------------------------------------------------
+DirectoryStream::DirectoryStream(int dirSector) {
+  type = DIRECTORY_TYPE;
+  sector = dirSector;
+  cursor = 0;
+}
+
+//----------------------------------------------------------------------
+// DirectoryStream::Read
+/*! 	Copy the next entries in use of the directory, and move the
+//	cursor past them.
+//
+//	\param entries the array receiving the entries
+//	\param count the maximum number of entries to copy
+//	\return the number of entries copied, 0 at the end of the directory
+*/
+//----------------------------------------------------------------------
+int
+DirectoryStream::Read(DirectoryEntry *entries, int count) {
+  OpenFile file(sector);
+  Directory directory(g_cfg->NumDirEntries);
+  directory.FetchFrom(&file);
+  return directory.ReadEntries(&cursor, entries, count);
 }
@@ -44,6 +44,10 @@
 class DirectoryEntry {
 public:
   bool inUse;                    //!< Is this directory entry in use?
+  bool deleted;                  /*!< Was this entry in use (so that the
+                                      search of a name goes on past it)?
+                                 */
+  bool isDir;                    //!< Is the file a directory?
   int sector;                    /*!< Location on disk to find the
                                       FileHeader for this file
                                  */
@@ -52,21 +56,35 @@ public:
                                  */
 };
 
+/*! \brief Defines the header of a directory file, before its entries
+*/
+class DirectoryHeader {
+public:
+  int tableSize;    //!< Number of entries (a power of two)
+  int numUsed;      //!< Number of entries in use
+  int numDeleted;   //!< Number of entries marked deleted
+};
+
 /*!\brief Defines a UNIX-like "directory".
 //
 // Each entry in the directory describes a file, and where to find
 // it on disk.
 // The directory data structure can be stored in memory, or on disk.
-// When it is on disk, it is stored as a regular Nachos file.
+// When it is on disk, it is stored as a regular Nachos file: a header
+// followed by a hash table of entries, indexed by a hash of the file
+// names (with linear probing).
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk.
+// from/to disk. The entries are only read when a search reaches them,
+// and only the modified ones are written back, so that the cost of an
+// operation does not depend on the size of the directory. The table
+// doubles when it is 3/4 full.
 */
 
 class Directory {
 public:
   Directory(int size);   // Initialize an empty directory
-                         // with space for "size" files
+                         // with space for "size" files (a power of two)
 
   ~Directory();   // De-allocate the directory
 
@@ -77,25 +95,70 @@ public:
   int Find(char *name);   // Find the sector number of the
                           // FileHeader for file: "name"
 
-  int Add(char *name, int newSector);   // Add a file name into the directory
+  int Add(char *name, int newSector, bool isDir);   // Add a file name
+                                                    // into the directory
 
   int Remove(char *name);   // Remove a file from the directory
 
   void List(char *, int);   // Print the names of all the files
                             // in the directory
 
+  int ReadEntries(int *index, DirectoryEntry *entries, int count);
+                            // Copy the entries in use from a table
+                            // index, reading only the ones copied
+
   void Print();   // Verbose print of the contents
                   //  of the directory -- all the file
                   //   names and their contents.
   bool empty();
 
 private:
-  int tableSize;               //!< Number of directory entries
+  DirectoryHeader header;      //!< Sizes of the table
   DirectoryEntry *table;       /*!< Table of pairs:
-                                  <file name, file header location>
+                                  <file name, file header location>,
+                                  followed by the flags below (one
+                                  buffer of the slab caches)
                                */
+  bool *loaded;                //!< Entries read from the disk
+  bool *dirty;                 //!< Entries to write back to the disk
+  bool headerDirty;            //!< Header to write back to the disk
+  bool grown;                  //!< Table resized since FetchFrom
+  OpenFile *source;            //!< Directory file the entries are read
+                               //!< from (NULL if not fetched)
+
+  void Init(int size);         // Allocate an empty table
+  void LoadAll();              // Read all the entries not read yet
+  void LoadRange(int first, int n);   // Read the entries [first, first+n)
+  DirectoryEntry *Entry(int i);   // Entry i, read from disk if needed
+  void Grow();                 // Double the size of the table
   int FindIndex(char *name);   // Find the index into the directory
                                //   table corresponding to "name"
 };
 
+/*! \brief Defines a directory opened to enumerate its entries
+//
+// The stream keeps the directory by its header sector, and a cursor:
+// the index in the hash table of the next entry to return. Each call
+// to Read fetches the directory header again and reads only the table
+// entries it goes through, so that listing a directory in batches
+// costs its own sectors only. Entries added or removed between two
+// calls may or may not be returned, as with UNIX readdir; if the table
+// grows in between, entries may be returned twice.
+*/
+class DirectoryStream : public Slab<DirectoryStream> {
+public:
+  //! Open the directory whose header is at sector
+  DirectoryStream(int sector);
+
+  //! Copy at most count entries in use from the cursor, and move it
+  int Read(DirectoryEntry *entries, int count);
+
+  ObjectType type;   //!< Object type, for validity checks of the
+                     //!< system calls (must be the first field)
+
+private:
+  int sector;   //!< Sector of the header of the directory
+  int cursor;   //!< Table index of the next entry to look at
+};
+
 #endif   // DIRECTORY_H
@@ -3,12 +3,14 @@
 //
 //	(in UNIX, this would be called the i-node).
 //      The file header is used to locate where on disk the
-//	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector,
+//	file's data is stored.  We implement this as a table of
+//	extents -- each entry in the table gives a run of consecutive
+//	disk sectors containing that portion of the file data. The
+//	data is allocated contiguously whenever possible, so that the
+//	table of most files fits in the first header sector; longer
+//	tables are chained in further header sectors. The data of a
+//	file small enough is kept in its first header sector instead,
+//	so that reading it costs no disk access once the file is open.
 //
 //      Unlike in a real system, we do not keep track of file permissions,
 //	ownership, last modification date, etc., in the file header.
@@ -37,23 +39,163 @@
 
 #include "filesys/filehdr.h"
 #include "drivers/drvDisk.h"
+#include "filesys/bufcache.h"
+#include "filesys/journal.h"
+#include "kernel/msgerror.h"
 #include "kernel/system.h"
 #include "utility/config.h"
 
-FileHeader::FileHeader(void) { dataSectors = NULL; }
+FileHeader::FileHeader(void) {
+  isdir = 0;
+  numBytes = numSectors = numExtents = numHeaderSectors = 0;
+  maxExtents = 0;
+  extents = NULL;
+  inlineData = (char *) SlabAlloc(InlineDataSize);
+  memset(inlineData, 0, InlineDataSize);
+}
 
 FileHeader::~FileHeader(void) {
-  if (dataSectors != NULL) {
-    delete[] dataSectors;
+  SlabFree(extents, maxExtents * sizeof(Extent));
+  SlabFree(inlineData, InlineDataSize);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AddExtent
+/*! 	Append a run of data sectors at the end of the file, merged with
+//	the last extent when they are consecutive on disk.
+//
+//	\param start the first disk sector of the run
+//	\param length the number of sectors of the run
+*/
+//----------------------------------------------------------------------
+void
+FileHeader::AddExtent(int start, int length) {
+  if (numExtents > 0) {
+    Extent *last = &extents[numExtents - 1];
+    if (last->start + last->length == start) {
+      last->length += length;
+      numSectors += length;
+      return;
+    }
+  }
+
+  if (numExtents == maxExtents) {
+    int oldMax = maxExtents;
+    maxExtents = (maxExtents == 0) ? 4 : 2 * maxExtents;
+    Extent *bigger = (Extent *) SlabAlloc(maxExtents * sizeof(Extent));
+    for (int i = 0; i < numExtents; i++)
+      bigger[i] = extents[i];
+    SlabFree(extents, oldMax * sizeof(Extent));
+    extents = bigger;
+  }
+  extents[numExtents].start = start;
+  extents[numExtents].length = length;
+  extents[numExtents].first = numSectors;
+  numExtents++;
+  numSectors += length;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AddSectors
+/*! 	Allocate data sectors at the end of the file, contiguous to the
+//	last ones if possible, else in runs as long as possible.
+//
+//	\param freeMap is the bitmap of free disk sectors
+//	\param count the number of sectors to allocate
+//	\return false if the disk is full or the file too fragmented (the
+//	sectors already allocated are kept)
+*/
+//----------------------------------------------------------------------
+bool
+FileHeader::AddSectors(BitMap *freeMap, int count) {
+  // Extend the last extent in place while the next sectors are free
+  if (numExtents > 0) {
+    Extent *last = &extents[numExtents - 1];
+    int next = last->start + last->length;
+    while (count > 0 && next < NUM_SECTORS && !freeMap->Test(next)) {
+      freeMap->Mark(next++);
+      last->length++;
+      numSectors++;
+      count--;
+    }
+  }
+
+  while (count > 0) {
+    if (numExtents == MAX_EXTENTS)
+      return false;   // too fragmented
+    int length;
+    int start = freeMap->FindRun(count, &length);
+    if (start == ERROR)
+      return false;   // not enough space
+    AddExtent(start, length);
+    count -= length;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FreeFrom
+/*! 	Free the data sectors of the file after the first count ones.
+//
+//	\param freeMap is the bitmap of free disk sectors
+//	\param count the number of data sectors to keep
+*/
+//----------------------------------------------------------------------
+void
+FileHeader::FreeFrom(BitMap *freeMap, int count) {
+  while (numSectors > count) {
+    Extent *last = &extents[numExtents - 1];
+    int keep = (count > last->first) ? count - last->first : 0;
+    for (int i = keep; i < last->length; i++) {
+      ASSERT(freeMap->Test(last->start + i));   // ought to be marked!
+      freeMap->Clear(last->start + i);
+    }
+    numSectors -= last->length - keep;
+    if (keep == 0)
+      numExtents--;
+    else
+      last->length = keep;
   }
 }
 
+//----------------------------------------------------------------------
+// FileHeader::AdjustHeaderSectors
+/*! 	Allocate or free the header sectors following the first one, so
+//	that they can hold the list of extents.
+//
+//	\param freeMap is the bitmap of free disk sectors
+//	\return false if there are not enough free sectors
+*/
+//----------------------------------------------------------------------
+bool
+FileHeader::AdjustHeaderSectors(BitMap *freeMap) {
+  int needed = 0;
+  if (numExtents > ExtentsInFirstSector)
+    needed = divRoundUp(numExtents - ExtentsInFirstSector, ExtentsInSector);
+  ASSERT(needed < MAX_HEADER_SECTORS);
+
+  while (numHeaderSectors < needed) {
+    int sector = freeMap->Find();
+    if (sector == ERROR)
+      return false;
+    headerSectors[numHeaderSectors++] = sector;
+  }
+  while (numHeaderSectors > needed) {
+    int sector = headerSectors[--numHeaderSectors];
+    ASSERT(freeMap->Test(sector));   // ought to be marked!
+    freeMap->Clear(sector);
+  }
+  return true;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 /*! 	Initialize a file header, including allocating space
 //      on disk for the file data.
 //	Allocate data and header blocks for the file out of the
-//      map of free disk blocks.
+//      map of free disk blocks. The data sectors are taken in a single
+//	run of consecutive sectors if possible. A file of at most
+//	InlineDataSize bytes gets no data sector: its data is inline.
 //
 //	\param freeMap is the bitmap of free disk sectors
 //	\param fileSize is the required number of bytes in the file
@@ -63,77 +205,86 @@ FileHeader::~FileHeader(void) {
 //----------------------------------------------------------------------
 bool
 FileHeader::Allocate(BitMap *freeMap, int fileSize) {
-  int i;
-  numBytes = fileSize;
-
   ASSERT(fileSize <= MAX_FILE_LENGTH);
 
-  // Compute the number of sectors to store the file
-  numSectors = divRoundUp(fileSize, g_cfg->SectorSize);
-
-  // Compute how many header sectors are required
-  numHeaderSectors =
-      divRoundUp((numSectors - DatasInFirstSector), DatasInSector);
+  numBytes = fileSize;
+  numSectors = numExtents = numHeaderSectors = 0;
+  memset(inlineData, 0, InlineDataSize);
+  if (fileSize <= InlineDataSize)
+    return true;
 
-  // Check if there is enough free sectors for both of them
-  if (freeMap->NumClear() < numSectors + numHeaderSectors)
+  // Compute the number of sectors to store the file
+  int count = divRoundUp(fileSize, g_cfg->SectorSize);
+  if (freeMap->NumClear() < count)
     return false;   // not enough space
-  DEBUG('f', (char *) "Allocate:\n%d DATA sector(s)\n%d HEADER sector(s)\n",
-        numSectors, numHeaderSectors);
-  // allocate all the necessary sectors and put them in their respective table
-  for (i = 0; i < numHeaderSectors; i++)
-    headerSectors[i] = freeMap->Find();
-  // Allocates memory for the table of data sectors
-  dataSectors = new int[MAX_DATA_SECTORS];
-  for (i = 0; i < numSectors; i++)
-    dataSectors[i] = freeMap->Find();
 
+  if (!AddSectors(freeMap, count) || !AdjustHeaderSectors(freeMap)) {
+    FreeFrom(freeMap, 0);
+    AdjustHeaderSectors(freeMap);
+    return false;
+  }
+  DEBUG('f', (char *) "Allocate:\n%d DATA sector(s) in %d extent(s)\n"
+                      "%d HEADER sector(s)\n",
+        numSectors, numExtents, numHeaderSectors);
   return true;
 }
+
 //----------------------------------------------------------------------
 // FileHeader::reAllocate
 /*! 	add new data blocks when the file grows up and allocate new header
 blocks
 //      if necessary.
 //	Allocate data and header blocks for the file out of the map of free disk
-blocks.
+blocks, following the last data sector if possible.
+//	When the file had its data inline, the data moves to the first
+//	data sector.
 //
 //	\param freeMap is the bit map of free disk sectors
 //	\param oldFileSize is the actual number of bytes in the file
 //      \param newFileSize is the wanted number of bytes in the file
 //	\return false if there are not enough free blocks to accomodate
-//	the new file.
+//	the new file (the file is then left unchanged).
 */
 //----------------------------------------------------------------------
 bool
 FileHeader::reAllocate(BitMap *freeMap, int oldFileSize, int newFileSize) {
-  int i;
-
-  // How many new data sectors are required
-  int newnumSectors = divRoundUp(newFileSize, g_cfg->SectorSize) - numSectors;
-  numBytes = newFileSize;
-
-  // How many new header sectors are required ?
-  int newnumHeaderSectors =
-      divRoundUp((numSectors - DatasInFirstSector), DatasInSector) -
-      numHeaderSectors;
   ASSERT(newFileSize <= MAX_FILE_LENGTH);
+  if (IsInline() && newFileSize <= InlineDataSize) {
+    numBytes = newFileSize;
+    return true;
+  }
 
-  // Check if there is enough free space on disk
-  if (freeMap->NumClear() < (newnumSectors + newnumHeaderSectors))
+  // How many new data sectors are required
+  int oldSectors = numSectors;
+  int count = divRoundUp(newFileSize, g_cfg->SectorSize) - numSectors;
+  if (freeMap->NumClear() < count)
     return false;   // not enough space on disk
-  DEBUG('f', (char *) "Reallocate :\n%d DATA sector(s)\n%d HEADER sector(s)\n",
-        newnumSectors, newnumHeaderSectors);
-
-  // allocate the new sectors
-  for (i = 0; i < newnumHeaderSectors; i++)
-    headerSectors[i + numHeaderSectors] = freeMap->Find();
-  for (i = 0; i < newnumSectors; i++)
-    dataSectors[i + numSectors] = freeMap->Find();
 
-  numSectors += newnumSectors;
-  numHeaderSectors += newnumHeaderSectors;
+  if (!AddSectors(freeMap, count) || !AdjustHeaderSectors(freeMap)) {
+    FreeFrom(freeMap, oldSectors);
+    AdjustHeaderSectors(freeMap);
+    return false;
+  }
 
+  // Move the inline data to the first data sector, which the journal
+  // may still hold as metadata if it is not a directory
+  if (oldSectors == 0 && oldFileSize > 0) {
+    char data[g_cfg->SectorSize];
+    memset(data, 0, g_cfg->SectorSize);
+    memcpy(data, inlineData, InlineDataSize);
+    if (IsDir())
+      WriteMetadata(extents[0].start, data);
+    else {
+      if (g_journal != NULL)
+        g_journal->Revoke(extents[0].start);
+      g_buffer_cache->WriteSector(extents[0].start, data);
+    }
+    memset(inlineData, 0, InlineDataSize);
+  }
+  numBytes = newFileSize;
+  DEBUG('f', (char *) "Reallocate :\n%d DATA sector(s) in %d extent(s)\n"
+                      "%d HEADER sector(s)\n",
+        numSectors, numExtents, numHeaderSectors);
   return true;
 }
 //----------------------------------------------------------------------
@@ -146,23 +297,15 @@ FileHeader::reAllocate(BitMap *freeMap, int oldFileSize, int newFileSize) {
 
 void
 FileHeader::Deallocate(BitMap *freeMap) {
-  int i;
-
-  // Free the data sectors
-  for (i = 0; i < numSectors; i++) {
-    ASSERT(freeMap->Test((int) dataSectors[i]));   // ought to be marked!
-    freeMap->Clear((int) dataSectors[i]);
-  }
-  // Free the header sectors
-  for (i = 0; i < numHeaderSectors; i++) {
-    ASSERT(freeMap->Test((int) headerSectors[i]));   // ought to be marked!
-    freeMap->Clear((int) headerSectors[i]);
-  }
+  // Free the data sectors, then the header sectors
+  FreeFrom(freeMap, 0);
+  AdjustHeaderSectors(freeMap);
 }
 
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-/*! 	Fetch contents of file header from disk.
+/*! 	Fetch contents of file header from disk. Most files have few
+//	extents, which fit in the first header sector.
 //
 //	\param sector is the disk sector containing the file header
 */
@@ -171,52 +314,50 @@ FileHeader::Deallocate(BitMap *freeMap) {
 void
 FileHeader::FetchFrom(int sector) {
   int SectorImg[g_cfg->SectorSize / sizeof(int)];
-  int i, j;
-
-  // Fills the temporary buffer with zeros
-  memset(SectorImg, 0, g_cfg->SectorSize);
 
   // Read the header from the disk
   // and put it in the temporary buffer
-  g_disk_driver->ReadSector(sector, (char *) SectorImg);
-
-  // Allocates memory for the table of data sectors
-  dataSectors = new int[MAX_DATA_SECTORS];
+  g_buffer_cache->ReadSector(sector, (char *) SectorImg);
 
   // Set up the memory image of the file header
   // from the newly read buffer
   isdir = SectorImg[0];
   numBytes = SectorImg[1];
-  numSectors = SectorImg[2];
-  numHeaderSectors = SectorImg[3];
-  ASSERT(numHeaderSectors <= MAX_HEADER_SECTORS);
-
-  // Get the first header sector
-  headerSectors[0] = NextHeaderSector(SectorImg);
-
-  // Get the number of the data sectors stored into
-  // the header sector in disk
-  for (i = 4; i < DatasInSector; i++)
-    dataSectors[i - 4] = SectorImg[i];
-
-  // Get the other numbers of header sectors and data sectors
-  for (i = 0; i < numHeaderSectors; i++) {
-    // Fill the temporary buffer with zeroes
-    memset(SectorImg, 0, g_cfg->SectorSize);
-    g_disk_driver->ReadSector(headerSectors[i], (char *) SectorImg);
-
-    for (j = 0; j < DatasInSector; j++)
-      dataSectors[DatasInFirstSector + i * DatasInSector + j] = SectorImg[j];
-
-    /* Make sure we don't go out of bouds */
-    if (i + 1 < numHeaderSectors)
-      headerSectors[i + 1] = NextHeaderSector(SectorImg);
+  int count = SectorImg[3];
+  ASSERT(count <= MAX_EXTENTS);
+  numSectors = numExtents = numHeaderSectors = 0;
+
+  // A header without data sectors holds the data itself
+  if (SectorImg[2] == 0) {
+    ASSERT(numBytes <= InlineDataSize);
+    memcpy(inlineData, &SectorImg[4], InlineDataSize);
+    return;
+  }
+
+  // Get the extents, from the first header sector, then from the
+  // following ones
+  int *entry = &SectorImg[4];
+  int left = ExtentsInFirstSector;
+  int next = NextHeaderSector(SectorImg);
+  for (int i = 0; i < count; i++) {
+    if (left == 0) {
+      ASSERT(next != 0 && numHeaderSectors < MAX_HEADER_SECTORS);
+      headerSectors[numHeaderSectors++] = next;
+      g_buffer_cache->ReadSector(next, (char *) SectorImg);
+      next = NextHeaderSector(SectorImg);
+      entry = SectorImg;
+      left = ExtentsInSector;
+    }
+    AddExtent(entry[0], entry[1]);
+    entry += 2;
+    left--;
   }
 }
 
 //----------------------------------------------------------------------
 // FileHeader::WriteBack
-/*! 	Write the modified contents of the file header back to disk.
+/*! 	Write the modified contents of the file header back to disk,
+//	through the metadata journal.
 //
 //	\param sector is the disk sector to contain the file header
 */
@@ -224,8 +365,7 @@ FileHeader::FetchFrom(int sector) {
 
 void
 FileHeader::WriteBack(int sector) {
-  int SectorImg[DatasInSector];
-  int i, j;
+  int SectorImg[g_cfg->SectorSize / sizeof(int)];
 
   // Fills the temporary buffer with zeroes
   memset(SectorImg, 0, g_cfg->SectorSize);
@@ -234,35 +374,42 @@ FileHeader::WriteBack(int sector) {
   SectorImg[0] = isdir;
   SectorImg[1] = numBytes;
   SectorImg[2] = numSectors;
-  SectorImg[3] = numHeaderSectors;
-
-  // Fills the number of the data sectors and the first header
-  // sector in the temporary buffer
-  for (i = 4; i < DatasInSector; i++)
-    SectorImg[i] = dataSectors[i - 4];
-  NextHeaderSector(SectorImg) = headerSectors[0];
-
-  // Write the first header sector into disk
-  g_disk_driver->WriteSector(sector, (char *) SectorImg);
-
-  // Write the following header sectors into disk
-  for (i = 0; i < numHeaderSectors; i++) {
-    memset(SectorImg, 0, g_cfg->SectorSize);
-    for (j = 0; j < DatasInSector; j++)
-      SectorImg[j] = dataSectors[j + DatasInFirstSector + i * DatasInSector];
-    if (i + 1 < numHeaderSectors)
-      NextHeaderSector(SectorImg) = headerSectors[i + 1];
-    else
-      NextHeaderSector(SectorImg) = 0;
-    g_disk_driver->WriteSector(headerSectors[i], (char *) SectorImg);
+  SectorImg[3] = numExtents;
+  if (IsInline()) {
+    memcpy(&SectorImg[4], inlineData, InlineDataSize);
+    WriteMetadata(sector, (char *) SectorImg);
+    return;
+  }
+
+  // Fills the extents, writing each header sector once full
+  int *entry = &SectorImg[4];
+  int left = ExtentsInFirstSector;
+  int current = sector;
+  int h = 0;
+  for (int i = 0; i < numExtents; i++) {
+    if (left == 0) {
+      NextHeaderSector(SectorImg) = headerSectors[h];
+      WriteMetadata(current, (char *) SectorImg);
+      current = headerSectors[h++];
+      memset(SectorImg, 0, g_cfg->SectorSize);
+      entry = SectorImg;
+      left = ExtentsInSector;
+    }
+    entry[0] = extents[i].start;
+    entry[1] = extents[i].length;
+    entry += 2;
+    left--;
   }
+  NextHeaderSector(SectorImg) = 0;
+  WriteMetadata(current, (char *) SectorImg);
 }
 
 //----------------------------------------------------------------------
 // FileHeader::ByteToSector
 /*!     This is essentially a translation from a virtual address (the
 //	offset in the file) to a physical address (the sector where the
-//	data at the offset is stored).
+//	data at the offset is stored): a binary search of the extent
+//	holding the offset.
 //
 //	\param offset is the location within the file of the byte in question
 //      \return which disk sector is storing a particular byte within the file.
@@ -270,7 +417,18 @@ FileHeader::WriteBack(int sector) {
 //----------------------------------------------------------------------
 int
 FileHeader::ByteToSector(int offset) {
-  return (dataSectors[offset / g_cfg->SectorSize]);
+  int index = offset / g_cfg->SectorSize;
+  ASSERT(index < numSectors);
+
+  int low = 0, high = numExtents - 1;
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (extents[mid].first <= index)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+  return extents[low].start + index - extents[low].first;
 }
 
 //----------------------------------------------------------------------
@@ -301,6 +459,8 @@ FileHeader::ChangeFileLength(int newsize) {
 //----------------------------------------------------------------------
 int
 FileHeader::MaxFileLength() {
+  if (IsInline())
+    return InlineDataSize;
   return numSectors * g_cfg->SectorSize;
 }
 //----------------------------------------------------------------------
@@ -317,11 +477,22 @@ FileHeader::Print() {
 
   printf("FileHeader contents.  File size: %" PRIu32 ".  File blocks:\n",
          numBytes);
-  for (i = 0; i < numSectors; i++)
-    printf("%" PRIu32 " ", dataSectors[i]);
+  for (i = 0; i < numExtents; i++)
+    printf("%" PRIu32 "-%" PRIu32 " ", extents[i].start,
+           extents[i].start + extents[i].length - 1);
   printf("\nFile contents:\n");
+  if (IsInline()) {
+    for (k = 0; k < numBytes; k++) {
+      if ('\040' <= inlineData[k] && inlineData[k] <= '\176')
+        printf("%c", inlineData[k]);
+      else
+        printf("\\%x", (unsigned char) inlineData[k]);
+    }
+    printf("\n");
+    return;
+  }
   for (i = k = 0; i < numSectors; i++) {
-    g_disk_driver->ReadSector(dataSectors[i], data);
+    g_buffer_cache->ReadSector(ByteToSector(i * g_cfg->SectorSize), data);
     for (j = 0; ((uint32_t) j < g_cfg->SectorSize) && (k < numBytes);
          j++, k++) {
       if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
@@ -366,3 +537,45 @@ void
 FileHeader::SetDir() {
   isdir = 1;
 }
+
+//----------------------------------------------------------------------
+// FileHeader::IsInline
+/*! 	\return true if the file has no data sector, its data (if any)
+//	being stored in the header.
+*/
+//----------------------------------------------------------------------
+bool
+FileHeader::IsInline() {
+  return (numSectors == 0);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReadInline
+/*! 	Copy inline data of the file.
+//
+//	\param into the buffer to contain the data
+//	\param count the number of bytes to copy
+//	\param position the offset within the file of the first byte
+*/
+//----------------------------------------------------------------------
+void
+FileHeader::ReadInline(char *into, int count, int position) {
+  ASSERT(IsInline() && position + count <= InlineDataSize);
+  memcpy(into, &inlineData[position], count);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::WriteInline
+/*! 	Modify inline data of the file, in memory only (WriteBack
+//	writes it to the disk with the header).
+//
+//	\param from the buffer containing the data
+//	\param count the number of bytes to copy
+//	\param position the offset within the file of the first byte
+*/
+//----------------------------------------------------------------------
+void
+FileHeader::WriteInline(char *from, int count, int position) {
+  ASSERT(IsInline() && position + count <= InlineDataSize);
+  memcpy(&inlineData[position], from, count);
+}
@@ -28,13 +28,18 @@
 
 #include "machine/disk.h"
 #include "utility/bitmap.h"
+#include "utility/slab.h"
 
 /*! \brief Defines the Nachos "file header"
 //
 // (in UNIX terms,the "i-node"), describing where on disk to find all
 // of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks.
+// The file header is organized as a table of extents, runs of
+// consecutive data sectors, so that the data of a file stays
+// contiguous on disk as much as possible. The data of a small file
+// is stored in the first header sector itself, in place of the
+// extents (inline data), and moves to data sectors when the file
+// grows beyond InlineDataSize bytes.
 //
 // The file header data structure can be stored in memory or on disk.
 //
@@ -56,39 +61,45 @@ extern Config *g_cfg;
 //   |   isDir              | if it is a directory, 1, 0 otherwise
 //   |   numBytes           | total size of the data (header excluded)
 //   |   numSectors         | total number of sectors
-//   |   numHeaderSectors   | number of header sectors
+//   |   numExtents         | number of extents
 //   .----------------------.
-//   |   List of the        | The list of the sector addresses containing data
-//   |   Data sectors       | (at most DatasInFirstSector sectors)
-//   |                      |
+//   |   List of the        | The list of the extents (first sector,
+//   |   extents            | number of sectors) of the data, in file
+//   |                      | order (at most ExtentsInFirstSector extents)
+//   |                      | or, if numSectors is 0, the data of the
+//   |                      | file (at most InlineDataSize bytes)
 //   . ---------------------.
 //   |  Next header sector  | The sector containing the remaining of the
-//   |                      | list of data sectors (a "normal" header sector,
-//   .----------------------. see below)
+//   |                      | list of extents (a "normal" header sector,
+//   .----------------------. see below), 0 if none
 //
 // 2. The other "normal" header sectors
 //
 //   .----------------------.
-//   |  List of the         | The list of the sector addresses containing data
-//   |  Data sectors (ctd.) | (at most DatasInSector sectors)
+//   |  List of the         | The list of the extents (ctd.)
+//   |  extents (ctd.)      | (at most ExtentsInSector extents)
 //   |                      |
 //   .----------------------.
 //   |  Next header sector  | The sector containing the remaining of the
-//   |                      | list of data sectors (a "normal" header sector,
-//   .----------------------. see below)
+//   |                      | list of extents (a "normal" header sector,
+//   .----------------------. see below), 0 if none
 //
 // Be careful when modifying the format of the file header on disk
 // Methods FetchFrom and WriteBack assume THIS representation
 
-// Number of sector numbers that can be stored in the first sector
+// Number of extents that can be stored in the first sector
 // representing a file header, which contains a header of 4 ints
 // and a trailer of 1 int (5 integers in total)
-#define DatasInFirstSector                                                     \
-  ((int) ((g_cfg->SectorSize - 5 * sizeof(int)) / sizeof(int)))
+#define ExtentsInFirstSector                                                   \
+  ((int) ((g_cfg->SectorSize - 5 * sizeof(int)) / (2 * sizeof(int))))
+
+// Number of bytes of data that can be stored in the first header
+// sector, in place of the extents
+#define InlineDataSize ((int) (g_cfg->SectorSize - 5 * sizeof(int)))
 
-// Number of sector numbers that can be put in a "normal" header sector
-#define DatasInSector                                                          \
-  ((int) ((g_cfg->SectorSize - 1 * sizeof(int)) / sizeof(int)))
+// Number of extents that can be put in a "normal" header sector
+#define ExtentsInSector                                                        \
+  ((int) ((g_cfg->SectorSize - 1 * sizeof(int)) / (2 * sizeof(int))))
 
 // Get the value of the next header sector, given the hdrSector array
 // of int representing the contents of the current header sector
@@ -98,16 +109,29 @@ extern Config *g_cfg;
 //! Maximum number of header sectors in a file
 #define MAX_HEADER_SECTORS 32
 
-//! Maximum number of data sectors in a file
+//! Maximum number of extents in a file
 // (computed according to the disk representation of the file)
-#define MAX_DATA_SECTORS                                                       \
-  ((int) ((MAX_HEADER_SECTORS - 1) * DatasInSector + DatasInFirstSector))
+#define MAX_EXTENTS                                                            \
+  ((int) ((MAX_HEADER_SECTORS - 1) * ExtentsInSector + ExtentsInFirstSector))
 
-#define MAX_FILE_LENGTH ((int) ((MAX_DATA_SECTORS) * g_cfg->SectorSize))
+//! Maximum length of a file: the whole disk, if it is not too fragmented
+#define MAX_FILE_LENGTH ((int) (NUM_SECTORS * g_cfg->SectorSize))
+
+/*! \brief Defines a run of consecutive data sectors of a file
+*/
+class Extent {
+public:
+  int start;    //!< first disk sector of the run
+  int length;   //!< number of sectors of the run
+  int first;    //!< index in the file of the first sector of the run
+                //!< (in memory only)
+};
 
 /*! \brief Defines a file header in the Nachos file system
- */
-class FileHeader {
+//
+// The headers and their buffers come from slab caches (see slab.h).
+*/
+class FileHeader : public Slab<FileHeader> {
 public:
   FileHeader(void);    // Initialize the header (made empty)
   ~FileHeader(void);   // Deallocate the file header
@@ -139,15 +163,32 @@ public:
   void Print();                 //!< Print the contents of the file.
   bool IsDir();                 //!< return true if the file header is marked
                                 //!< as a directory.
+  bool IsInline();              //!< return true if the data of the file is
+                                //!< stored in the header
+  void ReadInline(char *into, int count, int position);   //!< Read
+                                //!< inline data
+  void WriteInline(char *from, int count, int position);   //!< Write
+                                //!< inline data
   void SetFile();               //!< Mark this header as a file header
   void SetDir();                //!< Mark this header as a directory header
 private:
+  bool AddSectors(BitMap *freeMap, int count);   //!< Allocate data sectors
+                                                 //!< at the end of the file
+  void FreeFrom(BitMap *freeMap, int count);   //!< Free the data sectors
+                                               //!< after the first count
+  bool AdjustHeaderSectors(BitMap *freeMap);   //!< Allocate or free header
+                                               //!< sectors for the extents
+  void AddExtent(int start, int length);   //!< Append an extent
+
   int isdir;
   int numBytes;           //!< Number of bytes in the file
   int numSectors;         //!< Number of data sectors in the file
-  int *dataSectors;       /*!< Disk sector numbers for each data
-                           block in the file
+  int numExtents;         //!< Number of extents of data sectors
+  int maxExtents;         //!< Number of entries allocated in extents
+  Extent *extents;        /*!< Runs of data sectors, in file order
                           */
+  char *inlineData;       //!< Data of the file while it has no data
+                          //!< sectors (InlineDataSize bytes)
   int numHeaderSectors;   //!< number of sectors used for the header
   int headerSectors[MAX_HEADER_SECTORS]; /*!< Disk sectors numbers for each
                                          header block of the file
@@ -58,22 +58,18 @@
 */
 
 #include "filesys/filesys.h"
+#include "filesys/dcache.h"
 #include "filesys/directory.h"
 #include "filesys/filehdr.h"
+#include "filesys/journal.h"
 #include "filesys/oftable.h"
+#include "kernel/elf.h"
 #include "kernel/msgerror.h"
 #include "kernel/system.h"
 #include "machine/disk.h"
 #include "utility/bitmap.h"
 #include "utility/config.h"
 
-/*! Sectors containing the file headers for the bitmap of free sectors,
-// and the directory of files.  These file headers are placed in well-known
-// sectors, so that they can be located on boot-up.
-*/
-#define FreeMapSector   0
-#define DirectorySector 1
-
 //----------------------------------------------------------------------
 // decompname
 /*! this function returns the name of the first directory
@@ -114,6 +110,39 @@ decompname(const char *orig_path, char *head, char *tail) {
   }
 }
 
+//----------------------------------------------------------------------
+// FindName
+/*!
+//  this function looks a name up in a directory, through the dentry
+//  cache: the directory is only read if the name is not cached, and
+//  the result is then cached.
+//
+//   \param dirsector is the sector of the directory header
+//   \param name is the name in the directory (no '/')
+//   \param isDir is set to true if the file found is a directory
+//   \return the sector number of the file header, or ERROR if the name
+//     does not exist
+*/
+//----------------------------------------------------------------------
+int
+FindName(int dirsector, char *name, bool *isDir) {
+  int sector;
+  if (g_dentry_cache->Lookup(dirsector, name, &sector, isDir))
+    return sector;
+
+  OpenFile dirfile(dirsector);
+  Directory directory(g_cfg->NumDirEntries);
+  directory.FetchFrom(&dirfile);
+  sector = directory.Find(name);
+  *isDir = false;
+  if (sector >= 0) {
+    OpenFile file(sector);
+    *isDir = file.IsDir();
+  }
+  g_dentry_cache->Enter(dirsector, name, sector, *isDir);
+  return sector;
+}
+
 //----------------------------------------------------------------------
 // FindDir
 /*!
@@ -138,10 +167,6 @@ int
 FindDir(char *name) {
   DEBUG('f', (char *) "FindDir [%s]\n", name);
 
-  // Fetch the root directory from disk
-  Directory directory(g_cfg->NumDirEntries);
-  directory.FetchFrom(g_file_system->GetDirFile());
-
   // Start the search in the root directory
   int sector = DirectorySector;
   char dirname[g_cfg->MaxFileNameSize];
@@ -151,15 +176,13 @@ FindDir(char *name) {
     strcpy(name, reminder);
 
     // Get the sector of the file/directory corresponding to 'name'
-    sector = directory.Find(dirname);
+    bool isDir;
+    sector = FindName(sector, dirname, &isDir);
     if (sector < 0)
       return ERROR;   // This file/directory does not exist ...
 
     // Check that it is a directory
-    OpenFile file(sector);
-    if (file.GetFileHeader()->IsDir())
-      directory.FetchFrom(&file);
-    else
+    if (!isDir)
       return ERROR;
   }
   strcpy(name, reminder);
@@ -176,30 +199,41 @@ FindDir(char *name) {
 //	not all of the sectors marked as free).
 //
 //	If format = false, we just have to open the files
-//	representing the bitmap and the directory.
+//	representing the bitmap and the directory, once the metadata
+//	journal of the disk, if any, has been replayed.
 //
 //	\param format should we initialize the disk?
 */
 //----------------------------------------------------------------------
 FileSystem::FileSystem(bool format) {
+  int journalSize = 0;
+  uint32_t journalSeq = 0;
+
   DEBUG('f', (char *) "Initializing the file system.\n");
+  freeMap = new BitMap(NUM_SECTORS);
+  freeMapLock = new Lock((char *) "Free map");
+  g_journal = NULL;
   if (format) {
-    BitMap freeMap(NUM_SECTORS);
     Directory directory(g_cfg->NumDirEntries);
     FileHeader mapHdr, dirHdr;
 
     DEBUG('f', (char *) "Formatting the file system.\n");
 
     // First, allocate space for FileHeaders for the directory and bitmap
-    // (make sure no one else grabs these!)
-    freeMap.Mark(FreeMapSector);
-    freeMap.Mark(DirectorySector);
+    // (make sure no one else grabs these!), and for the journal
+    freeMap->Mark(FreeMapSector);
+    freeMap->Mark(DirectorySector);
+    journalSize = g_cfg->JournalSectors;
+    journalSeq = 1;
+    Journal::Format(journalSize);
+    for (int i = 0; i < journalSize; i++)
+      freeMap->Mark(JournalSector + i);
 
     // Second, allocate space for the data blocks containing the contents
     // of the directory and bitmap files.  There better be enough space!
 
-    ASSERT(mapHdr.Allocate(&freeMap, FreeMapFileSize));
-    ASSERT(dirHdr.Allocate(&freeMap, g_cfg->DirectoryFileSize));
+    ASSERT(mapHdr.Allocate(freeMap, FreeMapFileSize));
+    ASSERT(dirHdr.Allocate(freeMap, g_cfg->DirectoryFileSize));
 
     // Mark the Root directory as a directory
     dirHdr.SetDir();
@@ -227,19 +261,26 @@ FileSystem::FileSystem(bool format) {
     // to hold the file data for the directory and bitmap.
 
     DEBUG('f', (char *) "Writing bitmap and directory back to disk.\n");
-    freeMap.WriteBack(freeMapFile);   // flush changes to disk
+    freeMap->WriteBack(freeMapFile);   // flush changes to disk
     directory.WriteBack(directoryFile);
 
     if (DebugIsEnabled('f')) {
-      freeMap.Print();
+      freeMap->Print();
       directory.Print();
     }
   } else {
     // if we are not formatting the disk, just open the files representing
     // the bitmap and directory; these are left open while Nachos is running
+    if (!Journal::Recover(&journalSize, &journalSeq))
+      journalSize = 0;
     freeMapFile = new OpenFile(FreeMapSector);
     directoryFile = new OpenFile(DirectorySector);
+    freeMap->FetchFrom(freeMapFile);
   }
+
+  if (journalSize > 0)
+    g_journal = new Journal(journalSize, journalSeq, freeMap, freeMapFile,
+                            freeMapLock);
 }
 
 //----------------------------------------------------------------------
@@ -249,6 +290,10 @@ FileSystem::FileSystem(bool format) {
 //----------------------------------------------------------------------
 
 FileSystem::~FileSystem() {
+  delete g_journal;
+  g_journal = NULL;
+  delete freeMap;
+  delete freeMapLock;
   delete freeMapFile;
   delete directoryFile;
 }
@@ -297,29 +342,37 @@ FileSystem::Create(char *name, int initialSize) {
     return INEXIST_FILE_ERROR;
   }
 
+  bool isDir;
+  if (FindName(dirsector, dirname, &isDir) != ERROR) {
+    g_open_file_table->createLock->Release();
+    return ALREADY_IN_DIRECTORY;   // file is already in directory
+  }
+
   OpenFile dirfile(dirsector);
   Directory directory(g_cfg->NumDirEntries);
   directory.FetchFrom(&dirfile);
 
-  if (directory.Find((char *) dirname) != ERROR) {
-    g_open_file_table->createLock->Release();
-    return ALREADY_IN_DIRECTORY;   // file is already in directory
-  }
+  // The updates of the metadata go to the same transaction
+  BeginMetadataUpdate();
 
-  // Get the freemap from the disk
-  BitMap freeMap(NUM_SECTORS);
-  freeMap.FetchFrom(freeMapFile);
+  // Lock the freemap
+  freeMapLock->Acquire();
 
   // Find a sector to hold the file header
-  sector = freeMap.Find();
+  sector = freeMap->Find();
   if (sector == ERROR) {
+    freeMapLock->Release();
+    EndMetadataUpdate();
     g_open_file_table->createLock->Release();
     return OUT_OF_DISK;   // no free block for file header
   }
 
   // Add the file in the directory
-  int add_result = directory.Add(dirname, sector);
+  int add_result = directory.Add(dirname, sector, false);
   if (add_result != NO_ERROR) {
+    freeMap->Clear(sector);
+    freeMapLock->Release();
+    EndMetadataUpdate();
     g_open_file_table->createLock->Release();
     return add_result;   // Could not add new entry in Dir
   }
@@ -329,15 +382,21 @@ FileSystem::Create(char *name, int initialSize) {
   hdr.SetFile();
 
   // Allocate space for the data sectors
-  if (!hdr.Allocate(&freeMap, initialSize)) {
+  if (!hdr.Allocate(freeMap, initialSize)) {
+    freeMap->Clear(sector);
+    freeMapLock->Release();
+    EndMetadataUpdate();
     g_open_file_table->createLock->Release();
     return OUT_OF_DISK;   // no space on disk for data
   }
+  freeMapLock->Release();
 
-  // everthing worked, flush all changes back to disk
+  // everthing worked, flush all changes back to disk (the freemap
+  // is written at the next Sync, or with the transaction)
   hdr.WriteBack(sector);            // File header
   directory.WriteBack(&dirfile);    // Directory
-  freeMap.WriteBack(freeMapFile);   // Freemap
+  EndMetadataUpdate();
+  g_dentry_cache->Enter(dirsector, dirname, sector, false);
 
   DEBUG('f', (char *) "END Creating file %s, size %d\n", name, initialSize);
   g_open_file_table->createLock->Release();
@@ -366,14 +425,10 @@ FileSystem::Open(char *name) {
   if (dirsector == ERROR)
     return NULL;
 
-  // Read the directory from disk
-  OpenFile dirfile(dirsector);
-  DEBUG('f', (char *) "Opening file %s\n", name);
-  Directory directory(g_cfg->NumDirEntries);
-  directory.FetchFrom(&dirfile);
-
   // Find the file in the directory
-  sector = directory.Find(dirname);
+  DEBUG('f', (char *) "Opening file %s\n", name);
+  bool isDir;
+  sector = FindName(dirsector, dirname, &isDir);
   if (sector >= 0) {
     openFile = new OpenFile(sector);   // name was found in directory
     openFile->SetName(name);
@@ -386,6 +441,37 @@ FileSystem::Open(char *name) {
   return openFile;   // return NULL if not found
 }
 
+//----------------------------------------------------------------------
+// FileSystem::OpenDir
+/*! 	Open a directory to enumerate its entries. Only the path is
+//	looked up: the entries are read in batches by the stream.
+//
+//	\param name the text name of the directory, "/" for the root
+//	(NOT MODIFIED)
+//	\return the directory stream, NULL if name is not a directory
+*/
+//----------------------------------------------------------------------
+DirectoryStream *
+FileSystem::OpenDir(char *name) {
+  char dirname[g_cfg->MaxFileNameSize];
+
+  // Find the directory containing it, a trailing / giving the
+  // directory itself
+  strcpy(dirname, name);
+  int sector = FindDir(dirname);
+  if (sector == ERROR)
+    return NULL;
+  if (dirname[0] != '\0') {
+    bool isDir;
+    sector = FindName(sector, dirname, &isDir);
+    if (sector < 0 || !isDir)
+      return NULL;
+  }
+
+  DEBUG('f', (char *) "Opening directory %s\n", name);
+  return new DirectoryStream(sector);
+}
+
 //----------------------------------------------------------------------
 // FileSystem::Remove
 /*! 	Delete a file from the file system.  This requires:
@@ -436,20 +522,21 @@ FileSystem::Remove(char *name) {
   if (fileHdr.IsDir())
     return NOT_A_FILE;
 
-  // Get the freemap file from the disk
-  BitMap freeMap(NUM_SECTORS);
-  freeMap.FetchFrom(freeMapFile);
-
   // Indicate that sectors are deallocated in the freemap
-  fileHdr.Deallocate(&freeMap);   // remove data blocks
-  freeMap.Clear(sector);          // remove header block
+  BeginMetadataUpdate();
+  freeMapLock->Acquire();
+  fileHdr.Deallocate(freeMap);   // remove data blocks
+  freeMap->Clear(sector);        // remove header block
+  freeMapLock->Release();
 
   // Remove the file from the directory
   directory.Remove(dirname);
+  g_dentry_cache->Enter(dirsector, dirname, ERROR, false);
+  g_elf_cache->Forget(sector);
 
-  // Flush everything to disk
-  freeMap.WriteBack(freeMapFile);   // freemap
-  directory.WriteBack(&dirfile);    // directory
+  // Flush the directory to disk
+  directory.WriteBack(&dirfile);
+  EndMetadataUpdate();
 
   return NO_ERROR;
 }
@@ -466,11 +553,10 @@ FileSystem::List() {
   printf("\nNachOS File System content :\n----------------------------\n");
   directory.List((char *) "/", 0);
 
-  BitMap bitmap(NUM_SECTORS);
-  bitmap.FetchFrom(freeMapFile);
+  int numClear = freeMap->NumClear();
   printf("Free Space : %" PRIu32 " bytes (%" PRIu32 " %% )\n",
-         bitmap.NumClear() * g_cfg->SectorSize,
-         (int) ((float) (bitmap.NumClear() * g_cfg->SectorSize) * 100 /
+         numClear * g_cfg->SectorSize,
+         (int) ((float) (numClear * g_cfg->SectorSize) * 100 /
                 (float) (NUM_SECTORS * g_cfg->SectorSize)));
 }
 
@@ -497,9 +583,7 @@ FileSystem::Print() {
   dirHdr.FetchFrom(DirectorySector);
   dirHdr.Print();
 
-  BitMap freeMap(NUM_SECTORS);
-  freeMap.FetchFrom(freeMapFile);
-  freeMap.Print();
+  freeMap->Print();
 
   Directory directory(g_cfg->NumDirEntries);
   directory.FetchFrom(directoryFile);
@@ -517,6 +601,51 @@ FileSystem::GetFreeMapFile() {
   return freeMapFile;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::GetFreeMap()
+/*!    lock the in-memory free map and return it. The caller allocates
+//     or frees sectors in it, then calls ReleaseFreeMap. The changes
+//     reach the disk at the next Sync.
+*/
+//----------------------------------------------------------------------
+BitMap *
+FileSystem::GetFreeMap() {
+  freeMapLock->Acquire();
+  return freeMap;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReleaseFreeMap()
+/*!    release the lock taken on the free map by GetFreeMap.
+//
+*/
+//----------------------------------------------------------------------
+void
+FileSystem::ReleaseFreeMap() {
+  freeMapLock->Release();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Sync()
+/*!    write back to the free map file the parts of the free map that
+//     changed since the last Sync. Called before the buffer cache is
+//     flushed. With a journal, the running transaction, which holds
+//     them, is committed, and the log checkpointed, so that the
+//     metadata reach their home sectors.
+*/
+//----------------------------------------------------------------------
+void
+FileSystem::Sync() {
+  if (g_journal != NULL) {
+    g_journal->Commit();
+    g_journal->Checkpoint();
+    return;
+  }
+  freeMapLock->Acquire();
+  freeMap->WriteChanges(freeMapFile);
+  freeMapLock->Release();
+}
+
 //----------------------------------------------------------------------
 // FileSystem::GetDirFile()
 /*!    return the base directory file (used by the open file table).
@@ -570,24 +699,39 @@ FileSystem::Mkdir(char *dirname) {
   if (parentdir.Find(name) >= 0)
     return ALREADY_IN_DIRECTORY;   // Le sous-rep existe deja !
 
-  // Get the freemap
-  BitMap freeMap(NUM_SECTORS);
-  freeMap.FetchFrom(freeMapFile);
+  // The updates of the metadata go to the same transaction
+  BeginMetadataUpdate();
+
+  // Lock the freemap
+  freeMapLock->Acquire();
 
   // Get a free sector for the file header
-  int hdr_sect = freeMap.Find();
-  if (hdr_sect < 0)
+  int hdr_sect = freeMap->Find();
+  if (hdr_sect < 0) {
+    freeMapLock->Release();
+    EndMetadataUpdate();
     return OUT_OF_DISK;   // plus de place sur le disque
+  }
 
   // Allocate free sectors for the directory contents
   FileHeader hdr;
-  if (!hdr.Allocate(&freeMap, g_cfg->DirectoryFileSize))
+  if (!hdr.Allocate(freeMap, g_cfg->DirectoryFileSize)) {
+    freeMap->Clear(hdr_sect);
+    freeMapLock->Release();
+    EndMetadataUpdate();
     return OUT_OF_DISK;   // no space on disk for data
+  }
 
   // Add the directory in the parent directory
-  int add_result = parentdir.Add(name, hdr_sect);
-  if (add_result != NO_ERROR)
+  int add_result = parentdir.Add(name, hdr_sect, true);
+  if (add_result != NO_ERROR) {
+    hdr.Deallocate(freeMap);
+    freeMap->Clear(hdr_sect);
+    freeMapLock->Release();
+    EndMetadataUpdate();
     return add_result;
+  }
+  freeMapLock->Release();
 
   /*
    * Flush everything to disk
@@ -604,7 +748,8 @@ FileSystem::Mkdir(char *dirname) {
 
   // Parent directory
   parentdir.WriteBack(&parentdirfile);
-  freeMap.WriteBack(freeMapFile);
+  EndMetadataUpdate();
+  g_dentry_cache->Enter(parentsect, name, hdr_sect, true);
 
   return NO_ERROR;
 }
@@ -664,22 +809,23 @@ FileSystem::Rmdir(char *dirname) {
   if (!thedir.empty())
     return DIRECTORY_NOT_EMPTY;   // directory is not empty
 
-  // Get the freemap from disk
-  BitMap freeMap(NUM_SECTORS);
-  freeMap.FetchFrom(freeMapFile);
-
   // Deallocate the data sectors of the directory
-  thedirheader.Deallocate(&freeMap);
+  BeginMetadataUpdate();
+  freeMapLock->Acquire();
+  thedirheader.Deallocate(freeMap);
 
   // Deallocate the sector containing the directory header
-  freeMap.Clear(thedirsect);
+  freeMap->Clear(thedirsect);
+  freeMapLock->Release();
 
   // We remove the directory from its parent directory
   parentdir.Remove(name);
+  g_dentry_cache->Enter(parentsect, name, ERROR, false);
+  g_dentry_cache->PurgeDirectory(thedirsect);
 
-  // Flush everything to disk
-  freeMap.WriteBack(freeMapFile);        // freemap
-  parentdir.WriteBack(&parentdirfile);   // parent directory
+  // Flush the parent directory to disk
+  parentdir.WriteBack(&parentdirfile);
+  EndMetadataUpdate();
 
   return NO_ERROR;
 }
@@ -43,10 +43,26 @@
 */
 #define FreeMapFileSize (NUM_SECTORS / BITS_IN_BYTE)
 
+/*! Sectors containing the file headers for the bitmap of free sectors,
+// and the directory of files.  These file headers are placed in well-known
+// sectors, so that they can be located on boot-up.
+*/
+#define FreeMapSector   0
+#define DirectorySector 1
+
+//! First sector of the metadata journal (superblock, then log), when
+//! the disk has one
+#define JournalSector   2
+
 #include "filesys/openfile.h"
 #include "kernel/copyright.h"
 
+class BitMap;
+class DirectoryStream;
+class Lock;
+
 int FindDir(char *);
+int FindName(int dirsector, char *name, bool *isDir);
 /*! \brief Defines the Nachos file system
  */
 class FileSystem {
@@ -62,6 +78,9 @@ public:
 
   OpenFile *Open(char *name);   //!< Open a file (UNIX open)
 
+  DirectoryStream *OpenDir(char *name);   //!< Open a directory (UNIX
+                                          //!< opendir)
+
   int Remove(char *name);   //!< Delete a file (UNIX unlink)
 
   void List();   //!< List all the files in the file system
@@ -70,6 +89,12 @@ public:
 
   OpenFile *GetFreeMapFile();   //!< Get the free map table
 
+  BitMap *GetFreeMap();   //!< Lock the free map and return it
+
+  void ReleaseFreeMap();   //!< Release the lock taken by GetFreeMap
+
+  void Sync();   //!< Write back the changed parts of the free map
+
   OpenFile *GetDirFile();   //!< Get the root directory
 
   int Mkdir(char *);   //!< Create a new directory
@@ -83,6 +108,10 @@ private:
   OpenFile *directoryFile; /*!< "Root" directory -- list of
                             file names, represented as a file
                             */
+  BitMap *freeMap;         /*!< In-memory copy of the bit map, kept
+                            while Nachos is running
+                           */
+  Lock *freeMapLock;       //!< Serializes the updates of freeMap
 };
 
 #endif   // FS_H
@@ -22,6 +22,13 @@
 */
 
 #include "filesys/filesys.h"
+#include "drivers/drvDisk.h"
+#include "filesys/bufcache.h"
+#include "filesys/filehdr.h"
+#include "filesys/journal.h"
+#include "filesys/openfile.h"
+#include "machine/disk.h"
+#include "machine/machine.h"
 #include "kernel/msgerror.h"
 #include "kernel/system.h"
 #include "kernel/thread.h"
@@ -30,6 +37,52 @@
 
 #define TransferSize 10   // make it small (10), just to be difficult
 
+//----------------------------------------------------------------------
+// Import
+// 	Write the contents of a host file to the data sectors of a Nachos
+//	file just created with the same length, directly in the disk
+//	image: one host write per extent of the file, instead of the
+//	simulated requests of OpenFile::Write (BulkImport mode). The
+//	inline data of a small file is written with its header.
+//----------------------------------------------------------------------
+static void
+Import(FILE *fp, int fileLength, OpenFile *openFile) {
+  int sectorSize = g_cfg->SectorSize;
+  int numSectors = divRoundUp(fileLength, sectorSize);
+  if (numSectors == 0)
+    return;
+
+  // Read the whole file, padded with zeroes to a number of sectors
+  char *data = new char[numSectors * sectorSize];
+  memset(data, 0, numSectors * sectorSize);
+  if (fread(data, 1, fileLength, fp) != (size_t) fileLength) {
+    printf("Copy: couldn't read Unix file\n");
+    exit(ERROR);
+  }
+
+  // Write each run of consecutive data sectors at once
+  FileHeader *hdr = openFile->GetFileHeader();
+  if (hdr->IsInline()) {
+    openFile->WriteAt(data, fileLength, 0);
+    delete[] data;
+    return;
+  }
+  int i = 0;
+  while (i < numSectors) {
+    int start = hdr->ByteToSector(i * sectorSize);
+    int n = 1;
+    while (i + n < numSectors &&
+           hdr->ByteToSector((i + n) * sectorSize) == start + n)
+      n++;
+    for (int k = 0; k < n && g_journal != NULL; k++)
+      g_journal->Revoke(start + k);
+    g_buffer_cache->Discard(start, n);
+    g_disk_driver->WriteImage(start, n, data + i * sectorSize);
+    i += n;
+  }
+  delete[] data;
+}
+
 //----------------------------------------------------------------------
 // Copy
 // 	Copy the contents of the UNIX file "from" to the Nachos file "to"
@@ -63,10 +116,15 @@ Copy(char *from, char *to) {
   openFile = g_file_system->Open(to);
   ASSERT(openFile != NULL);
 
-  // Copy the data in TransferSize chunks
-  char buffer[TransferSize];
-  while ((amountRead = fread(buffer, sizeof(char), TransferSize, fp)) > 0)
-    openFile->Write(buffer, amountRead);
+  // Copy the data in TransferSize chunks, or all at once in the disk
+  // image
+  if (g_cfg->BulkImport)
+    Import(fp, fileLength, openFile);
+  else {
+    char buffer[TransferSize];
+    while ((amountRead = fread(buffer, sizeof(char), TransferSize, fp)) > 0)
+      openFile->Write(buffer, amountRead);
+  }
 
   // Close the UNIX and the Nachos files
   delete openFile;
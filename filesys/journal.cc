@@ -0,0 +1,708 @@
+/*! \file journal.cc
+//  \brief Routines of the metadata journal
+//
+//	The metadata sectors written by the file system operations go to
+//	the running transaction, and to the buffer cache, which keeps them
+//	until the transaction commits: they must not reach their home
+//	sectors before (write-ahead logging). A kernel thread commits the
+//	running transaction some time after its first update
+//	(JournalCommitDelay), so that the operations of concurrent threads
+//	share the writes of a commit, and checkpoints once half of the log
+//	is used.
+//
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "filesys/journal.h"
+#include "drivers/drvDisk.h"
+#include "filesys/bufcache.h"
+#include "filesys/filesys.h"
+#include "kernel/msgerror.h"
+#include "kernel/synch.h"
+#include "kernel/system.h"
+#include "kernel/thread.h"
+#include "machine/machine.h"
+#include "utility/bitmap.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+
+//----------------------------------------------------------------------
+// TagsPerDescriptor
+//! 	Number of home sectors listed by a descriptor sector.
+//----------------------------------------------------------------------
+static int
+TagsPerDescriptor() {
+  return g_cfg->SectorSize / sizeof(uint32_t) - JOURNAL_DESC_HEADER;
+}
+
+//----------------------------------------------------------------------
+// Checksum
+/*! 	Fold the words of a sector into the checksum of a transaction.
+//
+//	\param sum the checksum of the previous sectors
+//	\param data the sector
+//	\return the new checksum
+*/
+//----------------------------------------------------------------------
+static uint32_t
+Checksum(uint32_t sum, char *data) {
+  uint32_t *words = (uint32_t *) data;
+  for (uint32_t i = 0; i < g_cfg->SectorSize / sizeof(uint32_t); i++)
+    sum = ((sum << 5) | (sum >> 27)) ^ words[i];
+  return sum;
+}
+
+//----------------------------------------------------------------------
+// WriteSuperblock
+/*! 	Write the superblock of the journal, saying that the log is
+//	empty and giving the sequence number of its next transaction.
+//
+//	\param size the sectors of the journal
+//	\param seq the sequence number of the next transaction
+*/
+//----------------------------------------------------------------------
+static void
+WriteSuperblock(int size, uint32_t seq) {
+  uint32_t sb[g_cfg->SectorSize / sizeof(uint32_t)];
+  memset(sb, 0, g_cfg->SectorSize);
+  sb[0] = JOURNAL_MAGIC;
+  sb[1] = size;
+  sb[2] = seq;
+  g_disk_driver->WriteSector(JournalSector, (char *) sb);
+  g_disk_driver->Sync();
+}
+
+//----------------------------------------------------------------------
+// CompareBlocks
+//! 	Order the blocks by home sector, for qsort.
+//----------------------------------------------------------------------
+static int
+CompareBlocks(const void *a, const void *b) {
+  return ((JournalBlock *) a)->sector - ((JournalBlock *) b)->sector;
+}
+
+//----------------------------------------------------------------------
+// JournalDaemon, JournalTimer
+/*! 	Body of the kernel thread of the journal, and handler of its
+//	commit timer. Need these to be C routines, because C++ can't
+//	handle pointers to member functions.
+*/
+//----------------------------------------------------------------------
+static void
+JournalDaemon(int64_t arg) {
+  ((Journal *) arg)->RunDaemon();
+}
+
+static void
+JournalTimer(int64_t arg) {
+  ((Journal *) arg)->Wakeup();
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+/*! 	Write an empty journal on a disk being formatted. The first
+//	sector of the log is cleared, so that a transaction left by a
+//	previous file system is not taken for a valid one. Without
+//	journal, the superblock of a previous one is cleared.
+//
+//	\param size the sectors of the journal, from JournalSector (0 for
+//	no journal)
+*/
+//----------------------------------------------------------------------
+void
+Journal::Format(int size) {
+  char zero[g_cfg->SectorSize];
+  memset(zero, 0, g_cfg->SectorSize);
+  if (size == 0) {
+    g_disk_driver->WriteSector(JournalSector, zero);
+    g_disk_driver->Sync();
+    return;
+  }
+  g_disk_driver->WriteSector(JournalSector + 1, zero);
+  WriteSuperblock(size, 1);
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+/*! 	Bring the file system back to a consistent state after a crash,
+//	before it is used: the transactions committed to the log, from
+//	its beginning, are written again to their home sectors. The
+//	replay stops at the first transaction not completely written (a
+//	descriptor with another sequence number, or a wrong checksum),
+//	then the log is emptied.
+//
+//	\param size is set to the sectors of the journal
+//	\param seq is set to the sequence number of the next transaction
+//	\return false if the disk has no journal
+*/
+//----------------------------------------------------------------------
+bool
+Journal::Recover(int *size, uint32_t *seq) {
+  int sectorSize = g_cfg->SectorSize;
+  int tags = TagsPerDescriptor();
+  uint32_t sb[sectorSize / sizeof(uint32_t)];
+
+  g_disk_driver->ReadSector(JournalSector, (char *) sb);
+  if (sb[0] != JOURNAL_MAGIC)
+    return false;
+  *size = sb[1];
+  uint32_t s = sb[2];
+
+  int pos = 1;
+  int replayed = 0;
+  while (pos + 2 < *size) {
+    // The first descriptor gives the length of the transaction
+    uint32_t desc[sectorSize / sizeof(uint32_t)];
+    g_disk_driver->ReadSector(JournalSector + pos, (char *) desc);
+    if (desc[0] != JOURNAL_DESC_MAGIC || desc[1] != s || desc[3] != 0)
+      break;
+    int count = desc[2];
+    int numDesc = divRoundUp(count, tags);
+    int length = numDesc + count + 1;
+    if (count <= 0 || pos + length > *size)
+      break;
+
+    char *log = new char[length * sectorSize];
+    char *bufs[length];
+    for (int i = 0; i < length; i++)
+      bufs[i] = &log[i * sectorSize];
+    g_disk_driver->ReadSectors(JournalSector + pos, length, bufs);
+
+    uint32_t sum = 0;
+    bool valid = true;
+    for (int d = 0; d < numDesc; d++) {
+      uint32_t *words = (uint32_t *) bufs[d];
+      if (words[0] != JOURNAL_DESC_MAGIC || words[1] != s ||
+          (int) words[3] != d)
+        valid = false;
+      sum = Checksum(sum, bufs[d]);
+    }
+    for (int i = 0; i < count; i++)
+      sum = Checksum(sum, bufs[numDesc + i]);
+    uint32_t *commit = (uint32_t *) bufs[length - 1];
+    if (!valid || commit[0] != JOURNAL_COMMIT_MAGIC || commit[1] != s ||
+        (int) commit[2] != count || commit[3] != sum) {
+      delete[] log;
+      break;
+    }
+
+    for (int i = 0; i < count; i++) {
+      uint32_t *words = (uint32_t *) bufs[i / tags];
+      g_buffer_cache->WriteSector(words[JOURNAL_DESC_HEADER + i % tags],
+                                  bufs[numDesc + i]);
+    }
+    delete[] log;
+    DEBUG('f', (char *) "Journal: replayed transaction %d, %d sectors\n", s,
+          count);
+    replayed++;
+    pos += length;
+    s++;
+  }
+
+  // The home sectors are written before the log is emptied
+  if (replayed > 0)
+    g_buffer_cache->Flush();
+  WriteSuperblock(*size, s);
+  *seq = s;
+  return true;
+}
+
+//----------------------------------------------------------------------
+// Journal::Journal
+/*! 	Use the journal of the disk, whose log is empty.
+//
+//	\param theSize the sectors of the journal, from JournalSector
+//	\param seq the sequence number of the next transaction
+//	\param map the in-memory free map, whose changes are logged with
+//	each transaction
+//	\param mapFile the file of the free map
+//	\param mapLock the lock serializing the updates of the free map
+*/
+//----------------------------------------------------------------------
+Journal::Journal(int theSize, uint32_t seq, BitMap *map, OpenFile *mapFile,
+                 Lock *mapLock) {
+  size = theSize;
+  head = 1;
+  logSeq = seq;
+  freeMap = map;
+  freeMapFile = mapFile;
+  freeMapLock = mapLock;
+
+  // The largest transaction that fits in the log
+  int tags = TagsPerDescriptor();
+  capacity = 1;
+  while (divRoundUp(capacity + 1, tags) + capacity + 2 <= size - 1)
+    capacity++;
+
+  // The blocks of the transactions get their storage when first used,
+  // the log holds at most size blocks
+  maxRunning = maxClosed = capacity;
+  running = new JournalBlock[capacity];
+  closed = new JournalBlock[capacity];
+  for (int i = 0; i < capacity; i++)
+    running[i].data = closed[i].data = NULL;
+  committed = new JournalBlock[size];
+  committedData = new char[size * g_cfg->SectorSize];
+  for (int i = 0; i < size; i++)
+    committed[i].data = &committedData[i * g_cfg->SectorSize];
+  numRunning = numClosed = numCommitted = 0;
+
+  handles = 0;
+  closing = false;
+  lock = new Lock((char *) "journal");
+  drained = new Condition((char *) "journal drained", lock);
+  reopened = new Condition((char *) "journal reopened", lock);
+  writer = new Lock((char *) "journal writer");
+  wake = new Semaphore((char *) "journal wake", 0);
+  daemon = NULL;
+  timer.armed = false;
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+//! 	De-allocate the journal.
+//----------------------------------------------------------------------
+Journal::~Journal() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  g_timer_wheel->Cancel(&timer);
+  g_machine->interrupt->SetStatus(oldLevel);
+  for (int i = 0; i < maxRunning; i++)
+    delete[] running[i].data;
+  for (int i = 0; i < maxClosed; i++)
+    delete[] closed[i].data;
+  delete[] running;
+  delete[] closed;
+  delete[] committed;
+  delete[] committedData;
+  delete lock;
+  delete drained;
+  delete reopened;
+  delete writer;
+
+  // The kernel thread is still blocked on its semaphore, it is deleted
+  // with the other threads: the semaphore must outlive it
+  if (daemon == NULL)
+    delete wake;
+}
+
+//----------------------------------------------------------------------
+// Journal::StartDaemon
+/*! 	Create the kernel thread that commits the transactions and
+//	checkpoints the log in the background.
+//
+//	\param owner process the thread is attached to
+*/
+//----------------------------------------------------------------------
+void
+Journal::StartDaemon(Process *owner) {
+  daemon = new Thread((char *) "journal");
+  if (daemon->StartKernel(owner, JournalDaemon, (int64_t) this) !=
+      NO_ERROR) {
+    fprintf(stderr, "Nachos boot error: cannot start journal thread\n");
+    exit(ERROR);
+  }
+}
+
+//----------------------------------------------------------------------
+// Journal::RunDaemon
+/*! 	Body of the kernel thread: commit the running transaction once
+//	its commit delay is over, and checkpoint once half of the log is
+//	used, so that the commits seldom wait for a checkpoint.
+*/
+//----------------------------------------------------------------------
+void
+Journal::RunDaemon() {
+  while (true) {
+    wake->P();
+    Commit();
+    if (head > size / 2)
+      Checkpoint();
+  }
+}
+
+//----------------------------------------------------------------------
+// Journal::Wakeup
+/*! 	Wake up the kernel thread, at the end of the commit delay. Called
+//	by the kernel timer, with interrupts disabled.
+*/
+//----------------------------------------------------------------------
+void
+Journal::Wakeup() {
+  wake->V();
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+/*! 	Start an operation updating the metadata. It waits while the
+//	running transaction is being closed, and commits it first if it
+//	is already half full, so that the operation fits in it.
+*/
+//----------------------------------------------------------------------
+void
+Journal::Begin() {
+  lock->Acquire();
+  while (true) {
+    while (closing)
+      reopened->Wait();
+    if (numRunning <= capacity / 2)
+      break;
+    lock->Release();
+    Commit();
+    lock->Acquire();
+  }
+  handles++;
+  lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+//! 	End an operation started by Begin.
+//----------------------------------------------------------------------
+void
+Journal::End() {
+  lock->Acquire();
+  ASSERT(handles > 0);
+  handles--;
+  if (handles == 0 && closing)
+    drained->Broadcast();
+  lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::FindBlock
+/*! 	Look for the block of a sector.
+//
+//	\param blocks the blocks
+//	\param count the number of blocks
+//	\param sector the home sector
+//	\return the block, NULL if the sector has none
+*/
+//----------------------------------------------------------------------
+JournalBlock *
+Journal::FindBlock(JournalBlock *blocks, int count, int32_t sector) {
+  for (int i = 0; i < count; i++)
+    if (blocks[i].sector == sector)
+      return &blocks[i];
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+// Journal::Write
+/*! 	Write a metadata sector: its contents join the running
+//	transaction (replacing the ones it already holds there), and the
+//	buffer cache.
+//
+//	\param sector the home sector
+//	\param data the new contents of the sector
+*/
+//----------------------------------------------------------------------
+void
+Journal::Write(int32_t sector, char *data) {
+  lock->Acquire();
+  ASSERT(handles > 0 || closing);
+  JournalBlock *block = FindBlock(running, numRunning, sector);
+  if (block == NULL) {
+    // An operation larger than the log makes the array grow
+    if (numRunning == maxRunning) {
+      JournalBlock *blocks = new JournalBlock[2 * maxRunning];
+      for (int i = 0; i < maxRunning; i++) {
+        blocks[i] = running[i];
+        blocks[maxRunning + i].data = NULL;
+      }
+      delete[] running;
+      running = blocks;
+      maxRunning *= 2;
+    }
+    block = &running[numRunning++];
+    block->sector = sector;
+    if (block->data == NULL)
+      block->data = new char[g_cfg->SectorSize];
+  }
+  memcpy(block->data, data, g_cfg->SectorSize);
+
+  // The first update of the transaction starts its commit delay
+  if (numRunning == 1 && !closing && !timer.armed) {
+    IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    g_timer_wheel->Add(&timer,
+                       g_stats->getTotalTicks() +
+                           nano_to_cycles(g_cfg->JournalCommitDelay,
+                                          g_cfg->ProcessorFrequency),
+                       JournalTimer, (int64_t) this);
+    g_machine->interrupt->SetStatus(oldLevel);
+  }
+  lock->Release();
+
+  g_buffer_cache->WriteLogged(sector, data);
+}
+
+//----------------------------------------------------------------------
+// Journal::Overlay
+/*! 	Replace the contents of a sector read from the disk by the most
+//	recent ones held by the journal, not written to the home sector
+//	yet: the ones of the running transaction, of the transaction being
+//	written, or of the log. Called by the buffer cache, it does not
+//	block, so the transactions do not change meanwhile.
+//
+//	\param sector the home sector
+//	\param data the contents read, replaced if the journal has the sector
+*/
+//----------------------------------------------------------------------
+void
+Journal::Overlay(int32_t sector, char *data) {
+  JournalBlock *block = FindBlock(running, numRunning, sector);
+  if (block == NULL)
+    block = FindBlock(closed, numClosed, sector);
+  if (block == NULL)
+    block = FindBlock(committed, numCommitted, sector);
+  if (block != NULL)
+    memcpy(data, block->data, g_cfg->SectorSize);
+}
+
+//----------------------------------------------------------------------
+// Journal::Revoke
+/*! 	A freed metadata sector is about to hold file data, which do not
+//	go through the journal: the journal must neither write its old
+//	contents to the home sector, nor replay them after a crash. The
+//	sector leaves the running transaction, and the log is checkpointed
+//	if it holds the sector. Called before writing file data, without
+//	being in an operation.
+//
+//	\param sector the home sector
+*/
+//----------------------------------------------------------------------
+void
+Journal::Revoke(int32_t sector) {
+  if (FindBlock(running, numRunning, sector) == NULL &&
+      FindBlock(closed, numClosed, sector) == NULL &&
+      FindBlock(committed, numCommitted, sector) == NULL)
+    return;
+
+  lock->Acquire();
+  JournalBlock *block = FindBlock(running, numRunning, sector);
+  if (block != NULL) {
+    JournalBlock last = running[--numRunning];
+    running[numRunning] = *block;
+    *block = last;
+  }
+  lock->Release();
+
+  if (FindBlock(closed, numClosed, sector) != NULL ||
+      FindBlock(committed, numCommitted, sector) != NULL)
+    Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+/*! 	Commit the running transaction: once its operations are done,
+//	the changes of the free map join it, and the next operations go
+//	to a new transaction while it is written to the log. Its blocks
+//	can then reach their home sectors.
+//
+//	A transaction larger than the log is written as several
+//	transactions of the log, checkpointing it in between.
+*/
+//----------------------------------------------------------------------
+void
+Journal::Commit() {
+  writer->Acquire();
+
+  lock->Acquire();
+  closing = true;
+  while (handles > 0)
+    drained->Wait();
+  lock->Release();
+
+  freeMapLock->Acquire();
+  freeMap->WriteChanges(freeMapFile);
+  freeMapLock->Release();
+
+  lock->Acquire();
+  JournalBlock *blocks = running;
+  int max = maxRunning;
+  running = closed;
+  maxRunning = maxClosed;
+  closed = blocks;
+  maxClosed = max;
+  numClosed = numRunning;
+  numRunning = 0;
+  closing = false;
+  reopened->Broadcast();
+  lock->Release();
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  g_timer_wheel->Cancel(&timer);
+  g_machine->interrupt->SetStatus(oldLevel);
+
+  for (int done = 0; done < numClosed; done += capacity)
+    WriteLog(&closed[done], (numClosed - done < capacity) ? numClosed - done
+                                                          : capacity);
+  numClosed = 0;
+  writer->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteLog
+/*! 	Write a transaction to the log, after a checkpoint if the log is
+//	full: the descriptors, the blocks and the commit sector are
+//	written with a single disk request. The caller holds writer.
+//
+//	\param blocks the blocks of the transaction
+//	\param count the number of blocks, at most capacity
+*/
+//----------------------------------------------------------------------
+void
+Journal::WriteLog(JournalBlock *blocks, int count) {
+  int sectorSize = g_cfg->SectorSize;
+  int tags = TagsPerDescriptor();
+  int numDesc = divRoundUp(count, tags);
+  int length = numDesc + count + 1;
+  if (head + length > size)
+    CheckpointLocked();
+  ASSERT(head + length <= size);
+  uint32_t seq = logSeq;
+
+  // Build the descriptors and the commit sector around the blocks
+  char *meta = new char[(numDesc + 1) * sectorSize];
+  memset(meta, 0, (numDesc + 1) * sectorSize);
+  char **bufs = new char *[length];
+  for (int d = 0; d < numDesc; d++) {
+    uint32_t *desc = (uint32_t *) &meta[d * sectorSize];
+    desc[0] = JOURNAL_DESC_MAGIC;
+    desc[1] = seq;
+    desc[2] = count;
+    desc[3] = d;
+    bufs[d] = (char *) desc;
+  }
+  for (int i = 0; i < count; i++) {
+    ((uint32_t *) bufs[i / tags])[JOURNAL_DESC_HEADER + i % tags] =
+        blocks[i].sector;
+    bufs[numDesc + i] = blocks[i].data;
+  }
+  uint32_t sum = 0;
+  for (int i = 0; i < numDesc + count; i++)
+    sum = Checksum(sum, bufs[i]);
+  uint32_t *commit = (uint32_t *) &meta[numDesc * sectorSize];
+  commit[0] = JOURNAL_COMMIT_MAGIC;
+  commit[1] = seq;
+  commit[2] = count;
+  commit[3] = sum;
+  bufs[length - 1] = (char *) commit;
+
+  DEBUG('f', (char *) "Journal: commit %d, %d sectors at %d\n", seq, count,
+        head);
+  g_disk_driver->WriteSectors(JournalSector + head, length, bufs);
+  g_disk_driver->Sync();
+  head += length;
+  logSeq = seq + 1;
+  delete[] bufs;
+  delete[] meta;
+
+  // Remember the committed contents, for the checkpoint
+  for (int i = 0; i < count; i++) {
+    JournalBlock *c = FindBlock(committed, numCommitted, blocks[i].sector);
+    if (c == NULL) {
+      c = &committed[numCommitted++];
+      c->sector = blocks[i].sector;
+    }
+    memcpy(c->data, blocks[i].data, sectorSize);
+  }
+  g_stats->incrJournalCommits(count);
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+/*! 	Write the committed blocks to their home sectors, and empty the
+//	log.
+*/
+//----------------------------------------------------------------------
+void
+Journal::Checkpoint() {
+  writer->Acquire();
+  CheckpointLocked();
+  writer->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::CheckpointLocked
+/*! 	Checkpoint, the caller holding writer. The committed contents of
+//	the sectors are written in sector order, by runs of consecutive
+//	sectors, then the superblock marks the log as empty. The running
+//	transaction goes on meanwhile.
+*/
+//----------------------------------------------------------------------
+void
+Journal::CheckpointLocked() {
+  if (head == 1)
+    return;
+
+  qsort(committed, numCommitted, sizeof(JournalBlock), CompareBlocks);
+  int i = 0;
+  while (i < numCommitted) {
+    int n = 1;
+    while (i + n < numCommitted &&
+           committed[i + n].sector == committed[i].sector + n)
+      n++;
+    char *bufs[n];
+    for (int k = 0; k < n; k++)
+      bufs[k] = committed[i + k].data;
+    g_disk_driver->WriteSectors(committed[i].sector, n, bufs);
+    i += n;
+  }
+  g_disk_driver->Sync();
+
+  DEBUG('f', (char *) "Journal: checkpoint of %d sectors\n", numCommitted);
+  WriteSuperblock(size, logSeq);
+  head = 1;
+  numCommitted = 0;
+  g_stats->incrCheckpoints();
+}
+
+//----------------------------------------------------------------------
+// WriteMetadata
+/*! 	Write a metadata sector (file header, directory, free map),
+//	through the journal if the disk has one, else through the buffer
+//	cache.
+//
+//	\param sector the home sector
+//	\param data the new contents of the sector
+*/
+//----------------------------------------------------------------------
+void
+WriteMetadata(int32_t sector, char *data) {
+  if (g_journal != NULL)
+    g_journal->Write(sector, data);
+  else
+    g_buffer_cache->WriteSector(sector, data);
+}
+
+//----------------------------------------------------------------------
+// BeginMetadataUpdate, EndMetadataUpdate
+/*! 	Delimit an operation updating metadata, so that its sectors and
+//	its changes of the free map go to the same transaction. Nothing is
+//	done without journal.
+*/
+//----------------------------------------------------------------------
+void
+BeginMetadataUpdate() {
+  if (g_journal != NULL)
+    g_journal->Begin();
+}
+
+void
+EndMetadataUpdate() {
+  if (g_journal != NULL)
+    g_journal->End();
+}
@@ -0,0 +1,177 @@
+/*! \file journal.h
+    \brief Data structures of the metadata journal
+
+        The journal makes the updates of the file system metadata (file
+        headers, directories, free map) atomic and sequential: instead
+        of being written to their home sectors, scattered across the
+        disk, the metadata sectors modified by the file system
+        operations are gathered in a transaction, written in a single
+        request to a log kept in a reserved region of the disk (group
+        commit). They reach their home sectors later, in the background
+        (checkpoint). After a crash, the transactions of the log are
+        written again to their home sectors at boot, without scanning
+        the file system.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "kernel/copyright.h"
+#include "kernel/timerwheel.h"
+#include "utility/utility.h"
+
+class BitMap;
+class Condition;
+class Lock;
+class OpenFile;
+class Process;
+class Semaphore;
+class Thread;
+
+//! Magic numbers of the superblock, descriptor and commit sectors
+#define JOURNAL_MAGIC        0x4a4e4c53
+#define JOURNAL_DESC_MAGIC   0x4a4e4c44
+#define JOURNAL_COMMIT_MAGIC 0x4a4e4c43
+
+//! Words at the beginning of a descriptor sector, before the home
+//! sectors of the blocks
+#define JOURNAL_DESC_HEADER 4
+
+/*! \brief Defines a metadata sector held by the journal
+*/
+struct JournalBlock {
+  int32_t sector;   //!< home sector
+  char *data;       //!< contents to be written to the home sector
+};
+
+/*! \brief Defines the metadata journal
+//
+// The log occupies the sectors following the superblock, at
+// JournalSector. Each transaction is written after the previous one,
+// as one run of sectors: descriptor sectors listing the home sectors
+// of the blocks, the blocks, and a commit sector holding a checksum
+// of the blocks. A checkpoint writes the committed blocks to their
+// home sectors and empties the log, the superblock then giving the
+// sequence number of the next transaction, the first one to replay
+// after a crash.
+//
+// A file system operation updating metadata runs between Begin and
+// End: its sectors, written with Write, join the running transaction,
+// so that the transaction never holds a partial operation. A sector
+// written again before the commit is updated in place. A transaction
+// larger than the log is written as several transactions of the log.
+//
+// The journal keeps the sectors until they reach their home sectors:
+// the buffer cache may drop them, and takes them from the journal when
+// reading them again (see Overlay).
+*/
+class Journal {
+public:
+  //! Write an empty journal of size sectors (format)
+  static void Format(int size);
+
+  //! Replay the transactions of the log, false if the disk has no journal
+  static bool Recover(int *size, uint32_t *seq);
+
+  //! Use the journal of size sectors, whose next transaction is seq
+  Journal(int size, uint32_t seq, BitMap *freeMap, OpenFile *freeMapFile,
+          Lock *freeMapLock);
+
+  //! De-allocate the journal (Sync must have been called before)
+  ~Journal();
+
+  //! Start the kernel thread that commits and checkpoints
+  void StartDaemon(Process *owner);
+
+  //! Start and end an operation updating the metadata
+  void Begin();
+  void End();
+
+  //! Write a metadata sector, in the running transaction
+  void Write(int32_t sector, char *data);
+
+  //! Give the contents of a sector read from the disk, if more recent
+  void Overlay(int32_t sector, char *data);
+
+  //! Forget a sector about to hold file data
+  void Revoke(int32_t sector);
+
+  //! Commit the running transaction, with the changes of the free map
+  void Commit();
+
+  //! Write the committed blocks to their home sectors, empty the log
+  void Checkpoint();
+
+  //! Body of the kernel thread
+  void RunDaemon();
+
+  //! Wake up the kernel thread (commit timer)
+  void Wakeup();
+
+private:
+  //! Checkpoint, with writer held
+  void CheckpointLocked();
+
+  //! Write blocks of the closed transaction to the log, with writer held
+  void WriteLog(JournalBlock *blocks, int count);
+
+  //! Find a block in an array of blocks, NULL if absent
+  JournalBlock *FindBlock(JournalBlock *blocks, int count, int32_t sector);
+
+  int size;                 //!< sectors of the journal, superblock included
+  int head;                 //!< offset of the next transaction in the log
+  uint32_t logSeq;          //!< sequence number of the next transaction
+                            //!< written to the log
+  int capacity;             //!< maximum number of blocks of a transaction
+                            //!< of the log
+
+  JournalBlock *running;    //!< blocks of the running transaction
+  int numRunning;
+  int maxRunning;           //!< size of the array, grows if needed
+  JournalBlock *closed;     //!< blocks of the transaction being written
+  int numClosed;
+  int maxClosed;
+  JournalBlock *committed;  //!< last committed contents of the sectors
+  int numCommitted;         //!< not checkpointed yet
+  char *committedData;      //!< storage of the contents of committed
+
+  int handles;              //!< operations in the running transaction
+  bool closing;             //!< the running transaction is being closed
+
+  Lock *lock;               //!< protects the running transaction
+  Condition *drained;       //!< signaled when handles drops to 0
+  Condition *reopened;      //!< signaled when a new transaction starts
+  Lock *writer;             //!< serializes the commits and checkpoints
+  Semaphore *wake;          //!< wakes up the kernel thread
+  Thread *daemon;           //!< the kernel thread, NULL if not started
+  KernelTimer timer;        //!< commit delay of the running transaction
+
+  BitMap *freeMap;          //!< the free map, logged at each commit
+  OpenFile *freeMapFile;
+  Lock *freeMapLock;
+};
+
+//! Write a metadata sector, through the journal if there is one
+void WriteMetadata(int32_t sector, char *data);
+
+//! Delimit an operation updating metadata (see Journal::Begin)
+void BeginMetadataUpdate();
+void EndMetadataUpdate();
+
+#endif   // JOURNAL_H
@@ -22,8 +22,10 @@
 */
 
 #include "filesys/oftable.h"
+#include "filesys/dcache.h"
 #include "filesys/directory.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "kernel/msgerror.h"
 #include "kernel/system.h"
 #include "utility/bitmap.h"
@@ -35,12 +37,14 @@
  */
 //----------------------------------------------------------
 OpenFileTableEntry::OpenFileTableEntry() {
-  name = new char[g_cfg->MaxFileNameSize];
-  numthread = 1;
+  name = (char *) SlabAlloc(g_cfg->MaxFileNameSize);
+  numthread = 0;
   ToBeDeleted = false;
   lock = new Lock((char *) "File Synchronisation");
   file = NULL;
   sector = INVALID_SECTOR;
+  nextByName = NULL;
+  nextBySector = NULL;
 }
 
 //----------------------------------------------------------
@@ -51,20 +55,63 @@ OpenFileTableEntry::OpenFileTableEntry() {
 */
 //----------------------------------------------------------
 OpenFileTableEntry::~OpenFileTableEntry() {
-  if (ToBeDeleted) {
-    // Get the freemap from disk
-    BitMap freeMap(NUM_SECTORS);
-    freeMap.FetchFrom(g_file_system->GetFreeMapFile());
+  Release();
+  SlabFree(name, g_cfg->MaxFileNameSize);
+  delete lock;
+}
 
+//----------------------------------------------------------
+// OpenFileTableEntry::Release()
+/*! Delete the file from the file system if the boolean
+// ToBeDeleted is set to true, and close it. The entry keeps
+// its lock and name buffer, to be filled again by the next
+// open.
+*/
+//----------------------------------------------------------
+void
+OpenFileTableEntry::Release() {
+  if (ToBeDeleted) {
     // Indicate that some sectors are freed due to the file deletion
-    file->GetFileHeader()->Deallocate(&freeMap);
-    freeMap.Clear(sector);
-    // Write the freemap back to disk
-    freeMap.WriteBack(g_file_system->GetFreeMapFile());
+    BeginMetadataUpdate();
+    BitMap *freeMap = g_file_system->GetFreeMap();
+    file->GetFileHeader()->Deallocate(freeMap);
+    freeMap->Clear(sector);
+    g_file_system->ReleaseFreeMap();
+    EndMetadataUpdate();
   }
-  delete[] name;
   delete file;
-  delete lock;
+  file = NULL;
+  numthread = 0;
+  ToBeDeleted = false;
+  sector = INVALID_SECTOR;
+  nextByName = NULL;
+  nextBySector = NULL;
+}
+
+//----------------------------------------------------------
+// static unsigned HashName(char *name)
+/*! FNV-1a hash of a file name, folded to a bucket of the
+//  open file table.
+*/
+//----------------------------------------------------------
+static unsigned
+HashName(char *name) {
+  unsigned h = 2166136261u;
+  for (; *name != '\0'; name++) {
+    h ^= (unsigned char) *name;
+    h *= 16777619u;
+  }
+  return h & (OFT_BUCKETS - 1);
+}
+
+//----------------------------------------------------------
+// static unsigned HashSector(int sector)
+/*! bucket of the open file table for a header sector.
+ */
+//----------------------------------------------------------
+static unsigned
+HashSector(int sector) {
+  return (unsigned) sector & (OFT_BUCKETS - 1);
 }
 
 //----------------------------------------------------------
@@ -74,118 +121,138 @@ OpenFileTableEntry::~OpenFileTableEntry() {
 //----------------------------------------------------------
 OpenFileTable::OpenFileTable() {
   createLock = new Lock((char *) "Creation Synch");
-  for (int i = 0; i < NBOFTENTRY; i++) {
-    table[i] = NULL;
+  for (int i = 0; i < OFT_BUCKETS; i++) {
+    byName[i] = NULL;
+    bySector[i] = NULL;
   }
-  nbentry = 0;
+  numEntries = 0;
+  freeEntries = NULL;
 }
 //----------------------------------------------------------
 // OpenFileTable::~OpenFileTable()
 /*! initialize the open file table.
  */
 //----------------------------------------------------------
-OpenFileTable::~OpenFileTable() { delete createLock; }
+OpenFileTable::~OpenFileTable() {
+  while (freeEntries != NULL) {
+    OpenFileTableEntry *entry = freeEntries;
+    freeEntries = entry->nextByName;
+    delete entry;
+  }
+  delete createLock;
+}
+
+//----------------------------------------------------------
+// OpenFileTable::NewEntry()
+/*! Give an empty entry: a closed one if any, whose lock and
+// name buffer are reused, else a new one.
+//
+// \return the entry, in no index
+*/
+//----------------------------------------------------------
+OpenFileTableEntry *
+OpenFileTable::NewEntry() {
+  OpenFileTableEntry *entry = freeEntries;
+  if (entry == NULL)
+    return new OpenFileTableEntry;
+  freeEntries = entry->nextByName;
+  entry->nextByName = NULL;
+  return entry;
+}
 
 //----------------------------------------------------------
 // void OpenFileTable::Open(char *name,Openfile *file)
 /*! check if the file is already open
 // and if not creates a new entry in
-// the table.
+// the table. The file is looked up by name first, then by
+// header sector, so that a file opened under two different
+// paths still gets a single entry. The returned OpenFile
+// shares the file header of the entry.
 //
 // \return the open file
 // \param name is the name of the file
-// \param file is an Openfile object to strore in the table
 */
 //----------------------------------------------------------
 OpenFile *
 OpenFileTable::Open(char *name) {
-  OpenFile *newfile = NULL;
-  int num, sector, dirsector;
+  OpenFile *newfile;
+  OpenFileTableEntry *entry;
+  int sector, dirsector;
   char filename[g_cfg->MaxFileNameSize];
 
   // Find the file in the open file table
-  num = findl(name);
   DEBUG('f', (char *) "opening file %s\n", name);
-  if (num != ERROR) {
-    // The file is opened by another thread
-    if (!table[num]->ToBeDeleted) {
-      // Update the reference count and return an OpenFile
-      table[num]->numthread++;
-      newfile = new OpenFile(table[num]->sector);
-      newfile->SetName(name);
-      DEBUG('f', (char *) "File %s was in the table\n", name);
-      return newfile;
-    } else
-      return NULL;
-  } else {
-    if (nbentry != ERROR) {   // there is some place in the table
-      OpenFileTableEntry *entry = new OpenFileTableEntry;
-      OpenFile *openfile = NULL;
-      Directory directory(g_cfg->NumDirEntries);
+  entry = FindByName(name);
+  if (entry == NULL) {
+    strcpy(filename, name);
 
-      strcpy(entry->name, name);
-      strcpy(filename, name);
+    // Find the directory containing the file
+    dirsector = FindDir(filename);
+    if (dirsector == INVALID_SECTOR)
+      return NULL;
 
-      // Find the directory containing the file and read it from the disk
-      dirsector = FindDir(filename);
-      if (dirsector == INVALID_SECTOR)
-        return NULL;
-      OpenFile dirfile(dirsector);
-      directory.FetchFrom(&dirfile);
+    // Find the file in the directory
+    bool isDir;
+    sector = FindName(dirsector, filename, &isDir);
+    if (sector < 0 || isDir)   // name isn't in directory or is a directory
+      return NULL;
 
-      // Find the file in the directory
-      sector = directory.Find(filename);
-      if (sector >= 0) {
-        openfile = new OpenFile(sector);   // name was found in directory
-        if (openfile->IsDir()) {           // name is a directory ...
-          delete openfile;
-          delete entry;
-          return NULL;
-        }
-      } else {   // name isn't in directory
-        delete entry;
+    entry = FindBySector(sector);
+    if (entry == NULL) {
+      if (numEntries == NBOFTENTRY) {   // there is no place in the table
+        printf("OFT OPEN: File %s cannot be opened ", name);
         return NULL;
       }
 
-      // We found the file
-      newfile = new OpenFile(sector);   // we fill the new entry
-      newfile->SetName(name);
-      openfile->SetName(name);
+      // We found the file: fill a new entry
+      entry = NewEntry();
+      strcpy(entry->name, name);
       entry->sector = sector;
-      entry->file = openfile;
-      table[nbentry] = entry;
-      nbentry = next_entry();
-
+      entry->file = new OpenFile(sector);
+      entry->file->SetName(name);
+      Insert(entry);
       DEBUG('f', (char *) "File %s has been opened successfully\n", name);
-      return newfile;
-    } else {
-      printf("OFT OPEN: File %s cannot be opened ", name);
-      return NULL;
-    }
-  }
+    } else
+      DEBUG('f', (char *) "File %s was in the table as %s\n", name,
+            entry->name);
+  } else
+    DEBUG('f', (char *) "File %s was in the table\n", name);
+
+  // The file may have been removed while other threads have it open
+  if (entry->ToBeDeleted)
+    return NULL;
+
+  // Update the reference count and return an OpenFile
+  entry->numthread++;
+  newfile = new OpenFile(entry->file);
+  newfile->SetName(name);
+  return newfile;
 }
 
 //----------------------------------------------------------
-// void OpenFileTable::Close(char *name)
+// void OpenFileTable::Close(OpenFile *file)
 /*! called when a thread closes a file : this method
 // decrease numthread and if it is null then the entry is
-// deleted.
-// \param name is the name of the file to close
+// deleted. The caller deletes its OpenFile afterwards.
+// \param file is the open file to close
 */
 //----------------------------------------------------------
 void
-OpenFileTable::Close(char *name) {
-  int num;
-  DEBUG('f', (char *) "Closing File %s \n", name);
-  num = findl(name);
-  if (num != ERROR) {          // the file is in the table
-    table[num]->numthread--;   // the thread has no longer this file opened
-    if (table[num]->numthread <= 0) {   // if no threads has this file opened
-      DEBUG('f', (char *) "File %s is no more in the table\n", name);
-      delete table[num];   // then remove it from the table
-      table[num] = NULL;
+OpenFileTable::Close(OpenFile *file) {
+  OpenFileTableEntry *entry;
+  DEBUG('f', (char *) "Closing File %s \n", file->GetName());
+  entry = FindBySector(file->GetSector());
+  if (entry != NULL) {   // the file is in the table
+    entry->numthread--;   // the thread has no longer this file opened
+    if (entry->numthread <= 0) {   // if no threads has this file opened
+      DEBUG('f', (char *) "File %s is no more in the table\n", entry->name);
+      Unlink(entry);   // then remove it from the table
+      entry->Release();
+      entry->nextByName = freeEntries;
+      freeEntries = entry;
     }
-    DEBUG('f', (char *) "File %s has been closed successfully\n", name);
+    DEBUG('f', (char *) "File %s has been closed successfully\n",
+          file->GetName());
   }
 }
 
@@ -199,10 +266,9 @@ OpenFileTable::Close(char *name) {
 //----------------------------------------------------------
 void
 OpenFileTable::FileLock(char *name) {
-  int num;
-  num = findl(name);
-  if (num != ERROR) {
-    table[num]->lock->Acquire();
+  OpenFileTableEntry *entry = FindByName(name);
+  if (entry != NULL) {
+    entry->lock->Acquire();
     DEBUG('f', (char *) "File %s has been locked\n", name);
   }
 }
@@ -216,32 +282,85 @@ OpenFileTable::FileLock(char *name) {
 //----------------------------------------------------------
 void
 OpenFileTable::FileRelease(char *name) {
-  int num;
-  num = findl(name);
-  if (num != ERROR) {
-    table[num]->lock->Release();
+  OpenFileTableEntry *entry = FindByName(name);
+  if (entry != NULL) {
+    entry->lock->Release();
     DEBUG('f', (char *) "File %s has been released\n", name);
   }
 }
+
 //----------------------------------------------------------
-// int OpenFileTable::findl(char *name)
-/*!find a file in the table return
+// OpenFileTableEntry *OpenFileTable::FindByName(char *name)
+/*! find a file in the table from the name it was first
+//  opened with
 //
-// \return ERROR if the file is not in the table
-//         or its place in the table if it was already opened
+// \return NULL if the file is not in the table
+//         or its entry if it was already opened
 // \param name is the name of the file we want to find
 */
 //----------------------------------------------------------
-int
-OpenFileTable::findl(char *name) {
-  int i = 0;
-  while (i < NBOFTENTRY) {
-    if (table[i] != NULL)
-      if (strcmp(table[i]->name, name) == 0)
-        return i;
-    i++;
-  }
-  return ERROR;
+OpenFileTableEntry *
+OpenFileTable::FindByName(char *name) {
+  OpenFileTableEntry *entry = byName[HashName(name)];
+  while (entry != NULL && strcmp(entry->name, name) != 0)
+    entry = entry->nextByName;
+  return entry;
+}
+
+//----------------------------------------------------------
+// OpenFileTableEntry *OpenFileTable::FindBySector(int sector)
+/*! find a file in the table from the sector of its header
+//
+// \return NULL if the file is not in the table
+//         or its entry if it was already opened
+// \param sector is the sector of the file header
+*/
+//----------------------------------------------------------
+OpenFileTableEntry *
+OpenFileTable::FindBySector(int sector) {
+  OpenFileTableEntry *entry = bySector[HashSector(sector)];
+  while (entry != NULL && entry->sector != sector)
+    entry = entry->nextBySector;
+  return entry;
+}
+
+//----------------------------------------------------------
+// void OpenFileTable::Insert(OpenFileTableEntry *entry)
+/*! add a new entry at the head of its name and sector buckets
+//
+// \param entry is the entry to add, with its name and sector set
+*/
+//----------------------------------------------------------
+void
+OpenFileTable::Insert(OpenFileTableEntry *entry) {
+  unsigned n = HashName(entry->name);
+  unsigned s = HashSector(entry->sector);
+  entry->nextByName = byName[n];
+  byName[n] = entry;
+  entry->nextBySector = bySector[s];
+  bySector[s] = entry;
+  numEntries++;
+}
+
+//----------------------------------------------------------
+// void OpenFileTable::Unlink(OpenFileTableEntry *entry)
+/*! take an entry out of its name and sector buckets
+//
+// \param entry is the entry to remove, which must be in the table
+*/
+//----------------------------------------------------------
+void
+OpenFileTable::Unlink(OpenFileTableEntry *entry) {
+  OpenFileTableEntry **p;
+  p = &byName[HashName(entry->name)];
+  while (*p != entry)
+    p = &(*p)->nextByName;
+  *p = entry->nextByName;
+  p = &bySector[HashSector(entry->sector)];
+  while (*p != entry)
+    p = &(*p)->nextBySector;
+  *p = entry->nextBySector;
+  numEntries--;
 }
 
 //----------------------------------------------------------
@@ -259,7 +378,8 @@ OpenFileTable::findl(char *name) {
 int
 OpenFileTable::Remove(char *name) {
   Directory directory(g_cfg->NumDirEntries);
-  int num, sector, dirsector;
+  OpenFileTableEntry *entry;
+  int sector, dirsector;
   char filename[g_cfg->MaxFileNameSize];
 
   DEBUG('f', (char *) "Removing file %s\n", name);
@@ -277,32 +397,18 @@ OpenFileTable::Remove(char *name) {
   if (sector == INVALID_SECTOR)
     return INEXIST_FILE_ERROR;   // file not found
 
-  // Scan the open file table
-  num = findl(name);
-  if (num != ERROR) {   // file is opened by a thread
-    table[num]->ToBeDeleted = true;
+  // Look up the open file table, by header so that the file is
+  // found whatever the name it was opened with
+  entry = FindBySector(sector);
+  if (entry != NULL) {   // file is opened by a thread
+    entry->ToBeDeleted = true;
     directory.Remove(filename);
+    BeginMetadataUpdate();
     directory.WriteBack(&dirfile);
+    EndMetadataUpdate();
+    g_dentry_cache->Enter(dirsector, filename, ERROR, false);
   } else {   // file isn't opened
     return (g_file_system->Remove(name));
   }
   return NO_ERROR;
 }
-//----------------------------------------------------------
-// int OpenFileTable::next_entry()
-/*! this function looks in the table where
-//  it is possible to add a new entry
-//
-// \return the next valid entry in the table
-*/
-//----------------------------------------------------------
-int
-OpenFileTable::next_entry() {
-  int i = 0;
-  while (i < NBOFTENTRY) {
-    if (table[i] == NULL)
-      return i;
-    i++;
-  }
-  return ERROR;
-}
@@ -4,9 +4,11 @@
    This data structure maintain a list of all the files open in the
    system. It keep track of all of the files currently open. When a
    new thread opens a file, the open table would be checked to see
-   if any other thread already has it open. The processes still
-   maintain a private copy of the openfile objects. The file table
-   is only used to synchronise accesses to these files.
+   if any other thread already has it open. Each process gets its
+   own openfile object (with its own seek position), but all the
+   openfile objects of a same file share the in-memory file header
+   kept by the table entry. Entries are indexed both by name and by
+   header sector, so that lookups do not depend on the table size.
 
  * -----------------------------------------------------
  * This file is part of the Nachos-RiscV distribution
@@ -35,6 +37,10 @@
 // same time.
 #define NBOFTENTRY 15
 
+// number of hash buckets of each index of the open file table
+// (must be a power of two)
+#define OFT_BUCKETS 32
+
 /*! \brief defines the structure of a record in the open file table
  */
 class OpenFileTableEntry {
@@ -47,8 +53,12 @@ public:
                       when every thread will close it.
                     */
   int sector;       //!< the disc sector where is located the fileheader
+  OpenFileTableEntry *nextByName;     //!< next entry in the name bucket
+  OpenFileTableEntry *nextBySector;   //!< next entry in the sector bucket
   OpenFileTableEntry();
   ~OpenFileTableEntry();   // delete the file if necessary
+  void Release();          // delete the file if necessary, and close it
+                           // so that the entry can be reused
 };
 
 /*! \brief Defines a list of all opened files
@@ -65,7 +75,7 @@ public:
                                    and if not creates a new entry in
                                    the table
                                */
-  void Close(char *name);     /*!< decrease numthread and if numthread
+  void Close(OpenFile *file); /*!< decrease numthread and if numthread
                                 is 0 then remove the file from
                                 the open file table
                               */
@@ -77,13 +87,22 @@ public:
 
   int Remove(char *name);   //!< remove the file from the file system
 
-  int next_entry();   //!< this function give the next valid entry in the table
   Lock *createLock;
 
 private:
-  OpenFileTableEntry *table[NBOFTENTRY];   //!< the list of open files
-  int nbentry;             //!< the number of the next valid entry in the table
-  int findl(char *name);   // find a file in the table
+  OpenFileTableEntry *byName[OFT_BUCKETS];     //!< entries hashed by name
+  OpenFileTableEntry *bySector[OFT_BUCKETS];   //!< entries hashed by sector
+  int numEntries;   //!< the number of files in the table
+  OpenFileTableEntry *freeEntries;   /*!< closed entries, kept with their
+                                        lock and name buffer for the
+                                        next open (linked by nextByName)
+                                     */
+
+  OpenFileTableEntry *FindByName(char *name);   // find a file by its name
+  OpenFileTableEntry *FindBySector(int sector);   // find a file by its header
+  void Insert(OpenFileTableEntry *entry);   // add an entry to both indexes
+  OpenFileTableEntry *NewEntry();   // a free entry, reused if possible
+  void Unlink(OpenFileTableEntry *entry);   // take an entry out of them
 };
 
 #endif   // FS_OFT
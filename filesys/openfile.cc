@@ -26,7 +26,11 @@
 
 #include "filesys/openfile.h"
 #include "drivers/drvDisk.h"
+#include "filesys/bufcache.h"
 #include "filesys/filehdr.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "kernel/elf.h"
 #include "kernel/msgerror.h"
 #include "kernel/system.h"
 #include <strings.h>
@@ -42,7 +46,8 @@
 OpenFile::OpenFile(int sector) {
   // Allocate the file header and file name
   hdr = new FileHeader;
-  name = new char[g_cfg->MaxFileNameSize];
+  name = (char *) SlabAlloc(g_cfg->MaxFileNameSize);
+  name[0] = '\0';
   ASSERT(hdr != 0);
 
   // Fetch the file header from disk
@@ -51,6 +56,31 @@ OpenFile::OpenFile(int sector) {
   // Set OpenFile parameters
   fSector = sector;
   seekPosition = 0;
+  ownsHdr = true;
+  raNext = raWindow = raEnd = 0;
+  type = FILE_TYPE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::OpenFile
+/*! 	Open another handle on an already open Nachos file. The file
+//	header is not fetched again: the new handle points at the header
+//	of "shared", so that a change of the file length or of its
+//	allocation is seen at once through every handle. The handle has
+//	its own seek position.
+//
+//	\param shared the handle whose file header is shared. It must
+//	outlive the new handle.
+*/
+//----------------------------------------------------------------------
+OpenFile::OpenFile(OpenFile *shared) {
+  hdr = shared->hdr;
+  name = (char *) SlabAlloc(g_cfg->MaxFileNameSize);
+  strcpy(name, shared->name);
+  fSector = shared->fSector;
+  seekPosition = 0;
+  ownsHdr = false;
+  raNext = raWindow = raEnd = 0;
   type = FILE_TYPE;
 }
 
@@ -60,8 +90,9 @@ OpenFile::OpenFile(int sector) {
 //----------------------------------------------------------------------
 OpenFile::~OpenFile() {
   type = INVALID_TYPE;
-  delete hdr;
-  delete[] name;
+  if (ownsHdr)
+    delete hdr;
+  SlabFree(name, g_cfg->MaxFileNameSize);
 }
 
 //----------------------------------------------------------------------
@@ -78,13 +109,26 @@ OpenFile::Seek(int position) {
   seekPosition = position;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::Tell
+/*! 	Return the current location within the open file, where the next
+//	Read or Write will start from.
+*/
+//----------------------------------------------------------------------
+int
+OpenFile::Tell() {
+  return seekPosition;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Read
 /*! 	Read a portion of a file, starting from seekPosition.
 //	Return the number of bytes actually read, and as a
 //	side effect, increment the current position within the file.
 //
-//	Implemented using the more primitive ReadAt.
+//	Implemented using the more primitive ReadAt. A Read starting where
+//	the previous one ended reads the next sectors ahead (see
+//	ReadAhead).
 //
 //	\param into the buffer to contain the data to be read from disk
 //	\param numBytes the number of bytes to transfer
@@ -93,10 +137,61 @@ OpenFile::Seek(int position) {
 int
 OpenFile::Read(char *into, int numBytes) {
   int result = ReadAt(into, numBytes, seekPosition);
+  ReadAhead(seekPosition, result);
   seekPosition += result;
   return result;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+/*! 	Detect the sequential reads of the handle, and start reading
+//	into the buffer cache the sectors that the next ones will need,
+//	without waiting for the disk, so that the transfers overlap with
+//	the work of the reader. Called after each read through the
+//	handle, by Read or by the read system call.
+//
+//	The window starts at READ_AHEAD_MIN sectors, doubles on each
+//	sequential read up to g_cfg->ReadAheadSectors, and collapses on
+//	a seek. New sectors are only requested once less than half of the
+//	window remains ahead of the reader, so that they are read by a few
+//	large requests rather than one at a time.
+//
+//	\param position the offset within the file of the bytes read
+//	\param numBytes the number of bytes read
+*/
+//----------------------------------------------------------------------
+void
+OpenFile::ReadAhead(int position, int numBytes) {
+  bool sequential = (position == raNext);
+  raNext = position + numBytes;
+  if (numBytes <= 0 || hdr->IsInline())
+    return;
+  if (!sequential || g_cfg->ReadAheadSectors == 0) {
+    raWindow = raEnd = 0;
+    return;
+  }
+  raWindow = (raWindow == 0) ? READ_AHEAD_MIN : 2 * raWindow;
+  if (raWindow > (int) g_cfg->ReadAheadSectors)
+    raWindow = g_cfg->ReadAheadSectors;
+
+  int current = divRoundDown(raNext, g_cfg->SectorSize);
+  if (raEnd - current >= raWindow / 2)
+    return;   // enough sectors ahead already
+
+  int first = (raEnd > current) ? raEnd : current;
+  int last = current + raWindow - 1;
+  int numSectors = divRoundUp(hdr->FileLength(), g_cfg->SectorSize);
+  if (last >= numSectors)
+    last = numSectors - 1;
+
+  int run;
+  for (int i = first; i <= last; i += run) {
+    run = SectorRun(i, last);
+    g_buffer_cache->ReadAhead(hdr->ByteToSector(i * g_cfg->SectorSize), run);
+  }
+  raEnd = last + 1;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Write
 /*! 	Write a portion of a file, starting from seekPosition.
@@ -127,8 +222,12 @@ OpenFile::Write(char *into, int numBytes) {
 //	boundary; however the disk only knows how to read a whole disk
 //	sector at a time.
 //
-//	We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	The full sectors that are part of the request are read straight
+//	   into "into", the partial sectors at both ends are read into a
+//	   one-sector buffer and we only copy the part we are interested in.
+//
+//	The inline data of a small file is copied from its header, with
+//	no disk access.
 //
 //	\param into  the buffer to contain the data to be read from disk
 //	\param numBytes the number of bytes to transfer
@@ -139,7 +238,7 @@ OpenFile::Write(char *into, int numBytes) {
 int
 OpenFile::ReadAt(char *into, int numBytes, int position) {
   int fileLength = hdr->FileLength();
-  int i, firstSector, lastSector, numSectors;
+  int i, firstSector, lastSector, run;
 
   // Check if the location in the file is valid
   if ((numBytes <= 0) || (position < 0) || (position >= fileLength))
@@ -149,20 +248,40 @@ OpenFile::ReadAt(char *into, int numBytes, int position) {
     numBytes = fileLength - position;
   DEBUG('f', (char *) "Reading %d bytes at %d, from file of length %d.\n",
         numBytes, position, fileLength);
+  if (hdr->IsInline()) {
+    hdr->ReadInline(into, numBytes, position);
+    return numBytes;
+  }
 
   // Compute the list of sectors to be read
   firstSector = divRoundDown(position, g_cfg->SectorSize);
   lastSector = divRoundDown(position + numBytes - 1, g_cfg->SectorSize);
-  numSectors = 1 + lastSector - firstSector;
 
-  // read in all the full and partial sectors that we need
-  char buf[numSectors * g_cfg->SectorSize];
-  for (i = firstSector; i <= lastSector; i++)
-    g_disk_driver->ReadSector(hdr->ByteToSector(i * g_cfg->SectorSize),
-                              &buf[(i - firstSector) * g_cfg->SectorSize]);
+  // the last sector entirely covered by the request
+  int lastFull = lastSector;
+  if ((int) ((lastSector + 1) * g_cfg->SectorSize) > position + numBytes)
+    lastFull--;
 
-  // copy the part we want
-  bcopy(&buf[position - (firstSector * g_cfg->SectorSize)], into, numBytes);
+  // read in all the full and partial sectors that we need, each run
+  // of consecutive full disk sectors with a single request
+  char buf[g_cfg->SectorSize];
+  for (i = firstSector; i <= lastSector; i += run) {
+    int start = i * g_cfg->SectorSize;
+    if (start < position || i > lastFull) {
+      // partial sector: copy the part we want
+      int from = (start < position) ? position : start;
+      int to = start + g_cfg->SectorSize;
+      if (to > position + numBytes)
+        to = position + numBytes;
+      g_buffer_cache->ReadSector(hdr->ByteToSector(start), buf);
+      bcopy(&buf[from - start], &into[from - position], to - from);
+      run = 1;
+    } else {
+      run = SectorRun(i, lastFull);
+      g_buffer_cache->ReadSectors(hdr->ByteToSector(start), run,
+                                  &into[start - position]);
+    }
+  }
   return numBytes;
 }
 
@@ -182,6 +301,16 @@ OpenFile::ReadAt(char *into, int numBytes, int position) {
 //	   in the data that will be modified, and write back all the full
 //	   or partial sectors that are part of the request.
 //
+//	The contents of the directories and of the free map are metadata,
+//	written through the journal. The growth of another file updates
+//	its header and the free map: it is an operation of the journal,
+//	and its data sectors may have been metadata the journal still
+//	holds (see Journal::Revoke).
+//
+//	The inline data of a small file is written with its header, as
+//	metadata; it moves to a data sector when the file outgrows it
+//	(see FileHeader::reAllocate).
+//
 //	\param from the buffer containing the data to be written to disk
 //	\param numBytes the number of bytes to transfer
 //	\param position  the offset within the file of the first byte to be
@@ -192,32 +321,50 @@ int
 OpenFile::WriteAt(char *from, int numBytes, int position) {
   int fileLength = hdr->FileLength();
   int maxFileLength = hdr->MaxFileLength();
-  int i, firstSector, lastSector, numSectors;
+  int i, firstSector, lastSector, numSectors, run;
   bool firstAligned, lastAligned;
+  bool metadata = IsMetadata();
 
   // Check the location in the file is valid
   if ((numBytes <= 0) || (position < 0) || (position > fileLength))
     return 0;   // check request
 
+  // The headers of the file may change if it is an executable
+  g_elf_cache->Forget(fSector);
+
   // Allocate new sectors if the file is not big enough
   if ((position + numBytes) > maxFileLength) {   // there isn't enough place
-    // Fetch the freemap from disk
-    BitMap freeMap(NUM_SECTORS);
-    freeMap.FetchFrom(g_file_system->GetFreeMapFile());
-    // Reallocate room for the new sectors in the file header
-    if (!hdr->reAllocate(&freeMap, fileLength, position + numBytes))
+    // Reallocate room for the new sectors in the file header, the
+    // resident freemap reaches the disk at the next sync
+    if (!metadata)
+      BeginMetadataUpdate();
+    BitMap *freeMap = g_file_system->GetFreeMap();
+    bool grown = hdr->reAllocate(freeMap, fileLength, position + numBytes);
+    g_file_system->ReleaseFreeMap();
+    if (!grown)
       numBytes = fileLength - position;
-    else {
-      // Write back the header and freemap to disk
-      hdr->WriteBack(fSector);
-      freeMap.WriteBack(g_file_system->GetFreeMapFile());
-    }
+    else
+      hdr->WriteBack(fSector);   // Write back the header to disk
+    if (!metadata)
+      EndMetadataUpdate();
   } else if ((position + numBytes) > fileLength)
     hdr->ChangeFileLength(position + numBytes);
 
   DEBUG('f', (char *) "Writing %d bytes at %d, to file of length %d.\n",
         numBytes, position, fileLength);
 
+  if (hdr->IsInline()) {
+    if (numBytes <= 0)
+      return 0;
+    if (!metadata)
+      BeginMetadataUpdate();
+    hdr->WriteInline(from, numBytes, position);
+    hdr->WriteBack(fSector);
+    if (!metadata)
+      EndMetadataUpdate();
+    return numBytes;
+  }
+
   // Compute the list of sectors to be written
   firstSector = divRoundDown(position, g_cfg->SectorSize);
   lastSector = divRoundDown(position + numBytes - 1, g_cfg->SectorSize);
@@ -239,13 +386,46 @@ OpenFile::WriteAt(char *from, int numBytes, int position) {
   // copy in the bytes we want to change
   bcopy(from, &buf[position - (firstSector * g_cfg->SectorSize)], numBytes);
 
-  // write modified sectors back
-  for (i = firstSector; i <= lastSector; i++)
-    g_disk_driver->WriteSector(hdr->ByteToSector(i * g_cfg->SectorSize),
-                               &buf[(i - firstSector) * g_cfg->SectorSize]);
+  // write modified sectors back, by runs of consecutive disk sectors
+  if (metadata) {
+    for (i = firstSector; i <= lastSector; i++)
+      WriteMetadata(hdr->ByteToSector(i * g_cfg->SectorSize),
+                    &buf[(i - firstSector) * g_cfg->SectorSize]);
+    return numBytes;
+  }
+  if (g_journal != NULL)
+    for (i = firstSector; i <= lastSector; i++)
+      g_journal->Revoke(hdr->ByteToSector(i * g_cfg->SectorSize));
+  for (i = firstSector; i <= lastSector; i += run) {
+    run = SectorRun(i, lastSector);
+    g_buffer_cache->WriteSectors(hdr->ByteToSector(i * g_cfg->SectorSize),
+                                 run,
+                                 &buf[(i - firstSector) * g_cfg->SectorSize]);
+  }
   return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::SectorRun
+/*! 	Count the sectors of the file, from the first one, stored in
+//	consecutive disk sectors (so that they can be transferred with a
+//	single disk request).
+//
+//	\param first the index of the first sector in the file
+//	\param last the index of the last sector to consider
+//	\return the number of sectors of the run (at least 1)
+*/
+//----------------------------------------------------------------------
+int
+OpenFile::SectorRun(int first, int last) {
+  int start = hdr->ByteToSector(first * g_cfg->SectorSize);
+  int n = 1;
+  while (first + n <= last &&
+         hdr->ByteToSector((first + n) * g_cfg->SectorSize) == start + n)
+    n++;
+  return n;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 //! 	Return the number of bytes in the file.
@@ -263,6 +443,14 @@ OpenFile::GetFileHeader() {
   return hdr;
 }
 //----------------------------------------------------------------------
+// OpenFile::GetSector
+//! 	Return the sector of the file's header, which identifies the file.
+//----------------------------------------------------------------------
+int
+OpenFile::GetSector() {
+  return fSector;
+}
+//----------------------------------------------------------------------
 // OpenFile::IsDir
 //! 	Return true if the file is a directory.
 //----------------------------------------------------------------------
@@ -270,6 +458,17 @@ bool
 OpenFile::IsDir() {
   return hdr->IsDir();
 }
+
+//----------------------------------------------------------------------
+// OpenFile::IsMetadata
+/*! 	Return true if the contents of the file are metadata of the file
+//	system (a directory or the free map).
+*/
+//----------------------------------------------------------------------
+bool
+OpenFile::IsMetadata() {
+  return hdr->IsDir() || fSector == FreeMapSector;
+}
 //----------------------------------------------------------------------
 // OpenFile::GetName
 //! 	Return the name of the file.
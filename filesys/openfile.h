@@ -27,10 +27,15 @@
 
 #include "kernel/copyright.h"
 #include "kernel/system.h"
+#include "utility/slab.h"
 #include "utility/utility.h"
 
 class FileHeader;
 
+//! Initial read-ahead window, in sectors, once a file is read
+//! sequentially (it then doubles up to g_cfg->ReadAheadSectors)
+#define READ_AHEAD_MIN 4
+
 /*!  \brief Defines the data structure maintained when a file is opened
 //
 //	This is the "real" implementation, that turns these
@@ -38,14 +43,21 @@ class FileHeader;
 //	In this baseline implementation of the file system, we don't
 //	worry about concurrent accesses to the file system
 //	by different threads -- this is part of the assignment.
+//
+//	The handles and their names come from slab caches (see slab.h).
 */
-class OpenFile {
+class OpenFile : public Slab<OpenFile> {
 public:
   /*! Open a file whose header is located
      at "sector" on the disk
   */
   OpenFile(int sector);
 
+  /*! Open a second handle on the file opened by "shared". Both handles
+     use the same in-memory file header, which stays owned by "shared"
+  */
+  OpenFile(OpenFile *shared);
+
   //! Close the file
   ~OpenFile();
 
@@ -54,6 +66,9 @@ public:
   */
   void Seek(int position);
 
+  //! Return the current position within the file -- UNIX ftell
+  int Tell();
+
   /*! Read/write bytes from the file,
      starting at the implicit position.
      Return the # actually read/written,
@@ -68,6 +83,11 @@ public:
   int ReadAt(char *into, int numBytes, int position);
   int WriteAt(char *from, int numBytes, int position);
 
+  /*! Note that numBytes were just read at position, and if they
+     follow the previous read, start reading the next sectors ahead
+  */
+  void ReadAhead(int position, int numBytes);
+
   int Length();                  /*!< Return the number of bytes in the
                                     file (this interface is simpler
                                     than the UNIX idiom -- lseek to
@@ -75,6 +95,8 @@ public:
                                  */
   FileHeader *GetFileHeader();   //!< return the file's header
 
+  int GetSector();   //!< return the sector of the file's header
+
   char *GetName();   //!< return the file's name
 
   void SetName(char *);   //!< Set the file's name
@@ -85,6 +107,15 @@ private:
   FileHeader *hdr;    //!< Header for this file
   int seekPosition;   //!< Current position within the file
   int fSector;        //!< The file's first sector
+  bool ownsHdr;       //!< true if hdr must be deleted with this handle
+  int raNext;         //!< Position of the next Read if access is sequential
+  int raWindow;       //!< Read-ahead window in sectors, 0 after a seek
+  int raEnd;          //!< First sector of the file not read ahead yet
+
+  int SectorRun(int first, int last);   //!< Length of a run of sectors
+                                        //!< consecutive on disk
+
+  bool IsMetadata();   //!< true for the directories and the free map
 
 public:
   //! Object type, for validity checks during system calls (must be the first
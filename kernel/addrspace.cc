@@ -31,6 +31,7 @@
 #include "kernel/addrspace.h"
 #include "filesys/filehdr.h"
 #include "filesys/filesys.h"
+#include "filesys/oftable.h"
 #include "filesys/openfile.h"
 #include "kernel/elf.h"
 #include "kernel/msgerror.h"
@@ -38,6 +39,7 @@
 #include "kernel/system.h"
 #include "utility/stats.h"
 #include "vm/physMem.h"
+#include "vm/shm.h"
 
 //----------------------------------------------------------------------
 /** 	Create an address space to run a user program.
@@ -48,13 +50,10 @@
  //      and can be generated using a standard MIPS cross-compiler
  //      (here gcc).
  //
- //      For now, the code and data are entirely loaded into memory and
- //      the stacks are preallocated (NB: memory here stands for the
- //      memory of the simulated MIPS machine). Code/Data loading will
- //      be changed in the virtual memory assignment.
- //
- //      Don't look at this code right now. You may get lost. You will
- //      have plenty of time to do so in the virtual memory assignment
+ //      Code and data are loaded on demand: the constructor only fills
+ //      in the translation table, each page being read from the
+ //      executable (or zero-filled for bss) by the page fault manager
+ //      the first time it is touched.
  //
  //	\param exec_file is the file containing the object code
  //             to load into memory, or NULL when the address space
@@ -64,12 +63,17 @@
  */
 //----------------------------------------------------------------------
 AddrSpace::AddrSpace(OpenFile *exec_file, Process *p, uint64_t *err) {
-  char eident[16];
   *err = 0;
   translationTable = NULL;
   freePageId = 0;
+  heapBreak = heapEnd = 0;
+  swapHint = INVALID_SECTOR;
+  residentFrames = INVALID_PAGE;
+  sharedFrames = NULL;
   process = p;
-  char is32Bits = 0;
+  nb_mapped_files = 0;
+  nb_segments = 0;
+  nb_shm_segments = 0;
 
   /* Empty user address space requested ? */
   if (exec_file == NULL) {
@@ -78,21 +82,8 @@ AddrSpace::AddrSpace(OpenFile *exec_file, Process *p, uint64_t *err) {
     return;
   }
 
-  // Read the 16 first bytes of the Header to check if the
-  // file is 32 or 64 bits
-  exec_file->ReadAt((char *) &eident, 16, 0);
-  if (eident[EI_CLASS] == ELFCLASS32)
-    is32Bits = 1;
-  else if (eident[EI_CLASS] == ELFCLASS64)
-    is32Bits = 0;
-  else {
-    printf("Error, the ELF File was not recognized as a 32 or 64 bits file, "
-           "exiting.\n");
-    exit(ERROR);
-  }
-
-  // Read elf header and check file format
-  ElfFile elff(exec_file, is32Bits, err);
+  // Get the headers of the file, parsed once for all its executions
+  ElfFile *elff = g_elf_cache->Lookup(exec_file, err);
   if (*err != NO_ERROR) {
     printf("Error, wrong file format for ELF file, exiting.\n");
     exit(ERROR);
@@ -105,13 +96,12 @@ AddrSpace::AddrSpace(OpenFile *exec_file, Process *p, uint64_t *err) {
 
   // Compute the highest virtual address to init the translation table
   uint64_t mem_topaddr = 0;
-  for (int i = 0; i < elff.getShNum(); i++) {
-    // Ignore empty sections
-    if (elff.getShSize(i) <= 0)
+  for (int i = 0; i < elff->getPhNum(); i++) {
+    if (elff->getPhType(i) != PT_LOAD)
       continue;
-    uint64_t section_topaddr = elff.getShAddr(i) + elff.getShSize(i);
-    if ((elff.getShFlags(i) & SHF_ALLOC) && (section_topaddr > mem_topaddr))
-      mem_topaddr = section_topaddr;
+    uint64_t segment_topaddr = elff->getPhAddr(i) + elff->getPhMemSize(i);
+    if (segment_topaddr > mem_topaddr)
+      mem_topaddr = segment_topaddr;
   }
 
   // Allocate space in virtual memory
@@ -122,103 +112,71 @@ AddrSpace::AddrSpace(OpenFile *exec_file, Process *p, uint64_t *err) {
   DEBUG('a', (char *) "Allocated virtual area [0x0,0x%x[ for program\n",
         mem_topaddr);
 
-  // Loading of all sections
-  for (int i = 0; i < elff.getShNum(); i++) {
-    // Retrieve the section name
-    const char *section_name = elff.getShName(i);
-
-    DEBUG('a', (char *) "Section %d : size=0x%x name=\"%s\"\n", i,
-          elff.getShSize(i), section_name);
-
-    // Ignore empty sections
-    if (elff.getShSize(i) <= 0)
-      continue;
-
-    // Look if this section has to be loaded (SHF_ALLOC flag)
-    if (!(elff.getShFlags(i) & SHF_ALLOC))
+  // Loading of the PT_LOAD segments
+  for (int i = 0; i < elff->getPhNum(); i++) {
+    if (elff->getPhType(i) != PT_LOAD || elff->getPhMemSize(i) == 0)
       continue;
 
-    printf("\t- Section %s : file offset 0x%x, size 0x%x, addr 0x%x, %s%s\n",
-           section_name, (unsigned) elff.getShOffset(i),
-           (unsigned) elff.getShSize(i), (unsigned) elff.getShAddr(i),
-           (elff.getShFlags(i) & SHF_WRITE) ? "R/W" : "R",
-           (elff.getShFlags(i) & SHF_EXECINSTR) ? "/X" : "");
-
-    // Make sure section is aligned on page boundary
-    ASSERT((elff.getShAddr(i) % g_cfg->PageSize) == 0);
-
-
-    // Initializes the page table entries and loads the section
-    // in memory (demand paging will be implemented later on)
-    for (unsigned int pgdisk = 0,
-                      virt_page = elff.getShAddr(i) / g_cfg->PageSize;
-         pgdisk < divRoundUp(elff.getShSize(i), g_cfg->PageSize);
-         pgdisk++, virt_page++) {
+    uint64_t addr = elff->getPhAddr(i);
+    uint64_t offset = elff->getPhOffset(i);
+    uint64_t flags = elff->getPhFlags(i);
+    printf("\t- Segment %d : file offset 0x%x, size 0x%x/0x%x, addr 0x%x, "
+           "%s%s\n",
+           i, (unsigned) offset, (unsigned) elff->getPhFileSize(i),
+           (unsigned) elff->getPhMemSize(i), (unsigned) addr,
+           (flags & PF_W) ? "R/W" : "R", (flags & PF_X) ? "/X" : "");
+
+    // The segment may start within a page, but at the same offset in
+    // the file: the page is then read from the file from its start
+    if ((addr & g_cfg->PageMask) != (offset & g_cfg->PageMask) ||
+        nb_segments == MAX_SEGMENTS) {
+      printf("Error, unsupported segment layout in ELF file, exiting.\n");
+      exit(ERROR);
+    }
+    uint64_t file_end = addr + elff->getPhFileSize(i);
+    if (elff->getPhFileSize(i) > 0) {
+      segments[nb_segments].first_address = addr;
+      segments[nb_segments].end_address = file_end;
+      nb_segments++;
+    }
 
-      /* Without demand paging */
+    // Initializes the page table entries of the segment. Pages are not
+    // loaded now but on first touch, by the page fault manager
+    for (uint64_t virt_page = addr >> g_cfg->PageShift;
+         virt_page < divRoundUp(addr + elff->getPhMemSize(i),
+                                g_cfg->PageSize);
+         virt_page++) {
+      uint64_t page_addr = virt_page << g_cfg->PageShift;
 
       // Set up default values for the page table entry
       translationTable->clearBitSwap(virt_page);
       translationTable->setBitReadAllowed(virt_page);
 
-      if (elff.getShFlags(i) & SHF_WRITE)
+      if (flags & PF_W)
         translationTable->setBitWriteAllowed(virt_page);
       else
         translationTable->clearBitWriteAllowed(virt_page);
       translationTable->clearBitIo(virt_page);
 
-      // Get a page in physical memory, halt of there is not sufficient space
-      int pp = g_physical_mem_manager->FindFreePage();
-      if (pp == INVALID_PAGE) {
-        printf("Not enough free space to load program %s\n",
-               exec_file->GetName());
-        g_machine->interrupt->Halt(ERROR);
-      }
-      g_physical_mem_manager->tpr[pp].virtualPage = virt_page;
-      g_physical_mem_manager->tpr[pp].owner = this;
-      g_physical_mem_manager->tpr[pp].locked = true;
-      translationTable->setPhysicalPage(virt_page, pp);
-
-      // The SHT_NOBITS flag indicates if the section has an image
-      // in the executable file (text or data section) or not
-      // (bss section)
-      if (elff.getShType(i) != SHT_NOBITS) {
-        // The section has an image in the executable file
-        // Read it from the disk
-        exec_file->ReadAt(
-            (char *) &(g_machine->mainMemory[translationTable->getPhysicalPage(
-                                                 virt_page) *
-                                             g_cfg->PageSize]),
-            g_cfg->PageSize, elff.getShOffset(i) + pgdisk * g_cfg->PageSize);
-
-      } else {
-        // The section does not have an image in the executable
-        // Fill it with zeroes
-        memset(&(g_machine
-                     ->mainMemory[translationTable->getPhysicalPage(virt_page) *
-                                  g_cfg->PageSize]),
-               0, g_cfg->PageSize);
-      }
-
-      // The page has been loded in physical memory but
-      // later-on will be saved in the swap disk. We have to indicate this
-      // in the translation table
-      translationTable->setAddrDisk(virt_page, INVALID_SECTOR);
-
-      // The entry is valid
-      translationTable->setBitValid(virt_page);
+      // The page fault manager reads the page from the executable at
+      // offset addrDisk, up to the end of the image of the segment
+      // (see ExecPageBytes), or fills it with zeroes when it has no
+      // image (bss)
+      if (page_addr < file_end)
+        translationTable->setAddrDisk(virt_page,
+                                      offset - addr + page_addr);
+      else
+        translationTable->setAddrDisk(virt_page, INVALID_SECTOR);
 
-      /* End of code without demand paging */
+      // The page is not in physical memory yet
+      translationTable->clearBitValid(virt_page);
     }
   }
 
   // Get program start address
-  CodeStartAddress = (int32_t) elff.getEntry();
+  CodeStartAddress = (int32_t) elff->getEntry();
   printf("\t- Program start address : 0x%lx\n\n",
          (unsigned long) CodeStartAddress);
-
-  // Init the number of memory mapped files to zero
-  nb_mapped_files = 0;
 }
 
 //----------------------------------------------------------------------
@@ -230,24 +188,22 @@ AddrSpace::~AddrSpace() {
   int i;
 
   if (translationTable != NULL) {
+    // Release the physical pages (freed unless other address spaces
+    // share them) and the swap sectors of the address space, without
+    // walking its virtual pages
+    g_physical_mem_manager->ReleaseAddrSpace(this);
+    delete translationTable;
+  }
 
-    // For every virtual page
-    for (i = 0; i < freePageId; i++) {
+  // Segments not detached by a last thread (see DetachSegments)
+  for (i = 0; i < nb_shm_segments; i++)
+    shm_segments[i].segment->Release();
 
-      // If it is in physical memory, free the physical page
-      if (translationTable->getBitValid(i)) {
-        g_physical_mem_manager->FreePhysicalPage(
-            translationTable->getPhysicalPage(i));
-      }
-      // If it is in the swap disk, free the corresponding disk sector
-      if (translationTable->getBitSwap(i)) {
-        int addrDisk = translationTable->getAddrDisk(i);
-        if (addrDisk >= 0) {
-          g_swap_manager->ReleasePageSwap(translationTable->getAddrDisk(i));
-        }
-      }
-    }
-    delete translationTable;
+  // The modified pages were written back by the last thread (see
+  // Thread::Finish): only close the mapped files
+  for (i = 0; i < nb_mapped_files; i++) {
+    g_open_file_table->Close(mapped_files[i].file);
+    delete mapped_files[i].file;
   }
 }
 
@@ -288,34 +244,11 @@ AddrSpace::StackAllocate(void) {
         stackBasePage * g_cfg->PageSize,
         (stackBasePage + numPages) * g_cfg->PageSize);
 
-  for (int i = stackBasePage; i < (stackBasePage + numPages); i++) {
-    /* Without demand paging */
-    // Allocate a new physical page for the stack, halt if not page available
-    int pp = g_physical_mem_manager->FindFreePage();
-    if (pp == INVALID_PAGE) {
-      printf("Not enough free space to load stack\n");
-      g_machine->interrupt->Halt(ERROR);
-    }
-    g_physical_mem_manager->tpr[pp].virtualPage = i;
-    g_physical_mem_manager->tpr[pp].owner = this;
-    g_physical_mem_manager->tpr[pp].locked = true;
-    translationTable->setPhysicalPage(i, pp);
-
-    // Fill the page with zeroes
-    memset(&(g_machine->mainMemory[translationTable->getPhysicalPage(i) *
-                                   g_cfg->PageSize]),
-           0x0, g_cfg->PageSize);
-    translationTable->setAddrDisk(i, INVALID_SECTOR);
-    translationTable->setBitValid(i);
-    translationTable->clearBitSwap(i);
-    translationTable->setBitReadAllowed(i);
-    translationTable->setBitWriteAllowed(i);
-    translationTable->clearBitIo(i);
-    /* End of code without demand paging */
-  }
+  // Stack pages are zero-filled on first touch by the page fault manager
+  ZeroFillPages(stackBasePage, numPages);
 
   int stackpointer =
-      (stackBasePage + numPages) * g_cfg->PageSize - 4 * sizeof(int);
+      ((stackBasePage + numPages) << g_cfg->PageShift) - 4 * sizeof(int);
   return stackpointer;
 }
 
@@ -347,6 +280,91 @@ AddrSpace::Alloc(int numPages) {
   return result;
 }
 
+//----------------------------------------------------------------------
+/*! Set up virtual pages to be zero-filled by the page fault manager
+//  the first time they are touched
+//
+//    \param firstPage the first virtual page
+//    \param numPages the number of pages
+*/
+//----------------------------------------------------------------------
+void
+AddrSpace::ZeroFillPages(int firstPage, int numPages) {
+  for (int i = firstPage; i < (firstPage + numPages); i++) {
+    translationTable->setAddrDisk(i, INVALID_SECTOR);
+    translationTable->clearBitValid(i);
+    translationTable->clearBitSwap(i);
+    translationTable->setBitReadAllowed(i);
+    translationTable->setBitWriteAllowed(i);
+    translationTable->clearBitIo(i);
+  }
+}
+
+//----------------------------------------------------------------------
+/*! Grow the heap of the process
+//
+//    \param size number of bytes to add to the heap
+//    \return the address of the first added byte, or ERROR when the
+//      virtual space is exhausted
+*/
+//----------------------------------------------------------------------
+int64_t
+AddrSpace::Sbrk(int size) {
+  if (size < 0)
+    return ERROR;
+
+  uint64_t result = heapBreak;
+  if (heapBreak + size <= heapEnd) {
+    heapBreak += size;
+    return result;
+  }
+
+  // The heap can only grow in place when it ends at the bump pointer
+  // of Alloc, otherwise (first call, or a stack or a mapping allocated
+  // since the last growth) a new heap area is started
+  if (heapEnd != ((uint64_t) freePageId << g_cfg->PageShift)) {
+    int numPages = divRoundUp(size, g_cfg->PageSize);
+    int firstPage = Alloc(numPages);
+    if (firstPage == INVALID_PAGE)
+      return ERROR;
+    ZeroFillPages(firstPage, numPages);
+    result = (uint64_t) firstPage << g_cfg->PageShift;
+    heapBreak = result + size;
+    heapEnd = (uint64_t) (firstPage + numPages) << g_cfg->PageShift;
+  } else {
+    int numPages = divRoundUp(heapBreak + size - heapEnd, g_cfg->PageSize);
+    int firstPage = Alloc(numPages);
+    if (firstPage == INVALID_PAGE)
+      return ERROR;
+    ZeroFillPages(firstPage, numPages);
+    heapBreak += size;
+    heapEnd += (uint64_t) numPages << g_cfg->PageShift;
+  }
+  DEBUG('a', (char *) "Heap break moved to 0x%lx\n", heapBreak);
+  return result;
+}
+
+//----------------------------------------------------------------------
+/*! Number of bytes of a page of the program to read from the
+//  executable file: the whole page, but for the last page of the image
+//  of a segment followed by zero-filled data
+//
+//    \param virtualPage a page with an image in the executable file
+//    \return the number of bytes to read
+*/
+//----------------------------------------------------------------------
+int
+AddrSpace::ExecPageBytes(uint64_t virtualPage) {
+  uint64_t page_addr = virtualPage << g_cfg->PageShift;
+  for (int i = 0; i < nb_segments; i++) {
+    s_segment *s = &segments[i];
+    if (page_addr + g_cfg->PageSize > s->first_address &&
+        page_addr < s->end_address)
+      return MIN(g_cfg->PageSize, s->end_address - page_addr);
+  }
+  return g_cfg->PageSize;
+}
+
 //----------------------------------------------------------------------
 /** Map an open file in memory
  *
@@ -357,8 +375,39 @@ AddrSpace::Alloc(int numPages) {
 // ----------------------------------------------------------------------
 uint64_t
 AddrSpace::Mmap(OpenFile *f, int size) {
-  printf("**** Warning: method AddrSpace::Mmap is not implemented yet\n");
-  exit(ERROR);
+  if (size <= 0 || nb_mapped_files == MAX_MAPPED_FILES)
+    return ERROR;
+
+  int numPages = divRoundUp(size, g_cfg->PageSize);
+  int firstPage = Alloc(numPages);
+  if (firstPage == INVALID_PAGE)
+    return ERROR;
+
+  // The mapping has its own open file, so that it outlives a Close
+  // of the file by the program
+  OpenFile *file = g_open_file_table->Open(f->GetName());
+  if (file == NULL)
+    return ERROR;
+
+  // The pages are loaded from the file by the page fault manager, at
+  // offset addrDisk, the first time they are touched
+  for (int i = 0; i < numPages; i++) {
+    int vp = firstPage + i;
+    translationTable->setAddrDisk(vp, i << g_cfg->PageShift);
+    translationTable->clearBitValid(vp);
+    translationTable->clearBitSwap(vp);
+    translationTable->setBitReadAllowed(vp);
+    translationTable->setBitWriteAllowed(vp);
+    translationTable->clearBitIo(vp);
+  }
+
+  s_mapped_file *m = &mapped_files[nb_mapped_files++];
+  m->first_address = firstPage << g_cfg->PageShift;
+  m->size = numPages << g_cfg->PageShift;
+  m->file = file;
+  DEBUG('a', (char *) "Mapped file %s at [0x%x,0x%x[\n", file->GetName(),
+        m->first_address, m->first_address + m->size);
+  return m->first_address;
 }
 
 //----------------------------------------------------------------------
@@ -370,7 +419,222 @@ AddrSpace::Mmap(OpenFile *f, int size) {
 //----------------------------------------------------------------------
 OpenFile *
 AddrSpace::findMappedFile(int64_t addr) {
-  printf("**** Warning: method AddrSpace::findMappedFile is not implemented "
-         "yet\n");
-  exit(ERROR);
+  s_mapped_file *m = FindMapping(addr);
+  return (m != NULL) ? m->file : NULL;
+}
+
+//----------------------------------------------------------------------
+/*! Mapping containing an address
+//
+// \param addr: virtual address to be searched for
+// \return the mapping, NULL if the address is not in a mapped file
+*/
+//----------------------------------------------------------------------
+s_mapped_file *
+AddrSpace::FindMapping(int64_t addr) {
+  for (int i = 0; i < nb_mapped_files; i++)
+    if (addr >= mapped_files[i].first_address &&
+        addr < mapped_files[i].first_address + mapped_files[i].size)
+      return &mapped_files[i];
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+/*! Write a resident page of a mapped file back to the file. The bytes
+// beyond the end of the file are not written, so that the file does
+// not grow.
+//
+// \param virtualPage: the virtual page, in a mapping
+// \param pp: the physical page holding it (locked by the caller)
+*/
+//----------------------------------------------------------------------
+void
+AddrSpace::WriteMappedPage(uint64_t virtualPage, uint64_t pp) {
+  OpenFile *file = findMappedFile(virtualPage << g_cfg->PageShift);
+  ASSERT(file != NULL);
+  int offset = translationTable->getAddrDisk(virtualPage);
+  int len = file->Length() - offset;
+  if (len > (int) g_cfg->PageSize)
+    len = g_cfg->PageSize;
+  if (len > 0)
+    file->WriteAt((char *) &(g_machine->mainMemory[pp << g_cfg->PageShift]),
+                  len, offset);
+}
+
+//----------------------------------------------------------------------
+/*! Write back a page of a mapping if it is resident and modified. The
+// page is locked during the write so that it cannot be evicted, and
+// its bit M is cleared before, so that a modification made meanwhile
+// keeps it dirty.
+//
+// \param virtualPage: the virtual page, in a mapping
+*/
+//----------------------------------------------------------------------
+void
+AddrSpace::SyncMappedPage(uint64_t virtualPage) {
+  // Wait if the page is being loaded or evicted
+  while (translationTable->getBitIo(virtualPage))
+    g_current_thread->Yield();
+  if (!translationTable->getBitValid(virtualPage) ||
+      !translationTable->getBitM(virtualPage))
+    return;
+
+  uint64_t pp = translationTable->getPhysicalPage(virtualPage);
+  g_physical_mem_manager->LockPage(pp);
+  translationTable->clearBitM(virtualPage);
+  WriteMappedPage(virtualPage, pp);
+  g_physical_mem_manager->UnlockPage(pp);
+}
+
+//----------------------------------------------------------------------
+/*! Write back the modified pages of the mappings overlapping a range
+// of addresses
+//
+// \param addr: first address of the range
+// \param size: size of the range in bytes
+// \return NO_ERROR, or ERROR if the range is not entirely mapped
+*/
+//----------------------------------------------------------------------
+int
+AddrSpace::Msync(uint64_t addr, int size) {
+  if (size <= 0)
+    return ERROR;
+  uint64_t first = addr >> g_cfg->PageShift;
+  uint64_t last = (addr + size - 1) >> g_cfg->PageShift;
+
+  for (uint64_t vp = first; vp <= last; vp++)
+    if (FindMapping(vp << g_cfg->PageShift) == NULL)
+      return ERROR;
+  for (uint64_t vp = first; vp <= last; vp++)
+    SyncMappedPage(vp);
+  return NO_ERROR;
+}
+
+//----------------------------------------------------------------------
+/*! Write back the modified pages of all the mappings. Called by the
+// last thread of the process, which can still wait for the disk.
+*/
+//----------------------------------------------------------------------
+void
+AddrSpace::SyncMappedFiles() {
+  for (int i = 0; i < nb_mapped_files; i++) {
+    uint64_t first = mapped_files[i].first_address >> g_cfg->PageShift;
+    uint64_t count = mapped_files[i].size >> g_cfg->PageShift;
+    for (uint64_t vp = first; vp < first + count; vp++)
+      SyncMappedPage(vp);
+  }
+}
+
+//----------------------------------------------------------------------
+/*! Hold a shared memory segment created by the process: it is not
+// mapped until the process attaches it.
+//
+// \param segment: the new segment, held once by its creation
+// \return NO_ERROR, or ERROR if the table of segments is full
+*/
+//----------------------------------------------------------------------
+int
+AddrSpace::HoldSegment(ShmSegment *segment) {
+  if (nb_shm_segments == MAX_SHM_SEGMENTS)
+    return ERROR;
+  s_shm_segment *s = &shm_segments[nb_shm_segments++];
+  s->segment = segment;
+  s->first_page = INVALID_PAGE;
+  return NO_ERROR;
+}
+
+//----------------------------------------------------------------------
+/*! Map a shared memory segment in the address space. Its pages are
+// zero-filled pages for the translation table, the page fault manager
+// finds them in the segment (see FindSegment).
+//
+// \param segment: the segment
+// \return the address of its first byte, or ERROR when the table of
+//   segments or the virtual space is full
+*/
+//----------------------------------------------------------------------
+int64_t
+AddrSpace::AttachSegment(ShmSegment *segment) {
+  s_shm_segment *s = NULL;
+  for (int i = 0; i < nb_shm_segments; i++)
+    if (shm_segments[i].segment == segment)
+      s = &shm_segments[i];
+  if (s != NULL && s->first_page != INVALID_PAGE)
+    return (int64_t) s->first_page << g_cfg->PageShift;
+  if (s == NULL && nb_shm_segments == MAX_SHM_SEGMENTS)
+    return ERROR;
+
+  int firstPage = Alloc(segment->numPages);
+  if (firstPage == INVALID_PAGE)
+    return ERROR;
+  ZeroFillPages(firstPage, segment->numPages);
+  if (s == NULL) {
+    s = &shm_segments[nb_shm_segments++];
+    s->segment = segment;
+    segment->Hold();
+  }
+  s->first_page = firstPage;
+  DEBUG('a', (char *) "Attached segment %d at [0x%x,0x%x[\n",
+        (int) segment->id, firstPage << g_cfg->PageShift,
+        (firstPage + segment->numPages) << g_cfg->PageShift);
+  return (int64_t) firstPage << g_cfg->PageShift;
+}
+
+//----------------------------------------------------------------------
+/*! Search if a virtual page is in an attached shared memory segment
+//
+// \param virtualPage: the virtual page
+// \param index: set to the page in the segment
+// \return the segment, NULL if none
+*/
+//----------------------------------------------------------------------
+ShmSegment *
+AddrSpace::FindSegment(uint64_t virtualPage, int *index) {
+  for (int i = 0; i < nb_shm_segments; i++) {
+    s_shm_segment *s = &shm_segments[i];
+    if (s->first_page != INVALID_PAGE &&
+        virtualPage >= (uint64_t) s->first_page &&
+        virtualPage < (uint64_t) (s->first_page + s->segment->numPages)) {
+      *index = virtualPage - s->first_page;
+      return s->segment;
+    }
+  }
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+/*! Unmap the shared memory segments and release them. The pages that
+// only this address space maps are saved in their segment if other
+// address spaces still hold it (see
+// PhysicalMemManager::DetachSegmentPage). Called by the last thread of
+// the process, which can still wait for the disk.
+*/
+//----------------------------------------------------------------------
+void
+AddrSpace::DetachSegments() {
+  for (int s = 0; s < nb_shm_segments; s++) {
+    ShmSegment *segment = shm_segments[s].segment;
+    int first = shm_segments[s].first_page;
+    for (int i = 0; first != INVALID_PAGE && i < segment->numPages; i++) {
+      int vp = first + i;
+
+      // Wait for a page being loaded or evicted
+      while (translationTable->getBitIo(vp))
+        g_current_thread->Yield();
+      if (!translationTable->getBitValid(vp))
+        continue;
+      uint64_t pp = translationTable->getPhysicalPage(vp);
+      g_physical_mem_manager->LockPage(pp);
+      if (!translationTable->getBitValid(vp) ||
+          translationTable->getPhysicalPage(vp) != pp) {
+        // Evicted meanwhile, look at the page again
+        g_physical_mem_manager->UnlockPage(pp);
+        i--;
+        continue;
+      }
+      g_physical_mem_manager->DetachSegmentPage(pp, this, segment, i);
+    }
+    segment->Release();
+  }
+  nb_shm_segments = 0;
 }
@@ -26,12 +26,15 @@
 #include "kernel/copyright.h"
 #include "machine/machine.h"
 #include "utility/list.h"
+#include <vector>
 
 // Forward references
 class Thread;
 class Semaphore;
 class OpenFile;
 class Process;
+class ShmSegment;
+struct sharer_c;
 
 #define MAX_MAPPED_FILES 10
 //! Information describing a memory-mapped file
@@ -42,6 +45,20 @@ typedef struct {
 } s_mapped_file;
 typedef s_mapped_file t_mapped_files[MAX_MAPPED_FILES];
 
+#define MAX_SHM_SEGMENTS 8
+//! Shared memory segment held by an address space
+typedef struct {
+  ShmSegment *segment;
+  int first_page;   // first page of its mapping, INVALID_PAGE if not attached
+} s_shm_segment;
+
+#define MAX_SEGMENTS 8
+//! Part of a loaded segment whose contents come from the executable
+typedef struct {
+  uint64_t first_address;   // address of the first byte of the image
+  uint64_t end_address;     // address following its last byte
+} s_segment;
+
 /**
  @brief Defines the data structures to keep track of memory resources of
  executing user programs (address spaces).
@@ -62,13 +79,10 @@ public:
    //      and can be generated using a standard MIPS cross-compiler
    //      (here gcc).
    //
-   //      For now, the code and data are entirely loaded into memory and
-   //      the stacks are preallocated (NB: memory here stands for the
-   //      memory of the simulated MIPS machine). Code/Data loading will
-   //      be changed in the virtual memory assignment.
-   //
-   //      Don't look at this code right now. You may get lost. You will
-   //      have plenty of time to do so in the virtual memory assignment
+   //      Code and data are loaded on demand: the constructor only fills
+   //      in the translation table, each page being read from the
+   //      executable (or zero-filled for bss) by the page fault manager
+   //      the first time it is touched.
    //
    //	\param exec_file is the file containing the object code
    //             to load into memory, or NULL when the address space
@@ -103,6 +117,21 @@ public:
     allocated in RAM. */
   TranslationTable *translationTable;
 
+  /*! Swap sector following the last one allocated to this address
+    space: its next pages are saved right after, so that they can be
+    read back (and written) sequentially. */
+  uint32_t swapHint;
+
+  /*! Physical pages owned by this address space, linked through the
+    physical page table (see PhysicalMemManager::LinkFrame), and its
+    mappings of the shared pages of other address spaces. They are
+    released at once when the address space is deleted. */
+  uint64_t residentFrames;
+  struct sharer_c *sharedFrames;
+
+  /*! Sectors of the swap area allocated to this address space */
+  std::vector<uint32_t> swapSlots;
+
   /*! Map an open file in memory
    *
    * \param f: pointer to open file descriptor
@@ -117,6 +146,74 @@ public:
    */
   OpenFile *findMappedFile(int64_t addr);
 
+  /*! Write back the modified pages of the mappings overlapping a
+   * range of addresses
+   *
+   * \param addr: first address of the range
+   * \param size: size of the range in bytes
+   * \return NO_ERROR, or ERROR if the range is not entirely mapped
+   */
+  int Msync(uint64_t addr, int size);
+
+  /*! Write back the modified pages of all the mappings */
+  void SyncMappedFiles();
+
+  /*! Write a resident page of a mapped file back to the file
+   *
+   * \param virtualPage: the virtual page, in a mapping
+   * \param pp: the physical page holding it (locked by the caller)
+   */
+  void WriteMappedPage(uint64_t virtualPage, uint64_t pp);
+
+  /*! Grow the heap of the process
+   *
+   * The heap is extended in place while no other area was allocated
+   * after it, and a new heap area is started otherwise. Its pages are
+   * zero-filled on first touch.
+   *
+   * \param size: number of bytes to add to the heap (0 to read the break)
+   * \return the address of the first added byte, or ERROR
+   */
+  int64_t Sbrk(int size);
+
+  /*! Hold a shared memory segment created by the process, so that it
+   * lives at least as long as the address space
+   *
+   * \param segment: the new segment
+   * \return NO_ERROR, or ERROR if too many segments are held
+   */
+  int HoldSegment(ShmSegment *segment);
+
+  /*! Map a shared memory segment in the address space, its pages being
+   * shared with the other address spaces attaching it
+   *
+   * \param segment: the segment
+   * \return the address of the mapping (the same one if the segment is
+   * already attached), or ERROR
+   */
+  int64_t AttachSegment(ShmSegment *segment);
+
+  /*! Search if a virtual page is in a shared memory segment
+   *
+   * \param virtualPage: the virtual page
+   * \param index: set to the page in the segment
+   * \return the segment, NULL if the page is not in one
+   */
+  ShmSegment *FindSegment(uint64_t virtualPage, int *index);
+
+  /*! Unmap and release the shared memory segments, saving the pages
+   * still in use by other address spaces (called by the last thread)
+   */
+  void DetachSegments();
+
+  /*! Number of bytes of a page of the program to read from the
+   * executable file, the page being zero-filled beyond them
+   *
+   * \param virtualPage: a page with an image in the executable file
+   * \return the bytes up to the end of the image of its segment
+   */
+  int ExecPageBytes(uint64_t virtualPage);
+
 private:
   //* Code start address, found in the ELF file
   int64_t CodeStartAddress;
@@ -129,6 +226,10 @@ private:
    */
   int Alloc(int numPages);
 
+  /*! Set up virtual pages to be zero-filled by the page fault manager
+   *  the first time they are touched */
+  void ZeroFillPages(int firstPage, int numPages);
+
   /** Number of the next virtual page to be allocated.
     Virtual addresses allocated in a very simple manner : an
     allocation will simply increment this address by
@@ -136,12 +237,31 @@ private:
     malloc/free functions implemented yet) */
   int freePageId;
 
+  /*! Current end of the heap (first byte after it), and end of the
+    pages allocated for it. Both are 0 until the first Sbrk. */
+  uint64_t heapBreak;
+  uint64_t heapEnd;
+
   /*! (Heavyweight) process using this address space */
   Process *process;
 
+  /*! Images in the executable file of the loaded segments */
+  int nb_segments;
+  s_segment segments[MAX_SEGMENTS];
+
   /*! List of memory-mapped files */
   int nb_mapped_files;
   t_mapped_files mapped_files;
+
+  /*! Mapping containing an address, NULL if none */
+  s_mapped_file *FindMapping(int64_t addr);
+
+  /*! Write back a page of a mapping if it is resident and modified */
+  void SyncMappedPage(uint64_t virtualPage);
+
+  /*! Shared memory segments created or attached */
+  int nb_shm_segments;
+  s_shm_segment shm_segments[MAX_SHM_SEGMENTS];
 };
 
 #endif   // ADDRSPACE_H
@@ -0,0 +1,257 @@
+/*! \file aio.cc
+//  \brief Routines for the asynchronous I/O of a process
+//
+//      The requests are performed by a kernel thread attached to the
+//      process, started by SC_AIO_SUBMIT when none is running, and
+//      finishing once the submission queue is empty. The indexes of
+//      the ring are free-running counters, the slot of an index being
+//      the index modulo the number of entries.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "kernel/aio.h"
+#include "filesys/openfile.h"
+#include "kernel/msgerror.h"
+#include "kernel/process.h"
+#include "kernel/system.h"
+#include "kernel/thread.h"
+#include "machine/machine.h"
+#include "userlib/syscall.h"
+
+#include <stddef.h>
+
+//----------------------------------------------------------------------
+// AioWorker
+/*!	Entry point of the worker thread (C++ does not allow a pointer
+//	to a member function).
+*/
+//----------------------------------------------------------------------
+static void
+AioWorker(int64_t arg) {
+  ((AioContext *) arg)->RunWorker();
+}
+
+//----------------------------------------------------------------------
+// AioContext::AioContext
+/*!	Constructor. No ring is served and no worker runs until the
+//	first submission.
+//
+//	\param owner the process the requests come from
+*/
+//----------------------------------------------------------------------
+AioContext::AioContext(Process *owner) {
+  process = owner;
+  lock = new Lock((char *) "aio");
+  done = new Condition((char *) "aio done", lock);
+  ring = 0;
+  working = false;
+}
+
+//----------------------------------------------------------------------
+// AioContext::~AioContext
+/*!	Destructor. The worker is attached to the process, so it has
+//	finished when the process is deleted.
+*/
+//----------------------------------------------------------------------
+AioContext::~AioContext() {
+  ASSERT(!working);
+  delete done;
+  delete lock;
+}
+
+//----------------------------------------------------------------------
+// AioContext::ReadRing
+/*!	Copy the header of the ring served from the user memory.
+//
+//	\param r where to copy the header
+//	\return false if the ring is not valid
+*/
+//----------------------------------------------------------------------
+bool
+AioContext::ReadRing(AioRingT *r) {
+  if (!g_machine->mmu->CopyFromUser(ring, (char *) r, sizeof(AioRingT)))
+    return false;
+  return r->entries > 0;
+}
+
+//----------------------------------------------------------------------
+// AioContext::StartWorker
+/*!	Start the worker thread, unless it is running. Called with the
+//	lock held.
+*/
+//----------------------------------------------------------------------
+void
+AioContext::StartWorker() {
+  if (working)
+    return;
+  Thread *worker = new Thread((char *) "aio worker");
+  if (worker->StartKernel(process, AioWorker, (int64_t) this) != NO_ERROR) {
+    delete worker;
+    return;
+  }
+  working = true;
+}
+
+//----------------------------------------------------------------------
+// AioContext::Submit
+/*!	Take the requests added to the submission queue of a ring since
+//	the last call, and start a worker to perform them. Returns
+//	without waiting for them.
+//
+//	\param ringAddr address of the ring in the user memory
+//	\return the number of requests not taken by the worker yet, or
+//	ERROR if the ring is not valid or another ring is being served
+*/
+//----------------------------------------------------------------------
+int
+AioContext::Submit(uint64_t ringAddr) {
+  AioRingT r;
+  int pending = ERROR;
+
+  lock->Acquire();
+  if (!working || ring == ringAddr) {
+    ring = ringAddr;
+    if (ReadRing(&r)) {
+      pending = (int) (r.sq_tail - r.sq_head);
+      if (pending > 0)
+        StartWorker();
+    }
+  }
+  lock->Release();
+  return pending;
+}
+
+//----------------------------------------------------------------------
+// AioContext::Wait
+/*!	Wait until at least min completions are posted in the completion
+//	queue of a ring, or the worker has nothing left to do.
+//
+//	\param ringAddr address of the ring in the user memory
+//	\param min number of completions to wait for
+//	\return the number of completions available, or ERROR if the
+//	ring is not valid or another ring is being served
+*/
+//----------------------------------------------------------------------
+int
+AioContext::Wait(uint64_t ringAddr, int min) {
+  AioRingT r;
+  int available = ERROR;
+
+  lock->Acquire();
+  if (!working || ring == ringAddr) {
+    ring = ringAddr;
+    while (ReadRing(&r)) {
+      available = (int) (r.cq_tail - r.cq_head);
+      if (available >= min)
+        break;
+      // A worker stopped by a full completion queue resumes here
+      if (!working && r.sq_head != r.sq_tail)
+        StartWorker();
+      if (!working)
+        break;
+      done->Wait();
+    }
+  }
+  lock->Release();
+  return available;
+}
+
+//----------------------------------------------------------------------
+// AioContext::RunWorker
+/*!	Body of the worker thread: perform the requests of the submission
+//	queue in order and post their results, until the queue is empty
+//	or there is no room left in the completion queue. The lock is
+//	released while a request is performed, so that the program can
+//	submit and wait meanwhile.
+*/
+//----------------------------------------------------------------------
+void
+AioContext::RunWorker() {
+  AioRingT r;
+  AioRequestT req;
+  AioCompletionT comp;
+
+  lock->Acquire();
+  while (ReadRing(&r) && r.sq_head != r.sq_tail &&
+         r.cq_tail - r.cq_head < r.entries) {
+    // Take the request, which frees its slot for the program. The
+    // worker may go on on another hart after each wait, hence the MMU
+    // is looked up at every access
+    if (!g_machine->mmu->CopyFromUser(r.sq + (r.sq_head % r.entries) *
+                                      sizeof(req), (char *) &req, sizeof(req)))
+      break;
+    r.sq_head++;
+    g_machine->mmu->CopyToUser(ring + offsetof(AioRingT, sq_head),
+                               (char *) &r.sq_head, sizeof(r.sq_head));
+
+    lock->Release();
+    comp.tag = req.tag;
+    comp.result = Perform(&req);
+    lock->Acquire();
+
+    // Post the completion (the program may have moved cq_head)
+    if (!ReadRing(&r))
+      break;
+    g_machine->mmu->CopyToUser(r.cq + (r.cq_tail % r.entries) * sizeof(comp),
+                               (char *) &comp, sizeof(comp));
+    r.cq_tail++;
+    g_machine->mmu->CopyToUser(ring + offsetof(AioRingT, cq_tail),
+                               (char *) &r.cq_tail, sizeof(r.cq_tail));
+    done->Broadcast();
+  }
+  working = false;
+  done->Broadcast();
+  lock->Release();
+}
+
+//----------------------------------------------------------------------
+// AioContext::Perform
+/*!	Perform one request, as the corresponding read or write system
+//	call would. Requests at offset -1 use and move the current
+//	position of the file.
+//
+//	\param req the request
+//	\return the number of bytes transferred, or ERROR
+*/
+//----------------------------------------------------------------------
+int64_t
+AioContext::Perform(AioRequestT *req) {
+  if (req->size < 0)
+    return ERROR;
+
+  if (req->id == CONSOLE_INPUT && req->op == AIO_READ)
+    return ReadConsoleToUser(req->buffer, req->size);
+  if (req->id == CONSOLE_OUTPUT && req->op == AIO_WRITE)
+    return WriteFromUser(NULL, req->buffer, req->size, 0);
+
+  OpenFile *file = NULL;
+  if (req->id > CONSOLE_OUTPUT)
+    file = (OpenFile *) g_object_addrs->SearchObject(req->id, FILE_TYPE);
+  if (file == NULL || file->type != FILE_TYPE)
+    return ERROR;
+
+  int position = (req->offset < 0) ? file->Tell() : (int) req->offset;
+  int numbytes;
+  if (req->op == AIO_READ)
+    numbytes = ReadFileToUser(file, req->buffer, req->size, position);
+  else if (req->op == AIO_WRITE)
+    numbytes = WriteFromUser(file, req->buffer, req->size, position);
+  else
+    return ERROR;
+  if (req->offset < 0)
+    file->Seek(position + numbytes);
+  return numbytes;
+}
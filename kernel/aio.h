@@ -0,0 +1,107 @@
+/*! \file aio.h
+    \brief Data structures for the asynchronous I/O of a process
+
+        A program shares with the kernel a ring made of a submission
+        queue and a completion queue (see AioRing in userlib/syscall.h).
+        SC_AIO_SUBMIT hands the new requests to a kernel worker thread,
+        which performs them one after the other and posts their results
+        in the completion queue, so that the program keeps running while
+        the disk is busy and polls for completions without system calls.
+        SC_AIO_WAIT blocks until enough completions are posted.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef AIO_H
+#define AIO_H
+
+#include "kernel/copyright.h"
+#include "kernel/synch.h"
+
+class OpenFile;
+class Process;
+
+//! Kernel view of an AioRing (layout of userlib/syscall.h)
+typedef struct {
+  int64_t entries;   //!< Number of slots of each queue
+  int64_t sq_head;   //!< Next request taken by the kernel
+  int64_t sq_tail;   //!< Next request written by the program
+  int64_t cq_head;   //!< Next completion read by the program
+  int64_t cq_tail;   //!< Next completion written by the kernel
+  int64_t sq;        //!< Address of the submission queue
+  int64_t cq;        //!< Address of the completion queue
+} AioRingT;
+
+//! Kernel view of an AioRequest
+typedef struct {
+  int64_t op;       //!< AIO_READ or AIO_WRITE
+  int64_t id;       //!< File (or console) to read or write
+  int64_t buffer;   //!< Address of the data
+  int64_t size;     //!< Number of bytes to transfer
+  int64_t offset;   //!< Position in the file, -1 for the current one
+  int64_t tag;      //!< Copied into the completion
+} AioRequestT;
+
+//! Kernel view of an AioCompletion
+typedef struct {
+  int64_t tag;      //!< Tag of the request
+  int64_t result;   //!< Number of bytes transferred, or ERROR
+} AioCompletionT;
+
+/*! \brief Asynchronous I/O state of a process
+ */
+class AioContext {
+public:
+  //! Create the context of a process, without any worker
+  AioContext(Process *owner);
+
+  //! Deallocate the context
+  ~AioContext();
+
+  //! Take the new requests of a ring and start a worker if needed
+  int Submit(uint64_t ringAddr);
+
+  //! Wait until at least min completions are posted in a ring
+  int Wait(uint64_t ringAddr, int min);
+
+  //! Body of the worker thread
+  void RunWorker();
+
+private:
+  //! Read the header of the ring from the user memory
+  bool ReadRing(AioRingT *r);
+
+  //! Start the worker thread, unless it is running
+  void StartWorker();
+
+  //! Perform one request in the context of the worker
+  int64_t Perform(AioRequestT *req);
+
+  Process *process;   //!< Process owning the context
+  Lock *lock;         //!< Protects the ring and the fields below
+  Condition *done;    //!< Broadcast when a completion is posted
+  uint64_t ring;      //!< Address of the ring being served
+  bool working;       //!< true while a worker thread is running
+};
+
+// Transfers between open files or the console and the user memory,
+// shared with the synchronous system calls (see exception.cc)
+int ReadFileToUser(OpenFile *file, uint64_t addr, int size, int position);
+int ReadConsoleToUser(uint64_t addr, int size);
+int WriteFromUser(OpenFile *file, uint64_t addr, int size, int position);
+
+#endif   // AIO_H
@@ -17,6 +17,15 @@ ElfFile::ElfFile(OpenFile *exec_file, char is32bits, uint64_t *err) {
   // Type of Elf header
   this->is32Hdr = is32bits;
   this->incorrect_header = 0;
+  symbols32 = NULL;
+  symbols64 = NULL;
+  numSymbols = 0;
+  symnames = NULL;
+  program_table32 = NULL;
+  program_table64 = NULL;
+  section_table32 = NULL;
+  section_table64 = NULL;
+  shnames = NULL;
 
   // Read header and check validity
   if (this->is32Hdr) {
@@ -31,12 +40,36 @@ ElfFile::ElfFile(OpenFile *exec_file, char is32bits, uint64_t *err) {
     return;
   }
 
+  // Read the program headers, all at once
+  if (this->is32Hdr) {
+    program_table32 = (Elf32_Phdr *) new char[elf32Hdr.e_phnum *
+                                              sizeof(Elf32_Phdr)];
+    exec_file->ReadAt((char *) program_table32,
+                      elf32Hdr.e_phnum * sizeof(Elf32_Phdr), elf32Hdr.e_phoff);
+  } else {
+    program_table64 = (Elf64_Phdr *) new char[elf64Hdr.e_phnum *
+                                              sizeof(Elf64_Phdr)];
+    exec_file->ReadAt((char *) program_table64,
+                      elf64Hdr.e_phnum * sizeof(Elf64_Phdr), elf64Hdr.e_phoff);
+  }
+}
+
+/**	Read the section table of the file and the names of the sections,
+ //	which are not needed to load the program
+ //
+ //	\param exec_file is the file containing the object code
+ */
+void
+ElfFile::ReadSections(OpenFile *exec_file) {
+  if (incorrect_header || shnames != NULL)
+    return;
+
   // Read section table
   if (this->is32Hdr) {
     section_table32 =
-        (Elf32_Shdr *) new char[elf32Hdr.e_shnum * sizeof(elf32Hdr)];
+        (Elf32_Shdr *) new char[elf32Hdr.e_shnum * sizeof(Elf32_Shdr)];
     exec_file->ReadAt((char *) section_table32,
-                      elf32Hdr.e_shnum * sizeof(elf32Hdr), elf32Hdr.e_shoff);
+                      elf32Hdr.e_shnum * sizeof(Elf32_Shdr), elf32Hdr.e_shoff);
     // Read section names
     shname_section32 = &section_table32[elf32Hdr.e_shstrndx];
     shnames = new char[shname_section32->sh_size];
@@ -44,9 +77,9 @@ ElfFile::ElfFile(OpenFile *exec_file, char is32bits, uint64_t *err) {
                       shname_section32->sh_offset);
   } else {
     section_table64 =
-        (Elf64_Shdr *) new char[elf64Hdr.e_shnum * sizeof(elf64Hdr)];
+        (Elf64_Shdr *) new char[elf64Hdr.e_shnum * sizeof(Elf64_Shdr)];
     exec_file->ReadAt((char *) section_table64,
-                      elf64Hdr.e_shnum * sizeof(elf64Hdr), elf64Hdr.e_shoff);
+                      elf64Hdr.e_shnum * sizeof(Elf64_Shdr), elf64Hdr.e_shoff);
     // Read section names
     shname_section64 = &section_table64[elf64Hdr.e_shstrndx];
     shnames = new char[shname_section64->sh_size];
@@ -55,6 +88,44 @@ ElfFile::ElfFile(OpenFile *exec_file, char is32bits, uint64_t *err) {
   }
 }
 
+/**	Read the symbol table of the file and its string table, if the
+ //	file has got one (it is not stripped)
+ //
+ //	\param exec_file is the file containing the object code
+ //	\return the number of symbols read
+ */
+uint64_t
+ElfFile::ReadSymbols(OpenFile *exec_file) {
+  if (incorrect_header || numSymbols != 0)
+    return numSymbols;
+
+  ReadSections(exec_file);
+  for (int i = 0; i < getShNum(); i++) {
+    if (getShType(i) != SHT_SYMTAB)
+      continue;
+    int link = is32Hdr ? section_table32[i].sh_link : section_table64[i].sh_link;
+    if (link <= 0 || link >= getShNum())
+      return 0;
+
+    // Read the symbols
+    char *table = new char[getShSize(i)];
+    exec_file->ReadAt(table, getShSize(i), getShOffset(i));
+    if (is32Hdr) {
+      symbols32 = (Elf32_Sym *) table;
+      numSymbols = getShSize(i) / sizeof(Elf32_Sym);
+    } else {
+      symbols64 = (Elf64_Sym *) table;
+      numSymbols = getShSize(i) / sizeof(Elf64_Sym);
+    }
+
+    // Read their names
+    symnames = new char[getShSize(link)];
+    exec_file->ReadAt(symnames, getShSize(link), getShOffset(link));
+    break;
+  }
+  return numSymbols;
+}
+
 void
 ElfFile::CheckELF32Header(Elf32_Ehdr *elfHdr, uint64_t *err) {
   /* Make sure it is an ELF file by looking at its header (see elf32.h) */
@@ -93,7 +164,8 @@ ElfFile::CheckELF32Header(Elf32_Ehdr *elfHdr, uint64_t *err) {
   /* Make sure ELF file internal structures are consistent with what
      we expect */
   if (elfHdr->e_ehsize != sizeof(Elf32_Ehdr) ||
-      elfHdr->e_shentsize != sizeof(Elf32_Shdr)) {
+      elfHdr->e_shentsize != sizeof(Elf32_Shdr) ||
+      elfHdr->e_phentsize != sizeof(Elf32_Phdr)) {
     *err = EXEC_FILE_FORMAT_ERROR;
     return;
   }
@@ -150,7 +222,8 @@ ElfFile::CheckELF64Header(Elf64_Ehdr *elfHdr, uint64_t *err) {
   /* Make sure ELF file internal structures are consistent with what
      we expect */
   if (elfHdr->e_ehsize != sizeof(Elf64_Ehdr) ||
-      elfHdr->e_shentsize != sizeof(Elf64_Shdr)) {
+      elfHdr->e_shentsize != sizeof(Elf64_Shdr) ||
+      elfHdr->e_phentsize != sizeof(Elf64_Phdr)) {
     *err = EXEC_FILE_FORMAT_ERROR;
     return;
   }
@@ -171,3 +244,88 @@ ElfFile::CheckELF64Header(Elf64_Ehdr *elfHdr, uint64_t *err) {
 
   *err = NO_ERROR;
 }
+
+/**	Initialize an empty cache of executable file headers
+ */
+ElfCache::ElfCache() {
+  for (int i = 0; i < ELF_CACHE_SIZE; i++) {
+    sectors[i] = -1;
+    files[i] = NULL;
+    lastUse[i] = 0;
+  }
+  clock = 0;
+}
+
+/**	Delete the cached headers
+ */
+ElfCache::~ElfCache() {
+  for (int i = 0; i < ELF_CACHE_SIZE; i++)
+    delete files[i];
+}
+
+/**	Get the parsed headers of an executable file. On a miss, the
+ //	headers are read (the thread may block on the disk) before being
+ //	entered in place of the least recently used entry.
+ //
+ //	\param exec_file is the file containing the object code
+ //	\param err: error code NO_ERROR if OK
+ //	\return the headers, or NULL on error
+ */
+ElfFile *
+ElfCache::Lookup(OpenFile *exec_file, uint64_t *err) {
+  int sector = exec_file->GetSector();
+  for (int i = 0; i < ELF_CACHE_SIZE; i++) {
+    if (sectors[i] == sector) {
+      lastUse[i] = ++clock;
+      *err = NO_ERROR;
+      return files[i];
+    }
+  }
+
+  // Read the 16 first bytes of the Header to check if the
+  // file is 32 or 64 bits
+  char eident[16];
+  exec_file->ReadAt(eident, 16, 0);
+  if (eident[EI_CLASS] != ELFCLASS32 && eident[EI_CLASS] != ELFCLASS64) {
+    *err = EXEC_FILE_FORMAT_ERROR;
+    return NULL;
+  }
+  ElfFile *elff = new ElfFile(exec_file, eident[EI_CLASS] == ELFCLASS32, err);
+  if (*err != NO_ERROR) {
+    delete elff;
+    return NULL;
+  }
+
+  // Another thread may have entered the file while this one was reading
+  int victim = 0;
+  for (int i = 0; i < ELF_CACHE_SIZE; i++) {
+    if (sectors[i] == sector) {
+      delete elff;
+      lastUse[i] = ++clock;
+      return files[i];
+    }
+    if (lastUse[i] < lastUse[victim])
+      victim = i;
+  }
+  delete files[victim];
+  sectors[victim] = sector;
+  files[victim] = elff;
+  lastUse[victim] = ++clock;
+  return elff;
+}
+
+/**	Forget the headers of a file, written or removed
+ //
+ //	\param sector is the sector of the file header
+ */
+void
+ElfCache::Forget(int sector) {
+  for (int i = 0; i < ELF_CACHE_SIZE; i++) {
+    if (sectors[i] == sector) {
+      delete files[i];
+      sectors[i] = -1;
+      files[i] = NULL;
+      lastUse[i] = 0;
+    }
+  }
+}
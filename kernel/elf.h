@@ -133,6 +133,30 @@ typedef struct {
   Elf32_Word p_align;
 } Elf32_Phdr;
 
+typedef struct {
+  Elf64_Word p_type;     //!< Segment type (see PT_* below)
+  Elf64_Word p_flags;    //!< Access rights (see PF_* below)
+  Elf64_Off p_offset;    //!< Segment offset in file
+  Elf64_Addr p_vaddr;    //!< Segment virtual address
+  Elf64_Addr p_paddr;
+  Elf64_Xword p_filesz;  //!< Size of the segment image in the file
+  Elf64_Xword p_memsz;   //!< Size of the segment in memory (>= p_filesz,
+                         //!< the end is zero-filled)
+  Elf64_Xword p_align;
+} Elf64_Phdr;
+
+#define PT_NULL    0
+#define PT_LOAD    1
+#define PT_DYNAMIC 2
+#define PT_INTERP  3
+#define PT_NOTE    4
+#define PT_SHLIB   5
+#define PT_PHDR    6
+
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
 /* Reserved section table indexes */
 #define SHN_UNDEF     0
 #define SHN_LORESERVE 0xff00
@@ -194,6 +218,31 @@ typedef struct {
 #define SHF_EXECINSTR 0x4
 #define SHF_MASKPROC  0xf0000000
 
+//! Symbol table entry (only used fields are commented)
+typedef struct {
+  Elf32_Word st_name;      //!< Symbol name (index in string table)
+  Elf32_Addr st_value;     //!< Symbol value (address)
+  Elf32_Word st_size;      //!< Size of the object (bytes)
+  unsigned char st_info;   //!< Symbol type and binding
+  unsigned char st_other;
+  Elf32_Half st_shndx;
+} Elf32_Sym;
+
+typedef struct {
+  Elf64_Word st_name;      //!< Symbol name (index in string table)
+  unsigned char st_info;   //!< Symbol type and binding
+  unsigned char st_other;
+  Elf64_Half st_shndx;
+  Elf64_Addr st_value;     //!< Symbol value (address)
+  Elf64_Xword st_size;     //!< Size of the object (bytes)
+} Elf64_Sym;
+
+/* symbol type, in st_info */
+#define ELF_ST_TYPE(info) ((info) & 0xf)
+#define STT_NOTYPE        0
+#define STT_OBJECT        1
+#define STT_FUNC          2
+
 class ElfFile {
   char is32Hdr;
   char incorrect_header;
@@ -206,6 +255,12 @@ class ElfFile {
   Elf32_Shdr *shname_section32;
   Elf64_Shdr *shname_section64;
   char *shnames;
+  Elf32_Phdr *program_table32;   // Program headers (segments)
+  Elf64_Phdr *program_table64;
+  Elf32_Sym *symbols32;   // Symbol table, read by ReadSymbols
+  Elf64_Sym *symbols64;
+  uint64_t numSymbols;
+  char *symnames;         // String table of the symbols
 
 public:
   /** 	Management of ELF files, called when loading a new program in memory
@@ -220,13 +275,75 @@ public:
    *   all memory it uses (RAM and swap area).
    */
   ~ElfFile() {
-    if (incorrect_header == 0) {
-      if (is32Hdr)
-        delete section_table32;
-      else
-        delete section_table64;
-      delete shnames;
-    }
+    delete[] (char *) section_table32;
+    delete[] (char *) section_table64;
+    delete[] shnames;
+    delete[] (char *) program_table32;
+    delete[] (char *) program_table64;
+    delete[] (char *) symbols32;
+    delete[] (char *) symbols64;
+    delete[] symnames;
+  }
+
+  /**	Read the section table of the file, needed by the getSh*
+   *      methods (the program is loaded from the program headers)
+   *      \param exec_file is the file containing the object code
+   */
+  void ReadSections(OpenFile *exec_file);
+
+  /**	Read the symbol table of the file, if it has one
+   *      \param exec_file is the file containing the object code
+   *      \return the number of symbols read
+   */
+  uint64_t ReadSymbols(OpenFile *exec_file);
+
+  /**	Get number of symbols read by ReadSymbols
+   *      \return number of symbols
+   */
+  uint64_t getSymNum() { return numSymbols; }
+
+  /**	Get value (address) of symbol number i
+   *      \param i = symbol number
+   *      \return value of symbol
+   */
+  uint64_t getSymValue(uint64_t i) {
+    if (is32Hdr)
+      return symbols32[i].st_value;
+    else
+      return symbols64[i].st_value;
+  }
+
+  /**	Get size of symbol number i
+   *      \param i = symbol number
+   *      \return size of the object in bytes
+   */
+  uint64_t getSymSize(uint64_t i) {
+    if (is32Hdr)
+      return symbols32[i].st_size;
+    else
+      return symbols64[i].st_size;
+  }
+
+  /**	Get type of symbol number i
+   *      \param i = symbol number
+   *      \return type of symbol (STT_*)
+   */
+  int getSymType(uint64_t i) {
+    if (is32Hdr)
+      return ELF_ST_TYPE(symbols32[i].st_info);
+    else
+      return ELF_ST_TYPE(symbols64[i].st_info);
+  }
+
+  /**	Get name of symbol number i
+   *      \param i = symbol number
+   *      \return name of symbol
+   */
+  const char *getSymName(uint64_t i) {
+    if (is32Hdr)
+      return symnames + symbols32[i].st_name;
+    else
+      return symnames + symbols64[i].st_name;
   }
 
   /**	Get number of sections in Elf
@@ -314,6 +431,118 @@ public:
     else
       return shnames + section_table64[i].sh_name;
   }
+
+  /**	Get number of program headers (segments) in Elf
+   *      \return number of segments
+   */
+  uint16_t getPhNum() {
+    if (is32Hdr)
+      return elf32Hdr.e_phnum;
+    else
+      return elf64Hdr.e_phnum;
+  }
+
+  /**	Get type of segment number i
+   *      \param i = segment number
+   *      \return type of segment (PT_*)
+   */
+  uint64_t getPhType(int i) {
+    if (is32Hdr)
+      return program_table32[i].p_type;
+    else
+      return program_table64[i].p_type;
+  }
+
+  /**	Get access rights of segment number i
+   *      \param i = segment number
+   *      \return flags of segment (PF_*)
+   */
+  uint64_t getPhFlags(int i) {
+    if (is32Hdr)
+      return program_table32[i].p_flags;
+    else
+      return program_table64[i].p_flags;
+  }
+
+  /**	Get offset in file of segment number i
+   *      \param i = segment number
+   *      \return offset in file (bytes)
+   */
+  uint64_t getPhOffset(int i) {
+    if (is32Hdr)
+      return program_table32[i].p_offset;
+    else
+      return program_table64[i].p_offset;
+  }
+
+  /**	Get virtual address of segment number i
+   *      \param i = segment number
+   *      \return virtual address of segment
+   */
+  uint64_t getPhAddr(int i) {
+    if (is32Hdr)
+      return program_table32[i].p_vaddr;
+    else
+      return program_table64[i].p_vaddr;
+  }
+
+  /**	Get size in file of segment number i
+   *      \param i = segment number
+   *      \return size of the image of the segment (bytes)
+   */
+  uint64_t getPhFileSize(int i) {
+    if (is32Hdr)
+      return program_table32[i].p_filesz;
+    else
+      return program_table64[i].p_filesz;
+  }
+
+  /**	Get size in memory of segment number i
+   *      \param i = segment number
+   *      \return size of segment in memory (bytes)
+   */
+  uint64_t getPhMemSize(int i) {
+    if (is32Hdr)
+      return program_table32[i].p_memsz;
+    else
+      return program_table64[i].p_memsz;
+  }
+};
+
+//! Number of executable files whose headers are kept by the ElfCache
+#define ELF_CACHE_SIZE 8
+
+/*! \brief Defines the cache of the parsed headers of executable files
+//
+// Executing a program again does not read and parse its headers again.
+// The entries are indexed by the sector of the file header, and the
+// least recently used one is replaced. The file system forgets the
+// entry of a file when it is written or removed.
+*/
+class ElfCache {
+public:
+  ElfCache();    //!< Initialize an empty cache
+  ~ElfCache();   //!< Delete the cached headers
+
+  /**	Get the parsed headers of an executable file, reading them if
+   *      they are not cached
+   *      \param exec_file is the file containing the object code
+   *      \param err: error code NO_ERROR if OK
+   *      \return the headers, owned by the cache, or NULL on error. They
+   *      stay valid until the calling thread blocks.
+   */
+  ElfFile *Lookup(OpenFile *exec_file, uint64_t *err);
+
+  /**	Forget the headers of a file
+   *      \param sector is the sector of the file header
+   */
+  void Forget(int sector);
+
+private:
+  int sectors[ELF_CACHE_SIZE];        //!< File of each entry (-1 if free)
+  ElfFile *files[ELF_CACHE_SIZE];     //!< Headers of each entry
+  uint64_t lastUse[ELF_CACHE_SIZE];   //!< Time of the last lookup
+  uint64_t clock;                     //!< Lookups done so far
 };
 
 #endif /* NACHOS_ELF_H */
@@ -30,13 +30,20 @@
 */
 #include "drivers/drvACIA.h"
 #include "drivers/drvConsole.h"
+#include "filesys/bufcache.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
 #include "filesys/oftable.h"
+#include "kernel/aio.h"
 #include "kernel/msgerror.h"
+#include "kernel/pipe.h"
+#include "vm/shm.h"
 #include "kernel/synch.h"
 #include "kernel/system.h"
 #include "machine/machine.h"
 #include "userlib/syscall.h"
 #include "vm/pagefaultmanager.h"
+#include "vm/physMem.h"
 
 //----------------------------------------------------------------------
 // GetLengthParam
@@ -47,42 +54,1638 @@
 //----------------------------------------------------------------------
 static int
 GetLengthParam(int addr) {
-  int i = 0;
-  uint64_t c = 1;   // Non nul value to start scanning the string
+  // Scan the string page by page until the null character is found
+  int length = g_machine->mmu->UserStringLength(addr);
 
-  // Scan the string until the null character is found
-  while (c != 0) {
-    g_machine->mmu->ReadMem(addr++, 1, &c);
-    i++;
+  // An invalid string is seen as an empty one
+  return (length == ERROR) ? 1 : length;
+}
+
+//----------------------------------------------------------------------
+// GetStringParam
+/*!	Copies a string from the machine memory
+//
+//	\param addr is the memory address of the string
+//	\param dest is where the string is going to be copied
+//      \param maxlen maximum length of the string to copy in dest,
+//        including the trailing '\0'
+*/
+//----------------------------------------------------------------------
+static void
+GetStringParam(uint64_t addr, char *dest, int maxlen) {
+  // Copy the string page by page, dest is always terminated
+  g_machine->mmu->CopyStringFromUser(addr, dest, maxlen);
+}
+
+//----------------------------------------------------------------------
+// ReadFileToUser
+/*!	Read bytes of an open file, from a given position, straight
+//	into a buffer of the machine memory. Each page of the buffer is
+//	translated (which brings it in memory and marks it dirty), then
+//	locked so that it cannot be evicted while the thread waits for
+//	the disk, and the file is read directly into main memory.
+//
+//	\param file is the open file to read
+//	\param addr is the memory address of the buffer
+//	\param size is the number of bytes to read
+//	\param position is the offset within the file of the first byte
+//	\return the number of bytes read
+*/
+//----------------------------------------------------------------------
+int
+ReadFileToUser(OpenFile *file, uint64_t addr, int size, int position) {
+  int total = 0;
+
+  while (total < size) {
+    // The thread may go on on another hart after waiting for the disk
+    MMU *mmu = g_machine->mmu;
+    uint32_t physAddr;
+    int n = g_cfg->PageSize - (addr & g_cfg->PageMask);
+    if (n > size - total)
+      n = size - total;
+
+    ExceptionType exc = mmu->Translate(addr, &physAddr, 1, true);
+    if (exc != NO_EXCEPTION) {
+      g_machine->RaiseException(exc, addr);
+      break;
+    }
+
+    // Lock the frame, it may have been replaced while we waited for it
+    uint64_t pp = physAddr >> g_cfg->PageShift;
+    uint64_t vpn = addr >> g_cfg->PageShift;
+    g_physical_mem_manager->LockPage(pp);
+    if (!mmu->translationTable->getBitValid(vpn) ||
+        mmu->translationTable->getPhysicalPage(vpn) != pp) {
+      g_physical_mem_manager->UnlockPage(pp);
+      continue;
+    }
+
+    int numread = file->ReadAt((char *) &g_machine->mainMemory[physAddr], n,
+                               position + total);
+    mmu->InvalidateDecodedPage(pp);
+    g_physical_mem_manager->UnlockPage(pp);
+
+    total += numread;
+    addr += numread;
+    if (numread < n)
+      break;   // end of file
+  }
+  return total;
+}
+
+//----------------------------------------------------------------------
+// ReadConsoleToUser
+/*!	Read a line from the console into a buffer of the machine memory,
+//	by chunks through the I/O buffer of the thread. The line is
+//	terminated by a '\0' if there is room for it in the buffer.
+//
+//	\param addr is the memory address of the buffer
+//	\param size is the maximum number of chars to read
+//	\return the number of chars received if ShortReads is set in the
+//	configuration, else size
+*/
+//----------------------------------------------------------------------
+int
+ReadConsoleToUser(uint64_t addr, int size) {
+  char *buffer = g_current_thread->GetIOBuffer();
+  int total = 0;
+
+  while (total < size) {
+    // Keep room for the '\0' added by GetString
+    int n = size - total;
+    if (n > IO_BUFFER_SIZE - 1)
+      n = IO_BUFFER_SIZE - 1;
+    g_console_driver->GetString(buffer, n);
+
+    int received = strlen(buffer);
+    bool eol =
+        (received < n) || (received > 0 && buffer[received - 1] == '\n');
+    int copied = received;
+    if (eol && total + received < size)
+      copied++;   // the '\0'
+    if (!g_machine->mmu->CopyToUser(addr + total, buffer, copied))
+      break;
+    total += received;
+    if (eol)
+      break;
+  }
+  return g_cfg->ShortReads ? total : size;
+}
+
+//----------------------------------------------------------------------
+// WriteFromUser
+/*!	Write a buffer of the machine memory to a file or to the console,
+//	by chunks through the I/O buffer of the thread. Writing stops at
+//	the first chunk that could not be entirely written.
+//
+//	\param file is the open file to write to, NULL for the console
+//	\param addr is the memory address of the buffer
+//	\param size is the number of bytes to write
+//	\param position is the offset within the file of the first byte
+//	(unused for the console)
+//	\return the number of bytes written
+*/
+//----------------------------------------------------------------------
+int
+WriteFromUser(OpenFile *file, uint64_t addr, int size, int position) {
+  char *buffer = g_current_thread->GetIOBuffer();
+  int total = 0;
+
+  while (total < size) {
+    int n = size - total;
+    if (n > IO_BUFFER_SIZE)
+      n = IO_BUFFER_SIZE;
+    if (!g_machine->mmu->CopyFromUser(addr + total, buffer, n))
+      break;
+
+    int written = n;
+    if (file != NULL)
+      written = file->WriteAt(buffer, n, position + total);
+    else
+      g_console_driver->PutString(buffer, n);
+    total += written;
+    if (written < n)
+      break;
+  }
+  return total;
+}
+
+//----------------------------------------------------------------------
+// TransferVector
+/*!	Read or write the buffers of an array of IOVec of the machine
+//	memory, in order, from a given position of a file. The transfer
+//	stops at the first buffer that could not be entirely filled or
+//	written.
+//
+//	\param file is the open file, NULL for the console (write only)
+//	\param iov is the memory address of the array of IOVec
+//	\param count is the number of IOVec in the array
+//	\param position is the offset within the file of the first byte
+//	\param writing is true to write the buffers, false to read them
+//	\return the total number of bytes transferred
+*/
+//----------------------------------------------------------------------
+static int
+TransferVector(OpenFile *file, uint64_t iov, int count, int position,
+               bool writing) {
+  // Layout of an IOVec in the machine memory (see userlib/syscall.h)
+  struct {
+    uint64_t base;
+    int64_t len;
+  } vec;
+  int total = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (!g_machine->mmu->CopyFromUser(iov + i * sizeof(vec), (char *) &vec,
+                                      sizeof(vec)) ||
+        vec.len < 0)
+      break;
+
+    int n;
+    if (writing)
+      n = WriteFromUser(file, vec.base, vec.len, position + total);
+    else
+      n = ReadFileToUser(file, vec.base, vec.len, position + total);
+    total += n;
+    if (n < vec.len)
+      break;
+  }
+  return total;
+}
+
+//----------------------------------------------------------------------
+// SyscallHalt
+/*!	The halt system call. Stops Nachos.
+*/
+//----------------------------------------------------------------------
+static void
+SyscallHalt(int64_t no_syscall) {
+  DEBUG('e', (char *) "Shutdown, initiated by user program.\n");
+  g_console_driver->Flush();
+  g_file_system->Sync();
+  g_buffer_cache->Flush();
+  g_machine->interrupt->Halt(NO_ERROR);
+}
+
+//----------------------------------------------------------------------
+// SyscallSysTime
+/*!	The systime system call. Gets the system time
+*/
+//----------------------------------------------------------------------
+static void
+SyscallSysTime(int64_t no_syscall) {
+  DEBUG('e', (char *) "Systime call, initiated by user program.\n");
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  uint64_t tick = g_stats->getTotalTicks();
+  uint32_t seconds =
+      (uint32_t) cycle_to_sec(tick, g_cfg->ProcessorFrequency);
+  uint32_t nanos =
+      (uint32_t) cycle_to_nano(tick, g_cfg->ProcessorFrequency);
+  g_machine->mmu->WriteMem(addr, sizeof(uint32_t), seconds);
+  g_machine->mmu->WriteMem(addr + 4, sizeof(uint32_t), nanos);
+}
+
+//----------------------------------------------------------------------
+// SyscallExit
+/*!	The exit system call
+//	Ends the calling thread
+*/
+//----------------------------------------------------------------------
+static void
+SyscallExit(int64_t no_syscall) {
+  DEBUG('e', (char *) "Thread 0x%x %s exit call.\n", g_current_thread,
+        g_current_thread->GetName());
+  ASSERT(g_current_thread->type == THREAD_TYPE);
+  g_current_thread->Finish();
+}
+
+//----------------------------------------------------------------------
+// SyscallExec
+/*!	The exec system call
+//	Creates a new process (thread+address space)
+*/
+//----------------------------------------------------------------------
+static void
+SyscallExec(int64_t no_syscall) {
+  DEBUG('e', (char *) "Process: Exec call.\n");
+  uint64_t addr;
+  uint64_t size;
+  char name[MAXSTRLEN];
+  uint64_t error = NO_ERROR;
+
+  // Get the process name
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  size = GetLengthParam(addr);
+  char ch[size];
+  GetStringParam(addr, ch, size);
+  sprintf(name, "master thread of process %s", ch);
+  Process *p = new Process(ch, &error);
+  if (error != NO_ERROR) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    if (error == OUT_OF_MEMORY)
+      g_syscall_error->SetError(error);
+    else
+      g_syscall_error->SetMsg(ch, error);
+    return;
+  }
+  // The new process inherits the standard input and output
+  Process *parent = g_current_thread->GetProcessOwner();
+  p->stdInput = parent->stdInput;
+  p->stdOutput = parent->stdOutput;
+  Pipe::Retain(p->stdInput);
+  Pipe::Retain(p->stdOutput);
+  Thread *ptThread = new Thread(name);
+  int32_t tid = g_object_addrs->AddObject(ptThread, THREAD_TYPE);
+  ptThread->SetObjectId(tid);
+  error = ptThread->Start(p, p->addrspace->getCodeStartAddress64(), -1);
+  if (error != NO_ERROR) {
+    // The process will not run: the peers must see its ends closed
+    Pipe::Release(p->stdInput);
+    Pipe::Release(p->stdOutput);
+    p->stdInput = CONSOLE_INPUT;
+    p->stdOutput = CONSOLE_OUTPUT;
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    if (error == OUT_OF_MEMORY)
+      g_syscall_error->SetError(error);
+    else
+      g_syscall_error->SetMsg(name, error);
+    return;
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, tid);
+}
+
+//----------------------------------------------------------------------
+// SyscallNewThread
+/*!	The newThread system call
+//	Create a new thread in the same address space
+*/
+//----------------------------------------------------------------------
+static void
+SyscallNewThread(int64_t no_syscall) {
+  DEBUG('e', (char *) "Multithread: NewThread call.\n");
+  Thread *ptThread;
+  uint64_t name_addr;
+  int64_t fun;
+  uint64_t arg;
+  uint64_t err = NO_ERROR;
+  // Get the address of the string for the name of the thread
+  name_addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  // Get the pointer to the function to be executed by the new thread
+  fun = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  // Get the function parameters
+  arg = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
+  // Build the name of the thread
+  int size = GetLengthParam(name_addr);
+  char thr_name[size];
+  GetStringParam(name_addr, thr_name, size);
+  // char *proc_name = g_current_thread->getProcessOwner()->getName();
+  //  Finally start it
+  ptThread = new Thread(thr_name);
+  int32_t tid = g_object_addrs->AddObject(ptThread, THREAD_TYPE);
+  ptThread->SetObjectId(tid);
+  err = ptThread->Start(g_current_thread->GetProcessOwner(), fun, arg);
+  if (err != NO_ERROR) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(err);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, tid);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallJoin
+/*!	The join system call
+//	Wait for the thread idThread to finish
+*/
+//----------------------------------------------------------------------
+static void
+SyscallJoin(int64_t no_syscall) {
+  DEBUG('e', (char *) "Process or thread: Join call.\n");
+  int64_t tid;
+  Thread *ptThread;
+  tid = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  ptThread = (Thread *) g_object_addrs->SearchObject(tid, THREAD_TYPE);
+  if (ptThread && ptThread->type == THREAD_TYPE)
+    g_current_thread->Join(ptThread);
+  // Otherwise the thread already terminated (its identifier was removed
+  // by Finish) or the call is on an object that is not a thread. Exit with no error
+  // code since we cannot separate the two cases
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  DEBUG('e', (char *) "Fin Join");
+}
+
+//----------------------------------------------------------------------
+// SyscallSleep
+/*!	The sleep system call
+//	Sleep for a number of cycles, off the ready list
+*/
+//----------------------------------------------------------------------
+static void
+SyscallSleep(int64_t no_syscall) {
+  int64_t ticks = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  DEBUG('e', (char *) "Thread: Sleep call for %lld cycles.\n", ticks);
+  if (ticks < 0) {
+    g_syscall_error->SetError(INVALID_DURATION);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    return;
+  }
+  g_current_thread->SleepUntil(g_stats->getTotalTicks() + ticks);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+}
+
+//----------------------------------------------------------------------
+// SyscallPipe
+/*!	The pipe system call
+//	Create a pipe, and return its reader and its writer
+*/
+//----------------------------------------------------------------------
+static void
+SyscallPipe(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Pipe call.\n");
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  Pipe *pipe = new Pipe();
+  if (!g_machine->mmu->WriteMem(addr, sizeof(int64_t),
+                                pipe->GetId(PIPE_READER)) ||
+      !g_machine->mmu->WriteMem(addr + sizeof(int64_t), sizeof(int64_t),
+                                pipe->GetId(PIPE_WRITER))) {
+    Pipe::Release(pipe->GetId(PIPE_READER));
+    Pipe::Release(pipe->GetId(PIPE_WRITER));
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    return;
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+}
+
+//----------------------------------------------------------------------
+// SyscallRedirect
+/*!	The redirect system call
+//	Set the standard input and output of the process
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRedirect(int64_t no_syscall) {
+  int64_t input = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int64_t output = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  DEBUG('e', (char *) "Filesystem: Redirect call (%lld, %lld).\n", input,
+        output);
+  if (input != CONSOLE_INPUT && !Pipe::IsEnd(input, PIPE_READER)) {
+    g_syscall_error->SetError(INVALID_FILE_ID, input);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    return;
+  }
+  if (output != CONSOLE_OUTPUT && !Pipe::IsEnd(output, PIPE_WRITER)) {
+    g_syscall_error->SetError(INVALID_FILE_ID, output);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    return;
+  }
+  // Retain first: the new ends may be the current ones
+  Process *process = g_current_thread->GetProcessOwner();
+  Pipe::Retain(input);
+  Pipe::Retain(output);
+  Pipe::Release(process->stdInput);
+  Pipe::Release(process->stdOutput);
+  process->stdInput = input;
+  process->stdOutput = output;
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+}
+
+//----------------------------------------------------------------------
+// SyscallYield
+/*!	The yield system call
+//	Give the processor to another ready thread
+*/
+//----------------------------------------------------------------------
+static void
+SyscallYield(int64_t no_syscall) {
+  if (g_current_thread->type == THREAD_TYPE) {
+    g_current_thread->Yield();
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_syscall_error->SetError(INVALID_SEMAPHORE_ID);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallPError
+/*!	the PError system call
+//	print the last error message
+*/
+//----------------------------------------------------------------------
+static void
+SyscallPError(int64_t no_syscall) {
+  DEBUG('e', (char *) "Debug: Perror call.\n");
+  uint64_t size;
+  int addr;
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  size = GetLengthParam(addr);
+  char ch[size];
+  GetStringParam(addr, ch, size);
+  g_syscall_error->PrintLastMsg(g_console_driver, ch);
+}
+
+//----------------------------------------------------------------------
+// SyscallCreate
+/*!	The create system call
+//	Create a new file in nachos file system
+*/
+//----------------------------------------------------------------------
+static void
+SyscallCreate(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Create call.\n");
+  uint64_t addr;
+  int size;
+  uint64_t ret;
+  int sizep;
+  // Get the name and initial size of the new file
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  sizep = GetLengthParam(addr);
+  char ch[sizep];
+  GetStringParam(addr, ch, sizep);
+  // Try to create it
+  int err = g_file_system->Create(ch, size);
+  if (err == NO_ERROR) {
+    ret = NO_ERROR;
+  } else {
+    ret = ERROR;
+    if (err == OUT_OF_DISK)
+      g_syscall_error->SetError(err);
+    else
+      g_syscall_error->SetMsg(ch, err);
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, ret);
+}
+
+//----------------------------------------------------------------------
+// SyscallOpen
+/*!	The open system call
+//	Opens a file and returns an openfile identifier
+*/
+//----------------------------------------------------------------------
+static void
+SyscallOpen(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Open call.\n");
+  uint64_t addr;
+  int sizep;
+  int ret = 0;
+  // Get the file name
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  sizep = GetLengthParam(addr);
+  char ch[sizep];
+  GetStringParam(addr, ch, sizep);
+  // Try to open the file
+  OpenFile *file = g_open_file_table->Open(ch);
+  if (file == NULL) {
+    g_syscall_error->SetMsg(ch, OPENFILE_ERROR);
+  } else {
+    ret = g_object_addrs->AddObject(file, FILE_TYPE);
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, ret);
+}
+
+//----------------------------------------------------------------------
+// SyscallRead
+/*!	The read system call
+//	Read in a file or the console
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRead(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Read call.\n");
+  uint64_t addr;
+  int size;
+  int64_t f;
+  int numread;
+  // Get the buffer address in the machine memory
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  // Get the requested size
+  size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  // Get the openfile number or 0 (standard input)
+  f = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
+  if (f == CONSOLE_INPUT)
+    f = g_current_thread->GetProcessOwner()->stdInput;
+
+  // Read in a file, straight into the pages of the user buffer
+  if (f != CONSOLE_INPUT) {
+    int64_t fid = f;
+    OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid, FILE_TYPE);
+    Pipe *pipe = (Pipe *) g_object_addrs->SearchObject(fid, PIPE_READER_TYPE);
+    if (pipe != NULL) {
+      numread = pipe->Read(addr, size);
+    } else if (file && file->type == FILE_TYPE) {
+      int position = file->Tell();
+      numread = ReadFileToUser(file, addr, size, position);
+      file->Seek(position + numread);
+      file->ReadAhead(position, numread);
+    } else {
+      numread = ERROR;
+      g_syscall_error->SetError(INVALID_FILE_ID, f);
+    }
+  }
+  // Read on the console
+  else {
+    numread = ReadConsoleToUser(addr, size);
+    DEBUG('e', (char *) "Console read of size %d\n", numread);
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, numread);
+}
+
+//----------------------------------------------------------------------
+// SyscallWrite
+/*!	The write system call
+//	Write in a file or at the console
+*/
+//----------------------------------------------------------------------
+static void
+SyscallWrite(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Write call.\n");
+  uint64_t addr;
+  int size;
+  uint64_t f;
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  // f is the openfileid or 1 (standard output)
+  f = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
+  if (f == CONSOLE_OUTPUT)
+    f = g_current_thread->GetProcessOwner()->stdOutput;
+  int numwrite;
+  // Write in a file or a pipe
+  if (f > CONSOLE_OUTPUT) {
+    int64_t fid = f;
+    OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid, FILE_TYPE);
+    Pipe *pipe = (Pipe *) g_object_addrs->SearchObject(fid, PIPE_WRITER_TYPE);
+    if (pipe != NULL) {
+      numwrite = pipe->Write(addr, size);
+      if (numwrite == ERROR)
+        g_syscall_error->SetError(BROKEN_PIPE, f);
+    } else if (file && file->type == FILE_TYPE) {
+      // write in file
+      int position = file->Tell();
+      numwrite = WriteFromUser(file, addr, size, position);
+      file->Seek(position + numwrite);
+    } else {
+      numwrite = ERROR;
+      g_syscall_error->SetError(INVALID_FILE_ID, f);
+    }
+  }
+  // write at the console
+  else {
+    if (f == CONSOLE_OUTPUT) {
+      numwrite = WriteFromUser(NULL, addr, size, 0);
+    } else {
+      numwrite = ERROR;
+      g_syscall_error->SetError(INVALID_FILE_ID, f);
+    }
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, numwrite);
+}
+
+//----------------------------------------------------------------------
+// SyscallSeek
+/*!	The seek system call
+//	Seek to a given position in an opened file
+*/
+//----------------------------------------------------------------------
+static void
+SyscallSeek(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Seek call.\n");
+  int offset;
+  int64_t f;
+  uint64_t error = NO_ERROR;
+
+  // Get the offset into the file
+  offset = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  // Get the openfile number or 1 (console)
+  f = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+
+  // Seek into a file
+  if (f > CONSOLE_OUTPUT) {
+    int64_t fid = f;
+    OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid, FILE_TYPE);
+    if (file && file->type == FILE_TYPE) {
+      file->Seek(offset);
+    } else {
+      error = ERROR;
+      g_syscall_error->SetError(INVALID_FILE_ID, f);
+    }
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, error);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_FILE_ID, f);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallVectorIO
+/*!	The readv and writev system calls
+//	Read or write several buffers in a file, or write them at the
+//	console, from the current position
+*/
+//----------------------------------------------------------------------
+static void
+SyscallVectorIO(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Readv/Writev call.\n");
+  bool writing = (no_syscall == SC_WRITEV);
+  uint64_t iov = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int count = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  int64_t f = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
+  int numbytes;
+
+  if (f > CONSOLE_OUTPUT) {
+    OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(f, FILE_TYPE);
+    if (file && file->type == FILE_TYPE) {
+      int position = file->Tell();
+      numbytes = TransferVector(file, iov, count, position, writing);
+      file->Seek(position + numbytes);
+    } else {
+      numbytes = ERROR;
+      g_syscall_error->SetError(INVALID_FILE_ID, f);
+    }
+  } else if (writing && f == CONSOLE_OUTPUT) {
+    numbytes = TransferVector(NULL, iov, count, 0, true);
+  } else {
+    numbytes = ERROR;
+    g_syscall_error->SetError(INVALID_FILE_ID, f);
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, numbytes);
+}
+
+//----------------------------------------------------------------------
+// SyscallPositionalIO
+/*!	The pread and pwrite system calls
+//	Read or write a file at a given position, without using or
+//	changing its current position
+*/
+//----------------------------------------------------------------------
+static void
+SyscallPositionalIO(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Pread/Pwrite call.\n");
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  int offset = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
+  int64_t f = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_4);
+  OpenFile *file = NULL;
+  int numbytes;
+
+  if (f > CONSOLE_OUTPUT)
+    file = (OpenFile *) g_object_addrs->SearchObject(f, FILE_TYPE);
+  if (file && file->type == FILE_TYPE) {
+    if (no_syscall == SC_PWRITE)
+      numbytes = WriteFromUser(file, addr, size, offset);
+    else
+      numbytes = ReadFileToUser(file, addr, size, offset);
+  } else {
+    numbytes = ERROR;
+    g_syscall_error->SetError(INVALID_FILE_ID, f);
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, numbytes);
+}
+
+//----------------------------------------------------------------------
+// SyscallAio
+/*!	The asynchronous I/O system calls
+//	Hand the new requests of a ring to the worker of the process,
+//	or wait for their completions
+*/
+//----------------------------------------------------------------------
+static void
+SyscallAio(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: AioSubmit/AioWait call.\n");
+  uint64_t ring = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int min = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  Process *process = g_current_thread->GetProcessOwner();
+  int result;
+
+  if (process->aio == NULL)
+    process->aio = new AioContext(process);
+  if (no_syscall == SC_AIO_SUBMIT)
+    result = process->aio->Submit(ring);
+  else
+    result = process->aio->Wait(ring, min);
+  if (result == ERROR)
+    g_syscall_error->SetError(INVALID_AIO_RING, ring);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
+}
+
+//----------------------------------------------------------------------
+// SyscallClose
+/*!	The close system call
+//	Close a file
+*/
+//----------------------------------------------------------------------
+static void
+SyscallClose(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Close call.\n");
+  // Get the openfile number
+  int64_t fid = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid, FILE_TYPE);
+  DirectoryStream *dir =
+      (DirectoryStream *) g_object_addrs->SearchObject(fid, DIRECTORY_TYPE);
+  if (Pipe::IsEnd(fid, PIPE_READER) || Pipe::IsEnd(fid, PIPE_WRITER)) {
+    Pipe::Release(fid);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else if (file && file->type == FILE_TYPE) {
+    g_open_file_table->Close(file);
+    g_object_addrs->RemoveObject(fid);
+    delete file;
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else if (dir != NULL) {
+    g_object_addrs->RemoveObject(fid);
+    delete dir;
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_FILE_ID, fid);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallRemove
+/*!	The Remove system call
+//	Remove a file from the file system
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRemove(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Remove call.\n");
+  uint64_t ret;
+  uint64_t addr;
+  int sizep;
+  // Get the name of the file to be removes
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  sizep = GetLengthParam(addr);
+  char *ch = new char[sizep];
+  GetStringParam(addr, ch, sizep);
+  // Actually remove it
+  int err = g_open_file_table->Remove(ch);
+  if (err == NO_ERROR) {
+    ret = 0;
+  } else {
+    ret = ERROR;
+    g_syscall_error->SetMsg(ch, err);
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, ret);
+}
+
+//----------------------------------------------------------------------
+// SyscallMkdir
+/*!	the Mkdir system call
+//	make a new directory in the file system
+*/
+//----------------------------------------------------------------------
+static void
+SyscallMkdir(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Mkdir call.\n");
+  uint64_t addr;
+  int sizep;
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  sizep = GetLengthParam(addr);
+  char name[sizep];
+  GetStringParam(addr, name, sizep);
+  // name is the name of the new directory
+  uint64_t good = g_file_system->Mkdir(name);
+  if (good != NO_ERROR) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    if (good == OUT_OF_DISK)
+      g_syscall_error->SetError(good);
+    else
+      g_syscall_error->SetMsg(name, good);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, (good));
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallRmdir
+/*!	the Rmdir system call
+//	remove a directory from the file system
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRmdir(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Rmdir call.\n");
+  uint64_t addr;
+  int sizep;
+  addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  sizep = GetLengthParam(addr);
+  char name[sizep];
+  GetStringParam(addr, name, sizep);
+  uint64_t good = g_file_system->Rmdir(name);
+  if (good != NO_ERROR) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetMsg(name, good);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, good);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallFSList
+/*!	The FSList system call
+//	Lists all the file and directories in the filesystem
+*/
+//----------------------------------------------------------------------
+static void
+SyscallFSList(int64_t no_syscall) {
+  g_file_system->List();
+}
+
+//----------------------------------------------------------------------
+// SyscallOpenDir
+/*!	The OpenDir system call
+//	Open a directory to read its entries with ReadDir
+*/
+//----------------------------------------------------------------------
+static void
+SyscallOpenDir(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: OpenDir call.\n");
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int sizep = GetLengthParam(addr);
+  char name[sizep];
+  GetStringParam(addr, name, sizep);
+  DirectoryStream *dir = g_file_system->OpenDir(name);
+  if (dir == NULL) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetMsg(name, NOT_A_DIRECTORY);
+    return;
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL,
+                              g_object_addrs->AddObject(dir, DIRECTORY_TYPE));
+}
+
+//----------------------------------------------------------------------
+// SyscallReadDir
+/*!	The ReadDir system call
+//	Copy the next entries of a directory into an array of DirEntry
+//	of the machine memory, at most READDIR_MAX_ENTRIES per call
+*/
+//----------------------------------------------------------------------
+static void
+SyscallReadDir(int64_t no_syscall) {
+  int64_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  int64_t count = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
+  DEBUG('e', (char *) "Filesystem: ReadDir call (%lld, %lld).\n", id, count);
+  DirectoryStream *dir =
+      (DirectoryStream *) g_object_addrs->SearchObject(id, DIRECTORY_TYPE);
+  if (dir == NULL || count < 0) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_FILE_ID, id);
+    return;
+  }
+  if (count > READDIR_MAX_ENTRIES)
+    count = READDIR_MAX_ENTRIES;
+
+  // Layout of a DirEntry in the machine memory (see userlib/syscall.h)
+  struct {
+    int64_t isDir;
+    char name[DIRENT_NAME_SIZE];
+  } user;
+  ASSERT(FILENAMEMAXLEN < DIRENT_NAME_SIZE);
+
+  DirectoryEntry entries[READDIR_MAX_ENTRIES];
+  int n = dir->Read(entries, count);
+  for (int i = 0; i < n; i++) {
+    memset(&user, 0, sizeof(user));
+    user.isDir = entries[i].isDir;
+    strncpy(user.name, entries[i].name, FILENAMEMAXLEN);
+    if (!g_machine->mmu->CopyToUser(addr + i * sizeof(user), (char *) &user,
+                                    sizeof(user))) {
+      g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+      return;
+    }
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, n);
+}
+
+//----------------------------------------------------------------------
+// AciaPortParameter
+/*!	Read the port argument of TtySendTo and TtyReceiveFrom, port 0
+//	for TtySend and TtyReceive, whose other arguments come one
+//	register earlier.
+//
+//	\param no_syscall the system call
+//	\param sendTo the system call taking a port
+//	\param first set to the register of the first other argument
+//	\return the port, -1 (error set) if the ACIA has no such port
+*/
+//----------------------------------------------------------------------
+static int
+AciaPortParameter(int64_t no_syscall, int64_t sendTo, int *first) {
+  if (no_syscall != sendTo) {
+    *first = REG_SYSCALL_PARAM_1;
+    return 0;
+  }
+  *first = REG_SYSCALL_PARAM_2;
+  int64_t port = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  if (port < 0 || port >= g_machine->acia->NumPorts()) {
+    g_syscall_error->SetError(INVALID_ACIA_PORT, port);
+    return ERROR;
+  }
+  return port;
+}
+
+//----------------------------------------------------------------------
+// SyscallTtySend
+/*!	the TtySend and TtySendTo system calls
+//	Sends some char by the serial line emulated, through a port of
+//	the ACIA for TtySendTo
+*/
+//----------------------------------------------------------------------
+static void
+SyscallTtySend(int64_t no_syscall) {
+  DEBUG('e', (char *) "ACIA: Send call.\n");
+  if (g_cfg->ACIA != ACIA_NONE) {
+    uint64_t result;
+    int first;
+    int port = AciaPortParameter(no_syscall, SC_TTY_SEND_TO, &first);
+    if (port < 0) {
+      g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+      return;
+    }
+    uint64_t addr = g_machine->ReadIntRegister(first);
+    char buff[MAXSTRLEN];
+    g_machine->mmu->CopyStringFromUser(addr, buff, MAXSTRLEN);
+    result = g_acia_driver->TtySend(buff, port);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(NO_ACIA);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallTtyReceive
+/*!	the TtyReceive and TtyReceiveFrom system calls
+//	read some char on the serial line, from a port of the ACIA for
+//	TtyReceiveFrom
+*/
+//----------------------------------------------------------------------
+static void
+SyscallTtyReceive(int64_t no_syscall) {
+  DEBUG('e', (char *) "ACIA: Receive call.\n");
+  if (g_cfg->ACIA != ACIA_NONE) {
+    uint64_t result;
+    int first;
+    int port = AciaPortParameter(no_syscall, SC_TTY_RECEIVE_FROM, &first);
+    if (port < 0) {
+      g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+      return;
+    }
+    uint64_t addr = g_machine->ReadIntRegister(first);
+    int length = g_machine->ReadIntRegister(first + 1);
+    char buff[length + 1];
+    result = g_acia_driver->TtyReceive(buff, length, port);
+    g_machine->mmu->CopyToUser(addr, buff, length + 1);
+    g_machine->mmu->WriteMem(addr + length + 1, 1, 0);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(NO_ACIA);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallMmap
+/*!	The mmap system call
+//	Map a file in memory
+*/
+//----------------------------------------------------------------------
+static void
+SyscallMmap(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Mmap call.\n");
+  uint64_t fid = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid, FILE_TYPE);
+  if (file) {
+    int size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+    AddrSpace *ap = g_current_thread->GetProcessOwner()->addrspace;
+    int addr = ap->Mmap(file, size);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ((int) addr));
+    if (addr == ERROR)
+      g_syscall_error->SetError(OUT_OF_MEMORY);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_FILE_ID, fid);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallMsync
+/*!	The msync system call
+//	Write back the modified pages of a mapped file
+*/
+//----------------------------------------------------------------------
+static void
+SyscallMsync(int64_t no_syscall) {
+  DEBUG('e', (char *) "Filesystem: Msync call.\n");
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  AddrSpace *ap = g_current_thread->GetProcessOwner()->addrspace;
+  int result = ap->Msync(addr, size);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
+  if (result == ERROR)
+    g_syscall_error->SetError(NOT_MAPPED, addr);
+}
+
+//----------------------------------------------------------------------
+// SyscallShmCreate
+/*!	The shm_create system call
+//	Create a shared memory segment
+*/
+//----------------------------------------------------------------------
+static void
+SyscallShmCreate(int64_t no_syscall) {
+  int size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  DEBUG('e', (char *) "Memory: ShmCreate call (%d bytes).\n", size);
+  if (size <= 0) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(OUT_OF_MEMORY);
+    return;
+  }
+  ShmSegment *segment = new ShmSegment(divRoundUp(size, g_cfg->PageSize));
+  AddrSpace *ap = g_current_thread->GetProcessOwner()->addrspace;
+  if (ap->HoldSegment(segment) == ERROR) {
+    segment->Release();
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(OUT_OF_MEMORY);
+    return;
+  }
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, segment->id);
+}
+
+//----------------------------------------------------------------------
+// SyscallShmAttach
+/*!	The shm_attach system call
+//	Map a shared memory segment in the address space
+*/
+//----------------------------------------------------------------------
+static void
+SyscallShmAttach(int64_t no_syscall) {
+  int64_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  DEBUG('e', (char *) "Memory: ShmAttach call (%lld).\n", id);
+  ShmSegment *segment =
+      (ShmSegment *) g_object_addrs->SearchObject(id, SHM_TYPE);
+  if (segment == NULL) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_SHM_ID, id);
+    return;
+  }
+  AddrSpace *ap = g_current_thread->GetProcessOwner()->addrspace;
+  int64_t addr = ap->AttachSegment(segment);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, addr);
+  if (addr == ERROR)
+    g_syscall_error->SetError(OUT_OF_MEMORY);
+}
+
+//----------------------------------------------------------------------
+// SyscallDebug
+/*!	The debug system call
+//	Print its parameter on the host output, or switch the simulation
+//	mode of the user code (DEBUG_DETAILED, DEBUG_FAST_FORWARD)
+*/
+//----------------------------------------------------------------------
+static void
+SyscallDebug(int64_t no_syscall) {
+  DEBUG('e', (char *) "Nachos: debug system call.\n");
+  int64_t param = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  if (param == DEBUG_DETAILED || param == DEBUG_FAST_FORWARD) {
+    g_machine->SetFastForward(param == DEBUG_FAST_FORWARD);
+    return;
   }
-  return i + 1;
+  printf("Debug system call: parameter %" PRIu64 "\n", param);
 }
 
 //----------------------------------------------------------------------
-// GetStringParam
-/*!	Copies a string from the machine memory
+// SyscallRWLockCreate
+/*!	Create a reader-writer lock
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRWLockCreate(int64_t no_syscall) {
+  DEBUG('e', (char *) "RWLock: Create call.\n");
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int size = GetLengthParam(addr);
+  char name[size];
+  GetStringParam(addr, name, size);
+  RWLock *rwlock = new RWLock(name);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL,
+                              g_object_addrs->AddObject(rwlock, RWLOCK_TYPE));
+}
+
+//----------------------------------------------------------------------
+// SyscallRWLockDestroy
+/*!	Destroy a reader-writer lock
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRWLockDestroy(int64_t no_syscall) {
+  DEBUG('e', (char *) "RWLock: Destroy call.\n");
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  RWLock *obj = (RWLock *) g_object_addrs->SearchObject(id, RWLOCK_TYPE);
+  if (obj && obj->type == RWLOCK_TYPE) {
+    delete obj;
+    g_object_addrs->RemoveObject(id);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_RWLOCK_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallRWLockRead
+/*!	Acquire a reader-writer lock in read mode
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRWLockRead(int64_t no_syscall) {
+  DEBUG('e', (char *) "RWLock: AcquireRead call.\n");
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  RWLock *obj = (RWLock *) g_object_addrs->SearchObject(id, RWLOCK_TYPE);
+  if (obj && obj->type == RWLOCK_TYPE) {
+    obj->AcquireRead();
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_RWLOCK_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallRWLockWrite
+/*!	Acquire a reader-writer lock in write mode
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRWLockWrite(int64_t no_syscall) {
+  DEBUG('e', (char *) "RWLock: AcquireWrite call.\n");
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  RWLock *obj = (RWLock *) g_object_addrs->SearchObject(id, RWLOCK_TYPE);
+  if (obj && obj->type == RWLOCK_TYPE) {
+    obj->AcquireWrite();
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_RWLOCK_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallRWLockRelease
+/*!	Release a reader-writer lock
+*/
+//----------------------------------------------------------------------
+static void
+SyscallRWLockRelease(int64_t no_syscall) {
+  DEBUG('e', (char *) "RWLock: Release call.\n");
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  RWLock *obj = (RWLock *) g_object_addrs->SearchObject(id, RWLOCK_TYPE);
+  if (obj && obj->type == RWLOCK_TYPE) {
+    obj->Release();
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_RWLOCK_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallBarrierCreate
+/*!	Create a barrier
+*/
+//----------------------------------------------------------------------
+static void
+SyscallBarrierCreate(int64_t no_syscall) {
+  DEBUG('e', (char *) "Barrier: Create call.\n");
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int count = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  if (count <= 0) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_COUNTER);
+    return;
+  }
+  int size = GetLengthParam(addr);
+  char name[size];
+  GetStringParam(addr, name, size);
+  Barrier *barrier = new Barrier(name, count);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL,
+                              g_object_addrs->AddObject(barrier, BARRIER_TYPE));
+}
+
+//----------------------------------------------------------------------
+// SyscallBarrierDestroy
+/*!	Destroy a barrier
+*/
+//----------------------------------------------------------------------
+static void
+SyscallBarrierDestroy(int64_t no_syscall) {
+  DEBUG('e', (char *) "Barrier: Destroy call.\n");
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  Barrier *obj = (Barrier *) g_object_addrs->SearchObject(id, BARRIER_TYPE);
+  if (obj && obj->type == BARRIER_TYPE) {
+    delete obj;
+    g_object_addrs->RemoveObject(id);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_BARRIER_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallBarrierWait
+/*!	Wait for the other threads at a barrier
+*/
+//----------------------------------------------------------------------
+static void
+SyscallBarrierWait(int64_t no_syscall) {
+  DEBUG('e', (char *) "Barrier: Wait call.\n");
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  Barrier *obj = (Barrier *) g_object_addrs->SearchObject(id, BARRIER_TYPE);
+  if (obj && obj->type == BARRIER_TYPE) {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, obj->Wait() ? 1 : 0);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_BARRIER_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallSemCreate
+/*!	Create a semaphore with an initial value
+*/
+//----------------------------------------------------------------------
+static void
+SyscallSemCreate(int64_t no_syscall) {
+  DEBUG('e', (char *) "Semaphore: Create call.\n");
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int initval = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  int size = GetLengthParam(addr);
+  char name[size];
+  GetStringParam(addr, name, size);
+  Semaphore *sem = new Semaphore(name, initval);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL,
+                              g_object_addrs->AddObject(sem, SEMAPHORE_TYPE));
+}
+
+//----------------------------------------------------------------------
+// SyscallSemDestroy
+/*!	Destroy a semaphore
+*/
+//----------------------------------------------------------------------
+static void
+SyscallSemDestroy(int64_t no_syscall) {
+  DEBUG('e', (char *) "Semaphore: Destroy call.\n");
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  Semaphore *sem = (Semaphore *) g_object_addrs->SearchObject(id, SEMAPHORE_TYPE);
+  if (sem && sem->type == SEMAPHORE_TYPE) {
+    delete sem;
+    g_object_addrs->RemoveObject(id);
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_SEMAPHORE_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallP
+/*!	The P system call, on the fast path: no trace and no message
+//	unless the semaphore identifier is invalid
+*/
+//----------------------------------------------------------------------
+static void
+SyscallP(int64_t no_syscall) {
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  Semaphore *sem = (Semaphore *) g_object_addrs->SearchObject(id, SEMAPHORE_TYPE);
+  if (sem) {
+    sem->P();
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_SEMAPHORE_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallV
+/*!	The V system call, on the fast path like SyscallP
+*/
+//----------------------------------------------------------------------
+static void
+SyscallV(int64_t no_syscall) {
+  int32_t id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  Semaphore *sem = (Semaphore *) g_object_addrs->SearchObject(id, SEMAPHORE_TYPE);
+  if (sem) {
+    sem->V();
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
+  } else {
+    g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
+    g_syscall_error->SetError(INVALID_SEMAPHORE_ID, id);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallFutexWait
+/*!	Wait on a futex while its word holds a value
+*/
+//----------------------------------------------------------------------
+static void
+SyscallFutexWait(int64_t no_syscall) {
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int32_t val = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  int result = g_futex_table->Wait(g_current_thread->GetProcessOwner()->addrspace,
+                                   addr, val);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
+  if (result == ERROR)
+    g_syscall_error->SetError(INVALID_FUTEX, addr);
+}
+
+//----------------------------------------------------------------------
+// SyscallFutexWake
+/*!	Wake up the threads waiting on a futex
+*/
+//----------------------------------------------------------------------
+static void
+SyscallFutexWake(int64_t no_syscall) {
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int count = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  g_machine->WriteIntRegister(
+      REG_RET_SYSCALL,
+      g_futex_table->Wake(g_current_thread->GetProcessOwner()->addrspace, addr,
+                          count));
+}
+
+//----------------------------------------------------------------------
+// SyscallSbrk
+/*!	Grow the heap of the process
+*/
+//----------------------------------------------------------------------
+static void
+SyscallSbrk(int64_t no_syscall) {
+  int size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  DEBUG('e', (char *) "Memory: Sbrk call, size %d.\n", size);
+  int64_t addr = g_current_thread->GetProcessOwner()->addrspace->Sbrk(size);
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, addr);
+  if (addr == ERROR)
+    g_syscall_error->SetError(OUT_OF_MEMORY);
+}
+
+//----------------------------------------------------------------------
+// LockUserPage
+/*!	Translate an address of the machine memory and lock its frame, so
+//	that it cannot be evicted while the kernel works on it directly
 //
-//	\param addr is the memory address of the string
-//	\param dest is where the string is going to be copied
-//      \param maxlen maximum length of the string to copy in dest,
-//        including the trailing '\0'
+//	\param addr is the memory address
+//	\param writing is true if the page is to be modified
+//	\param held is a frame already locked by the caller (or -1): the page
+//	  is not locked again if it is in this frame
+//	\param physAddr receives the physical address of addr
+//	\return false if the translation failed (the exception has been raised)
+*/
+//----------------------------------------------------------------------
+static bool
+LockUserPage(uint64_t addr, bool writing, int64_t held, uint32_t *physAddr) {
+  for (;;) {
+    // The thread may go on on another hart after a page fault
+    MMU *mmu = g_machine->mmu;
+    ExceptionType exc = mmu->Translate(addr, physAddr, 1, writing);
+    if (exc != NO_EXCEPTION) {
+      g_machine->RaiseException(exc, addr);
+      return false;
+    }
+    uint64_t pp = *physAddr >> g_cfg->PageShift;
+    if ((int64_t) pp == held)
+      return true;
+
+    // The frame may have been replaced while we waited for it
+    uint64_t vpn = addr >> g_cfg->PageShift;
+    g_physical_mem_manager->LockPage(pp);
+    if (mmu->translationTable->getBitValid(vpn) &&
+        mmu->translationTable->getPhysicalPage(vpn) == pp)
+      return true;
+    g_physical_mem_manager->UnlockPage(pp);
+  }
+}
+
+//----------------------------------------------------------------------
+// SyscallMemCopy
+/*!	Copy a memory area of the process to another, one host memmove
+//	per page, instead of one interpreted load and store per word.
+//	Its simulated time is BulkMemoryCost cycles per 64 bytes.
 */
 //----------------------------------------------------------------------
 static void
-GetStringParam(uint64_t addr, char *dest, int maxlen) {
-  int i = 0;
-  uint64_t c = 1;   // Non nul value to start scanning the string
+SyscallMemCopy(int64_t no_syscall) {
+  uint64_t dst = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  uint64_t src = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  uint32_t size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
+  DEBUG('e', (char *) "Memory: MemCopy call, size %u.\n", size);
+
+  uint32_t total = 0;
+  int result = NO_ERROR;
+  while (total < size) {
+    uint32_t n = g_cfg->PageSize - (dst & g_cfg->PageMask);
+    if (n > g_cfg->PageSize - (src & g_cfg->PageMask))
+      n = g_cfg->PageSize - (src & g_cfg->PageMask);
+    if (n > size - total)
+      n = size - total;
+
+    uint32_t dstPhys, srcPhys;
+    if (!LockUserPage(dst, true, -1, &dstPhys)) {
+      result = ERROR;
+      break;
+    }
+    uint64_t dstPage = dstPhys >> g_cfg->PageShift;
+    if (!LockUserPage(src, false, dstPage, &srcPhys)) {
+      g_physical_mem_manager->UnlockPage(dstPage);
+      result = ERROR;
+      break;
+    }
+    uint64_t srcPage = srcPhys >> g_cfg->PageShift;
+
+    memmove(&g_machine->mainMemory[dstPhys], &g_machine->mainMemory[srcPhys],
+            n);
+    g_machine->mmu->InvalidateDecodedPage(dstPage);
+    if (srcPage != dstPage)
+      g_physical_mem_manager->UnlockPage(srcPage);
+    g_physical_mem_manager->UnlockPage(dstPage);
+
+    dst += n;
+    src += n;
+    total += n;
+  }
+  g_machine->interrupt->OneTick(
+      divRoundUp((uint64_t) total * g_cfg->BulkMemoryCost, 64));
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
+}
+
+//----------------------------------------------------------------------
+// SyscallMemFill
+/*!	Set the bytes of a memory area of the process to a value, one host
+//	memset per page. Its simulated time is BulkMemoryCost cycles per
+//	64 bytes.
+*/
+//----------------------------------------------------------------------
+static void
+SyscallMemFill(int64_t no_syscall) {
+  uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
+  int value = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
+  uint32_t size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
+  DEBUG('e', (char *) "Memory: MemFill call, size %u.\n", size);
+
+  uint32_t total = 0;
+  int result = NO_ERROR;
+  while (total < size) {
+    uint32_t n = g_cfg->PageSize - (addr & g_cfg->PageMask);
+    if (n > size - total)
+      n = size - total;
+
+    uint32_t physAddr;
+    if (!LockUserPage(addr, true, -1, &physAddr)) {
+      result = ERROR;
+      break;
+    }
+    uint64_t pp = physAddr >> g_cfg->PageShift;
+    memset(&g_machine->mainMemory[physAddr], value, n);
+    g_machine->mmu->InvalidateDecodedPage(pp);
+    g_physical_mem_manager->UnlockPage(pp);
 
-  while ((c != 0) && (i < maxlen)) {
-    // Read a character from the machine memory
-    g_machine->mmu->ReadMem(addr++, 1, &c);
-    // Put it in the kernel memory
-    dest[i++] = (char) c;
+    addr += n;
+    total += n;
   }
-  // Force a \0 at the end
-  dest[maxlen - 1] = '\0';
+  g_machine->interrupt->OneTick(
+      divRoundUp((uint64_t) total * g_cfg->BulkMemoryCost, 64));
+  g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
 }
 
+//! Handler of a system call, called with the system call number
+typedef void (*SyscallHandler)(int64_t no_syscall);
+
+/*! \brief Entry of the system call table
+//
+// The table is indexed by the system call number; the number is kept
+// in each entry to check that entries stay in the order of syscall.h.
+// A NULL handler marks a system call not implemented in this kernel.
+*/
+struct SyscallEntry {
+  int64_t number;          //!< system call number (defined in syscall.h)
+  const char *name;        //!< name used in the statistics
+  SyscallHandler handler;  //!< function implementing the system call
+};
+
+//! The system call table
+static const struct SyscallEntry syscall_table[] = {
+  {SC_HALT,            "halt",             SyscallHalt},
+  {SC_EXIT,            "exit",             SyscallExit},
+  {SC_EXEC,            "exec",             SyscallExec},
+  {SC_JOIN,            "join",             SyscallJoin},
+  {SC_CREATE,          "create",           SyscallCreate},
+  {SC_OPEN,            "open",             SyscallOpen},
+  {SC_READ,            "read",             SyscallRead},
+  {SC_WRITE,           "write",            SyscallWrite},
+  {SC_SEEK,            "seek",             SyscallSeek},
+  {SC_CLOSE,           "close",            SyscallClose},
+  {SC_NEW_THREAD,      "new_thread",       SyscallNewThread},
+  {SC_YIELD,           "yield",            SyscallYield},
+  {SC_PERROR,          "perror",           SyscallPError},
+  {SC_P,               "p",                SyscallP},
+  {SC_V,               "v",                SyscallV},
+  {SC_SEM_CREATE,      "sem_create",       SyscallSemCreate},
+  {SC_SEM_DESTROY,     "sem_destroy",      SyscallSemDestroy},
+  {SC_LOCK_CREATE,     "lock_create",      NULL},
+  {SC_LOCK_DESTROY,    "lock_destroy",     NULL},
+  {SC_LOCK_ACQUIRE,    "lock_acquire",     NULL},
+  {SC_LOCK_RELEASE,    "lock_release",     NULL},
+  {SC_COND_CREATE,     "cond_create",      NULL},
+  {SC_COND_DESTROY,    "cond_destroy",     NULL},
+  {SC_COND_WAIT,       "cond_wait",        NULL},
+  {SC_COND_SIGNAL,     "cond_signal",      NULL},
+  {SC_COND_BROADCAST,  "cond_broadcast",   NULL},
+  {SC_TTY_SEND,        "tty_send",         SyscallTtySend},
+  {SC_TTY_RECEIVE,     "tty_receive",      SyscallTtyReceive},
+  {SC_MKDIR,           "mkdir",            SyscallMkdir},
+  {SC_RMDIR,           "rmdir",            SyscallRmdir},
+  {SC_REMOVE,          "remove",           SyscallRemove},
+  {SC_FSLIST,          "fslist",           SyscallFSList},
+  {SC_SYS_TIME,        "sys_time",         SyscallSysTime},
+  {SC_MMAP,            "mmap",             SyscallMmap},
+  {SC_DEBUG,           "debug",            SyscallDebug},
+  {SC_RWLOCK_CREATE,   "rwlock_create",    SyscallRWLockCreate},
+  {SC_RWLOCK_DESTROY,  "rwlock_destroy",   SyscallRWLockDestroy},
+  {SC_RWLOCK_READ,     "rwlock_read",      SyscallRWLockRead},
+  {SC_RWLOCK_WRITE,    "rwlock_write",     SyscallRWLockWrite},
+  {SC_RWLOCK_RELEASE,  "rwlock_release",   SyscallRWLockRelease},
+  {SC_BARRIER_CREATE,  "barrier_create",   SyscallBarrierCreate},
+  {SC_BARRIER_DESTROY, "barrier_destroy",  SyscallBarrierDestroy},
+  {SC_BARRIER_WAIT,    "barrier_wait",     SyscallBarrierWait},
+  {SC_READV,           "readv",            SyscallVectorIO},
+  {SC_WRITEV,          "writev",           SyscallVectorIO},
+  {SC_PREAD,           "pread",            SyscallPositionalIO},
+  {SC_PWRITE,          "pwrite",           SyscallPositionalIO},
+  {SC_AIO_SUBMIT,      "aio_submit",       SyscallAio},
+  {SC_AIO_WAIT,        "aio_wait",         SyscallAio},
+  {SC_MSYNC,           "msync",            SyscallMsync},
+  {SC_FUTEX_WAIT,      "futex_wait",       SyscallFutexWait},
+  {SC_FUTEX_WAKE,      "futex_wake",       SyscallFutexWake},
+  {SC_SBRK,            "sbrk",             SyscallSbrk},
+  {SC_MEMCOPY,         "memcopy",          SyscallMemCopy},
+  {SC_MEMFILL,         "memfill",          SyscallMemFill},
+  {SC_SLEEP,           "sleep",            SyscallSleep},
+  {SC_PIPE,            "pipe",             SyscallPipe},
+  {SC_REDIRECT,        "redirect",         SyscallRedirect},
+  {SC_SHM_CREATE,      "shm_create",       SyscallShmCreate},
+  {SC_SHM_ATTACH,      "shm_attach",       SyscallShmAttach},
+  {SC_OPENDIR,         "opendir",          SyscallOpenDir},
+  {SC_READDIR,         "readdir",          SyscallReadDir},
+  {SC_TTY_SEND_TO,     "tty_send_to",      SyscallTtySend},
+  {SC_TTY_RECEIVE_FROM, "tty_receive_from", SyscallTtyReceive},
+};
+
+//! Number of entries of the system call table
+#define NUM_SYSCALLS ((int64_t) (sizeof(syscall_table) / sizeof(syscall_table[0])))
+
 //----------------------------------------------------------------------
 // ExceptionHandler
 /*!   Entry point into the Nachos kernel.  Called when a user program
@@ -109,10 +1712,6 @@ GetStringParam(uint64_t addr, char *dest, int maxlen) {
 void
 ExceptionHandler(ExceptionType exceptiontype, int vaddr) {
 
-  // Get the content of register 17 (system call number in case
-  // of a system call
-  int64_t no_syscall = g_machine->ReadIntRegister(REG_NO_SYSCALL);
-
   switch (exceptiontype) {
   case NO_EXCEPTION:
     printf("Nachos internal error, a NoException exception is raised ...\n");
@@ -120,539 +1719,42 @@ ExceptionHandler(ExceptionType exceptiontype, int vaddr) {
     break;
 
   case SYSCALL_EXCEPTION: {
-
     // System calls
     // -------------
-    switch (no_syscall) {
-      char msg[MAXSTRLEN];   // Argument for the PError system call
-
-    case SC_HALT:
-      // The halt system call. Stops Nachos.
-      DEBUG('e', (char *) "Shutdown, initiated by user program.\n");
-      g_machine->interrupt->Halt(NO_ERROR);
-      g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      return;
-
-    case SC_SYS_TIME: {
-      // The systime system call. Gets the system time
-      DEBUG('e', (char *) "Systime call, initiated by user program.\n");
-      uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      uint64_t tick = g_stats->getTotalTicks();
-      uint32_t seconds =
-          (uint32_t) cycle_to_sec(tick, g_cfg->ProcessorFrequency);
-      uint32_t nanos =
-          (uint32_t) cycle_to_nano(tick, g_cfg->ProcessorFrequency);
-      g_machine->mmu->WriteMem(addr, sizeof(uint32_t), seconds);
-      g_machine->mmu->WriteMem(addr + 4, sizeof(uint32_t), nanos);
-      g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      break;
-    }
-
-    case SC_EXIT: {
-      // The exit system call
-      // Ends the calling thread
-      DEBUG('e', (char *) "Thread 0x%x %s exit call.\n", g_current_thread,
-            g_current_thread->GetName());
-      ASSERT(g_current_thread->type == THREAD_TYPE);
-      g_current_thread->Finish();
-      break;
-    }
-
-    case SC_EXEC: {
-      // The exec system call
-      // Creates a new process (thread+address space)
-      DEBUG('e', (char *) "Process: Exec call.\n");
-      uint64_t addr;
-      uint64_t size;
-      char name[MAXSTRLEN];
-      uint64_t error = NO_ERROR;
-
-      // Get the process name
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      size = GetLengthParam(addr);
-      char ch[size];
-      GetStringParam(addr, ch, size);
-      sprintf(name, "master thread of process %s", ch);
-      Process *p = new Process(ch, &error);
-      if (error != NO_ERROR) {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        if (error == OUT_OF_MEMORY)
-          g_syscall_error->SetMsg((char *) "", error);
-        else
-          g_syscall_error->SetMsg(ch, error);
-        break;
-      }
-      Thread *ptThread = new Thread(name);
-      int32_t tid = g_object_addrs->AddObject(ptThread);
-      error = ptThread->Start(p, p->addrspace->getCodeStartAddress64(), -1);
-      if (error != NO_ERROR) {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        if (error == OUT_OF_MEMORY)
-          g_syscall_error->SetMsg((char *) "", error);
-        else
-          g_syscall_error->SetMsg(name, error);
-        break;
-      }
-      g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      g_machine->WriteIntRegister(REG_RET_SYSCALL, tid);
-      break;
-    }
-
-    case SC_NEW_THREAD: {
-      // The newThread system call
-      // Create a new thread in the same address space
-      DEBUG('e', (char *) "Multithread: NewThread call.\n");
-      Thread *ptThread;
-      uint64_t name_addr;
-      int64_t fun;
-      uint64_t arg;
-      uint64_t err = NO_ERROR;
-      // Get the address of the string for the name of the thread
-      name_addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      // Get the pointer to the function to be executed by the new thread
-      fun = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
-      // Get the function parameters
-      arg = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
-      // Build the name of the thread
-      int size = GetLengthParam(name_addr);
-      char thr_name[size];
-      GetStringParam(name_addr, thr_name, size);
-      // char *proc_name = g_current_thread->getProcessOwner()->getName();
-      //  Finally start it
-      ptThread = new Thread(thr_name);
-      int32_t tid = g_object_addrs->AddObject(ptThread);
-      err = ptThread->Start(g_current_thread->GetProcessOwner(), fun, arg);
-      if (err != NO_ERROR) {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        g_syscall_error->SetMsg((char *) "", err);
-      } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, tid);
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      }
-      break;
-    }
-
-    case SC_JOIN: {
-      // The join system call
-      // Wait for the thread idThread to finish
-      DEBUG('e', (char *) "Process or thread: Join call.\n");
-      int64_t tid;
-      Thread *ptThread;
-      tid = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      ptThread = (Thread *) g_object_addrs->SearchObject(tid);
-      if (ptThread && ptThread->type == THREAD_TYPE) {
-        g_current_thread->Join(ptThread);
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
-      } else
-      // Thread already terminated (type set to INVALID_TYPE) or call on an
-      // object that is not a thread Exit with no error code since we cannot
-      // separate the two cases
-      {
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
-      }
-      DEBUG('e', (char *) "Fin Join");
-      break;
-    }
-
-    case SC_YIELD: {
-      DEBUG('e', (char *) "Process or thread: Yield call.\n");
-      if (g_current_thread->type == THREAD_TYPE) {
-        g_current_thread->Yield();
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
-      } else {
-        g_syscall_error->SetMsg((char *) "", INVALID_SEMAPHORE_ID);
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-      }
-      break;
-    }
-
-    case SC_PERROR: {
-      // the PError system call
-      // print the last error message
-      DEBUG('e', (char *) "Debug: Perror call.\n");
-      uint64_t size;
-      int addr;
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      size = GetLengthParam(addr);
-      char ch[size];
-      GetStringParam(addr, ch, size);
-      g_syscall_error->PrintLastMsg(g_console_driver, ch);
-      break;
-    }
-
-    case SC_CREATE: {
-      // The create system call
-      // Create a new file in nachos file system
-      DEBUG('e', (char *) "Filesystem: Create call.\n");
-      uint64_t addr;
-      int size;
-      uint64_t ret;
-      int sizep;
-      // Get the name and initial size of the new file
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
-      sizep = GetLengthParam(addr);
-      char ch[sizep];
-      GetStringParam(addr, ch, sizep);
-      // Try to create it
-      int err = g_file_system->Create(ch, size);
-      if (err == NO_ERROR) {
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-        ret = NO_ERROR;
-      } else {
-        ret = ERROR;
-        if (err == OUT_OF_DISK)
-          g_syscall_error->SetMsg((char *) "", err);
-        else
-          g_syscall_error->SetMsg(ch, err);
-      }
-      g_machine->WriteIntRegister(REG_RET_SYSCALL, ret);
-      break;
-    }
-
-    case SC_OPEN: {
-      // The open system call
-      // Opens a file and returns an openfile identifier
-      DEBUG('e', (char *) "Filesystem: Open call.\n");
-      uint64_t addr;
-      int sizep;
-      int ret = 0;
-      // Get the file name
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      sizep = GetLengthParam(addr);
-      char ch[sizep];
-      GetStringParam(addr, ch, sizep);
-      // Try to open the file
-      OpenFile *file = g_open_file_table->Open(ch);
-      if (file == NULL) {
-        g_syscall_error->SetMsg(ch, OPENFILE_ERROR);
-      } else {
-        ret = g_object_addrs->AddObject(file);
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      }
-      g_machine->WriteIntRegister(REG_RET_SYSCALL, ret);
-      break;
-    }
-
-    case SC_READ: {
-      // The read system call
-      // Read in a file or the console
-      DEBUG('e', (char *) "Filesystem: Read call.\n");
-      uint64_t addr;
-      int size;
-      int64_t f;
-      int numread;
-      // Get the buffer address in the machine memory
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      // Get the requested size
-      size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
-      // Get the openfile number or 0 (console)
-      f = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
-      char buffer[size];
-
-      // Read in a file
-      if (f != CONSOLE_INPUT) {
-        int64_t fid = f;
-        OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid);
-        if (file && file->type == FILE_TYPE) {
-          numread = file->Read(buffer, size);
-          g_syscall_error->SetMsg((char *) "", NO_ERROR);
-        } else {
-          numread = ERROR;
-          sprintf(msg, "%" PRId64 "", f);
-          g_syscall_error->SetMsg(msg, INVALID_FILE_ID);
-        }
-      }
-      // Read on the console
-      else {
-        g_console_driver->GetString(buffer, size);
-        DEBUG('e', (char *) "Console read. We have %s of size %d\n", buffer,
-              size);
-        numread = size;
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      }
-      for (int i = 0; i < numread;
-           i++) {   // copy the buffer into the emulator memory
-        g_machine->mmu->WriteMem(addr++, 1, buffer[i]);
-      }
-      g_machine->WriteIntRegister(REG_RET_SYSCALL, numread);
-      break;
-    }
-
-    case SC_WRITE: {
-      // The write system call
-      // Write in a file or at the console
-      DEBUG('e', (char *) "Filesystem: Write call.\n");
-      uint64_t addr;
-      int size;
-      uint64_t f;
-      uint64_t c;
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
-      // f is the openfileid or 1 (console)
-      f = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_3);
-      char buffer[size];
-      for (int i = 0; i < size; i++) {
-        g_machine->mmu->ReadMem(addr++, 1, &c);
-        buffer[i] = c;
-      }
-      int numwrite;
-      // Write in a file
-      if (f > CONSOLE_OUTPUT) {
-        int64_t fid = f;
-        OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid);
-        if (file && file->type == FILE_TYPE) {
-          // write in file
-          numwrite = file->Write(buffer, size);
-          g_syscall_error->SetMsg((char *) "", NO_ERROR);
-        } else {
-          numwrite = ERROR;
-          sprintf(msg, "%" PRId64 "", f);
-          g_syscall_error->SetMsg(msg, INVALID_FILE_ID);
-        }
-      }
-      // write at the console
-      else {
-        if (f == CONSOLE_OUTPUT) {
-          g_console_driver->PutString(buffer, size);
-          numwrite = size;
-          g_syscall_error->SetMsg((char *) "", NO_ERROR);
-        } else {
-          numwrite = ERROR;
-          sprintf(msg, "%" PRId64 "", f);
-          g_syscall_error->SetMsg(msg, INVALID_FILE_ID);
-        }
-      }
-      g_machine->WriteIntRegister(REG_RET_SYSCALL, numwrite);
-      break;
-    }
-
-    case SC_SEEK: {
-      // Seek to a given position in an opened file
-      DEBUG('e', (char *) "Filesystem: Seek call.\n");
-      int offset;
-      int64_t f;
-      uint64_t error = NO_ERROR;
-
-      // Get the offset into the file
-      offset = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      // Get the openfile number or 1 (console)
-      f = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
-
-      // Seek into a file
-      if (f > CONSOLE_OUTPUT) {
-        int64_t fid = f;
-        OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid);
-        if (file && file->type == FILE_TYPE) {
-          file->Seek(offset);
-          g_syscall_error->SetMsg((char *) "", NO_ERROR);
-        } else {
-          error = ERROR;
-          sprintf(msg, "%" PRId64 "", f);
-          g_syscall_error->SetMsg(msg, INVALID_FILE_ID);
-        }
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, error);
-      } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        sprintf(msg, "%" PRId64 "", f);
-        g_syscall_error->SetMsg(msg, INVALID_FILE_ID);
-      }
-      break;
-    }
-
-    case SC_CLOSE: {
-      // The close system call
-      // Close a file
-      DEBUG('e', (char *) "Filesystem: Close call.\n");
-      // Get the openfile number
-      int64_t fid = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid);
-      if (file && file->type == FILE_TYPE) {
-        g_open_file_table->Close(file->GetName());
-        g_object_addrs->RemoveObject(fid);
-        delete file;
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        sprintf(msg, "%" PRId64 "", fid);
-        g_syscall_error->SetMsg(msg, INVALID_FILE_ID);
-      }
-      break;
-    }
-
-    case SC_REMOVE: {
-      // The Remove system call
-      // Remove a file from the file system
-      DEBUG('e', (char *) "Filesystem: Remove call.\n");
-      uint64_t ret;
-      uint64_t addr;
-      int sizep;
-      // Get the name of the file to be removes
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      sizep = GetLengthParam(addr);
-      char *ch = new char[sizep];
-      GetStringParam(addr, ch, sizep);
-      // Actually remove it
-      int err = g_open_file_table->Remove(ch);
-      if (err == NO_ERROR) {
-        ret = 0;
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      } else {
-        ret = ERROR;
-        g_syscall_error->SetMsg(ch, err);
-      }
-      g_machine->WriteIntRegister(REG_RET_SYSCALL, ret);
-      break;
-    }
-
-    case SC_MKDIR: {
-      // the Mkdir system call
-      // make a new directory in the file system
-      DEBUG('e', (char *) "Filesystem: Mkdir call.\n");
-      uint64_t addr;
-      int sizep;
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      sizep = GetLengthParam(addr);
-      char name[sizep];
-      GetStringParam(addr, name, sizep);
-      // name is the name of the new directory
-      uint64_t good = g_file_system->Mkdir(name);
-      if (good != NO_ERROR) {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        if (good == OUT_OF_DISK)
-          g_syscall_error->SetMsg((char *) "", good);
-        else
-          g_syscall_error->SetMsg(name, good);
-      } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, (good));
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      }
-      break;
-    }
-
-    case SC_RMDIR: {
-      // the Rmdir system call
-      // remove a directory from the file system
-      DEBUG('e', (char *) "Filesystem: Rmdir call.\n");
-      uint64_t addr;
-      int sizep;
-      addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      sizep = GetLengthParam(addr);
-      char name[sizep];
-      GetStringParam(addr, name, sizep);
-      uint64_t good = g_file_system->Rmdir(name);
-      if (good != NO_ERROR) {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        g_syscall_error->SetMsg(name, good);
-      } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, good);
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      }
-      break;
-    }
-
-    case SC_FSLIST: {
-      // The FSList system call
-      // Lists all the file and directories in the filesystem
-      g_file_system->List();
-      g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      break;
-    }
-
-    case SC_TTY_SEND: {
-      // the TtySend system call
-      // Sends some char by the serial line emulated
-      DEBUG('e', (char *) "ACIA: Send call.\n");
-      if (g_cfg->ACIA != ACIA_NONE) {
-        uint64_t result;
-        uint64_t c;
-        uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-        char buff[MAXSTRLEN];
-        for (int i = 0;; i++) {
-          g_machine->mmu->ReadMem(addr + i, 1, &c);
-          buff[i] = (char) c;
-          if (buff[i] == '\0')
-            break;
-        }
-        result = g_acia_driver->TtySend(buff);
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        g_syscall_error->SetMsg((char *) "", NO_ACIA);
-      }
-      break;
-    }
-
-    case SC_TTY_RECEIVE: {
-      // the TtyReceive system call
-      // read some char on the serial line
-      DEBUG('e', (char *) "ACIA: Receive call.\n");
-      if (g_cfg->ACIA != ACIA_NONE) {
-        uint64_t result;
-        uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-        int length = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
-        char buff[length + 1];
-        result = g_acia_driver->TtyReceive(buff, length);
-        int i = 0;
-        while ((i <= length)) {
-          g_machine->mmu->WriteMem(addr, 1, buff[i]);
-          addr++;
-          i++;
-        }
-        g_machine->mmu->WriteMem(addr, 1, 0);
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, result);
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        g_syscall_error->SetMsg((char *) "", NO_ACIA);
-      }
-      break;
-    }
-
-    case SC_MMAP: {
-      // Map a file in memory
-      DEBUG('e', (char *) "Filesystem: Mmap call.\n");
-      uint64_t fid = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-      OpenFile *file = (OpenFile *) g_object_addrs->SearchObject(fid);
-      if (file) {
-        int size = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2);
-        AddrSpace *ap = g_current_thread->GetProcessOwner()->addrspace;
-        int addr = ap->Mmap(file, size);
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ((int) addr));
-        g_syscall_error->SetMsg((char *) "", NO_ERROR);
-      } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        sprintf(msg, "%p", file);
-        g_syscall_error->SetMsg(msg, INVALID_FILE_ID);
-      }
-      break;
-    }
-
-    case SC_DEBUG: {
-      // Map a file in memory
-      DEBUG('e', (char *) "Nachos: debug system call.\n");
-      printf("Debug system call: parameter %" PRIu64 "\n",
-             g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1));
-      break;
-    }
-
-    default:
-      printf("Invalid system call number : %" PRIu64 "\n", no_syscall);
+    // Get the content of register 17 (system call number) and run its
+    // handler, counting the calls and the time spent in each of them.
+    // The error of the previous system call is cleared, except for
+    // PError which prints it.
+    int64_t no_syscall = g_machine->ReadIntRegister(REG_NO_SYSCALL);
+    if (no_syscall < 0 || no_syscall >= NUM_SYSCALLS ||
+        syscall_table[no_syscall].handler == NULL) {
+      printf("Invalid system call number : %" PRId64 "\n", no_syscall);
       exit(ERROR);
-      break;
     }
-
+    const struct SyscallEntry *entry = &syscall_table[no_syscall];
+    ASSERT(entry->number == no_syscall);
+    if (no_syscall != SC_PERROR)
+      g_syscall_error->SetError(NO_ERROR);
+    g_stats->incrSyscall(no_syscall, entry->name);
+    Time start = g_stats->getTotalTicks();
+    entry->handler(no_syscall);
+    g_stats->incrSyscallTicks(no_syscall, g_stats->getTotalTicks() - start);
     break;
   }
 
   // Other exceptions
   // ----------------
   case READONLY_EXCEPTION:
+    // Write to a copy-on-write page, raised by the MMU
+    if (g_current_thread->GetProcessOwner()->addrspace->translationTable
+            ->getBitCow(vaddr >> g_cfg->PageShift)) {
+      if (g_page_fault_manager->CopyOnWrite(vaddr >> g_cfg->PageShift) !=
+          NO_EXCEPTION) {
+        printf("\t*** Copy on write failed, ... exiting\n");
+        g_machine->interrupt->Halt(ERROR);
+      }
+      break;
+    }
     printf("FATAL USER EXCEPTION (Thread %s, PC=0x%" PRIx64 "):\n",
            g_current_thread->GetName(), g_machine->pc);
     printf("\t*** Write to virtual address 0x%x on read-only page ***\n",
@@ -691,110 +1793,12 @@ ExceptionHandler(ExceptionType exceptiontype, int vaddr) {
 
   case PAGEFAULT_EXCEPTION:
     ExceptionType e;
-    e = g_page_fault_manager->PageFault(vaddr / g_cfg->PageSize);
+    e = g_page_fault_manager->PageFault(vaddr >> g_cfg->PageShift);
     if (e != NO_EXCEPTION) {
       printf("\t*** Page fault handling failed, ... exiting\n");
       g_machine->interrupt->Halt(ERROR);
     }
     break;
-  #ifdef ETUDIANTS_TP
-  case SC_SEM_CREATE: {
-    // Pour créer un sémaphore
-    DEBUG('e', (char*)"Semaphore: Create call.\n");
-    
-    // 1. Récupérer les paramètres
-    uint64_t addr = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1); // adresse du nom 
-    int initval = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_2); // valeur initiale
-    
-    // 2. Récupérer le nom du sémaphore
-    int size = GetLengthParam(addr);
-    char name[size];
-    GetStringParam(addr, name, size);
-
-    // 3. Créer le sémaphore
-    Semaphore *sem = new Semaphore(name, initval);
-    
-    // 4. Ajouter le sémaphore à la table des objets et récupérer son ID
-    int id = g_object_addrs->AddObject(sem);
-    
-    // 5. Renvoyer l'ID ou ERROR
-    if (id != ERROR) {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, id);
-        g_syscall_error->SetMsg((char*)"", NO_ERROR);
-    } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        g_syscall_error->SetMsg((char*)"", OUT_OF_MEMORY); 
-    }
-    break;
-}
-
-case SC_SEM_DESTROY: {
-    // Pour détruire un sémaphore
-    DEBUG('e', (char*)"Semaphore: Destroy call.\n");
-    
-    // 1. Récupérer l'ID du sémaphore
-    int id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-    
-    // 2. Récupérer le sémaphore depuis son ID
-    Semaphore *sem = (Semaphore*)g_object_addrs->SearchObject(id);
-    
-    // 3. Vérifier que c'est bien un sémaphore valide
-    if (sem && sem->type == SEMAPHORE_TYPE) {
-        delete sem;
-        g_object_addrs->RemoveObject(id);
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
-        g_syscall_error->SetMsg((char*)"", NO_ERROR);
-    } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR); 
-        g_syscall_error->SetMsg((char*)"", INVALID_SEMAPHORE_ID);
-    }
-    break;
-}
-
-case SC_P: {
-    // Pour faire un P() sur un sémaphore
-    DEBUG('e', (char*)"Semaphore: P call.\n");
-    
-    // 1. Récupérer l'ID du sémaphore
-    int id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-    
-    // 2. Récupérer le sémaphore 
-    Semaphore *sem = (Semaphore*)g_object_addrs->SearchObject(id);
-    
-    // 3. Vérifier et faire le P()
-    if (sem && sem->type == SEMAPHORE_TYPE) {
-        sem->P();
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
-        g_syscall_error->SetMsg((char*)"", NO_ERROR);
-    } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        g_syscall_error->SetMsg((char*)"", INVALID_SEMAPHORE_ID);
-    }
-    break;
-}
-
-case SC_V: {
-    // Pour faire un V() sur un sémaphore  
-    DEBUG('e', (char*)"Semaphore: V call.\n");
-    
-    // 1. Récupérer l'ID du sémaphore
-    int id = g_machine->ReadIntRegister(REG_SYSCALL_PARAM_1);
-    
-    // 2. Récupérer le sémaphore
-    Semaphore *sem = (Semaphore*)g_object_addrs->SearchObject(id);
-    
-    // 3. Vérifier et faire le V()
-    if (sem && sem->type == SEMAPHORE_TYPE) {
-        sem->V();
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, NO_ERROR);
-        g_syscall_error->SetMsg((char*)"", NO_ERROR);
-    } else {
-        g_machine->WriteIntRegister(REG_RET_SYSCALL, ERROR);
-        g_syscall_error->SetMsg((char*)"", INVALID_SEMAPHORE_ID);
-    }
-    break;
-}
-#endif ETUDIANTS_TP
   default:
     printf("Unknown exception %d\n", exceptiontype);
     g_machine->interrupt->Halt(ERROR);
@@ -32,6 +32,7 @@
 #undef MAIN
 
 #include "kernel/msgerror.h"
+#include "kernel/snapshot.h"
 #include "kernel/system.h"
 #include "kernel/thread.h"
 #include "utility/config.h"
@@ -94,21 +95,25 @@ main(int argc, char **argv) {
     }
   }
 
-  if (g_cfg->Remove) {   // remove Nachos file
-    g_file_system->Remove(g_cfg->FileToRemove);
-  }
-  if (g_cfg->MakeDir) {   // Make Nachos directory
-    g_file_system->Mkdir(g_cfg->DirToMake);
-  }
-  if (g_cfg->RemoveDir) {   // Remove Nachos file
-    g_file_system->Rmdir(g_cfg->DirToRemove);
-  }
-  if (g_cfg->NbCopy != 0) {   // copy from UNIX to Nachos
+  // A disk restored from a snapshot went through these boot actions
+  // before it was saved
+  if (!g_cfg->DiskSnapshotRestore) {
+    if (g_cfg->Remove) {   // remove Nachos file
+      g_file_system->Remove(g_cfg->FileToRemove);
+    }
+    if (g_cfg->MakeDir) {   // Make Nachos directory
+      g_file_system->Mkdir(g_cfg->DirToMake);
+    }
+    if (g_cfg->RemoveDir) {   // Remove Nachos file
+      g_file_system->Rmdir(g_cfg->DirToRemove);
+    }
+    if (g_cfg->NbCopy != 0) {   // copy from UNIX to Nachos
 
-    for (uint32_t i = 0; i < g_cfg->NbCopy; i++) {
-      if ((strlen(g_cfg->ToCopyUnix[i]) != 0) &&
-          (strlen(g_cfg->ToCopyNachos[i]) != 0))
-        Copy(g_cfg->ToCopyUnix[i], g_cfg->ToCopyNachos[i]);
+      for (uint32_t i = 0; i < g_cfg->NbCopy; i++) {
+        if ((strlen(g_cfg->ToCopyUnix[i]) != 0) &&
+            (strlen(g_cfg->ToCopyNachos[i]) != 0))
+          Copy(g_cfg->ToCopyUnix[i], g_cfg->ToCopyNachos[i]);
+      }
     }
   }
   if (g_cfg->Print) {   // print a Nachos file
@@ -120,6 +125,9 @@ main(int argc, char **argv) {
   if (g_cfg->PrintFileSyst) {   // print entire filesystem
     g_file_system->Print();
   }
+  if (g_cfg->DiskSnapshotSave) {   // save the disk prepared above
+    SaveSnapshot(g_cfg->DiskSnapshotFile);
+  }
 
   if (!strcmp(startfilename, "")) {
     printf("Warning: No program to start\n");
@@ -129,9 +137,11 @@ main(int argc, char **argv) {
       fprintf(stderr, g_syscall_error->GetFormat(err), startfilename);
       exit(ERROR);
     }
-    g_machine->mmu->translationTable = p->addrspace->translationTable;
+    for (int i = 0; i < g_machine->numHarts; i++)
+      g_machine->harts[i].mmu->translationTable =
+          p->addrspace->translationTable;
     Thread *t = new Thread(startfilename);
-    g_object_addrs->AddObject(t);
+    t->SetObjectId(g_object_addrs->AddObject(t, THREAD_TYPE));
     err = t->Start(p, p->addrspace->getCodeStartAddress64(), -1);
     if (err != NO_ERROR) {
       fprintf(stderr, "Unable to start initial process: %s\n", startfilename);
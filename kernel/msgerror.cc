@@ -27,7 +27,9 @@
 //-----------------------------------------------------------------
 SyscallError::SyscallError() {
   lastError = NO_ERROR;
-  errorAbout = NULL;
+  aboutKind = ABOUT_NONE;
+  errorAbout[0] = '\0';
+  aboutNumber = 0;
 
   msgs[NO_ERROR] = (char *) "no error %s \n";
   msgs[INC_ERROR] = (char *) "incorrect error type %s \n";
@@ -36,6 +38,7 @@ SyscallError::SyscallError() {
   msgs[EXEC_FILE_FORMAT_ERROR] =
       (char *) "file %s is not a valid executable file (not in ELF format)\n";
   msgs[OUT_OF_MEMORY] = (char *) "out of memory %s\n";
+  msgs[NOT_MAPPED] = (char *) "address %s is not in a mapped file\n";
 
   msgs[OUT_OF_DISK] = (char *) "out of disk space %s\n";
   msgs[ALREADY_IN_DIRECTORY] = (char *) "file or directory %s already exists\n";
@@ -55,9 +58,19 @@ SyscallError::SyscallError() {
   msgs[INVALID_CONDITION_ID] = (char *) "invalid condition identifier %s\n";
   msgs[INVALID_FILE_ID] = (char *) "invalid file identifier %s\n";
   msgs[INVALID_THREAD_ID] = (char *) "invalid thread identifier %s\n";
+  msgs[INVALID_RWLOCK_ID] =
+      (char *) "invalid reader-writer lock identifier %s\n";
+  msgs[INVALID_BARRIER_ID] = (char *) "invalid barrier identifier %s\n";
+  msgs[INVALID_AIO_RING] = (char *) "invalid or busy aio ring %s\n";
+  msgs[INVALID_FUTEX] = (char *) "invalid futex address %s\n";
   msgs[WRONG_FILE_ENDIANESS] = (char *) "Incorrect code endianess\n";
 
   msgs[NO_ACIA] = (char *) "no ACIA driver installed %s\n";
+  msgs[INVALID_DURATION] = (char *) "negative sleep duration\n";
+  msgs[BROKEN_PIPE] = (char *) "write on pipe %s without reader\n";
+  msgs[INVALID_SHM_ID] =
+      (char *) "invalid shared memory segment identifier %s\n";
+  msgs[INVALID_ACIA_PORT] = (char *) "invalid ACIA port %s\n";
 }
 
 //-----------------------------------------------------------------
@@ -65,10 +78,7 @@ SyscallError::SyscallError() {
 /*!      Destructor. De-allocate the structures
  */
 //-----------------------------------------------------------------
-SyscallError::~SyscallError() {
-  if (errorAbout != NULL)
-    delete[] errorAbout;
-}
+SyscallError::~SyscallError() {}
 
 //-----------------------------------------------------------------
 // SyscallError::SetMsg
@@ -81,26 +91,13 @@ SyscallError::~SyscallError() {
 //-----------------------------------------------------------------
 void
 SyscallError::SetMsg(char *about, int num) {
-
-  // Delete old "about" string
-  if (errorAbout != NULL)
-    delete errorAbout;
-
-  // Allocate a new one if the argument is not NULL
-  if (about != NULL) {
-    int size = strlen(about) + 1;
-    errorAbout = new char[size];
-    strcpy(errorAbout, about);
+  if (about != NULL && about[0] != '\0') {
+    strncpy(errorAbout, about, MAXSTRLEN - 1);
+    errorAbout[MAXSTRLEN - 1] = '\0';
+    aboutKind = ABOUT_STRING;
   } else
-    errorAbout = NULL;
-
-  // Remember the error code of the last system call
-  if ((num < 0) || (num >= NUMMSGERROR))
-    lastError = INC_ERROR;
-  if (msgs[num] == NULL)
-    lastError = INC_ERROR;
-  else
-    lastError = num;
+    aboutKind = ABOUT_NONE;
+  lastError = num;
 }
 
 //-----------------------------------------------------------------
@@ -132,10 +129,22 @@ SyscallError::GetFormat(int num) {
 //-----------------------------------------------------------------
 void
 SyscallError::PrintLastMsg(DriverConsole *cons, char *ch) {
-
-  int size = strlen(msgs[lastError]) + strlen(errorAbout) + 1;
-  char *msg = new char[size];
-  sprintf(msg, msgs[lastError], errorAbout);
+  char about[MAXSTRLEN];
+  char msg[2 * MAXSTRLEN];
+
+  // Format the context of the error, then the message
+  switch (aboutKind) {
+  case ABOUT_STRING:
+    strcpy(about, errorAbout);
+    break;
+  case ABOUT_NUMBER:
+    snprintf(about, MAXSTRLEN, "%" PRId64, aboutNumber);
+    break;
+  default:
+    about[0] = '\0';
+    break;
+  }
+  snprintf(msg, sizeof(msg), GetFormat(lastError), about);
 
   cons->PutString(ch, strlen(ch));
   cons->PutString((char *) " : ", 3);
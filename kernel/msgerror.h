@@ -20,6 +20,9 @@
 #ifndef MSGERROR_H
 #define MSGERROR_H
 
+#include "utility/config.h"   // for MAXSTRLEN
+#include <stdint.h>
+
 // Forward declarations
 class SyscallError;
 class DriverConsole;
@@ -40,6 +43,7 @@ enum {
   OPENFILE_ERROR,
   EXEC_FILE_FORMAT_ERROR,
   OUT_OF_MEMORY,
+  NOT_MAPPED,
 
   OUT_OF_DISK,
   ALREADY_IN_DIRECTORY,
@@ -57,10 +61,18 @@ enum {
   INVALID_CONDITION_ID,
   INVALID_FILE_ID,
   INVALID_THREAD_ID,
+  INVALID_RWLOCK_ID,
+  INVALID_BARRIER_ID,
+  INVALID_AIO_RING,
+  INVALID_FUTEX,
 
   /* Other messages */
   WRONG_FILE_ENDIANESS,
   NO_ACIA,
+  INVALID_DURATION,
+  BROKEN_PIPE,
+  INVALID_SHM_ID,
+  INVALID_ACIA_PORT,
 
   NUMMSGERROR /* Must always be last */
 };
@@ -71,8 +83,9 @@ enum {
 //  When an error occurs during a system call, a negative value
 //  is return to the user program and then an error message
 //  can be printed using the system call PError(). This structure
-//  contains the last error message with the corresponding context
-//  string (eg. the name of an unknow file).
+//  contains the last error code with its context: a string (eg. the
+//  name of an unknow file) or a number (eg. an invalid identifier).
+//  The message itself is only formatted by PError().
 */
 class SyscallError {
 public:
@@ -82,6 +95,19 @@ public:
   void SetMsg(char *about, int num);
   //!< Set the current error message
 
+  //! Set the current error, without context
+  void SetError(int num) {
+    lastError = num;
+    aboutKind = ABOUT_NONE;
+  }
+
+  //! Set the current error, whose context is a number
+  void SetError(int num, int64_t about) {
+    lastError = num;
+    aboutKind = ABOUT_NUMBER;
+    aboutNumber = about;
+  }
+
   void PrintLastMsg(DriverConsole *cons, char *ch);
   //!< Print the error message with a user defined
   //!< string
@@ -90,8 +116,12 @@ public:
   const char *GetFormat(int num);
 
 private:
-  int lastError;             //!< last error's ident
-  char *errorAbout;          //!< context string
+  //! Kind of context of the last error
+  enum { ABOUT_NONE, ABOUT_STRING, ABOUT_NUMBER } aboutKind;
+
+  int lastError;                 //!< last error's ident
+  char errorAbout[MAXSTRLEN];    //!< context string (ABOUT_STRING)
+  int64_t aboutNumber;           //!< context number (ABOUT_NUMBER)
   char *msgs[NUMMSGERROR];   //!< The array of strings for the error messages
 };
 
@@ -0,0 +1,239 @@
+/*! \file pipe.cc
+//  \brief Routines of the pipes between processes
+//
+//      A read returns as soon as some bytes are available, a write
+//      blocks until all its bytes are in the buffer, or until the
+//      last reader is gone. The ends are released without taking the
+//      lock of the pipe: the last use of an end may be dropped by the
+//      destruction of a process, which must not block.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "kernel/pipe.h"
+#include "kernel/msgerror.h"
+#include "kernel/system.h"
+#include "machine/machine.h"
+
+//----------------------------------------------------------------------
+// Pipe::Pipe
+/*!	Create an empty pipe, and register its reader and its writer in
+//	the object table, each used once.
+*/
+//----------------------------------------------------------------------
+Pipe::Pipe() {
+  buffer = new char[PIPE_SIZE];
+  head = count = 0;
+  lock = new Lock((char *) "pipe");
+  notEmpty = new Condition((char *) "pipe not empty", lock);
+  notFull = new Condition((char *) "pipe not full", lock);
+  ids[PIPE_READER] = g_object_addrs->AddObject(this, PIPE_READER_TYPE);
+  ids[PIPE_WRITER] = g_object_addrs->AddObject(this, PIPE_WRITER_TYPE);
+  refs[PIPE_READER] = refs[PIPE_WRITER] = 1;
+  users = 0;
+}
+
+//----------------------------------------------------------------------
+// Pipe::~Pipe
+/*!	Delete a pipe, once its two ends are closed and the last thread
+//	in Read or Write has left.
+*/
+//----------------------------------------------------------------------
+Pipe::~Pipe() {
+  ASSERT(refs[PIPE_READER] == 0 && refs[PIPE_WRITER] == 0 && users == 0);
+  delete notFull;
+  delete notEmpty;
+  delete lock;
+  delete[] buffer;
+}
+
+//----------------------------------------------------------------------
+// Pipe::Read
+/*!	Read at most size bytes into the memory of the program, waiting
+//	for bytes to be written if the pipe is empty.
+//
+//	\param addr the address of the buffer of the program
+//	\param size the size of the buffer
+//	\return the number of bytes read, 0 if the pipe is empty and no
+//	writer is left
+*/
+//----------------------------------------------------------------------
+int
+Pipe::Read(uint64_t addr, int size) {
+  int done = 0;
+
+  // The ends may be closed while the thread sleeps
+  users++;
+  lock->Acquire();
+  while (count == 0 && refs[PIPE_WRITER] > 0)
+    notEmpty->Wait();
+  while (done < size && count > 0) {
+    int n = size - done;
+    if (n > count)
+      n = count;
+    if (n > PIPE_SIZE - head)
+      n = PIPE_SIZE - head;
+    if (!g_machine->mmu->CopyToUser(addr + done, &buffer[head], n))
+      break;
+    head = (head + n) % PIPE_SIZE;
+    count -= n;
+    done += n;
+  }
+  if (done > 0)
+    notFull->Broadcast();
+  bool last = Leave();
+  lock->Release();
+  if (last)
+    delete this;
+  return done;
+}
+
+//----------------------------------------------------------------------
+// Pipe::Write
+/*!	Write size bytes of the memory of the program, waiting for room
+//	in the buffer while it is full.
+//
+//	\param addr the address of the buffer of the program
+//	\param size the number of bytes to write
+//	\return the number of bytes written, fewer than size if the last
+//	reader is gone meanwhile, ERROR if no reader is left
+*/
+//----------------------------------------------------------------------
+int
+Pipe::Write(uint64_t addr, int size) {
+  int done = 0;
+
+  users++;
+  lock->Acquire();
+  while (done < size) {
+    while (count == PIPE_SIZE && refs[PIPE_READER] > 0)
+      notFull->Wait();
+    if (refs[PIPE_READER] == 0)
+      break;
+    int tail = (head + count) % PIPE_SIZE;
+    int n = size - done;
+    if (n > PIPE_SIZE - count)
+      n = PIPE_SIZE - count;
+    if (n > PIPE_SIZE - tail)
+      n = PIPE_SIZE - tail;
+    if (!g_machine->mmu->CopyFromUser(addr + done, &buffer[tail], n))
+      break;
+    count += n;
+    done += n;
+    notEmpty->Broadcast();
+  }
+  bool broken = (refs[PIPE_READER] == 0);
+  bool last = Leave();
+  lock->Release();
+  if (last)
+    delete this;
+  return (done == 0 && broken && size > 0) ? ERROR : done;
+}
+
+//----------------------------------------------------------------------
+// Pipe::Leave
+/*!	Count one less thread in Read or Write, with the lock held.
+//
+//	\return true if the pipe is to be deleted, its two ends being
+//	closed and no other thread using it
+*/
+//----------------------------------------------------------------------
+bool
+Pipe::Leave() {
+  users--;
+  return users == 0 && refs[PIPE_READER] == 0 && refs[PIPE_WRITER] == 0;
+}
+
+//----------------------------------------------------------------------
+// Pipe::Find
+/*!	Look an identifier up in the object table.
+//
+//	\param id the identifier
+//	\param end set to the end of the pipe identified
+//	\return the pipe, NULL if id is not a pipe end
+*/
+//----------------------------------------------------------------------
+Pipe *
+Pipe::Find(int64_t id, int *end) {
+  Pipe *pipe = (Pipe *) g_object_addrs->SearchObject(id, PIPE_READER_TYPE);
+  *end = PIPE_READER;
+  if (pipe == NULL) {
+    pipe = (Pipe *) g_object_addrs->SearchObject(id, PIPE_WRITER_TYPE);
+    *end = PIPE_WRITER;
+  }
+  return pipe;
+}
+
+//----------------------------------------------------------------------
+// Pipe::IsEnd
+/*!	Tell whether an identifier is a given end of a pipe.
+//
+//	\param id the identifier
+//	\param end PIPE_READER or PIPE_WRITER
+*/
+//----------------------------------------------------------------------
+bool
+Pipe::IsEnd(int64_t id, int end) {
+  int found;
+  return Find(id, &found) != NULL && found == end;
+}
+
+//----------------------------------------------------------------------
+// Pipe::Retain
+/*!	Count one more use of a pipe end, by a process which takes it as
+//	its standard input or output.
+//
+//	\param id the identifier, ignored if it is not a pipe end (console)
+*/
+//----------------------------------------------------------------------
+void
+Pipe::Retain(int64_t id) {
+  int end;
+  Pipe *pipe = Find(id, &end);
+  if (pipe != NULL)
+    pipe->refs[end]++;
+}
+
+//----------------------------------------------------------------------
+// Pipe::Release
+/*!	Count one less use of a pipe end. After the last one, the end is
+//	removed from the object table and the threads waiting on the pipe
+//	are woken up, to see the end of file or the broken pipe; the pipe
+//	is deleted with its second end, or by the last of these threads.
+//
+//	\param id the identifier, ignored if it is not a pipe end (console)
+*/
+//----------------------------------------------------------------------
+void
+Pipe::Release(int64_t id) {
+  int end;
+  Pipe *pipe = Find(id, &end);
+  if (pipe == NULL || --pipe->refs[end] > 0)
+    return;
+
+  DEBUG('e', (char *) "Pipe %s end %d closed\n",
+        end == PIPE_READER ? "reader" : "writer", (int) id);
+  g_object_addrs->RemoveObject(pipe->ids[end]);
+
+  // A woken thread must not run (on another hart) before the pipe is
+  // left alone or deleted here, since it may delete it
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  pipe->notEmpty->Broadcast();
+  pipe->notFull->Broadcast();
+  if (pipe->refs[PIPE_READER] == 0 && pipe->refs[PIPE_WRITER] == 0 &&
+      pipe->users == 0)
+    delete pipe;
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+}
@@ -0,0 +1,95 @@
+/*! \file pipe.h
+    \brief Data structures for the pipes between processes
+
+        A pipe is a ring buffer of the kernel with two ends, registered
+        in the object table: SC_READ on the reader takes the bytes
+        written by SC_WRITE on the writer, in order, blocking while the
+        pipe is empty or full. The ends are counted: the identifiers
+        returned by SC_PIPE and the standard input and output of the
+        processes (see SC_REDIRECT), inherited by SC_EXEC. A reader
+        gets an end of file once no writer is left, and a writer an
+        error once no reader is left.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "kernel/copyright.h"
+#include "kernel/synch.h"
+
+//! Size of the ring buffer of a pipe, in bytes
+#define PIPE_SIZE 4096
+
+//! Ends of a pipe
+enum { PIPE_READER = 0, PIPE_WRITER = 1 };
+
+/*! \brief Defines a pipe
+//
+// The bytes are copied straight between the ring buffer and the
+// memory of the programs, at most two copies per transfer. The lock
+// of the pipe is held during the copies, the conditions are signalled
+// when bytes are added or removed, or when an end is closed.
+*/
+class Pipe {
+public:
+  //! Create an empty pipe, and register its two ends
+  Pipe();
+
+  //! Delete a pipe whose two ends are closed and no thread uses
+  ~Pipe();
+
+  //! Identifier of an end
+  int32_t GetId(int end) { return ids[end]; }
+
+  //! Read at most size bytes into user memory, 0 at end of file
+  int Read(uint64_t addr, int size);
+
+  //! Write size bytes from user memory, ERROR if no reader is left
+  int Write(uint64_t addr, int size);
+
+  //! Count one more use of an end (nothing if id is not a pipe end)
+  static void Retain(int64_t id);
+
+  //! Count one less use of an end, closing it after the last one
+  static void Release(int64_t id);
+
+  //! true if id is the given end of a pipe
+  static bool IsEnd(int64_t id, int end);
+
+private:
+  //! Count one less thread in Read or Write, true if the pipe is unused
+  bool Leave();
+
+  //! Pipe of an end, NULL if id is not a pipe end
+  static Pipe *Find(int64_t id, int *end);
+
+  char *buffer;   //!< Ring buffer, PIPE_SIZE bytes
+  int head;       //!< Index of the first byte to read
+  int count;      //!< Number of bytes in the buffer
+
+  int32_t ids[2];   //!< Identifiers of the ends
+  int refs[2];      //!< Uses of the ends, an end is closed at 0
+  int users;        //!< Threads in Read or Write, which keep the pipe alive
+
+  Lock *lock;              //!< Protects the buffer
+  Condition *notEmpty;     //!< Readers wait on it
+  Condition *notFull;      //!< Writers wait on it
+};
+
+#endif   // PIPE_H
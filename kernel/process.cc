@@ -17,8 +17,13 @@
 */
 
 #include "kernel/process.h"
+#include "kernel/aio.h"
 #include "kernel/msgerror.h"
+#include "kernel/pipe.h"
+#include "kernel/profile.h"
 #include "kernel/system.h"
+#include "userlib/syscall.h"
+#include "vm/loadcontrol.h"
 
 //----------------------------------------------------------------------
 // Process::Process
@@ -32,6 +37,14 @@
 //----------------------------------------------------------------------
 Process::Process(char *filename, uint64_t *err) {
   numThreads = 0;
+  aio = NULL;
+  profile = NULL;
+  suspended = false;
+  workingSet = 0;
+  loadFaults = 0;
+  loadEpoch = 0;
+  stdInput = CONSOLE_INPUT;
+  stdOutput = CONSOLE_OUTPUT;
   *err = NO_ERROR;
   if (filename == NULL) {
     DEBUG('t', (char *) "Create empty process\n");
@@ -84,10 +97,28 @@ Process::Process(char *filename, uint64_t *err) {
 Process::~Process() {
   ASSERT(numThreads == 0);
 
+  // The load controller may hold it suspended
+  g_load_control->Forget(this);
+
+  // Close its ends of pipes, the pipe sees an end of file or a broken
+  // pipe once no process uses them anymore
+  Pipe::Release(stdInput);
+  Pipe::Release(stdOutput);
+
   // Delete the address space. Done for all processes, even the one created
   // for startup, for which there is no executable file attached
   delete addrspace;
 
+  // The asynchronous I/O worker, if any, was one of the threads
+  delete aio;
+
+  // Symbolize the samples of the profiler while the executable is open
+  if (profile != NULL) {
+    if (exec_file != NULL)
+      profile->Write(exec_file, name);
+    delete profile;
+  }
+
   // Delete program name
   delete[] name;
 
@@ -32,6 +32,8 @@
 class AddrSpace;
 class Thread;
 class Semaphore;
+class AioContext;
+class Profile;
 
 /*! \brief Defines the data structures to keep track of the execution
  environment of a user program */
@@ -57,6 +59,26 @@ public:
   ProcessStat *stat; /*!< Statistics concerning this
                        process */
 
+  AioContext *aio; /*!< Asynchronous I/O state (NULL until the
+                     first submission) */
+
+  Profile *profile; /*!< Sampled program counters (NULL until the
+                      first sample) */
+
+  bool suspended; /*!< Kept off the harts by the load controller
+                    (see LoadController) */
+  uint32_t workingSet; /*!< Working set estimated by the load
+                         controller, in pages */
+  uint64_t loadFaults; /*!< Page faults at the last check of the load
+                         controller */
+  uint64_t loadEpoch; /*!< Last check of the load controller that
+                        visited the process */
+
+  int64_t stdInput;  /*!< Read by SC_READ on CONSOLE_INPUT: the console
+                       or a pipe reader (see SC_REDIRECT) */
+  int64_t stdOutput; /*!< Written by SC_WRITE on CONSOLE_OUTPUT: the
+                       console or a pipe writer */
+
   char *getName() { return (name); } /*!< Returns the process name */
 
 private:
@@ -0,0 +1,200 @@
+/*! \file profile.cc
+//  \brief Routines for the sampling profiler of user programs
+//
+//      Samples are taken by the timer interrupt handler (see system.cc),
+//      so that their period is the time slice. They are only
+//      symbolized once, when the process ends.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "kernel/profile.h"
+#include "filesys/openfile.h"
+#include "kernel/elf.h"
+#include "kernel/system.h"
+
+//! A function of the symbol table, with the samples taken in it
+typedef struct {
+  uint64_t start;     //!< Address of the function
+  uint64_t end;       //!< Address following the function
+  const char *name;   //!< Name of the function
+  uint64_t samples;   //!< Samples taken in the function
+} ProfileFunction;
+
+//----------------------------------------------------------------------
+// CompareFunctions
+/*!	Order the functions by address, for qsort
+*/
+//----------------------------------------------------------------------
+static int
+CompareFunctions(const void *a, const void *b) {
+  uint64_t sa = ((const ProfileFunction *) a)->start;
+  uint64_t sb = ((const ProfileFunction *) b)->start;
+  return (sa < sb) ? -1 : (sa > sb);
+}
+
+//----------------------------------------------------------------------
+// Profile::Profile
+/*!	Constructor. Create an empty histogram
+*/
+//----------------------------------------------------------------------
+Profile::Profile() {
+  numSlots = PROFILE_INITIAL_SLOTS;
+  slots = new ProfileSlot[numSlots];
+  for (uint64_t i = 0; i < numSlots; i++)
+    slots[i].pc = FREE_SLOT;
+  numUsed = 0;
+  total = 0;
+}
+
+//----------------------------------------------------------------------
+// Profile::~Profile
+/*!	Destructor. De-allocate the histogram
+*/
+//----------------------------------------------------------------------
+Profile::~Profile() { delete[] slots; }
+
+//----------------------------------------------------------------------
+// Profile::Sample
+/*!	Record one sample at a program counter. Called by the timer
+//	interrupt handler, so without any allocation but the growth of
+//	the table.
+//
+//	\param pc the program counter of the interrupted user program
+*/
+//----------------------------------------------------------------------
+void
+Profile::Sample(uint64_t pc) {
+  if (2 * (numUsed + 1) > numSlots)
+    Grow();
+
+  uint64_t i = (pc >> 1) & (numSlots - 1);   // 2-byte aligned (RVC)
+  while (slots[i].pc != pc && slots[i].pc != FREE_SLOT)
+    i = (i + 1) & (numSlots - 1);
+  if (slots[i].pc == FREE_SLOT) {
+    slots[i].pc = pc;
+    slots[i].samples = 0;
+    numUsed++;
+  }
+  slots[i].samples++;
+  total++;
+}
+
+//----------------------------------------------------------------------
+// Profile::Grow
+/*!	Double the number of slots of the histogram, re-inserting the
+//	sampled program counters
+*/
+//----------------------------------------------------------------------
+void
+Profile::Grow() {
+  ProfileSlot *old = slots;
+  uint64_t oldSlots = numSlots;
+
+  numSlots *= 2;
+  slots = new ProfileSlot[numSlots];
+  for (uint64_t i = 0; i < numSlots; i++)
+    slots[i].pc = FREE_SLOT;
+  for (uint64_t j = 0; j < oldSlots; j++) {
+    if (old[j].pc == FREE_SLOT)
+      continue;
+    uint64_t i = (old[j].pc >> 1) & (numSlots - 1);
+    while (slots[i].pc != FREE_SLOT)
+      i = (i + 1) & (numSlots - 1);
+    slots[i] = old[j];
+  }
+  delete[] old;
+}
+
+//----------------------------------------------------------------------
+// Profile::Write
+/*!	Map the samples to the functions of the symbol table of the
+//	executable, and append them to g_cfg->ProfileFile, one line
+//	"process;function samples" per function (the collapsed-stack
+//	format of flamegraph.pl, without call stacks). Samples outside of
+//	any function, or taken in a stripped executable, are reported
+//	as [unknown].
+//
+//	\param exec_file the executable of the process
+//	\param name the name of the process
+*/
+//----------------------------------------------------------------------
+void
+Profile::Write(OpenFile *exec_file, const char *name) {
+  if (total == 0)
+    return;
+
+  FILE *out = fopen(g_cfg->ProfileFile, "a");
+  if (out == NULL) {
+    printf("Warning: cannot write the profile of %s in %s\n", name,
+           g_cfg->ProfileFile);
+    return;
+  }
+
+  // Read the symbol table of the executable
+  unsigned char eident[EI_NIDENT];
+  uint64_t err;
+  exec_file->ReadAt((char *) eident, EI_NIDENT, 0);
+  ElfFile elf(exec_file, eident[EI_CLASS] == ELFCLASS32, &err);
+  uint64_t numSymbols = (err == NO_ERROR) ? elf.ReadSymbols(exec_file) : 0;
+
+  // Keep the functions, ordered by address. A function of unknown size
+  // ends where the next one starts.
+  ProfileFunction *functions = new ProfileFunction[numSymbols + 1];
+  int numFunctions = 0;
+  for (uint64_t i = 0; i < numSymbols; i++) {
+    if (elf.getSymType(i) != STT_FUNC || elf.getSymValue(i) == 0)
+      continue;
+    functions[numFunctions].start = elf.getSymValue(i);
+    functions[numFunctions].end = elf.getSymValue(i) + elf.getSymSize(i);
+    functions[numFunctions].name = elf.getSymName(i);
+    functions[numFunctions].samples = 0;
+    numFunctions++;
+  }
+  qsort(functions, numFunctions, sizeof(ProfileFunction), CompareFunctions);
+  for (int f = 0; f < numFunctions; f++)
+    if (functions[f].end == functions[f].start)
+      functions[f].end =
+          (f + 1 < numFunctions) ? functions[f + 1].start : (uint64_t) -1;
+
+  // Charge each sampled program counter to its function
+  uint64_t unknown = 0;
+  for (uint64_t i = 0; i < numSlots; i++) {
+    if (slots[i].pc == FREE_SLOT)
+      continue;
+    int low = 0, high = numFunctions - 1, found = -1;
+    while (low <= high) {   // last function starting at or before pc
+      int mid = (low + high) / 2;
+      if (functions[mid].start <= slots[i].pc) {
+        found = mid;
+        low = mid + 1;
+      } else
+        high = mid - 1;
+    }
+    if (found >= 0 && slots[i].pc < functions[found].end)
+      functions[found].samples += slots[i].samples;
+    else
+      unknown += slots[i].samples;
+  }
+
+  for (int f = 0; f < numFunctions; f++)
+    if (functions[f].samples != 0)
+      fprintf(out, "%s;%s %" PRIu64 "\n", name, functions[f].name,
+              functions[f].samples);
+  if (unknown != 0)
+    fprintf(out, "%s;[unknown] %" PRIu64 "\n", name, unknown);
+  fclose(out);
+  delete[] functions;
+}
@@ -0,0 +1,74 @@
+/*! \file profile.h
+    \brief Data structures for the sampling profiler of user programs
+
+        When profiling is enabled (Profile = 1 in the configuration),
+        every timer interrupt that stops a user program records its
+        program counter in a histogram owned by the process. When the
+        process ends, the histogram is mapped to the functions of the
+        ELF symbol table of the executable, and appended to the file
+        ProfileFile in the collapsed-stack format of the flamegraph
+        tools ("process;function samples" per line).
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "kernel/copyright.h"
+#include <stdint.h>
+
+class OpenFile;
+
+//! Initial number of slots of a profile histogram (power of two)
+#define PROFILE_INITIAL_SLOTS 256
+
+//! Program counter of a free slot (user instructions are aligned)
+#define FREE_SLOT ((uint64_t) -1)
+
+//! One program counter of a profile histogram, with its samples
+typedef struct {
+  uint64_t pc;        //!< Sampled program counter (FREE_SLOT if none)
+  uint64_t samples;   //!< Number of samples at this program counter
+} ProfileSlot;
+
+/*! \brief Defines the sampled program counters of a process
+//
+// The histogram is an open-addressing hash table keyed by the program
+// counter, doubled when it becomes half full.
+*/
+class Profile {
+public:
+  Profile();    //!< Create an empty histogram
+  ~Profile();   //!< De-allocate the histogram
+
+  void Sample(uint64_t pc);   //!< Record one sample at pc
+
+  void Write(OpenFile *exec_file, const char *name);
+  //!< Append the samples, by function of exec_file, to
+  //!< g_cfg->ProfileFile for the process of that name
+
+private:
+  void Grow();   //!< Double the number of slots
+
+  ProfileSlot *slots;   //!< The hash table
+  uint64_t numSlots;    //!< Number of slots (power of two)
+  uint64_t numUsed;     //!< Number of distinct program counters
+  uint64_t total;       //!< Total number of samples
+};
+
+#endif   // PROFILE_H
@@ -4,14 +4,33 @@ thread.
 //
 // 	These routines assume that interrupts are already disabled.
 //	If interrupts are disabled, we can assume mutual exclusion
-//	(since we are on a uniprocessor).
+//	(the harts of a multi-hart machine are simulated in turn, a hart
+//	is never interrupted by another one).
+//
+//	Each hart has its own ready queues: a thread that becomes ready
+//	goes back to the queue of the hart it last ran on, and a hart
+//	whose queue is empty takes a thread from the queue of another
+//	hart (work stealing).
+//
+//	Switching a hart to another address space flushes its TLB, so
+//	among the threads of a same level, a hart first dispatches the
+//	ones of the address space it last ran (the threads of a same
+//	process), ahead of older ready threads. At most
+//	g_cfg->AffinityLimit threads are dispatched in a row that way, the
+//	first thread of the queue then runs whatever its address space.
 //
 // 	NOTE: We can't use Locks to provide mutual exclusion here, since
 // 	if we needed to wait for a lock, and the lock was busy, we would
 //	end up calling FindNextToRun(), and that would put us in an
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
+// 	Two policies are available (Scheduler in the configuration file):
+//	straight FIFO (round robin), or a multi-level feedback queue. In
+//	the latter, each thread has a base priority level; a thread using
+//	up its time slice moves down one level (longer slices, lower
+//	priority), and a thread woken up after blocking (typically on an
+//	I/O) goes back to its base level. All threads are periodically
+//	moved back to their base level so that none starves.
  * -----------------------------------------------------
  * This file is part of the Nachos-RiscV distribution
  * Copyright (c) 2022 University of Rennes 1.
@@ -31,6 +50,10 @@ thread.
 #include "kernel/scheduler.h"
 #include "kernel/system.h"
 #include "kernel/thread.h"
+#include "machine/timer.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+#include "utility/trace.h"
 
 //----------------------------------------------------------------------
 //  Scheduler::Scheduler
@@ -38,19 +61,38 @@ thread.
 //      running threads to empty.
 */
 //----------------------------------------------------------------------
-Scheduler::Scheduler() { readyList = new ListThread; }
+Scheduler::Scheduler() {
+  numQueues = g_cfg->NumHarts;
+  queues = new RunQueue[numQueues];
+  for (int q = 0; q < numQueues; q++) {
+    queues[q].readyList = new ListThread;
+    for (int i = 0; i < MLFQ_LEVELS; i++)
+      queues[q].levels[i] = new ListThread;
+    queues[q].levelMap = 0;
+    queues[q].affinityRun = 0;
+  }
+  lastBoost = 0;
+}
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
 /*! 	Destructor. De-allocate the list of ready threads.
  */
 //----------------------------------------------------------------------
-Scheduler::~Scheduler() { delete readyList; }
+Scheduler::~Scheduler() {
+  for (int q = 0; q < numQueues; q++) {
+    delete queues[q].readyList;
+    for (int i = 0; i < MLFQ_LEVELS; i++)
+      delete queues[q].levels[i];
+  }
+  delete[] queues;
+}
 
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 /*! 	Mark a thread as ready, but not necessarily running yet.
-//	Put it in the ready list, for later scheduling onto the CPU.
+//	Put it in the ready queue of the hart it last ran on (the current
+//	hart for a new thread), for later scheduling onto the CPU.
 //
 //	\param thread is the thread to be put on the ready list.
 */
@@ -58,12 +100,46 @@ Scheduler::~Scheduler() { delete readyList; }
 void
 Scheduler::ReadyToRun(Thread *thread) {
   DEBUG('t', (char *) "Putting thread %s in ready list.\n", thread->GetName());
-  readyList->Append((void *) thread);
+  // A second runnable thread needs the time slices again (the timer
+  // may be stopped in tickless mode)
+  if (g_timer != NULL)
+    g_timer->Arm();
+
+  // Ready-to-run latency and length of the ready queues
+  thread->ready_time = g_stats->getTotalTicks();
+  g_stats->incrReadyThreads(1);
+
+  if (thread->hart < 0)
+    thread->hart = g_machine->currentHart;
+  RunQueue *queue = &queues[thread->hart];
+
+  if (g_cfg->SchedulingPolicy != SCHED_MLFQ) {
+    queue->readyList->Append((void *) thread);
+    return;
+  }
+
+  if (thread->blocked) {
+    // Woken up after blocking: back to the base level
+    thread->blocked = false;
+    thread->level = thread->priority;
+  } else if (thread == g_current_thread) {
+    // Preempted (or yielding): move down if the time slice is used up
+    if (g_stats->getTotalTicks() - thread->dispatch_time >=
+            Quantum(thread->level) &&
+        thread->level < MLFQ_LEVELS - 1)
+      thread->level++;
+  } else {
+    // New thread
+    thread->level = thread->priority;
+  }
+
+  queue->levels[LevelOf(thread)]->Append((void *) thread);
+  queue->levelMap |= 1U << LevelOf(thread);
 }
 
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
-/*! 	Return the next thread to be scheduled onto the CPU.
+/*! 	Return the next thread to be scheduled onto the current hart.
 //	If there are no ready threads, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
@@ -72,8 +148,282 @@ Scheduler::ReadyToRun(Thread *thread) {
 //----------------------------------------------------------------------
 Thread *
 Scheduler::FindNextToRun() {
-  Thread *thread = (Thread *) readyList->Remove();
-  return thread;
+  return FindNextToRun(g_machine->currentHart);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FindNextToRun
+/*! 	Return the next thread to be scheduled onto a hart: the next one
+//	of its ready queue or, if it is empty, the next one of the queue
+//	of another hart, which then belongs to this hart. The threads of
+//	the processes suspended by the load control are passed over.
+//
+//	The time the thread spent in the ready queue is counted in the
+//	statistics, up to the time of the hart.
+//
+//	\param hart is the hart to schedule a thread onto
+//	\return Thread to be scheduled on the hart, NULL if none is ready
+*/
+//----------------------------------------------------------------------
+Thread *
+Scheduler::FindNextToRun(int hart) {
+  if (g_cfg->SchedulingPolicy == SCHED_MLFQ &&
+      g_stats->getTotalTicks() >= lastBoost + MLFQ_BOOST_QUANTA * Quantum(0))
+    BoostAll();
+
+  for (int n = 0; n < numQueues; n++) {
+    Thread *thread = Dequeue(&queues[(hart + n) % numQueues], hart);
+    if (thread != NULL) {
+      if (n != 0)
+        DEBUG('t', (char *) "Hart %d steals thread %s from hart %d\n", hart,
+              thread->GetName(), thread->hart);
+      thread->hart = hart;
+      Time now = hart == g_machine->currentHart ? g_stats->getTotalTicks()
+                                                : g_machine->harts[hart].clock;
+      g_stats->incrReadyLatency(
+          thread->process != NULL ? thread->process->stat : NULL,
+          now > thread->ready_time ? now - thread->ready_time : 0);
+      g_stats->incrReadyThreads(-1);
+      return thread;
+    }
+  }
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Dequeue
+/*! 	Remove the next thread of a ready queue: the next one of the
+//	queue with round robin, the next one of the highest level with a
+//	thread to run with the multi-level feedback policy (see
+//	DequeueAffine).
+//
+//	\param queue is the ready queue
+//	\param hart is the hart the thread is dispatched onto
+//	\return the thread removed, NULL if the queue has no thread to run
+*/
+//----------------------------------------------------------------------
+Thread *
+Scheduler::Dequeue(RunQueue *queue, int hart) {
+  if (g_cfg->SchedulingPolicy != SCHED_MLFQ)
+    return DequeueAffine(queue->readyList, hart);
+
+  // Non-empty levels, from the highest
+  for (uint32_t map = queue->levelMap; map != 0; map &= map - 1) {
+    int level = __builtin_ctz(map);
+    Thread *thread = DequeueAffine(queue->levels[level], hart);
+    if (thread == NULL)
+      continue;   // only threads of suspended processes
+    if (queue->levels[level]->IsEmpty())
+      queue->levelMap &= ~(1U << level);
+    return thread;
+  }
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::DequeueAffine
+/*! 	Remove the first thread of a list of ready threads, or the first
+//	one of the address space the hart last ran if the first thread
+//	is of another one: the switch then keeps the TLB of the hart.
+//	The threads passed over keep their place, and the first one is
+//	taken after g_cfg->AffinityLimit threads dispatched in a row
+//	ahead of it. The threads of the suspended processes are not
+//	considered.
+//
+//	\param list is the list of ready threads
+//	\param hart is the hart the thread is dispatched onto
+//	\return the thread removed, NULL if the list has no thread to run
+*/
+//----------------------------------------------------------------------
+Thread *
+Scheduler::DequeueAffine(ListThread *list, int hart) {
+  ListElement<Thread *> *prev = NULL;
+  ListElement<Thread *> *first = list->getFirst();
+  while (first != NULL && IsSuspended((Thread *) first->item)) {
+    prev = first;
+    first = first->next;
+  }
+  if (first == NULL)
+    return NULL;
+
+  RunQueue *own = &queues[hart];
+  TranslationTable *space = g_machine->harts[hart].mmu->translationTable;
+  if (space != NULL && own->affinityRun < g_cfg->AffinityLimit &&
+      SpaceOf((Thread *) first->item) != space) {
+    for (ListElement<Thread *> *e = first; e->next != NULL; e = e->next)
+      if (SpaceOf((Thread *) e->next->item) == space &&
+          !IsSuspended((Thread *) e->next->item)) {
+        own->affinityRun++;
+        return (Thread *) list->RemoveAfter(e);
+      }
+  }
+  own->affinityRun = 0;
+  return (Thread *) list->RemoveAfter(prev);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::IsSuspended
+/*! 	Check if a thread belongs to a process suspended by the load
+//	control (see LoadController).
+//
+//	\param thread is the thread
+//	\return true if the thread must not be dispatched
+*/
+//----------------------------------------------------------------------
+bool
+Scheduler::IsSuspended(Thread *thread) {
+  return thread->process != NULL && thread->process->suspended;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SpaceOf
+/*! 	Address space of a thread, as seen by the MMU.
+//
+//	\param thread is the thread
+//	\return the translation table of its process, NULL for a thread
+//	of the kernel
+*/
+//----------------------------------------------------------------------
+TranslationTable *
+Scheduler::SpaceOf(Thread *thread) {
+  if (thread->process == NULL || thread->process->addrspace == NULL)
+    return NULL;
+  return thread->process->addrspace->translationTable;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Quantum
+/*! 	Time slice of the threads of a level, doubled at each level down.
+//
+//	\param level is the priority level
+//	\return the time slice in cycles
+*/
+//----------------------------------------------------------------------
+Time
+Scheduler::Quantum(int level) {
+  return (Time) nano_to_cycles(g_cfg->Quantum, g_cfg->ProcessorFrequency)
+         << level;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::IsEmpty
+/*! 	Check if some thread is ready to run, on any hart.
+//
+//	\return true if the ready queues are empty
+*/
+//----------------------------------------------------------------------
+bool
+Scheduler::IsEmpty() {
+  for (int q = 0; q < numQueues; q++)
+    if (g_cfg->SchedulingPolicy != SCHED_MLFQ
+            ? !queues[q].readyList->IsEmpty()
+            : queues[q].levelMap != 0)
+      return false;
+  return true;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ShouldPreempt
+/*! 	Decide, at a timer interrupt, if the running thread has to give
+//	up the CPU. With round robin, it does as soon as another thread is
+//	ready. With the multi-level feedback policy, it keeps the CPU
+//	until the time slice of its level is used up, unless a thread of
+//	a higher level is ready. Only the threads ready on the hart of
+//	the thread are considered.
+//
+//	\param thread is the running thread
+//	\return true if the thread has to yield the CPU
+*/
+//----------------------------------------------------------------------
+bool
+Scheduler::ShouldPreempt(Thread *thread) {
+  RunQueue *queue = &queues[thread->hart];
+  if (g_cfg->SchedulingPolicy != SCHED_MLFQ)
+    return !queue->readyList->IsEmpty();
+  if (queue->levelMap == 0)
+    return false;
+  if (__builtin_ctz(queue->levelMap) < LevelOf(thread))
+    return true;
+  return g_stats->getTotalTicks() - thread->dispatch_time >=
+         Quantum(thread->level);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::LevelOf
+/*! 	Level of the ready queue of a thread: its current level, or the
+//	level it inherited from the threads waiting for its locks if higher.
+//
+//	\param thread is the thread
+//	\return the level, between 0 and MLFQ_LEVELS - 1
+*/
+//----------------------------------------------------------------------
+int
+Scheduler::LevelOf(Thread *thread) {
+  return (thread->inherited < thread->level) ? thread->inherited
+                                             : thread->level;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::InheritPriority
+/*! 	Priority inheritance: waiter is going to wait for a lock held by
+//	owner, owner runs at the level of waiter until it releases its
+//	locks. If owner is ready, it moves to the ready queue of its new
+//	level. Inheritance is not transitive (an owner blocked on another
+//	lock does not lend its new level further).
+//
+//	\param owner is the thread holding the lock
+//	\param waiter is the thread that waits for the lock
+*/
+//----------------------------------------------------------------------
+void
+Scheduler::InheritPriority(Thread *owner, Thread *waiter) {
+  if (g_cfg->SchedulingPolicy != SCHED_MLFQ)
+    return;
+  int level = LevelOf(waiter);
+  int old = LevelOf(owner);
+  if (owner->inherited > level)
+    owner->inherited = level;
+  if (LevelOf(owner) == old || owner->hart < 0)
+    return;
+  RunQueue *queue = &queues[owner->hart];
+  if (!queue->levels[old]->Search(owner))
+    return;
+
+  DEBUG('t', (char *) "Thread %s inherits level %d\n", owner->GetName(),
+        level);
+  queue->levels[old]->RemoveItem(owner);
+  if (queue->levels[old]->IsEmpty())
+    queue->levelMap &= ~(1U << old);
+  queue->levels[LevelOf(owner)]->Append((void *) owner);
+  queue->levelMap |= 1U << LevelOf(owner);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::BoostAll
+/*! 	Move all ready threads back to their base priority level, so that
+//	the threads of the low levels are not starved.
+*/
+//----------------------------------------------------------------------
+void
+Scheduler::BoostAll() {
+  lastBoost = g_stats->getTotalTicks();
+  for (int q = 0; q < numQueues; q++) {
+    RunQueue *queue = &queues[q];
+    for (int level = 0; level < MLFQ_LEVELS; level++) {
+      if (queue->levels[level]->IsEmpty())
+        continue;
+      ListThread *list = queue->levels[level];
+      queue->levels[level] = new ListThread;
+      queue->levelMap &= ~(1U << level);
+      Thread *thread;
+      while ((thread = (Thread *) list->Remove()) != NULL) {
+        thread->level = thread->priority;
+        queue->levels[LevelOf(thread)]->Append((void *) thread);
+        queue->levelMap |= 1U << LevelOf(thread);
+      }
+      delete list;
+    }
+  }
 }
 
 //----------------------------------------------------------------------
@@ -96,6 +446,9 @@ Scheduler::SwitchTo(Thread *nextThread) {
   g_current_thread->CheckOverflow();   // check if the old thread
                                        // had an undetected stack overflow
 
+  // Charge the old thread's process with what it did since the last tick
+  g_machine->FlushStats();
+
   DEBUG('t',
         (char *) "Switching from thread \"%s\" to thread \"%s\" time %llu\n",
         g_current_thread->GetName(), nextThread->GetName(),
@@ -103,18 +456,31 @@ Scheduler::SwitchTo(Thread *nextThread) {
 
   // Modify the current thread
   g_current_thread = nextThread;
+  nextThread->dispatch_time = g_stats->getTotalTicks();
 
   // Save the context of old thread
   oldThread->SaveProcessorState();
-  oldThread->SaveSimulatorState();
 
   // Do the context switch if the two threads are different
   if (oldThread != g_current_thread) {
+    g_stats->incrContextSwitches();
+    TRACE(TRACE_SWITCH, nextThread->trace_track, oldThread->trace_track, 0);
+
     // Restore the state of the operating system from its
     // kernelContext structure such that it goes on executing when
     // it was last interrupted
+    TranslationTable *space = g_machine->mmu->translationTable;
     nextThread->RestoreProcessorState();
-    nextThread->RestoreSimulatorState();
+
+    // The TLB caches translations of the old address space
+    bool cross = g_machine->mmu->translationTable != space;
+    if (cross)
+      g_machine->mmu->FlushTLB();
+    g_stats->incrSpaceSwitches(cross);
+
+    // Switch to the host stack of the new thread, we come back here
+    // when the old thread is switched to again
+    oldThread->SwitchSimulatorState(nextThread);
   }
 
   DEBUG('t', (char *) "Now in thread \"%s\" time %llu\n",
@@ -124,8 +490,174 @@ Scheduler::SwitchTo(Thread *nextThread) {
   // we need to delete its carcass.  Note we cannot delete the thread
   // before now (for example, in Thread::Finish()), because up to this
   // point, we were still running on the old thread's stack!
-  printf("**** Warning: thread actual deletion not implemented yet\n");
+  if (g_thread_to_be_destroyed != NULL) {
+    delete g_thread_to_be_destroyed;
+    g_thread_to_be_destroyed = NULL;
+  }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SwitchHart
+/*! 	Move the simulation on to the next hart. The harts are simulated
+//	in turn, each one up to the end of the current time window of the
+//	machine, then the next window starts: the simulated time of the
+//	harts never differ by more than the length of a window.
+//
+//	The thread of the hart left keeps running on it, unless it ran for
+//	a time slice and has to give up the CPU, as it would at a timer
+//	interrupt of the hart (see ShouldPreempt): it then
+//	goes back to the ready queue, and the hart dispatches a thread
+//	the next time it is simulated, like an idle hart does. An idle
+//	hart with no thread to dispatch (even taken from another hart)
+//	stays idle until the end of the window.
+//
+//	The registers of the machine are the ones of the thread of the
+//	current hart, they are saved and restored with the thread.
+//
+//	With g_cfg->ParallelHarts, the harts left in user mode first run
+//	on host threads (see Machine::RunParallel); the harts then go on
+//	serially from where they were stopped, running the kernel.
+//
+//	\param idle is true if the thread of the current hart goes to
+//		sleep, leaving the hart idle
+*/
+//----------------------------------------------------------------------
+void
+Scheduler::SwitchHart(bool idle) {
+  Thread *oldThread = g_current_thread;
+  Hart *hart = &g_machine->harts[g_machine->currentHart];
+
+  // Save the state of the hart, the time slices of its thread go on
+  g_machine->FlushStats();
+  oldThread->SaveProcessorState();
+  hart->clock = g_stats->getTotalTicks();
+  hart->thread = idle ? NULL : oldThread;
+  if (!idle)
+    EndOfWindow(hart);
+
+  int next;
+  for (;;) {
+    // The user code of the harts can run on host threads up to the end
+    // of the window, or up to the next interrupt
+    if (g_cfg->ParallelHarts) {
+      g_machine->RunParallel(MIN(g_machine->windowEnd,
+                                 g_machine->interrupt->NextDue()));
+      for (int i = 0; i < g_machine->numHarts; i++) {
+        hart = &g_machine->harts[i];
+        if (hart->parallel && hart->thread != NULL &&
+            hart->clock >= g_machine->windowEnd)
+          EndOfWindow(hart);
+      }
+    }
+
+    for (next = (g_machine->currentHart + 1) % g_machine->numHarts;;
+         next = (next + 1) % g_machine->numHarts) {
+      hart = &g_machine->harts[next];
+      if (hart->clock < g_machine->windowEnd) {
+        if (hart->thread == NULL) {
+          // Idle hart: dispatch a ready thread
+          hart->thread = FindNextToRun(next);
+          if (hart->thread != NULL) {
+            hart->inUser = false;
+            hart->thread->dispatch_time = hart->clock;
+            TranslationTable *space = SpaceOf(hart->thread);
+            bool cross = space != NULL && space != hart->mmu->translationTable;
+            if (cross)
+              hart->mmu->FlushTLB();
+            g_stats->incrSpaceSwitches(cross);
+            g_stats->incrContextSwitches();
+            TRACE(TRACE_SWITCH, hart->thread->trace_track, 0, 0);
+          }
+        }
+        if (hart->thread != NULL)
+          break;
+
+        // Nothing to run before the end of the window
+        hart->idleTicks += g_machine->windowEnd - hart->clock;
+        hart->clock = g_machine->windowEnd;
+      }
+      if (next == g_machine->currentHart)
+        break;
+    }
+    if (hart->thread != NULL && hart->clock < g_machine->windowEnd)
+      break;
+
+    // Every hart reached the end of the window: the next one starts
+    // at the time of the hart the least advanced
+    Time start = ~(Time) 0;
+    for (int i = 0; i < g_machine->numHarts; i++)
+      if (g_machine->harts[i].thread != NULL &&
+          g_machine->harts[i].clock < start)
+        start = g_machine->harts[i].clock;
+    if (start == ~(Time) 0) {
+      // Every hart is idle, a thread preempted above is ready
+      ASSERT(!IsEmpty());
+      start = g_machine->windowEnd;
+    }
+    g_machine->windowEnd = start + g_machine->windowLength;
+  }
+
+  DEBUG('t', (char *) "Hart %d runs thread \"%s\" time %llu\n", next,
+        hart->thread->GetName(), hart->clock);
+
+  // Resume the hart
+  Thread *nextThread = hart->thread;
+  g_machine->currentHart = next;
+  g_machine->mmu = hart->mmu;
+  g_stats->setTotalTicks(hart->clock);
+  g_current_thread = nextThread;
+  nextThread->RestoreProcessorState();   // it may have run on a host thread
+  if (nextThread != oldThread)
+    oldThread->SwitchSimulatorState(nextThread);
 
+  // The thread switched from may have finished (see SwitchTo)
+  if (g_thread_to_be_destroyed != NULL) {
+    delete g_thread_to_be_destroyed;
+    g_thread_to_be_destroyed = NULL;
+  }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::EndOfWindow
+/*! 	Called when a hart reaches the end of a time window: its thread
+//	goes back to the ready queue if it ran for a time slice and has to
+//	give up the CPU, as it would at a timer interrupt of the hart (see
+//	ShouldPreempt), leaving the hart idle.
+//
+//	\param hart the hart, running a thread
+*/
+//----------------------------------------------------------------------
+void
+Scheduler::EndOfWindow(Hart *hart) {
+  Thread *thread = hart->thread;
+
+  if (g_cfg->TimeSharing && hart->clock - thread->dispatch_time >= Quantum(0) &&
+      ShouldPreempt(thread)) {
+    g_stats->incrPreemptions();
+    ReadyToRun(thread);
+    hart->thread = NULL;
+  }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::IdleHart
+/*! 	Called when the thread of the current hart goes to sleep with no
+//	thread ready to replace it. If another hart has a thread to run,
+//	the hart is left idle and the simulation goes on with the other
+//	harts, this function returning once the thread is woken up and a
+//	hart dispatched it. Otherwise, the machine is idle.
+//
+//	\return true if the thread was switched out and dispatched again
+*/
+//----------------------------------------------------------------------
+bool
+Scheduler::IdleHart() {
+  for (int i = 0; i < g_machine->numHarts; i++)
+    if (i != g_machine->currentHart && g_machine->harts[i].thread != NULL) {
+      SwitchHart(true);
+      return true;
+    }
+  return false;
 }
 
 //----------------------------------------------------------------------
@@ -136,7 +668,17 @@ Scheduler::SwitchTo(Thread *nextThread) {
 //----------------------------------------------------------------------
 void
 Scheduler::Print() {
-  printf("Ready list contents: [");
-  readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
-  printf("]\n");
+  for (int q = 0; q < numQueues; q++) {
+    if (numQueues > 1)
+      printf("Hart %d: ", q);
+    printf("Ready list contents: [");
+    if (g_cfg->SchedulingPolicy != SCHED_MLFQ)
+      queues[q].readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
+    else
+      for (int level = 0; level < MLFQ_LEVELS; level++) {
+        printf(" %d:", level);
+        queues[q].levels[level]->Mapcar((VoidFunctionPtr) ThreadPrint);
+      }
+    printf("]\n");
+  }
 }
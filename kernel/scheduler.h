@@ -29,32 +29,109 @@
 
 #include "kernel/copyright.h"
 #include "utility/list.h"
+#include "utility/utility.h"
 
 class Thread;
+class TranslationTable;
+struct Hart;
+
+#define MLFQ_LEVELS 8   //!< Number of priority levels (0 is the highest)
+#define MLFQ_BOOST_QUANTA 64   //!< Quanta between two boosts of all threads
+
+/*! \brief Ready queues of one hart
+ */
+struct RunQueue {
+  //! Queue of threads that are ready to run, but not running.
+  ListThread *readyList;
+
+  //! Ready queues of the multi-level feedback policy, one per level
+  ListThread *levels[MLFQ_LEVELS];
+
+  //! Bit i is set if levels[i] is not empty
+  uint32_t levelMap;
+
+  //! Threads dispatched in a row onto the hart ahead of older ready
+  //! threads, because they share its address space
+  uint32_t affinityRun;
+};
 
 class Scheduler {
 public:
-  //! Constructor. Initializes list of ready threads.
+  //! Constructor. Initializes the ready queues of the harts.
   Scheduler();
 
-  //! Destructor. De-allocates the ready list.
+  //! Destructor. De-allocates the ready queues.
   ~Scheduler();
 
-  //! Inserts a thread in the ready list
+  //! Inserts a thread in the ready queue of its hart
   void ReadyToRun(Thread *thread);
 
-  //! Dequeue first thread of the ready list, if any, and return thread.
+  //! Dequeue the next thread of the current hart, if any, and return thread.
   Thread *FindNextToRun();
 
+  //! Dequeue the next thread of the queue of a hart, or of the queue of
+  //! another hart if it is empty (work stealing)
+  Thread *FindNextToRun(int hart);
+
   //! Causes a context switch to nextThread
   void SwitchTo(Thread *nextThread);
 
   //! Print contents of ready list.
   void Print();
 
+  //! Time slice of the threads of a level (in cycles)
+  Time Quantum(int level);
+
+  //! True if no thread is ready to run, on any hart
+  bool IsEmpty();
+
+  //! True if the thread has to give up the CPU at a timer interrupt
+  bool ShouldPreempt(Thread *thread);
+
+  //! Lend the priority level of waiter to owner, that holds a lock
+  //! waiter is waiting for
+  void InheritPriority(Thread *owner, Thread *waiter);
+
+  //! Move the simulation on to the next hart, at the end of the time
+  //! window of the current one or when it becomes idle
+  void SwitchHart(bool idle);
+
+  //! Leave the current hart idle if another hart has a thread to run
+  bool IdleHart();
+
 protected:
-  //! Queue of threads that are ready to run, but not running.
-  ListThread *readyList;
+  //! Ready queues, one per hart
+  RunQueue *queues;
+
+  //! Number of ready queues (g_cfg->NumHarts)
+  int numQueues;
+
+  //! Dequeue the next thread of a ready queue for a hart, NULL if it
+  //! is empty
+  Thread *Dequeue(RunQueue *queue, int hart);
+
+  //! Dequeue the first thread of a list, or the first one sharing the
+  //! address space of a hart within the fairness limit
+  Thread *DequeueAffine(ListThread *list, int hart);
+
+  //! Translation table of the address space of a thread, NULL for a
+  //! kernel thread
+  TranslationTable *SpaceOf(Thread *thread);
+
+  //! True if the process of a thread is suspended by the load control
+  bool IsSuspended(Thread *thread);
+
+  //! Preempt the thread of a hart at the end of a window, if needed
+  void EndOfWindow(Hart *hart);
+
+  //! Time of the last boost of all threads to their base priority
+  Time lastBoost;
+
+  //! Move all ready threads back to their base priority level
+  void BoostAll();
+
+  //! Level of the ready queue of a thread (including inherited priority)
+  int LevelOf(Thread *thread);
 };
 
 #endif   // SCHEDULER_H
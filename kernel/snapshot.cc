@@ -0,0 +1,102 @@
+/*! \file snapshot.cc
+//  \brief Snapshots of the disk taken after the boot
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "kernel/snapshot.h"
+#include "filesys/bufcache.h"
+#include "filesys/filesys.h"
+#include "kernel/msgerror.h"
+#include "kernel/system.h"
+#include "machine/disk.h"
+#include "machine/machine.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+
+//----------------------------------------------------------------------
+// SaveSnapshot
+/*!     Save the state of the machine once the boot actions are done:
+//      the dirty sectors of the buffer cache are written first, so that
+//      the disk holds the whole file system. The disks of a striped
+//      volume are saved one after the other.
+//
+//      \param fileName the host file of the snapshot
+*/
+//----------------------------------------------------------------------
+void
+SaveSnapshot(char *fileName) {
+  g_file_system->Sync();
+  g_buffer_cache->Flush();
+
+  int fd = OpenForWrite(fileName);
+  struct SnapshotHeader hdr;
+  hdr.magic = SNAPSHOT_MAGIC;
+  hdr.version = SNAPSHOT_VERSION;
+  hdr.sectorSize = g_cfg->SectorSize;
+  hdr.diskSize = g_cfg->NumDisks * g_cfg->DiskSize;
+  hdr.ticks = g_stats->getTotalTicks();
+  WriteFile(fd, (char *) &hdr, sizeof(hdr));
+  for (uint32_t i = 0; i < g_cfg->NumDisks; i++)
+    g_machine->disks[i]->Save(fd);
+  Close(fd);
+
+  printf("Snapshot saved in %s at time %" PRIu64 "\n", fileName, hdr.ticks);
+}
+
+//----------------------------------------------------------------------
+// RestoreSnapshot
+/*!     Resume from a snapshot saved by a previous run with the same
+//      disk geometry: the snapshot is mapped and its disks copied to
+//      the simulated disks, before the file system is mounted.
+//
+//      \param fileName the host file of the snapshot
+*/
+//----------------------------------------------------------------------
+void
+RestoreSnapshot(char *fileName) {
+  int fd = OpenForReadWrite(fileName, false);
+  if (fd < 0) {
+    fprintf(stderr, "Nachos boot error: cannot open snapshot %s\n", fileName);
+    Exit(ERROR);
+  }
+  size_t size = sizeof(struct SnapshotHeader) +
+                (size_t) g_cfg->NumDisks * g_cfg->DiskSize;
+  Lseek(fd, 0, SEEK_END);
+  char *snapshot = (size_t) Tell(fd) >= size ? MapFile(fd, size) : NULL;
+  if (snapshot == NULL) {
+    fprintf(stderr, "Nachos boot error: cannot map snapshot %s\n", fileName);
+    Exit(ERROR);
+  }
+
+  struct SnapshotHeader *hdr = (struct SnapshotHeader *) snapshot;
+  if (hdr->magic != SNAPSHOT_MAGIC || hdr->version != SNAPSHOT_VERSION ||
+      hdr->sectorSize != g_cfg->SectorSize ||
+      hdr->diskSize != g_cfg->NumDisks * g_cfg->DiskSize) {
+    fprintf(stderr,
+            "Nachos boot error: snapshot %s does not match the "
+            "configuration\n",
+            fileName);
+    Exit(ERROR);
+  }
+  for (uint32_t i = 0; i < g_cfg->NumDisks; i++)
+    g_machine->disks[i]->Restore(snapshot + sizeof(struct SnapshotHeader) +
+                                 (size_t) i * g_cfg->DiskSize);
+  g_stats->setTotalTicks(hdr->ticks);
+
+  UnmapFile(snapshot, size);
+  Close(fd);
+}
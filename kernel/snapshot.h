@@ -0,0 +1,58 @@
+/*! \file snapshot.h
+    \brief Snapshots of the disk taken after the boot
+
+        Preparing the disk (formatting it, copying the FileToCopy
+        files, creating and removing files and directories) dominates
+        the run time of short experiments. With DiskSnapshotSave = 1,
+        the contents of the disk once these boot actions are done are
+        saved in DiskSnapshotFile with the simulated time, just before
+        the first user program starts. A later run with
+        DiskSnapshotRestore = 1 maps the snapshot and starts from that
+        disk instead of doing the boot actions again, so that many
+        experiments can start from one warm disk.
+
+        Only the disk (not the swap disk) and the time are saved. The
+        threads run on host stacks and the kernel objects are linked
+        by host pointers, so they are not part of the snapshot: at the
+        point it is taken, no user program has started yet, the memory
+        is free and only the boot thread exists. The first program is
+        loaded again after a restore.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "utility/utility.h"
+
+#define SNAPSHOT_MAGIC   0x4e534e50   //!< "NSNP"
+#define SNAPSHOT_VERSION 1
+
+/*! Header of a snapshot file, followed by the contents of the disk */
+struct SnapshotHeader {
+  uint32_t magic;        //!< SNAPSHOT_MAGIC
+  uint32_t version;      //!< SNAPSHOT_VERSION
+  uint32_t sectorSize;   //!< Geometry of the disk saved
+  uint32_t diskSize;     //!< Size of the disk contents in bytes
+  Time ticks;            //!< Simulated time of the snapshot
+};
+
+extern void SaveSnapshot(char *fileName);      // Save the machine state
+extern void RestoreSnapshot(char *fileName);   // Resume from a snapshot
+
+#endif   // SNAPSHOT_H
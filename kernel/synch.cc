@@ -1,289 +1,681 @@
-/*! \file synch.cc
-//  \brief Routines for synchronizing threads.
-//
-//      Three kinds of synchronization routines are defined here:
-//      semaphores, locks and condition variables.
-//
-// Any implementation of a synchronization routine needs some
-// primitive atomic operation. We assume Nachos is running on
-// a uniprocessor, and thus atomicity can be provided by
-// turning off interrupts. While interrupts are disabled, no
-// context switch can occur, and thus the current thread is guaranteed
-// to hold the CPU throughout, until interrupts are reenabled.
-//
-// Because some of these routines might be called with interrupts
-// already disabled (Semaphore::V for one), instead of turning
-// on interrupts at the end of the atomic operation, we always simply
-// re-set the interrupt state back to its original value (whether
-// that be disabled or enabled).
- * -----------------------------------------------------
- * This file is part of the Nachos-RiscV distribution
- * Copyright (c) 2022 University of Rennes.
- *
- * This program is free software: you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation, version 3.
- *
- * This program is distributed in the hope that it will be useful, but
- * WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
- * General Public License for more details
- * (see see <http://www.gnu.org/licenses/>).
- * -----------------------------------------------------
-*/
-
-#include "kernel/synch.h"
-#include "kernel/msgerror.h"
-#include "kernel/scheduler.h"
-#include "kernel/system.h"
-
-//----------------------------------------------------------------------
-// Semaphore::Semaphore
-/*! 	Initializes a semaphore, so that it can be used for synchronization.
-//
-// \param debugName is an arbitrary name, useful for debugging only.
-// \param initialValue is the initial value of the semaphore.
-*/
-//----------------------------------------------------------------------
-Semaphore::Semaphore(char *debugName, uint32_t initialCount) {
-  semaphore_name = new char[strlen(debugName) + 1];
-  strcpy(semaphore_name, debugName);
-  count = initialCount;
-  wait_queue = new ListThread;
-  type = SEMAPHORE_TYPE;
-}
-
-//----------------------------------------------------------------------
-// Semaphore::Semaphore
-/*! 	De-allocates a semaphore, when no longer needed.  Assume no one
-//	is still waiting on the semaphore!
-*/
-//----------------------------------------------------------------------
-Semaphore::~Semaphore() {
-  type = INVALID_TYPE;
-  if (!wait_queue->IsEmpty()) {
-    DEBUG('s',
-          (char *) "Destructor of semaphore \"%s\", queue is not empty!!\n",
-          semaphore_name);
-    Thread *t = (Thread *) wait_queue->Remove();
-    DEBUG('s', (char *) "Queue contents %s\n", t->GetName());
-    wait_queue->Append((void *) t);
-  }
-  ASSERT(wait_queue->IsEmpty());
-  delete[] semaphore_name;
-  delete wait_queue;
-}
-
-//----------------------------------------------------------------------
-// Semaphore::P
-/*!
-// Implementation of P (counter decrementation+blocking if required).
-// Checking the
-// value and decrementing must be done atomically, so we
-// need to disable interrupts before checking the value.
-//
-//	Note that Thread::Sleep assumes that interrupts are disabled
-//	when it is called.
-*/
-//----------------------------------------------------------------------
-void
-Semaphore::P() {
-  
-  printf("**** Warning: method Semaphore::P is not implemented yet\n");
-    Interrupt *interrupt = g_machine->interrupt;
-    Thread *currentThread = g_current_thread;
-    IntStatus oldLevel = interrupt->SetStatus(INTERRUPTS_OFF); // disable interrupts
-    while(count == 0) { // semaphore not available
-        wait_queue->Append((void *)currentThread); // so go to sleep
-        currentThread->Sleep();
-    }
-    count--; // semaphore available, consume its value
-    (void) interrupt->SetStatus(oldLevel); // re-enable interrupts
-    // disable interrupts
-  exit(ERROR);
-}
-
-//----------------------------------------------------------------------
-// Semaphore::V
-/*! 	Implementation of V (counter incrementation + waking up a waiting thread
-//  if required).
-//	As with P(), this operation must be atomic, so we need to disable
-//	interrupts.  Scheduler::ReadyToRun() assumes that interrupts
-//	are disabled when it is called.
-*/
-//----------------------------------------------------------------------
-void
-Semaphore::V() {
-  printf("**** Warning: method Semaphore::V is not implemented yet\n");
-    Interrupt *interrupt = g_machine->interrupt;
-    IntStatus oldst= interrupt->SetStatus(INTERRUPTS_OFF); // disable interrupts
-    Thread *thread = (Thread *)wait_queue->Remove();
-    if (thread != NULL) // make thread ready
-        g_scheduler->ReadyToRun(thread);
-    count++;
-    (void) interrupt->SetStatus(oldst); // re-enable interrupts
-  exit(ERROR);
-}
-
-//----------------------------------------------------------------------
-// Lock::Lock
-/*! 	Initialize a Lock, so that it can be used for synchronization.
-//      The lock is initialy free
-//  \param "debugName" is an arbitrary name, useful for debugging.
-*/
-//----------------------------------------------------------------------
-
-Lock::Lock(char *debugName) {
-  lock_name = new char[strlen(debugName) + 1];
-  strcpy(lock_name, debugName);
-  wait_queue = new ListThread;
-  is_free = true;
-  owner = NULL;
-  type = LOCK_TYPE;
-}
-
-//----------------------------------------------------------------------
-// Lock::~Lock
-/*! 	De-allocate lock, when no longer needed. Assumes that no thread
-//      is waiting on the lock.
-*/
-//----------------------------------------------------------------------
-Lock::~Lock() {
-  type = INVALID_TYPE;
-  ASSERT(wait_queue->IsEmpty());
-  delete[] lock_name;
-  delete wait_queue;
-}
-
-//----------------------------------------------------------------------
-// Lock::Acquire
-/*! 	Wait until the lock become free.  Checking the
-//	state of the lock (free or busy) and modify it must be done
-//	atomically, so we need to disable interrupts before checking
-//	the value of is_free.
-//
-//	Note that Thread::Sleep assumes that interrupts are disabled
-//	when it is called.
-*/
-//----------------------------------------------------------------------
-void
-Lock::Acquire() {
-  printf("**** Warning: method Lock::Acquire is not implemented yet\n");
-  Interrupt *interrupt = g_machine->interrupt;
-  Thread *currentThread = g_current_thread;
-  IntStatus oldLevel = interrupt->SetStatus(INTERRUPTS_OFF); // disable interrupts
-
-  while (!is_free) { // lock is not free
-    wait_queue->Append((void *)currentThread); // so go to sleep
-    currentThread->Sleep();
-  }
-
-  is_free = false; // lock is now acquired
-  owner = currentThread; // current thread is the owner of the lock
-  (void) interrupt->SetStatus(oldLevel); // re-enable interrupts
-  exit(ERROR);
-}
-
-//----------------------------------------------------------------------
-// Lock::Release
-/*! 	Wake up a waiter if necessary, or release it if no thread is waiting.
-//      We check that the lock is held by the g_current_thread.
-//	As with Acquire, this operation must be atomic, so we need to disable
-//	interrupts.  Scheduler::ReadyToRun() assumes that threads
-//	are disabled when it is called.
-*/
-//----------------------------------------------------------------------
-#ifdef ETUDIANTS_TP
-void
-Lock::Release() {
-  printf("**** Warning: method Lock::Release is not implemented yet\n");
-  Interrupt *interrupt = g_machine->interrupt;
-  IntStatus oldLevel = interrupt->SetStatus(INTERRUPTS_OFF); // disable interrupts
-
-  ASSERT(isHeldByCurrentThread()); // check if the current thread holds the lock
-
-  if (!wait_queue->IsEmpty()) {
-    Thread *thread = (Thread *)wait_queue->Remove();
-    g_scheduler->ReadyToRun(thread); // make thread ready
-  } else {
-    is_free = true; // no thread is waiting, release the lock
-    owner = NULL; // no owner since the lock is free
-  }
-
-  (void) interrupt->SetStatus(oldLevel); // re-enable interrupts
-  exit(ERROR);
-}
-#endif ETUDIANTS_TP
-
-//----------------------------------------------------------------------
-// Lock::isHeldByCurrentThread
-/*! To check if current thread hold the lock
- */
-//----------------------------------------------------------------------
-bool
-Lock::isHeldByCurrentThread() {
-  return (g_current_thread == owner);
-}
-
-//----------------------------------------------------------------------
-// Condition::Condition
-/*! 	Initializes a Condition, so that it can be used for synchronization.
-//
-//    \param  "debugName" is an arbitrary name, useful for debugging.
-*/
-//----------------------------------------------------------------------
-Condition::Condition(char *debugName) {
-  condition_name = new char[strlen(debugName) + 1];
-  strcpy(condition_name, debugName);
-  wait_queue = new ListThread;
-  type = CONDITION_TYPE;
-}
-
-//----------------------------------------------------------------------
-// Condition::~Condition
-/*! 	De-allocate condition, when no longer needed.
-//      Assumes that nobody is waiting on the condition.
-*/
-//----------------------------------------------------------------------
-Condition::~Condition() {
-  type = INVALID_TYPE;
-  ASSERT(wait_queue->IsEmpty());
-  delete[] condition_name;
-  delete wait_queue;
-}
-
-//----------------------------------------------------------------------
-// Condition::Wait
-/*! Block the calling thread (put it in the wait queue).
-//  This operation must be atomic, so we need to disable interrupts.
-*/
-//----------------------------------------------------------------------
-void
-Condition::Wait() {
-  printf("**** Warning: method Condition::Wait is not implemented yet\n");
-  exit(ERROR);
-}
-
-//----------------------------------------------------------------------
-// Condition::Signal
-/*! Wake up the first thread of the wait queue (if any).
-// This operation must be atomic, so we need to disable interrupts.
-*/
-//----------------------------------------------------------------------
-void
-Condition::Signal() {
-  printf("**** Warning: method Condition::Signal is not implemented yet\n");
-  exit(ERROR);
-}
-
-//----------------------------------------------------------------------
-// Condition::Broadcast
-/*! Wake up all threads waiting in the waitqueue of the condition
-// This operation must be atomic, so we need to disable interrupts.
-*/
-//----------------------------------------------------------------------
-void
-Condition::Broadcast() {
-  printf("**** Warning: method Condition::Broadcast is not implemented yet\n");
-  exit(ERROR);
-}
+/*! \file synch.cc
+//  \brief Routines for synchronizing threads.
+//
+//      Three kinds of synchronization routines are defined here:
+//      semaphores, locks and condition variables.
+//
+// Any implementation of a synchronization routine needs some
+// primitive atomic operation. We assume Nachos is running on
+// a uniprocessor, and thus atomicity can be provided by
+// turning off interrupts. While interrupts are disabled, no
+// context switch can occur, and thus the current thread is guaranteed
+// to hold the CPU throughout, until interrupts are reenabled.
+//
+// Because some of these routines might be called with interrupts
+// already disabled (Semaphore::V for one), instead of turning
+// on interrupts at the end of the atomic operation, we always simply
+// re-set the interrupt state back to its original value (whether
+// that be disabled or enabled).
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "kernel/synch.h"
+#include "kernel/msgerror.h"
+#include "kernel/scheduler.h"
+#include "kernel/system.h"
+#include "machine/mmu.h"
+#include "utility/stats.h"
+#include "utility/trace.h"
+
+//----------------------------------------------------------------------
+// Semaphore::Semaphore
+/*! 	Initializes a semaphore, so that it can be used for synchronization.
+//
+// \param debugName is an arbitrary name, useful for debugging only.
+// \param initialValue is the initial value of the semaphore.
+*/
+//----------------------------------------------------------------------
+Semaphore::Semaphore(char *debugName, uint32_t initialCount) {
+  semaphore_name = new char[strlen(debugName) + 1];
+  strcpy(semaphore_name, debugName);
+  count = initialCount;
+  wait_queue = new ListThread;
+  stat = g_stats->NewLockStat(debugName, "semaphore");
+  type = SEMAPHORE_TYPE;
+}
+
+//----------------------------------------------------------------------
+// Semaphore::Semaphore
+/*! 	De-allocates a semaphore, when no longer needed.  Assume no one
+//	is still waiting on the semaphore!
+*/
+//----------------------------------------------------------------------
+Semaphore::~Semaphore() {
+  type = INVALID_TYPE;
+  if (!wait_queue->IsEmpty()) {
+    DEBUG('s',
+          (char *) "Destructor of semaphore \"%s\", queue is not empty!!\n",
+          semaphore_name);
+    Thread *t = (Thread *) wait_queue->Remove();
+    DEBUG('s', (char *) "Queue contents %s\n", t->GetName());
+    wait_queue->Append((void *) t);
+  }
+  ASSERT(wait_queue->IsEmpty());
+  delete[] semaphore_name;
+  delete wait_queue;
+}
+
+//----------------------------------------------------------------------
+// Semaphore::P
+/*!
+// Implementation of P (counter decrementation+blocking if required).
+// Checking the
+// value and decrementing must be done atomically, so we
+// need to disable interrupts before checking the value.
+//
+//	Note that Thread::Sleep assumes that interrupts are disabled
+//	when it is called.
+//
+//	The time a P waits is counted once, even when the thread has to
+//	go to sleep again.
+*/
+//----------------------------------------------------------------------
+void
+Semaphore::P() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  stat->incrAcquires();
+  if (count == 0) {
+    Time start = g_stats->getTotalTicks();
+    while (count == 0) {   // semaphore not available, so go to sleep
+      wait_queue->Append((void *) g_current_thread);
+      TRACE(TRACE_SEM_WAIT, g_current_thread->GetTraceTrack(), 0,
+            (uint64_t) this);
+      g_current_thread->Sleep();
+    }
+    stat->incrContended(g_stats->getTotalTicks() - start);
+  }
+  count--;   // semaphore available, consume its value
+  g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Semaphore::V
+/*! 	Implementation of V (counter incrementation + waking up a waiting thread
+//  if required).
+//	As with P(), this operation must be atomic, so we need to disable
+//	interrupts.  Scheduler::ReadyToRun() assumes that interrupts
+//	are disabled when it is called.
+*/
+//----------------------------------------------------------------------
+void
+Semaphore::V() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  Thread *thread = (Thread *) wait_queue->Remove();
+  if (thread != NULL) {   // make the waiting thread ready
+    TRACE(TRACE_SEM_WAKE, g_current_thread->GetTraceTrack(),
+          thread->GetTraceTrack(), (uint64_t) this);
+    g_scheduler->ReadyToRun(thread);
+  }
+  count++;
+  g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Lock::Lock
+/*! 	Initialize a Lock, so that it can be used for synchronization.
+//      The lock is initialy free
+//  \param "debugName" is an arbitrary name, useful for debugging.
+*/
+//----------------------------------------------------------------------
+
+Lock::Lock(char *debugName) {
+  lock_name = new char[strlen(debugName) + 1];
+  strcpy(lock_name, debugName);
+  wait_queue = new ListThread;
+  is_free = true;
+  owner = NULL;
+  stat = g_stats->NewLockStat(debugName, "lock");
+  type = LOCK_TYPE;
+}
+
+//----------------------------------------------------------------------
+// Lock::~Lock
+/*! 	De-allocate lock, when no longer needed. Assumes that no thread
+//      is waiting on the lock.
+*/
+//----------------------------------------------------------------------
+Lock::~Lock() {
+  type = INVALID_TYPE;
+  ASSERT(wait_queue->IsEmpty());
+  delete[] lock_name;
+  delete wait_queue;
+}
+
+//----------------------------------------------------------------------
+// Lock::Acquire
+/*! 	Wait until the lock become free.  Checking the
+//	state of the lock (free or busy) and modify it must be done
+//	atomically, so we need to disable interrupts before checking
+//	the value of is_free.
+//
+//	Note that Thread::Sleep assumes that interrupts are disabled
+//	when it is called.
+//
+//	A busy lock is handed over by Release: once woken up, the
+//	thread owns the lock, there is no need to test it again. While
+//	waiting, the owner inherits the priority level of the thread. The
+//	kernel is not preemptive and runs on a single CPU, so spinning
+//	before blocking could never see the lock released.
+*/
+//----------------------------------------------------------------------
+void
+Lock::Acquire() {
+  Interrupt *interrupt = g_machine->interrupt;
+  Thread *currentThread = g_current_thread;
+  IntStatus oldLevel = interrupt->SetStatus(INTERRUPTS_OFF); // disable interrupts
+
+  stat->incrAcquires();
+  if (is_free) {
+    is_free = false; // lock is now acquired
+    owner = currentThread; // current thread is the owner of the lock
+    currentThread->locks_held++;
+  } else {
+    ASSERT(owner != currentThread);
+    Time start = g_stats->getTotalTicks();
+    g_scheduler->InheritPriority(owner, currentThread);
+    wait_queue->Append((void *)currentThread); // so go to sleep
+    currentThread->Sleep();
+    ASSERT(owner == currentThread); // handed over by Release
+    stat->incrContended(g_stats->getTotalTicks() - start);
+  }
+  (void) interrupt->SetStatus(oldLevel); // re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// Lock::Release
+/*! 	Hand the lock over to the first waiter if necessary, or release
+//	it if no thread is waiting: the waiter cannot lose the lock to
+//	another thread between its wake up and its scheduling.
+//      We check that the lock is held by the g_current_thread.
+//	A thread gives back the priority it inherited when it releases the
+//	last lock it holds.
+//	As with Acquire, this operation must be atomic, so we need to disable
+//	interrupts.  Scheduler::ReadyToRun() assumes that threads
+//	are disabled when it is called.
+*/
+//----------------------------------------------------------------------
+void
+Lock::Release() {
+  Interrupt *interrupt = g_machine->interrupt;
+  IntStatus oldLevel = interrupt->SetStatus(INTERRUPTS_OFF); // disable interrupts
+
+  ASSERT(isHeldByCurrentThread()); // check if the current thread holds the lock
+
+  if (--owner->locks_held == 0)
+    owner->inherited = MLFQ_LEVELS; // no more inherited priority
+
+  if (!wait_queue->IsEmpty()) {
+    Thread *thread = (Thread *)wait_queue->Remove();
+    owner = thread; // the lock goes directly to the waiter
+    thread->locks_held++;
+    g_scheduler->ReadyToRun(thread); // make thread ready
+  } else {
+    is_free = true; // no thread is waiting, release the lock
+    owner = NULL; // no owner since the lock is free
+  }
+
+  (void) interrupt->SetStatus(oldLevel); // re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// Lock::Morph
+/*! 	Wait-morphing: a thread woken up by a condition associated with
+//	the lock joins the wait queue of the lock, and is made ready when
+//	the lock is handed over to it. It gets the lock at once if free.
+//	Called with interrupts disabled.
+//
+//  \param thread is the thread woken up
+*/
+//----------------------------------------------------------------------
+void
+Lock::Morph(Thread *thread) {
+  ASSERT(g_machine->interrupt->GetStatus() == INTERRUPTS_OFF);
+  stat->incrAcquires();
+  if (is_free) {
+    is_free = false;
+    owner = thread;
+    thread->locks_held++;
+    g_scheduler->ReadyToRun(thread);
+  } else {
+    g_scheduler->InheritPriority(owner, thread);
+    wait_queue->Append((void *) thread);
+  }
+}
+
+//----------------------------------------------------------------------
+// Lock::isHeldByCurrentThread
+/*! To check if current thread hold the lock
+ */
+//----------------------------------------------------------------------
+bool
+Lock::isHeldByCurrentThread() {
+  return (g_current_thread == owner);
+}
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+/*! 	Initialize a reader-writer lock, initially free.
+//
+//  \param "debugName" is an arbitrary name, useful for debugging.
+*/
+//----------------------------------------------------------------------
+RWLock::RWLock(char *debugName) {
+  rwlock_name = new char[strlen(debugName) + 1];
+  strcpy(rwlock_name, debugName);
+  readers = 0;
+  writer = NULL;
+  waiting_writers = 0;
+  read_queue = new ListThread;
+  write_queue = new ListThread;
+  type = RWLOCK_TYPE;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+/*! 	De-allocate a reader-writer lock. Assumes that no thread holds
+//      or waits for the lock.
+*/
+//----------------------------------------------------------------------
+RWLock::~RWLock() {
+  type = INVALID_TYPE;
+  ASSERT(read_queue->IsEmpty() && write_queue->IsEmpty());
+  delete[] rwlock_name;
+  delete read_queue;
+  delete write_queue;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead
+/*! 	Acquire the lock in read mode: wait while a writer holds the
+//	lock or waits for it. A waiting reader is counted in readers by
+//	the Release that wakes it up.
+*/
+//----------------------------------------------------------------------
+void
+RWLock::AcquireRead() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  if (writer == NULL && waiting_writers == 0)
+    readers++;
+  else {
+    read_queue->Append((void *) g_current_thread);
+    g_current_thread->Sleep();
+  }
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite
+/*! 	Acquire the lock in write mode: wait while readers or a writer
+//	hold the lock. A waiting writer is given the lock by the Release
+//	that wakes it up.
+*/
+//----------------------------------------------------------------------
+void
+RWLock::AcquireWrite() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  if (writer == NULL && readers == 0)
+    writer = g_current_thread;
+  else {
+    ASSERT(writer != g_current_thread);
+    waiting_writers++;
+    write_queue->Append((void *) g_current_thread);
+    g_current_thread->Sleep();
+    ASSERT(writer == g_current_thread);   // handed over by Release
+  }
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RWLock::Release
+/*! 	Release the lock. When it becomes free, hand it over to the
+//	first waiting writer if any, or else to all the waiting readers.
+*/
+//----------------------------------------------------------------------
+void
+RWLock::Release() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  if (writer == g_current_thread)
+    writer = NULL;
+  else {
+    ASSERT(readers > 0);
+    readers--;
+  }
+
+  if (readers == 0 && writer == NULL) {
+    if (waiting_writers > 0) {
+      writer = (Thread *) write_queue->Remove();
+      waiting_writers--;
+      g_scheduler->ReadyToRun(writer);
+    } else {
+      Thread *thread;
+      while ((thread = (Thread *) read_queue->Remove()) != NULL) {
+        readers++;
+        g_scheduler->ReadyToRun(thread);
+      }
+    }
+  }
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Barrier::Barrier
+/*! 	Initialize a barrier.
+//
+//  \param "debugName" is an arbitrary name, useful for debugging.
+//  \param "count" is the number of threads to wait for (> 0)
+*/
+//----------------------------------------------------------------------
+Barrier::Barrier(char *debugName, int nbThreads) {
+  ASSERT(nbThreads > 0);
+  barrier_name = new char[strlen(debugName) + 1];
+  strcpy(barrier_name, debugName);
+  count = nbThreads;
+  arrived = 0;
+  wait_queue = new ListThread;
+  type = BARRIER_TYPE;
+}
+
+//----------------------------------------------------------------------
+// Barrier::~Barrier
+/*! 	De-allocate a barrier. Assumes that no thread is waiting.
+*/
+//----------------------------------------------------------------------
+Barrier::~Barrier() {
+  type = INVALID_TYPE;
+  ASSERT(wait_queue->IsEmpty());
+  delete[] barrier_name;
+  delete wait_queue;
+}
+
+//----------------------------------------------------------------------
+// Barrier::Wait
+/*! 	Block until count threads have called Wait. The last thread to
+//	arrive wakes the others up and starts the next phase.
+//
+//	\return true in the last thread to arrive, false in the others
+*/
+//----------------------------------------------------------------------
+bool
+Barrier::Wait() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  bool last = false;
+
+  if (++arrived == count) {
+    arrived = 0;
+    Thread *thread;
+    while ((thread = (Thread *) wait_queue->Remove()) != NULL)
+      g_scheduler->ReadyToRun(thread);
+    last = true;
+  } else {
+    wait_queue->Append((void *) g_current_thread);
+    g_current_thread->Sleep();
+  }
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+  return last;
+}
+
+//----------------------------------------------------------------------
+// Condition::Condition
+/*! 	Initializes a Condition, so that it can be used for synchronization.
+//
+//    \param  "debugName" is an arbitrary name, useful for debugging.
+//    \param  "conditionLock" is the lock protecting the condition, or
+//             NULL
+*/
+//----------------------------------------------------------------------
+Condition::Condition(char *debugName, Lock *conditionLock) {
+  condition_name = new char[strlen(debugName) + 1];
+  strcpy(condition_name, debugName);
+  wait_queue = new ListThread;
+  lock = conditionLock;
+  stat = g_stats->NewLockStat(debugName, "condition");
+  type = CONDITION_TYPE;
+}
+
+//----------------------------------------------------------------------
+// Condition::~Condition
+/*! 	De-allocate condition, when no longer needed.
+//      Assumes that nobody is waiting on the condition.
+*/
+//----------------------------------------------------------------------
+Condition::~Condition() {
+  type = INVALID_TYPE;
+  ASSERT(wait_queue->IsEmpty());
+  delete[] condition_name;
+  delete wait_queue;
+}
+
+//----------------------------------------------------------------------
+// Condition::Wait
+/*! Block the calling thread (put it in the wait queue).
+//  This operation must be atomic, so we need to disable interrupts.
+//  With an associated lock, the calling thread must hold it: it is
+//  released while waiting, and held again when Wait returns.
+*/
+//----------------------------------------------------------------------
+void
+Condition::Wait() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  Time start = g_stats->getTotalTicks();
+
+  stat->incrAcquires();
+  wait_queue->Append((void *) g_current_thread);
+  if (lock != NULL) {
+    ASSERT(lock->isHeldByCurrentThread());
+    lock->Release();
+  }
+  g_current_thread->Sleep();
+  // Woken up with the lock handed over (see Lock::Morph)
+  ASSERT(lock == NULL || lock->isHeldByCurrentThread());
+  stat->incrContended(g_stats->getTotalTicks() - start);
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Condition::Wake
+/*! Wake up a thread of the wait queue: make it ready, or with an
+// associated lock, move it to the wait queue of the lock.
+//
+// \param thread is the thread removed from the wait queue
+*/
+//----------------------------------------------------------------------
+void
+Condition::Wake(Thread *thread) {
+  if (lock != NULL)
+    lock->Morph(thread);
+  else
+    g_scheduler->ReadyToRun(thread);
+}
+
+//----------------------------------------------------------------------
+// Condition::Signal
+/*! Wake up the first thread of the wait queue (if any).
+// This operation must be atomic, so we need to disable interrupts.
+*/
+//----------------------------------------------------------------------
+void
+Condition::Signal() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  Thread *thread = (Thread *) wait_queue->Remove();
+  if (thread != NULL)
+    Wake(thread);
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Condition::Broadcast
+/*! Wake up all threads waiting in the waitqueue of the condition
+// This operation must be atomic, so we need to disable interrupts.
+// With an associated lock, the threads are all moved at once to the
+// wait queue of the lock, and each Release runs only one of them.
+*/
+//----------------------------------------------------------------------
+void
+Condition::Broadcast() {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+
+  Thread *thread;
+  while ((thread = (Thread *) wait_queue->Remove()) != NULL)
+    Wake(thread);
+
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// HashFutex
+/*! Hash a futex (address space, word address) into a bucket number
+*/
+//----------------------------------------------------------------------
+static int
+HashFutex(AddrSpace *space, uint64_t addr) {
+  uint64_t h = ((uint64_t) space >> 4) * 31 + (addr >> 2);
+  return (int) (h % FUTEX_BUCKETS);
+}
+
+//----------------------------------------------------------------------
+// FutexTable::FutexTable
+/*! Create an empty futex table
+*/
+//----------------------------------------------------------------------
+FutexTable::FutexTable() {
+  for (int i = 0; i < FUTEX_BUCKETS; i++)
+    hashTable[i] = NULL;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::~FutexTable
+/*! De-allocate the futex table and its remaining queues
+*/
+//----------------------------------------------------------------------
+FutexTable::~FutexTable() {
+  for (int i = 0; i < FUTEX_BUCKETS; i++)
+    while (hashTable[i] != NULL) {
+      FutexQueue *q = hashTable[i];
+      hashTable[i] = q->hashNext;
+      delete q->waiters;
+      delete q;
+    }
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Find
+/*! Find the queue of a futex in its hash bucket
+//
+//  \param space the address space of the futex word
+//  \param addr the virtual address of the futex word
+//  \return the link pointing to the queue, or to NULL at the end of
+//          the bucket if nobody waits on the futex
+*/
+//----------------------------------------------------------------------
+FutexQueue **
+FutexTable::Find(AddrSpace *space, uint64_t addr) {
+  FutexQueue **ptr = &hashTable[HashFutex(space, addr)];
+  while (*ptr != NULL && ((*ptr)->space != space || (*ptr)->addr != addr))
+    ptr = &(*ptr)->hashNext;
+  return ptr;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wait
+/*! Put the current thread to sleep on a futex, if its word still holds
+//  the value the user code saw: otherwise the word changed since, and
+//  the thread must look at it again rather than wait for a wake-up
+//  that may already have happened.
+//
+//  \param space the address space of the futex word
+//  \param addr the virtual address of the futex word
+//  \param val the value the word must hold to wait
+//  \return NO_ERROR once woken up, 1 if the word held another value,
+//          ERROR if it is misaligned or cannot be read
+*/
+//----------------------------------------------------------------------
+int
+FutexTable::Wait(AddrSpace *space, uint64_t addr, int32_t val) {
+  int32_t word;
+  if ((addr & 3) != 0 ||
+      !g_machine->mmu->CopyFromUser(addr, (char *) &word, sizeof(word)))
+    return ERROR;
+  if (word != val)
+    return 1;
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  FutexQueue **ptr = Find(space, addr);
+  if (*ptr == NULL) {
+    FutexQueue *q = new FutexQueue;
+    q->space = space;
+    q->addr = addr;
+    q->waiters = new ListThread;
+    q->hashNext = NULL;
+    *ptr = q;
+  }
+  (*ptr)->waiters->Append((void *) g_current_thread);
+  g_current_thread->Sleep();
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+  return NO_ERROR;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wake
+/*! Wake up threads waiting on a futex, in FIFO order. The queue is
+//  freed once empty.
+//
+//  \param space the address space of the futex word
+//  \param addr the virtual address of the futex word
+//  \param count the maximum number of threads to wake up
+//  \return the number of threads woken up
+*/
+//----------------------------------------------------------------------
+int
+FutexTable::Wake(AddrSpace *space, uint64_t addr, int count) {
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  int woken = 0;
+  FutexQueue **ptr = Find(space, addr);
+  FutexQueue *q = *ptr;
+  if (q != NULL) {
+    Thread *thread;
+    while (woken < count && (thread = (Thread *) q->waiters->Remove()) != NULL) {
+      g_scheduler->ReadyToRun(thread);
+      woken++;
+    }
+    if (q->waiters->IsEmpty()) {
+      *ptr = q->hashNext;
+      delete q->waiters;
+      delete q;
+    }
+  }
+  (void) g_machine->interrupt->SetStatus(oldLevel);
+  return woken;
+}
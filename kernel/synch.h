@@ -32,6 +32,8 @@
 #include "kernel/thread.h"
 #include "utility/list.h"
 
+class AddrSpace;
+
 /*! \brief Defines the "semaphore" synchronization tool
 //
 // The semaphore has only two operations P() and V():
@@ -47,6 +49,9 @@
 // into a register, a context switch might have occurred,
 // and some other thread might have called P or V, so the true value might
 // now be different.
+//
+// The P calls that block, and the time they wait, are counted in a
+// LockStat, printed with the statistics.
 */
 class Semaphore {
 public:
@@ -66,6 +71,7 @@ private:
   char *semaphore_name;     //!< useful for debugging
   int count;                //!< semaphore counter
   ListThread *wait_queue;   //!< threads waiting in P() for the value to be > 0
+  LockStat *stat;           //!< contention statistics
 
 public:
   //! Object type, for validity checks during system calls (must be the first
@@ -80,12 +86,16 @@ public:
 //
 //	Acquire -- wait until the lock is FREE, then set it to BUSY
 //
-//	Release -- wake up a thread waiting in Acquire if necessary,
-//	           or else set the lock to FREE
+//	Release -- hand the lock over to a thread waiting in Acquire if
+//	           necessary, or else set the lock to FREE
 //
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).
+//
+// A thread waiting for a lock lends its priority level to the owner
+// (multi-level feedback scheduler), and the contention of the locks
+// is counted in a LockStat, printed with the statistics.
 */
 class Lock {
 public:
@@ -108,11 +118,100 @@ public:
   //! in Release, and in Condition variable operations below.
   bool isHeldByCurrentThread();
 
+  //! Make a thread woken up by a condition wait for the lock, without
+  //! running it until the lock is handed over to it
+  void Morph(Thread *thread);
+
 private:
   char *lock_name;          //!< for debugging
   ListThread *wait_queue;   //!< threads waiting to acquire the lock
   bool is_free;             //!< to know if the lock is free
   Thread *owner;            //!< Thread who has acquired the lock
+  LockStat *stat;           //!< contention statistics
+
+public:
+  //! Object type, for validity checks during system calls (must be the first
+  //! public field)
+  ObjectType type;
+};
+
+/*! \brief Defines the "reader-writer lock" synchronization tool
+//
+// A reader-writer lock is held either by any number of readers, or by
+// a single writer:
+//
+//	AcquireRead -- wait until no writer holds or waits for the lock
+//
+//	AcquireWrite -- wait until nobody holds the lock
+//
+//	Release -- release the lock (read or write mode), and hand it over
+//	           to the first waiting writer, or else to all waiting
+//	           readers
+//
+// Writers are preferred: a reader arriving while a writer waits is
+// queued, so that writers cannot be starved by a stream of readers.
+// The uncontended operations only update counters.
+*/
+class RWLock {
+public:
+  //! Reader-writer lock creation
+  RWLock(char *debugName);
+
+  //! Delete a reader-writer lock
+  ~RWLock();
+
+  //! For debugging
+  char *getName() { return rwlock_name; }
+
+  //! Acquire the lock in read (shared) mode
+  void AcquireRead();
+
+  //! Acquire the lock in write (exclusive) mode
+  void AcquireWrite();
+
+  //! Release the lock, acquired in either mode
+  void Release();
+
+private:
+  char *rwlock_name;         //!< for debugging
+  int readers;               //!< number of readers holding the lock
+  Thread *writer;            //!< writer holding the lock, if any
+  int waiting_writers;       //!< number of threads in write_queue
+  ListThread *read_queue;    //!< readers waiting for the lock
+  ListThread *write_queue;   //!< writers waiting for the lock
+
+public:
+  //! Object type, for validity checks during system calls (must be the first
+  //! public field)
+  ObjectType type;
+};
+
+/*! \brief Defines the "barrier" synchronization tool
+//
+// A barrier blocks the threads calling Wait until a given number of
+// threads have called it, then lets all of them go on, and can be
+// used again for the next phase.
+*/
+class Barrier {
+public:
+  //! Create a barrier for count threads
+  Barrier(char *debugName, int count);
+
+  //! Delete a barrier
+  ~Barrier();
+
+  //! For debugging
+  char *getName() { return barrier_name; }
+
+  //! Wait until count threads have reached the barrier. Return true in
+  //! the last thread to arrive
+  bool Wait();
+
+private:
+  char *barrier_name;       //!< for debugging
+  int count;                //!< number of threads to wait for
+  int arrived;              //!< threads arrived in the current phase
+  ListThread *wait_queue;   //!< threads waiting for the others
 
 public:
   //! Object type, for validity checks during system calls (must be the first
@@ -134,11 +233,18 @@ public:
 //
 //	Broadcast() -- wake up all threads waiting on the condition
 //
+// A condition can be associated with the lock protecting its state.
+// Wait then releases the lock and returns with the lock held, and the
+// threads woken up are moved to the wait queue of the lock instead of
+// the ready list (wait-morphing): they are run one at a time, when the
+// lock is handed over to them, instead of all running to block again
+// on the lock. The time spent in Wait is counted in a LockStat.
 */
 class Condition {
 public:
-  //! Create a condition and initialize it to "no one waiting"
-  Condition(char *debugName);
+  //! Create a condition and initialize it to "no one waiting",
+  //! associated with conditionLock if not NULL
+  Condition(char *debugName, Lock *conditionLock = NULL);
 
   //! Deallocate the condition
   ~Condition();
@@ -158,6 +264,11 @@ public:
 private:
   char *condition_name;     //!< For debbuging
   ListThread *wait_queue;   //!< Threads asked to wait
+  Lock *lock;               //!< Associated lock (NULL if none)
+  LockStat *stat;           //!< waiting statistics
+
+  //! Wake up a waiting thread, or morph it to the lock
+  void Wake(Thread *thread);
 
 public:
   //! Object type, for validity checks during system calls (must be the first
@@ -165,4 +276,46 @@ public:
   ObjectType type;
 };
 
+//! Number of hash buckets of the futex table
+#define FUTEX_BUCKETS 64
+
+/*! \brief Defines the queue of the threads waiting on a futex
+*/
+struct FutexQueue {
+  AddrSpace *space;         //!< Address space of the futex word
+  uint64_t addr;            //!< Virtual address of the futex word
+  ListThread *waiters;      //!< Threads waiting on it, in FIFO order
+  FutexQueue *hashNext;     //!< Next queue in the same hash bucket
+};
+
+/*! \brief Defines the futexes, the wait queues of the user-level locks
+//
+// A futex is a word of user memory, identified by its address space
+// and virtual address. User code takes locks with atomic instructions
+// on the word, and only calls the kernel to wait while the word holds
+// the value it saw, or to wake waiters. A queue only exists while
+// threads wait on its futex, and is found through a hash table. As the
+// kernel is not preemptive, checking the word and waiting are atomic.
+*/
+class FutexTable {
+public:
+  FutexTable();    //!< Create an empty table
+  ~FutexTable();   //!< De-allocate the table
+
+  //! Wait on the futex at addr of space if the word still holds val.
+  //! Return NO_ERROR once woken up, 1 if the word held another value,
+  //! ERROR if it cannot be read
+  int Wait(AddrSpace *space, uint64_t addr, int32_t val);
+
+  //! Wake up at most count threads waiting on the futex at addr of
+  //! space, return the number of threads woken up
+  int Wake(AddrSpace *space, uint64_t addr, int count);
+
+private:
+  //! Find the queue of a futex, NULL if nobody waits on it
+  FutexQueue **Find(AddrSpace *space, uint64_t addr);
+
+  FutexQueue *hashTable[FUTEX_BUCKETS];   //!< Heads of the buckets
+};
+
 #endif   // SYNCH_H
@@ -21,16 +21,27 @@
 #include "drivers/drvACIA.h"
 #include "drivers/drvConsole.h"
 #include "drivers/drvDisk.h"
+#include "filesys/bufcache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "filesys/oftable.h"
+#include "kernel/elf.h"
 #include "kernel/msgerror.h"
+#include "kernel/profile.h"
 #include "kernel/scheduler.h"
+#include "kernel/snapshot.h"
+#include "kernel/synch.h"
 #include "kernel/thread.h"
+#include "kernel/timerwheel.h"
+#include "machine/timer.h"
 #include "utility/config.h"
 #include "utility/objaddr.h"
 #include "utility/stats.h"
+#include "utility/trace.h"
 #include "utility/utility.h"
 #include "vm/pagefaultmanager.h"
+#include "vm/loadcontrol.h"
 #include "vm/physMem.h"
 #include "vm/swapManager.h"
 
@@ -46,23 +57,32 @@ Thread *g_current_thread;           //!< The thread holding the CPU
 Thread *g_thread_to_be_destroyed;   //!< The thread that just finished
 ListThread *g_alive;                //!< List of existing threads
 Scheduler *g_scheduler;             //!< Thread scheduler
+Timer *g_timer;   //!< Time slices (NULL without time sharing)
+TimerWheel *g_timer_wheel;   //!< Armed kernel timers (SC_SLEEP)
 
 // Device drivers
 DriverDisk *g_disk_driver;         //!< Disk driver
 DriverDisk *g_swap_disk_driver;    //!< Swap disk driver
 DriverConsole *g_console_driver;   //!< Console driver
 DriverACIA *g_acia_driver;         //!< Serial line driver
+BufferCache *g_buffer_cache;       //!< Cache of the file system sectors
 
 // Other Nachos components
 FileSystem *g_file_system;                //!< File system
+Journal *g_journal;                       //!< Metadata journal (NULL if none)
 OpenFileTable *g_open_file_table;         //!< Open File Table
+DentryCache *g_dentry_cache;              //!< Cache of path name lookups
+ElfCache *g_elf_cache;                    //!< Headers of executable files
 SwapManager *g_swap_manager;              //!< Management of swap area
 PageFaultManager *g_page_fault_manager;   //!< Page fault handler (used in VMM)
 PhysicalMemManager *g_physical_mem_manager;   //!< Physical memory manager
+LoadController *g_load_control;               //!< Virtual memory load control
 SyscallError *g_syscall_error;                //!< Error management
 Config *g_cfg;                                //!< Configuration of Nachos
 Statistics *g_stats;                          //!< performance metrics
+Trace *g_trace;                               //!< event trace
 ObjAddr *g_object_addrs;                      //!< addresses of kernel objets
+FutexTable *g_futex_table;                    //!< Threads waiting on futexes
 
 // Endianess of data in ELF file and endianess of host
 char risc_endianess;
@@ -82,10 +102,16 @@ CleanupOK() {
 //----------------------------------------------------------------------
 // TimerInterruptHandler
 /*! 	Interrupt handler for the timer device.  The timer device is
-//	set up to interrupt the CPU periodically (once every TimerTicks).
+//	set up to interrupt the CPU periodically (once every Quantum).
 //	This routine is called each time there is a timer interrupt,
 //	with interrupts disabled.
 //
+//	The timer is re-armed for the next time slice, except in tickless
+//	mode when no other thread is ready: the running thread has nobody
+//	to give the CPU to, and the timer is armed again by ReadyToRun.
+//	It also advances the wheel of the kernel timers, and keeps running
+//	while timers are armed.
+//
 //	Note that instead of calling Yield() directly (which would
 //	suspend the interrupt handler, not the interrupted thread
 //	which is what we wanted to context switch), we set a flag
@@ -97,14 +123,58 @@ CleanupOK() {
 //		whether it needs it or not.
 */
 //----------------------------------------------------------------------
-/*
 static void
-TimerInterruptHandler(int dummy)
-{
-    if (machine->getStatus() != IdleMode)
-        machine->interrupt->YieldOnReturn();
+TimerInterruptHandler(int64_t dummy) {
+  MachineStatus interrupted = g_machine->interrupt->GetInterruptedStatus();
+
+  // Sample the program counter of the interrupted user program
+  if (g_cfg->Profile && interrupted == USER_MODE) {
+    Process *process = g_current_thread->GetProcessOwner();
+    if (process->profile == NULL)
+      process->profile = new Profile();
+    process->profile->Sample(g_machine->pc);
+  }
+
+  // Wake up the threads whose sleep is over, before deciding whether
+  // the running thread is preempted
+  g_timer_wheel->Advance(g_stats->getTotalTicks());
+
+  // The process of the running thread may be suspended by the load
+  // control
+  if (g_load_control->Check() && g_machine->GetStatus() != IDLE_MODE)
+    g_machine->interrupt->YieldOnReturn();
+
+  if (g_cfg->TimeSharing) {
+    if (g_machine->GetStatus() != IDLE_MODE &&
+        g_scheduler->ShouldPreempt(g_current_thread))
+      g_machine->interrupt->YieldOnReturn();
+
+    if (!g_cfg->Tickless || !g_scheduler->IsEmpty()) {
+      g_timer->Arm();
+      return;
+    }
+  }
+
+  // The profiler keeps sampling while a thread runs, ReadyToRun arms
+  // the timer again when the machine leaves the idle loop
+  if ((g_cfg->Profile && interrupted != IDLE_MODE) ||
+      !g_timer_wheel->IsEmpty())
+    g_timer->Arm();
 }
+
+//----------------------------------------------------------------------
+// StartTimer
+/*! 	Start the hardware timer if it is stopped, creating it if there
+//	are no time slices (it is then only used by the kernel timers).
 */
+//----------------------------------------------------------------------
+void
+StartTimer() {
+  if (g_timer == NULL)
+    g_timer = new Timer(TimerInterruptHandler, 0, false);
+  else
+    g_timer->Arm();
+}
 
 //----------------------------------------------------------------------
 // Initialize
@@ -154,30 +224,40 @@ Initialize(int argc, char **argv) {
 
   // Create the statistics object (used from the very start)
   g_stats = new Statistics();
+  g_trace = g_cfg->Trace ? new Trace(g_cfg->TraceEvents) : NULL;
 
   // Create the Nachos hardware
   g_machine = new Machine(debugUserProg);
+  if (g_cfg->DiskSnapshotRestore)
+    RestoreSnapshot(g_cfg->DiskSnapshotFile);
 
   // Create the device drivers
-  g_disk_driver = new DriverDisk((char *) "sem disk", (char *) "lock disk",
-                                 g_machine->disk);
+  g_disk_driver = new DriverDisk((char *) "disk", g_machine->disks,
+                                 g_cfg->NumDisks);
+  g_buffer_cache = new BufferCache(g_disk_driver, g_cfg->CacheSectors,
+                                   g_cfg->CacheWriteBack);
   if (g_cfg->ACIA)
     g_acia_driver = new DriverACIA();
   g_console_driver = new DriverConsole();
 
   // Create the different objects making the Nachos kernel
   g_scheduler = new Scheduler();   // Initialize the ready queue
+  g_timer = NULL;
   g_page_fault_manager = new PageFaultManager();
   g_swap_manager = new SwapManager();
   g_swap_disk_driver = g_swap_manager->GetSwapDisk();
   g_physical_mem_manager = new PhysicalMemManager();
+  g_load_control = new LoadController();
   g_syscall_error = new SyscallError();
 
   // Init the Nachos internal data structures
   g_alive = new ListThread();   // List of threads (initially empty)
   g_object_addrs = new ObjAddr();
+  g_futex_table = new FutexTable();
   g_thread_to_be_destroyed = NULL;
   g_open_file_table = new OpenFileTable;
+  g_dentry_cache = new DentryCache;
+  g_elf_cache = new ElfCache;
 
   // Cleanup if user presses Ctrl-C
   CallOnUserAbort(CleanupOK);
@@ -207,6 +287,19 @@ Initialize(int argc, char **argv) {
   // because it is currently executing
   ASSERT(g_current_thread == g_scheduler->FindNextToRun());
 
+  // Start the kernel thread cleaning dirty pages in the background
+  g_physical_mem_manager->StartWritebackDaemon(rootProcess);
+
+  // Start the time slices, which also drive the profiler
+  if (g_cfg->Profile) {
+    FILE *profile = fopen(g_cfg->ProfileFile, "w");
+    if (profile != NULL)
+      fclose(profile);
+  }
+  g_timer_wheel = new TimerWheel();
+  if (g_cfg->TimeSharing || g_cfg->Profile)
+    StartTimer();
+
   // Enable interrupts
   g_machine->interrupt->SetStatus(INTERRUPTS_ON);
 
@@ -215,6 +308,8 @@ Initialize(int argc, char **argv) {
   // Thus; FileSystem initiaization has to be done after the first
   // (temporary) thread is created
   g_file_system = new FileSystem(g_cfg->FormatDisk);
+  if (g_journal != NULL)
+    g_journal->StartDaemon(rootProcess);
 }
 
 //----------------------------------------------------------------------
@@ -230,14 +325,28 @@ Cleanup() {
   // last executing thread after cleanup, there is no following
   // context switch, we have to free resources here.
   if (g_current_thread != NULL) {
+    g_machine->FlushStats();
     delete g_current_thread;
   }
 
+  // The machine stops at the time of the hart the most advanced
+  if (g_machine != NULL)
+    for (int i = 0; i < g_machine->numHarts; i++)
+      if (g_machine->harts[i].clock > g_stats->getTotalTicks())
+        g_stats->setTotalTicks(g_machine->harts[i].clock);
+
   // Clean all global objects
   printf("\nCleaning up...\n");
+  g_stats->Snapshot(true);
+  if (g_trace != NULL) {
+    g_trace->Write(g_cfg->TraceFile);
+    delete g_trace;
+    g_trace = NULL;
+  }
   if (g_cfg->PrintStat) {
     g_stats->Print();
   }
+  delete g_buffer_cache;
   delete g_disk_driver;
   delete g_console_driver;
   if (g_cfg->ACIA)
@@ -245,13 +354,19 @@ Cleanup() {
   delete g_syscall_error;
   delete g_file_system;
   delete g_open_file_table;
+  delete g_dentry_cache;
+  delete g_elf_cache;
   delete g_swap_manager;
+  delete g_timer;
+  delete g_timer_wheel;
   delete g_scheduler;
   delete g_stats;
   delete g_physical_mem_manager;
+  delete g_load_control;
   delete g_page_fault_manager;
   delete g_cfg;
   delete g_alive;
   delete g_object_addrs;
+  delete g_futex_table;
   delete g_machine;
 }
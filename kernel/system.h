@@ -27,7 +27,6 @@
 using namespace std;
 
 #include "utility/list.h"
-#include "utility/objaddr.h"
 
 /*! Each syscall makes sure that the object that the user passes to it
  * are of the expected type, by checking the typeId field against
@@ -39,12 +38,22 @@ typedef enum {
   CONDITION_TYPE = 0xdeefcdcd,
   FILE_TYPE = 0xdeadbeef,
   THREAD_TYPE = 0xbadcafe,
+  RWLOCK_TYPE = 0xdeefabab,
+  BARRIER_TYPE = 0xdeefbaba,
+  PIPE_READER_TYPE = 0xdeef5050,
+  PIPE_WRITER_TYPE = 0xdeef0505,
+  SHM_TYPE = 0xdeef5a5a,
+  DIRECTORY_TYPE = 0xdeefd1d1,
   INVALID_TYPE = 0xf0f0f0f
 } ObjectType;
 
+// The object table stores the type of each object
+#include "utility/objaddr.h"
+
 // Forward declarations (ie in other files)
 class Config;
 class Statistics;
+class Trace;
 class SyscallError;
 class Thread;
 class Scheduler;
@@ -52,10 +61,18 @@ class PageFaultManager;
 class PhysicalMemManager;
 class SwapManager;
 class FileSystem;
+class Journal;
 class OpenFileTable;
 class DriverDisk;
+class BufferCache;
+class DentryCache;
+class ElfCache;
+class FutexTable;
 class DriverConsole;
 class DriverACIA;
+class Timer;
+class TimerWheel;
+class LoadController;
 class Machine;
 
 // Initialization and cleanup routines
@@ -64,6 +81,8 @@ extern void Initialize(int argc,
                                        //!< called before anything else
 extern void Cleanup();                 //!< Cleanup, called when
                                        //!< Nachos is done.
+extern void StartTimer();              //!< Start the hardware timer
+                                       //!< (if stopped)
 // Global variables per type
 // By convention, all globals are in lower case and start by g_
 // ------------------------------------------------------------
@@ -76,25 +95,34 @@ extern Thread *g_current_thread;           //!< The thread holding the CPU
 extern Thread *g_thread_to_be_destroyed;   //!< The thread that just finished
 extern ListThread *g_alive;                //!< List of existing threads
 extern Scheduler *g_scheduler;             //!< Thread scheduler
+extern Timer *g_timer;   //!< Time slices (NULL without time sharing)
+extern TimerWheel *g_timer_wheel;   //!< Armed kernel timers (SC_SLEEP)
 
 // Device drivers
 extern DriverDisk *g_disk_driver;         //!< Disk driver
 extern DriverDisk *g_swap_disk_driver;    //!< Swap disk driver
 extern DriverConsole *g_console_driver;   //!< Console driver
 extern DriverACIA *g_acia_driver;         //!< Serial line driver
+extern BufferCache *g_buffer_cache;       //!< Cache of the file system sectors
 
 // Other Nachos components
 extern FileSystem *g_file_system;          //!< File system
+extern Journal *g_journal;                 //!< Metadata journal (NULL if none)
 extern OpenFileTable *g_open_file_table;   //!< Open File Table
+extern DentryCache *g_dentry_cache;        //!< Cache of path name lookups
+extern ElfCache *g_elf_cache;              //!< Headers of executable files
 extern SwapManager *g_swap_manager;        //!< Management of swap area
 extern PageFaultManager
     *g_page_fault_manager;   //!< Page fault handler (used in VMM)
 extern PhysicalMemManager
     *g_physical_mem_manager;            //!< Physical memory manager
+extern LoadController *g_load_control;  //!< Virtual memory load control
 extern SyscallError *g_syscall_error;   //!< Error management
 extern Config *g_cfg;                   //!< Configuration of Nachos
 extern Statistics *g_stats;             //!< performance metrics
+extern Trace *g_trace;                  //!< event trace (NULL if disabled)
 extern ObjAddr *g_object_addrs;         //!< addresses of kernel objets
+extern FutexTable *g_futex_table;       //!< Threads waiting on futexes
 
 // Endianess of data in ELF file and host endianess
 //
@@ -27,9 +27,12 @@
 */
 
 #include "kernel/thread.h"
+#include "filesys/bufcache.h"
 #include "kernel/msgerror.h"
 #include "kernel/scheduler.h"
 #include "kernel/synch.h"
+#include "kernel/timerwheel.h"
+#include "utility/trace.h"
 
 #define UNSIGNED_LONG_AT_ADDR(addr) (*((unsigned long int *) (addr)))
 
@@ -38,6 +41,12 @@
                // simulator stack, for detecting
                // stack overflows
 
+int8_t *Thread::stack_pool[STACK_POOL_SIZE];
+int Thread::stack_pool_size = 0;
+char *Thread::io_pool[IO_POOL_SIZE];
+int Thread::io_pool_size = 0;
+void *Thread::free_threads = NULL;
+
 //----------------------------------------------------------------------
 // Thread::Thread
 /*! 	Constructor. Initialize an empty thread (just a name)
@@ -52,6 +61,29 @@ Thread::Thread(char *threadName) {
 
   // No process owner yet
   process = NULL;
+
+  // User thread unless started by StartKernel
+  kernel_func = NULL;
+  kernel_arg = 0;
+
+  // Scheduling state
+  priority = 0;
+  level = 0;
+  blocked = false;
+  dispatch_time = 0;
+  ready_time = 0;
+  hart = -1;
+  trace_track = TRACE_TRACK(threadName);
+  inherited = MLFQ_LEVELS;
+  locks_held = 0;
+
+  // No I/O buffer until the first system call needing one
+  io_buffer = NULL;
+
+  // Not known by the user programs yet, nobody waits for the thread
+  object_id = -1;
+  finished = false;
+  join_queue = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -77,8 +109,7 @@ Thread::~Thread() {
   // the system at system shutdown time. It this situation, we do not
   // free the stack since we are still using it
   if (this != g_current_thread)
-    DeallocBoundedArray(simulator_context.stackBottom,
-                        simulator_context.stackSize);
+    FreeSimulatorStack(simulator_context.stackBottom);
 
   // NB: the thread stack itself is not freed, we do not attempt to
   // reuse the address space dedicated to stack The corresponding
@@ -98,6 +129,17 @@ Thread::~Thread() {
 
   g_machine->interrupt->SetStatus(oldLevel);
 
+  // Keep the I/O buffer for the next thread
+  if (io_buffer != NULL) {
+    if (io_pool_size < IO_POOL_SIZE)
+      io_pool[io_pool_size++] = io_buffer;
+    else
+      delete[] io_buffer;
+  }
+
+  // Woken up in Finish, the threads which joined are gone
+  delete join_queue;
+
   delete[] thread_name;
 }
 
@@ -112,8 +154,142 @@ Thread::~Thread() {
 int
 Thread::Start(Process *owner, int64_t func, int64_t arg) {
   ASSERT(process == NULL);
-  printf("**** Warning: method Thread::Start is not implemented yet\n");
-  exit(ERROR);
+
+  int8_t *stack = AllocSimulatorStack();
+
+  process = owner;
+
+  // User stack in the address space of the process
+  int64_t sp = process->addrspace->StackAllocate();
+  InitThreadContext(func, sp, arg);
+  InitSimulatorContext(stack, SIMULATORSTACKSIZE);
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  process->numThreads++;
+  g_alive->Append(this);
+  g_scheduler->ReadyToRun(this);
+  g_machine->interrupt->SetStatus(oldLevel);
+
+  return NO_ERROR;
+}
+
+//----------------------------------------------------------------------
+// Thread::operator new
+/*!  Allocate the object of a thread, reusing the object of a deleted
+//   thread if any, so that spawning threads does not call malloc.
+//
+// \param size size of the object
+*/
+//----------------------------------------------------------------------
+void *
+Thread::operator new(size_t size) {
+  ASSERT(size == sizeof(Thread));
+  if (free_threads == NULL)
+    return ::operator new(size);
+  void *ptr = free_threads;
+  free_threads = *(void **) ptr;
+  return ptr;
+}
+
+//----------------------------------------------------------------------
+// Thread::operator delete
+/*!  Keep the object of a deleted thread for the next allocation.
+//
+// \param ptr the object
+*/
+//----------------------------------------------------------------------
+void
+Thread::operator delete(void *ptr) {
+  *(void **) ptr = free_threads;
+  free_threads = ptr;
+}
+
+//----------------------------------------------------------------------
+// Thread::AllocSimulatorStack
+/*!  Allocate a simulator stack, taking the stack of a finished thread
+//   when one is available (it is still mapped and in the host caches).
+//
+// \return the lowest address of the stack
+*/
+//----------------------------------------------------------------------
+int8_t *
+Thread::AllocSimulatorStack() {
+  if (stack_pool_size > 0)
+    return stack_pool[--stack_pool_size];
+  return AllocBoundedArray(SIMULATORSTACKSIZE);
+}
+
+//----------------------------------------------------------------------
+// Thread::FreeSimulatorStack
+/*!  Keep the simulator stack of a finished thread in the pool, or give
+//   it back to the host if the pool is full.
+//
+// \param stack the lowest address of the stack
+*/
+//----------------------------------------------------------------------
+void
+Thread::FreeSimulatorStack(int8_t *stack) {
+  if (stack_pool_size < STACK_POOL_SIZE)
+    stack_pool[stack_pool_size++] = stack;
+  else
+    DeallocBoundedArray(stack, SIMULATORSTACKSIZE);
+}
+
+//----------------------------------------------------------------------
+// Thread::GetIOBuffer
+/*!  Return the kernel buffer of the thread used to move the data of
+//   its system calls, taking the buffer of a finished thread if one is
+//   available. Keeping it out of the simulator stack allows requests
+//   of any size, processed by chunks of IO_BUFFER_SIZE bytes.
+//
+// \return a buffer of IO_BUFFER_SIZE bytes
+*/
+//----------------------------------------------------------------------
+char *
+Thread::GetIOBuffer() {
+  if (io_buffer == NULL) {
+    if (io_pool_size > 0)
+      io_buffer = io_pool[--io_pool_size];
+    else
+      io_buffer = new char[IO_BUFFER_SIZE];
+  }
+  return io_buffer;
+}
+
+//----------------------------------------------------------------------
+// Thread::StartKernel
+/*!  Attach a kernel thread to a process context and prepare it to be
+//   dispatched on the CPU. The thread does not execute user code: it
+//   runs the host function func on its simulator stack, then finishes.
+//
+// \param owner process the thread belongs to (used for statistics)
+// \param func host function executed by the thread
+// \param arg argument given to func
+// \return NO_ERROR on success, an error code on error
+*/
+//----------------------------------------------------------------------
+int
+Thread::StartKernel(Process *owner, VoidFunctionPtr func, int64_t arg) {
+  ASSERT(process == NULL);
+  ASSERT(func != NULL);
+
+  int8_t *stack = AllocSimulatorStack();
+
+  process = owner;
+  kernel_func = func;
+  kernel_arg = arg;
+
+  // No user context: the registers are only saved and restored
+  InitThreadContext(0, 0, 0);
+  InitSimulatorContext(stack, SIMULATORSTACKSIZE);
+
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  process->numThreads++;
+  g_alive->Append(this);
+  g_scheduler->ReadyToRun(this);
+  g_machine->interrupt->SetStatus(oldLevel);
+
+  return NO_ERROR;
 }
 
 //----------------------------------------------------------------------
@@ -141,6 +317,12 @@ Thread::InitThreadContext(int64_t initialPCREG, int64_t initialSP,
 
   // Set the stack register
   thread_context.int_registers[STACK_REG] = initialSP;
+
+  // No floating point state until the first floating point instruction,
+  // no reservation until the first load-reserved
+  thread_context.fp_valid = false;
+  thread_context.reserved = false;
+  thread_context.reserved_addr = thread_context.reserved_value = 0;
 }
 
 //----------------------------------------------------------------------
@@ -160,7 +342,22 @@ ThreadPrint(long arg) {
 void
 StartThreadExecution(void) {
   printf("****  Starting thread\n");
+
+  // The thread switched from may have finished (see Scheduler::SwitchTo)
+  if (g_thread_to_be_destroyed != NULL) {
+    delete g_thread_to_be_destroyed;
+    g_thread_to_be_destroyed = NULL;
+  }
+
   g_machine->interrupt->SetStatus(INTERRUPTS_ON);
+
+  // Kernel threads run their host function instead of user code
+  if (g_current_thread->kernel_func != NULL) {
+    g_current_thread->kernel_func(g_current_thread->kernel_arg);
+    g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+    g_current_thread->Finish();
+  }
+
   g_machine->Run();
   // Should not return there ...
   ASSERT(0);
@@ -191,12 +388,17 @@ Thread::InitSimulatorContext(int8_t *base_stack_addr,
   // NB: the gcc implementation of makecontext
   //     interprets ss_sp as the stack BASE and not stack BOTTOM
   //     (may not be portable to other architectures/compilers)
+#ifdef HOST_FAST_SWITCH
+  simulator_context.sp =
+      InitHostStack(base_stack_addr, stack_size, StartThreadExecution);
+#else
   ASSERT(getcontext(&(simulator_context.buf)) == 0);
   simulator_context.buf.uc_stack.ss_sp = base_stack_addr;
   simulator_context.buf.uc_stack.ss_size = stack_size;
   simulator_context.buf.uc_stack.ss_flags = 0;
   simulator_context.buf.uc_link = NULL;
   makecontext(&simulator_context.buf, StartThreadExecution, 0);
+#endif
 
   // Setup kernel stack parameters for low-level context switch
   simulator_context.stackBottom = base_stack_addr;
@@ -209,14 +411,39 @@ Thread::InitSimulatorContext(int8_t *base_stack_addr,
 //----------------------------------------------------------------------
 // Thread::Join
 /*!
-//      Sleep the thread until another thread finishes.
+//      Sleep the thread until another thread finishes. The thread
+//      waits in the join queue of Idthread, woken up by its Finish,
+//      instead of polling it.
+//
+//      NOTE: once woken up, Idthread may already be deleted.
 //	\param Idthread thread to wait for
 //----------------------------------------------------------------------
 */
 void
 Thread::Join(Thread *Idthread) {
-  while (g_alive->Search(Idthread))
-    Yield();
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  if (!Idthread->finished) {
+    if (Idthread->join_queue == NULL)
+      Idthread->join_queue = new ListThread;
+    Idthread->join_queue->Append(this);
+    Sleep();
+  }
+  g_machine->interrupt->SetStatus(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Thread::SetPriority
+/*!     Set the base priority level of the thread, used by the
+//      multi-level feedback scheduler. The thread goes back to this
+//      level the next time it is put in the ready list after blocking.
+//
+//	\param p priority level, between 0 (highest) and MLFQ_LEVELS - 1
+*/
+//----------------------------------------------------------------------
+void
+Thread::SetPriority(int p) {
+  ASSERT(p >= 0 && p < MLFQ_LEVELS);
+  priority = p;
 }
 
 //----------------------------------------------------------------------
@@ -262,8 +489,46 @@ Thread::Finish() {
 
   DEBUG('t', (char *) "Finishing thread \"%s\"\n", GetName());
 
+  // The last thread of the process writes back its mapped files, and
+  // the pages of its shared memory segments other processes still use
+  if (process != NULL && process->numThreads == 1) {
+    process->addrspace->SyncMappedFiles();
+    process->addrspace->DetachSegments();
+  }
+
+  // The last user thread writes the dirty sectors while it can still
+  // wait for the disk, Nachos halts once it is gone (the kernel threads
+  // only wait for work)
+  bool last = true;
+  for (ListElement<Thread *> *e = g_alive->getFirst(); e != NULL;
+       e = e->next) {
+    Thread *other = (Thread *) e->item;
+    if (other != this && other->kernel_func == NULL)
+      last = false;
+  }
+  if (last) {
+    g_file_system->Sync();
+    g_buffer_cache->Flush();
+  }
 
-  printf("**** Warning: method Thread::Finish is not fully implemented yet\n");
+  g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  ASSERT(this == g_current_thread);
+
+  // The thread no longer exists for Join, and is deleted by the next
+  // thread to run. Its identifier goes away now so that it does not
+  // designate the object once reused by another thread
+  g_alive->RemoveItem(this);
+  if (object_id != -1)
+    g_object_addrs->RemoveObject(object_id);
+  finished = true;
+  g_thread_to_be_destroyed = this;
+
+  // Wake up the threads waiting for this one
+  if (join_queue != NULL) {
+    Thread *thread;
+    while ((thread = (Thread *) join_queue->Remove()) != NULL)
+      g_scheduler->ReadyToRun(thread);
+  }
 
   // Go to sleep
   Sleep();   // invokes SWITCH
@@ -283,9 +548,12 @@ Thread::Finish() {
 //	on the front of the ready list, and switching to it, can be done
 //	atomically.  On return, we re-set the interrupt level to its
 //	original state, in case we are called with interrupts disabled.
+//
+//	\return true if the CPU was given to another thread, false if
+//	the yield had no effect
 */
 //----------------------------------------------------------------------
-void
+bool
 Thread::Yield() {
   Thread *nextThread;
   IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
@@ -298,8 +566,10 @@ Thread::Yield() {
   if (nextThread != NULL) {
     g_scheduler->ReadyToRun(this);
     g_scheduler->SwitchTo(nextThread);
-  }
+  } else
+    g_stats->incrEmptyYields();
   (void) g_machine->interrupt->SetStatus(oldLevel);
+  return nextThread != NULL;
 }
 
 //----------------------------------------------------------------------
@@ -331,6 +601,9 @@ Thread::Sleep() {
 
   DEBUG('t', (char *) "Sleeping thread \"%s\"\n", GetName());
 
+  // Lets the scheduler know the thread blocked when it is woken up
+  blocked = true;
+
   // In case, there is nobody else to execute, we wait for an
   // interrupt In case there is no interrupt to come in the future,
   // Nachos exists
@@ -339,6 +612,10 @@ Thread::Sleep() {
   // set to the thread which is put to sleep, which is weird and
   // would need to be fixed
   while ((nextThread = g_scheduler->FindNextToRun()) == NULL) {
+    // Another hart has work: this one stays idle meanwhile, and the
+    // thread goes on once a hart dispatched it again
+    if (g_scheduler->IdleHart())
+      return;
     DEBUG('t', (char *) "Nobody to run => idle\n");
     g_machine->interrupt->Idle();   // no one to run, wait for an interrupt
   }
@@ -348,46 +625,111 @@ Thread::Sleep() {
 }
 
 //----------------------------------------------------------------------
-// Thread::SaveProcessorState
-/*!	Save the CPU state of a user program on a context switch
- */
+// WakeUpSleeper
+/*!	Handler of the kernel timer of a thread in SleepUntil.
+//
+//	\param arg the sleeping thread
+*/
+//----------------------------------------------------------------------
+static void
+WakeUpSleeper(int64_t arg) {
+  g_scheduler->ReadyToRun((Thread *) arg);
+}
+
+//----------------------------------------------------------------------
+// Thread::SleepUntil
+/*!	Put the thread to sleep until a given time, off the ready list:
+//	a kernel timer on its stack makes it ready again, at the first
+//	timer interrupt after the deadline.
+//
+//	\param when the deadline, in cycles
+*/
 //----------------------------------------------------------------------
 void
-Thread::SaveProcessorState() {
-  printf("**** Warning: method Thread::SaveProcessorState is not implemented "
-         "yet\n");
-  exit(ERROR);
+Thread::SleepUntil(Time when) {
+  ASSERT(this == g_current_thread);
+  if (when <= g_stats->getTotalTicks())
+    return;
+
+  KernelTimer timer;
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  g_timer_wheel->Add(&timer, when, WakeUpSleeper, (int64_t) this);
+  Sleep();
+  g_machine->interrupt->SetStatus(oldLevel);
 }
 
 //----------------------------------------------------------------------
-// Thread::RestoreProcessorState
-/*!	Restore the CPU state of a user program on a context switch.
+// Thread::SaveProcessorState
+/*!	Save the CPU state of a user program on a context switch.
+//	The floating point registers are only saved if the thread
+//	executed floating point instructions (Machine::fpUsed).
+//
+//	\param cpu the machine holding the registers
  */
 //----------------------------------------------------------------------
-
 void
-Thread::RestoreProcessorState() {
-  printf("**** Warning: method Thread::RestoreProcessorState is not "
-         "implemented yet\n");
-  exit(ERROR);
+Thread::SaveProcessorState(Machine *cpu) {
+  memcpy(thread_context.int_registers, cpu->int_registers,
+         sizeof(thread_context.int_registers));
+  thread_context.pc = cpu->pc;
+  thread_context.reserved = cpu->reserved;
+  thread_context.reserved_addr = cpu->reservedAddr;
+  thread_context.reserved_value = cpu->reservedValue;
+  if (cpu->fpUsed) {
+    memcpy(thread_context.float_registers, cpu->float_registers,
+           sizeof(thread_context.float_registers));
+    thread_context.fp_valid = true;
+  }
 }
 
 //----------------------------------------------------------------------
-// Thread::SaveSimulatorState
-/*!	Save the simulator state.
+// Thread::RestoreProcessorState
+/*!	Restore the CPU state of a user program on a context switch.
+//
+//	\param cpu the machine to load the registers into
  */
 //----------------------------------------------------------------------
+
 void
-Thread::SaveSimulatorState() {
-  getcontext(&(simulator_context.buf));
+Thread::RestoreProcessorState(Machine *cpu) {
+  memcpy(cpu->int_registers, thread_context.int_registers,
+         sizeof(thread_context.int_registers));
+  cpu->pc = thread_context.pc;
+
+  // The MMU translates the addresses of the process of the thread
+  if (process != NULL && process->addrspace != NULL)
+    cpu->mmu->translationTable = process->addrspace->translationTable;
+
+  if (thread_context.fp_valid)
+    memcpy(cpu->float_registers, thread_context.float_registers,
+           sizeof(thread_context.float_registers));
+
+  // Without a saved state, the floating point registers still hold
+  // the ones of another thread: they are cleared on first use
+  cpu->fpUsed = thread_context.fp_valid;
+
+  // The reservation set of the thread survives the switch: SC compares
+  // the memory with the value read by LR, so that a store of another
+  // thread meanwhile still makes it fail. Clearing it instead would
+  // fail every SC of a hart switched between its LR and its SC
+  cpu->reserved = thread_context.reserved;
+  cpu->reservedAddr = thread_context.reserved_addr;
+  cpu->reservedValue = thread_context.reserved_value;
 }
 
 //----------------------------------------------------------------------
-// Thread::RestoreSimulatorState
-/*!	Restore simulator state.
+// Thread::SwitchSimulatorState
+/*!	Save the simulator state of this thread, and restore the one
+//	of nextThread. Returns when this thread is switched to again.
+//
+//	\param nextThread the thread to resume
  */
 //----------------------------------------------------------------------
 void
-Thread::RestoreSimulatorState() {
-  setcontext(&(simulator_context.buf));
+Thread::SwitchSimulatorState(Thread *nextThread) {
+#ifdef HOST_FAST_SWITCH
+  SwitchHostStack(&simulator_context.sp, nextThread->simulator_context.sp);
+#else
+  swapcontext(&(simulator_context.buf), &(nextThread->simulator_context.buf));
+#endif
 }
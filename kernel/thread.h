@@ -42,6 +42,16 @@ class Thread;
 // Size of the simulator's execution stack
 #define SIMULATORSTACKSIZE (32 * 1024)   // in Bytes
 
+// Number of simulator stacks of finished threads kept for reuse
+#define STACK_POOL_SIZE 16
+
+// Size of the kernel buffer used by a thread to move the data of its
+// system calls, which are processed by chunks of this size
+#define IO_BUFFER_SIZE (4 * 1024)   // in Bytes
+
+// Number of I/O buffers of finished threads kept for reuse
+#define IO_POOL_SIZE 16
+
 // External function, dummy routine whose sole job is to call Thread::Print.
 extern void ThreadPrint(long arg);
 
@@ -51,7 +61,8 @@ class Process;
 /*! \brief Defines the context of the Nachos simulator
  */
 typedef struct {
-  ucontext_t buf;
+  ucontext_t buf;   //!< host context (ucontext switch)
+  void *sp;         //!< saved host stack pointer (HOST_FAST_SWITCH)
   int8_t *stackBottom;
   int stackSize;
 } simulatorContextT;
@@ -68,6 +79,15 @@ typedef struct {
 
   //! Program counter
   int64_t pc;
+
+  //! true if float_registers hold a saved state (the thread executed
+  //! floating point instructions)
+  bool fp_valid;
+
+  //! Reservation set of the last load-reserved of the thread
+  bool reserved;
+  uint64_t reserved_addr;
+  uint64_t reserved_value;
 } threadContextT;
 
 /*! \brief Data structures for managing threads
@@ -81,18 +101,33 @@ public:
   //! Deallocate a Thread.
   ~Thread();
 
+  //! Allocate a thread, reusing the object of a deleted thread if any
+  static void *operator new(size_t size);
+
+  //! Keep the object of a deleted thread for the next allocation
+  static void operator delete(void *ptr);
+
   //! Start a thread, attaching it to a process (return NoError on success)
   int Start(Process *owner, int64_t func, int64_t arg);
 
-  //! Wait for another thread to finish its execution
+  //! Start a kernel thread, running the host function func(arg) in the
+  //! context of a process instead of user code (return NoError on success)
+  int StartKernel(Process *owner, VoidFunctionPtr func, int64_t arg);
+
+  //! Wait for another thread to finish its execution, sleeping until
+  //! it calls Finish
   void Join(Thread *Idthread);
 
-  //! Relinquish the CPU if any other thread is runnable.
-  void Yield();
+  //! Relinquish the CPU if any other thread is runnable, false if
+  //! there was none
+  bool Yield();
 
   //! Put the thread to sleep and relinquish the processor
   void Sleep();
 
+  //! Put the thread to sleep until the time reaches when (in cycles)
+  void SleepUntil(Time when);
+
   //! Finish the execution of the thread, and prepare its deallocation
   void Finish();
 
@@ -108,20 +143,34 @@ public:
   //  before jumping to user code
   void InitThreadContext(int64_t initialPCREG, int64_t initialSP, int64_t arg);
 
-  //! Save the processor registers.
-  void SaveProcessorState();
+  //! Save the processor registers (of the CPU of a hart run by a
+  //! host thread, see Machine::RunParallel, if not g_machine).
+  void SaveProcessorState(Machine *cpu = g_machine);
 
   //! Restore the processor registers.
-  void RestoreProcessorState();
-
-  //! Save the state of the Nachos simulator.
-  void SaveSimulatorState();
+  void RestoreProcessorState(Machine *cpu = g_machine);
 
-  //! Restore Nachos simulator state.
-  void RestoreSimulatorState();
+  //! Save the state of the Nachos simulator and resume the one of
+  //! nextThread, returning when this thread is resumed.
+  void SwitchSimulatorState(Thread *nextThread);
 
   char *GetName() { return (thread_name); }
   Process *GetProcessOwner() { return process; }
+  uint16_t GetTraceTrack() { return trace_track; }
+
+  //! Identifier of the thread in g_object_addrs, removed when the
+  //! thread finishes (-1 if the thread has none)
+  int32_t GetObjectId() { return object_id; }
+  void SetObjectId(int32_t id) { object_id = id; }
+
+  //! Kernel buffer of IO_BUFFER_SIZE bytes for the system calls of the
+  //! thread, allocated on first use
+  char *GetIOBuffer();
+
+  //! Base priority level of the thread (0 is the highest, used by the
+  //! multi-level feedback scheduler)
+  int GetPriority() { return priority; }
+  void SetPriority(int p);
 
 protected:
   //! Thread name (for debugging)
@@ -136,6 +185,81 @@ protected:
   //! Thread context
   threadContextT thread_context;
 
+  //! Host function run by a kernel thread (NULL for user threads)
+  VoidFunctionPtr kernel_func;
+
+  //! Argument of the kernel function
+  int64_t kernel_arg;
+
+  friend void StartThreadExecution(void);
+
+  //! Base priority level (multi-level feedback scheduler)
+  int priority;
+
+  //! Current priority level, between priority and MLFQ_LEVELS - 1
+  int level;
+
+  //! true if the thread went to sleep (blocked) and was not woken up yet
+  bool blocked;
+
+  //! Time at which the thread was last given the CPU
+  Time dispatch_time;
+
+  //! Time at which the thread was last put in a ready queue
+  Time ready_time;
+
+  //! Hart the thread runs on, or whose ready queue it is in (-1 until
+  //! it is first made ready)
+  int hart;
+
+  //! Track of the thread in the event trace
+  uint16_t trace_track;
+
+  //! Highest priority level lent by the threads waiting for a lock held
+  //! by this thread (MLFQ_LEVELS when none)
+  int inherited;
+
+  //! Number of locks held by the thread
+  int locks_held;
+
+  //! I/O buffer of the thread (NULL until GetIOBuffer is called)
+  char *io_buffer;
+
+  //! Identifier of the thread in g_object_addrs, -1 if none
+  int32_t object_id;
+
+  //! true once the thread called Finish
+  bool finished;
+
+  //! Threads sleeping in Join until this one finishes (NULL until the
+  //! first Join)
+  ListThread *join_queue;
+
+  friend class Scheduler;
+  friend class Lock;
+
+private:
+  //! Simulator stack, reused from a finished thread if possible
+  static int8_t *AllocSimulatorStack();
+
+  //! Keep the simulator stack of a finished thread for reuse
+  static void FreeSimulatorStack(int8_t *stack);
+
+  //! Simulator stacks of finished threads
+  static int8_t *stack_pool[STACK_POOL_SIZE];
+
+  //! Number of stacks in stack_pool
+  static int stack_pool_size;
+
+  //! I/O buffers of finished threads
+  static char *io_pool[IO_POOL_SIZE];
+
+  //! Number of buffers in io_pool
+  static int io_pool_size;
+
+  //! Objects of deleted threads, linked through their first word
+  static void *free_threads;
+
 public:
   //! signature to make sure the thread is in the correct state
   ObjectType type;
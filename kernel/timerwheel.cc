@@ -0,0 +1,202 @@
+/*! \file timerwheel.cc
+//  \brief Routines of the kernel timers
+//
+//      The wheel is a classic hierarchical timing wheel: a timer goes
+//      in the level whose slots are just long enough to reach its
+//      deadline, and moves to the lower levels each time the wheel
+//      reaches its slot, at most WHEEL_LEVELS - 1 times. The wheel is
+//      only advanced by the timer interrupt handler, and every routine
+//      has to be called with interrupts disabled.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "kernel/timerwheel.h"
+#include "kernel/system.h"
+#include "machine/machine.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+
+//----------------------------------------------------------------------
+// TimerWheel::TimerWheel
+/*!	Build an empty wheel. A tick of the wheel is a time slice of the
+//	hardware timer, which advances the wheel on each of its
+//	interrupts.
+*/
+//----------------------------------------------------------------------
+TimerWheel::TimerWheel() {
+  for (int level = 0; level < WHEEL_LEVELS; level++)
+    for (int i = 0; i < WHEEL_SLOTS; i++)
+      slots[level][i] = NULL;
+  tickLength = nano_to_cycles(g_cfg->Quantum, g_cfg->ProcessorFrequency);
+  if (tickLength == 0)
+    tickLength = 1;
+  current = g_stats->getTotalTicks() / tickLength;
+  numTimers = 0;
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Add
+/*!	Arm a timer, and start the hardware timer if it is stopped. The
+//	handler is called by the timer interrupt following the deadline,
+//	so at most a time slice late.
+//
+//	\param timer the timer, not armed
+//	\param when the deadline, in cycles
+//	\param handler the function called once the deadline is reached
+//	\param arg the argument of the handler
+*/
+//----------------------------------------------------------------------
+void
+TimerWheel::Add(KernelTimer *timer, Time when, VoidFunctionPtr handler,
+                int64_t arg) {
+  ASSERT(g_machine->interrupt->GetStatus() == INTERRUPTS_OFF);
+  timer->when = when;
+  timer->expires = divRoundUp(when, tickLength);
+  timer->handler = handler;
+  timer->arg = arg;
+  timer->armed = true;
+  Insert(timer);
+  numTimers++;
+
+  StartTimer();
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Cancel
+/*!	Disarm a timer, nothing is done if it already expired.
+//
+//	\param timer the timer
+*/
+//----------------------------------------------------------------------
+void
+TimerWheel::Cancel(KernelTimer *timer) {
+  ASSERT(g_machine->interrupt->GetStatus() == INTERRUPTS_OFF);
+  if (!timer->armed)
+    return;
+  Unlink(timer);
+  timer->armed = false;
+  numTimers--;
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Advance
+/*!	Process the ticks of the wheel up to the current time, calling
+//	the handlers of the timers which expire. When the wheel is empty,
+//	it jumps directly to the current tick.
+//
+//	\param now the current time, in cycles
+*/
+//----------------------------------------------------------------------
+void
+TimerWheel::Advance(Time now) {
+  uint64_t target = now / tickLength;
+
+  while (numTimers > 0 && current <= target) {
+    int index = current & WHEEL_MASK;
+
+    // The level 0 wrapped around: bring the timers of the next slots
+    // of the upper levels
+    if (index == 0)
+      for (int level = 1; level < WHEEL_LEVELS && Cascade(level) == 0; level++)
+        ;
+
+    KernelTimer *timer;
+    while ((timer = slots[0][index]) != NULL) {
+      Unlink(timer);
+      timer->armed = false;
+      numTimers--;
+      (*timer->handler)(timer->arg);
+    }
+    current++;
+  }
+  if (current <= target)
+    current = target + 1;
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Insert
+/*!	Put a timer in the slot of its deadline: in level n if it expires
+//	in less than WHEEL_SLOTS^(n + 1) ticks. A timer expiring later than
+//	the wheel reaches goes in the last slot of the wheel, and is put
+//	again in the right slot when it cascades.
+//
+//	\param timer the timer
+*/
+//----------------------------------------------------------------------
+void
+TimerWheel::Insert(KernelTimer *timer) {
+  uint64_t expires = timer->expires;
+  if (expires < current)
+    expires = current;   // overdue: expires with the next tick
+  uint64_t delta = expires - current;
+  if (delta >= WHEEL_SPAN) {
+    delta = WHEEL_SPAN - 1;
+    expires = current + delta;
+  }
+
+  int level = 0;
+  while (delta >= ((uint64_t) 1 << (WHEEL_BITS * (level + 1))))
+    level++;
+
+  KernelTimer **head =
+      &slots[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+  timer->slot = head;
+  timer->prev = NULL;
+  timer->next = *head;
+  if (*head != NULL)
+    (*head)->prev = timer;
+  *head = timer;
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Unlink
+/*!	Remove a timer from the list of its slot.
+//
+//	\param timer the timer
+*/
+//----------------------------------------------------------------------
+void
+TimerWheel::Unlink(KernelTimer *timer) {
+  if (timer->prev != NULL)
+    timer->prev->next = timer->next;
+  else
+    *timer->slot = timer->next;
+  if (timer->next != NULL)
+    timer->next->prev = timer->prev;
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Cascade
+/*!	Spread the timers of the current slot of a level over the lower
+//	levels, which they now fit in.
+//
+//	\param level the level, from 1
+//	\return the index of the slot, the next level cascades when it
+//	is 0
+*/
+//----------------------------------------------------------------------
+int
+TimerWheel::Cascade(int level) {
+  int index = (current >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  KernelTimer *timer = slots[level][index];
+  slots[level][index] = NULL;
+  while (timer != NULL) {
+    KernelTimer *next = timer->next;
+    Insert(timer);
+    timer = next;
+  }
+  return index;
+}
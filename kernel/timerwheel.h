@@ -0,0 +1,108 @@
+/*! \file timerwheel.h
+    \brief Data structures for the kernel timers
+
+        A kernel timer calls a function once the simulated time reaches
+        its deadline: it wakes up a thread sleeping in SC_SLEEP, and can
+        bound any other wait of the kernel. The armed timers are kept in
+        a hierarchical timer wheel, driven by the interrupts of the
+        hardware timer (see TimerInterruptHandler), so that arming,
+        cancelling and expiring a timer take constant time whatever the
+        number of timers.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "kernel/copyright.h"
+#include "utility/utility.h"
+
+//! Number of levels of the wheel
+#define WHEEL_LEVELS 4
+
+//! Each level has 2^WHEEL_BITS slots, a slot of a level spanning the
+//! whole previous level
+#define WHEEL_BITS  6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK  (WHEEL_SLOTS - 1)
+
+//! Ticks covered by the wheel: the timers expiring later wait in the
+//! last level, and are placed again when it cascades
+#define WHEEL_SPAN ((uint64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+/*! \brief Defines a kernel timer
+//
+// The timer is embedded in the data of its user (the stack of a
+// sleeping thread for instance), the wheel only links it.
+*/
+struct KernelTimer {
+  Time when;                 //!< Deadline, in cycles
+  uint64_t expires;          //!< Deadline, in ticks of the wheel
+  VoidFunctionPtr handler;   //!< Called with interrupts disabled
+  int64_t arg;               //!< Argument of the handler
+  bool armed;                //!< The timer is in the wheel
+  KernelTimer **slot;        //!< Head of the list of its slot
+  KernelTimer *next;         //!< Next timer of the slot
+  KernelTimer *prev;         //!< Previous timer of the slot
+};
+
+/*! \brief Defines the wheel of the armed kernel timers
+//
+// The level 0 holds the timers expiring in the next WHEEL_SLOTS ticks,
+// one slot per tick. Each slot of level n holds the timers of
+// WHEEL_SLOTS^n ticks, which are spread over level n - 1 (cascade)
+// when the wheel reaches them. A tick of the wheel is a time slice of
+// the hardware timer.
+*/
+class TimerWheel {
+public:
+  //! Build an empty wheel, starting at the current time
+  TimerWheel();
+
+  //! Arm a timer to call handler(arg) once the time reaches when
+  void Add(KernelTimer *timer, Time when, VoidFunctionPtr handler,
+           int64_t arg);
+
+  //! Disarm a timer if it did not expire yet
+  void Cancel(KernelTimer *timer);
+
+  //! Expire the timers whose deadline is before now
+  void Advance(Time now);
+
+  //! true if no timer is armed
+  bool IsEmpty() { return numTimers == 0; }
+
+private:
+  //! Put a timer in the slot of its deadline
+  void Insert(KernelTimer *timer);
+
+  //! Unlink a timer from its slot
+  void Unlink(KernelTimer *timer);
+
+  //! Move the timers of a slot of a level to the lower levels
+  int Cascade(int level);
+
+  //! Heads of the lists of timers of the slots
+  KernelTimer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+
+  uint64_t current;   //!< Next tick to be processed
+  Time tickLength;    //!< Length of a tick, in cycles
+  int numTimers;      //!< Number of armed timers
+};
+
+#endif   // TIMERWHEEL_H
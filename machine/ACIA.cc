@@ -145,3 +145,46 @@ ACIA::PutChar(char c) {
   // Cause the char forwading.
   sysdep->SendChar();
 };
+
+//-------------------------------------------------------------------------
+// ACIA::PutBytes
+/** Queue bytes for transmission in the FRAMED mode. The bytes are
+ * coalesced into frames and sent once the sliding window allows it.
+ \param data: the bytes to send
+ \param len: the number of bytes to send
+ \param port: the port to send them through
+ \return the number of bytes accepted (less than len when the
+ * transmit buffer is full)
+*/
+//-------------------------------------------------------------------------
+int
+ACIA::PutBytes(char *data, int len, int port) {
+  return sysdep->PutBytes(port, data, len);
+};
+
+//-------------------------------------------------------------------------
+// ACIA::GetMessage
+/** Take the oldest complete message out of the FRAMED mode receive
+ * buffer.
+ \param data: where to copy the message (without its '\0')
+ \param len: the room available in data
+ \param port: the port it was received on
+ \return the number of bytes copied, -1 if no complete message has
+ * been received yet
+*/
+//-------------------------------------------------------------------------
+int
+ACIA::GetMessage(char *data, int len, int port) {
+  return sysdep->GetMessage(port, data, len);
+};
+
+//-------------------------------------------------------------------------
+// ACIA::NumPorts
+/** Get the number of ports of the ACIA.
+ \return the number of ports
+*/
+//-------------------------------------------------------------------------
+int
+ACIA::NumPorts() {
+  return sysdep->NumPorts();
+};
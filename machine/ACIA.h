@@ -48,6 +48,7 @@ enum RegStatus { EMPTY, FULL };
 #define BUSY_WAITING   0   //!< Indicate that no ACIA interrupts are allowed.
 #define REC_INTERRUPT  1   //!< Indicate that reception interrupts are allowed.
 #define SEND_INTERRUPT 2   //!< Indicates that send interrupts are allowed.
+#define FRAMED         4   //!< Indicates that bytes go in acknowledged frames.
 
 /*! \brief Defines an ACIA (Asynchronous Communication Interface
   Adapter) device. An ACIA is an asynchronous
@@ -114,6 +115,32 @@ public:
   */
   void PutChar(char);
 
+  /** Queue bytes for transmission in the FRAMED mode. The bytes are
+   * coalesced into frames and sent once the sliding window allows it.
+   \param data: the bytes to send
+   \param len: the number of bytes to send
+   \param port: the port to send them through
+   \return the number of bytes accepted (less than len when the
+   * transmit buffer is full)
+  */
+  int PutBytes(char *data, int len, int port = 0);
+
+  /** Take the oldest complete message, i.e. the bytes up to and
+   * including the next '\0', out of the FRAMED mode receive buffer.
+   * Bytes beyond len are discarded.
+   \param data: where to copy the message (without its '\0')
+   \param len: the room available in data
+   \param port: the port it was received on
+   \return the number of bytes copied, -1 if no complete message has
+   * been received yet
+  */
+  int GetMessage(char *data, int len, int port = 0);
+
+  /** Get the number of ports of the ACIA, each one linked to its own
+   * peer (FRAMED mode only, the other modes use port 0).
+  */
+  int NumPorts();
+
 private:
   //! Output data register (filled-in by method PutChar)
   char outputRegister;
@@ -132,6 +159,7 @@ private:
     of the ACIA, using UDP sockets.  It will be able to write on
     the registers of an object from the class ACIA.  */
   friend class ACIA_sysdep;
+  friend class AciaPort;
   ACIA_sysdep *sysdep;
 };
 
@@ -30,6 +30,7 @@
 
 #include "ACIA_sysdep.h"
 #include "drivers/drvACIA.h"
+#include "machine/aciaswitch.h"
 #include "utility/stats.h"
 #include <strings.h>
 
@@ -46,6 +47,18 @@ DummyInterruptEm(int64_t arg) {
   ACIA_s->InterruptEm();
 }
 
+static void
+DummySendFrames(int64_t arg) {
+  AciaPort *port = (AciaPort *) arg;
+  port->SendFrames();
+}
+
+static void
+DummyRetransmit(int64_t arg) {
+  AciaPort *port = (AciaPort *) arg;
+  port->Retransmit();
+}
+
 //------------------------------------------------------------------------
 /** Initializes a system dependent part of the ACIA.
  * \param interface: the non-system dependent part of the Acia simulation (ACIA)
@@ -56,23 +69,119 @@ ACIA_sysdep::ACIA_sysdep(ACIA *iface, Machine *m) {
   // 'interface' is a pointer to the associated ACIA object.
   interface = iface;
 
-  // Open a socket and assign a name to it.
-  sock = OpenSocket();
-  AssignNameToSocket(g_cfg->TargetMachineName, sock);
+  // Attach to the switch, or open a socket per port.
+  aciaSwitch = NULL;
+  if (g_cfg->AciaTransport == ACIA_TRANSPORT_SWITCH)
+    aciaSwitch = new AciaSwitch(g_cfg->AciaSwitch, g_cfg->AciaNode,
+                                g_cfg->AciaPorts, g_cfg->EventInput);
+  numPorts = g_cfg->AciaPorts;
+  ports = new AciaPort *[numPorts];
+  for (int p = 0; p < numPorts; p++)
+    ports[p] = new AciaPort(this, p);
+
+  // Start checking for incoming char (the interrupt simulation watches
+  // the sockets, or the doorbell of the switch, in EventInput mode).
+  if (g_cfg->EventInput && aciaSwitch != NULL)
+    m->interrupt->WatchInput(aciaSwitch->Doorbell(), DummyInterruptRec,
+                             (int64_t) this, ACIA_RECEIVE_INT);
+  else if (g_cfg->EventInput)
+    for (int p = 0; p < numPorts; p++)
+      m->interrupt->WatchInput(ports[p]->sock, DummyInterruptRec,
+                               (int64_t) this, ACIA_RECEIVE_INT);
+  else
+    m->interrupt->Schedule(
+        DummyInterruptRec, (int64_t) this,
+        nano_to_cycles(CHECK_TIME, g_cfg->ProcessorFrequency),
+        ACIA_RECEIVE_INT);
+};
+
+//------------------------------------------------------------------------
+/** Deallocates it and close the sockets. */
+//------------------------------------------------------------------------
+ACIA_sysdep::~ACIA_sysdep() {
+  for (int p = 0; p < numPorts; p++) {
+    if (g_cfg->EventInput && aciaSwitch == NULL)
+      g_machine->interrupt->UnwatchInput(ports[p]->sock);
+    delete ports[p];
+  }
+  delete[] ports;
+  if (aciaSwitch != NULL) {
+    if (g_cfg->EventInput)
+      g_machine->interrupt->UnwatchInput(aciaSwitch->Doorbell());
+    delete aciaSwitch;
+  }
+};
+
+//------------------------------------------------------------------------
+/** Initializes a port of the ACIA.
+ * \param sys: the system dependent part of the ACIA
+ * \param num: the number of the port
+ */
+//------------------------------------------------------------------------
+AciaPort::AciaPort(ACIA_sysdep *sys, int num) {
+  sysdep = sys;
+  number = num;
 
-  bcopy(g_cfg->TargetMachineName, sockName,
-        strlen(g_cfg->TargetMachineName) + 1);
+  // Open a socket and assign a name to it, unless on the switch.
+  sock = -1;
+  if (sysdep->aciaSwitch == NULL) {
+    sock = OpenSocket();
+    AssignNameToSocket(g_cfg->TargetMachineName, sock,
+                       g_cfg->NumPortLoc + number);
+    strcpy(sockName, g_cfg->TargetMachineName);
+  }
 
-  // Start checking for incoming char.
-  m->interrupt->Schedule(DummyInterruptRec, (int64_t) this,
-                         nano_to_cycles(CHECK_TIME, g_cfg->ProcessorFrequency),
-                         ACIA_RECEIVE_INT);
+  // Buffers of the FRAMED mode.
+  txRing = new char[ACIA_RING_SIZE];
+  txBase = txNext = txEnd = 0;
+  sndBase = sndNext = 0;
+  sendPending = false;
+  retransmitPending = false;
+  retransmitBase = 0;
+  rxRing = new char[ACIA_RING_SIZE];
+  rxHead = 0;
+  rxCount = 0;
+  rcvNext = 0;
+};
+
+//------------------------------------------------------------------------
+/** Deallocates it and close its socket. */
+//------------------------------------------------------------------------
+AciaPort::~AciaPort() {
+  if (sock >= 0)
+    CloseSocket(sock);
+  delete[] txRing;
+  delete[] rxRing;
+};
+
+//------------------------------------------------------------------------
+/** Send a datagram to the peer of the port, through its socket or the
+ * switch. As with UDP, a datagram the switch has no room for is lost.
+ * \param data: the datagram
+ * \param len: its length
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::SendDatagram(char *data, int len) {
+  if (sock >= 0)
+    SendToSocket(sock, data, len, sockName, g_cfg->NumPortDist + number);
+  else
+    (void) sysdep->aciaSwitch->Send(number, data, len);
 };
 
 //------------------------------------------------------------------------
-/** Deallocates it and close the socket. */
+/** Read a datagram from the peer of the port, without waiting.
+ * \param data: where to copy the datagram
+ * \param size: the room available in data
+ * \return the length of the datagram, -1 if there is none
+ */
 //------------------------------------------------------------------------
-ACIA_sysdep::~ACIA_sysdep() { CloseSocket(sock); };
+int
+AciaPort::ReceiveDatagram(char *data, int size) {
+  if (sock >= 0)
+    return ReadFromSocket(sock, data, size);
+  return sysdep->aciaSwitch->Receive(number, data, size);
+};
 
 //------------------------------------------------------------------------
 /** Check if there is an incoming char.
@@ -89,13 +198,23 @@ ACIA_sysdep::InterruptRec() {
   int received;
 
   // Schedule a interrupt for next polling.
-  g_machine->interrupt->Schedule(
-      DummyInterruptRec, (int64_t) this,
-      nano_to_cycles(CHECK_TIME, g_cfg->ProcessorFrequency), ACIA_RECEIVE_INT);
+  if (!g_cfg->EventInput)
+    g_machine->interrupt->Schedule(
+        DummyInterruptRec, (int64_t) this,
+        nano_to_cycles(CHECK_TIME, g_cfg->ProcessorFrequency),
+        ACIA_RECEIVE_INT);
+
+  if ((interface->mode & FRAMED) != 0) {
+    if (aciaSwitch != NULL && aciaSwitch->Doorbell() >= 0)
+      aciaSwitch->ClearDoorbell();
+    for (int p = 0; p < numPorts; p++)
+      ports[p]->ReceiveFrames();
+    return;
+  }
 
   // Check if a char had been threw through the socket
   // Try to read a char from the socket.
-  received = ReadFromSocket(sock, &(interface->inputRegister), 1);
+  received = ports[0]->ReceiveDatagram(&(interface->inputRegister), 1);
 
   // If this operation successed...
   if (received != -1) {
@@ -117,7 +236,7 @@ ACIA_sysdep::InterruptRec() {
 void
 ACIA_sysdep::InterruptEm() {
   // Send the char.
-  SendToSocket(sock, &(interface->outputRegister), 1, sockName);
+  ports[0]->SendDatagram(&(interface->outputRegister), 1);
   // Drain the output register.
   interface->outputRegister = 0;
   interface->outputStateRegister = EMPTY;
@@ -150,3 +269,216 @@ ACIA_sysdep::Drain() {
   interface->inputRegister = 0;
   interface->inputStateRegister = EMPTY;
 };
+
+//------------------------------------------------------------------------
+/** Queue bytes in the transmit buffer (FRAMED mode) and schedule
+ * their emission. The emission is delayed by SEND_TIME so that the
+ * bytes queued in the meantime travel in the same frame.
+ * \param data: the bytes to send
+ * \param len: the number of bytes to send
+ * \return the number of bytes accepted.
+ */
+//------------------------------------------------------------------------
+int
+AciaPort::PutBytes(char *data, int len) {
+  int room = ACIA_RING_SIZE - (int) (txEnd - txBase);
+  if (len > room)
+    len = room;
+  for (int i = 0; i < len; i++)
+    txRing[(txEnd + i) % ACIA_RING_SIZE] = data[i];
+  txEnd += len;
+  if (len > 0)
+    ScheduleSend();
+  return len;
+};
+
+//------------------------------------------------------------------------
+/** Take a complete message out of the receive buffer (FRAMED mode).
+ * A message ends with a '\0', or fills the whole buffer. The bytes
+ * that do not fit in data are discarded.
+ * \param data: where to copy the message (without its '\0')
+ * \param len: the room available in data
+ * \return the number of bytes copied, -1 if there is no complete
+ * message yet.
+ */
+//------------------------------------------------------------------------
+int
+AciaPort::GetMessage(char *data, int len) {
+  int size;
+  for (size = 0; size < rxCount; size++)
+    if (rxRing[(rxHead + size) % ACIA_RING_SIZE] == '\0')
+      break;
+  if (size == rxCount && rxCount < ACIA_RING_SIZE)
+    return -1;
+
+  int copied = (size < len) ? size : len;
+  for (int i = 0; i < copied; i++)
+    data[i] = rxRing[(rxHead + i) % ACIA_RING_SIZE];
+
+  // Consume the message and its terminator.
+  int consumed = (size < rxCount) ? size + 1 : size;
+  rxHead = (rxHead + consumed) % ACIA_RING_SIZE;
+  rxCount -= consumed;
+  return copied;
+};
+
+//------------------------------------------------------------------------
+/** Send as many frames of queued bytes as the window allows, each one
+ * carrying up to ACIA_MTU bytes, and arm the retransmission timer.
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::SendFrames() {
+  sendPending = false;
+  while ((uint16_t) (sndNext - sndBase) < ACIA_WINDOW && txNext != txEnd) {
+    int len = (int) (txEnd - txNext);
+    if (len > ACIA_MTU)
+      len = ACIA_MTU;
+    frameLen[sndNext % ACIA_WINDOW] = len;
+    SendFrame(sndNext, txNext, len);
+    txNext += len;
+    sndNext++;
+  }
+  ArmRetransmit();
+};
+
+//------------------------------------------------------------------------
+/** Send again the unacknowledged frames (go-back-N) if none was
+ * acknowledged since the timer was armed. The frames keep the bounds
+ * they were first sent with, so that a frame received twice is always
+ * recognized by its sequence number.
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::Retransmit() {
+  retransmitPending = false;
+  if (sndNext != sndBase && sndBase == retransmitBase) {
+    uint32_t pos = txBase;
+    for (uint16_t seq = sndBase; seq != sndNext; seq++) {
+      SendFrame(seq, pos, frameLen[seq % ACIA_WINDOW]);
+      pos += frameLen[seq % ACIA_WINDOW];
+    }
+  }
+  ArmRetransmit();
+};
+
+//------------------------------------------------------------------------
+/** Read every pending datagram (FRAMED mode). In-order data frames
+ * are appended to the receive buffer when there is room for them, and
+ * every data frame is answered with a cumulative acknowledgement.
+ * Then, in Interrupt mode, execute the handlers.
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::ReceiveFrames() {
+  char frame[ACIA_FRAME_SIZE];
+  int received;
+  bool gotData = false;
+  uint16_t oldBase = sndBase;
+
+  while ((received = ReceiveDatagram(frame, ACIA_FRAME_SIZE)) != -1) {
+    if (received < ACIA_HEADER_SIZE)
+      continue;
+    uint16_t seq = (uint8_t) frame[1] | ((uint8_t) frame[2] << 8);
+    if (frame[0] == ACIA_FRAME_ACK) {
+      AckReceived(seq);
+    } else if (frame[0] == ACIA_FRAME_DATA) {
+      int len = received - ACIA_HEADER_SIZE;
+      if (seq == rcvNext && len <= ACIA_RING_SIZE - rxCount) {
+        for (int i = 0; i < len; i++)
+          rxRing[(rxHead + rxCount + i) % ACIA_RING_SIZE] =
+              frame[ACIA_HEADER_SIZE + i];
+        rxCount += len;
+        rcvNext++;
+        gotData = true;
+      }
+      SendAck();
+    }
+  }
+
+  int mode = sysdep->interface->mode;
+  if (gotData && (mode & REC_INTERRUPT) != 0)
+    g_acia_driver->InterruptReceive(number);
+  if (sndBase != oldBase && (mode & SEND_INTERRUPT) != 0)
+    g_acia_driver->InterruptSend(number);
+};
+
+//------------------------------------------------------------------------
+/** Slide the window up to the frame the peer expects next, freeing
+ * the acknowledged bytes.
+ * \param ack: the next frame expected by the peer
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::AckReceived(uint16_t ack) {
+  uint16_t acked = ack - sndBase;
+  if (acked == 0 || acked > (uint16_t) (sndNext - sndBase))
+    return;
+  while (sndBase != ack) {
+    txBase += frameLen[sndBase % ACIA_WINDOW];
+    sndBase++;
+  }
+  if (txNext != txEnd)
+    ScheduleSend();
+};
+
+//------------------------------------------------------------------------
+/** Send one data frame.
+ * \param seq: sequence number of the frame
+ * \param pos: position of its first byte in the transmit buffer
+ * \param len: number of payload bytes
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::SendFrame(uint16_t seq, uint32_t pos, int len) {
+  char frame[ACIA_FRAME_SIZE];
+  frame[0] = ACIA_FRAME_DATA;
+  frame[1] = seq & 0xff;
+  frame[2] = seq >> 8;
+  for (int i = 0; i < len; i++)
+    frame[ACIA_HEADER_SIZE + i] = txRing[(pos + i) % ACIA_RING_SIZE];
+  SendDatagram(frame, ACIA_HEADER_SIZE + len);
+};
+
+//------------------------------------------------------------------------
+/** Acknowledge every frame received in order so far.
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::SendAck() {
+  char frame[ACIA_HEADER_SIZE];
+  frame[0] = ACIA_FRAME_ACK;
+  frame[1] = rcvNext & 0xff;
+  frame[2] = rcvNext >> 8;
+  SendDatagram(frame, ACIA_HEADER_SIZE);
+};
+
+//------------------------------------------------------------------------
+/** Schedule a SendFrames, unless one is already pending.
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::ScheduleSend() {
+  if (sendPending)
+    return;
+  sendPending = true;
+  g_machine->interrupt->Schedule(
+      DummySendFrames, (int64_t) this,
+      nano_to_cycles(SEND_TIME, g_cfg->ProcessorFrequency), ACIA_SEND_INT);
+};
+
+//------------------------------------------------------------------------
+/** Arm the retransmission timer while frames are in flight.
+ */
+//------------------------------------------------------------------------
+void
+AciaPort::ArmRetransmit() {
+  if (retransmitPending || sndNext == sndBase)
+    return;
+  retransmitPending = true;
+  retransmitBase = sndBase;
+  g_machine->interrupt->Schedule(
+      DummyRetransmit, (int64_t) this,
+      nano_to_cycles(RETRANSMIT_TIME, g_cfg->ProcessorFrequency),
+      ACIA_SEND_INT);
+};
@@ -35,13 +35,109 @@
 
 // Forward declaration
 class ACIA;
+class ACIA_sysdep;
+class AciaSwitch;
+
+/* In the FRAMED mode, bytes are coalesced into datagrams made of a
+   header (a frame type and a 16-bit sequence number) followed by up to
+   ACIA_MTU bytes of payload. Data frames are acknowledged cumulatively
+   and at most ACIA_WINDOW of them are left unacknowledged. */
+#define ACIA_FRAME_SIZE  1400   //!< Largest datagram sent in the FRAMED mode
+#define ACIA_HEADER_SIZE 3      //!< Frame type and sequence number
+#define ACIA_MTU         (ACIA_FRAME_SIZE - ACIA_HEADER_SIZE)
+#define ACIA_WINDOW      8       //!< Frames sent and not yet acknowledged
+#define ACIA_RING_SIZE   16384   //!< Transmit and receive buffers (power of 2)
+
+#define ACIA_FRAME_DATA 'D'   //!< Frame carrying payload bytes
+#define ACIA_FRAME_ACK  'A'   //!< Frame giving the next expected sequence
+
+/*! \brief This class is used to simulate a port of the ACIA, linked to
+    a peer of its own.
+
+    In the FRAMED mode, every port has its own buffers, sliding window
+    and sequence numbers. Its frames travel in UDP datagrams, from
+    NumPortLoc + p to NumPortDist + p of TargetMachineName for port p,
+    or through the switch shared by the Nachos of the host, port p
+    being linked to node p (g_cfg->AciaTransport).
+ */
+class AciaPort {
+public:
+  /** Initializes port number of the system dependent part sysdep. */
+  AciaPort(ACIA_sysdep *sysdep, int number);
+
+  /** Deallocates it and close its socket. */
+  ~AciaPort();
+
+  /** Queue bytes in the transmit buffer (FRAMED mode) and schedule
+   * their emission.
+   * \return the number of bytes accepted.
+   */
+  int PutBytes(char *data, int len);
+
+  /** Take a complete message out of the receive buffer (FRAMED mode).
+   * \return the number of bytes copied, -1 if there is none yet.
+   */
+  int GetMessage(char *data, int len);
+
+  /** Send as many frames of queued bytes as the window allows. */
+  void SendFrames();
+
+  /** Send again the unacknowledged frames if none was acknowledged
+   * since the timer was armed.
+   */
+  void Retransmit();
+
+  /** Read every pending frame, then execute the handlers. */
+  void ReceiveFrames();
+
+  /** Send a datagram to the peer. */
+  void SendDatagram(char *data, int len);
+
+  /** Read a datagram from the peer, -1 if there is none. */
+  int ReceiveDatagram(char *data, int size);
+
+  int sock;   //!< UNIX socket of the port, -1 on the switch
+
+private:
+  void AckReceived(uint16_t ack);
+  void SendFrame(uint16_t seq, uint32_t pos, int len);
+  void SendAck();
+  void ScheduleSend();
+  void ArmRetransmit();
+
+  ACIA_sysdep *sysdep;        //!< System dependent part of the ACIA
+  int number;                 //!< Number of the port
+  char sockName[MAXSTRLEN];   //!< Name of the machine of the peer
+
+  // FRAMED mode transmission: the bytes from txBase to txNext are sent
+  // but unacknowledged, those from txNext to txEnd are not sent yet.
+  // The positions only grow and are taken modulo ACIA_RING_SIZE.
+  char *txRing;                   //!< Transmit buffer
+  uint32_t txBase;                //!< First unacknowledged byte
+  uint32_t txNext;                //!< First unsent byte
+  uint32_t txEnd;                 //!< End of the queued bytes
+  uint16_t sndBase;               //!< Oldest unacknowledged frame
+  uint16_t sndNext;               //!< Next frame to send
+  int frameLen[ACIA_WINDOW];      //!< Payload of the frames in flight
+  bool sendPending;               //!< A SendFrames is scheduled
+  bool retransmitPending;         //!< The retransmission timer is armed
+  uint16_t retransmitBase;        //!< sndBase when the timer was armed
+
+  // FRAMED mode reception
+  char *rxRing;        //!< Receive buffer
+  int rxHead;          //!< Oldest received byte
+  int rxCount;         //!< Number of received bytes
+  uint16_t rcvNext;    //!< Next expected frame
+};
 
 /*! \brief This class is used to simulate an Asynchronous Communicating
     Interface Adapter on top of Unix sockets.
 
     The system dependent ACIA provides emissions and receptions of
     bytes using sockets. An emission and a reception can be done in
-    parallel (full duplex).
+    parallel (full duplex). The FRAMED mode has several ports, linked
+    to different peers (g_cfg->AciaPorts); the other modes only use
+    port 0.
  */
 class ACIA_sysdep {
 public:
@@ -51,7 +147,7 @@ public:
    */
   ACIA_sysdep(ACIA *interface, Machine *m);
 
-  /** Deallocates it and close the socket. */
+  /** Deallocates it and close the sockets. */
   ~ACIA_sysdep();
 
   /** Check if there is an incoming char.
@@ -79,10 +175,31 @@ public:
    */
   void Drain();
 
+  /** Queue bytes in the transmit buffer of a port (FRAMED mode).
+   * \return the number of bytes accepted.
+   */
+  int PutBytes(int port, char *data, int len) {
+    return ports[port]->PutBytes(data, len);
+  }
+
+  /** Take a complete message out of the receive buffer of a port
+   * (FRAMED mode).
+   * \return the number of bytes copied, -1 if there is none yet.
+   */
+  int GetMessage(int port, char *data, int len) {
+    return ports[port]->GetMessage(data, len);
+  }
+
+  /** Number of ports of the ACIA. */
+  int NumPorts() { return numPorts; }
+
 private:
-  ACIA *interface;     //!< ACIA
-  int sock;            //!< UNIX socket number for incoming/outgoing packets.
-  char sockName[32];   //!< File name corresponding to UNIX socket.
+  friend class AciaPort;
+
+  ACIA *interface;        //!< ACIA
+  int numPorts;           //!< Ports of the ACIA
+  AciaPort **ports;       //!< The ports
+  AciaSwitch *aciaSwitch; //!< Switch the frames go through, NULL for UDP
 };
 
 #endif   // _ACIA_SIM
@@ -0,0 +1,210 @@
+/*! \file aciaswitch.cc
+//  \brief Routines of the virtual network switch of the ACIAs
+//
+//      The frames are copied in and out of the rings of the host file
+//      shared by the nodes. A node only writes the tail of the rings
+//      it sends to and the head of the rings it receives from: the
+//      contents of a frame are published by the release store of the
+//      tail, and its room given back by the release store of the head.
+//
+//      A node rings the doorbell of the receiver when the receiver had
+//      read all the frames before the one just sent, so that it may
+//      have found the ring empty and gone to sleep: the positions are
+//      then accessed in sequential consistency, so that the sender
+//      either sees the head of the receiver caught up, or the receiver
+//      sees the new tail.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "machine/aciaswitch.h"
+#include "kernel/msgerror.h"
+#include "machine/machine.h"
+#include "machine/sysdep.h"
+#include "utility/config.h"
+
+//----------------------------------------------------------------------
+// CopyToRing
+/*!	Copy bytes into a ring, wrapping around its end.
+//
+//	\param ring the ring
+//	\param pos the position of the first byte
+//	\param data the bytes
+//	\param len the number of bytes
+*/
+//----------------------------------------------------------------------
+static void
+CopyToRing(SwitchRing *ring, uint32_t pos, char *data, int len) {
+  int offset = pos % SWITCH_RING_SIZE;
+  int first = MIN(len, SWITCH_RING_SIZE - offset);
+  memcpy(&ring->data[offset], data, first);
+  memcpy(ring->data, data + first, len - first);
+}
+
+//----------------------------------------------------------------------
+// CopyFromRing
+/*!	Copy bytes out of a ring, wrapping around its end.
+//
+//	\param ring the ring
+//	\param pos the position of the first byte
+//	\param data where to copy the bytes
+//	\param len the number of bytes
+*/
+//----------------------------------------------------------------------
+static void
+CopyFromRing(SwitchRing *ring, uint32_t pos, char *data, int len) {
+  int offset = pos % SWITCH_RING_SIZE;
+  int first = MIN(len, SWITCH_RING_SIZE - offset);
+  memcpy(data, &ring->data[offset], first);
+  memcpy(data + first, ring->data, len - first);
+}
+
+//----------------------------------------------------------------------
+// AciaSwitch::AciaSwitch
+/*!	Attach a node to the switch. The frames left in the rings of the
+//	node by a previous cluster are dropped, as well as those sent by
+//	the nodes started earlier: the framed mode sends them again.
+//
+//	\param name the host file holding the switch (on a memory file
+//	system, such as /dev/shm, not to be written back to a disk)
+//	\param self the number of this node
+//	\param nodes the number of nodes of the switch
+//	\param withDoorbells true to open the doorbells of the nodes,
+//	named after the host file followed by "." and the node number
+*/
+//----------------------------------------------------------------------
+AciaSwitch::AciaSwitch(char *name, int self, int nodes, bool withDoorbells) {
+  node = self;
+  numNodes = nodes;
+  size = (size_t) numNodes * numNodes * sizeof(SwitchRing);
+  rings = (SwitchRing *) MapSharedFile(name, size);
+  if (rings == NULL) {
+    printf("Cannot attach to the switch %s, or it has another number of "
+           "nodes, exiting\n",
+           name);
+    exit(ERROR);
+  }
+  for (int from = 0; from < numNodes; from++) {
+    SwitchRing *ring = Ring(from, node);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ring->head, tail, __ATOMIC_RELEASE);
+  }
+
+  doorbell = -1;
+  doorbells = NULL;
+  if (withDoorbells) {
+    doorbells = new int[numNodes];
+    for (int n = 0; n < numNodes; n++) {
+      char doorbellName[MAXSTRLEN + 16];
+      sprintf(doorbellName, "%s.%d", name, n);
+      doorbells[n] = OpenFifo(doorbellName);
+      if (doorbells[n] < 0) {
+        printf("Cannot open the doorbell %s of the switch, exiting\n",
+               doorbellName);
+        exit(ERROR);
+      }
+    }
+    doorbell = doorbells[node];
+  }
+}
+
+//----------------------------------------------------------------------
+// AciaSwitch::~AciaSwitch
+//!	Detach the node from the switch, the host file is left for the
+//!	other nodes.
+//----------------------------------------------------------------------
+AciaSwitch::~AciaSwitch() {
+  UnmapSharedFile((char *) rings, size);
+  if (doorbells != NULL) {
+    for (int n = 0; n < numNodes; n++)
+      Close(doorbells[n]);
+    delete[] doorbells;
+  }
+}
+
+//----------------------------------------------------------------------
+// AciaSwitch::Send
+/*!	Append a frame to the ring of the destination node.
+//
+//	\param to the destination node
+//	\param frame the frame
+//	\param len its length
+//	\return true if it was sent, false if the ring had no room for it
+*/
+//----------------------------------------------------------------------
+bool
+AciaSwitch::Send(int to, char *frame, int len) {
+  SwitchRing *ring = Ring(node, to);
+  uint16_t length = len;
+  uint32_t tail = ring->tail;
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+  ASSERT(len <= UINT16_MAX);
+  if (SWITCH_RING_SIZE - (tail - head) <
+      (uint32_t) (SWITCH_FRAME_HEADER + len))
+    return false;
+  CopyToRing(ring, tail, (char *) &length, SWITCH_FRAME_HEADER);
+  CopyToRing(ring, tail + SWITCH_FRAME_HEADER, frame, len);
+  __atomic_store_n(&ring->tail, tail + SWITCH_FRAME_HEADER + len,
+                   __ATOMIC_SEQ_CST);
+
+  // A full pipe already holds a ring of the doorbell
+  if (doorbells != NULL &&
+      __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail) {
+    char bell = 0;
+    (void) WritePartial(doorbells[to], &bell, 1);
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------
+// AciaSwitch::Receive
+/*!	Take the oldest frame of the ring of a source node.
+//
+//	\param from the source node
+//	\param frame where to copy the frame
+//	\param room the room available in frame, the bytes beyond are
+//	discarded
+//	\return the number of bytes copied, -1 if the ring is empty
+*/
+//----------------------------------------------------------------------
+int
+AciaSwitch::Receive(int from, char *frame, int room) {
+  SwitchRing *ring = Ring(from, node);
+  uint16_t length;
+  uint32_t head = ring->head;
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+
+  if (head == tail)
+    return -1;
+  CopyFromRing(ring, head, (char *) &length, SWITCH_FRAME_HEADER);
+  int copied = MIN((int) length, room);
+  CopyFromRing(ring, head + SWITCH_FRAME_HEADER, frame, copied);
+  __atomic_store_n(&ring->head, head + SWITCH_FRAME_HEADER + length,
+                   __ATOMIC_SEQ_CST);
+  return copied;
+}
+
+//----------------------------------------------------------------------
+// AciaSwitch::ClearDoorbell
+//!	Read the rings of the doorbell of the node, the rings of frames
+//!	being read next.
+//----------------------------------------------------------------------
+void
+AciaSwitch::ClearDoorbell() {
+  char bells[64];
+  while (ReadPartial(doorbell, bells, sizeof(bells)) > 0)
+    ;
+}
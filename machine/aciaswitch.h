@@ -0,0 +1,100 @@
+/*! \file aciaswitch.h
+    \brief Data structures of the virtual network switch of the ACIAs
+
+        Nachos processes running on the same host form a cluster of
+        nodes whose ACIAs are linked by a switch in shared memory: a
+        host file mapped by every node, holding a ring of frames for
+        each ordered pair of nodes. Port p of the ACIA of node n is
+        linked to port n of node p, and a frame goes from a node to
+        another without a system call, instead of a UDP datagram.
+
+        A full ring drops the frame, as a congested network would: the
+        framed mode of the ACIA sends it again.
+
+        The rings are polled. In EventInput mode, a node also has a
+        doorbell, a named pipe the interrupt simulation waits on:
+        another node writes a byte to it when it sends a frame the node
+        may not have seen, once it has read all the previous ones.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef ACIASWITCH_H
+#define ACIASWITCH_H
+
+#include "kernel/copyright.h"
+#include "utility/utility.h"
+
+//! Bytes of the ring of frames of a pair of nodes (power of two)
+#define SWITCH_RING_SIZE 65536
+
+//! Bytes before each frame of a ring, giving its length
+#define SWITCH_FRAME_HEADER 2
+
+/*! \brief Defines the ring of the frames sent by a node to another
+//
+// The ring has a single writer, the sending node, and a single reader,
+// the receiving node: each one only updates its own position, with
+// atomic accesses, so that they need no lock. The positions only grow
+// and are taken modulo SWITCH_RING_SIZE; they are on cache lines of
+// their own not to be shared by the two nodes.
+*/
+struct SwitchRing {
+  uint32_t head;                  //!< End of the frames read
+  char headLine[60];
+  uint32_t tail;                  //!< End of the frames written
+  char tailLine[60];
+  char data[SWITCH_RING_SIZE];    //!< Frames, each one after its length
+};
+
+/*! \brief Defines the attachment of a node to the switch
+*/
+class AciaSwitch {
+public:
+  //! Attach node self to the switch of nodes nodes held by the host file
+  //! name, created if it doesn't exist, with doorbells if requested
+  AciaSwitch(char *name, int self, int nodes, bool doorbells);
+
+  //! Detach the node from the switch
+  ~AciaSwitch();
+
+  //! Send a frame to a node, false if it was dropped (ring full)
+  bool Send(int to, char *frame, int len);
+
+  //! Take the next frame sent by a node, -1 if there is none
+  int Receive(int from, char *frame, int room);
+
+  //! Host file of the doorbell of the node, -1 if none
+  int Doorbell() { return doorbell; }
+
+  //! Empty the doorbell, before reading the rings
+  void ClearDoorbell();
+
+private:
+  //! Ring of the frames sent by from to to
+  SwitchRing *Ring(int from, int to) { return &rings[from * numNodes + to]; }
+
+  int node;             //!< This node
+  int numNodes;         //!< Nodes of the switch
+  SwitchRing *rings;    //!< Rings of every pair of nodes, mapped from the
+                        //!< host file
+  size_t size;          //!< Size of the mapping
+  int doorbell;         //!< Doorbell of this node, -1 if none
+  int *doorbells;       //!< Doorbells of every node, NULL if none
+};
+
+#endif   // ACIASWITCH_H
@@ -100,8 +100,9 @@ void
 Console::CheckCharAvail() {
   char c;
 
-  // schedule the next time to poll for a packet
-  if (intState)
+  // schedule the next time to poll for a packet (the interrupt
+  // simulation watches the file in EventInput mode)
+  if (intState && !g_cfg->EventInput)
     g_machine->interrupt->Schedule(
         ConsoleReadPoll, (int64_t) this,
         nano_to_cycles(CONSOLE_TIME, g_cfg->ProcessorFrequency),
@@ -169,6 +170,11 @@ Console::PutChar(char ch) {
 void
 Console::EnableInterrupt() {
   intState = true;
+  if (g_cfg->EventInput) {
+    g_machine->interrupt->WatchInput(readFileNo, ConsoleReadPoll, (int64_t) this,
+                                     CONSOLE_READ_INT);
+    return;
+  }
   g_machine->interrupt->Schedule(
       ConsoleReadPoll, (int64_t) this,
       nano_to_cycles(CONSOLE_TIME, g_cfg->ProcessorFrequency),
@@ -182,4 +188,6 @@ Console::EnableInterrupt() {
 void
 Console::DisableInterrupt() {
   intState = false;
+  if (g_cfg->EventInput)
+    g_machine->interrupt->UnwatchInput(readFileNo);
 }
@@ -7,7 +7,9 @@
 //	therefore about the behavior of this simulation).
 //
 //	Disk operations are asynchronous, so we have to invoke an interrupt
-//	handler when the simulated operation completes.
+//	handler when the simulated operation completes. Each request
+//	schedules its own interrupt, so that the requests in progress on
+//	an SSD complete independently.
  * -----------------------------------------------------
  * This file is part of the Nachos-RiscV distribution
  * Copyright (c) 2022 University of Rennes 1.
@@ -32,11 +34,13 @@
 #include "machine/machine.h"
 #include "utility/config.h"
 #include "utility/stats.h"
+#include "utility/trace.h"
 
 //! dummy procedure because we can't take a pointer of a member function
 static void
 DiskDone(int64_t arg) {
-  ((Disk *) arg)->HandleInterrupt();
+  DiskCompletion *completion = (DiskCompletion *) arg;
+  completion->disk->HandleInterrupt(completion);
 }
 
 //----------------------------------------------------------------------
@@ -48,12 +52,11 @@ DiskDone(int64_t arg) {
 //
 //	\param name text name of the file simulating the Nachos disk
 //	\param callWhenDone interrupt handler to be called when disk read/write
-//	   request completes
-//	\param callArg argument to pass the interrupt handler
+//	   request completes, with the tag of the request
 */
 //----------------------------------------------------------------------
 
-Disk::Disk(char *name, VoidNoArgFunctionPtr callWhenDone) {
+Disk::Disk(char *name, VoidFunctionPtr callWhenDone) {
   uint32_t magicNum;
   int tmp = 0;
 
@@ -61,10 +64,15 @@ Disk::Disk(char *name, VoidNoArgFunctionPtr callWhenDone) {
   handler = callWhenDone;
   lastSector = 0;
   bufferInit = 0;
+  traceTrack = TRACE_TRACK(name);
+  baseFile = -1;
+  present = NULL;
 
   // Open the UNIX file used to simulate the disk
-  fileno = OpenForReadWrite(name, false);
-  if (fileno >= 0) {   // file exists, check magic number
+  if (g_cfg->DiskOverlay[0] != '\0')
+    OpenOverlay(name);
+  else if ((fileno = OpenForReadWrite(name, false)) >= 0) {
+    // file exists, check magic number
     Read(fileno, (char *) &magicNum, g_cfg->MagicSize);
     ASSERT(magicNum == g_cfg->MagicNumber);
   } else {   // file doesn't exist, create it
@@ -77,8 +85,29 @@ Disk::Disk(char *name, VoidNoArgFunctionPtr callWhenDone) {
     Lseek(fileno, g_cfg->DiskSize - sizeof(int), 0);
     WriteFile(fileno, (char *) &tmp, sizeof(int));
   }
+
+  // Map the UNIX file once, sectors are then copied with memcpy
+  image = NULL;
+  if (g_cfg->DiskMapped && present == NULL) {
+    image = MapFile(fileno, g_cfg->DiskSize);
+    if (image == NULL)
+      DEBUG('h', (char *) "Cannot map %s, using system calls\n", name);
+  }
   DEBUG('h', (char *) "[ctor] Clear active\n");
-  active = false;
+  outstanding = 0;
+  maxRequests = 1;
+  channelFree = NULL;
+  if (g_cfg->DiskModel == DISK_MODEL_SSD) {
+    maxRequests = g_cfg->SsdQueueDepth;
+    channelFree = new Time[g_cfg->SsdChannels];
+    for (uint32_t c = 0; c < g_cfg->SsdChannels; c++)
+      channelFree[c] = 0;
+  }
+  completions = new DiskCompletion[maxRequests];
+  for (int i = 0; i < maxRequests; i++) {
+    completions[i].disk = this;
+    completions[i].busy = false;
+  }
 }
 
 //----------------------------------------------------------------------
@@ -88,7 +117,260 @@ Disk::Disk(char *name, VoidNoArgFunctionPtr callWhenDone) {
 */
 //----------------------------------------------------------------------
 
-Disk::~Disk() { Close(fileno); }
+Disk::~Disk() {
+  if (image != NULL)
+    UnmapFile(image, g_cfg->DiskSize);
+  Close(fileno);
+  if (baseFile >= 0)
+    Close(baseFile);
+  delete[] present;
+  delete[] completions;
+  delete[] channelFree;
+}
+
+//----------------------------------------------------------------------
+// Disk::OpenOverlay()
+/*! 	Open the base image of the disk read-only, and the delta file of
+//	the run (creating it if it doesn't exist) for reading and writing.
+//	A missing base image reads as zeros, it is not created: several
+//	simulations sharing the image must not race to write it.
+//
+//	\param name text name of the base image
+*/
+//----------------------------------------------------------------------
+
+void
+Disk::OpenOverlay(char *name) {
+  uint32_t magicNum;
+  char deltaName[2 * MAXSTRLEN];
+  int bitmapSize = NUM_SECTORS / 8;
+
+  baseFile = OpenForRead(name, false);
+  if (baseFile >= 0) {   // check the magic number of the image
+    Read(baseFile, (char *) &magicNum, g_cfg->MagicSize);
+    ASSERT(magicNum == g_cfg->MagicNumber);
+  }
+
+  present = new uint8_t[bitmapSize];
+  sprintf(deltaName, "%s.%s", name, g_cfg->DiskOverlay);
+  fileno = OpenForReadWrite(deltaName, false);
+  if (fileno >= 0) {   // delta of a previous run, load its bitmap
+    Read(fileno, (char *) &magicNum, sizeof(magicNum));
+    ASSERT(magicNum == OVERLAY_MAGIC);
+    Read(fileno, (char *) present, bitmapSize);
+  } else {   // empty delta, the sectors are only written when modified
+    fileno = OpenForWrite(deltaName);
+    magicNum = OVERLAY_MAGIC;
+    memset(present, 0, bitmapSize);
+    WriteFile(fileno, (char *) &magicNum, sizeof(magicNum));
+    WriteFile(fileno, (char *) present, bitmapSize);
+  }
+  DEBUG('h', (char *) "Overlay of %s in %s, base image %s\n", name,
+        deltaName, baseFile >= 0 ? "read-only" : "missing");
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadSectors()
+/*! 	Read a run of consecutive sectors from the UNIX files: from the
+//	mapped image, or with a system call, or from the delta file and the
+//	base image of an overlay, with a system call per run of sectors
+//	held by the same file.
+//
+//	\param sectorNumber the first disk sector to read
+//	\param numSectors the number of sectors to read
+//	\param data the buffers to hold the incoming bytes, one per sector
+*/
+//----------------------------------------------------------------------
+
+void
+Disk::ReadSectors(int sectorNumber, int numSectors, char **data) {
+  int offset = g_cfg->SectorSize * sectorNumber + g_cfg->MagicSize;
+
+  if (image != NULL) {
+    for (int i = 0; i < numSectors; i++)
+      memcpy(data[i], &image[offset + i * g_cfg->SectorSize],
+             g_cfg->SectorSize);
+    return;
+  }
+  if (present == NULL) {
+    ReadVector(fileno, data, numSectors, g_cfg->SectorSize, offset);
+    return;
+  }
+  for (int i = 0, n; i < numSectors; i += n) {
+    bool delta = InDelta(sectorNumber + i);
+    for (n = 1; i + n < numSectors && InDelta(sectorNumber + i + n) == delta;
+         n++)
+      ;
+    if (delta)
+      ReadVector(fileno, &data[i], n, g_cfg->SectorSize,
+                 OVERLAY_DATA_OFFSET +
+                     (sectorNumber + i) * g_cfg->SectorSize);
+    else if (baseFile >= 0)
+      ReadVector(baseFile, &data[i], n, g_cfg->SectorSize,
+                 offset + i * g_cfg->SectorSize);
+    else
+      for (int j = 0; j < n; j++)
+        memset(data[i + j], 0, g_cfg->SectorSize);
+  }
+}
+
+//----------------------------------------------------------------------
+// Disk::WriteSectors()
+/*! 	Write a run of consecutive sectors to the UNIX files (see
+//	ReadSectors). With an overlay, the sectors go to the delta file,
+//	whose bitmap is updated when they were not held yet.
+//
+//	\param sectorNumber the first disk sector to write
+//	\param numSectors the number of sectors to write
+//	\param data the bytes to be written, one buffer per sector
+*/
+//----------------------------------------------------------------------
+
+void
+Disk::WriteSectors(int sectorNumber, int numSectors, char **data) {
+  int offset = g_cfg->SectorSize * sectorNumber + g_cfg->MagicSize;
+
+  if (image != NULL) {
+    for (int i = 0; i < numSectors; i++)
+      memcpy(&image[offset + i * g_cfg->SectorSize], data[i],
+             g_cfg->SectorSize);
+    return;
+  }
+  if (present == NULL) {
+    WriteVector(fileno, data, numSectors, g_cfg->SectorSize, offset);
+    return;
+  }
+  WriteVector(fileno, data, numSectors, g_cfg->SectorSize,
+              OVERLAY_DATA_OFFSET + sectorNumber * g_cfg->SectorSize);
+
+  // Record the new sectors in the bitmap of the file, after their
+  // contents
+  int first = -1, last = -1;
+  for (int s = sectorNumber; s < sectorNumber + numSectors; s++)
+    if (!InDelta(s)) {
+      present[s / 8] |= 1 << (s % 8);
+      if (first < 0)
+        first = s / 8;
+      last = s / 8;
+    }
+  if (first >= 0) {
+    Lseek(fileno, sizeof(uint32_t) + first, 0);
+    WriteFile(fileno, (char *) &present[first], last - first + 1);
+  }
+}
+
+//----------------------------------------------------------------------
+// Disk::Sync()
+/*! 	Write the modified sectors of the mapped image to the UNIX file,
+//	so that they survive a crash of Nachos. Nothing to do when the
+//	file is accessed with system calls.
+*/
+//----------------------------------------------------------------------
+
+void
+Disk::Sync() {
+  if (image != NULL)
+    SyncMappedFile(image, g_cfg->DiskSize);
+}
+
+//----------------------------------------------------------------------
+// Disk::WriteImage()
+/*! 	Write a run of consecutive sectors directly to the UNIX file, in
+//	a single host write: this is not a simulated request, it takes no
+//	simulated time and raises no interrupt. Used to import files in
+//	bulk at boot, when no request is in progress.
+//
+//	\param sectorNumber the first disk sector to write
+//	\param numSectors the number of sectors to write
+//	\param data the bytes to be written, numSectors sectors
+*/
+//----------------------------------------------------------------------
+
+void
+Disk::WriteImage(int sectorNumber, int numSectors, char *data) {
+  ASSERT(outstanding == 0);
+  ASSERT((sectorNumber >= 0) && (numSectors > 0) &&
+         (sectorNumber + numSectors <= NUM_SECTORS));
+
+  int offset = g_cfg->SectorSize * sectorNumber + g_cfg->MagicSize;
+  if (image != NULL)
+    memcpy(&image[offset], data, numSectors * g_cfg->SectorSize);
+  else if (present == NULL) {
+    Lseek(fileno, offset, 0);
+    WriteFile(fileno, data, numSectors * g_cfg->SectorSize);
+  } else {   // a track at a time, to the delta file
+    char *buffers[SECTORS_PER_TRACK];
+    for (int i = 0, n; i < numSectors; i += n) {
+      n = MIN(numSectors - i, SECTORS_PER_TRACK);
+      for (int j = 0; j < n; j++)
+        buffers[j] = data + (i + j) * g_cfg->SectorSize;
+      WriteSectors(sectorNumber + i, n, buffers);
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+// Disk::Save()
+/*! 	Append the whole contents of the disk, magic number included,
+//	to a UNIX file (snapshot of the machine). No request must be in
+//	progress.
+//
+//	\param fd the UNIX file to write to
+*/
+//----------------------------------------------------------------------
+
+void
+Disk::Save(int fd) {
+  ASSERT(outstanding == 0);
+  if (image != NULL) {
+    WriteFile(fd, image, g_cfg->DiskSize);
+    return;
+  }
+  char *contents = new char[g_cfg->DiskSize];
+  if (present == NULL) {
+    Lseek(fileno, 0, 0);
+    Read(fileno, contents, g_cfg->DiskSize);
+  } else {   // the sectors seen through the overlay
+    char *buffers[SECTORS_PER_TRACK];
+    *(uint32_t *) contents = g_cfg->MagicNumber;
+    for (int s = 0; s < NUM_SECTORS; s += SECTORS_PER_TRACK) {
+      for (int j = 0; j < SECTORS_PER_TRACK; j++)
+        buffers[j] = contents + g_cfg->MagicSize + (s + j) * g_cfg->SectorSize;
+      ReadSectors(s, SECTORS_PER_TRACK, buffers);
+    }
+  }
+  WriteFile(fd, contents, g_cfg->DiskSize);
+  delete[] contents;
+}
+
+//----------------------------------------------------------------------
+// Disk::Restore()
+/*! 	Replace the contents of the disk by contents saved by Save.
+//
+//	\param contents the saved contents, DiskSize bytes
+*/
+//----------------------------------------------------------------------
+
+void
+Disk::Restore(char *contents) {
+  ASSERT(outstanding == 0);
+  ASSERT(*(uint32_t *) contents == g_cfg->MagicNumber);
+  if (image != NULL)
+    memcpy(image, contents, g_cfg->DiskSize);
+  else if (present == NULL) {
+    Lseek(fileno, 0, 0);
+    WriteFile(fileno, contents, g_cfg->DiskSize);
+  } else {   // only the sectors that differ go to the delta file
+    char *current = new char[g_cfg->SectorSize];
+    for (int s = 0; s < NUM_SECTORS; s++) {
+      char *saved = contents + g_cfg->MagicSize + s * g_cfg->SectorSize;
+      ReadSectors(s, 1, &current);
+      if (memcmp(current, saved, g_cfg->SectorSize) != 0)
+        WriteSectors(s, 1, &saved);
+    }
+    delete[] current;
+  }
+}
 
 //----------------------------------------------------------------------
 // Disk::PrintSector()
@@ -128,31 +410,52 @@ PrintSector(bool writing, int sector, char *data) {
 //----------------------------------------------------------------------
 void
 Disk::ReadRequest(int sectorNumber, char *data) {
-  int ticks = ComputeLatency(sectorNumber, false);
+  ReadRequest(sectorNumber, 1, &data);
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadRequest
+/*!	Simulate a request to read a run of consecutive sectors, as a
+//	single request: one seek, then the transfer of every sector
+//	(see ComputeLatency). The UNIX file is read with a single
+//	system call.
+//
+//	\param sectorNumber the first disk sector to read
+//	\param numSectors the number of sectors to read
+//	\param data the buffers to hold the incoming bytes, one per sector
+//	\param tag the argument of the handler of the disk, identifying
+//	the request when it completes
+*/
+//----------------------------------------------------------------------
+void
+Disk::ReadRequest(int sectorNumber, int numSectors, char **data,
+                  int64_t tag) {
+  // At most maxRequests requests at a time
+  ASSERT(outstanding < maxRequests);
 
-  // Only one request at a time
-  ASSERT(!active);
+  int ticks = ComputeLatency(sectorNumber, false, numSectors);
 
-  // Sanity check of the sector number
-  ASSERT((sectorNumber >= 0) && (sectorNumber < NUM_SECTORS))
+  // Sanity check of the sector numbers
+  ASSERT((sectorNumber >= 0) && (numSectors > 0) &&
+         (sectorNumber + numSectors <= NUM_SECTORS));
 
-  DEBUG('h', (char *) "Reading from sector %d\n", sectorNumber);
+  DEBUG('h', (char *) "Reading %d sectors from sector %d\n", numSectors,
+        sectorNumber);
 
   // Read in the UNIX file
-  Lseek(fileno, g_cfg->SectorSize * sectorNumber + g_cfg->MagicSize, 0);
-  Read(fileno, data, g_cfg->SectorSize);
+  ReadSectors(sectorNumber, numSectors, data);
   if (DebugIsEnabled('h'))
-    PrintSector(false, sectorNumber, data);
+    for (int i = 0; i < numSectors; i++)
+      PrintSector(false, sectorNumber + i, data[i]);
 
   DEBUG('h', (char *) "[rdrq] Set active\n");
-  active = true;
-  UpdateLast(sectorNumber);
+  UpdateLast(sectorNumber + numSectors - 1);
 
   // Update the statistics
   g_current_thread->GetProcessOwner()->stat->incrNumDiskReads();
+  TRACE(TRACE_DISK_ISSUE, traceTrack, numSectors, sectorNumber);
 
-  // Schedule the end of IO interrupt
-  g_machine->interrupt->Schedule(DiskDone, (int64_t) this, ticks, DISK_INT);
+  Issue(ticks, tag);
 }
 
 //----------------------------------------------------------------------
@@ -173,47 +476,95 @@ Disk::ReadRequest(int sectorNumber, char *data) {
 
 void
 Disk::WriteRequest(int sectorNumber, char *data) {
-  int ticks = ComputeLatency(sectorNumber, true);
+  WriteRequest(sectorNumber, 1, &data);
+}
 
-  // Only one request at a time
-  ASSERT(!active);
+//----------------------------------------------------------------------
+// Disk::WriteRequest
+/*!	Simulate a request to write a run of consecutive sectors, as a
+//	single request (see ReadRequest).
+//
+//	\param sectorNumber the first disk sector to write
+//	\param numSectors the number of sectors to write
+//	\param data the bytes to be written, one buffer per sector
+//	\param tag the argument of the handler of the disk
+*/
+//----------------------------------------------------------------------
+
+void
+Disk::WriteRequest(int sectorNumber, int numSectors, char **data,
+                   int64_t tag) {
+  // At most maxRequests requests at a time
+  ASSERT(outstanding < maxRequests);
 
-  // Sanity check of the sector number
-  ASSERT((sectorNumber >= 0) && (sectorNumber < NUM_SECTORS));
+  int ticks = ComputeLatency(sectorNumber, true, numSectors);
 
-  DEBUG('h', (char *) "Writing to sector %d\n", sectorNumber);
+  // Sanity check of the sector numbers
+  ASSERT((sectorNumber >= 0) && (numSectors > 0) &&
+         (sectorNumber + numSectors <= NUM_SECTORS));
+
+  DEBUG('h', (char *) "Writing %d sectors to sector %d\n", numSectors,
+        sectorNumber);
 
   // Write in the UNIX file
-  Lseek(fileno, g_cfg->SectorSize * sectorNumber + g_cfg->MagicSize, 0);
-  WriteFile(fileno, data, g_cfg->SectorSize);
+  WriteSectors(sectorNumber, numSectors, data);
   if (DebugIsEnabled('h'))
-    PrintSector(true, sectorNumber, data);
+    for (int i = 0; i < numSectors; i++)
+      PrintSector(true, sectorNumber + i, data[i]);
 
   DEBUG('h', (char *) "[wrrq] Set active\n");
-  active = true;
-  UpdateLast(sectorNumber);
+  UpdateLast(sectorNumber + numSectors - 1);
 
   // Update statistics
   g_current_thread->GetProcessOwner()->stat->incrNumDiskWrites();
+  TRACE(TRACE_DISK_ISSUE, traceTrack, numSectors | TRACE_DISK_WRITE,
+        sectorNumber);
+
+  Issue(ticks, tag);
+}
+
+//----------------------------------------------------------------------
+// Disk::Issue()
+/*! 	Record a request in a free entry of the requests in progress, and
+//	schedule its end of IO interrupt.
+//
+//	\param ticks how long the request takes
+//	\param tag the argument of the handler of the disk
+*/
+//----------------------------------------------------------------------
 
-  // Schedule the end of IO interrupt
-  g_machine->interrupt->Schedule(DiskDone, (int64_t) this, ticks, DISK_INT);
+void
+Disk::Issue(int ticks, int64_t tag) {
+  DiskCompletion *completion = completions;
+  while (completion->busy)
+    completion++;
+  completion->busy = true;
+  completion->tag = tag;
+  outstanding++;
+
+  g_machine->interrupt->Schedule(DiskDone, (int64_t) completion, ticks,
+                                 DISK_INT);
 }
 
 //----------------------------------------------------------------------
 // Disk::HandleInterrupt()
 /*! 	Called when it is time to invoke the disk interrupt handler,
-//	to tell the Nachos kernel that the disk request is done.
+//	to tell the Nachos kernel that a disk request is done.
+//
+//	\param completion the entry of the request
 */
 //----------------------------------------------------------------------
 
 void
-Disk::HandleInterrupt() {
+Disk::HandleInterrupt(DiskCompletion *completion) {
   DEBUG('h', (char *) "[isr] Clear active\n");
-  active = false;
+  ASSERT(completion->busy);
+  completion->busy = false;
+  outstanding--;
+  TRACE(TRACE_DISK_DONE, traceTrack, 0, 0);
 
   // Call the disk interrupt handler
-  (*handler)();
+  (*handler)(completion->tag);
 }
 
 //----------------------------------------------------------------------
@@ -281,11 +632,20 @@ Disk::ModuloDiff(int to, Time from) {
 //   	read requests to the current track to be satisfied more quickly.
 //   	The contents of the track buffer are discarded after every seek to
 //   	a new track.
+//
+//	A request to a run of sectors pays the seek and rotational
+//	latency once, then the transfer time of each sector.
+//
+//	An SSD has no head, its latency comes from its channels (see
+//	FlashLatency).
 */
 //----------------------------------------------------------------------
 
 int
-Disk::ComputeLatency(int newSector, bool writing) {
+Disk::ComputeLatency(int newSector, bool writing, int numSectors) {
+  if (g_cfg->DiskModel == DISK_MODEL_SSD)
+    return FlashLatency(newSector, writing, numSectors);
+
   int rotation;
   int seek = TimeToSeek(newSector, &rotation);
   Time timeAfter = g_stats->getTotalTicks() + seek + rotation;
@@ -293,7 +653,7 @@ Disk::ComputeLatency(int newSector, bool writing) {
 
 #ifndef NOTRACKBUF   // turn this on if you don't want the track buffer stuff
   // check if track buffer applies
-  if ((writing == false) && (seek == 0) &&
+  if ((writing == false) && (seek == 0) && (numSectors == 1) &&
       ((Time) ((timeAfter - bufferInit) / rot_time) >
        (Time) ModuloDiff(newSector, bufferInit / rot_time))) {
     DEBUG('h', (char *) "Request latency = %d\n", rot_time);
@@ -303,8 +663,9 @@ Disk::ComputeLatency(int newSector, bool writing) {
 
   rotation += ModuloDiff(newSector, timeAfter / rot_time) * rot_time;
 
-  DEBUG('h', (char *) "Request latency = %d\n", seek + rotation + rot_time);
-  return (seek + rotation + rot_time);
+  DEBUG('h', (char *) "Request latency = %d\n",
+        seek + rotation + numSectors * rot_time);
+  return (seek + rotation + numSectors * rot_time);
 }
 
 //----------------------------------------------------------------------
@@ -323,3 +684,40 @@ Disk::UpdateLast(int newSector) {
     bufferInit = g_stats->getTotalTicks() + seek + rotate;
   lastSector = newSector;
 }
+
+//----------------------------------------------------------------------
+// Disk::FlashLatency
+/*!   	Return how long a request will take on an SSD, and reserve the
+//	channels it uses. Each sector of the request is a page of the
+//	channel sector % SsdChannels, which reads or programs it once
+//	done with the pages of the requests already in progress: the
+//	consecutive sectors of a request are thus transferred in
+//	parallel, and the requests on different channels overlap.
+//
+//	\param newSector the first sector of the request
+//	\param writing true for a write (program) request
+//	\param numSectors the number of sectors of the request
+//	\return the time until the last page of the request is done
+*/
+//----------------------------------------------------------------------
+int
+Disk::FlashLatency(int newSector, bool writing, int numSectors) {
+  Time now = g_stats->getTotalTicks();
+  Time page = nano_to_cycles(writing ? g_cfg->SsdProgramLatency
+                                     : g_cfg->SsdReadLatency,
+                             g_cfg->ProcessorFrequency);
+  if (page == 0)
+    page = 1;
+
+  Time end = now;
+  for (int i = 0; i < numSectors; i++) {
+    Time *channel = &channelFree[(newSector + i) % g_cfg->SsdChannels];
+    if (*channel < now)
+      *channel = now;
+    *channel += page;
+    if (*channel > end)
+      end = *channel;
+  }
+  DEBUG('h', (char *) "Request latency = %d\n", (int) (end - now));
+  return (int) (end - now);
+}
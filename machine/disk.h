@@ -4,7 +4,9 @@
         A physical disk can accept (one at a time) requests to
         read/write a disk sector;
         when the request is satisfied, the CPU gets an interrupt, and
-        the next request can be sent to the disk.
+        the next request can be sent to the disk. A flash disk (SSD)
+        accepts several requests at once, and completes them in any
+        order.
 
         Disk contents are preserved across machine crashes, but if
         a file system operation (eg, create a file) is in progress when
@@ -38,6 +40,26 @@
 #define NUM_TRACKS        64   //!< number of tracks per disk
 #define NUM_SECTORS       (SECTORS_PER_TRACK * NUM_TRACKS)
 //!< total # of sectors per disk
+
+//! Magic number of the delta files of the overlays
+#define OVERLAY_MAGIC 0x4f564c59
+
+//! Offset of the sectors in a delta file, after the magic number and
+//! the sector-presence bitmap (host page aligned, so that the sectors
+//! never written remain holes of the file)
+#define OVERLAY_DATA_OFFSET 4096
+
+class Disk;
+
+/*! \brief Defines a request in progress on a disk, until its interrupt
+*/
+class DiskCompletion {
+public:
+  Disk *disk;    //!< the disk
+  int64_t tag;   //!< argument of the disk handler, given by the requester
+  bool busy;     //!< a request is in progress in this entry
+};
+
 /*! \brief Defines a physical disk I/O device.
 //
 // The disk
@@ -65,43 +87,117 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// With the DISK_MODEL_SSD model, the disk is a flash device instead:
+// the sectors (flash pages) are spread over g_cfg->SsdChannels
+// channels, sector s on channel s % SsdChannels, each channel reading
+// or programming one page at a time in a fixed time, whatever the
+// previous request. Up to g_cfg->SsdQueueDepth requests are accepted
+// at once; those on different channels overlap, and each one raises
+// its own interrupt when its last page is done, possibly before older
+// requests.
+//
+// With g_cfg->DiskOverlay set, the UNIX file of the disk is a base
+// image, opened read-only and shared by any number of simulations: the
+// sectors written go to a sparse delta file of the run, named after the
+// image followed by "." and DiskOverlay. The delta file starts with a
+// bitmap of the sectors it holds, each one then stored at its offset
+// from OVERLAY_DATA_OFFSET; the other sectors are read from the base
+// image (zeros if there is no base image). A delta file left by a
+// previous run is used again.
 */
 class Disk {
 public:
-  Disk(char *name, VoidNoArgFunctionPtr callWhenDone);
+  Disk(char *name, VoidFunctionPtr callWhenDone);
   /*!< Create a simulated disk.
-       Invoke (*callWhenDone)
-       every time a request completes. */
+       Invoke (*callWhenDone)(tag)
+       every time a request completes,
+       with the tag of the request. */
   ~Disk(); /*!< Deallocate the disk. */
 
   void ReadRequest(int sectorNumber, char *data);
   /*!< Read/write an single disk sector.
        These routines send a request to
        the disk and return immediately.
-       Only one request allowed at a time! */
+       At most MaxRequests() requests
+       at a time! */
   void WriteRequest(int sectorNumber, char *data);
 
-  void HandleInterrupt(); /*!< Interrupt handler, invoked when
-                               disk request finishes. */
+  void ReadRequest(int sectorNumber, int numSectors, char **data,
+                   int64_t tag = 0);
+  /*!< Read/write a run of numSectors
+       consecutive sectors, data[i] holding
+       the contents of sector
+       sectorNumber + i, as a single request */
+  void WriteRequest(int sectorNumber, int numSectors, char **data,
+                    int64_t tag = 0);
+
+  int MaxRequests() { return maxRequests; }
+  /*!< Return how many requests the
+       disk accepts at once */
+
+  void HandleInterrupt(DiskCompletion *completion);
+  /*!< Interrupt handler, invoked when
+       a disk request finishes. */
+
+  void Sync(); /*!< Write the mapped image to the UNIX
+                    file (DiskMapped mode). */
+
+  void Save(int fd); /*!< Write the whole disk contents
+                          to the UNIX file fd (snapshots). */
+  void Restore(char *contents); /*!< Replace the disk contents
+                          by a copy saved by Save. */
+
+  void WriteImage(int sectorNumber, int numSectors, char *data);
+  /*!< Write a run of sectors at once,
+       outside of the simulation (no latency
+       and no interrupt: bulk import at boot) */
+
+  int LastSector() { return lastSector; }
+  /*!< Return the sector the disk head
+       stands on (previous request) */
 
-  int ComputeLatency(int newSector, bool writing);
+  int ComputeLatency(int newSector, bool writing, int numSectors = 1);
   /*!< Return how long a request to
-  newSector will take:
-  (seek + rotational delay + transfer) */
+  numSectors sectors from newSector will take:
+  (seek + rotational delay + transfer),
+  or the time the channels of an SSD take */
 
 private:
   int fileno;                   //!< UNIX file number for simulated disk
-  VoidNoArgFunctionPtr handler; /*!< Interrupt handler, to be invoked
+                                //!< (the delta file of an overlay)
+  int baseFile;                 //!< Base image of an overlay, read-only,
+                                //!< -1 if none
+  uint8_t *present;             //!< Bitmap of the sectors held by the
+                                //!< delta file, NULL if no overlay
+  char *image;                  //!< UNIX file mapped in memory, NULL if
+                                //!< accessed with system calls
+  VoidFunctionPtr handler;      /*!< Interrupt handler, to be invoked
                                   when any disk request finishes
                                 */
-  bool active;                  //!< Is a disk operation in progress?
+  int outstanding;              //!< Number of requests in progress
+  int maxRequests;              //!< Requests accepted at once
+  DiskCompletion *completions;  //!< Requests in progress, maxRequests
+                                //!< entries
+  Time *channelFree;            //!< When each flash channel finishes its
+                                //!< last page (SSD only)
   int lastSector;               //!< The previous disk request
   Time bufferInit;              //!< When the track buffer started
                                 //!< being loaded
+  uint16_t traceTrack;          //!< Track of the disk in the event trace
 
+  void OpenOverlay(char *name);   // open the base image and the delta file
+  bool InDelta(int sector) {   // sector held by the delta file
+    return (present[sector / 8] >> (sector % 8)) & 1;
+  }
+  void ReadSectors(int sectorNumber, int numSectors, char **data);
+  void WriteSectors(int sectorNumber, int numSectors, char **data);
+                                // transfer to/from the UNIX files
   int TimeToSeek(int newSector, int *rotate);   // time to get to the new track
   int ModuloDiff(int to, Time from);            // # sectors between to and from
   void UpdateLast(int newSector);
+  int FlashLatency(int newSector, bool writing, int numSectors);
+  void Issue(int ticks, int64_t tag);   // schedule the end of a request
 };
 
 #endif   // DISK_H
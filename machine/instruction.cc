@@ -52,6 +52,15 @@ void
 Instruction::Decode()
 
 {
+  // A compressed instruction is decoded as the one it stands for
+  if ((value & 0x3) != 0x3) {
+    length = 2;
+    value = ExpandCompressed(value & 0xffff);
+  } else {
+    length = 4;
+    value = value & 0xffffffff;
+  }
+
   opcode = value & 0x7f;
   rs1 = ((value >> 15) & 0x1f);
   rs2 = ((value >> 20) & 0x1f);
@@ -81,6 +90,221 @@ Instruction::Decode()
   shamt = ((value >> 20) & 0x3f);
 }
 
+// Encoding of the 32-bit instruction formats, for ExpandCompressed
+static uint32_t
+EncodeR(int opcode, int rd, int funct3, int rs1, int rs2, int funct7) {
+  return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+         (rd << 7) | opcode;
+}
+
+static uint32_t
+EncodeI(int opcode, int rd, int funct3, int rs1, int32_t imm) {
+  return ((imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) |
+         opcode;
+}
+
+static uint32_t
+EncodeS(int opcode, int funct3, int rs1, int rs2, int32_t imm) {
+  return (((imm >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) |
+         (funct3 << 12) | ((imm & 0x1f) << 7) | opcode;
+}
+
+static uint32_t
+EncodeB(int funct3, int rs1, int rs2, int32_t imm) {
+  return (((imm >> 12) & 1) << 31) | (((imm >> 5) & 0x3f) << 25) |
+         (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+         (((imm >> 1) & 0xf) << 8) | (((imm >> 11) & 1) << 7) | RISCV_BR;
+}
+
+static uint32_t
+EncodeJ(int rd, int32_t imm) {
+  return (((imm >> 20) & 1) << 31) | (((imm >> 1) & 0x3ff) << 21) |
+         (((imm >> 11) & 1) << 20) | (((imm >> 12) & 0xff) << 12) |
+         (rd << 7) | RISCV_JAL;
+}
+
+// Bit field of a compressed instruction, and sign extension
+#define CBITS(c, hi, lo) (((c) >> (lo)) & ((1 << ((hi) - (lo) + 1)) - 1))
+#define SEXT(v, bits) ((int32_t) ((uint32_t) (v) << (32 - (bits))) >> (32 - (bits)))
+
+//----------------------------------------------------------------------
+// Instruction::ExpandCompressed
+/*!	Expand a compressed (RVC, RV64C) instruction into the 32-bit
+//	instruction it stands for.
+//
+//	\param c the compressed instruction
+//	\return the 32-bit instruction, 0 (illegal) if c is reserved
+*/
+//----------------------------------------------------------------------
+uint32_t
+Instruction::ExpandCompressed(uint16_t c) {
+  int funct3 = CBITS(c, 15, 13);
+  int rd = CBITS(c, 11, 7);        // rd/rs1 of the CI and CR formats
+  int rs2 = CBITS(c, 6, 2);        // rs2 of the CR and CSS formats
+  int rdp = CBITS(c, 4, 2) + 8;    // rd'/rs2' of the CIW, CL, CS formats
+  int rs1p = CBITS(c, 9, 7) + 8;   // rs1' of the CL, CS, CB formats
+  int32_t imm6 = SEXT((CBITS(c, 12, 12) << 5) | CBITS(c, 6, 2), 6);
+  int shamt = (CBITS(c, 12, 12) << 5) | CBITS(c, 6, 2);
+  int32_t imm;
+
+  switch (c & 0x3) {
+  case RISCV_C_Q0:
+    switch (funct3) {
+    case 0:   // c.addi4spn
+      imm = (CBITS(c, 12, 11) << 4) | (CBITS(c, 10, 7) << 6) |
+            (CBITS(c, 6, 6) << 2) | (CBITS(c, 5, 5) << 3);
+      if (imm == 0)
+        return 0;
+      return EncodeI(RISCV_OPI, rdp, RISCV_OPI_ADDI, 2, imm);
+    case 1:   // c.fld
+      imm = (CBITS(c, 12, 10) << 3) | (CBITS(c, 6, 5) << 6);
+      return EncodeI(RISCV_FLW, rdp, 3, rs1p, imm);
+    case 2:   // c.lw
+      imm = (CBITS(c, 12, 10) << 3) | (CBITS(c, 6, 6) << 2) |
+            (CBITS(c, 5, 5) << 6);
+      return EncodeI(RISCV_LD, rdp, RISCV_LD_LW, rs1p, imm);
+    case 3:   // c.ld
+      imm = (CBITS(c, 12, 10) << 3) | (CBITS(c, 6, 5) << 6);
+      return EncodeI(RISCV_LD, rdp, RISCV_LD_LD, rs1p, imm);
+    case 5:   // c.fsd
+      imm = (CBITS(c, 12, 10) << 3) | (CBITS(c, 6, 5) << 6);
+      return EncodeS(RISCV_FSW, 3, rs1p, rdp, imm);
+    case 6:   // c.sw
+      imm = (CBITS(c, 12, 10) << 3) | (CBITS(c, 6, 6) << 2) |
+            (CBITS(c, 5, 5) << 6);
+      return EncodeS(RISCV_ST, RISCV_ST_STW, rs1p, rdp, imm);
+    case 7:   // c.sd
+      imm = (CBITS(c, 12, 10) << 3) | (CBITS(c, 6, 5) << 6);
+      return EncodeS(RISCV_ST, RISCV_ST_STD, rs1p, rdp, imm);
+    default:
+      return 0;
+    }
+
+  case RISCV_C_Q1:
+    switch (funct3) {
+    case 0:   // c.addi, c.nop
+      return EncodeI(RISCV_OPI, rd, RISCV_OPI_ADDI, rd, imm6);
+    case 1:   // c.addiw
+      if (rd == 0)
+        return 0;
+      return EncodeI(RISCV_OPIW, rd, RISCV_OPIW_ADDIW, rd, imm6);
+    case 2:   // c.li
+      return EncodeI(RISCV_OPI, rd, RISCV_OPI_ADDI, 0, imm6);
+    case 3:
+      if (rd == 2) {   // c.addi16sp
+        imm = SEXT((CBITS(c, 12, 12) << 9) | (CBITS(c, 6, 6) << 4) |
+                       (CBITS(c, 5, 5) << 6) | (CBITS(c, 4, 3) << 7) |
+                       (CBITS(c, 2, 2) << 5),
+                   10);
+        if (imm == 0)
+          return 0;
+        return EncodeI(RISCV_OPI, 2, RISCV_OPI_ADDI, 2, imm);
+      }
+      // c.lui
+      if (imm6 == 0)
+        return 0;
+      return ((uint32_t) imm6 << 12) | (rd << 7) | RISCV_LUI;
+    case 4:
+      switch (CBITS(c, 11, 10)) {
+      case 0:   // c.srli
+        return EncodeI(RISCV_OPI, rs1p, RISCV_OPI_SRI, rs1p, shamt);
+      case 1:   // c.srai
+        return EncodeI(RISCV_OPI, rs1p, RISCV_OPI_SRI, rs1p,
+                       (RISCV_OPI_SRI_SRAI << 5) | shamt);
+      case 2:   // c.andi
+        return EncodeI(RISCV_OPI, rs1p, RISCV_OPI_ANDI, rs1p, imm6);
+      default:
+        switch ((CBITS(c, 12, 12) << 2) | CBITS(c, 6, 5)) {
+        case 0:   // c.sub
+          return EncodeR(RISCV_OP, rs1p, RISCV_OP_ADD, rs1p, rdp,
+                         RISCV_OP_ADD_SUB);
+        case 1:   // c.xor
+          return EncodeR(RISCV_OP, rs1p, RISCV_OP_XOR, rs1p, rdp, 0);
+        case 2:   // c.or
+          return EncodeR(RISCV_OP, rs1p, RISCV_OP_OR, rs1p, rdp, 0);
+        case 3:   // c.and
+          return EncodeR(RISCV_OP, rs1p, RISCV_OP_AND, rs1p, rdp, 0);
+        case 4:   // c.subw
+          return EncodeR(RISCV_OPW, rs1p, RISCV_OPW_ADDSUBW, rs1p, rdp,
+                         RISCV_OPW_ADDSUBW_SUBW);
+        case 5:   // c.addw
+          return EncodeR(RISCV_OPW, rs1p, RISCV_OPW_ADDSUBW, rs1p, rdp,
+                         RISCV_OPW_ADDSUBW_ADDW);
+        default:
+          return 0;
+        }
+      }
+    case 5:   // c.j
+      imm = SEXT((CBITS(c, 12, 12) << 11) | (CBITS(c, 11, 11) << 4) |
+                     (CBITS(c, 10, 9) << 8) | (CBITS(c, 8, 8) << 10) |
+                     (CBITS(c, 7, 7) << 6) | (CBITS(c, 6, 6) << 7) |
+                     (CBITS(c, 5, 3) << 1) | (CBITS(c, 2, 2) << 5),
+                 12);
+      return EncodeJ(0, imm);
+    default:   // c.beqz, c.bnez
+      imm = SEXT((CBITS(c, 12, 12) << 8) | (CBITS(c, 11, 10) << 3) |
+                     (CBITS(c, 6, 5) << 6) | (CBITS(c, 4, 3) << 1) |
+                     (CBITS(c, 2, 2) << 5),
+                 9);
+      return EncodeB((funct3 == 6) ? RISCV_BR_BEQ : RISCV_BR_BNE, rs1p, 0,
+                     imm);
+    }
+
+  case RISCV_C_Q2:
+    switch (funct3) {
+    case 0:   // c.slli
+      return EncodeI(RISCV_OPI, rd, RISCV_OPI_SLLI, rd, shamt);
+    case 1:   // c.fldsp
+      imm = (CBITS(c, 12, 12) << 5) | (CBITS(c, 6, 5) << 3) |
+            (CBITS(c, 4, 2) << 6);
+      return EncodeI(RISCV_FLW, rd, 3, 2, imm);
+    case 2:   // c.lwsp
+      if (rd == 0)
+        return 0;
+      imm = (CBITS(c, 12, 12) << 5) | (CBITS(c, 6, 4) << 2) |
+            (CBITS(c, 3, 2) << 6);
+      return EncodeI(RISCV_LD, rd, RISCV_LD_LW, 2, imm);
+    case 3:   // c.ldsp
+      if (rd == 0)
+        return 0;
+      imm = (CBITS(c, 12, 12) << 5) | (CBITS(c, 6, 5) << 3) |
+            (CBITS(c, 4, 2) << 6);
+      return EncodeI(RISCV_LD, rd, RISCV_LD_LD, 2, imm);
+    case 4:
+      if (CBITS(c, 12, 12) == 0) {
+        if (rs2 == 0) {   // c.jr
+          if (rd == 0)
+            return 0;
+          return EncodeI(RISCV_JALR, 0, 0, rd, 0);
+        }
+        // c.mv
+        return EncodeR(RISCV_OP, rd, RISCV_OP_ADD, 0, rs2, 0);
+      }
+      if (rs2 == 0) {
+        if (rd == 0)   // c.ebreak
+          return EncodeI(RISCV_SYSTEM, 0, RISCV_SYSTEM_ENV, 0,
+                         RISCV_SYSTEM_ENV_EBREAK);
+        // c.jalr
+        return EncodeI(RISCV_JALR, 1, 0, rd, 0);
+      }
+      // c.add
+      return EncodeR(RISCV_OP, rd, RISCV_OP_ADD, rd, rs2, 0);
+    case 5:   // c.fsdsp
+      imm = (CBITS(c, 12, 10) << 3) | (CBITS(c, 9, 7) << 6);
+      return EncodeS(RISCV_FSW, 3, 2, rs2, imm);
+    case 6:   // c.swsp
+      imm = (CBITS(c, 12, 9) << 2) | (CBITS(c, 8, 7) << 6);
+      return EncodeS(RISCV_ST, RISCV_ST_STW, 2, rs2, imm);
+    default:   // c.sdsp
+      imm = (CBITS(c, 12, 10) << 3) | (CBITS(c, 9, 7) << 6);
+      return EncodeS(RISCV_ST, RISCV_ST_STD, 2, rs2, imm);
+    }
+
+  default:   // not a compressed instruction
+    return 0;
+  }
+}
+
 std::string
 Instruction::printDecodedInstrRISCV(uint64_t pc) {
   if (this->opcode == RISCV_OPIW)   // If we are on opiw, shamt only have 5bits
@@ -257,6 +481,31 @@ Instruction::printDecodedInstrRISCV(uint64_t pc) {
       }
     }
     break;
+  case RISCV_ATOM: {
+    const char *op;
+    switch (this->funct7 >> 2) {
+    case RISCV_ATOM_LR:   op = "lr"; break;
+    case RISCV_ATOM_SC:   op = "sc"; break;
+    case RISCV_ATOM_SWAP: op = "amoswap"; break;
+    case RISCV_ATOM_ADD:  op = "amoadd"; break;
+    case RISCV_ATOM_XOR:  op = "amoxor"; break;
+    case RISCV_ATOM_AND:  op = "amoand"; break;
+    case RISCV_ATOM_OR:   op = "amoor"; break;
+    case RISCV_ATOM_MIN:  op = "amomin"; break;
+    case RISCV_ATOM_MAX:  op = "amomax"; break;
+    case RISCV_ATOM_MINU: op = "amominu"; break;
+    case RISCV_ATOM_MAXU: op = "amomaxu"; break;
+    default:              op = "amo???"; break;
+    }
+    stream << op << ((this->funct3 == RISCV_ATOM_W) ? ".w" : ".d");
+    stream << " \tx" + std::to_string(this->rd);
+    if ((this->funct7 >> 2) != RISCV_ATOM_LR)
+      stream << ",x" + std::to_string(this->rs2);
+    stream << ",(x" + std::to_string(this->rs1) + ")";
+  } break;
+  case RISCV_FENCE:
+    stream << "fence";
+    break;
   case RISCV_SYSTEM:
     stream << "ecall";
     break;
@@ -166,9 +166,6 @@
 // #define RISCV_FP_FMVXD 0x71
 // #define RISCV_FP_FMVDX 0x79
 
-// FIXME some special operations of the base instruction set are not yet
-// supported. (FENCE)
-
 /******************************************************************************
  * Specification of the standard M extension
  ********************************************
@@ -197,7 +194,30 @@
 
 #define RISCV_FENCE 0x0f
 
+/******************************************************************************
+ * Specification of the standard C extension
+ ********************************************
+ * Compressed instructions are 16-bit long, their two lower bits (quadrant)
+ * are not 0b11. Each one stands for a 32-bit instruction, into which it is
+ * expanded when decoded: only the length of the instruction differs.
+ ******************************************************************************/
+
+#define RISCV_C_Q0 0x0
+#define RISCV_C_Q1 0x1
+#define RISCV_C_Q2 0x2
+
+/******************************************************************************
+ * Specification of the standard A extension
+ ********************************************
+ * Atomic memory operations (AMO), load-reserved and store-conditional.
+ * funct3 gives the width (word or double word), the upper five bits of
+ * funct7 (funct5) the operation, its two lower bits are the aq/rl ordering
+ * bits (every access is sequentially consistent in the simulator).
+ ******************************************************************************/
+
 #define RISCV_ATOM      0x2f
+#define RISCV_ATOM_W    0x2
+#define RISCV_ATOM_D    0x3
 #define RISCV_ATOM_LR   0x2
 #define RISCV_ATOM_SC   0x3
 #define RISCV_ATOM_SWAP 0x1
@@ -228,11 +248,17 @@ public:
   short imm12_I_signed, imm12_S_signed, imm13, imm13_signed;
   uint32_t imm31_12, imm21_1;
   int32_t imm31_12_signed, imm21_1_signed;
+  uint8_t length;   //!< Length in bytes: 2 for a compressed (RVC)
+                    //!< instruction, 4 otherwise
   Instruction();
   Instruction(uint64_t val);
 
   void Decode();   //!< Decode the binary representation of the instruction
 
+  static uint32_t ExpandCompressed(uint16_t c);
+  //!< 32-bit instruction a compressed
+  //!< one stands for (0 if illegal)
+
   std::string printDecodedInstrRISCV(uint64_t pc);
 };
 
@@ -32,17 +32,25 @@
 //  DO NOT CHANGE -- part of the machine emulation
 //
 
+#include "kernel/scheduler.h"
 #include "kernel/system.h"
 #include "kernel/thread.h"
+#include "kernel/timerwheel.h"
 #include "machine/machine.h"
 #include "utility/stats.h"
+#include "utility/trace.h"
+#include "vm/physMem.h"
+
+//! Initial size of the heap of pending interrupts
+#define PENDING_INITIAL_SIZE 16
 
 //! String definition for debugging messages
 static char *intLevelNames[] = {(char *) "off", (char *) "on"};
 //! String definition for debugging messages
 static char *intTypeNames[] = {
     (char *) "timer",        (char *) "disk",         (char *) "console write",
-    (char *) "console read", (char *) "ACIA receive", (char *) "ACIA send"};
+    (char *) "console read", (char *) "ACIA receive", (char *) "ACIA send",
+    (char *) "input poll"};
 
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -61,6 +69,8 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int64_t param, Time t,
   arg = param;
   when = t;
   type = kind;
+  seq = 0;
+  next = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -72,9 +82,17 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int64_t param, Time t,
 //----------------------------------------------------------------------
 Interrupt::Interrupt() {
   level = INTERRUPTS_OFF;
-  pending = new ListTime;
+  maxPending = PENDING_INITIAL_SIZE;
+  pending = new PendingInterrupt *[maxPending];
+  numPending = 0;
+  nextDue = (Time) -1;
+  seq = 0;
+  freeList = NULL;
   inHandler = false;
+  interruptedStatus = IDLE_MODE;
   yieldOnReturn = false;
+  numInputs = 0;
+  inputPollPending = false;
 }
 
 //----------------------------------------------------------------------
@@ -82,9 +100,83 @@ Interrupt::Interrupt() {
 //! 	De-allocate the data structures needed by the interrupt simulation.
 //----------------------------------------------------------------------
 Interrupt::~Interrupt() {
-  while (!pending->IsEmpty())
-    delete (PendingInterrupt *) (pending->Remove());
-  delete pending;
+  for (int i = 0; i < numPending; i++)
+    delete pending[i];
+  delete[] pending;
+  while (freeList != NULL) {
+    PendingInterrupt *p = freeList;
+    freeList = p->next;
+    delete p;
+  }
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Before
+/*! 	Order of the heap of pending interrupts: by time, then in the
+//	order they were scheduled.
+//
+//	\return true if interrupt a has to fire before interrupt b
+*/
+//----------------------------------------------------------------------
+bool
+Interrupt::Before(PendingInterrupt *a, PendingInterrupt *b) {
+  return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::HeapInsert
+/*! 	Insert an interrupt in the heap of pending interrupts (sift up),
+//	and update the time of the next interrupt.
+*/
+//----------------------------------------------------------------------
+void
+Interrupt::HeapInsert(PendingInterrupt *toOccur) {
+  if (numPending == maxPending) {
+    PendingInterrupt **bigger = new PendingInterrupt *[2 * maxPending];
+    for (int i = 0; i < numPending; i++)
+      bigger[i] = pending[i];
+    delete[] pending;
+    pending = bigger;
+    maxPending *= 2;
+  }
+  int i = numPending++;
+  while (i > 0 && Before(toOccur, pending[(i - 1) / 2])) {
+    pending[i] = pending[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  pending[i] = toOccur;
+  nextDue = pending[0]->when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::HeapRemove
+/*! 	Remove the next interrupt from the heap of pending interrupts
+//	(sift down), and update the time of the next interrupt.
+//
+//	\return the removed interrupt
+*/
+//----------------------------------------------------------------------
+PendingInterrupt *
+Interrupt::HeapRemove() {
+  ASSERT(numPending > 0);
+  PendingInterrupt *top = pending[0];
+  PendingInterrupt *moved = pending[--numPending];
+  int i = 0;
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= numPending)
+      break;
+    if (child + 1 < numPending && Before(pending[child + 1], pending[child]))
+      child++;
+    if (!Before(pending[child], moved))
+      break;
+    pending[i] = pending[child];
+    i = child;
+  }
+  if (numPending > 0)
+    pending[i] = moved;
+  nextDue = (numPending > 0) ? pending[0]->when : (Time) -1;
+  return top;
 }
 
 //----------------------------------------------------------------------
@@ -139,21 +231,46 @@ Interrupt::SetStatus(IntStatus now) {
 //	Two things can cause OneTick to be called:
 //	- interrupts are re-enabled
 //	- a user instruction is executed
+//
+//	This is on the path of every instruction: when no interrupt is
+//	due yet (nextDue), nothing else is done.
+//
+//	\param nbcycles the time to advance (cycles)
+//	\param betweenInstructions is true when called by Machine::Run,
+//		after a user instruction
 */
 //----------------------------------------------------------------------
 void
-Interrupt::OneTick(int nbcycles) {
+Interrupt::OneTick(int nbcycles, bool betweenInstructions) {
   ASSERT(level == INTERRUPTS_ON);   // interrupts need to be enabled,
                                     // to check for an interrupt handler
 
   MachineStatus old = g_machine->GetStatus();
 
-  // advance simulated time
+  // charge the statistics batched by the simulator, then advance
+  // simulated time
+  g_machine->FlushStats();
   if (g_machine->GetStatus() == SYSTEM_MODE) {
     g_current_thread->GetProcessOwner()->stat->incrSystemTicks(nbcycles);
   } else {
     g_current_thread->GetProcessOwner()->stat->incrUserTicks(nbcycles);
   }
+  if (g_stats->SnapshotDue())
+    g_stats->Snapshot(false);
+
+  // End of the time window of the hart, simulate the next one (never
+  // with a single hart)
+  if (g_stats->getTotalTicks() >= g_machine->windowEnd) {
+    g_machine->harts[g_machine->currentHart].inUser = betweenInstructions;
+    ChangeLevel(INTERRUPTS_ON, INTERRUPTS_OFF);
+    g_machine->SetStatus(SYSTEM_MODE);
+    g_scheduler->SwitchHart(false);
+    g_machine->SetStatus(old);
+    ChangeLevel(INTERRUPTS_OFF, INTERRUPTS_ON);
+  }
+
+  if (g_stats->getTotalTicks() < nextDue)
+    return;
 
   // check any pending interrupts are now ready to fire
   ChangeLevel(INTERRUPTS_ON, INTERRUPTS_OFF);   // first, turn off interrupts
@@ -166,7 +283,8 @@ Interrupt::OneTick(int nbcycles) {
                          // for a context switch, ok to do it now
     yieldOnReturn = false;
     g_machine->SetStatus(SYSTEM_MODE);   // yield is a kernel routine
-    g_current_thread->Yield();
+    if (g_current_thread->Yield())
+      g_stats->incrPreemptions();
     g_machine->SetStatus(old);
   }
 }
@@ -199,12 +317,22 @@ Interrupt::YieldOnReturn() {
 //
 //	If there are no pending interrupts, stop.  There's nothing
 //	more for us to do.
+//
+//	The idle time is first used to zero a batch of free pages, for
+//	the next zero-fill page faults.
 */
 //----------------------------------------------------------------------
 void
 Interrupt::Idle() {
   DEBUG('i', (char *) "Machine idling; checking for interrupts.\n");
   g_machine->SetStatus(IDLE_MODE);
+  if (g_physical_mem_manager != NULL)
+    g_physical_mem_manager->ZeroFreePages(IDLE_ZERO_PAGES);
+  if (numInputs > 0 && WaitForInputs()) {
+    yieldOnReturn = false;
+    g_machine->SetStatus(SYSTEM_MODE);
+    return;   // input arrived, there may be a runnable thread
+  }
   if (CheckIfDue(true)) {       // check for any pending interrupts
     while (CheckIfDue(false))   // check for any other pending
       ;                         // interrupts
@@ -217,8 +345,8 @@ Interrupt::Idle() {
 
   // if there are no pending interrupts, and nothing is on the ready
   // queue, it is time to stop.   If the console or the ACIA is
-  // operating, there are *always* pending interrupts, so this code
-  // is not reached.  Instead, the halt must be invoked by the user program.
+  // operating, there are *always* pending interrupts (or watched
+  // inputs, waited for above), so this code is not reached.  Instead, the halt must be invoked by the user program.
 
   DEBUG('i', (char *) "Machine idle.  No interrupts to do.\n");
   printf("No threads ready or runnable, and no pending interrupts.\n");
@@ -244,7 +372,8 @@ Interrupt::Halt(int errorcode) {
 /*! 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it in a binary heap ordered by time, in a
+//	node taken from the pool of the previous interrupts.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -261,14 +390,24 @@ Interrupt::Schedule(VoidFunctionPtr handler, int64_t arg, int fromNow,
                     IntType type) {
   Time when;
   when = g_stats->getTotalTicks() + fromNow;
-  PendingInterrupt *toOccur = new PendingInterrupt(handler, arg, when, type);
+  PendingInterrupt *toOccur;
+  if (freeList != NULL) {
+    toOccur = freeList;
+    freeList = toOccur->next;
+    toOccur->handler = handler;
+    toOccur->arg = arg;
+    toOccur->when = when;
+    toOccur->type = type;
+  } else
+    toOccur = new PendingInterrupt(handler, arg, when, type);
 
   ASSERT(toOccur != NULL);
+  toOccur->seq = seq++;
 
   DEBUG('i', (char *) "Scheduling interrupt handler %s at time = %llu\n",
         intTypeNames[type], when);
   ASSERT(fromNow > 0);
-  pending->SortedInsert(toOccur, when);
+  HeapInsert(toOccur);
 }
 
 //----------------------------------------------------------------------
@@ -287,46 +426,236 @@ Interrupt::Schedule(VoidFunctionPtr handler, int64_t arg, int fromNow,
 //----------------------------------------------------------------------
 bool
 Interrupt::CheckIfDue(bool advanceClock) {
-  MachineStatus old = g_machine->GetStatus();
   Time when;
 
   ASSERT(level == INTERRUPTS_OFF);   // interrupts need to be disabled,
                                      // to invoke an interrupt handler
   if (DebugIsEnabled('i'))
     DumpState();
-  PendingInterrupt *toOccur = (PendingInterrupt *) pending->SortedRemove(&when);
-
-  if (toOccur == NULL)   // no pending interrupts
+  if (numPending == 0)   // no pending interrupts
   {
     return false;
   }
+  PendingInterrupt *toOccur = pending[0];
+  when = toOccur->when;
 
   if (advanceClock && when > g_stats->getTotalTicks()) {   // advance the clock
     g_stats->incrIdleTicks(when - g_stats->getTotalTicks());
     g_stats->setTotalTicks(when);
-    //	delete when;
-  } else if (when > g_stats->getTotalTicks()) {   // not time yet, put it back
-    pending->SortedInsert(toOccur, when);
+  } else if (when > g_stats->getTotalTicks()) {   // not time yet
     return false;
   }
 
-  // Check if there is nothing more to do, and if so, quit
+  // Check if there is nothing more to do, and if so, quit (unless the
+  // timer has to wake up sleeping threads)
   if ((g_machine->GetStatus() == IDLE_MODE) && (toOccur->type == TIMER_INT) &&
-      pending->IsEmpty()) {
-    pending->SortedInsert(toOccur, when);
+      numPending == 1 && g_timer_wheel->IsEmpty()) {
     printf("this is the end \n");
     return false;
   }
+  HeapRemove();
+
+  CallHandler(toOccur->handler, toOccur->arg, toOccur->type);
+  toOccur->next = freeList;   // recycle the node
+  freeList = toOccur;
+  return true;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::CallHandler
+/*! 	Run an interrupt handler, in the kernel, with interrupts
+//	disabled.
+//
+//	\param handler is the procedure to call
+//	\param arg is the argument to pass to the procedure
+//	\param type is the hardware device that generated the interrupt
+*/
+//----------------------------------------------------------------------
+void
+Interrupt::CallHandler(VoidFunctionPtr handler, int64_t arg, IntType type) {
+  MachineStatus old = g_machine->GetStatus();
 
   inHandler = true;
+  interruptedStatus = old;
+  TRACE(TRACE_INTERRUPT,
+        g_current_thread != NULL ? g_current_thread->GetTraceTrack() : 0, type,
+        0);
   g_machine->SetStatus(SYSTEM_MODE);   // whatever we were doing,
                                        // we are now going to be
                                        // running in the kernel
-  (*(toOccur->handler))(toOccur->arg);   // call the interrupt handler
-  g_machine->SetStatus(old);             // restore the machine status
+  (*handler)(arg);             // call the interrupt handler
+  g_machine->SetStatus(old);   // restore the machine status
   inHandler = false;
-  delete toOccur;
-  return true;
+}
+
+//----------------------------------------------------------------------
+// InputPoll
+//! 	Dummy function because C++ is weird about pointers to member functions
+//----------------------------------------------------------------------
+static void
+InputPoll(int64_t arg) {
+  Interrupt *interrupt = (Interrupt *) arg;
+  interrupt->PollInputs();
+}
+
+//----------------------------------------------------------------------
+// Interrupt::WatchInput
+/*! 	Watch a host file for input (EventInput mode). Instead of each
+//	device polling its file, the watched files are checked together
+//	every INPUT_POLL_TIME while the machine runs, and waited for on
+//	the host when it is idle.
+//
+//	\param fd is the host file (or socket)
+//	\param handler is the procedure to call when characters arrive
+//	\param arg is the argument to pass to the procedure
+//	\param type is the hardware device that generated the interrupt
+*/
+//----------------------------------------------------------------------
+void
+Interrupt::WatchInput(int fd, VoidFunctionPtr handler, int64_t arg,
+                      IntType type) {
+  for (int i = 0; i < numInputs; i++)
+    if (inputs[i].fd == fd)
+      return;
+  ASSERT(numInputs < MAX_INPUTS);
+  inputs[numInputs].fd = fd;
+  inputs[numInputs].handler = handler;
+  inputs[numInputs].arg = arg;
+  inputs[numInputs].type = type;
+  numInputs++;
+
+  if (!inputPollPending) {
+    inputPollPending = true;
+    Schedule(InputPoll, (int64_t) this,
+             nano_to_cycles(INPUT_POLL_TIME, g_cfg->ProcessorFrequency),
+             INPUT_INT);
+  }
+}
+
+//----------------------------------------------------------------------
+// Interrupt::UnwatchInput
+/*! 	Stop watching a host file for input.
+//
+//	\param fd is the host file (or socket)
+*/
+//----------------------------------------------------------------------
+void
+Interrupt::UnwatchInput(int fd) {
+  for (int i = 0; i < numInputs; i++)
+    if (inputs[i].fd == fd) {
+      inputs[i] = inputs[--numInputs];
+      return;
+    }
+}
+
+//----------------------------------------------------------------------
+// Interrupt::FireInputs
+/*! 	Call the handlers of the watched files which have input. A
+//	handler may stop watching its file, the others are looked up
+//	again.
+//
+//	\param fds the files checked
+//	\param ready true for the files with input
+//	\param count number of files checked
+*/
+//----------------------------------------------------------------------
+void
+Interrupt::FireInputs(int *fds, bool *ready, int count) {
+  for (int i = 0; i < count; i++) {
+    if (!ready[i])
+      continue;
+    for (int j = 0; j < numInputs; j++)
+      if (inputs[j].fd == fds[i]) {
+        CallHandler(inputs[j].handler, inputs[j].arg, inputs[j].type);
+        break;
+      }
+  }
+}
+
+//----------------------------------------------------------------------
+// Interrupt::PollInputs
+/*! 	Periodic check of the watched files while the machine runs,
+//	with a single host system call for all of them.
+*/
+//----------------------------------------------------------------------
+void
+Interrupt::PollInputs() {
+  int fds[MAX_INPUTS];
+  bool ready[MAX_INPUTS];
+  int count = numInputs;
+
+  inputPollPending = false;
+  for (int i = 0; i < count; i++)
+    fds[i] = inputs[i].fd;
+  if (count > 0 && WaitForInput(fds, ready, count, 0) > 0)
+    FireInputs(fds, ready, count);
+
+  // Poll again while files are watched
+  if (numInputs > 0 && !inputPollPending) {
+    inputPollPending = true;
+    Schedule(InputPoll, (int64_t) this,
+             nano_to_cycles(INPUT_POLL_TIME, g_cfg->ProcessorFrequency),
+             INPUT_INT);
+  }
+}
+
+//----------------------------------------------------------------------
+// Interrupt::WaitForInputs
+/*! 	Called by Idle when files are watched. If no device but the
+//	timer has work pending, block on the host until input arrives
+//	or until the next timer interrupt, instead of simulating polls
+//	until then. The simulated time jumps forward by the time waited.
+//
+//	When a device has work pending, its interrupt comes first: the
+//	host does not wait, the inputs are checked by the next poll.
+//
+// eturn
+//	true, if input arrived and its handlers were called
+*/
+//----------------------------------------------------------------------
+bool
+Interrupt::WaitForInputs() {
+  Time now = g_stats->getTotalTicks();
+  Time deadline = (Time) -1;
+  for (int i = 0; i < numPending; i++) {
+    if (pending[i]->type == INPUT_INT)
+      continue;
+    if (pending[i]->type != TIMER_INT)
+      return false;
+    deadline = MIN(deadline, pending[i]->when);
+  }
+  if (deadline <= now)
+    return false;
+
+  int fds[MAX_INPUTS];
+  bool ready[MAX_INPUTS];
+  int count = numInputs;
+  for (int i = 0; i < count; i++)
+    fds[i] = inputs[i].fd;
+
+  int64_t timeout = -1;
+  if (deadline != (Time) -1)
+    timeout = (deadline - now) * 1000 / g_cfg->ProcessorFrequency;
+  DEBUG('i', (char *) "Machine idle, waiting for input.\n");
+  int64_t start = HostTime();
+  bool arrived = (WaitForInput(fds, ready, count, timeout) > 0);
+  if (!arrived && deadline == (Time) -1)
+    return false;   // interrupted by a signal
+
+  // Jump forward by the time waited, up to the timer interrupt
+  Time end = deadline;
+  if (arrived) {
+    int64_t waited = HostTime() - start;
+    end = now + nano_to_cycles(waited, g_cfg->ProcessorFrequency);
+    if (end > deadline)
+      end = deadline;
+  }
+  g_stats->incrIdleTicks(end - now);
+  g_stats->setTotalTicks(end);
+
+  if (arrived)
+    FireInputs(fds, ready, count);
+  return arrived;
 }
 
 //----------------------------------------------------------------------
@@ -347,14 +676,15 @@ PrintPending(int64_t arg) {
 //----------------------------------------------------------------------
 // DumpState
 /*! 	Print the complete interrupt state - the status, and all interrupts
-//	that are scheduled to occur in the future.
+//	that are scheduled to occur in the future (in heap order).
 */
 //----------------------------------------------------------------------
 void
 Interrupt::DumpState() {
   printf("Pending interrupts:\n");
   fflush(stdout);
-  pending->Mapcar(PrintPending);
+  for (int i = 0; i < numPending; i++)
+    PrintPending((int64_t) pending[i]);
   printf("End of pending interrupts\n");
   fflush(stdout);
 }
@@ -50,9 +50,22 @@
 #include "kernel/copyright.h"
 #include "utility/list.h"
 
+//! Number of host files the interrupt simulation can watch (console, and
+//! a socket per port of the ACIA, up to ACIA_MAX_PORTS)
+#define MAX_INPUTS 68
+
+//! Free pages zeroed each time the machine is idle
+#define IDLE_ZERO_PAGES 32
+
 //! Interrupts can be disabled (INT_OFF) or enabled (INT_ON)
 enum IntStatus { INTERRUPTS_OFF, INTERRUPTS_ON };
 
+/*! Nachos-RiscV can be running kernel code (SYSTEM_MODE), user code
+ (USER_MODE), or there can be no runnable thread, because the ready list is
+ empty (IDLE_MODE).
+*/
+enum MachineStatus { IDLE_MODE, SYSTEM_MODE, USER_MODE };
+
 /*! IntType records which hardware device generated an interrupt.
  In Nachos, we support a hardware timer device, a disk, a console
  display, a keyboard and an ACIA.
@@ -63,7 +76,8 @@ enum IntType {
   CONSOLE_WRITE_INT,
   CONSOLE_READ_INT,
   ACIA_RECEIVE_INT,
-  ACIA_SEND_INT
+  ACIA_SEND_INT,
+  INPUT_INT
 };
 
 /*! \brief  Defines an interrupt that is scheduled
@@ -85,6 +99,8 @@ public:
   int64_t arg;             //!< The argument to the function.
   Time when;               //!< When the interrupt is supposed to fire
   IntType type;            //!< for debugging
+  uint64_t seq;            //!< Scheduling order, among equal "when"
+  PendingInterrupt *next;  //!< Next free node (pool of the interrupts)
 };
 
 /*! \brief Defines a low level interrupt hardware
@@ -116,6 +132,12 @@ public:
   void YieldOnReturn();   //!< Cause a context switch on return
                           //!< from an interrupt handler
 
+  MachineStatus GetInterruptedStatus() {
+    return interruptedStatus;
+  }   //!< Status of the machine when the running
+      //!< interrupt handler was called
+
+
   void DumpState();   //!< Print interrupt state
 
   // NOTE: the following are internal to the hardware simulation code.
@@ -128,19 +150,50 @@ public:
                 IntType type);   //!< at time ``when''.  This is called
                                  //!< by the hardware device simulators.
 
-  void OneTick(int nbcy);   // !<Advance simulated time of nbcy cycles
+  void OneTick(int nbcy, bool betweenInstructions = false);
+  //!< Advance simulated time of nbcy cycles
+
+  Time NextDue() { return nextDue; }   //!< Time of the next interrupt
+
+  void WatchInput(int fd,   //!< Call handler(arg) when characters
+                  VoidFunctionPtr handler,   //!< arrive on the host
+                  int64_t arg,               //!< file fd (EventInput
+                  IntType type);             //!< mode)
+
+  void UnwatchInput(int fd);   //!< Stop watching the host file fd
+
+  void PollInputs();   //!< Check the watched files without waiting
 
 private:
   IntStatus level;   //!< are interrupts enabled or disabled?
-  ListTime *pending; /*!< the list of interrupts scheduled
-                       to occur in the future
-                     */
+  PendingInterrupt **pending; /*!< binary heap of the interrupts
+                                scheduled to occur in the future,
+                                the next one first
+                              */
+  int numPending;             //!< number of interrupts in the heap
+  int maxPending;             //!< size of the heap array
+  Time nextDue;               //!< time of the next interrupt (heap top)
+  uint64_t seq;               //!< number of interrupts scheduled so far
+  PendingInterrupt *freeList; //!< recycled interrupt nodes
   bool inHandler;    //!< TRUE if we are running an interrupt handler
+  MachineStatus interruptedStatus;   //!< machine status before the running
+                                     //!< interrupt handler
 
   bool yieldOnReturn; /*!< TRUE if we are to context switch
                                 on return from the interrupt handler
                       */
 
+  //! Host file watched for input, and the handler of its characters
+  struct InputSource {
+    int fd;
+    VoidFunctionPtr handler;
+    int64_t arg;
+    IntType type;
+  };
+  InputSource inputs[MAX_INPUTS];   //!< The watched files
+  int numInputs;                    //!< Number of watched files
+  bool inputPollPending;            //!< A PollInputs is scheduled
+
   // these functions are internal to the interrupt simulation code
 
   bool CheckIfDue(bool advanceClock);   // Check if an interrupt is supposed
@@ -148,6 +201,20 @@ private:
 
   void ChangeLevel(IntStatus old,    // setStatus, without advancing the
                    IntStatus now);   // simulated time
+
+  void CallHandler(VoidFunctionPtr handler,   // run an interrupt handler
+                   int64_t arg, IntType type);
+
+  bool WaitForInputs();   // Idle: wait on the host for input, up to
+                          // the next timer interrupt
+
+  void FireInputs(int *fds, bool *ready,   // call the handlers of the
+                  int count);              // files with input
+
+  void HeapInsert(PendingInterrupt *toOccur);   // add to the heap
+  PendingInterrupt *HeapRemove();               // remove the heap top
+  bool Before(PendingInterrupt *a,              // heap order
+              PendingInterrupt *b);
 };
 
 #endif   // INTERRRUPT_H
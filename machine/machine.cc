@@ -26,6 +26,7 @@
 #include "kernel/msgerror.h"
 #include "kernel/system.h"
 #include "machine/interrupt.h"
+#include "machine/translator.h"
 
 /*! Textual names of the exceptions that can be generated by user program
  execution, for debugging purpose.
@@ -78,32 +79,136 @@ Machine::Machine(bool debug) {
     int_registers[i] = 0;
   for (i = 0; i < NUM_FP_REGS; i++)
     float_registers[i] = 0;
+  fpUsed = false;
 
-  // Allocate the main memory of the machine and fills it up with zeroes
-  int memSize = g_cfg->NumPhysPages * g_cfg->PageSize;
-  mainMemory = new int8_t[memSize];
-  for (i = 0; i < memSize; i++)
-    mainMemory[i] = 0;
+  // Allocate the main memory of the machine, filled with zeroes: the
+  // host pages are only allocated when the kernel or the programs
+  // first touch them
+  mainMemory = AllocZeroedArray((size_t) g_cfg->NumPhysPages *
+                                g_cfg->PageSize);
 
   // Check the endianess of the host machine
   CheckEndian();
 
   // Sets the debug mode of the machine according to the debug flag
   singleStep = debug;
+  fastForward = g_cfg->FastForward;
+
+  reserved = false;
+  reservedAddr = reservedValue = 0;
+
+  pendingInstructions = pendingMemAccesses = 0;
+  pendingTLBHits = pendingTLBMisses = 0;
+  for (i = 0; i < NUM_COST_CLASSES; i++)
+    pendingClass[i] = 0;
+  pendingMemCacheHits = pendingMemCacheMisses = 0;
 
   // Create the machine sub-components
-  this->mmu = new MMU();
+  this->mmu = new MMU(this);
+
+  // The first hart runs the boot thread, the others start idle
+  numHarts = g_cfg->NumHarts;
+  harts = new Hart[numHarts];
+  for (i = 0; i < numHarts; i++) {
+    harts[i].mmu = (i == 0) ? mmu : new MMU(this, mmu);
+    harts[i].thread = NULL;
+    harts[i].clock = harts[i].idleTicks = 0;
+    harts[i].inUser = harts[i].parallel = false;
+    harts[i].cpu = NULL;
+  }
+  currentHart = 0;
+  windowLength = MAX(nano_to_cycles((Time) g_cfg->HartWindow,
+                                    g_cfg->ProcessorFrequency),
+                     (Time) 1);
+  windowEnd = (numHarts > 1) ? windowLength : ~(Time) 0;
   this->interrupt = new Interrupt();
-  this->disk = new Disk(DISK_FILE_NAME, DiskRequestDone);
-  this->diskSwap = new Disk(DISK_SWAP_NAME, DiskSwapRequestDone);
+  // The first disk of each volume keeps the name of a single disk,
+  // the others are numbered from 1
+  this->disks = new Disk *[g_cfg->NumDisks];
+  this->swapDisks = new Disk *[g_cfg->NumDisks];
+  for (i = 0; i < (int) g_cfg->NumDisks; i++) {
+    char diskName[MAXSTRLEN], swapName[MAXSTRLEN];
+    strcpy(diskName, DISK_FILE_NAME);
+    strcpy(swapName, DISK_SWAP_NAME);
+    if (i > 0) {
+      sprintf(diskName + strlen(diskName), "%d", i);
+      sprintf(swapName + strlen(swapName), "%d", i);
+    }
+    this->disks[i] = new Disk(diskName, DiskRequestDone);
+    this->swapDisks[i] = new Disk(swapName, DiskSwapRequestDone);
+  }
   this->console = new Console(NULL, NULL, ConsoleGet, ConsolePut);
+#ifdef NACHOS_DBT
+  if (g_cfg->TranslationThreshold != 0)
+    this->translator = new Translator(this);
+  else
+#endif
+    this->translator = NULL;
   if (g_cfg->ACIA)
     this->acia = new ACIA(this);
   else
     this->acia = NULL;
 
+  // The host threads of the harts are only started when first needed
+  parent = NULL;
+  hostThreads = NULL;
+  parallelHarts = NULL;
+
   // Set the machine status
   status = SYSTEM_MODE;
+  exceptionRaised = false;
+}
+
+//----------------------------------------------------------------------
+// Machine::Machine
+/*! 	Constructor of the CPU of a hart, to run its user code on a host
+//	thread (see RunParallel). It has its own registers and statistics,
+//	and shares the rest with the machine.
+//
+//	\param machine the machine of the hart
+//	\param hart the number of the hart
+*/
+//----------------------------------------------------------------------
+Machine::Machine(Machine *machine, int hart) {
+  int i;
+
+  for (i = 0; i < NUM_INT_REGS; i++)
+    int_registers[i] = 0;
+  for (i = 0; i < NUM_FP_REGS; i++)
+    float_registers[i] = 0;
+  fpUsed = false;
+  reserved = false;
+  reservedAddr = reservedValue = 0;
+  is32Bits = 0;
+  pc = badvaddr_reg = 0;
+  mainMemory = machine->mainMemory;
+  mmu = machine->harts[hart].mmu;
+  harts = NULL;
+  numHarts = 0;
+  currentHart = hart;
+  windowLength = windowEnd = 0;
+  acia = NULL;
+  interrupt = machine->interrupt;
+  disks = swapDisks = NULL;
+  console = NULL;
+  translator = NULL;
+  pendingInstructions = pendingMemAccesses = 0;
+  pendingTLBHits = pendingTLBMisses = 0;
+  for (i = 0; i < NUM_COST_CLASSES; i++)
+    pendingClass[i] = 0;
+  pendingMemCacheHits = pendingMemCacheMisses = 0;
+  status = USER_MODE;
+  singleStep = false;
+  fastForward = false;
+  runUntilTime = 0;
+  uint64_t mask = ~(uint64_t) 0;   // masks of the logical shifts, as in Run
+  for (i = 0; i < 64; i++, mask >>= 1)
+    shiftMask[i] = mask;
+  exceptionRaised = false;
+  n_inst = cycle = 0;
+  parent = machine;
+  hostThreads = NULL;
+  parallelHarts = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -112,14 +217,44 @@ Machine::Machine(bool debug) {
 //      simulated RISCV machine.
 //----------------------------------------------------------------------
 Machine::~Machine() {
+  // The CPU of a hart owns nothing
+  if (parent != NULL)
+    return;
+
+  // Stop the host threads of the harts
+  if (hostThreads != NULL) {
+    pthread_mutex_lock(&parallelLock);
+    parallelQuit = true;
+    pthread_cond_broadcast(&parallelStart);
+    pthread_mutex_unlock(&parallelLock);
+    for (int i = 0; i < numHarts - 1; i++)
+      pthread_join(hostThreads[i], NULL);
+    for (int i = 0; i < numHarts; i++)
+      delete harts[i].cpu;
+    delete[] hostThreads;
+    delete[] parallelHarts;
+  }
+
   // Deallocate the machine components
-  delete this->mmu;
+  for (int i = 1; i < numHarts; i++)
+    delete harts[i].mmu;
+  delete this->harts[0].mmu;
+  delete[] harts;
   delete this->interrupt;
   if (this->acia != NULL)
     delete this->acia;
-  delete this->disk;
-  delete this->diskSwap;
+  for (uint32_t i = 0; i < g_cfg->NumDisks; i++) {
+    delete this->disks[i];
+    delete this->swapDisks[i];
+  }
+  delete[] this->disks;
+  delete[] this->swapDisks;
   delete this->console;
+#ifdef NACHOS_DBT
+  delete this->translator;
+#endif
+  DeallocZeroedArray(mainMemory,
+                     (size_t) g_cfg->NumPhysPages * g_cfg->PageSize);
 }
 
 //----------------------------------------------------------------------
@@ -134,6 +269,10 @@ Machine::~Machine() {
 //----------------------------------------------------------------------
 void
 Machine::RaiseException(ExceptionType which, int badVAddr) {
+  // Only the kernel handles exceptions, serially
+  if (parent != NULL)
+    Retry();
+
   // Sanity check of the exception number
   if (which <= EXCEPTION_NUMBER) {
     DEBUG('m', (char *) "Exception: %s at PC : %x\n", exceptionNames[which],
@@ -141,6 +280,7 @@ Machine::RaiseException(ExceptionType which, int badVAddr) {
 
     // Call of the exception handler
     badvaddr_reg = badVAddr;
+    exceptionRaised = true;
     this->status = SYSTEM_MODE;
     ExceptionHandler(which, badVAddr);   // call the exception handler
     this->status = USER_MODE;            // interrupts are enabled at this point
@@ -197,6 +337,81 @@ Machine::Debugger() {
   }
 }
 
+//----------------------------------------------------------------------
+// Machine::FlushStats
+/*!	Charge the statistics batched by the simulator to the process of
+//	the current thread. The simulator only increments counters of the
+//	machine on the path of every instruction and memory access; they
+//	are charged here on each clock tick, before the pending interrupts
+//	are checked, and before each context switch so that they go to the
+//	process that caused them.
+*/
+//----------------------------------------------------------------------
+void
+Machine::FlushStats() {
+  if ((pendingInstructions | pendingMemAccesses | pendingTLBHits |
+       pendingTLBMisses) == 0)
+    return;
+  FlushStats(g_current_thread->GetProcessOwner()->stat);
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushStats
+/*!	Charge the statistics batched by the simulator to a process.
+//	In fast-forward mode, the instructions are only counted globally,
+//	and the other statistics are dropped.
+//
+//	\param stat the statistics of the process
+*/
+//----------------------------------------------------------------------
+void
+Machine::FlushStats(ProcessStat *stat) {
+  if (fastForward) {
+    g_stats->incrFastForwarded(pendingInstructions);
+    pendingInstructions = pendingMemAccesses = 0;
+    pendingTLBHits = pendingTLBMisses = 0;
+    pendingMemCacheHits = pendingMemCacheMisses = 0;
+    return;
+  }
+
+  stat->incrNumInstructions(pendingInstructions);
+  stat->incrMemoryAccesses(pendingMemAccesses);
+  stat->incrTLBHits(pendingTLBHits);
+  stat->incrTLBMisses(pendingTLBMisses);
+  pendingInstructions = pendingMemAccesses = 0;
+  pendingTLBHits = pendingTLBMisses = 0;
+
+  if (g_cfg->CostModel)
+    for (int i = 0; i < NUM_COST_CLASSES; i++) {
+      stat->incrInstrClass(i, pendingClass[i]);
+      pendingClass[i] = 0;
+    }
+  if (g_cfg->MemCacheLines != 0) {
+    stat->incrMemCache(pendingMemCacheHits, pendingMemCacheMisses);
+    pendingMemCacheHits = pendingMemCacheMisses = 0;
+  }
+}
+
+//----------------------------------------------------------------------
+// Machine::SetFastForward
+/*!	Switch between the fast-forward and the detailed modes, the
+//	statistics batched so far being charged in the mode they were
+//	counted in. Called by the Debug system call, and on the pc
+//	breakpoints of the configuration (DetailedStartPC, DetailedStopPC).
+//
+//	\param on true for the fast-forward mode
+*/
+//----------------------------------------------------------------------
+void
+Machine::SetFastForward(bool on) {
+  if (on == fastForward)
+    return;
+  FlushStats();
+  DEBUG('m', (char *) "Switching to the %s mode at pc 0x%" PRIx64 "\n",
+        on ? "fast-forward" : "detailed", pc);
+  fastForward = on;
+}
+
 //----------------------------------------------------------------------
 // Machine::DumpState
 /*! 	Print the user program's CPU state.  We might print the contents
@@ -261,6 +476,22 @@ Machine::WriteFPRegister(int num, int64_t value) {
   float_registers[num] = value;
 }
 
+//----------------------------------------------------------------------
+// Machine::UseFP
+/*! 	Called before each floating point instruction. On the first one
+//	since the running thread was restored without floating point state,
+//	the registers left by the previous thread are cleared.
+*/
+//----------------------------------------------------------------------
+void
+Machine::UseFP() {
+  if (fpUsed)
+    return;
+  for (int i = 0; i < NUM_FP_REGS; i++)
+    float_registers[i] = 0;
+  fpUsed = true;
+}
+
 //----------------------------------------------------------------------
 // Machine::Run
 /*! 	Make the RISCV machine start the execution of a user program.
@@ -289,17 +520,30 @@ Machine::Run() {
   // We are now in user mode
   this->status = USER_MODE;
 
-  // Machine main loop : execute instructions one at a time
+  // Machine main loop : execute instructions one at a time, or one
+  // basic block at a time if asked to in the configuration file (the
+  // debugger always runs instruction by instruction), or by batches in
+  // fast-forward mode
   for (;;) {
-    tps = OneInstruction(&instr);
+    if (fastForward && !singleStep)
+      tps = FastForward(&instr);
+    else if (g_cfg->BlockExecution && !singleStep)
+      tps = RunBlock(&instr);
+    else
+      tps = OneInstruction(&instr);
 
     // machine mode is not set accordingly in case of page faults
     // triggered by the instruction... Have to fix that
     this->status = USER_MODE;
 
+    // The pc breakpoints delimiting the region run in detailed mode
+    if ((uint64_t) pc ==
+        (fastForward ? g_cfg->DetailedStartPC : g_cfg->DetailedStopPC))
+      SetFastForward(!fastForward);
+
     // Advance simulated time and check if there are any pending
     // interrupts to be called.
-    interrupt->OneTick(tps);
+    interrupt->OneTick(tps, true);
 
     // Call the debugger is required
     if (singleStep && (runUntilTime <= g_stats->getTotalTicks()))
@@ -307,6 +551,348 @@ Machine::Run() {
   }
 }
 
+//----------------------------------------------------------------------
+// int Machine::RunBlock
+/*!	Execute user instructions up to the end of the current basic
+//	block, that is up to and including the first branch, JAL, JALR
+//	or ECALL, or the first instruction that raised an exception
+//	(page fault, bus error...). Blocks are also cut after
+//	MAX_BLOCK_LENGTH instructions so that straight-line code cannot
+//	delay interrupts for too long.
+//
+//	Instructions are fetched already decoded from the MMU cache, and
+//	Run charges the execution time of the whole block in a single
+//	OneTick call, so pending interrupts are only checked at block
+//	boundaries. Since block boundaries only depend on the program,
+//	simulated time stays deterministic.
+//
+//	A block run often enough is translated into host code (see
+//	Translator), which runs it up to the first instruction it leaves
+//	to the interpreter: the block then goes on here, with the same
+//	boundaries, time and statistics.
+//
+//  \param instr Instruction object used to execute the block
+//  \return Execution time of the block in cycles
+*/
+//----------------------------------------------------------------------
+int
+Machine::RunBlock(Instruction *instr) {
+  int execution_time = 0;
+  int n = 0;
+
+#ifdef NACHOS_DBT
+  uint32_t physAddr;
+  if (translator != NULL && mmu->ProbeTLB(pc, 2, false, &physAddr)) {
+    TranslatedBlock *block = translator->Lookup(pc, physAddr);
+    if (block != NULL) {
+      int64_t start = pc;
+      n = block->code();
+      mmu->ChargeFetches(start, n);
+      pendingInstructions += n;
+      n_inst += n;
+      cycle += n;
+      g_stats->incrTranslatedInstructions(n);
+      execution_time = n * USER_TICK;
+      if (n == block->length && block->complete)
+        return execution_time;
+    }
+  }
+#endif
+
+  for (; n < MAX_BLOCK_LENGTH; n++) {
+    exceptionRaised = false;
+    execution_time += OneInstruction(instr);
+    if (exceptionRaised)
+      break;
+
+    // Control transfer instructions end the block
+    if (instr->opcode == RISCV_BR || instr->opcode == RISCV_JAL ||
+        instr->opcode == RISCV_JALR || instr->opcode == RISCV_SYSTEM)
+      break;
+
+    // So does the end of the region run in detailed mode (see Run)
+    if ((uint64_t) pc == g_cfg->DetailedStopPC)
+      break;
+  }
+  return execution_time;
+}
+
+//----------------------------------------------------------------------
+// int Machine::FastForward
+/*!	Execute user instructions in fast-forward mode, up to and
+//	including the first system instruction (ECALL...), the first
+//	instruction that raised an exception, or FAST_FORWARD_BATCH
+//	instructions. The instructions only have their functional effect:
+//	each one is charged USER_TICK, whatever the cost model, memory
+//	accesses are not charged, and the statistics are not kept (see
+//	FlushStats). Pending interrupts are only checked between batches.
+//
+//	The batch also ends when the pc reaches DetailedStartPC, where Run
+//	switches to the detailed mode.
+//
+//  \param instr Instruction object used to execute the batch
+//  \return Execution time of the batch in cycles
+*/
+//----------------------------------------------------------------------
+int
+Machine::FastForward(Instruction *instr) {
+  int n;
+
+  for (n = 1; n <= FAST_FORWARD_BATCH; n++) {
+    exceptionRaised = false;
+    OneInstruction(instr);
+    if (exceptionRaised || instr->opcode == RISCV_SYSTEM ||
+        (uint64_t) pc == g_cfg->DetailedStartPC)
+      break;
+  }
+  return MIN(n, FAST_FORWARD_BATCH) * USER_TICK;
+}
+
+//----------------------------------------------------------------------
+// ParallelHostThread
+//!	Start routine of the host threads of the harts
+//----------------------------------------------------------------------
+static void *
+ParallelHostThread(void *machine) {
+  ((Machine *) machine)->ParallelWorker();
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+// Machine::RunParallel
+/*!	Run the user code of the harts on host threads, in parallel, up to
+//	time limit. Called by the scheduler each time it moves on to
+//	another hart, with the end of the time window or the next
+//	interrupt as limit: the harts do not depend on each other before.
+//
+//	Only the harts whose thread was left between two user instructions
+//	are run, each one on the CPU of the hart (a Machine sharing the main
+//	memory, with its own registers and statistics). Whatever needs the
+//	kernel (system call, exception, page fault, write to decoded code)
+//	stops the hart before the instruction (see Retry): the instruction
+//	is run again when the hart is simulated serially, as the kernel is
+//	only run by one host thread at a time. The time and the statistics
+//	are charged to the processes at the end of the phase.
+//
+//	The harts sharing memory see the stores of the others in the order
+//	of the host.
+//
+//	\param limit the time the harts are run up to
+*/
+//----------------------------------------------------------------------
+void
+Machine::RunParallel(Time limit) {
+  int i;
+
+  for (i = 0; i < numHarts; i++)
+    harts[i].parallel = false;
+
+  // Instructions are not printed from host threads
+  if (numHarts < 2 || singleStep || fastForward || DebugIsEnabled('m'))
+    return;
+
+  // Harts that can be run on host threads
+  parallelCount = 0;
+  for (i = 0; i < numHarts; i++) {
+    Hart *hart = &harts[i];
+    if (hart->thread != NULL && hart->inUser && hart->clock < limit)
+      parallelCount++;
+  }
+  if (parallelCount < 2)
+    return;
+
+  // Start the host threads on the first phase
+  if (hostThreads == NULL) {
+    for (i = 0; i < numHarts; i++)
+      harts[i].cpu = new Machine(this, i);
+    parallelHarts = new int[numHarts];
+    pthread_mutex_init(&parallelLock, NULL);
+    pthread_cond_init(&parallelStart, NULL);
+    pthread_cond_init(&parallelDone, NULL);
+    parallelPhase = 0;
+    parallelQuit = false;
+    hostThreads = new pthread_t[numHarts - 1];
+    for (i = 0; i < numHarts - 1; i++)
+      if (pthread_create(&hostThreads[i], NULL, ParallelHostThread, this) !=
+          0) {
+        printf("Error: cannot create the host threads of the harts\n");
+        exit(ERROR);
+      }
+  }
+
+  parallelCount = 0;
+  for (i = 0; i < numHarts; i++) {
+    Hart *hart = &harts[i];
+    if (hart->thread != NULL && hart->inUser && hart->clock < limit)
+      parallelHarts[parallelCount++] = i;
+  }
+  for (i = 0; i < parallelCount; i++) {
+    Hart *hart = &harts[parallelHarts[i]];
+    hart->thread->RestoreProcessorState(hart->cpu);
+    hart->mmu->cpu = hart->cpu;
+    hart->parallel = true;
+  }
+
+  // Run the phase, this host thread taking part
+  pthread_mutex_lock(&parallelLock);
+  parallelNext = 0;
+  parallelLimit = limit;
+  parallelActive = numHarts - 1;
+  parallelPhase++;
+  pthread_cond_broadcast(&parallelStart);
+  pthread_mutex_unlock(&parallelLock);
+  RunParallelHarts();
+  pthread_mutex_lock(&parallelLock);
+  while (parallelActive > 0)
+    pthread_cond_wait(&parallelDone, &parallelLock);
+  pthread_mutex_unlock(&parallelLock);
+
+  // Charge the time and the statistics of the harts to their processes
+  for (i = 0; i < parallelCount; i++) {
+    Hart *hart = &harts[parallelHarts[i]];
+    ProcessStat *stat = hart->thread->GetProcessOwner()->stat;
+    hart->mmu->cpu = this;
+    hart->thread->SaveProcessorState(hart->cpu);
+    Time before = g_stats->getTotalTicks();
+    hart->cpu->FlushStats(stat);
+    stat->incrUserTicks(hart->cpu->parallelTicks);
+    hart->clock += g_stats->getTotalTicks() - before;
+  }
+}
+
+//----------------------------------------------------------------------
+// Machine::ParallelWorker
+/*!	Main loop of the host threads of the harts: run harts on each
+//	phase started by RunParallel, until the machine is deleted.
+*/
+//----------------------------------------------------------------------
+void
+Machine::ParallelWorker() {
+  uint64_t phase = 0;
+
+  pthread_mutex_lock(&parallelLock);
+  for (;;) {
+    while (parallelPhase == phase && !parallelQuit)
+      pthread_cond_wait(&parallelStart, &parallelLock);
+    if (parallelQuit)
+      break;
+    phase = parallelPhase;
+    pthread_mutex_unlock(&parallelLock);
+    RunParallelHarts();
+    pthread_mutex_lock(&parallelLock);
+    if (--parallelActive == 0)
+      pthread_cond_signal(&parallelDone);
+  }
+  pthread_mutex_unlock(&parallelLock);
+}
+
+//----------------------------------------------------------------------
+// Machine::RunParallelHarts
+//!	Run the harts of the phase not taken yet by another host thread
+//----------------------------------------------------------------------
+void
+Machine::RunParallelHarts() {
+  int n;
+
+  while ((n = __atomic_fetch_add(&parallelNext, 1, __ATOMIC_RELAXED)) <
+         parallelCount) {
+    Hart *hart = &harts[parallelHarts[n]];
+    hart->cpu->RunHart(parallelLimit - hart->clock);
+  }
+}
+
+//----------------------------------------------------------------------
+// Machine::RunHart
+/*!	Run user instructions on the CPU of a hart, for a host thread, up
+//	to "budget" cycles or up to an instruction that needs the kernel.
+//
+//	\param budget the time to run (cycles)
+*/
+//----------------------------------------------------------------------
+void
+Machine::RunHart(Time budget) {
+  Instruction instr;
+
+  parallelTicks = 0;
+  if (sigsetjmp(retryPoint, 0) != 0) {
+    // Retry: back to the state before the instruction
+    pc = retryPc;
+    pendingInstructions = retryInstructions;
+    pendingMemAccesses = retryMemAccesses;
+    pendingTLBHits = retryTLBHits;
+    pendingTLBMisses = retryTLBMisses;
+    pendingMemCacheHits = retryMemCacheHits;
+    pendingMemCacheMisses = retryMemCacheMisses;
+    return;
+  }
+
+  // The memory accesses take time too, as charged by FlushStats
+  while (parallelTicks + pendingMemAccesses * MEMORY_TICKS +
+             pendingMemCacheMisses * g_cfg->MemCacheMissPenalty <
+         budget) {
+    retryPc = pc;
+    retryInstructions = pendingInstructions;
+    retryMemAccesses = pendingMemAccesses;
+    retryTLBHits = pendingTLBHits;
+    retryTLBMisses = pendingTLBMisses;
+    retryMemCacheHits = pendingMemCacheHits;
+    retryMemCacheMisses = pendingMemCacheMisses;
+    parallelTicks += OneInstruction(&instr);
+  }
+}
+
+//----------------------------------------------------------------------
+// Machine::Retry
+/*!	Stop the hart run by this host thread before the instruction being
+//	run, that needs the kernel. Never returns.
+*/
+//----------------------------------------------------------------------
+void
+Machine::Retry() {
+  ASSERT(parent != NULL);
+  siglongjmp(retryPoint, 1);
+}
+
+//----------------------------------------------------------------------
+// InstructionClass
+/*!	Class of an executed instruction for the cost model (COST_*)
+//
+//  \param instr the instruction
+//  \param taken true if it changed the control flow (branches)
+*/
+//----------------------------------------------------------------------
+static int
+InstructionClass(Instruction *instr, bool taken) {
+  switch (instr->opcode) {
+  case RISCV_LD:
+  case RISCV_FLW:
+    return COST_LOAD;
+  case RISCV_ST:
+  case RISCV_FSW:
+    return COST_STORE;
+  case RISCV_BR:
+    return taken ? COST_BRANCH_TAKEN : COST_BRANCH_NOT_TAKEN;
+  case RISCV_JAL:
+  case RISCV_JALR:
+    return COST_JUMP;
+  case RISCV_OP:
+  case RISCV_OPW:
+    return (instr->funct7 == 1) ? COST_MULDIV : COST_ALU;
+  case RISCV_FMADD:
+  case RISCV_FMSUB:
+  case RISCV_FNMSUB:
+  case RISCV_FNMADD:
+  case RISCV_FP:
+    return COST_FP;
+  case RISCV_ATOM:
+    return ((instr->funct7 >> 2) == RISCV_ATOM_LR) ? COST_LOAD : COST_STORE;
+  case RISCV_SYSTEM:
+    return COST_SYSTEM;
+  default:
+    return COST_ALU;
+  }
+}
+
 //----------------------------------------------------------------------
 // int Machine::OneInstruction
 /*!	Execute one instruction from a user-level program
@@ -337,18 +923,21 @@ Machine::Run() {
 int
 Machine::OneInstruction(Instruction *instr) {
   int execution_time;   // execution time of the instruction
-  if (!mmu->ReadMem(pc, 4, &(instr->value)))
+  Instruction *decoded;   // cached decoded form, owned by the MMU
+  if (!mmu->FetchInstruction(pc, &decoded))
     return 0;   // exception occurred
-  instr->Decode();
+  *instr = *decoded;
 
-  // Constant execution time for user instructions (see stats.h)
+  // Constant execution time for user instructions (see stats.h),
+  // unless the cost model charges it by class once it is executed
   execution_time = USER_TICK;
+  int64_t next_pc = pc + instr->length;
 
   // Update statistics
-  g_current_thread->GetProcessOwner()->stat->incrNumInstruction();
+  pendingInstructions++;
 
   // Print its textual representation if debug flag 'm' is set
-  if (DebugIsEnabled('m')) {
+  if (!fastForward && DebugIsEnabled('m')) {
     printf("%s: \t[PC: 0x%" PRIx64 "] \t%s\n", g_current_thread->GetName(), pc,
            instr->printDecodedInstrRISCV(pc).c_str());
     // DumpState();
@@ -360,7 +949,7 @@ Machine::OneInstruction(Instruction *instr) {
     // instr->printDecodedInstrRISCV().c_str());
   }
 
-  pc = pc + 4;
+  pc = pc + instr->length;
 
   uint64_t unsignedReg1 = 0;
   uint64_t unsignedReg2 = 0;
@@ -388,12 +977,12 @@ Machine::OneInstruction(Instruction *instr) {
     break;
 
   case RISCV_AUIPC:
-    int_registers[instr->rd] = pc - 4 + instr->imm31_12;
+    int_registers[instr->rd] = pc - instr->length + instr->imm31_12;
     break;
 
   case RISCV_JAL:
     int_registers[instr->rd] = pc;
-    pc = pc - 4 + instr->imm21_1_signed;
+    pc = pc - instr->length + instr->imm21_1_signed;
     break;
 
   case RISCV_JALR:
@@ -407,25 +996,25 @@ Machine::OneInstruction(Instruction *instr) {
     switch (instr->funct3) {
     case RISCV_BR_BEQ:
       if (int_registers[instr->rs1] == int_registers[instr->rs2]) {
-        pc = pc + (instr->imm13_signed) - 4;
+        pc = pc + (instr->imm13_signed) - instr->length;
       }
       break;
 
     case RISCV_BR_BNE:
       if (int_registers[instr->rs1] != int_registers[instr->rs2]) {
-        pc = pc + (instr->imm13_signed) - 4;
+        pc = pc + (instr->imm13_signed) - instr->length;
       }
       break;
 
     case RISCV_BR_BLT:
       if (int_registers[instr->rs1] < int_registers[instr->rs2]) {
-        pc = pc + (instr->imm13_signed) - 4;
+        pc = pc + (instr->imm13_signed) - instr->length;
       }
       break;
 
     case RISCV_BR_BGE:
       if (int_registers[instr->rs1] >= int_registers[instr->rs2]) {
-        pc = pc + (instr->imm13_signed) - 4;
+        pc = pc + (instr->imm13_signed) - instr->length;
       }
       break;
 
@@ -434,7 +1023,7 @@ Machine::OneInstruction(Instruction *instr) {
       unsignedReg2 = (uint64_t) int_registers[instr->rs2];
 
       if (unsignedReg1 < unsignedReg2) {
-        pc = pc + (instr->imm13_signed) - 4;
+        pc = pc + (instr->imm13_signed) - instr->length;
       }
       break;
 
@@ -443,7 +1032,7 @@ Machine::OneInstruction(Instruction *instr) {
       unsignedReg2 = (uint64_t) int_registers[instr->rs2];
 
       if (unsignedReg1 >= unsignedReg2) {
-        pc = pc + (instr->imm13_signed) - 4;
+        pc = pc + (instr->imm13_signed) - instr->length;
       }
       break;
 
@@ -593,6 +1182,84 @@ Machine::OneInstruction(Instruction *instr) {
     }
     break;
 
+  //************************************************************************
+  // Treatment for: ATOMIC INSTRUCTIONS (A extension)
+  case RISCV_ATOM: {
+    if (instr->funct3 != RISCV_ATOM_W && instr->funct3 != RISCV_ATOM_D) {
+      printf("In ATOM switch case, this should never happen... Instr was %x\n",
+             (int) instr->value);
+      exit(ERROR);
+    }
+    int size = (instr->funct3 == RISCV_ATOM_W) ? 4 : 8;
+    uint64_t addr = int_registers[instr->rs1];
+
+    // Atomic accesses must be naturally aligned
+    if (addr & (size - 1)) {
+      RaiseException(BUSERROR_EXCEPTION, addr);
+      return 0;
+    }
+
+    switch (instr->funct7 >> 2) {
+    case RISCV_ATOM_LR:
+      if (!mmu->ReadMem(addr, size, &value)) {
+        printf("RISCV_ATOM_LR = FAILURE\n");
+        return 0;
+      }
+      reserved = true;
+      reservedAddr = addr;
+      reservedValue = value;
+      int_registers[instr->rd] =
+          (size == 4) ? (int64_t) (int32_t) value : (int64_t) value;
+      break;
+
+    case RISCV_ATOM_SC: {
+      // The reservation set is the word read by LR: the store only
+      // happens if it still holds the value read (compare and swap,
+      // atomic with respect to the harts run by host threads)
+      bool stored = false;
+      if (reserved && reservedAddr == addr &&
+          !mmu->CompareAndSwap(addr, size, reservedValue,
+                               int_registers[instr->rs2], &stored)) {
+        printf("RISCV_ATOM_SC = FAILURE\n");
+        return 0;
+      }
+      reserved = false;
+      int_registers[instr->rd] = stored ? 0 : 1;
+    } break;
+
+    case RISCV_ATOM_SWAP:
+    case RISCV_ATOM_ADD:
+    case RISCV_ATOM_XOR:
+    case RISCV_ATOM_AND:
+    case RISCV_ATOM_OR:
+    case RISCV_ATOM_MIN:
+    case RISCV_ATOM_MAX:
+    case RISCV_ATOM_MINU:
+    case RISCV_ATOM_MAXU:
+      if (!mmu->AtomicMem(addr, size, instr->funct7 >> 2,
+                          int_registers[instr->rs2], &value)) {
+        printf("RISCV_ATOM_AMO = FAILURE\n");
+        return 0;
+      }
+      int_registers[instr->rd] = value;
+      break;
+
+    default:
+      printf("In ATOM switch case, this should never happen... Instr was %x\n",
+             (int) instr->value);
+      exit(ERROR);
+      break;
+    }
+  } break;
+
+  //************************************************************************
+  // Treatment for: FENCE INSTRUCTIONS
+  case RISCV_FENCE:
+    // Each hart sees its own accesses in order: only the harts run by
+    // host threads need to order their accesses to the main memory
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    break;
+
   //************************************************************************
   // Treatment for: OPI INSTRUCTIONS
   case RISCV_OPI:
@@ -862,7 +1529,7 @@ Machine::OneInstruction(Instruction *instr) {
   // Treatment for: SYSTEM INSTRUCTIONS
   case RISCV_SYSTEM:
     if (SYSCALL_EXCEPTION <= 33 && SYSCALL_EXCEPTION >= 0) {
-      g_machine->RaiseException(SYSCALL_EXCEPTION, pc);
+      RaiseException(SYSCALL_EXCEPTION, pc);
     } else {
       fprintf(stderr, "Unresolved system call %d\n", SYSCALL_EXCEPTION);
     }
@@ -871,6 +1538,7 @@ Machine::OneInstruction(Instruction *instr) {
   //************************************************************************
   // Treatment for: floating point operations
   case RISCV_FLW:
+    UseFP();
     if (!mmu->ReadMem(int_registers[instr->rs1] + instr->imm12_I_signed, 4,
                       &value))
       return 0;
@@ -878,7 +1546,7 @@ Machine::OneInstruction(Instruction *instr) {
     break;
 
   case RISCV_FSW:
-
+    UseFP();
     if (!mmu->WriteMem(
             (uint32_t) (int_registers[instr->rs1] + instr->imm12_S_signed), 4,
             float_registers[instr->rs2]))
@@ -887,30 +1555,35 @@ Machine::OneInstruction(Instruction *instr) {
     break;
 
   case RISCV_FMADD:
+    UseFP();
     float_registers[instr->rd] =
         float_registers[instr->rs1] * float_registers[instr->rs2] +
         float_registers[instr->rs3];
     break;
 
   case RISCV_FMSUB:
+    UseFP();
     float_registers[instr->rd] =
         float_registers[instr->rs1] * float_registers[instr->rs2] -
         float_registers[instr->rs3];
     break;
 
   case RISCV_FNMSUB:
+    UseFP();
     float_registers[instr->rd] =
         -float_registers[instr->rs1] * float_registers[instr->rs2] +
         float_registers[instr->rs3];
     break;
 
   case RISCV_FNMADD:
+    UseFP();
     float_registers[instr->rd] =
         -float_registers[instr->rs1] * float_registers[instr->rs2] -
         float_registers[instr->rs3];
     break;
 
   case RISCV_FP:
+    UseFP();
     switch (instr->funct7) {
     case RISCV_FP_ADD:
       float_registers[instr->rd] =
@@ -1041,7 +1714,7 @@ Machine::OneInstruction(Instruction *instr) {
   default:
     printf("In default part of switch opcode, instr %x is not handled yet "
            "(OPCode : %x, PC : %" PRIx64 ")  cycle is %d\n\n",
-           instr->opcode, instr->opcode, pc - 4, (int) cycle);
+           instr->opcode, instr->opcode, pc - instr->length, (int) cycle);
     exit(-1);
     break;
   }
@@ -1050,6 +1723,12 @@ Machine::OneInstruction(Instruction *instr) {
   n_inst = n_inst + 1;
   cycle++;
 
+  if (g_cfg->CostModel && !fastForward) {
+    int cls = InstructionClass(instr, pc != next_pc);
+    execution_time = g_cfg->InstructionCost[cls];
+    pendingClass[cls]++;
+  }
+
   // Now we have successfully executed the instruction.
   return execution_time;
 }
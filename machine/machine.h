@@ -46,6 +46,8 @@ class ACIA;
 #define NUM_FP_REGS  32   //!< Number of floating point registers
 
 #include <math.h> /* For emulating floating point RISCV instructions */
+#include <pthread.h>
+#include <setjmp.h>
 #include <sstream>
 #include <stdint.h>
 #include <string>
@@ -83,12 +85,9 @@ enum ExceptionType : short {
 // Possible exceptions recognized by the machine
 
 class Console;
-
-/*! Nachos-RiscV can be running kernel code (SYSTEM_MODE), user code
- (USER_MODE), or there can be no runnable thread, because the ready list is
- empty (IDLE_MODE).
-*/
-enum MachineStatus { IDLE_MODE, SYSTEM_MODE, USER_MODE };
+class Machine;
+class Thread;
+class Translator;
 
 // User program CPU state.  The full set of RISC registers, plus a few
 // more because we need to be able to start/stop a user program between
@@ -101,6 +100,10 @@ enum MachineStatus { IDLE_MODE, SYSTEM_MODE, USER_MODE };
 #define NUM_INT_REGS 32   //!< Number of integer registers
 #define NUM_FP_REGS  32   //!< Number of floating point registers
 
+#define MAX_BLOCK_LENGTH 256   //!< Max instructions run by Machine::RunBlock
+#define FAST_FORWARD_BATCH 1024   //!< Max instructions run by
+                                  //!< Machine::FastForward
+
 // Registers used for syscalls
 #define REG_NO_SYSCALL      17
 #define REG_RET_SYSCALL     10
@@ -109,6 +112,29 @@ enum MachineStatus { IDLE_MODE, SYSTEM_MODE, USER_MODE };
 #define REG_SYSCALL_PARAM_3 12
 #define REG_SYSCALL_PARAM_4 13
 
+/*! \brief One hart (hardware thread, or processor) of the machine
+//
+// The harts share the main memory and the devices. They are simulated
+// in turn on the host, each one for a time window (g_cfg->HartWindow)
+// of its own clock. The register file of a hart is the one of the
+// thread it runs: the registers are only saved and restored when the
+// simulation moves to another hart.
+//
+// With g_cfg->ParallelHarts, the user code of the harts is run on host
+// threads at the start of each window (see Machine::RunParallel).
+*/
+struct Hart {
+  MMU *mmu;         //!< MMU of the hart (TLB and memory cache)
+  Thread *thread;   //!< Thread running on the hart, NULL if idle
+  Time clock;       //!< Simulated time of the hart
+  Time idleTicks;   //!< Time the hart spent with nothing to run
+  bool inUser;      //!< Its thread was left between two user
+                    //!< instructions, and can be run by a host thread
+  Machine *cpu;     //!< CPU of the hart run by a host thread
+  bool parallel;    //!< The hart was run by a host thread in the
+                    //!< last parallel phase
+};
+
 /*! \brief Defines the simulated execution hardware
 //
 // User programs shouldn't be able to tell that they are running on our
@@ -129,6 +155,8 @@ class Machine {
 public:
   Machine(bool debug);   //!<  Constructor. Initialize the RISCV machine
                          //!<  for running user programs
+  Machine(Machine *machine, int hart);   //!< CPU of a hart of machine,
+                                         //!< run by a host thread
   ~Machine();            //!<  Destructor. De-allocate the data structures
 
   // Routines callable by the Nachos kernel
@@ -155,13 +183,44 @@ public:
   //!< Run one instruction of a user program.
   //!< Return the execution time of the instr (cycle)
 
+  int RunBlock(Instruction *instr);
+  //!< Run instructions up to the end of the
+  //!< current basic block (branch, jump,
+  //!< ecall or exception).
+  //!< Return the execution time of the block (cycle)
+
+  int FastForward(Instruction *instr);
+  //!< Run a batch of instructions in fast-forward
+  //!< mode, up to the next system instruction
+  //!< or exception.
+  //!< Return the execution time of the batch (cycle)
+
+  void SetFastForward(bool on);   //!< Switch between the fast-forward
+                                  //!< and the detailed modes
+  bool IsFastForward() { return fastForward; }
+
   void RaiseException(ExceptionType which, int badVAddr);
   //!< Trap to the Nachos kernel, because of a
   //!< system call or other exception.
 
+  void UseFP();   //!< Clear the floating point registers on the first
+                  //!< floating point instruction of a thread
+
   void Debugger();    //!< Invoke the user program debugger
   void DumpState();   //!< Print the user CPU and memory state
 
+  void FlushStats();   //!< Charge the batched statistics to the
+                       //!< process of the current thread
+  void FlushStats(ProcessStat *stat);   //!< ... to a process
+
+  void RunParallel(Time limit);   //!< Run the harts left in user mode
+                                  //!< on host threads up to time limit
+  bool InParallel() { return parent != NULL; }
+  //!< true for the CPU of a hart run by a host thread
+  void Retry();   //!< Abort the instruction of a hart run by a host
+                  //!< thread, for the kernel: it is run again serially
+  void ParallelWorker();   //!< Main loop of the host threads
+
   // Data structures -- all of these are accessible to Nachos kernel code.
   // "public" for convenience.
   //
@@ -176,6 +235,20 @@ public:
                                           // Warning : We actually only support
                                           // SINGLE precision float operations.
 
+  bool fpUsed;   /*!< true if float_registers belong to the running
+                   thread (it executed floating point instructions):
+                   they are then saved on context switches
+                 */
+
+  bool reserved;   /*!< true if the reservation set of a load-reserved
+                     (LR) is valid: it is cleared by the next
+                     store-conditional (SC), and saved with the
+                     registers of the thread on context switches
+                   */
+  uint64_t reservedAddr;    //!< Virtual address reserved by LR
+  uint64_t reservedValue;   /*!< Value read by LR: SC only succeeds if
+                              the memory still holds it */
+
   char is32Bits;   //!< is the program executed compiled in 32 or 64 bits
 
   int64_t pc;   //!< program counter
@@ -186,14 +259,41 @@ public:
                         code and data, while executing
                       */
 
-  MMU *mmu;             /*!< Machine memory management unit */
+  MMU *mmu;             /*!< Memory management unit of the current hart */
+  Hart *harts;          /*!< The harts, g_cfg->NumHarts of them */
+  int numHarts;         /*!< Number of harts */
+  int currentHart;      /*!< Hart being simulated: its thread is
+                          g_current_thread, its clock is the total
+                          time of g_stats */
+  Time windowLength;    /*!< Length of the time window (cycles) */
+  Time windowEnd;       /*!< End of the time window of the harts */
   ACIA *acia;           /*!< ACIA Hardware */
   Interrupt *interrupt; /*!< Interrupt management */
-  Disk *disk;           /*!< Raw disk device (hardware) */
-  Disk *diskSwap;       /*!< Swap raw disk device (hardware) */
+  Disk **disks;         /*!< Raw disk devices (hardware), the
+                          g_cfg->NumDisks disks of the volume of
+                          the file system */
+  Disk **swapDisks;     /*!< Swap raw disk devices (hardware),
+                          g_cfg->NumDisks of them */
   Console *console;     /*!< Console */
+  Translator *translator; /*!< Translator of the hot basic blocks into
+                            host code, NULL if disabled */
+
+  // Statistics counted by the simulator on each instruction and memory
+  // access, and charged to the running process by FlushStats (on each
+  // clock tick and on each context switch)
+  uint64_t pendingInstructions;   //!< Instructions executed
+  uint64_t pendingMemAccesses;    //!< Memory accesses
+  uint64_t pendingTLBHits;        //!< Translations found in the TLB
+  uint64_t pendingTLBMisses;      //!< Translations missed in the TLB
+  uint64_t pendingClass[NUM_COST_CLASSES];   //!< Instructions per class
+                                             //!< (cost model)
+  uint64_t pendingMemCacheHits;     //!< Accesses hitting the memory cache
+  uint64_t pendingMemCacheMisses;   //!< Accesses missing the memory cache
 
 private:
+  bool fastForward;   /*!< Run user code without timing details nor
+                        statistics, at USER_TICK per instruction (see
+                        FastForward) */
   MachineStatus status;   //!< idle, kernel mode, user mode
 
   bool singleStep;   /*!< Drop back into the debugger after each
@@ -204,6 +304,37 @@ private:
                      */
   uint64_t shiftMask[64];
 
+  bool exceptionRaised; /*!< Set by RaiseException, ends the basic
+                          block being run by RunBlock */
+
+  void RunHart(Time budget);   //!< Run user instructions on a host thread
+  void RunParallelHarts();     //!< Run harts of the phase until none left
+
+  // Parallel execution of the harts (see RunParallel)
+  Machine *parent;            //!< Machine of a hart CPU, NULL for the machine
+  sigjmp_buf retryPoint;      //!< Where Retry goes back to
+  int64_t retryPc;            //!< State before the instruction being run,
+  uint64_t retryInstructions; //!< restored by Retry
+  uint64_t retryMemAccesses;
+  uint64_t retryTLBHits;
+  uint64_t retryTLBMisses;
+  uint64_t retryMemCacheHits;
+  uint64_t retryMemCacheMisses;
+  Time parallelTicks;         //!< Time of the instructions run by the hart
+                              //!< in the phase
+  pthread_t *hostThreads;     //!< numHarts - 1 host threads, NULL until the
+                              //!< first phase
+  pthread_mutex_t parallelLock;
+  pthread_cond_t parallelStart;   //!< Signals a new phase, or the end
+  pthread_cond_t parallelDone;    //!< Signals the end of a phase
+  uint64_t parallelPhase;     //!< Number of the current phase
+  int parallelActive;         //!< Host threads still in the phase
+  bool parallelQuit;          //!< The host threads have to exit
+  int *parallelHarts;         //!< Harts run in the phase
+  int parallelCount;          //!< Number of them
+  int parallelNext;           //!< Next one for a host thread to take
+  Time parallelLimit;         //!< End of the phase
+
   uint64_t n_inst;
   uint64_t cycle;
 };
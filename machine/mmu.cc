@@ -36,22 +36,100 @@
 #include "kernel/msgerror.h"
 #include "kernel/system.h"
 #include "machine/machine.h"
+#include "machine/translator.h"
 #include "vm/pagefaultmanager.h"
 #include "vm/physMem.h"
+#include "utility/trace.h"
 
 //----------------------------------------------------------------------
 // MMU::MMU()
-/*! Construction. Empty for now
+/*! Construction. The TLB and the decoded-instruction cache start empty.
+//  The decoded instructions only depend on the main memory shared by
+//  the harts: the harts other than the boot one share its cache, so
+//  that a write to code drops the copies decoded on every hart.
+//
+//  \param machine is the machine charged for the accesses
+//  \param boot is the MMU of the boot hart, NULL for the boot hart
  */
 //----------------------------------------------------------------------
-MMU::MMU() { translationTable = NULL; }
+MMU::MMU(Machine *machine, MMU *boot) {
+  cpu = machine;
+  translationTable = NULL;
+  tlb = NULL;
+  tlbMask = 0;
+  superTlb = NULL;
+  superShift = 0;
+  if (g_cfg->TLBSize != 0) {
+    tlb = new TLBEntry[g_cfg->TLBSize];
+    tlbMask = g_cfg->TLBSize - 1;
+    if (g_cfg->SuperPagePages != 0) {
+      superTlb = new TLBEntry[SUPER_TLB_SIZE];
+      while ((1U << superShift) < g_cfg->SuperPagePages)
+        superShift++;
+    }
+    FlushTLB();
+  }
+  ownsDecoded = (boot == NULL);
+  if (ownsDecoded) {
+    decodedPages = new DecodedInstr *[g_cfg->NumPhysPages];
+    for (uint64_t i = 0; i < g_cfg->NumPhysPages; i++)
+      decodedPages[i] = NULL;
+  } else
+    decodedPages = boot->decodedPages;
+
+  // Memory cache of the cost model, where no line is valid
+  memCacheTags = NULL;
+  memCacheMask = memCacheLineShift = 0;
+  if (g_cfg->MemCacheLines != 0) {
+    memCacheTags = new uint32_t[g_cfg->MemCacheLines];
+    for (uint32_t i = 0; i < g_cfg->MemCacheLines; i++)
+      memCacheTags[i] = INVALID_LINE;
+    memCacheMask = g_cfg->MemCacheLines - 1;
+    while ((1U << memCacheLineShift) < g_cfg->MemCacheLineSize)
+      memCacheLineShift++;
+  }
+}
 
 //----------------------------------------------------------------------
 // MMU::~MMU()
-/*! Destructor. Empty for now
+/*! Destructor. De-allocate the TLB and the decoded-instruction cache
  */
 //----------------------------------------------------------------------
-MMU::~MMU() { translationTable = NULL; }
+MMU::~MMU() {
+  translationTable = NULL;
+  delete[] tlb;
+  delete[] superTlb;
+  delete[] memCacheTags;
+  if (!ownsDecoded)
+    return;
+  for (uint64_t i = 0; i < g_cfg->NumPhysPages; i++)
+    delete[] decodedPages[i];
+  delete[] decodedPages;
+}
+
+//----------------------------------------------------------------------
+// MMU::MemCacheAccess
+/*!     Look an access to main memory up in the direct-mapped memory
+//      cache of the cost model, and count it as a hit or a miss (each
+//      miss is charged MemCacheMissPenalty cycles, see stats.cc).
+//      The cache is left alone in fast-forward mode.
+//
+//	\param physAddr the physical address accessed
+*/
+//----------------------------------------------------------------------
+inline void
+MMU::MemCacheAccess(uint32_t physAddr) {
+  if (memCacheTags == NULL || cpu->IsFastForward())
+    return;
+  uint32_t line = physAddr >> memCacheLineShift;
+  uint32_t *tag = &memCacheTags[line & memCacheMask];
+  if (*tag == line)
+    cpu->pendingMemCacheHits++;
+  else {
+    *tag = line;
+    cpu->pendingMemCacheMisses++;
+  }
+}
 
 //----------------------------------------------------------------------
 // MMU::ReadMem
@@ -74,37 +152,41 @@ MMU::ReadMem(uint64_t virtAddr, int size, uint64_t *value) {
 
   DEBUG('z', (char *) "Reading VA 0x%x, size %d\n", virtAddr, size);
 
-  // Update statistics
-  g_current_thread->GetProcessOwner()->stat->incrMemoryAccess();
-
   // Perform address translation
   exc = Translate(virtAddr, &physAddr, size, false);
+  // A page fault may have resumed the thread on another hart
+  if (!cpu->InParallel() && g_machine->mmu != this)
+    return g_machine->mmu->ReadMem(virtAddr, size, value);
+
+  // Update statistics, once the access is on its final hart
+  cpu->pendingMemAccesses++;
   Translate(virtAddr, &physAddrEnd, size, false);
   if (exc == NO_EXCEPTION)
     ASSERT(physAddr == physAddrEnd);
 
   // Raise an exception if one has been detected during address translation
   if (exc != NO_EXCEPTION) {
-    g_machine->RaiseException(exc, virtAddr);
+    cpu->RaiseException(exc, virtAddr);
     return false;
   }
+  MemCacheAccess(physAddr);
 
   // Read data from main memory
   switch (size) {
   case 1:
-    *value = g_machine->mainMemory[physAddr];
+    *value = cpu->mainMemory[physAddr];
     break;
 
   case 2:
-    *value = *(uint16_t *) &g_machine->mainMemory[physAddr];
+    *value = *(uint16_t *) &cpu->mainMemory[physAddr];
     break;
 
   case 4:
-    *value = *(uint32_t *) &g_machine->mainMemory[physAddr];
+    *value = *(uint32_t *) &cpu->mainMemory[physAddr];
     break;
 
   case 8:
-    *value = *(uint64_t *) &g_machine->mainMemory[physAddr];
+    *value = *(uint64_t *) &cpu->mainMemory[physAddr];
     break;
 
   default:
@@ -138,45 +220,704 @@ MMU::WriteMem(uint64_t addr, int size, uint64_t value) {
   DEBUG('z', (char *) "Writing VA 0x%x, size %d, value 0x%x\n", addr, size,
         value);
 
-  // Update statistics
-  g_current_thread->GetProcessOwner()->stat->incrMemoryAccess();
-
   // Perform address translation
   exc = Translate(addr, &physicalAddress, size, true);
+  // A page fault may have resumed the thread on another hart
+  if (!cpu->InParallel() && g_machine->mmu != this)
+    return g_machine->mmu->WriteMem(addr, size, value);
+
+  // Update statistics, once the access is on its final hart
+  cpu->pendingMemAccesses++;
   Translate(addr, &physAddrEnd, size, true);
   if (exc == NO_EXCEPTION)
     ASSERT(physicalAddress == physAddrEnd);
 
   if (exc != NO_EXCEPTION) {
-    g_machine->RaiseException(exc, addr);
+    cpu->RaiseException(exc, addr);
     return false;
   }
 
+  // A hart run by a host thread cannot drop decoded instructions
+  // shared with the others: a write to code is run serially
+  if (cpu->InParallel() &&
+      decodedPages[physicalAddress >> g_cfg->PageShift] != NULL)
+    cpu->Retry();
+  MemCacheAccess(physicalAddress);
+
   // Write into the machine main memory
   switch (size) {
   case 1:
-    g_machine->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
+    cpu->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
     break;
 
   case 2:
-    *(uint16_t *) &g_machine->mainMemory[physicalAddress] =
+    *(uint16_t *) &cpu->mainMemory[physicalAddress] =
         (uint16_t) (value & 0xffff);
     break;
 
   case 4:
-    *(uint32_t *) &g_machine->mainMemory[physicalAddress] = (uint32_t) value;
+    *(uint32_t *) &cpu->mainMemory[physicalAddress] = (uint32_t) value;
     break;
   case 8:
-    *(uint64_t *) &g_machine->mainMemory[physicalAddress] = (uint64_t) value;
+    *(uint64_t *) &cpu->mainMemory[physicalAddress] = (uint64_t) value;
     break;
   default:
     ASSERT(false);
   }
+  InvalidateDecoded(physicalAddress, size);
   DEBUG('h', (char *) "\tValue written");
 
   return true;
 }
 
+//----------------------------------------------------------------------
+// MMU::TranslateAtomic
+/*!     Translate the virtual address of an atomic memory access, for
+//      writing, and count it as a single memory access.
+//
+//	\param addr the virtual address of the access
+//	\param size the size of the access (4 or 8 bytes)
+//	\param physAddr where to store the physical address
+//      \return Returns false if the translation step from
+//              virtual to physical memory failed (the exception has
+//              been raised), true otherwise.
+*/
+//----------------------------------------------------------------------
+bool
+MMU::TranslateAtomic(uint64_t addr, int size, uint32_t *physAddr) {
+  ExceptionType exc;
+
+  // Update statistics
+  cpu->pendingMemAccesses++;
+
+  exc = Translate(addr, physAddr, size, true);
+  if (exc != NO_EXCEPTION) {
+    cpu->RaiseException(exc, addr);
+    return false;
+  }
+
+  // As for WriteMem, a write to code is run serially
+  if (cpu->InParallel() && decodedPages[*physAddr >> g_cfg->PageShift] != NULL)
+    cpu->Retry();
+  MemCacheAccess(*physAddr);
+  return true;
+}
+
+//----------------------------------------------------------------------
+// AtomicResult
+/*!     Compute the value stored by an atomic memory operation.
+//
+//	\param op the operation (RISCV_ATOM_*)
+//	\param old the former contents of memory
+//	\param value the operand (register rs2)
+//	\param size the size of the operation (4 or 8 bytes)
+//      \return the new contents of memory
+*/
+//----------------------------------------------------------------------
+static uint64_t
+AtomicResult(int op, uint64_t old, uint64_t value, int size) {
+  // Comparisons of words are done on their (sign- or zero-) extension
+  int64_t sOld = (size == 4) ? (int32_t) old : (int64_t) old;
+  int64_t sValue = (size == 4) ? (int32_t) value : (int64_t) value;
+  uint64_t uOld = (size == 4) ? (uint32_t) old : old;
+  uint64_t uValue = (size == 4) ? (uint32_t) value : value;
+
+  switch (op) {
+  case RISCV_ATOM_SWAP:
+    return value;
+  case RISCV_ATOM_ADD:
+    return old + value;
+  case RISCV_ATOM_XOR:
+    return old ^ value;
+  case RISCV_ATOM_AND:
+    return old & value;
+  case RISCV_ATOM_OR:
+    return old | value;
+  case RISCV_ATOM_MIN:
+    return (sOld < sValue) ? old : value;
+  case RISCV_ATOM_MAX:
+    return (sOld > sValue) ? old : value;
+  case RISCV_ATOM_MINU:
+    return (uOld < uValue) ? old : value;
+  case RISCV_ATOM_MAXU:
+    return (uOld > uValue) ? old : value;
+  default:
+    ASSERT(false);
+    return 0;
+  }
+}
+
+//----------------------------------------------------------------------
+// MMU::AtomicMem
+/*!     Atomically read "size" bytes of virtual memory at "addr" and
+//      write back the result of the operation op with value. The
+//      operation uses a host compare-and-swap, so that it is also
+//      atomic between the harts run by host threads.
+//
+//	\param addr the virtual address of the access
+//	\param size the size of the access (4 or 8 bytes)
+//	\param op the operation (RISCV_ATOM_*)
+//	\param value the operand
+//	\param old where to store the former contents (sign-extended)
+//      \return Returns false if the translation step from
+//              virtual to physical memory failed (the exception has
+//              been raised), true otherwise.
+*/
+//----------------------------------------------------------------------
+bool
+MMU::AtomicMem(uint64_t addr, int size, int op, uint64_t value,
+               uint64_t *old) {
+  uint32_t physAddr;
+  if (!TranslateAtomic(addr, size, &physAddr))
+    return false;
+
+  if (size == 4) {
+    uint32_t *word = (uint32_t *) &cpu->mainMemory[physAddr];
+    uint32_t former = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+    while (!__atomic_compare_exchange_n(
+        word, &former, (uint32_t) AtomicResult(op, former, value, 4), false,
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+      ;
+    *old = (int64_t) (int32_t) former;
+  } else {
+    ASSERT(size == 8);
+    uint64_t *dword = (uint64_t *) &cpu->mainMemory[physAddr];
+    uint64_t former = __atomic_load_n(dword, __ATOMIC_SEQ_CST);
+    while (!__atomic_compare_exchange_n(dword, &former,
+                                        AtomicResult(op, former, value, 8),
+                                        false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST))
+      ;
+    *old = former;
+  }
+  InvalidateDecoded(physAddr, size);
+  return true;
+}
+
+//----------------------------------------------------------------------
+// MMU::CompareAndSwap
+/*!     Atomically write value into "size" bytes of virtual memory at
+//      "addr" if they hold expected (store-conditional).
+//
+//	\param addr the virtual address of the access
+//	\param size the size of the access (4 or 8 bytes)
+//	\param expected the value memory must hold
+//	\param value the value to write
+//	\param swapped set to true if the value has been written
+//      \return Returns false if the translation step from
+//              virtual to physical memory failed (the exception has
+//              been raised), true otherwise.
+*/
+//----------------------------------------------------------------------
+bool
+MMU::CompareAndSwap(uint64_t addr, int size, uint64_t expected,
+                    uint64_t value, bool *swapped) {
+  uint32_t physAddr;
+  if (!TranslateAtomic(addr, size, &physAddr))
+    return false;
+
+  if (size == 4) {
+    uint32_t former = (uint32_t) expected;
+    *swapped = __atomic_compare_exchange_n(
+        (uint32_t *) &cpu->mainMemory[physAddr], &former, (uint32_t) value,
+        false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  } else {
+    ASSERT(size == 8);
+    *swapped = __atomic_compare_exchange_n(
+        (uint64_t *) &cpu->mainMemory[physAddr], &expected, value, false,
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  }
+  if (*swapped)
+    InvalidateDecoded(physAddr, size);
+  return true;
+}
+
+//----------------------------------------------------------------------
+// MMU::CopyFromUser
+/*!     Copy "size" bytes of virtual memory at "addr" into the kernel
+//      buffer "dest". The address is translated once per page, and the
+//      part of each page is copied with a single memcpy from main
+//      memory. A page fault on a page is served before the page is
+//      copied, so a page copied earlier may be evicted meanwhile.
+//
+//	\param addr the virtual address to read from
+//	\param dest the kernel buffer to copy to
+//	\param size the number of bytes to copy
+//      \return Returns false if the translation step from
+//              virtual to physical memory failed (the exception has
+//              been raised), true otherwise.
+*/
+//----------------------------------------------------------------------
+bool
+MMU::CopyFromUser(uint64_t addr, char *dest, int size) {
+  while (size > 0) {
+    uint32_t physAddr;
+    int n = g_cfg->PageSize - (addr & g_cfg->PageMask);
+    if (n > size)
+      n = size;
+
+    ExceptionType exc = Translate(addr, &physAddr, 1, false);
+    if (exc != NO_EXCEPTION) {
+      cpu->RaiseException(exc, addr);
+      return false;
+    }
+    // A page fault may have resumed the thread on another hart
+    if (g_machine->mmu != this)
+      return g_machine->mmu->CopyFromUser(addr, dest, size);
+    memcpy(dest, &cpu->mainMemory[physAddr], n);
+
+    addr += n;
+    dest += n;
+    size -= n;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------
+// MMU::CopyToUser
+/*!     Copy "size" bytes of the kernel buffer "src" into virtual memory
+//      at "addr", one translation and one memcpy per page. The decoded
+//      instructions of the bytes written are invalidated, as in
+//      WriteMem.
+//
+//	\param addr the virtual address to write to
+//	\param src the kernel buffer to copy from
+//	\param size the number of bytes to copy
+//      \return Returns false if the translation step from
+//              virtual to physical memory failed (the exception has
+//              been raised), true otherwise.
+*/
+//----------------------------------------------------------------------
+bool
+MMU::CopyToUser(uint64_t addr, char *src, int size) {
+  while (size > 0) {
+    uint32_t physAddr;
+    int n = g_cfg->PageSize - (addr & g_cfg->PageMask);
+    if (n > size)
+      n = size;
+
+    ExceptionType exc = Translate(addr, &physAddr, 1, true);
+    if (exc != NO_EXCEPTION) {
+      cpu->RaiseException(exc, addr);
+      return false;
+    }
+    // A page fault may have resumed the thread on another hart
+    if (g_machine->mmu != this)
+      return g_machine->mmu->CopyToUser(addr, src, size);
+    memcpy(&cpu->mainMemory[physAddr], src, n);
+    InvalidateDecoded(physAddr, n);
+
+    addr += n;
+    src += n;
+    size -= n;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------
+// MMU::CopyStringFromUser
+/*!     Copy the '\0' terminated string at virtual address "addr" into
+//      "dest", one page at a time. At most "maxlen" bytes are copied,
+//      and dest is always terminated.
+//
+//	\param addr the virtual address of the string
+//	\param dest the kernel buffer to copy to
+//	\param maxlen the size of dest
+//      \return the number of bytes copied, including the '\0', or
+//              ERROR if the translation failed (the exception has been
+//              raised)
+*/
+//----------------------------------------------------------------------
+int
+MMU::CopyStringFromUser(uint64_t addr, char *dest, int maxlen) {
+  int copied = 0;
+
+  while (copied < maxlen) {
+    uint32_t physAddr;
+    int n = g_cfg->PageSize - (addr & g_cfg->PageMask);
+    if (n > maxlen - copied)
+      n = maxlen - copied;
+
+    ExceptionType exc = Translate(addr, &physAddr, 1, false);
+    if (exc != NO_EXCEPTION) {
+      dest[copied] = '\0';
+      cpu->RaiseException(exc, addr);
+      return ERROR;
+    }
+    // A page fault may have resumed the thread on another hart
+    if (g_machine->mmu != this) {
+      int rest = g_machine->mmu->CopyStringFromUser(addr, dest + copied,
+                                                    maxlen - copied);
+      return rest == ERROR ? ERROR : copied + rest;
+    }
+    char *from = (char *) &cpu->mainMemory[physAddr];
+    char *end = (char *) memchr(from, '\0', n);
+    if (end != NULL) {
+      memcpy(dest + copied, from, end - from + 1);
+      return copied + (end - from) + 1;
+    }
+    memcpy(dest + copied, from, n);
+
+    addr += n;
+    copied += n;
+  }
+  dest[maxlen - 1] = '\0';
+  return maxlen;
+}
+
+//----------------------------------------------------------------------
+// MMU::UserStringLength
+/*!     Return the length of the '\0' terminated string at virtual
+//      address "addr", scanning it one page at a time.
+//
+//	\param addr the virtual address of the string
+//      \return the length of the string, including the '\0', or
+//              ERROR if the translation failed (the exception has been
+//              raised)
+*/
+//----------------------------------------------------------------------
+int
+MMU::UserStringLength(uint64_t addr) {
+  int length = 0;
+
+  for (;;) {
+    uint32_t physAddr;
+    int n = g_cfg->PageSize - (addr & g_cfg->PageMask);
+
+    ExceptionType exc = Translate(addr, &physAddr, 1, false);
+    if (exc != NO_EXCEPTION) {
+      cpu->RaiseException(exc, addr);
+      return ERROR;
+    }
+    // A page fault may have resumed the thread on another hart
+    if (g_machine->mmu != this) {
+      int rest = g_machine->mmu->UserStringLength(addr);
+      return rest == ERROR ? ERROR : length + rest;
+    }
+    char *from = (char *) &cpu->mainMemory[physAddr];
+    char *end = (char *) memchr(from, '\0', n);
+    if (end != NULL)
+      return length + (end - from) + 1;
+
+    addr += n;
+    length += n;
+  }
+}
+
+//----------------------------------------------------------------------
+// MMU::FetchInstruction
+/*!     Fetch the instruction at virtual address "virtAddr" and return
+//      a pointer to its decoded form.
+//
+//      Decoded instructions are cached per physical page: the word is
+//      read from main memory and decoded only on the first fetch, or
+//      after the cached copy has been invalidated by a write to the
+//      word (WriteMem) or by the kernel reusing the physical page
+//      (InvalidateDecodedPage). The address is still translated on
+//      every fetch, so that page faults and U bits behave as before.
+//
+//	\param virtAddr the virtual address of the instruction
+//	\param instr the place to store a pointer to the decoded
+//              instruction. The pointed object belongs to the cache and
+//              must not be modified.
+//      \return Returns false if the translation step from
+//              virtual to physical memory failed, true otherwise.
+*/
+//----------------------------------------------------------------------
+bool
+MMU::FetchInstruction(uint64_t virtAddr, Instruction **instr) {
+  ExceptionType exc;
+  uint32_t physAddr;
+
+  // Update statistics
+  cpu->pendingMemAccesses++;
+
+  // Perform address translation: instructions are 2-byte aligned
+  exc = Translate(virtAddr, &physAddr, 2, false);
+  if (exc != NO_EXCEPTION) {
+    cpu->RaiseException(exc, virtAddr);
+    return false;
+  }
+  MemCacheAccess(physAddr);
+
+  // Look for the decoded instruction in the cache of its physical page
+  int halvesPerPage = g_cfg->PageSize / 2;
+  DecodedInstr *page = decodedPages[physAddr >> g_cfg->PageShift];
+  int offset = physAddr & g_cfg->PageMask;
+
+  // The cache is shared by the harts, a hart run by a host thread
+  // decodes missing instructions in a copy of its own
+  if (cpu->InParallel() && (page == NULL || !page[offset / 2].valid)) {
+    if (!ReadInstruction(virtAddr, physAddr, &uncachedInstr.value))
+      return false;
+    uncachedInstr.Decode();
+    *instr = &uncachedInstr;
+    return true;
+  }
+  if (page == NULL) {
+    page = new DecodedInstr[halvesPerPage];
+    for (int i = 0; i < halvesPerPage; i++)
+      page[i].valid = false;
+    decodedPages[physAddr >> g_cfg->PageShift] = page;
+  }
+  DecodedInstr *entry = &page[offset / 2];
+
+  // Miss: read and decode the instruction from main memory. A 32-bit
+  // instruction at the end of the page continues on the next virtual
+  // page: it is decoded each time, as a write to that page does not
+  // drop it from the cache
+  if (!entry->valid) {
+    if (!ReadInstruction(virtAddr, physAddr, &entry->instr.value))
+      return false;
+    if (offset == (int) g_cfg->PageSize - 2 && (entry->instr.value & 3) == 3) {
+      uncachedInstr.value = entry->instr.value;
+      uncachedInstr.Decode();
+      *instr = &uncachedInstr;
+      return true;
+    }
+    entry->instr.Decode();
+    entry->valid = true;
+  }
+
+  *instr = &entry->instr;
+  return true;
+}
+
+//----------------------------------------------------------------------
+// MMU::ReadInstruction
+/*!     Read the binary representation of the instruction at virtAddr:
+//      16 bits for a compressed instruction, 32 bits otherwise, its
+//      second half being translated apart at the end of a page.
+//
+//	\param virtAddr the virtual address of the instruction
+//	\param physAddr its translation
+//	\param value where to store the instruction
+//      \return Returns false if the translation of the second half
+//              failed (the exception has been raised), true otherwise.
+*/
+//----------------------------------------------------------------------
+bool
+MMU::ReadInstruction(uint64_t virtAddr, uint32_t physAddr, uint64_t *value) {
+  *value = *(uint16_t *) &cpu->mainMemory[physAddr];
+  if ((*value & 3) != 3)
+    return true;
+
+  uint32_t physHigh = physAddr + 2;
+  if ((physHigh & g_cfg->PageMask) == 0) {
+    ExceptionType exc = Translate(virtAddr + 2, &physHigh, 2, false);
+    if (exc != NO_EXCEPTION) {
+      cpu->RaiseException(exc, virtAddr + 2);
+      return false;
+    }
+  }
+  *value |= (uint64_t) *(uint16_t *) &cpu->mainMemory[physHigh] << 16;
+  return true;
+}
+
+//----------------------------------------------------------------------
+// MMU::InvalidateDecodedPage
+/*!     Drop all the decoded instructions of a physical page. Called by
+//      the kernel whenever the contents of the page are replaced
+//      behind the MMU (page allocated, loaded or freed).
+//
+//	\param physPage the physical page number
+*/
+//----------------------------------------------------------------------
+void
+MMU::InvalidateDecodedPage(int physPage) {
+  ASSERT(physPage >= 0 && physPage < (int) g_cfg->NumPhysPages);
+  DecodedInstr *page = decodedPages[physPage];
+  if (page == NULL)
+    return;
+  for (unsigned int i = 0; i < g_cfg->PageSize / 2; i++)
+    page[i].valid = false;
+#ifdef NACHOS_DBT
+  if (g_machine->translator != NULL)
+    g_machine->translator->InvalidatePage(physPage);
+#endif
+}
+
+//----------------------------------------------------------------------
+// MMU::InvalidateDecoded
+/*!     Drop the decoded instructions overlapping the "size" bytes
+//      written at physical address "physAddr".
+//
+//	\param physAddr the physical address written to
+//	\param size the number of bytes written
+*/
+//----------------------------------------------------------------------
+void
+MMU::InvalidateDecoded(uint32_t physAddr, int size) {
+  // Instructions are cached per halfword, a 32-bit one starting on
+  // the halfword before the range overlaps it too
+  uint32_t halvesPerPage = g_cfg->PageSize / 2;
+  uint32_t first = physAddr / 2;
+  if (first > 0 && (first % halvesPerPage) != 0)
+    first--;
+  for (uint32_t h = first; h <= (physAddr + size - 1) / 2; h++) {
+    if (h / halvesPerPage >= g_cfg->NumPhysPages)
+      break;
+    DecodedInstr *page = decodedPages[h / halvesPerPage];
+    if (page != NULL) {
+      page[h % halvesPerPage].valid = false;
+#ifdef NACHOS_DBT
+      if (g_machine->translator != NULL)
+        g_machine->translator->InvalidatePage(h / halvesPerPage);
+#endif
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+// MMU::LookupTLB
+/*!     Look a virtual page up in the TLB, and in the TLB of the
+//      superpages, searched at the same time.
+//
+//	\param vpn the virtual page number
+//	\param writing true if the access writes
+//      \return the physical page, or -1 if the TLB does not hold the
+//              page (with the write right if writing)
+*/
+//----------------------------------------------------------------------
+inline int
+MMU::LookupTLB(int vpn, bool writing) {
+  TLBEntry *entry = &tlb[vpn & tlbMask];
+  if (entry->valid && entry->virtualPage == (uint64_t) vpn &&
+      (!writing || entry->writeAllowed))
+    return entry->physicalPage;
+  if (superTlb != NULL) {
+    uint64_t superPage = (uint64_t) vpn >> superShift;
+    TLBEntry *super = &superTlb[superPage & (SUPER_TLB_SIZE - 1)];
+    if (super->valid && super->virtualPage == superPage &&
+        (!writing || super->writeAllowed))
+      return super->physicalPage + (vpn & (g_cfg->SuperPagePages - 1));
+  }
+  return -1;
+}
+
+//----------------------------------------------------------------------
+// MMU::ProbeTLB
+/*!     Translate a virtual address if the TLB holds its page, without
+//      changing anything: Translate, ReadMem and WriteMem then succeed
+//      without calling the kernel. Used by the translated code, which
+//      leaves the other accesses to the interpreter.
+//
+//	\param virtAddr the virtual address
+//	\param size the size of the access (1, 2, 4, 8)
+//	\param writing true if the access writes
+//	\param physAddr where to store the physical address
+//      \return true if the TLB holds the translation and the access is
+//              aligned as Translate requires
+*/
+//----------------------------------------------------------------------
+bool
+MMU::ProbeTLB(uint64_t virtAddr, int size, bool writing, uint32_t *physAddr) {
+  uint32_t addr = virtAddr;   // as truncated by Translate
+  if (tlb == NULL || ((size == 4) && (addr & 0x3)) ||
+      ((size == 2) && (addr & 0x1)))
+    return false;
+  int frame = LookupTLB(addr >> g_cfg->PageShift, writing);
+  if (frame < 0)
+    return false;
+  *physAddr = (frame << g_cfg->PageShift) + (addr & g_cfg->PageMask);
+  return true;
+}
+
+//----------------------------------------------------------------------
+// MMU::DecodedAt
+/*!     Give the decoded instruction cached for a physical address, for
+//      the binary translator.
+//
+//	\param physAddr the physical address of the instruction
+//      \return the decoded instruction, NULL if the cache does not
+//              hold it
+*/
+//----------------------------------------------------------------------
+Instruction *
+MMU::DecodedAt(uint32_t physAddr) {
+  DecodedInstr *page = decodedPages[physAddr >> g_cfg->PageShift];
+  if (page == NULL)
+    return NULL;
+  DecodedInstr *entry = &page[(physAddr & g_cfg->PageMask) / 2];
+  return entry->valid ? &entry->instr : NULL;
+}
+
+//----------------------------------------------------------------------
+// MMU::HoldsDecoded
+/*!     Tell if a write to a memory range may drop decoded instructions
+//      (see InvalidateDecoded): the translated code leaves such writes
+//      to the interpreter, since they may drop the code being run.
+//
+//	\param physAddr the physical address written to
+//	\param size the number of bytes written
+*/
+//----------------------------------------------------------------------
+bool
+MMU::HoldsDecoded(uint32_t physAddr, int size) {
+  uint32_t last = (physAddr + size - 1) >> g_cfg->PageShift;
+  return decodedPages[physAddr >> g_cfg->PageShift] != NULL ||
+         (last < g_cfg->NumPhysPages && decodedPages[last] != NULL);
+}
+
+//----------------------------------------------------------------------
+// MMU::ChargeFetches
+/*!     Count the statistics of instructions run by the translated code,
+//      as FetchInstruction would: their page is in the TLB, which the
+//      translated code does not change.
+//
+//	\param virtAddr the virtual address of the first instruction
+//	\param count the number of instructions
+*/
+//----------------------------------------------------------------------
+void
+MMU::ChargeFetches(uint64_t virtAddr, int count) {
+  if (count == 0)
+    return;
+  cpu->pendingMemAccesses += 2 * count;
+  cpu->pendingTLBHits += count;
+  translationTable->setBitU((uint32_t) virtAddr >> g_cfg->PageShift);
+}
+
+//----------------------------------------------------------------------
+// MMU::FlushTLB
+/*!     Invalidate all the TLB entries. Must be called whenever the
+//      translation table used by the MMU changes.
+*/
+//----------------------------------------------------------------------
+void
+MMU::FlushTLB() {
+  if (tlb == NULL)
+    return;
+  for (uint32_t i = 0; i <= tlbMask; i++)
+    tlb[i].valid = false;
+  if (superTlb != NULL)
+    for (uint32_t i = 0; i < SUPER_TLB_SIZE; i++)
+      superTlb[i].valid = false;
+}
+
+//----------------------------------------------------------------------
+// MMU::InvalidateTLBEntry
+/*!     Invalidate the TLB entries caching the translation of a virtual
+//      page, if any: its own and the one of its superpage.
+//
+//	\param virtualPage the virtual page number
+*/
+//----------------------------------------------------------------------
+void
+MMU::InvalidateTLBEntry(uint64_t virtualPage) {
+  if (tlb == NULL)
+    return;
+  TLBEntry *entry = &tlb[virtualPage & tlbMask];
+  if (entry->virtualPage == virtualPage)
+    entry->valid = false;
+  if (superTlb != NULL) {
+    uint64_t superPage = virtualPage >> superShift;
+    entry = &superTlb[superPage & (SUPER_TLB_SIZE - 1)];
+    if (entry->virtualPage == superPage)
+      entry->valid = false;
+  }
+}
+
 //----------------------------------------------------------------------
 // MMU::Translate(uint32_t virtAddr, uint32_t *physAddr, int size, bool writing)
 /*! 	Translate a virtual address into a physical address, using
@@ -215,8 +956,27 @@ MMU::Translate(uint32_t virtAddr, uint32_t *physAddr, int size, bool writing) {
   }
 
   // Compute virtual page number and offset in the page
-  int vpn = virtAddr / g_cfg->PageSize;
-  int offset = virtAddr % g_cfg->PageSize;
+  int vpn = virtAddr >> g_cfg->PageShift;
+  int offset = virtAddr & g_cfg->PageMask;
+
+  // Look for the translation in the TLB first, and in the TLB of the
+  // superpages, searched at the same time
+  TLBEntry *entry = NULL;
+  if (tlb != NULL) {
+    entry = &tlb[vpn & tlbMask];
+    int frame = LookupTLB(vpn, writing);
+    if (frame >= 0) {
+      cpu->pendingTLBHits++;
+      if (writing)
+        translationTable->setBitM(vpn);
+      translationTable->setBitU(vpn);
+      cpu->pendingMemAccesses++;
+      *physAddr = (frame << g_cfg->PageShift) + offset;
+      DEBUG('h', (char *) "TLB hit, phys addr = 0x%x\n", *physAddr);
+      return NO_EXCEPTION;
+    }
+    cpu->pendingTLBMisses++;
+  }
 
   /*
    * Complete the addres translation
@@ -238,24 +998,50 @@ MMU::Translate(uint32_t virtAddr, uint32_t *physAddr, int size, bool writing) {
 
   // Check access rights
   if (writing && !translationTable->getBitWriteAllowed(vpn)) {
-    DEBUG('h', (char *) "write access on read-only virtual page # %d !\n", vpn);
-    return READONLY_EXCEPTION;
+    if (!translationTable->getBitCow(vpn)) {
+      DEBUG('h', (char *) "write access on read-only virtual page # %d !\n",
+            vpn);
+      return READONLY_EXCEPTION;
+    }
+
+    // Copy-on-write page: the kernel gives it a private writable copy
+    DEBUG('h', (char *) "Raising copy-on-write exception for page number %i\n",
+          vpn);
+    cpu->RaiseException(READONLY_EXCEPTION, virtAddr);
+
+    // The thread may have slept in the kernel and be resumed on
+    // another hart, whose MMU then goes on with the translation
+    if (g_machine->mmu != this)
+      return g_machine->mmu->Translate(virtAddr, physAddr, size, writing);
+
+    if (!translationTable->getBitWriteAllowed(vpn)) {
+      printf("Error: copy on write failed (bit writeAllowed should be set to "
+             "1)\n");
+      exit(ERROR);
+    }
   }
 
-  // If the page is not yet in main memory, run the page fault manager
-  if (!translationTable->getBitValid(vpn)) {
+  // If the page is not yet in main memory, run the page fault manager.
+  // The thread may sleep in the kernel once the page is mapped (loading
+  // the neighbouring pages), and the page be evicted meanwhile: the
+  // fault is then taken again
+  while (!translationTable->getBitValid(vpn)) {
+    // The kernel is not run by the host threads of the harts
+    if (cpu->InParallel())
+      cpu->Retry();
+
     // Update statistics
     g_current_thread->GetProcessOwner()->stat->incrPageFault();
+    TRACE(TRACE_PAGE_FAULT, g_current_thread->GetTraceTrack(), 0, vpn);
     DEBUG('h', (char *) "Raising page fault exception for page number %i\n",
           vpn);
 
     // call the page fault manager
-    g_machine->RaiseException(PAGEFAULT_EXCEPTION, virtAddr);
+    cpu->RaiseException(PAGEFAULT_EXCEPTION, virtAddr);
 
-    if (!translationTable->getBitValid(vpn)) {
-      printf("Error: page fault failed (bit valid should be set to 1)\n");
-      exit(ERROR);
-    }
+    // Resumed on another hart (see above)
+    if (g_machine->mmu != this)
+      return g_machine->mmu->Translate(virtAddr, physAddr, size, writing);
   }
 
   // Make sure physical address is correct
@@ -271,9 +1057,26 @@ MMU::Translate(uint32_t virtAddr, uint32_t *physAddr, int size, bool writing) {
     translationTable->setBitM(vpn);
   }
   translationTable->setBitU(vpn);
-  g_current_thread->GetProcessOwner()->stat->incrMemoryAccess();
+  cpu->pendingMemAccesses++;
 
-  *physAddr = translationTable->getPhysicalPage(vpn) * g_cfg->PageSize + offset;
+  *physAddr = (translationTable->getPhysicalPage(vpn) << g_cfg->PageShift) +
+              offset;
   DEBUG('h', (char *) "phys addr = 0x%x\n", *physAddr);
+
+  // Fill the TLB entry, of the superpage if the page is part of one
+  if (entry != NULL && superTlb != NULL && translationTable->getSuperPage(vpn)) {
+    uint64_t superPage = (uint64_t) vpn >> superShift;
+    TLBEntry *super = &superTlb[superPage & (SUPER_TLB_SIZE - 1)];
+    super->valid = true;
+    super->virtualPage = superPage;
+    super->physicalPage = translationTable->getPhysicalPage(vpn) -
+                          (vpn & (g_cfg->SuperPagePages - 1));
+    super->writeAllowed = translationTable->getBitWriteAllowed(vpn);
+  } else if (entry != NULL) {
+    entry->valid = true;
+    entry->virtualPage = vpn;
+    entry->physicalPage = translationTable->getPhysicalPage(vpn);
+    entry->writeAllowed = translationTable->getBitWriteAllowed(vpn);
+  }
   return NO_EXCEPTION;
 }
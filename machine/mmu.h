@@ -23,13 +23,41 @@
 #ifndef MMU_H
 #define MMU_H
 
+class Machine;
+
+//! Tag of a memory cache set that holds no line
+#define INVALID_LINE 0xffffffff
+
+//! Number of entries of the TLB of the superpages
+#define SUPER_TLB_SIZE 8
+
+/*! \brief One decoded instruction kept by the MMU instruction cache
+ */
+struct DecodedInstr {
+  bool valid;          //!< true if instr matches the word in main memory
+  Instruction instr;   //!< Decoded copy of the word in main memory
+};
+
+/*! \brief One entry of the MMU software TLB
+ */
+struct TLBEntry {
+  bool valid;              //!< true if the entry holds a translation
+  uint64_t virtualPage;    //!< Virtual page number (tag)
+  int physicalPage;        //!< Physical page it is mapped to
+  bool writeAllowed;       //!< Copy of the page table write right (a
+                           //!< mapped page can always be read)
+};
+
 /*! \brief Defines a MMU - Memory Management Unit
  */
 // This object manages the memory of the simulated MIPS processor for
 // the Nachos kernel.
 class MMU {
 public:
-  MMU();
+  MMU(Machine *machine, MMU *boot = NULL);
+  //!< MMU of a hart of machine, sharing
+  //!< the decoded-instruction cache of
+  //!< the MMU of the boot hart if not NULL
 
   ~MMU();
 
@@ -45,6 +73,88 @@ public:
   //!< Return FALSE if a correct
   //!< translation couldn't be found.
 
+  bool AtomicMem(uint64_t addr, int size, int op, uint64_t value,
+                 uint64_t *old);
+  //!< Atomically apply the operation op
+  //!< (RISCV_ATOM_*) of value to 4 or 8
+  //!< bytes of virtual memory (at addr),
+  //!< returning the former contents
+  //!< (sign-extended) in old.
+  //!< Return FALSE if a correct
+  //!< translation couldn't be found.
+
+  bool CompareAndSwap(uint64_t addr, int size, uint64_t expected,
+                      uint64_t value, bool *swapped);
+  //!< Atomically write value into 4 or
+  //!< 8 bytes of virtual memory (at addr)
+  //!< if they hold expected.
+  //!< Return FALSE if a correct
+  //!< translation couldn't be found.
+
+  bool CopyFromUser(uint64_t addr, char *dest, int size);
+  //!< Copy "size" bytes of virtual memory
+  //!< (at addr) into a kernel buffer, one
+  //!< translation and one memcpy per page.
+  //!< Return FALSE if a correct
+  //!< translation couldn't be found.
+
+  bool CopyToUser(uint64_t addr, char *src, int size);
+  //!< Copy "size" bytes of a kernel buffer
+  //!< into virtual memory (at addr), one
+  //!< translation and one memcpy per page.
+  //!< Return FALSE if a correct
+  //!< translation couldn't be found.
+
+  int CopyStringFromUser(uint64_t addr, char *dest, int maxlen);
+  //!< Copy a '\0' terminated string of
+  //!< virtual memory (at addr), at most
+  //!< maxlen bytes. Return the number of
+  //!< bytes copied, or ERROR.
+
+  int UserStringLength(uint64_t addr);
+  //!< Return the length of a string of
+  //!< virtual memory (at addr), including
+  //!< its '\0', or ERROR.
+
+  bool FetchInstruction(uint64_t virtAddr, Instruction **instr);
+  //!< Fetch the instruction at virtAddr,
+  //!< decoding it only if it is not
+  //!< already in the decoded-instruction
+  //!< cache. Return FALSE if a correct
+  //!< translation couldn't be found.
+
+  void InvalidateDecodedPage(int physPage);
+  //!< Drop every decoded instruction of a
+  //!< physical page (page (re)loaded or freed)
+
+  // Routines of the binary translator (see Translator)
+  bool ProbeTLB(uint64_t virtAddr, int size, bool writing,
+                uint32_t *physAddr);
+  //!< Translate an address only if the TLB
+  //!< holds it, without side effect: the
+  //!< access then cannot raise an exception
+
+  Instruction *DecodedAt(uint32_t physAddr);
+  //!< Cached decoded instruction at physAddr,
+  //!< NULL if not in the cache
+
+  bool HoldsDecoded(uint32_t physAddr, int size);
+  //!< true if a write to the range may drop
+  //!< decoded instructions
+
+  void ChargeFetches(uint64_t virtAddr, int count);
+  //!< Count the statistics of count fetches
+  //!< from the page of virtAddr, found in
+  //!< the TLB
+
+  void FlushTLB();
+  //!< Invalidate every TLB entry (address
+  //!< space switch)
+
+  void InvalidateTLBEntry(uint64_t virtualPage);
+  //!< Invalidate the TLB entry of a virtual
+  //!< page whose mapping or rights changed
+
   ExceptionType Translate(uint32_t virtAddr, uint32_t *physAddr, int size,
                           bool writing);
   //!< Translate an address, and check for
@@ -57,6 +167,52 @@ public:
   // to physical addresses (relative to the beginning of "mainMemory")
   // is controlled by a traditional linear page table
   TranslationTable *translationTable;   //!< Pointer to the translation table
+
+  Machine *cpu;   /*!< Machine charged for the accesses, which takes the
+                    exceptions: the CPU of the hart while it is run by a
+                    host thread (see Machine::RunParallel) */
+
+private:
+  int LookupTLB(int vpn, bool writing);
+  //!< Physical page of vpn in the TLB or the
+  //!< TLB of the superpages, -1 if absent
+
+  void InvalidateDecoded(uint32_t physAddr, int size);
+  //!< Drop the decoded instructions
+  //!< overlapping a written memory range
+
+  bool TranslateAtomic(uint64_t addr, int size, uint32_t *physAddr);
+  //!< Translate the address of an atomic
+  //!< access, which writes memory
+
+  bool ReadInstruction(uint64_t virtAddr, uint32_t physAddr, uint64_t *value);
+  //!< Read the 16 or 32 bits of the
+  //!< instruction at virtAddr
+
+  void MemCacheAccess(uint32_t physAddr);
+  //!< Count a hit or a miss of the memory
+  //!< cache of the cost model
+
+  TLBEntry *tlb;          //!< Direct-mapped TLB, g_cfg->TLBSize entries
+  uint32_t tlbMask;       //!< g_cfg->TLBSize - 1, to index the TLB
+  TLBEntry *superTlb;     //!< Direct-mapped TLB of the superpages, tagged
+                          //!< by superpage number (NULL if none)
+  uint32_t superShift;    //!< log2(g_cfg->SuperPagePages)
+
+  DecodedInstr **decodedPages; /*!< Decoded-instruction cache, one array
+                                 of PageSize/2 entries per physical page
+                                 (instructions are 2-byte aligned),
+                                 allocated on the first fetch from it */
+  bool ownsDecoded;            //!< false if decodedPages is the one of
+                               //!< the boot hart
+  Instruction uncachedInstr;   //!< Instruction decoded out of the cache
+                               //!< (by a hart run by a host thread, or
+                               //!< across a page boundary)
+
+  uint32_t *memCacheTags;       //!< Direct-mapped memory cache of the cost
+                                //!< model: line held by each set, or NULL
+  uint32_t memCacheMask;        //!< g_cfg->MemCacheLines - 1
+  uint32_t memCacheLineShift;   //!< log2(g_cfg->MemCacheLineSize)
 };
 
 #endif   // MMU_H
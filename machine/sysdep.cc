@@ -44,9 +44,12 @@
 #include "utility/config.h"
 
 extern "C" {
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -54,9 +57,12 @@ extern "C" {
 #include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 // Port Number for sockets
@@ -133,6 +139,57 @@ PollFile(int fd) {
   return true;
 }
 
+//----------------------------------------------------------------------
+// WaitForInput
+/*!	Wait for characters to be read on a set of files or sockets,
+//	with a single poll system call for all of them.
+//
+//	\param fds the file descriptors
+//	\param ready set to true for the descriptors with characters
+//	\param count number of descriptors
+//	\param timeout longest wait in nanoseconds, forever if negative
+//	eturn the number of descriptors with characters
+*/
+//----------------------------------------------------------------------
+
+int
+WaitForInput(int *fds, bool *ready, int count, int64_t timeout) {
+  struct pollfd pfds[count];
+  for (int i = 0; i < count; i++) {
+    pfds[i].fd = fds[i];
+    pfds[i].events = POLLIN;
+    pfds[i].revents = 0;
+  }
+
+  // poll counts in milliseconds, round up not to wake up too early
+  int ms = (timeout < 0) ? -1 : (int) MIN((timeout + 999999) / 1000000,
+                                          (int64_t) INT_MAX);
+  int retVal = poll(pfds, count, ms);
+  if (retVal < 0) {
+    // Interrupted by a signal: nothing to read
+    ASSERT(errno == EINTR);
+    retVal = 0;
+  }
+  for (int i = 0; i < count; i++)
+    ready[i] = (retVal > 0) && (pfds[i].revents != 0);
+  return retVal;
+}
+
+//----------------------------------------------------------------------
+// HostTime
+/*!	Time of the host, to measure how long it waited
+//
+//	eturn the monotonic time in nanoseconds
+*/
+//----------------------------------------------------------------------
+
+int64_t
+HostTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 //----------------------------------------------------------------------
 // OpenForWrite
 /*! 	Open a file for writing.  Create it if it doesn't exist; truncate it
@@ -166,6 +223,38 @@ OpenForReadWrite(char *name, bool crashOnError) {
   return fd;
 }
 
+//----------------------------------------------------------------------
+// OpenForRead
+/*! 	Open a file for reading only.
+//	Return the file descriptor, or error if it doesn't exist.
+//
+//	\param name file name
+*/
+//----------------------------------------------------------------------
+int
+OpenForRead(char *name, bool crashOnError) {
+  int fd = open(name, O_RDONLY, 0);
+
+  ASSERT(!crashOnError || fd >= 0);
+  return fd;
+}
+
+//----------------------------------------------------------------------
+// OpenFifo
+/*! 	Open a named pipe for reading and writing without blocking,
+//	creating it if it doesn't exist.
+//
+//	\param name file name
+//	\return the file descriptor, -1 on error
+*/
+//----------------------------------------------------------------------
+int
+OpenFifo(char *name) {
+  if (mkfifo(name, 0666) < 0 && errno != EEXIST)
+    return -1;
+  return open(name, O_RDWR | O_NONBLOCK, 0);
+}
+
 //----------------------------------------------------------------------
 // Read
 //! 	Read characters from an open file.  Abort if read fails.
@@ -187,6 +276,17 @@ ReadPartial(int fd, char *buffer, int nBytes) {
   return read(fd, buffer, nBytes);
 }
 
+//----------------------------------------------------------------------
+// WritePartial
+/*!	Write characters to an open file, returning how many were written
+//	(-1 if none could be, on a full pipe that does not block).
+*/
+//----------------------------------------------------------------------
+int
+WritePartial(int fd, char *buffer, int nBytes) {
+  return write(fd, buffer, nBytes);
+}
+
 //----------------------------------------------------------------------
 // WriteFile
 //! 	Write characters to an open file.  Abort if write fails.
@@ -197,6 +297,37 @@ WriteFile(int fd, char *buffer, int nBytes) {
   ASSERT(retVal == nBytes);
 }
 
+//----------------------------------------------------------------------
+// ReadVector, WriteVector
+/*! 	Read or write count buffers of size bytes each, from or to
+//	consecutive bytes of an open file starting at offset, with a
+//	single system call.  Abort if the transfer fails.
+*/
+//----------------------------------------------------------------------
+void
+ReadVector(int fd, char **buffers, int count, int size, int offset) {
+  struct iovec iov[count];
+  ASSERT(count <= IOV_MAX);
+  for (int i = 0; i < count; i++) {
+    iov[i].iov_base = buffers[i];
+    iov[i].iov_len = size;
+  }
+  int retVal = preadv(fd, iov, count, offset);
+  ASSERT(retVal == count * size);
+}
+
+void
+WriteVector(int fd, char **buffers, int count, int size, int offset) {
+  struct iovec iov[count];
+  ASSERT(count <= IOV_MAX);
+  for (int i = 0; i < count; i++) {
+    iov[i].iov_base = buffers[i];
+    iov[i].iov_len = size;
+  }
+  int retVal = pwritev(fd, iov, count, offset);
+  ASSERT(retVal == count * size);
+}
+
 //----------------------------------------------------------------------
 // Lseek
 //! 	Change the location within an open file.  Abort on error.
@@ -207,6 +338,85 @@ Lseek(int fd, int offset, int whence) {
   ASSERT(retVal >= 0);
 }
 
+//----------------------------------------------------------------------
+// MapFile
+/*! 	Map the first bytes of an open file in memory, shared with the
+//	file so that writes in memory reach the file.
+//
+//	\param fd the file, open for reading and writing
+//	\param size number of bytes to map
+//	\return the address of the mapping, NULL if the file cannot be
+//	mapped
+*/
+//----------------------------------------------------------------------
+char *
+MapFile(int fd, size_t size) {
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED)
+    return NULL;
+  return (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// SyncMappedFile
+//! 	Write the modified pages of a mapping returned by MapFile to the file.
+//----------------------------------------------------------------------
+void
+SyncMappedFile(char *addr, size_t size) {
+  int retVal = msync(addr, size, MS_SYNC);
+  ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+//! 	Write back and remove a mapping returned by MapFile.
+//----------------------------------------------------------------------
+void
+UnmapFile(char *addr, size_t size) {
+  SyncMappedFile(addr, size);
+  madvise(addr, size, MADV_DONTNEED);
+  munmap(addr, size);
+}
+
+//----------------------------------------------------------------------
+// MapSharedFile
+/*! 	Map a host file shared with other processes, creating it filled
+//	with zeros if it doesn't exist.
+//
+//	\param name file name
+//	\param size size of the file
+//	\return the address of the mapping, NULL if the file exists with
+//	another size or cannot be mapped
+*/
+//----------------------------------------------------------------------
+char *
+MapSharedFile(char *name, size_t size) {
+  struct stat st;
+  int fd = open(name, O_RDWR | O_CREAT, 0666);
+
+  if (fd < 0)
+    return NULL;
+  // The processes creating the file at once all give it the same size
+  if (fstat(fd, &st) < 0 ||
+      (st.st_size == 0 && ftruncate(fd, size) < 0) ||
+      (st.st_size != 0 && (size_t) st.st_size != size)) {
+    close(fd);
+    return NULL;
+  }
+  char *addr = MapFile(fd, size);
+  close(fd);
+  return addr;
+}
+
+//----------------------------------------------------------------------
+// UnmapSharedFile
+//! 	Remove a mapping returned by MapSharedFile, without writing it back.
+//----------------------------------------------------------------------
+void
+UnmapSharedFile(char *addr, size_t size) {
+  munmap(addr, size);
+}
+
 //----------------------------------------------------------------------
 // Tell
 //! 	Report the current location within an open file.
@@ -263,7 +473,7 @@ CloseSocket(int sockID) {
 //! 	Initialize a UNIX socket address -- magical!
 //----------------------------------------------------------------------
 static void
-InitSocketName(struct sockaddr_in *uname, char *name) {
+InitSocketName(struct sockaddr_in *uname, char *name, int port) {
   struct hostent host, *haddr;
   int i;
   // we search the machine IP address
@@ -276,7 +486,7 @@ InitSocketName(struct sockaddr_in *uname, char *name) {
   // port definition
   uname->sin_family = AF_INET;
   // uname->sin_port=N_PORT;
-  uname->sin_port = g_cfg->NumPortDist;
+  uname->sin_port = port;
   bcopy(*host.h_addr_list, &(uname->sin_addr), 4);
   for (i = 0; i < 8; i++)
     uname->sin_zero[i] = 0;
@@ -286,10 +496,12 @@ InitSocketName(struct sockaddr_in *uname, char *name) {
 // AssignNameToSocket
 /*!	Give a UNIX file name to the IPC port, so other instances of Nachos
 //	can locate the port.
+//
+//	\param port the local port number
 */
 //----------------------------------------------------------------------
 void
-AssignNameToSocket(char *socketName, int sockID) {
+AssignNameToSocket(char *socketName, int sockID, int port) {
   struct sockaddr_in uname;
   struct in_addr sad;
   int i;
@@ -297,7 +509,7 @@ AssignNameToSocket(char *socketName, int sockID) {
   // port definition
   uname.sin_family = AF_INET;
   // uname.sin_port=N_PORT;
-  uname.sin_port = g_cfg->NumPortLoc;
+  uname.sin_port = port;
   sad.s_addr = 0;
   uname.sin_addr = sad;
   for (i = 0; i < 8; i++)
@@ -328,13 +540,16 @@ ReadFromSocket(int sockID, char *buffer, int packetSize) {
 // SendToSocket
 /*! 	Transmit a fixed size packet to another Nachos' IPC port.
 //	Abort on error.
+//
+//	\param port the port number of the other Nachos
 */
 //----------------------------------------------------------------------
 void
-SendToSocket(int sockID, char *buffer, int packetSize, char *toName) {
+SendToSocket(int sockID, char *buffer, int packetSize, char *toName,
+             int port) {
   struct sockaddr_in uName;
 
-  InitSocketName(&uName, toName);
+  InitSocketName(&uName, toName, port);
   sendto(sockID, buffer, packetSize, 0, (sockaddr *) &uName, sizeof(uName));
 }
 
@@ -400,17 +615,77 @@ Random() {
   return rand();
 }
 
+#ifdef HOST_FAST_SWITCH
+//----------------------------------------------------------------------
+// SwitchHostStack
+/*! 	Save the callee-saved registers of the running host context on
+//	its stack, store its stack pointer in *oldSp, and resume the host
+//	context whose stack pointer is newSp (saved by a previous call, or
+//	built by InitHostStack).
+//
+//	SwitchHostStack(void **oldSp, void *newSp)
+*/
+//----------------------------------------------------------------------
+asm(".text\n"
+    ".globl SwitchHostStack\n"
+    ".type SwitchHostStack, @function\n"
+    "SwitchHostStack:\n"
+    "  pushq %rbp\n"
+    "  pushq %rbx\n"
+    "  pushq %r12\n"
+    "  pushq %r13\n"
+    "  pushq %r14\n"
+    "  pushq %r15\n"
+    "  movq %rsp, (%rdi)\n"
+    "  movq %rsi, %rsp\n"
+    "  popq %r15\n"
+    "  popq %r14\n"
+    "  popq %r13\n"
+    "  popq %r12\n"
+    "  popq %rbx\n"
+    "  popq %rbp\n"
+    "  ret\n"
+    ".size SwitchHostStack, .-SwitchHostStack\n");
+
+//----------------------------------------------------------------------
+// InitHostStack
+/*! 	Build the initial frame of a host stack, such that the first
+//	SwitchHostStack to it calls func (which must never return).
+//
+//	\param stack the lowest address of the stack
+//	\param size the size of the stack (in bytes)
+//	\param func function executed on the stack
+//	\return the stack pointer to give to SwitchHostStack
+*/
+//----------------------------------------------------------------------
+void *
+InitHostStack(int8_t *stack, size_t size, VoidNoArgFunctionPtr func) {
+  uint64_t *sp = (uint64_t *) (((uintptr_t) (stack + size)) & ~(uintptr_t) 15);
+  *--sp = 0;                    // return address of func (never used)
+  *--sp = (uint64_t) func;      // popped by the ret of SwitchHostStack
+  for (int i = 0; i < 6; i++)   // rbp, rbx, r12-r15
+    *--sp = 0;
+  return sp;
+}
+#endif   // HOST_FAST_SWITCH
+
 //----------------------------------------------------------------------
 // AllocBoundedArray
-/*! 	Return the address of a dynamically alloacted array.
+/*! 	Return the address of a dynamically alloacted array, mapped
+//	with an inaccessible guard page just below it, so that a stack
+//	overflow faults on the host instead of corrupting memory.
 //
 //	\param size amount of useful space needed (in bytes)
 */
 //----------------------------------------------------------------------
 int8_t *
 AllocBoundedArray(size_t size) {
-  int8_t *ptr = new int8_t[size];
-  return ptr;
+  size_t pgSize = getpagesize();
+  int8_t *ptr = (int8_t *) mmap(NULL, pgSize + size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT(ptr != MAP_FAILED);
+  mprotect(ptr, pgSize, PROT_NONE);
+  return ptr + pgSize;
 }
 
 //----------------------------------------------------------------------
@@ -423,5 +698,43 @@ AllocBoundedArray(size_t size) {
 //----------------------------------------------------------------------
 void
 DeallocBoundedArray(int8_t *ptr, size_t size) {
-  delete[] ptr;
+  size_t pgSize = getpagesize();
+  munmap(ptr - pgSize, pgSize + size);
+}
+
+//----------------------------------------------------------------------
+// AllocZeroedArray
+/*! 	Return the address of a large array filled with zeroes. It is
+//	an anonymous mapping without swap reservation: the host only
+//	allocates (and zeroes) a page the first time it is touched, so
+//	that the memory used grows with the part of the array actually
+//	used. Transparent huge pages are asked for when the host has
+//	them.
+//
+//	\param size size of the array (in bytes)
+*/
+//----------------------------------------------------------------------
+int8_t *
+AllocZeroedArray(size_t size) {
+  int8_t *ptr = (int8_t *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                -1, 0);
+  ASSERT(ptr != MAP_FAILED);
+#ifdef MADV_HUGEPAGE
+  madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+  return ptr;
+}
+
+//----------------------------------------------------------------------
+// DeallocZeroedArray
+/*! 	Deallocate an array allocated by AllocZeroedArray.
+//
+//	\param ptr the array to be deallocated
+//	\param size size of the array (in bytes)
+*/
+//----------------------------------------------------------------------
+void
+DeallocZeroedArray(int8_t *ptr, size_t size) {
+  munmap(ptr, size);
 }
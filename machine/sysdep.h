@@ -44,16 +44,40 @@
 
 extern bool PollFile(int fd);
 
+/* Wait for characters to be read on any of the count files fds, at
+// most timeout nanoseconds (forever if negative). ready[i] is set if
+// there are characters on fds[i]. Return the number of such files.
+*/
+
+extern int WaitForInput(int *fds, bool *ready, int count, int64_t timeout);
+
+/* Host monotonic time, in nanoseconds
+*/
+
+extern int64_t HostTime();
+
 /* File operations: open/read/write/lseek/close, and check for error
 // For simulating the disk and the console devices.
 */
 
 extern int OpenForWrite(char *name);
 extern int OpenForReadWrite(char *name, bool crashOnError);
+extern int OpenForRead(char *name, bool crashOnError);
+extern int OpenFifo(char *name);
 extern void Read(int fd, char *buffer, int nBytes);
 extern int ReadPartial(int fd, char *buffer, int nBytes);
+extern int WritePartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, char *buffer, int nBytes);
+extern void ReadVector(int fd, char **buffers, int count, int size,
+                       int offset);
+extern void WriteVector(int fd, char **buffers, int count, int size,
+                        int offset);
 extern void Lseek(int fd, int offset, int whence);
+extern char *MapFile(int fd, size_t size);
+extern void SyncMappedFile(char *addr, size_t size);
+extern void UnmapFile(char *addr, size_t size);
+extern char *MapSharedFile(char *name, size_t size);
+extern void UnmapSharedFile(char *addr, size_t size);
 extern int Tell(int fd);
 extern void Close(int fd);
 extern bool Unlink(char *name);
@@ -62,10 +86,10 @@ extern bool Unlink(char *name);
 
 extern int OpenSocket();
 extern void CloseSocket(int sockID);
-extern void AssignNameToSocket(char *socketName, int sockID);
+extern void AssignNameToSocket(char *socketName, int sockID, int port);
 extern int ReadFromSocket(int sockID, char *buffer, int packetSize);
 extern void SendToSocket(int sockID, char *buffer, int packetSize,
-                         char *toName);
+                         char *toName, int port);
 
 // Process control: abort, exit, and sleep
 extern void Abort();
@@ -86,6 +110,25 @@ extern int Random();
 extern int8_t *AllocBoundedArray(size_t size);
 extern void DeallocBoundedArray(int8_t *p, size_t size);
 
+/* Allocate, de-allocate a large zero-filled array, whose host pages
+// are only allocated when they are first touched
+*/
+
+extern int8_t *AllocZeroedArray(size_t size);
+extern void DeallocZeroedArray(int8_t *p, size_t size);
+
+/* Switch between the host stacks of two threads, saving only the
+// callee-saved host registers (instead of a full ucontext, whose
+// swapcontext makes a sigprocmask system call on each switch).
+// Only provided on x86_64 hosts (HOST_FAST_SWITCH defined).
+*/
+#if defined(__x86_64__)
+#define HOST_FAST_SWITCH
+extern "C" void SwitchHostStack(void **oldSp, void *newSp);
+extern void *InitHostStack(int8_t *stack, size_t size,
+                           VoidNoArgFunctionPtr func);
+#endif
+
 /* Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 */
@@ -64,8 +64,23 @@ Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom) {
   randomize = doRandom;
   handler = timerHandler;
   arg = callArg;
+  armed = false;
 
   // schedule the first interrupt from the timer device
+  Arm();
+}
+
+//----------------------------------------------------------------------
+// Timer::Arm
+/*!      Schedule the next interrupt of the timer device, one time slice
+//	from now, unless one is already scheduled.
+*/
+//----------------------------------------------------------------------
+void
+Timer::Arm() {
+  if (armed)
+    return;
+  armed = true;
   g_machine->interrupt->Schedule(TimerHandler, (int64_t) this,
                                  TimeOfNextInterrupt(), TIMER_INT);
 }
@@ -73,15 +88,13 @@ Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom) {
 //----------------------------------------------------------------------
 // Timer::TimerExpired
 /*!      Routine to simulate the interrupt generated by the hardware
-//	timer device.  Schedule the next interrupt, and invoke the
-//	interrupt handler.
+//	timer device.  Invoke the interrupt handler, which re-arms the
+//	timer if another interrupt is needed.
 */
 //----------------------------------------------------------------------
 void
 Timer::TimerExpired() {
-  // schedule the next timer device interrupt
-  g_machine->interrupt->Schedule(TimerHandler, (int64_t) this,
-                                 TimeOfNextInterrupt(), TIMER_INT);
+  armed = false;
 
   // invoke the Nachos interrupt handler for this device
   (*handler)(arg);
@@ -97,7 +110,7 @@ int
 Timer::TimeOfNextInterrupt() {
   if (randomize)
     return 1 + (Random() %
-                (nano_to_cycles(TIMER_TIME, g_cfg->ProcessorFrequency) * 2));
+                (nano_to_cycles(g_cfg->Quantum, g_cfg->ProcessorFrequency) * 2));
   else
-    return nano_to_cycles(TIMER_TIME, g_cfg->ProcessorFrequency);
+    return nano_to_cycles(g_cfg->Quantum, g_cfg->ProcessorFrequency);
 }
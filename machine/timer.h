@@ -6,7 +6,12 @@
         having a thread go to sleep for a specific period of time.
 
         We emulate a hardware timer by scheduling an interrupt to occur
-        every time stats->totalTicks has increased by TimerTicks.
+        every time stats->totalTicks has increased by the time slice
+        (Quantum in the configuration file).
+
+        The timer is one-shot: each interrupt has to be re-armed by the
+        interrupt handler (Arm), so that the kernel can stop the periodic
+        interrupts when they are useless (tickless mode).
 
         In order to introduce some randomness into time-slicing, if "doRandom"
         is set, then the interrupt comes after a random number of ticks.
@@ -44,6 +49,10 @@ public:
   //!< handler "timerHandler" every time slice.
   ~Timer() {}
 
+  void Arm();         //!< schedule the next interrupt, unless it is
+                      //!< already scheduled
+  bool IsArmed() { return armed; }   //!< true if an interrupt is scheduled
+
   // Internal routines to the timer emulation -- DO NOT call these
 
   void TimerExpired();   //!< called internally when the hardware
@@ -56,6 +65,7 @@ private:
   bool randomize;            //!< set if we need to use a random timeout delay
   VoidFunctionPtr handler;   //!< timer interrupt handler
   int arg;                   //!< argument to pass to interrupt handler
+  bool armed;                //!< set if an interrupt is scheduled
 };
 
 #endif   // TIMER_H
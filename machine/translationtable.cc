@@ -26,19 +26,44 @@
 #include "kernel/thread.h"
 #include "utility/config.h"
 
+//! Entry returned by Lookup for pages of unallocated second-level tables
+static PageTableEntry unmappedEntry;
+
 //----------------------------------------------------------------------
 // TranslationTable::TranslationTable
-/*!  Constructor. Allocate the page table entries
+/*!  Constructor. Allocate the page table entries, or only the first-level
+//   directory in DualLevel mode
  */
 //----------------------------------------------------------------------
 TranslationTable::TranslationTable() {
 
   // Init private fields
   maxNumPages = g_cfg->MaxVirtPages;
+  mode = g_cfg->TranslationTableMode;
+  pageTable = NULL;
+  directory = NULL;
+  directorySize = 0;
+  superPages = NULL;
+
+  if (mode == SingleLevel) {
+    DEBUG('h', (char *) "Allocationg translation table for %d pages (%ld kB)\n",
+          maxNumPages, ((long long) maxNumPages * g_cfg->PageSize) >> 10);
+    pageTable = new PageTableEntry[maxNumPages];
+  } else {
+    directorySize = divRoundUp(maxNumPages, DUAL_LEVEL_PAGES);
+    DEBUG('h', (char *) "Allocationg two-level translation table for %d pages\n",
+          maxNumPages);
+    directory = new PageTableEntry *[directorySize];
+    for (uint64_t i = 0; i < directorySize; i++)
+      directory[i] = NULL;
+  }
 
-  DEBUG('h', (char *) "Allocationg translation table for %d pages (%ld kB)\n",
-        maxNumPages, ((long long) maxNumPages * g_cfg->PageSize) >> 10);
-  pageTable = new PageTableEntry[maxNumPages];
+  if (g_cfg->SuperPagePages != 0) {
+    uint64_t regions = divRoundUp(maxNumPages, g_cfg->SuperPagePages);
+    superPages = new bool[regions];
+    for (uint64_t i = 0; i < regions; i++)
+      superPages[i] = false;
+  }
 }
 
 //----------------------------------------------------------------------
@@ -47,7 +72,21 @@ TranslationTable::TranslationTable() {
  */
 //----------------------------------------------------------------------
 TranslationTable::~TranslationTable() {
+  // A new table may be allocated at the same address, the MMUs must
+  // not take it for this one and keep its translations
+  if (g_machine != NULL)
+    for (int i = 0; i < g_machine->numHarts; i++)
+      if (g_machine->harts[i].mmu->translationTable == this) {
+        g_machine->harts[i].mmu->translationTable = NULL;
+        g_machine->harts[i].mmu->FlushTLB();
+      }
   delete[] pageTable;
+  if (directory != NULL) {
+    for (uint64_t i = 0; i < directorySize; i++)
+      delete[] directory[i];
+    delete[] directory;
+  }
+  delete[] superPages;
   DEBUG('h', (char *) "Translation table destroyed");
 }
 
@@ -62,6 +101,66 @@ TranslationTable::getMaxNumPages() {
   return maxNumPages;
 }
 
+//----------------------------------------------------------------------
+// TranslationTable::Lookup
+/*!  Get the entry of a virtual page for reading. In DualLevel mode, pages
+//   whose second-level table is not allocated share a default (unmapped)
+//   entry, which must not be modified.
+//   \param virtualPage : the virtual page
+//   \return the page table entry
+*/
+//----------------------------------------------------------------------
+PageTableEntry *
+TranslationTable::Lookup(uint64_t virtualPage) {
+  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
+  if (mode == SingleLevel)
+    return &pageTable[virtualPage];
+  PageTableEntry *second = directory[virtualPage / DUAL_LEVEL_PAGES];
+  if (second == NULL)
+    return &unmappedEntry;
+  return &second[virtualPage % DUAL_LEVEL_PAGES];
+}
+
+//----------------------------------------------------------------------
+// TranslationTable::Modify
+/*!  Get the entry of a virtual page for writing. In DualLevel mode, the
+//   second-level table holding the entry is allocated if needed.
+//   \param virtualPage : the virtual page
+//   \return the page table entry
+*/
+//----------------------------------------------------------------------
+PageTableEntry *
+TranslationTable::Modify(uint64_t virtualPage) {
+  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
+  if (mode == SingleLevel)
+    return &pageTable[virtualPage];
+  PageTableEntry **second = &directory[virtualPage / DUAL_LEVEL_PAGES];
+  if (*second == NULL)
+    *second = new PageTableEntry[DUAL_LEVEL_PAGES];
+  return &(*second)[virtualPage % DUAL_LEVEL_PAGES];
+}
+
+//----------------------------------------------------------------------
+// TranslationTable::InvalidateTLB
+/*!  Invalidate the MMU TLB entry of a virtual page whose mapping or
+//   access rights changed, on every hart whose MMU uses this table.
+//   The superpage holding the page, if any, is demoted.
+//   \param virtualPage : the virtual page
+*/
+//----------------------------------------------------------------------
+void
+TranslationTable::InvalidateTLB(uint64_t virtualPage) {
+  if (getSuperPage(virtualPage)) {
+    superPages[virtualPage / g_cfg->SuperPagePages] = false;
+    g_stats->incrDemotions();
+  }
+  if (g_machine == NULL)
+    return;
+  for (int i = 0; i < g_machine->numHarts; i++)
+    if (g_machine->harts[i].mmu->translationTable == this)
+      g_machine->harts[i].mmu->InvalidateTLBEntry(virtualPage);
+}
+
 //----------------------------------------------------------------------
 // TranslationTable::setPhysicalPage
 /*!  Set the physical page of a virtual page
@@ -71,8 +170,9 @@ TranslationTable::getMaxNumPages() {
 //----------------------------------------------------------------------
 void
 TranslationTable::setPhysicalPage(uint64_t virtualPage, uint64_t physicalPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].physicalPage = physicalPage;
+  ASSERT(physicalPage <= PTE_PHYS_MASK);
+  Modify(virtualPage)->setPhysicalPage(physicalPage);
+  InvalidateTLB(virtualPage);
 }
 
 //----------------------------------------------------------------------
@@ -84,8 +184,7 @@ TranslationTable::setPhysicalPage(uint64_t virtualPage, uint64_t physicalPage) {
 //----------------------------------------------------------------------
 uint64_t
 TranslationTable::getPhysicalPage(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].physicalPage;
+  return Lookup(virtualPage)->getPhysicalPage();
 }
 
 //----------------------------------------------------------------------
@@ -98,8 +197,7 @@ TranslationTable::getPhysicalPage(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::setAddrDisk(uint64_t virtualPage, uint32_t addrDisk) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].addrDisk = addrDisk;
+  Modify(virtualPage)->setAddrDisk(addrDisk);
 }
 
 //----------------------------------------------------------------------
@@ -111,8 +209,7 @@ TranslationTable::setAddrDisk(uint64_t virtualPage, uint32_t addrDisk) {
 //----------------------------------------------------------------------
 uint32_t
 TranslationTable::getAddrDisk(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].addrDisk;
+  return Lookup(virtualPage)->getAddrDisk();
 }
 
 //----------------------------------------------------------------------
@@ -123,8 +220,8 @@ TranslationTable::getAddrDisk(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::setBitValid(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].valid = true;
+  Modify(virtualPage)->setBit(PTE_VALID);
+  InvalidateTLB(virtualPage);
 }
 
 //----------------------------------------------------------------------
@@ -135,8 +232,8 @@ TranslationTable::setBitValid(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::clearBitValid(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].valid = false;
+  Modify(virtualPage)->clearBit(PTE_VALID);
+  InvalidateTLB(virtualPage);
 }
 
 //----------------------------------------------------------------------
@@ -148,8 +245,7 @@ TranslationTable::clearBitValid(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 bool
 TranslationTable::getBitValid(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].valid;
+  return Lookup(virtualPage)->getBit(PTE_VALID);
 }
 
 //----------------------------------------------------------------------
@@ -160,8 +256,7 @@ TranslationTable::getBitValid(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::setBitIo(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].io = true;
+  Modify(virtualPage)->setBit(PTE_IO);
 }
 
 //----------------------------------------------------------------------
@@ -172,8 +267,7 @@ TranslationTable::setBitIo(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::clearBitIo(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].io = false;
+  Modify(virtualPage)->clearBit(PTE_IO);
 }
 
 //----------------------------------------------------------------------
@@ -185,8 +279,43 @@ TranslationTable::clearBitIo(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 bool
 TranslationTable::getBitIo(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].io;
+  return Lookup(virtualPage)->getBit(PTE_IO);
+}
+
+//----------------------------------------------------------------------
+//  TranslationTable::setBitCow
+/*!  Set the bit cow of a virtual page: the page is writable but its
+//   physical page may be shared, writes are trapped (the bit
+//   writeAllowed is cleared) to give the page a private copy
+//   \param virtualPage : the virtual page
+*/
+//----------------------------------------------------------------------
+void
+TranslationTable::setBitCow(uint64_t virtualPage) {
+  Modify(virtualPage)->setBit(PTE_COW);
+}
+
+//----------------------------------------------------------------------
+//  TranslationTable::clearBitCow
+/*!  Clear the bit cow of a virtual page
+//   \param virtualPage : the virtual page
+*/
+//----------------------------------------------------------------------
+void
+TranslationTable::clearBitCow(uint64_t virtualPage) {
+  Modify(virtualPage)->clearBit(PTE_COW);
+}
+
+//----------------------------------------------------------------------
+//   TranslationTable::getBitCow
+/*!  Get the bit cow of a virtual page
+//   \param virtualPage : the virtual page
+//   \return value of the bit cow
+*/
+//----------------------------------------------------------------------
+bool
+TranslationTable::getBitCow(uint64_t virtualPage) {
+  return Lookup(virtualPage)->getBit(PTE_COW);
 }
 
 //----------------------------------------------------------------------
@@ -197,8 +326,7 @@ TranslationTable::getBitIo(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::setBitSwap(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].swap = true;
+  Modify(virtualPage)->setBit(PTE_SWAP);
 }
 
 //----------------------------------------------------------------------
@@ -209,8 +337,7 @@ TranslationTable::setBitSwap(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::clearBitSwap(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].swap = false;
+  Modify(virtualPage)->clearBit(PTE_SWAP);
 }
 
 //----------------------------------------------------------------------
@@ -222,8 +349,7 @@ TranslationTable::clearBitSwap(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 bool
 TranslationTable::getBitSwap(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].swap;
+  return Lookup(virtualPage)->getBit(PTE_SWAP);
 }
 
 //----------------------------------------------------------------------
@@ -234,8 +360,8 @@ TranslationTable::getBitSwap(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::setBitReadAllowed(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].readAllowed = true;
+  Modify(virtualPage)->setBit(PTE_READ);
+  InvalidateTLB(virtualPage);
 }
 
 //----------------------------------------------------------------------
@@ -246,8 +372,8 @@ TranslationTable::setBitReadAllowed(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::clearBitReadAllowed(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].readAllowed = false;
+  Modify(virtualPage)->clearBit(PTE_READ);
+  InvalidateTLB(virtualPage);
 }
 
 //----------------------------------------------------------------------
@@ -259,8 +385,7 @@ TranslationTable::clearBitReadAllowed(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 bool
 TranslationTable::getBitReadAllowed(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].readAllowed;
+  return Lookup(virtualPage)->getBit(PTE_READ);
 }
 
 //----------------------------------------------------------------------
@@ -271,8 +396,8 @@ TranslationTable::getBitReadAllowed(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::setBitWriteAllowed(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].writeAllowed = true;
+  Modify(virtualPage)->setBit(PTE_WRITE);
+  InvalidateTLB(virtualPage);
 }
 
 //----------------------------------------------------------------------
@@ -283,8 +408,8 @@ TranslationTable::setBitWriteAllowed(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 void
 TranslationTable::clearBitWriteAllowed(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].writeAllowed = false;
+  Modify(virtualPage)->clearBit(PTE_WRITE);
+  InvalidateTLB(virtualPage);
 }
 
 //----------------------------------------------------------------------
@@ -296,55 +421,134 @@ TranslationTable::clearBitWriteAllowed(uint64_t virtualPage) {
 //----------------------------------------------------------------------
 bool
 TranslationTable::getBitWriteAllowed(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].writeAllowed;
+  return Lookup(virtualPage)->getBit(PTE_WRITE);
 }
 
+//----------------------------------------------------------------------
+//  TranslationTable::setBitU
+/*!  Set the bit U of a virtual page
+//   \param virtualPage : the virtual page
+*/
+//----------------------------------------------------------------------
 void
 TranslationTable::setBitU(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].U = true;
+  Modify(virtualPage)->setBit(PTE_U);
 }
 
+//----------------------------------------------------------------------
+//  TranslationTable::clearBitU
+/*!  Clear the bit U of a virtual page
+//   \param virtualPage : the virtual page
+*/
+//----------------------------------------------------------------------
 void
 TranslationTable::clearBitU(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].U = false;
+  Modify(virtualPage)->clearBit(PTE_U);
 }
+
+//----------------------------------------------------------------------
+//   TranslationTable::getBitU
+/*!  Get the bit U of a virtual page
+//   \param virtualPage : the virtual page
+//   \return value of the bit U
+*/
+//----------------------------------------------------------------------
 bool
 TranslationTable::getBitU(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].U;
+  return Lookup(virtualPage)->getBit(PTE_U);
 }
 
+//----------------------------------------------------------------------
+//  TranslationTable::setBitM
+/*!  Set the bit M of a virtual page
+//   \param virtualPage : the virtual page
+*/
+//----------------------------------------------------------------------
 void
 TranslationTable::setBitM(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].M = true;
+  Modify(virtualPage)->setBit(PTE_M);
 }
 
+//----------------------------------------------------------------------
+//  TranslationTable::clearBitM
+/*!  Clear the bit M of a virtual page
+//   \param virtualPage : the virtual page
+*/
+//----------------------------------------------------------------------
 void
 TranslationTable::clearBitM(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  pageTable[virtualPage].M = false;
+  Modify(virtualPage)->clearBit(PTE_M);
 }
+
+//----------------------------------------------------------------------
+//   TranslationTable::getBitM
+/*!  Get the bit M of a virtual page
+//   \param virtualPage : the virtual page
+//   \return value of the bit M
+*/
+//----------------------------------------------------------------------
 bool
 TranslationTable::getBitM(uint64_t virtualPage) {
-  ASSERT((virtualPage >= 0) && (virtualPage < maxNumPages));
-  return pageTable[virtualPage].M;
+  return Lookup(virtualPage)->getBit(PTE_M);
+}
+
+//----------------------------------------------------------------------
+//   TranslationTable::Promote
+/*!  Map the aligned region of g_cfg->SuperPagePages pages holding a
+//   virtual page by a superpage, if all its pages are in memory, in
+//   contiguous physical pages starting on a multiple of the superpage
+//   size, and have the same access rights.
+//   \param virtualPage : a page of the region
+//   \return true if the region has been promoted
+*/
+//----------------------------------------------------------------------
+bool
+TranslationTable::Promote(uint64_t virtualPage) {
+  if (superPages == NULL || getSuperPage(virtualPage))
+    return false;
+  uint64_t pages = g_cfg->SuperPagePages;
+  uint64_t first = virtualPage & ~(pages - 1);
+  if (first + pages > maxNumPages)
+    return false;
+
+  PageTableEntry *head = Lookup(first);
+  uint64_t frame = head->getPhysicalPage();
+  if ((frame & (pages - 1)) != 0)
+    return false;
+  for (uint64_t i = 0; i < pages; i++) {
+    PageTableEntry *entry = Lookup(first + i);
+    if (!entry->getBit(PTE_VALID) || entry->getBit(PTE_IO) ||
+        entry->getPhysicalPage() != frame + i ||
+        entry->getBit(PTE_READ) != head->getBit(PTE_READ) ||
+        entry->getBit(PTE_WRITE) != head->getBit(PTE_WRITE))
+      return false;
+  }
+
+  DEBUG('h', (char *) "Superpage at virtual page %" PRIu64
+        ", physical page %" PRIu64 "\n", first, frame);
+  superPages[first / pages] = true;
+  g_stats->incrPromotions();
+  return true;
+}
+
+//----------------------------------------------------------------------
+//   TranslationTable::getSuperPage
+/*!  Tell whether a virtual page is mapped by a superpage
+//   \param virtualPage : the virtual page
+//   \return true if the region of the page has been promoted
+*/
+//----------------------------------------------------------------------
+bool
+TranslationTable::getSuperPage(uint64_t virtualPage) {
+  return superPages != NULL && superPages[virtualPage / g_cfg->SuperPagePages];
 }
 
 //----------------------------------------------------------------------
 //   PageTableEntry::PageTableEntry
-/*!  Constructor. Defaut initialization of a page table entry
+/*!  Constructor. Defaut initialization of a page table entry: all bits
+//   cleared, physical page 0, disk address -1
  */
 //----------------------------------------------------------------------
 PageTableEntry::PageTableEntry() {
-  valid = false;
-  swap = false;
-  addrDisk = -1;
-  readAllowed = false;
-  writeAllowed = false;
-  U = false;
-  M = false;
+  word = (uint64_t) (uint32_t) -1 << PTE_DISK_SHIFT;
 }
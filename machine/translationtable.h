@@ -33,8 +33,33 @@ class PageTableEntry;
 // Type of translation table used (linear, two-level)
 enum TranslationMode { SingleLevel, DualLevel };
 
+//! Number of entries of a second-level table in DualLevel mode
+#define DUAL_LEVEL_PAGES 1024
+
+// Layout of the 64-bit word of a page table entry
+#define PTE_VALID      0x01   //!< bit valid
+#define PTE_U          0x02   //!< bit U (used)
+#define PTE_M          0x04   //!< bit M (modified)
+#define PTE_READ       0x08   //!< bit readAllowed
+#define PTE_WRITE      0x10   //!< bit writeAllowed
+#define PTE_SWAP       0x20   //!< bit swap
+#define PTE_IO         0x40   //!< bit io
+#define PTE_COW        0x80   //!< bit cow (copy on write)
+#define PTE_PHYS_SHIFT 8            //!< physical page, bits 8 to 31
+#define PTE_PHYS_MASK  0xffffffULL  //!< physical page field (once shifted)
+#define PTE_DISK_SHIFT 32           //!< disk address, bits 32 to 63
+
 /*! \brief Defines the data structures used for address translation
 //
+// In SingleLevel mode the table is a flat array of MaxVirtPages entries.
+// In DualLevel mode it is a directory of second-level tables of
+// DUAL_LEVEL_PAGES entries each, a second-level table being only
+// allocated when one of its entries is first modified.
+//
+// An aligned region of g_cfg->SuperPagePages virtual pages mapped on as
+// many contiguous, aligned physical pages with the same rights can be
+// promoted to a superpage, which takes a single entry of the MMU TLB.
+// Changing the mapping or the rights of one of its pages demotes it.
 */
 
 class TranslationTable {
@@ -57,6 +82,10 @@ public:
   void clearBitIo(uint64_t virtualPage);
   bool getBitIo(uint64_t virtualPage);
 
+  void setBitCow(uint64_t virtualPage);
+  void clearBitCow(uint64_t virtualPage);
+  bool getBitCow(uint64_t virtualPage);
+
   void setBitValid(uint64_t virtualPage);
   void clearBitValid(uint64_t virtualPage);
   bool getBitValid(uint64_t virtualPage);
@@ -81,12 +110,37 @@ public:
   void clearBitM(uint64_t virtualPage);
   bool getBitM(uint64_t virtualPage);
 
+  // Superpages
+  bool Promote(uint64_t virtualPage);   //!< Map the region of a page by a
+                                        //!< superpage if it is possible
+  bool getSuperPage(uint64_t virtualPage);   //!< true if the page is part
+                                             //!< of a superpage
+
 private:
+  // Keep the MMU TLB coherent with the page table entries
+  void InvalidateTLB(uint64_t virtualPage);
+
+  // Entry of a virtual page, for reading (never allocates)
+  PageTableEntry *Lookup(uint64_t virtualPage);
+
+  // Entry of a virtual page, for writing (allocates in DualLevel mode)
+  PageTableEntry *Modify(uint64_t virtualPage);
+
   // Maximum number of pages that can be translated
   uint64_t maxNumPages;
 
-  // Page table entries
+  // Organization of the table (linear or two-level)
+  TranslationMode mode;
+
+  // Page table entries (SingleLevel mode)
   PageTableEntry *pageTable;
+
+  // First-level directory and its size (DualLevel mode)
+  PageTableEntry **directory;
+  uint64_t directorySize;
+
+  // Regions mapped by a superpage (NULL if the superpages are disabled)
+  bool *superPages;
 };
 
 /*! \class PageTableEntry
@@ -95,6 +149,27 @@ private:
 // Each entry defines a mapping from one virtual page to one physical page.
 // In addition, there are some extra bits for access control (valid and
 // read-only) and some bits for usage information (use and dirty).
+//
+// The whole entry is packed in one 64-bit word (see the PTE_* masks), and
+// bits are set and cleared with atomic read-modify-write operations:
+//   - valid: if not set, the page is not in physical memory.
+//   - U: the page has been referenced recently. Set by hardware (MMU)
+//     and reset by software (page replacement).
+//   - M: the copy of the page in RAM is modified and should be copied
+//     back to disk if evicted. Set by hardware (MMU) and reset by
+//     software when the page is copied back to disk.
+//   - readAllowed/writeAllowed: access rights to the whole page. If none
+//     of them is set, the page is considered not available at all, and
+//     any access to it leads to an AddressErrorException.
+//   - swap: the page must be loaded from swap if set, from the
+//     executable file otherwise.
+//   - io: set by the system every time the page is occupied in an
+//     input-output.
+//   - physicalPage: the page number in real memory (relative to the
+//     start of "mainMemory"). Relevant when valid is true only !
+//   - addrDisk: depending on the 'swap' bit, the location of the page
+//     in the swap (in <b>PAGES</b>) or from the beginning of the
+//     executable file (in <b>BYTES</b>), or -1 for anonymous mapping.
 */
 
 class PageTableEntry {
@@ -104,45 +179,36 @@ public:
     physical mem: page is considered unmapped */
   PageTableEntry();
 
-  /*! If this bit isn't set, then the page is not in physical
-    memory. */
-  bool valid;
-
-  /*! If bit U is set, the page has been referenced recently.
-    This bit is set by hardware (MMU) and reset by software (page replacement)
-  */
-  bool U;
-
-  /*! If bit M is set, the copy of the page in RAM is modified and should be
-   copied back to disk if evicted. This bit is set by hardware (MMU) and reset
-   by software when the page is copied back to disk */
-  bool M;
-
-  /*! Access rights to the page. If some of these flags are set, the
-     user is allowed to perform the corresponding operations
-     (read/write) over the whole page. If none of these flags is set,
-     then the page is considered not available at all, and any access
-     to the page leads to an AddressErrorException */
-  bool readAllowed;  /*!< Allows program to read the page contents */
-  bool writeAllowed; /*!< Allows program to modify the page contents */
-
-  /*! The page number in real memory (relative to the
-    start of "mainMemory"). Relevant when valid is true only ! */
-  int physicalPage;
-
-  /*! If this bit is set, the page must be load from swap.
-    If not, the page must be load from executable file.*/
-  bool swap;
-
-  /*! Depending on the 'swap' bit:
-    - swap == true : location, in terms of <b>PAGES</b>, in the swap
-    - swap == false: location, in terms of <b>BYTES</b>, from the beginning
-      of the executable file, or -1 for anonymous mapping */
-  int addrDisk;
-
-  /*! This bit is set by the system every time the
-    page is occupied in a input-output.  */
-  bool io;
+  bool getBit(uint64_t mask) { return (word & mask) != 0; }
+  void setBit(uint64_t mask) { __atomic_fetch_or(&word, mask, __ATOMIC_RELAXED); }
+  void clearBit(uint64_t mask) {
+    __atomic_fetch_and(&word, ~mask, __ATOMIC_RELAXED);
+  }
+
+  uint64_t getPhysicalPage() {
+    return (word >> PTE_PHYS_SHIFT) & PTE_PHYS_MASK;
+  }
+  void setPhysicalPage(uint64_t physicalPage) {
+    Replace(PTE_PHYS_MASK << PTE_PHYS_SHIFT, physicalPage << PTE_PHYS_SHIFT);
+  }
+
+  uint32_t getAddrDisk() { return (uint32_t) (word >> PTE_DISK_SHIFT); }
+  void setAddrDisk(uint32_t addrDisk) {
+    Replace(0xffffffffULL << PTE_DISK_SHIFT,
+            (uint64_t) addrDisk << PTE_DISK_SHIFT);
+  }
+
+private:
+  //! Atomically replace the bits of "mask" by "bits"
+  void Replace(uint64_t mask, uint64_t bits) {
+    uint64_t old = word;
+    while (!__atomic_compare_exchange_n(&word, &old, (old & ~mask) | bits,
+                                        true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED))
+      ;
+  }
+
+  uint64_t word;   //!< Packed contents of the entry
 };
 
 #endif   // TTABLE_H
@@ -0,0 +1,758 @@
+/*! \file translator.cc
+//  \brief Routines of the binary translator of the user code
+//
+//      A block is translated instruction by instruction, each one
+//      loading its operands from Machine::int_registers and storing its
+//      result there, so that the interpreter can take over after any
+//      of them. The translated instructions compute exactly what
+//      Machine::OneInstruction does; the others (floating point,
+//      atomics, divisions, system...) end the translation, the
+//      interpreter running the rest of the block.
+//
+//      The host code of a block is a function without arguments:
+//
+//              push rbx
+//              mov  rbx, &int_registers[0]
+//              <instructions>
+//              mov  [pc], next pc
+//              mov  eax, instructions run
+//              pop  rbx
+//              ret
+//
+//      A load or a store calls TranslatedLoad or TranslatedStore,
+//      which only do the access if the TLB holds it; otherwise, the
+//      code returns before the instruction, which the interpreter runs
+//      (page fault...). The translated code thus never enters the
+//      kernel, and the translations cannot be dropped while they run.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#ifdef NACHOS_DBT
+
+#ifndef __x86_64__
+#error "The binary translator (DBT=1) needs an x86-64 host"
+#endif
+
+#include "machine/translator.h"
+#include "kernel/msgerror.h"
+#include "kernel/system.h"
+#include "machine/machine.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+#include <sys/mman.h>
+
+// Host registers used by the translated code
+#define HOST_RAX 0
+#define HOST_RCX 1
+#define HOST_RDX 2
+#define HOST_RSI 6
+#define HOST_RDI 7
+
+// Outcome of the translation of an instruction
+#define NOT_TRANSLATED 0   //!< left to the interpreter, nothing emitted
+#define TRANSLATED     1   //!< the block goes on with the next instruction
+#define BLOCK_END      2   //!< control transfer, the exit is emitted
+
+//! Bytes of the code emitted by EmitExit
+#define EXIT_LENGTH 24
+
+//----------------------------------------------------------------------
+// TranslatedLoad
+/*!	Load of the translated code: read memory as OneInstruction does,
+//	if the TLB holds the address.
+//
+//	\param addr the virtual address
+//	\param funct3 the kind of load (RISCV_LD_*)
+//	\param dest the register loaded
+//	\return 1 if the load was done, 0 if it is left to the interpreter
+*/
+//----------------------------------------------------------------------
+static int
+TranslatedLoad(uint64_t addr, int funct3, int64_t *dest) {
+  int size = 1 << (funct3 & 3);
+  uint32_t physAddr;
+  uint64_t value;
+
+  if (!g_machine->mmu->ProbeTLB(addr, size, false, &physAddr))
+    return 0;
+  g_machine->mmu->ReadMem(addr, size, &value);
+  switch (funct3) {
+  case RISCV_LD_LB:
+    *dest = (int8_t) value;
+    break;
+  case RISCV_LD_LH:
+    *dest = (int16_t) value;
+    break;
+  case RISCV_LD_LW:
+    *dest = (int32_t) value;
+    break;
+  case RISCV_LD_LBU:
+    *dest = (uint8_t) value;
+    break;
+  case RISCV_LD_LWU:
+    *dest = (uint32_t) value;
+    break;
+  default:
+    *dest = value;
+    break;
+  }
+  return 1;
+}
+
+//----------------------------------------------------------------------
+// TranslatedStore
+/*!	Store of the translated code: write memory if the TLB holds the
+//	address with the write right, and if the write cannot drop
+//	decoded instructions (hence translations).
+//
+//	\param addr the virtual address
+//	\param size the number of bytes written
+//	\param value the value written
+//	\return 1 if the store was done, 0 if it is left to the interpreter
+*/
+//----------------------------------------------------------------------
+static int
+TranslatedStore(uint64_t addr, int size, uint64_t value) {
+  uint32_t physAddr;
+
+  if (!g_machine->mmu->ProbeTLB(addr, size, true, &physAddr) ||
+      g_machine->mmu->HoldsDecoded(physAddr, size))
+    return 0;
+  g_machine->mmu->WriteMem(addr, size, value);
+  return 1;
+}
+
+//----------------------------------------------------------------------
+// Translator::Translator
+/*!	Allocate the translator and its code cache, empty.
+//
+//	\param m the machine whose user code is translated
+*/
+//----------------------------------------------------------------------
+Translator::Translator(Machine *m) {
+  machine = m;
+  pages = new TranslatedPage *[g_cfg->NumPhysPages];
+  for (uint32_t i = 0; i < g_cfg->NumPhysPages; i++)
+    pages[i] = NULL;
+  cache = (uint8_t *) mmap(NULL, TRANSLATION_CACHE_SIZE,
+                           PROT_READ | PROT_WRITE | PROT_EXEC,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (cache == MAP_FAILED) {
+    printf("Error: cannot allocate the code cache of the binary "
+           "translator\n");
+    exit(ERROR);
+  }
+  codeEnd = cache;
+  discard = 0;
+}
+
+//----------------------------------------------------------------------
+// Translator::~Translator
+//!	De-allocate the translator
+//----------------------------------------------------------------------
+Translator::~Translator() {
+  Flush();
+  munmap(cache, TRANSLATION_CACHE_SIZE);
+  delete[] pages;
+}
+
+//----------------------------------------------------------------------
+// Translator::GetPage
+/*!	Give the translations of a physical page, allocating them on the
+//	first run of a block of the page.
+//
+//	\param physPage the physical page
+*/
+//----------------------------------------------------------------------
+TranslatedPage *
+Translator::GetPage(int physPage) {
+  TranslatedPage *page = pages[physPage];
+  if (page != NULL)
+    return page;
+
+  int halvesPerPage = g_cfg->PageSize / 2;
+  page = new TranslatedPage;
+  page->blocks = new TranslatedBlock *[halvesPerPage];
+  page->runs = new uint32_t[halvesPerPage];
+  for (int i = 0; i < halvesPerPage; i++) {
+    page->blocks[i] = NULL;
+    page->runs[i] = 0;
+  }
+  pages[physPage] = page;
+  return page;
+}
+
+//----------------------------------------------------------------------
+// Translator::Lookup
+/*!	Count a run of the block starting at pc, and give its translation.
+//	The block is translated on its TranslationThreshold-th run, and
+//	counted again from 0 if the interpreter has not yet decoded it.
+//
+//	\param pc the virtual address of the block
+//	\param physAddr its physical address
+//	\return the translation, NULL if the block is to be interpreted
+*/
+//----------------------------------------------------------------------
+TranslatedBlock *
+Translator::Lookup(int64_t pc, uint32_t physAddr) {
+  int physPage = physAddr >> g_cfg->PageShift;
+  int index = (physAddr & g_cfg->PageMask) / 2;
+
+  TranslatedBlock *block = GetPage(physPage)->blocks[index];
+  if (block == NULL) {
+    if (++pages[physPage]->runs[index] < g_cfg->TranslationThreshold)
+      return NULL;
+    block = Translate(pc, physAddr);
+    if (block == NULL) {
+      GetPage(physPage)->runs[index] = 0;   // the cache may be flushed
+      return NULL;
+    }
+    GetPage(physPage)->blocks[index] = block;
+  }
+
+  // A page shared at another address would need its own translation
+  if (block->length == 0 || block->virtPc != pc)
+    return NULL;
+  return block;
+}
+
+//----------------------------------------------------------------------
+// Translator::InvalidatePage
+/*!	Drop the translations of a physical page, and their runs. Called
+//	by the MMU each time decoded instructions of the page are dropped.
+//	Their host code stays in the cache until it is flushed.
+//
+//	\param physPage the physical page
+*/
+//----------------------------------------------------------------------
+void
+Translator::InvalidatePage(int physPage) {
+  TranslatedPage *page = pages[physPage];
+  if (page == NULL)
+    return;
+  for (unsigned int i = 0; i < g_cfg->PageSize / 2; i++)
+    delete page->blocks[i];
+  delete[] page->blocks;
+  delete[] page->runs;
+  delete page;
+  pages[physPage] = NULL;
+  g_stats->incrTranslationInvalidations();
+}
+
+//----------------------------------------------------------------------
+// Translator::Flush
+//!	Drop all the translations, and empty the code cache
+//----------------------------------------------------------------------
+void
+Translator::Flush() {
+  for (uint32_t i = 0; i < g_cfg->NumPhysPages; i++)
+    InvalidatePage(i);
+  codeEnd = cache;
+}
+
+//----------------------------------------------------------------------
+// Translator::Translate
+/*!	Translate the block starting at pc, up to where RunBlock ends it
+//	(control transfer, MAX_BLOCK_LENGTH instructions, DetailedStopPC),
+//	or up to the first instruction that is not translated, or that
+//	is on another page. An instruction of the page that is not yet in
+//	the decoded-instruction cache, as the interpreter did not run it,
+//	drops the translation: it would stay truncated until the page is
+//	invalidated. The last halfword of the page is not retried, since
+//	a 32-bit instruction there is never cached.
+//
+//	\param pc the virtual address of the block
+//	\param physAddr its physical address
+//	\return the translated block, of length 0 if its first instruction
+//	is not translated, NULL if an instruction is not yet decoded
+*/
+//----------------------------------------------------------------------
+TranslatedBlock *
+Translator::Translate(int64_t pc, uint32_t physAddr) {
+  if (codeEnd + MAX_BLOCK_LENGTH * TRANSLATION_MAX_CODE >
+      cache + TRANSLATION_CACHE_SIZE)
+    Flush();
+
+  TranslatedBlock *block = new TranslatedBlock;
+  uint8_t *start = codeEnd;
+  block->virtPc = pc;
+  block->code = (int (*)()) start;
+
+  // push rbx; mov rbx, &int_registers[0]
+  Emit8(0x53);
+  Emit8(0x48);
+  Emit8(0xbb);
+  Emit64((uint64_t) machine->int_registers);
+
+  int count = 0;
+  uint32_t physPage = physAddr >> g_cfg->PageShift;
+  for (;;) {
+    bool samePage = ((physAddr >> g_cfg->PageShift) == physPage);
+    Instruction *instr = samePage ? machine->mmu->DecodedAt(physAddr) : NULL;
+    if (instr == NULL && samePage &&
+        (physAddr & g_cfg->PageMask) != g_cfg->PageSize - 2) {
+      codeEnd = start;
+      delete block;
+      return NULL;
+    }
+    int result = (instr != NULL) ? TranslateInstruction(instr, pc, count)
+                                 : NOT_TRANSLATED;
+    if (result == NOT_TRANSLATED) {
+      EmitExit(pc, count);
+      block->complete = false;
+      break;
+    }
+    count++;
+    if (result == BLOCK_END) {
+      block->complete = true;
+      break;
+    }
+    pc += instr->length;
+    physAddr += instr->length;
+    if (count == MAX_BLOCK_LENGTH || (uint64_t) pc == g_cfg->DetailedStopPC) {
+      EmitExit(pc, count);
+      block->complete = true;
+      break;
+    }
+  }
+  ASSERT(codeEnd <= start + (count + 1) * TRANSLATION_MAX_CODE);
+
+  block->length = count;
+  if (count == 0) {
+    codeEnd = start;   // nothing worth running
+    block->code = NULL;
+  } else
+    g_stats->incrTranslations();
+  return block;
+}
+
+//----------------------------------------------------------------------
+// Translator::TranslateInstruction
+/*!	Emit the host code of an instruction, computing what
+//	OneInstruction computes.
+//
+//	\param instr the decoded instruction
+//	\param pc its virtual address
+//	\param count the number of instructions of the block before it
+//	\return NOT_TRANSLATED, TRANSLATED, or BLOCK_END for a control
+//	transfer
+*/
+//----------------------------------------------------------------------
+int
+Translator::TranslateInstruction(Instruction *instr, int64_t pc, int count) {
+  int64_t next = pc + instr->length;
+
+  switch (instr->opcode) {
+  case RISCV_LUI:
+    Emit8(0xb8);   // mov eax, imm32 (zero-extended)
+    Emit32(instr->imm31_12);
+    EmitStoreReg(instr->rd, HOST_RAX);
+    return TRANSLATED;
+
+  case RISCV_AUIPC:
+    Emit8(0x48);   // mov rax, imm64
+    Emit8(0xb8);
+    Emit64(pc + instr->imm31_12);
+    EmitStoreReg(instr->rd, HOST_RAX);
+    return TRANSLATED;
+
+  case RISCV_JAL:
+    if (instr->rd != 0) {
+      Emit8(0x48);   // mov rax, imm64
+      Emit8(0xb8);
+      Emit64(next);
+      EmitStoreReg(instr->rd, HOST_RAX);
+    }
+    EmitExit(pc + instr->imm21_1_signed, count + 1);
+    return BLOCK_END;
+
+  case RISCV_JALR:
+    // The target is truncated to 32 bits, the link register too
+    EmitLoadReg(HOST_RAX, instr->rs1, false);
+    Emit8(0x48);   // add rax, imm32
+    Emit8(0x05);
+    Emit32(instr->imm12_I_signed);
+    Emit8(0x25);   // and eax, 0xfffffffe
+    Emit32(0xfffffffe);
+    Emit8(0x48);   // mov [pc], rax
+    Emit8(0x89);
+    Emit8(0x83);
+    Emit32((uint8_t *) &machine->pc - (uint8_t *) machine->int_registers);
+    if (instr->rd != 0) {
+      Emit8(0x48);   // mov rax, imm64
+      Emit8(0xb8);
+      Emit64((int32_t) next);
+      EmitStoreReg(instr->rd, HOST_RAX);
+    }
+    Emit8(0xb8);   // mov eax, count; pop rbx; ret
+    Emit32(count + 1);
+    Emit8(0x5b);
+    Emit8(0xc3);
+    return BLOCK_END;
+
+  case RISCV_BR: {
+    uint8_t jcc;   // short jump if taken
+    switch (instr->funct3) {
+    case RISCV_BR_BEQ:
+      jcc = 0x74;
+      break;
+    case RISCV_BR_BNE:
+      jcc = 0x75;
+      break;
+    case RISCV_BR_BLT:
+      jcc = 0x7c;
+      break;
+    case RISCV_BR_BGE:
+      jcc = 0x7d;
+      break;
+    case RISCV_BR_BLTU:
+      jcc = 0x72;
+      break;
+    case RISCV_BR_BGEU:
+      jcc = 0x73;
+      break;
+    default:
+      return NOT_TRANSLATED;
+    }
+    EmitLoadReg(HOST_RAX, instr->rs1, false);
+    EmitLoadReg(HOST_RCX, instr->rs2, false);
+    Emit8(0x48);   // cmp rax, rcx
+    Emit8(0x39);
+    Emit8(0xc8);
+    Emit8(jcc);
+    Emit8(EXIT_LENGTH);
+    EmitExit(next, count + 1);
+    EmitExit(pc + instr->imm13_signed, count + 1);
+    return BLOCK_END;
+  }
+
+  case RISCV_LD:
+    if (instr->funct3 > RISCV_LD_LWU || instr->funct3 == RISCV_LD_LHU)
+      return NOT_TRANSLATED;
+    EmitLoadReg(HOST_RDI, instr->rs1, false);
+    Emit8(0x48);   // add rdi, imm32
+    Emit8(0x81);
+    Emit8(0xc7);
+    Emit32(instr->imm12_I_signed);
+    Emit8(0xbe);   // mov esi, funct3
+    Emit32(instr->funct3);
+    Emit8(0x48);   // mov rdx, &int_registers[rd]
+    Emit8(0xba);
+    Emit64((instr->rd != 0) ? (uint64_t) &machine->int_registers[instr->rd]
+                            : (uint64_t) &discard);
+    EmitCall((void *) TranslatedLoad);
+    break;
+
+  case RISCV_ST:
+    if (instr->funct3 > RISCV_ST_STD)
+      return NOT_TRANSLATED;
+    EmitLoadReg(HOST_RDI, instr->rs1, false);
+    Emit8(0x48);   // add rdi, imm32
+    Emit8(0x81);
+    Emit8(0xc7);
+    Emit32(instr->imm12_S_signed);
+    Emit8(0xbe);   // mov esi, size
+    Emit32(1 << instr->funct3);
+    EmitLoadReg(HOST_RDX, instr->rs2, false);
+    EmitCall((void *) TranslatedStore);
+    break;
+
+  case RISCV_FENCE:
+    Emit8(0x0f);   // mfence
+    Emit8(0xae);
+    Emit8(0xf0);
+    return TRANSLATED;
+
+  case RISCV_OPI:
+    // SLTIU compares the low word of rs1 to the zero-extended
+    // immediate
+    EmitLoadReg(HOST_RAX, instr->rs1, instr->funct3 == RISCV_OPI_SLTIU);
+    Emit8(0x48);
+    switch (instr->funct3) {
+    case RISCV_OPI_ADDI:
+      Emit8(0x05);   // add rax, imm32
+      Emit32(instr->imm12_I_signed);
+      break;
+    case RISCV_OPI_SLTI:
+    case RISCV_OPI_SLTIU:
+      Emit8(0x3d);   // cmp rax, imm32; setl/setb al; movzx eax, al
+      Emit32((instr->funct3 == RISCV_OPI_SLTI) ? (int32_t) instr->imm12_I_signed
+                                               : (int32_t) instr->imm12_I);
+      Emit8(0x0f);
+      Emit8((instr->funct3 == RISCV_OPI_SLTI) ? 0x9c : 0x92);
+      Emit8(0xc0);
+      Emit8(0x0f);
+      Emit8(0xb6);
+      Emit8(0xc0);
+      break;
+    case RISCV_OPI_XORI:
+      Emit8(0x35);   // xor rax, imm32
+      Emit32(instr->imm12_I_signed);
+      break;
+    case RISCV_OPI_ORI:
+      Emit8(0x0d);   // or rax, imm32
+      Emit32(instr->imm12_I_signed);
+      break;
+    case RISCV_OPI_ANDI:
+      Emit8(0x25);   // and rax, imm32
+      Emit32(instr->imm12_I_signed);
+      break;
+    case RISCV_OPI_SLLI:
+      Emit8(0xc1);   // shl rax, shamt
+      Emit8(0xe0);
+      Emit8(instr->shamt);
+      break;
+    default:   // RISCV_OPI_SRI
+      Emit8(0xc1);   // shr/sar rax, shamt
+      Emit8((instr->funct7_smaller == RISCV_OPI_SRI_SRLI) ? 0xe8 : 0xf8);
+      Emit8(instr->shamt);
+      break;
+    }
+    EmitStoreReg(instr->rd, HOST_RAX);
+    return TRANSLATED;
+
+  case RISCV_OPIW:
+    EmitLoadReg(HOST_RAX, instr->rs1, true);
+    switch (instr->funct3) {
+    case RISCV_OPIW_ADDIW:
+      Emit8(0x05);   // add eax, imm32
+      Emit32(instr->imm12_I_signed);
+      break;
+    case RISCV_OPIW_SLLIW:
+      Emit8(0xc1);   // shl eax, rs2
+      Emit8(0xe0);
+      Emit8(instr->rs2);
+      break;
+    case RISCV_OPIW_SRW:
+      Emit8(0xc1);   // shr/sar eax, rs2
+      Emit8((instr->funct7 == RISCV_OPIW_SRW_SRLIW) ? 0xe8 : 0xf8);
+      Emit8(instr->rs2);
+      break;
+    default:
+      codeEnd -= 6;   // drop the load of rs1
+      return NOT_TRANSLATED;
+    }
+    Emit8(0x48);   // movsxd rax, eax
+    Emit8(0x63);
+    Emit8(0xc0);
+    EmitStoreReg(instr->rd, HOST_RAX);
+    return TRANSLATED;
+
+  case RISCV_OP: {
+    uint8_t op;
+    if (instr->funct7 == RISCV_OP_M) {
+      if (instr->funct3 != RISCV_OP_M_MUL)
+        return NOT_TRANSLATED;
+      EmitLoadReg(HOST_RAX, instr->rs1, false);
+      EmitLoadReg(HOST_RCX, instr->rs2, false);
+      Emit8(0x48);   // imul rax, rcx
+      Emit8(0x0f);
+      Emit8(0xaf);
+      Emit8(0xc1);
+      EmitStoreReg(instr->rd, HOST_RAX);
+      return TRANSLATED;
+    }
+    EmitLoadReg(HOST_RAX, instr->rs1, false);
+    EmitLoadReg(HOST_RCX, instr->rs2, false);
+    Emit8(0x48);
+    switch (instr->funct3) {
+    case RISCV_OP_ADD:
+      op = (instr->funct7 == RISCV_OP_ADD_ADD) ? 0x01 : 0x29;   // add/sub
+      Emit8(op);
+      Emit8(0xc8);
+      break;
+    case RISCV_OP_SLL:
+      Emit8(0xd3);   // shl rax, cl
+      Emit8(0xe0);
+      break;
+    case RISCV_OP_SLT:
+    case RISCV_OP_SLTU:
+      Emit8(0x39);   // cmp rax, rcx; setl/setb al; movzx eax, al
+      Emit8(0xc8);
+      Emit8(0x0f);
+      Emit8((instr->funct3 == RISCV_OP_SLT) ? 0x9c : 0x92);
+      Emit8(0xc0);
+      Emit8(0x0f);
+      Emit8(0xb6);
+      Emit8(0xc0);
+      break;
+    case RISCV_OP_XOR:
+      Emit8(0x31);   // xor rax, rcx
+      Emit8(0xc8);
+      break;
+    case RISCV_OP_SR:
+      Emit8(0xd3);   // shr/sar rax, cl
+      Emit8((instr->funct7 == RISCV_OP_SR_SRL) ? 0xe8 : 0xf8);
+      break;
+    case RISCV_OP_OR:
+      Emit8(0x09);   // or rax, rcx
+      Emit8(0xc8);
+      break;
+    default:   // RISCV_OP_AND
+      Emit8(0x21);   // and rax, rcx
+      Emit8(0xc8);
+      break;
+    }
+    EmitStoreReg(instr->rd, HOST_RAX);
+    return TRANSLATED;
+  }
+
+  case RISCV_OPW:
+    // MULW gives the zero-extended low word of the product
+    if (instr->funct7 == RISCV_OP_M) {
+      if (instr->funct3 != RISCV_OPW_M_MULW)
+        return NOT_TRANSLATED;
+      EmitLoadReg(HOST_RAX, instr->rs1, true);
+      EmitLoadReg(HOST_RCX, instr->rs2, true);
+      Emit8(0x0f);   // imul eax, ecx
+      Emit8(0xaf);
+      Emit8(0xc1);
+      EmitStoreReg(instr->rd, HOST_RAX);
+      return TRANSLATED;
+    }
+    if (instr->funct3 != RISCV_OPW_ADDSUBW && instr->funct3 != RISCV_OPW_SLLW)
+      return NOT_TRANSLATED;
+    EmitLoadReg(HOST_RAX, instr->rs1, true);
+    EmitLoadReg(HOST_RCX, instr->rs2, true);
+    if (instr->funct3 == RISCV_OPW_SLLW) {
+      Emit8(0xd3);   // shl eax, cl
+      Emit8(0xe0);
+    } else {
+      Emit8((instr->funct7 == RISCV_OPW_ADDSUBW_ADDW) ? 0x01 : 0x29);
+      Emit8(0xc8);   // add/sub eax, ecx
+    }
+    Emit8(0x48);   // movsxd rax, eax
+    Emit8(0x63);
+    Emit8(0xc0);
+    EmitStoreReg(instr->rd, HOST_RAX);
+    return TRANSLATED;
+
+  default:
+    return NOT_TRANSLATED;
+  }
+
+  // Loads and stores: leave the instruction to the interpreter if the
+  // access was not done (test eax, eax; jnz over the exit)
+  Emit8(0x85);
+  Emit8(0xc0);
+  Emit8(0x75);
+  Emit8(EXIT_LENGTH);
+  EmitExit(pc, count);
+  return TRANSLATED;
+}
+
+//----------------------------------------------------------------------
+// Translator::Emit8, Emit32, Emit64
+//!	Append host code to the code cache
+//----------------------------------------------------------------------
+void
+Translator::Emit8(uint8_t byte) {
+  *codeEnd++ = byte;
+}
+
+void
+Translator::Emit32(uint32_t word) {
+  memcpy(codeEnd, &word, sizeof(word));
+  codeEnd += sizeof(word);
+}
+
+void
+Translator::Emit64(uint64_t word) {
+  memcpy(codeEnd, &word, sizeof(word));
+  codeEnd += sizeof(word);
+}
+
+//----------------------------------------------------------------------
+// Translator::EmitLoadReg
+/*!	Emit the load of a guest register into a host register: mov
+//	reg, [rbx + 8 * guest]. The guest register x0 is always 0 in
+//	memory.
+//
+//	\param host the host register
+//	\param guest the guest register
+//	\param word true to load the low 32 bits only, zero-extended
+*/
+//----------------------------------------------------------------------
+void
+Translator::EmitLoadReg(int host, int guest, bool word) {
+  if (!word)
+    Emit8(0x48);
+  Emit8(0x8b);
+  Emit8(0x83 | (host << 3));
+  Emit32(guest * sizeof(int64_t));
+}
+
+//----------------------------------------------------------------------
+// Translator::EmitStoreReg
+/*!	Emit the store of a host register into a guest register: mov
+//	[rbx + 8 * guest], reg. Nothing is emitted for x0.
+//
+//	\param guest the guest register
+//	\param host the host register
+*/
+//----------------------------------------------------------------------
+void
+Translator::EmitStoreReg(int guest, int host) {
+  if (guest == 0)
+    return;
+  Emit8(0x48);
+  Emit8(0x89);
+  Emit8(0x83 | (host << 3));
+  Emit32(guest * sizeof(int64_t));
+}
+
+//----------------------------------------------------------------------
+// Translator::EmitCall
+/*!	Emit the call of a function of the simulator: mov rax, function;
+//	call rax. The stack is aligned on 16 bytes, rbx having been pushed.
+//
+//	\param function the function
+*/
+//----------------------------------------------------------------------
+void
+Translator::EmitCall(void *function) {
+  Emit8(0x48);
+  Emit8(0xb8);
+  Emit64((uint64_t) function);
+  Emit8(0xff);
+  Emit8(0xd0);
+}
+
+//----------------------------------------------------------------------
+// Translator::EmitExit
+/*!	Emit the end of the translated code: set the pc of the machine,
+//	and return the number of instructions run. EXIT_LENGTH bytes.
+//
+//	\param pc the next pc
+//	\param count the number of instructions run
+*/
+//----------------------------------------------------------------------
+void
+Translator::EmitExit(int64_t pc, int count) {
+  Emit8(0x48);   // mov rax, pc
+  Emit8(0xb8);
+  Emit64(pc);
+  Emit8(0x48);   // mov [pc], rax
+  Emit8(0x89);
+  Emit8(0x83);
+  Emit32((uint8_t *) &machine->pc - (uint8_t *) machine->int_registers);
+  Emit8(0xb8);   // mov eax, count
+  Emit32(count);
+  Emit8(0x5b);   // pop rbx
+  Emit8(0xc3);   // ret
+}
+
+#endif   // NACHOS_DBT
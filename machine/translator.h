@@ -0,0 +1,115 @@
+/*! \file translator.h
+    \brief Data structures of the binary translator of the user code
+
+        The basic blocks of the user programs run often enough by the
+        block interpreter (Machine::RunBlock) are translated into x86-64
+        host code, from the decoded-instruction cache of the MMU. The
+        translated code works on the registers of the machine in
+        memory, and goes through the MMU for the memory accesses that
+        the TLB holds: everything else (other accesses, instructions
+        not translated) is left to the interpreter, which remains the
+        reference. The translator is only built with "make DBT=1".
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef TRANSLATOR_H
+#define TRANSLATOR_H
+
+#include "kernel/copyright.h"
+#include "utility/utility.h"
+
+class Instruction;
+class Machine;
+
+//! Bytes of host code kept, all the translations are dropped when full
+#define TRANSLATION_CACHE_SIZE (4 << 20)
+
+//! Bound of the host code of one guest instruction, in bytes
+#define TRANSLATION_MAX_CODE 128
+
+/*! \brief Defines a basic block translated into host code
+*/
+struct TranslatedBlock {
+  int64_t virtPc;   //!< Virtual address it was translated at
+  int length;       //!< Instructions translated, 0 if none could be
+  bool complete;    //!< true if the block ends where RunBlock ends it,
+                    //!< false if the interpreter goes on after it
+  int (*code)();    /*!< Host code: runs the instructions up to the end
+                      of the block, or up to an access the TLB does not
+                      hold, leaves pc on the next one, and returns the
+                      number of instructions run */
+};
+
+/*! \brief Defines the translations of a physical page
+*/
+struct TranslatedPage {
+  TranslatedBlock **blocks;   //!< Block starting on each halfword, or NULL
+  uint32_t *runs;             //!< Runs of each halfword as a block start
+};
+
+/*! \brief Defines the binary translator
+//
+// Blocks are looked up by physical address, the physical page of the
+// first instruction being the one of the whole block: the translations
+// of a page are dropped whenever its decoded instructions are.
+*/
+class Translator {
+public:
+  //! Translator of the user code run by machine
+  Translator(Machine *machine);
+
+  //! De-allocate the translations and the code cache
+  ~Translator();
+
+  //! Count a run of the block at pc, translated once it is hot
+  TranslatedBlock *Lookup(int64_t pc, uint32_t physAddr);
+
+  //! Drop the translations of a physical page
+  void InvalidatePage(int physPage);
+
+private:
+  //! Translations of a physical page, allocated if needed
+  TranslatedPage *GetPage(int physPage);
+
+  //! Translate the block at pc, NULL if it is not yet decoded
+  TranslatedBlock *Translate(int64_t pc, uint32_t physAddr);
+
+  //! Emit the host code of an instruction
+  int TranslateInstruction(Instruction *instr, int64_t pc, int count);
+
+  //! Drop all the translations and empty the code cache
+  void Flush();
+
+  // Emission of the host code at codeEnd
+  void Emit8(uint8_t byte);
+  void Emit32(uint32_t word);
+  void Emit64(uint64_t word);
+  void EmitLoadReg(int host, int guest, bool word);
+  void EmitStoreReg(int guest, int host);
+  void EmitCall(void *function);
+  void EmitExit(int64_t pc, int count);
+
+  Machine *machine;           //!< Machine whose user code is translated
+  TranslatedPage **pages;     //!< Translations of each physical page
+  uint8_t *cache;             //!< Code cache, readable, writable and
+                              //!< executable
+  uint8_t *codeEnd;           //!< End of the code emitted in the cache
+  int64_t discard;            //!< Destination of the loads to x0
+};
+
+#endif   // TRANSLATOR_H
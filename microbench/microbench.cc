@@ -0,0 +1,273 @@
+/*! \file microbench.cc
+//  \brief Host microbenchmarks of the kernel data structures
+//
+//  Exercises the lists, the bitmaps, the object table and the
+//  directories directly on the host, outside of the simulator, so
+//  that a change to one of them can be timed without the noise of a
+//  full Nachos run. Each benchmark runs once to warm up, then
+//  MB_RUNS times; the best run is reported in nanoseconds per
+//  operation.
+//
+//  Usage: microbench/microbench [filter]
+//  Only the benchmarks whose name contains filter are run.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "filesys/directory.h"
+#include "kernel/system.h"
+#include "utility/bitmap.h"
+#include "utility/list.h"
+#include "utility/objaddr.h"
+#include "utility/utility.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define MB_RUNS 5   //!< Measured runs of each benchmark
+
+//! Result of the benchmarks, so that the compiler keeps the loops
+static volatile uint64_t sink;
+
+//! Pseudo-random numbers, the same sequence on every run
+static uint32_t seed;
+
+static uint32_t
+MBRandom(void) {
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 8;
+}
+
+//! Host time in nanoseconds
+static uint64_t
+Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//----------------------------------------------------------------------
+// Lists
+//----------------------------------------------------------------------
+
+//! Insert size elements under random keys, then remove them in order,
+//! as for the lists of wake-up times
+static uint64_t
+ListSorted(int size) {
+  ListTime list;
+  Time key, sum = 0;
+  int rounds = 4096 / size;
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < size; i++)
+      list.SortedInsert(NULL, MBRandom() % (16 * size));
+    while (!list.IsEmpty()) {
+      list.SortedRemove(&key);
+      sum += key;
+    }
+  }
+  sink += sum;
+  return 2 * rounds * size;
+}
+
+static uint64_t
+ListSorted16(void) {
+  return ListSorted(16);
+}
+
+static uint64_t
+ListSorted256(void) {
+  return ListSorted(256);
+}
+
+//! Append and remove from the head, as for the ready list
+static uint64_t
+ListFifo(void) {
+  ListInt list;
+  for (int i = 0; i < 4096; i++) {
+    list.Append((void *) (intptr_t) i);
+    if (i & 1)
+      sink += (intptr_t) list.Remove();
+  }
+  while (!list.IsEmpty())
+    sink += (intptr_t) list.Remove();
+  return 2 * 4096;
+}
+
+//----------------------------------------------------------------------
+// Bitmaps
+//----------------------------------------------------------------------
+
+#define MB_BITS 16384   //!< Size of the bitmaps
+
+//! Bitmap with a given percentage of the bits set at random
+static BitMap *
+Fragmented(int percent) {
+  BitMap *map = new BitMap(MB_BITS);
+  for (int i = 0; i < MB_BITS; i++)
+    if ((int) (MBRandom() % 100) < percent)
+      map->Mark(i);
+  return map;
+}
+
+//! Find a clear bit and release it, on a map 90% full
+static uint64_t
+BitmapFind(void) {
+  BitMap *map = Fragmented(90);
+  for (int i = 0; i < 4096; i++) {
+    int bit = map->Find();
+    map->Clear(bit);
+    sink += bit;
+  }
+  delete map;
+  return 4096;
+}
+
+//! Find a run of 4 clear bits and release it, on a map 50% full
+static uint64_t
+BitmapFindRun(void) {
+  BitMap *map = Fragmented(50);
+  for (int i = 0; i < 4096; i++) {
+    int bit = map->FindRun(4);
+    if (bit >= 0)
+      for (int b = 0; b < 4; b++)
+        map->Clear(bit + b);
+    sink += bit;
+  }
+  delete map;
+  return 4096;
+}
+
+//----------------------------------------------------------------------
+// Object table
+//----------------------------------------------------------------------
+
+#define MB_OBJECTS 1024   //!< Objects in the table
+
+//! Look up random identifiers in a table of MB_OBJECTS objects
+static uint64_t
+ObjAddrSearch(void) {
+  ObjAddr table;
+  int32_t ids[MB_OBJECTS];
+  for (int i = 0; i < MB_OBJECTS; i++)
+    ids[i] = table.AddObject(&ids[i], SEMAPHORE_TYPE);
+  for (int i = 0; i < 65536; i++)
+    sink += (intptr_t) table.SearchObject(ids[MBRandom() % MB_OBJECTS],
+                                          SEMAPHORE_TYPE);
+  return 65536;
+}
+
+//! Add and remove objects, reusing the freed slots
+static uint64_t
+ObjAddrChurn(void) {
+  ObjAddr table;
+  int32_t ids[MB_OBJECTS];
+  for (int i = 0; i < MB_OBJECTS; i++)
+    ids[i] = table.AddObject(&ids[i], LOCK_TYPE);
+  for (int i = 0; i < 16384; i++) {
+    int k = MBRandom() % MB_OBJECTS;
+    table.RemoveObject(ids[k]);
+    ids[k] = table.AddObject(&ids[k], LOCK_TYPE);
+  }
+  sink += ids[0];
+  return 2 * 16384;
+}
+
+//----------------------------------------------------------------------
+// Directories
+//----------------------------------------------------------------------
+
+#define MB_DIR_SIZE 1024   //!< Entries of the directory
+
+//! Find names in a directory filled to a given percentage, half of
+//! the lookups for names that are not there
+static uint64_t
+DirectoryFind(int percent) {
+  Directory dir(MB_DIR_SIZE);
+  char name[FILENAMEMAXLEN];
+  int used = MB_DIR_SIZE * percent / 100;
+  for (int i = 0; i < used; i++) {
+    snprintf(name, sizeof(name), "file%d", i);
+    dir.Add(name, i + 1, false);
+  }
+  for (int i = 0; i < 16384; i++) {
+    snprintf(name, sizeof(name), "file%d", (int) (MBRandom() % (2 * used)));
+    sink += dir.Find(name);
+  }
+  return 16384;
+}
+
+static uint64_t
+DirectoryFind25(void) {
+  return DirectoryFind(25);
+}
+
+static uint64_t
+DirectoryFind50(void) {
+  return DirectoryFind(50);
+}
+
+static uint64_t
+DirectoryFind70(void) {
+  return DirectoryFind(70);
+}
+
+//----------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------
+
+//! A benchmark: runs once, returns the number of operations done
+struct MicroBench {
+  const char *name;
+  uint64_t (*run)(void);
+};
+
+static const struct MicroBench benchmarks[] = {
+    {"list/sorted-16", ListSorted16},
+    {"list/sorted-256", ListSorted256},
+    {"list/fifo", ListFifo},
+    {"bitmap/find-90%", BitmapFind},
+    {"bitmap/findrun4-50%", BitmapFindRun},
+    {"objaddr/search", ObjAddrSearch},
+    {"objaddr/add-remove", ObjAddrChurn},
+    {"directory/find-25%", DirectoryFind25},
+    {"directory/find-50%", DirectoryFind50},
+    {"directory/find-70%", DirectoryFind70},
+};
+
+int
+main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : "";
+
+  printf("%-24s %12s\n", "benchmark", "ns/op");
+  for (unsigned i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+    const struct MicroBench *b = &benchmarks[i];
+    if (strstr(b->name, filter) == NULL)
+      continue;
+    seed = 1;
+    b->run();   // warm up
+    double best = 0;
+    for (int r = 0; r < MB_RUNS; r++) {
+      seed = 1;
+      uint64_t start = Now();
+      uint64_t ops = b->run();
+      double ns = (double) (Now() - start) / ops;
+      if (r == 0 || ns < best)
+        best = ns;
+    }
+    printf("%-24s %12.1f\n", b->name, best);
+  }
+  return 0;
+}
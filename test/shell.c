@@ -23,10 +23,15 @@
 int
 main()
 {
-    ThreadId newProc;
+    ThreadId newProc, writer;
+    OpenFileId pipe[2];
     OpenFileId input = CONSOLE_INPUT;
     OpenFileId output = CONSOLE_OUTPUT;
+    OpenFileId dir;
+    DirEntry entries[16];
+    int n;
     char prompt[2], buffer[60];
+    char *second;
     int i,bg;
 
     prompt[0] = '-';
@@ -66,7 +71,55 @@ main()
 	if (n_strcmp(buffer,"exit")==0) {
 	    break;
 	  }
+
+	// Built-in "ls [dir]": list one directory, in batches of entries
+	if (buffer[0]=='l' && buffer[1]=='s'
+	    && (buffer[2]=='\0' || buffer[2]==' ')) {
+	  second = buffer + 2;
+	  while (*second == ' ') second++;
+	  dir = OpenDir(*second == '\0' ? "/" : second);
+	  if (dir == -1) {
+	    n_printf("\nUnable to list %s\n", second);
+	    continue;
+	  }
+	  while ((n = ReadDir(dir, entries, 16)) > 0)
+	    for (i = 0; i < n; i++)
+	      n_printf("%s%s\n", entries[i].name, entries[i].isDir ? "/" : "");
+	  Close(dir);
+	  continue;
+	}
 	    
+	// Pipeline "cmd1 | cmd2": cmd1 writes in a pipe read by cmd2,
+	// which both inherit as their standard output and input
+	second = buffer;
+	while (*second != '\0' && *second != '|') second++;
+	if (*second == '|') {
+	  *second = '\0';
+	  for (i = second - buffer; i > 0 && buffer[i-1] == ' '; i--)
+	    buffer[i-1] = '\0';
+	  second++;
+	  while (*second == ' ') second++;
+	  if (PipeCreate(pipe) < 0) {
+	    n_printf("\nUnable to create a pipe\n");
+	    continue;
+	  }
+	  Redirect(CONSOLE_INPUT, pipe[1]);
+	  writer = Exec(buffer);
+	  Redirect(pipe[0], CONSOLE_OUTPUT);
+	  newProc = Exec(second);
+	  Redirect(CONSOLE_INPUT, CONSOLE_OUTPUT);
+	  // Only the two commands use the pipe now
+	  Close(pipe[0]);
+	  Close(pipe[1]);
+	  if (writer == -1) n_printf("\nUnable to run %s\n", buffer);
+	  if (newProc == -1) n_printf("\nUnable to run %s\n", second);
+	  if (!bg) {
+	    if (writer != -1) Join(writer);
+	    if (newProc != -1) Join(newProc);
+	  }
+	  continue;
+	}
+
 	// Execute the command
 	// In the case it is a background command, don't wait for its completion
 	if( i > 0 ) {
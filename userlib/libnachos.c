@@ -24,6 +24,31 @@
 #include <stdarg.h>
 #include <stdint.h>
 
+// Size classes of the heap: small blocks of HEAP_MIN_BLOCK << i bytes,
+// i < HEAP_CLASSES; larger blocks are kept in a single first-fit list,
+// sorted by address so that neighbour free blocks are merged
+#define HEAP_CLASSES   8
+#define HEAP_MIN_BLOCK 16
+#define HEAP_MAX_SMALL (HEAP_MIN_BLOCK << (HEAP_CLASSES - 1))
+
+// Header of a heap block, just before the bytes returned by n_malloc
+typedef struct HeapBlock {
+  size_t size;              // usable bytes of the block
+  struct HeapBlock *next;   // next block of a free list, when free
+} HeapBlock;
+
+// Free small blocks kept by a thread created with threadCreate, moved
+// from/to the global lists by batches so that most n_malloc and n_free
+// do not take the heap lock. It lives in the frame of threadStart and
+// the tp register points to it (tp is 0 in the main thread).
+typedef struct {
+  HeapBlock *free[HEAP_CLASSES];
+  int count[HEAP_CLASSES];
+} ThreadCache;
+
+static void HeapReleaseCache(void);
+static void HeapFreeLarge(HeapBlock *block);
+
 //----------------------------------------------------------------------
 // threadStart()
 /*!	Makes a thread execute a function or program. This function
@@ -32,7 +57,8 @@
 //      of this function is to be able to terminate threads correctly,
 //      even when the thread to be terminated does not explicitly call
 //      Exit. threadStart provides the mechanism by which Exit
-//      is called automatically
+//      is called automatically. It also holds the heap cache of the
+//      thread, given back to the other threads by n_exit.
 //
 //	\param func is the identificator of the function to execute.
 */
@@ -42,10 +68,14 @@ static void
 threadStart(uint64_t func) {
   VoidNoArgFunctionPtr func2;
   func2 = (VoidNoArgFunctionPtr) func;
+  // Give the thread its cache of free heap blocks
+  ThreadCache cache;
+  n_memset(&cache, 0, sizeof(cache));
+  __asm__ volatile("mv tp, %0" : : "r"(&cache));
   // Call the function that actually contains the thread code
   (*func2)();
   // Call exit, such that there is no return using an empty stack
-  Exit(0);
+  n_exit(0);
 }
 
 //----------------------------------------------------------------------
@@ -67,6 +97,290 @@ threadCreate(char *debug_name, VoidNoArgFunctionPtr func) {
   return newThread(debug_name, (uint64_t) threadStart, (uint64_t) func);
 }
 
+//----------------------------------------------------------------------
+// n_atomic_add()
+/*!	Atomic addition (amoadd.w)
+//
+//	\param addr is the address of the integer,
+//	\param value is the value added.
+//	\return the former value of the integer.
+*/
+//----------------------------------------------------------------------
+int
+n_atomic_add(volatile int *addr, int value) {
+  return __atomic_fetch_add(addr, value, __ATOMIC_SEQ_CST);
+}
+
+//----------------------------------------------------------------------
+// n_atomic_swap()
+/*!	Atomic exchange (amoswap.w)
+//
+//	\param addr is the address of the integer,
+//	\param value is the value written.
+//	\return the former value of the integer.
+*/
+//----------------------------------------------------------------------
+int
+n_atomic_swap(volatile int *addr, int value) {
+  return __atomic_exchange_n(addr, value, __ATOMIC_SEQ_CST);
+}
+
+//----------------------------------------------------------------------
+// n_atomic_cas()
+/*!	Atomic compare and swap (lr.w / sc.w loop)
+//
+//	\param addr is the address of the integer,
+//	\param expected is the value the integer must hold,
+//	\param value is the value written.
+//	\return 1 if the value has been written, 0 otherwise.
+*/
+//----------------------------------------------------------------------
+int
+n_atomic_cas(volatile int *addr, int expected, int value) {
+  return __atomic_compare_exchange_n(addr, &expected, value, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+//----------------------------------------------------------------------
+// n_spin_init()
+/*!	Initialize a spinlock, free
+//
+//	\param lock is the spinlock.
+*/
+//----------------------------------------------------------------------
+void
+n_spin_init(SpinLock *lock) {
+  lock->locked = 0;
+}
+
+//----------------------------------------------------------------------
+// n_spin_lock()
+/*!	Acquire a spinlock. The uncontended path is a single atomic
+//	swap; a thread finding the lock held spins on reading it, and
+//	yields the CPU after a while, as the holder may wait for it.
+//
+//	\param lock is the spinlock.
+*/
+//----------------------------------------------------------------------
+#define SPIN_BEFORE_YIELD 100
+
+void
+n_spin_lock(SpinLock *lock) {
+  int spins = 0;
+  while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE) != 0) {
+    while (lock->locked) {
+      if (++spins >= SPIN_BEFORE_YIELD) {
+        Yield();
+        spins = 0;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+// n_spin_trylock()
+/*!	Acquire a spinlock if it is free
+//
+//	\param lock is the spinlock.
+//	\return 1 if the lock has been acquired, 0 otherwise.
+*/
+//----------------------------------------------------------------------
+int
+n_spin_trylock(SpinLock *lock) {
+  return __atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE) == 0;
+}
+
+//----------------------------------------------------------------------
+// n_spin_unlock()
+/*!	Release a spinlock
+//
+//	\param lock is the spinlock.
+*/
+//----------------------------------------------------------------------
+void
+n_spin_unlock(SpinLock *lock) {
+  __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------
+// n_mutex_init()
+/*!	Initialize a mutex, free
+//
+//	\param mutex is the mutex.
+*/
+//----------------------------------------------------------------------
+void
+n_mutex_init(Mutex *mutex) {
+  mutex->state = 0;
+}
+
+//----------------------------------------------------------------------
+// n_mutex_lock()
+/*!	Acquire a mutex. The uncontended path is a single compare and
+//	swap of the state from free to held. Otherwise the state is set to
+//	held with waiters, and the thread waits in the kernel (FutexWait)
+//	as long as it stays so.
+//
+//	\param mutex is the mutex.
+*/
+//----------------------------------------------------------------------
+void
+n_mutex_lock(Mutex *mutex) {
+  int state = 0;
+  if (__atomic_compare_exchange_n(&mutex->state, &state, 1, 0,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  if (state != 2)
+    state = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+  while (state != 0) {
+    FutexWait((int *) &mutex->state, 2);
+    state = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+//----------------------------------------------------------------------
+// n_mutex_trylock()
+/*!	Acquire a mutex if it is free
+//
+//	\param mutex is the mutex.
+//	\return 1 if the mutex has been acquired, 0 otherwise.
+*/
+//----------------------------------------------------------------------
+int
+n_mutex_trylock(Mutex *mutex) {
+  int state = 0;
+  return __atomic_compare_exchange_n(&mutex->state, &state, 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+//----------------------------------------------------------------------
+// n_mutex_unlock()
+/*!	Release a mutex. The kernel is only called (FutexWake) if threads
+//	may be waiting for it.
+//
+//	\param mutex is the mutex.
+*/
+//----------------------------------------------------------------------
+void
+n_mutex_unlock(Mutex *mutex) {
+  if (__atomic_fetch_sub(&mutex->state, 1, __ATOMIC_RELEASE) != 1) {
+    __atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+    FutexWake((int *) &mutex->state, 1);
+  }
+}
+
+//----------------------------------------------------------------------
+// n_cond_init()
+/*!	Initialize a condition variable
+//
+//	\param cond is the condition variable.
+*/
+//----------------------------------------------------------------------
+void
+n_cond_init(CondVar *cond) {
+  cond->seq = 0;
+  cond->waiters = 0;
+}
+
+//----------------------------------------------------------------------
+// n_cond_wait()
+/*!	Wait on a condition variable. A signal between the release of the
+//	mutex and the wait changes the sequence number, so the wait does
+//	not happen and the signal is not lost. The mutex is acquired again
+//	as held with waiters, as other threads may have been woken with us.
+//
+//	\param cond is the condition variable,
+//	\param mutex is the mutex held by the thread.
+*/
+//----------------------------------------------------------------------
+void
+n_cond_wait(CondVar *cond, Mutex *mutex) {
+  int seq = cond->seq;
+  __atomic_fetch_add(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+  n_mutex_unlock(mutex);
+  FutexWait((int *) &cond->seq, seq);
+  __atomic_fetch_sub(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0)
+    FutexWait((int *) &mutex->state, 2);
+}
+
+//----------------------------------------------------------------------
+// n_cond_signal()
+/*!	Wake up a thread waiting on a condition variable, without calling
+//	the kernel if none waits.
+//
+//	\param cond is the condition variable.
+*/
+//----------------------------------------------------------------------
+void
+n_cond_signal(CondVar *cond) {
+  __atomic_fetch_add(&cond->seq, 1, __ATOMIC_SEQ_CST);
+  if (cond->waiters > 0)
+    FutexWake((int *) &cond->seq, 1);
+}
+
+//----------------------------------------------------------------------
+// n_cond_broadcast()
+/*!	Wake up all the threads waiting on a condition variable
+//
+//	\param cond is the condition variable.
+*/
+//----------------------------------------------------------------------
+void
+n_cond_broadcast(CondVar *cond) {
+  __atomic_fetch_add(&cond->seq, 1, __ATOMIC_SEQ_CST);
+  if (cond->waiters > 0)
+    FutexWake((int *) &cond->seq, 0x7fffffff);
+}
+
+//----------------------------------------------------------------------
+// n_lifo_push()
+/*!	Push a node in a lock-free list (compare and swap of the head)
+//
+//	\param lifo is the list,
+//	\param node is the node pushed.
+*/
+//----------------------------------------------------------------------
+void
+n_lifo_push(Lifo *lifo, LifoNode *node) {
+  LifoNode *head = lifo->head;
+  do {
+    node->next = head;
+  } while (!__atomic_compare_exchange_n(&lifo->head, &head, node, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+//----------------------------------------------------------------------
+// n_lifo_take_all()
+/*!	Take every node of a lock-free list. Taking them all at once
+//	with an atomic swap of the head avoids the ABA problem of popping
+//	a single node.
+//
+//	\param lifo is the list.
+//	\return the nodes, the last pushed first, or NULL.
+*/
+//----------------------------------------------------------------------
+LifoNode *
+n_lifo_take_all(Lifo *lifo) {
+  return __atomic_exchange_n(&lifo->head, (LifoNode *) 0, __ATOMIC_ACQUIRE);
+}
+
+// Word-at-a-time operations: WORD_ONES has 1 in each byte, and
+// HAS_ZERO_BYTE is not 0 when one of the bytes of a word is 0
+#define WORD_SIZE 8
+#define WORD_ONES 0x0101010101010101ULL
+#define WORD_HIGHS 0x8080808080808080ULL
+#define HAS_ZERO_BYTE(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+#define WORD_OFFSET(p) ((uintptr_t) (p) & (WORD_SIZE - 1))
+
+// Word read or written in place of bytes of any type
+typedef uint64_t __attribute__((__may_alias__)) Word;
+
+// Size from which n_memcpy and n_memset let the kernel do the work
+// (MemCopy, MemFill), one host copy per page being much faster than
+// the interpreted loop once the system call is paid for
+#define BULK_MIN 1024
+
 //----------------------------------------------------------------------
 // n_strcmp()
 /*!	String comparison
@@ -83,6 +397,23 @@ n_strcmp(const char *s1, const char *s2) {
   int comparaison;
   int fini = 0;
   int i = 0;
+  // Skip the equal words when both strings have the same alignment
+  if (WORD_OFFSET(s1) == WORD_OFFSET(s2)) {
+    while (WORD_OFFSET(s1 + i) != 0) {
+      if (s1[i] != s2[i] || s1[i] == 0)
+        break;
+      i++;
+    }
+    if (WORD_OFFSET(s1 + i) == 0) {
+      const Word *w1 = (const Word *) (s1 + i);
+      const Word *w2 = (const Word *) (s2 + i);
+      while (*w1 == *w2 && !HAS_ZERO_BYTE(*w1)) {
+        w1++;
+        w2++;
+      }
+      i = (const char *) w1 - s1;
+    }
+  }
   while (!fini) {
     if ((s1[i] == 0) && (s2[i] == 0)) {
       fini = 1;
@@ -115,6 +446,21 @@ n_strcpy(char *dst, const char *src) {
   int i = 0;
   int fini = 0;
   if ((dst != 0) && (src != 0)) {
+    // Copy the words without a null byte when both strings have the
+    // same alignment
+    if (WORD_OFFSET(dst) == WORD_OFFSET(src)) {
+      while (WORD_OFFSET(src + i) != 0 && src[i] != '\0') {
+        dst[i] = src[i];
+        i++;
+      }
+      if (WORD_OFFSET(src + i) == 0) {
+        const Word *ws = (const Word *) (src + i);
+        Word *wd = (Word *) (dst + i);
+        while (!HAS_ZERO_BYTE(*ws))
+          *wd++ = *ws++;
+        i = (const char *) ws - src;
+      }
+    }
     while (fini == 0) {
       if (src[i] == '\0')
         fini = 1;
@@ -137,10 +483,21 @@ n_strcpy(char *dst, const char *src) {
 //----------------------------------------------------------------------
 size_t
 n_strlen(const char *s) {
-  size_t i = 0;
-  while (s[i] != 0)
-    i++;
-  return i;
+  const char *p = s;
+  while (WORD_OFFSET(p) != 0) {
+    if (*p == 0)
+      return p - s;
+    p++;
+  }
+  // Look for the null byte a word at a time: an aligned word never
+  // crosses a page, so no byte after the string is read from the next
+  const Word *w = (const Word *) p;
+  while (!HAS_ZERO_BYTE(*w))
+    w++;
+  p = (const char *) w;
+  while (*p != 0)
+    p++;
+  return p - s;
 }
 
 //----------------------------------------------------------------------
@@ -253,7 +610,17 @@ n_memcmp(const void *s1, const void *s2, size_t n) {
 
   int comparaison = 0;
   int fini = 0;
-  int i = 0;
+  size_t i = 0;
+  // Skip the equal words when both areas have the same alignment
+  if (WORD_OFFSET(c1) == WORD_OFFSET(c2)) {
+    while (i < n && WORD_OFFSET(c1 + i) != 0 && c1[i] == c2[i])
+      i++;
+    if (WORD_OFFSET(c1 + i) == 0) {
+      while (i + WORD_SIZE <= n &&
+             *(const Word *) (c1 + i) == *(const Word *) (c2 + i))
+        i += WORD_SIZE;
+    }
+  }
   while ((!fini) && (i < n)) {
     if (c1[i] < c2[i]) {
       fini = 1;
@@ -284,8 +651,43 @@ n_memcpy(void *s1, const void *s2, size_t n) {
   unsigned char *c1 = (unsigned char *) s1;
   unsigned char *c2 = (unsigned char *) s2;
 
-  int i = 0;
+  size_t i = 0;
   if ((c1 != 0) && (c2 != 0)) {
+    if (n >= BULK_MIN && MemCopy(c1, c2, n) == 0)
+      return (void *) c1;
+    // Bytes up to a word boundary of the destination
+    while (i < n && WORD_OFFSET(c1 + i) != 0) {
+      c1[i] = c2[i];
+      i++;
+    }
+    Word *wd = (Word *) (c1 + i);
+    int shift = WORD_OFFSET(c2 + i) * 8;
+    if (shift == 0) {
+      // Same alignment: copy words, four at a time
+      const Word *ws = (const Word *) (c2 + i);
+      for (; i + 4 * WORD_SIZE <= n; i += 4 * WORD_SIZE) {
+        wd[0] = ws[0];
+        wd[1] = ws[1];
+        wd[2] = ws[2];
+        wd[3] = ws[3];
+        wd += 4;
+        ws += 4;
+      }
+      for (; i + WORD_SIZE <= n; i += WORD_SIZE)
+        *wd++ = *ws++;
+    } else if (i + WORD_SIZE <= n) {
+      // Different alignment: each word written is made of two aligned
+      // words of the source (little-endian), which are only read when
+      // they hold bytes to copy
+      const Word *ws = (const Word *) (c2 + i - shift / 8);
+      uint64_t low = *ws++;
+      for (; i + WORD_SIZE <= n; i += WORD_SIZE) {
+        uint64_t high = *ws++;
+        *wd++ = (low >> shift) | (high << (64 - shift));
+        low = high;
+      }
+    }
+    // Remaining bytes
     while (i < n) {
       c1[i] = c2[i];
       i++;
@@ -309,10 +711,25 @@ n_memcpy(void *s1, const void *s2, size_t n) {
 void *
 n_memset(void *s, int c, size_t n) {
   unsigned char *c1 = (unsigned char *) s;
-  int i;
-  for (i = 0; i < n; i++) {
-    c1[i] = c;
+  size_t i = 0;
+  if (n >= BULK_MIN && MemFill(c1, c, n) == 0)
+    return (void *) c1;
+  while (i < n && WORD_OFFSET(c1 + i) != 0)
+    c1[i++] = c;
+  // Aligned words holding c in each byte
+  uint64_t word = (unsigned char) c * WORD_ONES;
+  Word *w = (Word *) (c1 + i);
+  for (; i + 4 * WORD_SIZE <= n; i += 4 * WORD_SIZE) {
+    w[0] = word;
+    w[1] = word;
+    w[2] = word;
+    w[3] = word;
+    w += 4;
   }
+  for (; i + WORD_SIZE <= n; i += WORD_SIZE)
+    *w++ = word;
+  while (i < n)
+    c1[i++] = c;
   return (void *) c1;
 }
 
@@ -623,20 +1040,575 @@ n_printf(const char *format, ...) {
     len = sizeof(buff) - 1;
   }
   if (len > 0) {
-    Write(buff, len, CONSOLE_OUTPUT);
+    n_fwrite(n_stdout, buff, len);
   }
 }
 
+//----------------------------------------------------------------------
+// n_fprintf()
+/*!	Print to a stream parameters, as n_printf.
+//
+//	\param stream is the stream to print to,
+//	\param parameters to print,
+//	\param type of print.
+*/
+//----------------------------------------------------------------------
+void
+n_fprintf(Stream *stream, const char *format, ...) {
+  va_list ap;
+  char buff[200];
+  int len;
+
+  va_start(ap, format);
+  len = n_vsnprintf(buff, sizeof(buff), format, ap);
+  va_end(ap);
+
+  if (len >= sizeof(buff)) {
+    len = sizeof(buff) - 1;
+  }
+  if (len > 0) {
+    n_fwrite(stream, buff, len);
+  }
+}
+
+// The standard streams, on the console
+static Stream stdoutStream = {CONSOLE_OUTPUT, N_LINEBUF, 0, 0, {0}, {0}};
+static Stream stdinStream = {CONSOLE_INPUT, N_LINEBUF, 0, 0, {0}, {0}};
+Stream *n_stdout = &stdoutStream;
+Stream *n_stdin = &stdinStream;
+
+//----------------------------------------------------------------------
+// n_stream_init()
+/*!	Initialize a stream, with an empty buffer
+//
+//	\param stream is the stream,
+//	\param id is the open file of the stream,
+//	\param mode is the buffering mode (N_FULLBUF, N_LINEBUF, N_NOBUF).
+*/
+//----------------------------------------------------------------------
+void
+n_stream_init(Stream *stream, OpenFileId id, int mode) {
+  stream->id = id;
+  stream->mode = mode;
+  stream->len = 0;
+  stream->pos = 0;
+  n_mutex_init(&stream->lock);
+}
+
+//----------------------------------------------------------------------
+// FlushLocked()
+/*!	Write the buffer of a stream to its file, the stream being locked
+//
+//	\param stream is the stream.
+//	\return 0, or -1 if the buffer could not be written.
+*/
+//----------------------------------------------------------------------
+static int
+FlushLocked(Stream *stream) {
+  int len = stream->len;
+  stream->len = 0;
+  if (len > 0 && Write(stream->buf, len, stream->id) < 0)
+    return -1;
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// n_setvbuf()
+/*!	Change the buffering mode of a stream
+//
+//	\param stream is the stream,
+//	\param mode is the buffering mode (N_FULLBUF, N_LINEBUF, N_NOBUF).
+*/
+//----------------------------------------------------------------------
+void
+n_setvbuf(Stream *stream, int mode) {
+  n_mutex_lock(&stream->lock);
+  FlushLocked(stream);
+  stream->mode = mode;
+  n_mutex_unlock(&stream->lock);
+}
+
+//----------------------------------------------------------------------
+// n_fwrite()
+/*!	Write bytes to a stream. They are copied into its buffer, which is
+//	written to the file when full, and depending on the mode after a
+//	newline or each call.
+//
+//	\param stream is the stream,
+//	\param buff is the bytes to write,
+//	\param size is the number of bytes.
+//	\return the number of bytes written, or -1 on a write error.
+*/
+//----------------------------------------------------------------------
+int
+n_fwrite(Stream *stream, const char *buff, int size) {
+  int i, newline = 0, error = 0;
+
+  n_mutex_lock(&stream->lock);
+  for (i = 0; i < size; i++) {
+    if (stream->len == N_BUFSIZ && FlushLocked(stream) < 0)
+      error = 1;
+    stream->buf[stream->len++] = buff[i];
+    if (buff[i] == '\n')
+      newline = 1;
+  }
+  if (stream->mode == N_NOBUF || (stream->mode == N_LINEBUF && newline))
+    if (FlushLocked(stream) < 0)
+      error = 1;
+  n_mutex_unlock(&stream->lock);
+  return error ? -1 : size;
+}
+
+//----------------------------------------------------------------------
+// n_fputs()
+/*!	Write a string to a stream
+//
+//	\param s is the string,
+//	\param stream is the stream.
+//	\return the number of bytes written, or -1 on a write error.
+*/
+//----------------------------------------------------------------------
+int
+n_fputs(const char *s, Stream *stream) {
+  return n_fwrite(stream, s, n_strlen(s));
+}
+
+//----------------------------------------------------------------------
+// n_fflush()
+/*!	Write the buffer of a stream to its file
+//
+//	\param stream is the stream.
+//	\return 0, or -1 on a write error.
+*/
+//----------------------------------------------------------------------
+int
+n_fflush(Stream *stream) {
+  n_mutex_lock(&stream->lock);
+  int result = FlushLocked(stream);
+  n_mutex_unlock(&stream->lock);
+  return result;
+}
+
+//----------------------------------------------------------------------
+// n_fgetc()
+/*!	Read a byte from a stream, refilling its buffer with one Read when
+//	empty. The console gives a line per Read, and the standard output
+//	is flushed before waiting for it, so that a prompt is seen.
+//
+//	\param stream is the stream.
+//	\return the byte, or -1 at the end of the file.
+*/
+//----------------------------------------------------------------------
+int
+n_fgetc(Stream *stream) {
+  int c;
+
+  n_mutex_lock(&stream->lock);
+  if (stream->pos >= stream->len) {
+    if (stream->id == CONSOLE_INPUT)
+      n_fflush(n_stdout);
+    int n = Read(stream->buf, N_BUFSIZ - 1, stream->id);
+    stream->pos = 0;
+    stream->len = 0;
+    if (n > 0) {
+      // The console ends the line with a '\0', and may report a read of
+      // the full size
+      stream->buf[n] = '\0';
+      stream->len = (stream->id == CONSOLE_INPUT) ? n_strlen(stream->buf) : n;
+    }
+  }
+  c = (stream->pos < stream->len) ? (unsigned char) stream->buf[stream->pos++]
+                                  : -1;
+  n_mutex_unlock(&stream->lock);
+  return c;
+}
+
 //----------------------------------------------------------------------
 // n_read_int()
 /*!
 // Very basic minimalist read integer function, no error
-// checking...
+// checking: read a decimal integer from the standard input, skipping
+// the spaces before it. Several integers can be given on one line.
 */
 //----------------------------------------------------------------------
 int
 n_read_int(void) {
-  char buff[200];
-  Read(buff, 200, CONSOLE_INPUT);
-  return n_atoi(buff);
+  int c, value = 0, negative = 0;
+
+  do
+    c = n_fgetc(n_stdin);
+  while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+  if (c == '-') {
+    negative = 1;
+    c = n_fgetc(n_stdin);
+  }
+  while (c >= '0' && c <= '9') {
+    value = value * 10 + (c - '0');
+    c = n_fgetc(n_stdin);
+  }
+
+  // The character after the integer is consumed, as a separator
+  return negative ? -value : value;
+}
+
+//----------------------------------------------------------------------
+// n_exit()
+/*!	End the thread, after writing what remains in the buffer of the
+//	standard output
+//
+//	\param status is the exit status.
+*/
+//----------------------------------------------------------------------
+void
+n_exit(int status) {
+  HeapReleaseCache();
+  n_fflush(n_stdout);
+  Exit(status);
+}
+
+// Heap management :
+// -----------------
+
+// Blocks moved at once between a thread cache and the global lists
+#define HEAP_BATCH 16
+
+// Bytes added to the heap by each Sbrk (at least)
+#define HEAP_CHUNK 65536
+
+// Global free lists, and part of the heap not yet cut into blocks,
+// protected by heapLock
+static Mutex heapLock;
+static HeapBlock *heapFree[HEAP_CLASSES];
+static HeapBlock *heapLarge;
+static char *arenaNext;
+static char *arenaEnd;
+
+//----------------------------------------------------------------------
+// CurrentCache()
+/*!	Heap cache of the running thread
+//
+//	\return the cache, or NULL in the main thread.
+*/
+//----------------------------------------------------------------------
+static ThreadCache *
+CurrentCache(void) {
+  ThreadCache *cache;
+  __asm__ volatile("mv %0, tp" : "=r"(cache));
+  return cache;
+}
+
+//----------------------------------------------------------------------
+// SizeClass()
+/*!	Size class of a small block
+//
+//	\param size is the number of bytes requested (at most HEAP_MAX_SMALL).
+//	\return the smallest class holding size bytes.
+*/
+//----------------------------------------------------------------------
+static int
+SizeClass(size_t size) {
+  int cls = 0;
+  while ((size_t) (HEAP_MIN_BLOCK << cls) < size)
+    cls++;
+  return cls;
+}
+
+//----------------------------------------------------------------------
+// HeapCarve()
+/*!	Cut a new block in the part of the heap not used yet, growing the
+//	heap with Sbrk when it is too small. The heap lock must be held.
+//
+//	\param size is the usable size of the block (multiple of 16).
+//	\return the block, or NULL if the address space is full.
+*/
+//----------------------------------------------------------------------
+static HeapBlock *
+HeapCarve(size_t size) {
+  size_t total = size + sizeof(HeapBlock);
+  if ((size_t) (arenaEnd - arenaNext) < total) {
+    size_t grow = total > HEAP_CHUNK ? total : HEAP_CHUNK;
+    if (grow > 0x40000000)
+      return NULL;
+    char *area = (char *) Sbrk((int) grow);
+    if (area == (char *) -1)
+      return NULL;
+    if (area != arenaEnd) {
+      // The heap did not grow in place: keep what remains of the
+      // former part as a large free block
+      if ((size_t) (arenaEnd - arenaNext) > sizeof(HeapBlock) + HEAP_MAX_SMALL) {
+        HeapBlock *rest = (HeapBlock *) arenaNext;
+        rest->size = arenaEnd - arenaNext - sizeof(HeapBlock);
+        HeapFreeLarge(rest);
+      }
+      arenaNext = area;
+    }
+    arenaEnd = area + grow;
+  }
+  HeapBlock *block = (HeapBlock *) arenaNext;
+  arenaNext += total;
+  block->size = size;
+  return block;
+}
+
+//----------------------------------------------------------------------
+// HeapFreeLarge()
+/*!	Put a large block in the free list, merging it with the free
+//	blocks just before and after it, or giving it back to the part of
+//	the heap not used yet when it ends there. The heap lock must be held.
+//
+//	\param block is the block.
+*/
+//----------------------------------------------------------------------
+static void
+HeapFreeLarge(HeapBlock *block) {
+  HeapBlock **prevLink = NULL;
+  HeapBlock **link = &heapLarge;
+  while (*link != NULL && *link < block) {
+    prevLink = link;
+    link = &(*link)->next;
+  }
+  HeapBlock *next = *link;
+  if (next != NULL && (char *) (block + 1) + block->size == (char *) next) {
+    block->size += sizeof(HeapBlock) + next->size;
+    next = next->next;
+  }
+  block->next = next;
+  *link = block;
+  HeapBlock *prev = prevLink ? *prevLink : NULL;
+  if (prev != NULL && (char *) (prev + 1) + prev->size == (char *) block) {
+    prev->size += sizeof(HeapBlock) + block->size;
+    prev->next = next;
+    link = prevLink;
+    block = prev;
+  }
+
+  // The last block before the unused part of the heap goes back there
+  if ((char *) (block + 1) + block->size == arenaNext) {
+    arenaNext = (char *) block;
+    *link = block->next;
+  }
+}
+
+//----------------------------------------------------------------------
+// HeapTakeSmall()
+/*!	Take a block of a size class from the global lists, or cut a new
+//	one. The heap lock must be held.
+//
+//	\param cls is the size class.
+//	\return the block, or NULL if the address space is full.
+*/
+//----------------------------------------------------------------------
+static HeapBlock *
+HeapTakeSmall(int cls) {
+  HeapBlock *block = heapFree[cls];
+  if (block != NULL) {
+    heapFree[cls] = block->next;
+    return block;
+  }
+  return HeapCarve(HEAP_MIN_BLOCK << cls);
+}
+
+//----------------------------------------------------------------------
+// HeapTakeLarge()
+/*!	Take the first free large block big enough, splitting it when
+//	what remains is still a large block, or cut a new one.
+//	The heap lock must be held.
+//
+//	\param size is the number of bytes requested (multiple of 16).
+//	\return the block, or NULL if the address space is full.
+*/
+//----------------------------------------------------------------------
+static HeapBlock *
+HeapTakeLarge(size_t size) {
+  HeapBlock **prev = &heapLarge;
+  for (HeapBlock *block = heapLarge; block != NULL; block = block->next) {
+    if (block->size >= size) {
+      if (block->size - size > sizeof(HeapBlock) + HEAP_MAX_SMALL) {
+        HeapBlock *rest = (HeapBlock *) ((char *) (block + 1) + size);
+        rest->size = block->size - size - sizeof(HeapBlock);
+        rest->next = block->next;
+        *prev = rest;
+        block->size = size;
+      } else
+        *prev = block->next;
+      return block;
+    }
+    prev = &block->next;
+  }
+  return HeapCarve(size);
+}
+
+//----------------------------------------------------------------------
+// CacheDrain()
+/*!	Give back to the global lists the blocks of a size class of a
+//	thread cache, but the first ones
+//
+//	\param cache is the thread cache,
+//	\param cls is the size class,
+//	\param keep is the number of blocks left in the cache.
+*/
+//----------------------------------------------------------------------
+static void
+CacheDrain(ThreadCache *cache, int cls, int keep) {
+  n_mutex_lock(&heapLock);
+  while (cache->count[cls] > keep) {
+    HeapBlock *block = cache->free[cls];
+    cache->free[cls] = block->next;
+    block->next = heapFree[cls];
+    heapFree[cls] = block;
+    cache->count[cls]--;
+  }
+  n_mutex_unlock(&heapLock);
+}
+
+//----------------------------------------------------------------------
+// HeapReleaseCache()
+/*!	Give back to the global lists all the blocks of the cache of the
+//	running thread, before it ends
+*/
+//----------------------------------------------------------------------
+static void
+HeapReleaseCache(void) {
+  ThreadCache *cache = CurrentCache();
+  if (cache == NULL)
+    return;
+  for (int cls = 0; cls < HEAP_CLASSES; cls++)
+    if (cache->count[cls] > 0)
+      CacheDrain(cache, cls, 0);
+}
+
+//----------------------------------------------------------------------
+// n_malloc()
+/*!	Allocate a block in the heap
+//
+//	\param size is the number of bytes requested.
+//	\return the address of the block (aligned on 16 bytes), or NULL
+//	  if the address space is full.
+*/
+//----------------------------------------------------------------------
+void *
+n_malloc(size_t size) {
+  HeapBlock *block;
+  if (size > 0x40000000)
+    return NULL;
+
+  if (size > HEAP_MAX_SMALL) {
+    n_mutex_lock(&heapLock);
+    block = HeapTakeLarge((size + 15) & ~(size_t) 15);
+    n_mutex_unlock(&heapLock);
+    return block ? block + 1 : NULL;
+  }
+
+  int cls = SizeClass(size);
+  ThreadCache *cache = CurrentCache();
+  if (cache == NULL) {
+    n_mutex_lock(&heapLock);
+    block = HeapTakeSmall(cls);
+    n_mutex_unlock(&heapLock);
+    return block ? block + 1 : NULL;
+  }
+
+  if (cache->free[cls] == NULL) {
+    // Refill the cache with a batch of blocks
+    n_mutex_lock(&heapLock);
+    while (cache->count[cls] < HEAP_BATCH) {
+      block = HeapTakeSmall(cls);
+      if (block == NULL)
+        break;
+      block->next = cache->free[cls];
+      cache->free[cls] = block;
+      cache->count[cls]++;
+    }
+    n_mutex_unlock(&heapLock);
+    if (cache->free[cls] == NULL)
+      return NULL;
+  }
+  block = cache->free[cls];
+  cache->free[cls] = block->next;
+  cache->count[cls]--;
+  return block + 1;
+}
+
+//----------------------------------------------------------------------
+// n_calloc()
+/*!	Allocate a zero-filled array in the heap
+//
+//	\param count is the number of elements,
+//	\param size is the size of an element.
+//	\return the address of the array, or NULL.
+*/
+//----------------------------------------------------------------------
+void *
+n_calloc(size_t count, size_t size) {
+  if (size != 0 && count > 0x40000000 / size)
+    return NULL;
+  void *ptr = n_malloc(count * size);
+  if (ptr != NULL)
+    n_memset(ptr, 0, count * size);
+  return ptr;
+}
+
+//----------------------------------------------------------------------
+// n_realloc()
+/*!	Resize a block of the heap
+//
+//	\param ptr is the block (NULL to allocate a new one),
+//	\param size is its new size (0 to free it).
+//	\return the address of the block, which moves when it does not
+//	  have room for size bytes, or NULL.
+*/
+//----------------------------------------------------------------------
+void *
+n_realloc(void *ptr, size_t size) {
+  if (ptr == NULL)
+    return n_malloc(size);
+  if (size == 0) {
+    n_free(ptr);
+    return NULL;
+  }
+  HeapBlock *block = (HeapBlock *) ptr - 1;
+  if (block->size >= size)
+    return ptr;
+  void *moved = n_malloc(size);
+  if (moved != NULL) {
+    n_memcpy(moved, ptr, block->size);
+    n_free(ptr);
+  }
+  return moved;
+}
+
+//----------------------------------------------------------------------
+// n_free()
+/*!	Release a block of the heap: small blocks go to the cache of the
+//	thread, which gives a batch back when it holds too many of them
+//
+//	\param ptr is the block (NULL is ignored).
+*/
+//----------------------------------------------------------------------
+void
+n_free(void *ptr) {
+  if (ptr == NULL)
+    return;
+  HeapBlock *block = (HeapBlock *) ptr - 1;
+
+  if (block->size > HEAP_MAX_SMALL) {
+    n_mutex_lock(&heapLock);
+    HeapFreeLarge(block);
+    n_mutex_unlock(&heapLock);
+    return;
+  }
+
+  int cls = SizeClass(block->size);
+  ThreadCache *cache = CurrentCache();
+  if (cache == NULL) {
+    n_mutex_lock(&heapLock);
+    block->next = heapFree[cls];
+    heapFree[cls] = block;
+    n_mutex_unlock(&heapLock);
+    return;
+  }
+  block->next = cache->free[cls];
+  cache->free[cls] = block;
+  if (++cache->count[cls] > 2 * HEAP_BATCH)
+    CacheDrain(cache, cls, HEAP_BATCH);
 }
@@ -32,13 +32,142 @@
 typedef void (*VoidNoArgFunctionPtr)();
 typedef unsigned int size_t;
 
+#ifndef NULL
+#define NULL ((void *) 0)
+#endif
+
 // Thread management
 // ----------------------------
 ThreadId threadCreate(char *debug_name, VoidNoArgFunctionPtr func);
 
+// Atomic operations (RISC-V A extension) :
+// ------------------------------------------
+// They never enter the kernel: the simulated processor executes them.
+
+// Atomically add <value> to <*addr>, return the former value.
+int n_atomic_add(volatile int *addr, int value);
+
+// Atomically write <value> into <*addr>, return the former value.
+int n_atomic_swap(volatile int *addr, int value);
+
+// Atomically write <value> into <*addr> if it holds <expected>,
+// return 1 if it did, 0 otherwise.
+int n_atomic_cas(volatile int *addr, int expected, int value);
+
+// Spinlock, spinning in user mode while the lock is held
+typedef struct {
+  volatile int locked;
+} SpinLock;
+
+// Initialize a spinlock (free).
+void n_spin_init(SpinLock *lock);
+
+// Acquire a spinlock, yielding the CPU if it stays held for long.
+void n_spin_lock(SpinLock *lock);
+
+// Acquire a spinlock if it is free, return 1 if it has been acquired.
+int n_spin_trylock(SpinLock *lock);
+
+// Release a spinlock.
+void n_spin_unlock(SpinLock *lock);
+
+// Mutex, only calling the kernel (futexes) when contended
+typedef struct {
+  volatile int state;   // 0 free, 1 held, 2 held with waiters
+} Mutex;
+
+// Initialize a mutex (free).
+void n_mutex_init(Mutex *mutex);
+
+// Acquire a mutex, waiting in the kernel while it is held.
+void n_mutex_lock(Mutex *mutex);
+
+// Acquire a mutex if it is free, return 1 if it has been acquired.
+int n_mutex_trylock(Mutex *mutex);
+
+// Release a mutex, waking up a waiting thread if any.
+void n_mutex_unlock(Mutex *mutex);
+
+// Condition variable, used with a mutex
+typedef struct {
+  volatile int seq;       // incremented by each signal
+  volatile int waiters;   // threads waiting, to skip the kernel if none
+} CondVar;
+
+// Initialize a condition variable.
+void n_cond_init(CondVar *cond);
+
+// Release the mutex, wait for a signal, then acquire the mutex again.
+void n_cond_wait(CondVar *cond, Mutex *mutex);
+
+// Wake up a thread waiting on the condition variable.
+void n_cond_signal(CondVar *cond);
+
+// Wake up all the threads waiting on the condition variable.
+void n_cond_broadcast(CondVar *cond);
+
+// Lock-free LIFO list, any number of threads pushing and taking
+typedef struct LifoNode {
+  struct LifoNode *next;
+} LifoNode;
+
+typedef struct {
+  LifoNode *volatile head;
+} Lifo;
+
+// Push a node in a lock-free list.
+void n_lifo_push(Lifo *lifo, LifoNode *node);
+
+// Take every node of a lock-free list at once, the last pushed first
+// (NULL if the list is empty).
+LifoNode *n_lifo_take_all(Lifo *lifo);
+
 // Input/Output operations :
 // ------------------------------------
 
+// Buffered streams: the bytes written are gathered in the buffer of the
+// stream, and written with one Write system call when it is flushed;
+// the bytes read come from the buffer, refilled with one Read when empty
+#define N_BUFSIZ 256
+
+#define N_FULLBUF 0   // flush when the buffer is full
+#define N_LINEBUF 1   // flush on each newline too
+#define N_NOBUF   2   // flush on each write
+
+typedef struct {
+  OpenFileId id;        // file of the stream
+  int mode;             // N_FULLBUF, N_LINEBUF or N_NOBUF
+  int len;              // bytes in the buffer
+  int pos;              // next byte to read from the buffer
+  Mutex lock;           // held while the stream is used
+  char buf[N_BUFSIZ];
+} Stream;
+
+// Standard output (line buffered) and input streams of the console
+extern Stream *n_stdout;
+extern Stream *n_stdin;
+
+// Initialize a stream on an open file.
+void n_stream_init(Stream *stream, OpenFileId id, int mode);
+
+// Change the buffering mode of a stream, after flushing it.
+void n_setvbuf(Stream *stream, int mode);
+
+// Write <size> bytes to a stream, return the number of bytes written.
+int n_fwrite(Stream *stream, const char *buff, int size);
+
+// Write a string to a stream.
+int n_fputs(const char *s, Stream *stream);
+
+// Write the buffer of a stream to its file.
+int n_fflush(Stream *stream);
+
+// Read a byte from a stream, return -1 at the end of the file.
+int n_fgetc(Stream *stream);
+
+// Print on a stream specified parameters.
+void n_fprintf(Stream *stream, const char *format, ...);
+
 // Print on the standard output specified parameters.
 void n_printf(const char *format, ...);
 
@@ -48,6 +177,9 @@ int n_snprintf(char *buff, int len, const char *format, ...);
 // Read an integer on the standard input
 int n_read_int(void);
 
+// Flush the standard output, then end the thread (Exit).
+void n_exit(int status);
+
 // String operations :
 // -------------------
 
@@ -85,3 +217,21 @@ void *n_memcpy(void *s1, const void *s2, size_t n);
 
 // Set the first n bytes in a memory area to a specified value.
 void *n_memset(void *s, int c, size_t n);
+
+// Memory allocation :
+// -------------------
+
+// Allocate a block of <size> bytes in the heap (grown with Sbrk),
+// aligned on 16 bytes; return NULL if the address space is full.
+// Small blocks come from a cache of the thread when it has been
+// created by threadCreate.
+void *n_malloc(size_t size);
+
+// Allocate a zero-filled array of <count> elements of <size> bytes.
+void *n_calloc(size_t count, size_t size);
+
+// Resize a block, moving its content if it does not fit in place.
+void *n_realloc(void *ptr, size_t size);
+
+// Release a block allocated by n_malloc (NULL is ignored).
+void n_free(void *ptr);
@@ -72,6 +72,35 @@
 #define SC_SYS_TIME       32
 #define SC_MMAP           33
 #define SC_DEBUG          34
+#define SC_RWLOCK_CREATE  35
+#define SC_RWLOCK_DESTROY 36
+#define SC_RWLOCK_READ    37
+#define SC_RWLOCK_WRITE   38
+#define SC_RWLOCK_RELEASE 39
+#define SC_BARRIER_CREATE 40
+#define SC_BARRIER_DESTROY 41
+#define SC_BARRIER_WAIT   42
+#define SC_READV          43
+#define SC_WRITEV         44
+#define SC_PREAD          45
+#define SC_PWRITE         46
+#define SC_AIO_SUBMIT     47
+#define SC_AIO_WAIT       48
+#define SC_MSYNC          49
+#define SC_FUTEX_WAIT     50
+#define SC_FUTEX_WAKE     51
+#define SC_SBRK           52
+#define SC_MEMCOPY        53
+#define SC_MEMFILL        54
+#define SC_SLEEP          55
+#define SC_PIPE           56
+#define SC_REDIRECT       57
+#define SC_SHM_CREATE     58
+#define SC_SHM_ATTACH     59
+#define SC_OPENDIR        60
+#define SC_READDIR        61
+#define SC_TTY_SEND_TO    62
+#define SC_TTY_RECEIVE_FROM 63
 
 #ifndef IN_ASM
 
@@ -167,6 +196,81 @@ t_error Read(char *buffer, int size, OpenFileId id);
 /* Seek to a specified offset into an opened file */
 t_error Seek(int offset, OpenFileId id);
 
+/* One buffer of a vectored read or write */
+typedef struct {
+  char *base; /* start of the buffer */
+  long len;   /* number of bytes of the buffer */
+} IOVec;
+
+/* Read into the "count" buffers described by "iov", in order, from the
+ * current position of the open file, and move the position past the
+ * bytes read. Return the total number of bytes read.
+ */
+t_error Readv(IOVec *iov, int count, OpenFileId id);
+
+/* Write the "count" buffers described by "iov", in order, at the
+ * current position of the open file (or at the console), and move the
+ * position past the bytes written. Return the total number of bytes
+ * written.
+ */
+t_error Writev(IOVec *iov, int count, OpenFileId id);
+
+/* Read "size" bytes of the open file, starting at "offset", into
+ * "buffer". The current position of the file is not used nor changed.
+ * Return the number of bytes actually read.
+ */
+t_error Pread(char *buffer, int size, int offset, OpenFileId id);
+
+/* Write "size" bytes from "buffer" to the open file, starting at
+ * "offset". The current position of the file is not used nor changed.
+ * Return the number of bytes actually written.
+ */
+t_error Pwrite(char *buffer, int size, int offset, OpenFileId id);
+
+/* Asynchronous I/O. The program and the kernel share a ring made of a
+ * submission queue and a completion queue of "entries" slots each.
+ * The indexes only grow, the slot of an index being the index modulo
+ * "entries". The program writes requests at sq_tail and reads
+ * completions at cq_head; the kernel takes requests at sq_head and
+ * posts completions at cq_tail, in the order of the requests.
+ */
+#define AIO_READ  0
+#define AIO_WRITE 1
+
+typedef struct {
+  long op;       /* AIO_READ or AIO_WRITE */
+  long id;       /* open file, ConsoleInput or ConsoleOutput */
+  char *buffer;  /* data to write, or room for the data read */
+  long size;     /* number of bytes */
+  long offset;   /* position in the file, -1 for the current position */
+  long tag;      /* returned in the completion */
+} AioRequest;
+
+typedef struct {
+  long tag;      /* tag of the request */
+  long result;   /* number of bytes transferred, or -1 */
+} AioCompletion;
+
+typedef struct {
+  long entries;
+  long sq_head;
+  long sq_tail;
+  long cq_head;
+  long cq_tail;
+  AioRequest *sq;
+  AioCompletion *cq;
+} AioRing;
+
+/* Hand the requests added to the submission queue of "ring" to the
+ * kernel, and return at once with the number of requests not started
+ * yet. */
+t_error AioSubmit(AioRing *ring);
+
+/* Wait until at least "min" completions are available in the
+ * completion queue of "ring" (or no request is left), and return the
+ * number of completions available. */
+t_error AioWait(AioRing *ring, int min);
+
 #ifndef SYSDEP_H
 /* Close the file, we're done reading and writing to it. */
 t_error Close(OpenFileId id);
@@ -191,6 +295,29 @@ t_error Rmdir(char *name);
 /* List the content of NachOS FileSystem */
 t_error FSList();
 
+/* Entry of a directory returned by ReadDir */
+#define DIRENT_NAME_SIZE 88
+
+typedef struct {
+  long isDir;                   /* 1 for a directory, 0 for a file */
+  char name[DIRENT_NAME_SIZE];  /* name in the directory, '\0'-terminated */
+} DirEntry;
+
+/* Maximum number of entries returned by one call to ReadDir */
+#define READDIR_MAX_ENTRIES 64
+
+/* Open a directory ("/" for the root) to read its entries with
+   ReadDir; Close it when done.
+   Return an identifier, or a negative number if an error ocurred. */
+OpenFileId OpenDir(char *name);
+
+/* Copy the next entries of the directory into entries, at most count
+   (and at most READDIR_MAX_ENTRIES), in no particular order. Only the
+   part of the directory holding them is read from the disk.
+   Return the number of entries copied, 0 at the end of the directory,
+   or a negative number if an error ocurred. */
+int ReadDir(OpenFileId dir, DirEntry *entries, int count);
+
 /******************************************************************/
 /* User-level synchronization operations :  */
 
@@ -234,6 +361,45 @@ t_error LockAcquire(LockId id);
 */
 t_error LockRelease(LockId id);
 
+/* System calls concerning reader-writer locks (writers are preferred) */
+typedef unsigned long RWLockId;
+
+/* Create a reader-writer lock.
+ Return an identifier */
+RWLockId RWLockCreate(char *debug_name);
+
+/* Destroy a reader-writer lock.
+   Return a negative number if an error ocurred. */
+t_error RWLockDestroy(RWLockId id);
+
+/* Acquire the lock id in read (shared) mode.
+   Return a negative number if an error ocurred. */
+t_error RWLockAcquireRead(RWLockId id);
+
+/* Acquire the lock id in write (exclusive) mode.
+   Return a negative number if an error ocurred. */
+t_error RWLockAcquireWrite(RWLockId id);
+
+/* Release the lock id, acquired in either mode.
+   Return a negative number if an error ocurred. */
+t_error RWLockRelease(RWLockId id);
+
+/* System calls concerning barriers */
+typedef unsigned long BarrierId;
+
+/* Create a barrier for count threads.
+ Return an identifier */
+BarrierId BarrierCreate(char *debug_name, int count);
+
+/* Destroy a barrier.
+   Return a negative number if an error ocurred. */
+t_error BarrierDestroy(BarrierId id);
+
+/* Wait until count threads have reached the barrier id.
+   Return 1 in the last thread to arrive, 0 in the others, and
+   a negative number if an error ocurred. */
+t_error BarrierWait(BarrierId id);
+
 /* System calls concerning conditions variables. */
 typedef unsigned long CondId;
 
@@ -274,12 +440,103 @@ int TtySend(char *mess);
 */
 int TtyReceive(char *mess, int length);
 
+/* Send the message through a port of the ACIA, each one linked to its
+   own peer (UseACIA = Framed, AciaPorts ports; on the switch, port p
+   is linked to node p). TtySend uses port 0.
+   Returns the number of bytes successfully sent.
+*/
+int TtySendTo(int port, char *mess);
+
+/* Wait for a message coming from a port of the ACIA (see TtySendTo).
+   Returns the number of characters actually received.
+*/
+int TtyReceiveFrom(int port, char *mess, int length);
+
 /* Map an opened file in memory. Size is the size to be mapped in bytes.
+   The pages are read from the file when first touched, and the
+   modified ones are written back to it when evicted, on Msync, and
+   when the process ends. Bytes beyond the end of the file are not
+   written back.
  */
 void *Mmap(OpenFileId f, int size);
 
-/* For debug purpose
+/* Write back to the file the modified pages of a mapping overlapping
+   the "size" bytes at "addr". Return -1 if they are not all mapped.
  */
+t_error Msync(void *addr, int size);
+
+/* System calls concerning futexes, the wait queues of user-level
+   locks built with atomic instructions on a word of memory (see the
+   mutexes of libnachos) */
+
+/* Wait until woken up by FutexWake, if the word at addr still holds
+   val. Return 0 once woken up, 1 if the word held another value, and
+   a negative number if an error ocurred. */
+t_error FutexWait(int *addr, int val);
+
+/* Wake up at most count threads waiting on the word at addr.
+   Return the number of threads woken up. */
+int FutexWake(int *addr, int count);
+
+/* Grow the heap of the process by size bytes, zero-filled.
+   Return the address of the first added byte (the previous break
+   when the heap grew in place), or -1 if the address space is full.
+   Sbrk(0) returns the current break. */
+void *Sbrk(int size);
+
+/* Copy size bytes from src to dst (the areas may overlap), or set size
+   bytes at addr to value, with one host copy per page: much faster
+   than a loop of the program for large areas (see the memory
+   functions of libnachos). Return 0, or a negative number if an
+   address is invalid. */
+t_error MemCopy(void *dst, const void *src, unsigned int size);
+t_error MemFill(void *addr, int value, unsigned int size);
+
+/* Sleep for at least ticks processor cycles, without using the CPU.
+   The thread is woken up by the time slice following the deadline.
+   Return 0, or a negative number if ticks is negative. */
+t_error Sleep(long ticks);
+
+/* Create a pipe: fds[0] is its reader and fds[1] its writer. Read on
+   the reader returns the bytes written on the writer, blocking while
+   the pipe is empty, and 0 once no writer is left; Write on the writer
+   blocks while the pipe is full, and fails once no reader is left.
+   Return 0, or a negative number if fds is invalid. */
+t_error PipeCreate(OpenFileId fds[2]);
+
+/* Set the standard input and output of the process, used instead of
+   the console by Read on CONSOLE_INPUT and Write on CONSOLE_OUTPUT,
+   and inherited by the processes it Execs: input is CONSOLE_INPUT or
+   a pipe reader, output is CONSOLE_OUTPUT or a pipe writer. Close
+   does not end a pipe still used as a standard input or output.
+   Return 0, or a negative number if an identifier is invalid. */
+t_error Redirect(OpenFileId input, OpenFileId output);
+
+/* System calls concerning shared memory segments */
+typedef unsigned long ShmId;
+
+/* Create a shared memory segment of size bytes, filled with zeroes.
+   The processes attaching it share its pages: what one writes is seen
+   by the others, without any copy. The segment lives as long as the
+   process which created it, or a process which attached it, runs.
+   Return an identifier, or a negative number if an error ocurred. */
+ShmId ShmCreate(int size);
+
+/* Map the shared memory segment id in the address space of the
+   process (at an address of its own). Return the address of its first
+   byte, or -1 if an error ocurred. */
+void *ShmAttach(ShmId id);
+
+/* For debug purpose: print param on the host output, or switch the
+   simulation mode of the user code. DEBUG_DETAILED starts the detailed
+   mode (timing and statistics of every instruction), DEBUG_FAST_FORWARD
+   the fast-forward mode (instructions run at full speed, charged a
+   constant time, without statistics), to time a region of interest of
+   a long program only.
+ */
+#define DEBUG_DETAILED     -1
+#define DEBUG_FAST_FORWARD -2
+
 void Debug(int param);
 
 #endif   // IN_ASM
@@ -33,16 +33,53 @@
 BitMap::BitMap(int nitems) {
   numBits = nitems;
   numWords = divRoundUp(numBits, BITS_IN_WORD);
-  map = new unsigned int[numWords];
-  for (int i = 0; i < numBits; i++)
-    Clear(i);
+  map = new uint64_t[numWords];
+  numFull = divRoundUp(numWords, BITS_IN_WORD);
+  full = new uint64_t[numFull];
+  numChunks = divRoundUp(numWords, BITMAP_CHUNK_WORDS);
+  dirty = new bool[numChunks];
+  for (int i = 0; i < numWords; i++)
+    map[i] = 0;
+  for (int i = 0; i < numChunks; i++)
+    dirty[i] = false;
+  cursor = 0;
+  Rebuild();
 }
 
 //----------------------------------------------------------------------
 // BitMap::~BitMap
 //!	De-allocate a bitmap.
 //----------------------------------------------------------------------
-BitMap::~BitMap() { delete[] map; }
+BitMap::~BitMap() {
+  delete[] map;
+  delete[] full;
+  delete[] dirty;
+}
+
+//----------------------------------------------------------------------
+// BitMap::Rebuild
+/*! 	Recompute the summary and the number of clear bits from the
+//	contents of the map. The bits of the last word beyond numBits, and
+//	the bits of the summary beyond numWords, are kept set so that the
+//	searches never return them.
+*/
+//----------------------------------------------------------------------
+void
+BitMap::Rebuild() {
+  if (numBits % BITS_IN_WORD != 0)
+    map[numWords - 1] |= ~0ULL << (numBits % BITS_IN_WORD);
+  for (int i = 0; i < numFull; i++)
+    full[i] = 0;
+  if (numWords % BITS_IN_WORD != 0)
+    full[numFull - 1] = ~0ULL << (numWords % BITS_IN_WORD);
+
+  numClear = 0;
+  for (int i = 0; i < numWords; i++) {
+    numClear += BITS_IN_WORD - __builtin_popcountll(map[i]);
+    if (map[i] == ~0ULL)
+      full[i / BITS_IN_WORD] |= 1ULL << (i % BITS_IN_WORD);
+  }
+}
 
 //----------------------------------------------------------------------
 // BitMap::Set
@@ -54,7 +91,16 @@ BitMap::~BitMap() { delete[] map; }
 void
 BitMap::Mark(int which) {
   ASSERT(which >= 0 && which < numBits);
-  map[which / BITS_IN_WORD] |= 1 << (which % BITS_IN_WORD);
+  int w = which / BITS_IN_WORD;
+  uint64_t bit = 1ULL << (which % BITS_IN_WORD);
+
+  if (map[w] & bit)
+    return;
+  map[w] |= bit;
+  numClear--;
+  if (map[w] == ~0ULL)
+    full[w / BITS_IN_WORD] |= 1ULL << (w % BITS_IN_WORD);
+  dirty[w / BITMAP_CHUNK_WORDS] = true;
 }
 
 //----------------------------------------------------------------------
@@ -67,7 +113,15 @@ BitMap::Mark(int which) {
 void
 BitMap::Clear(int which) {
   ASSERT(which >= 0 && which < numBits);
-  map[which / BITS_IN_WORD] &= ~(1 << (which % BITS_IN_WORD));
+  int w = which / BITS_IN_WORD;
+  uint64_t bit = 1ULL << (which % BITS_IN_WORD);
+
+  if (!(map[w] & bit))
+    return;
+  map[w] &= ~bit;
+  numClear++;
+  full[w / BITS_IN_WORD] &= ~(1ULL << (w % BITS_IN_WORD));
+  dirty[w / BITMAP_CHUNK_WORDS] = true;
 }
 
 //----------------------------------------------------------------------
@@ -81,28 +135,155 @@ bool
 BitMap::Test(int which) {
   ASSERT(which >= 0 && which < numBits);
 
-  if (map[which / BITS_IN_WORD] & (1 << (which % BITS_IN_WORD)))
+  if (map[which / BITS_IN_WORD] & (1ULL << (which % BITS_IN_WORD)))
     return true;
   else
     return false;
 }
 
+//----------------------------------------------------------------------
+// BitMap::NextClear
+/*! 	Find the first clear bit at or after "from". The rest of the word
+//	of "from" is tested at once, then the summary gives the next word
+//	that is not full.
+//
+//	\param from is the number of the first bit to consider
+//	\return the number of the bit, or numBits if all the bits from
+//	"from" are set
+*/
+//----------------------------------------------------------------------
+int
+BitMap::NextClear(int from) {
+  if (from >= numBits)
+    return numBits;
+
+  int w = from / BITS_IN_WORD;
+  uint64_t word = ~map[w] & (~0ULL << (from % BITS_IN_WORD));
+  if (word)
+    return w * BITS_IN_WORD + __builtin_ctzll(word);
+
+  // Look in the summary for the next word with a clear bit
+  w++;
+  int s = w / BITS_IN_WORD;
+  if (s >= numFull)
+    return numBits;
+  uint64_t free = ~full[s] & (~0ULL << (w % BITS_IN_WORD));
+  while (!free) {
+    if (++s >= numFull)
+      return numBits;
+    free = ~full[s];
+  }
+  w = s * BITS_IN_WORD + __builtin_ctzll(free);
+  return w * BITS_IN_WORD + __builtin_ctzll(~map[w]);
+}
+
+//----------------------------------------------------------------------
+// BitMap::NextSet
+/*! 	Find the first set bit at or after "from", one word at a time.
+//
+//	\param from is the number of the first bit to consider
+//	\param limit is the number of the bit where the search stops
+//	\return the number of the bit, or "limit" if there is no set bit
+//	before it
+*/
+//----------------------------------------------------------------------
+int
+BitMap::NextSet(int from, int limit) {
+  if (limit > numBits)
+    limit = numBits;
+
+  int w = from / BITS_IN_WORD;
+  uint64_t word = map[w] & (~0ULL << (from % BITS_IN_WORD));
+  while (!word) {
+    if (++w >= numWords || w * BITS_IN_WORD >= limit)
+      return limit;
+    word = map[w];
+  }
+  int i = w * BITS_IN_WORD + __builtin_ctzll(word);
+  return (i < limit) ? i : limit;
+}
+
 //----------------------------------------------------------------------
 // BitMap::Find
 /*! 	Return the number of the first bit which is clear.
 //	As a side effect, set the bit (mark it as in use).
 //	(In other words, find and allocate a bit.)
 //
+//	The search starts just after the bit found by the previous call
+//	(next fit), and wraps around to the beginning of the bitmap.
+//
 //	\return If no bits are clear, return ERROR
 */
 //----------------------------------------------------------------------
 int
 BitMap::Find() {
-  for (int i = 0; i < numBits; i++)
-    if (!Test(i)) {
-      Mark(i);
+  if (numClear == 0)
+    return ERROR;
+
+  int i = NextClear(cursor);
+  if (i == numBits)
+    i = NextClear(0);
+  Mark(i);
+  cursor = (i + 1 < numBits) ? i + 1 : 0;
+  return i;
+}
+
+//----------------------------------------------------------------------
+// BitMap::FindRun
+/*! 	Find a run of "count" consecutive clear bits (first fit), or if
+//	there is none, the longest run of clear bits, and mark them as
+//	allocated.
+//
+//	\param count the number of bits wanted
+//	\param length is set to the number of bits of the run found
+//	\return the number of the first bit of the run, or ERROR if no bits
+//	are clear
+*/
+//----------------------------------------------------------------------
+int
+BitMap::FindRun(int count, int *length) {
+  int best = ERROR, bestLength = 0;
+
+  for (int i = NextClear(0); i < numBits;) {
+    int end = NextSet(i, i + count);
+    if (end - i > bestLength) {
+      best = i;
+      bestLength = end - i;
+      if (bestLength == count)
+        break;
+    }
+    i = NextClear(end);
+  }
+
+  for (int i = 0; i < bestLength; i++)
+    Mark(best + i);
+  *length = bestLength;
+  return best;
+}
+
+//----------------------------------------------------------------------
+// BitMap::FindRun
+/*! 	Find a run of "count" consecutive clear bits (first fit) and mark
+//	them as allocated. Nothing is allocated if there is no such run.
+//
+//	\param count the number of bits wanted
+//	\return the number of the first bit of the run, or ERROR
+*/
+//----------------------------------------------------------------------
+int
+BitMap::FindRun(int count) {
+  if (count <= 0 || numClear < count)
+    return ERROR;
+
+  for (int i = NextClear(0); i < numBits;) {
+    int end = NextSet(i, i + count);
+    if (end - i == count) {
+      for (int j = i; j < end; j++)
+        Mark(j);
       return i;
     }
+    i = NextClear(end);
+  }
   return ERROR;
 }
 
@@ -114,12 +295,7 @@ BitMap::Find() {
 //----------------------------------------------------------------------
 int
 BitMap::NumClear() {
-  int count = 0;
-
-  for (int i = 0; i < numBits; i++)
-    if (!Test(i))
-      count++;
-  return count;
+  return numClear;
 }
 
 //----------------------------------------------------------------------
@@ -150,7 +326,10 @@ BitMap::Print() {
 //----------------------------------------------------------------------
 void
 BitMap::FetchFrom(OpenFile *file) {
-  file->ReadAt((char *) map, numWords * sizeof(unsigned), 0);
+  file->ReadAt((char *) map, divRoundUp(numBits, BITS_IN_BYTE), 0);
+  for (int i = 0; i < numChunks; i++)
+    dirty[i] = false;
+  Rebuild();
 }
 
 //----------------------------------------------------------------------
@@ -162,5 +341,36 @@ BitMap::FetchFrom(OpenFile *file) {
 //----------------------------------------------------------------------
 void
 BitMap::WriteBack(OpenFile *file) {
-  file->WriteAt((char *) map, numWords * sizeof(unsigned), 0);
+  file->WriteAt((char *) map, divRoundUp(numBits, BITS_IN_BYTE), 0);
+  for (int i = 0; i < numChunks; i++)
+    dirty[i] = false;
+}
+
+//----------------------------------------------------------------------
+// BitMap::WriteChanges
+/*! 	Store to a Nachos file the parts of a bitmap modified since it
+//	was last read from or written to the file. Runs of consecutive
+//	modified chunks are written with a single request, the rest of
+//	the file is not touched.
+//
+//	\param file is the place to write the bitmap to
+*/
+//----------------------------------------------------------------------
+void
+BitMap::WriteChanges(OpenFile *file) {
+  int i = 0;
+  while (i < numChunks) {
+    if (!dirty[i]) {
+      i++;
+      continue;
+    }
+    int first = i;
+    while (i < numChunks && dirty[i])
+      dirty[i++] = false;
+    int firstByte = first * BITMAP_CHUNK_WORDS * sizeof(uint64_t);
+    int lastByte = i * BITMAP_CHUNK_WORDS * sizeof(uint64_t);
+    if (lastByte > divRoundUp(numBits, BITS_IN_BYTE))
+      lastByte = divRoundUp(numBits, BITS_IN_BYTE);
+    file->WriteAt((char *) map + firstByte, lastByte - firstByte, firstByte);
+  }
 }
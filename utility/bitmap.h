@@ -4,8 +4,10 @@
         An array of bits each of which
         can be either on or off.
 
-        Represented as an array of unsigned integers, on which we do
-        modulo arithmetic to find the bit we are interested in.
+        Represented as an array of 64-bit words, on which we do
+        modulo arithmetic to find the bit we are interested in. A
+        summary keeps one bit per word, set when the word is full, so
+        that searches skip whole runs of allocated words.
 
         The bitmap can be parameterized with with the number of bits being
         managed.
@@ -31,10 +33,15 @@
 #include "filesys/openfile.h"
 #include "kernel/copyright.h"
 #include "utility/utility.h"
+#include <stdint.h>
 
 // Definitions helpful for representing a bitmap as an array of integers
 #define BITS_IN_BYTE 8
-#define BITS_IN_WORD 32
+#define BITS_IN_WORD 64
+
+// Number of words of a bitmap whose changes are tracked together, to
+// write back to a file only the parts that were modified
+#define BITMAP_CHUNK_WORDS 16
 
 /*!  \brief Defines a "bitmap" -- an array of bits
 
@@ -56,8 +63,16 @@ public:
   void Clear(int which);   // Clear the "nth" bit
   bool Test(int which);    // Is the "nth" bit set?
   int Find();              // Return the # of a clear bit, and as a side
-                // effect, set the bit.
+                // effect, set the bit. The search starts where the
+                // previous one stopped.
+                // If no bits are clear, return -1.
+  int FindRun(int count, int *length);   // Return the # of the first bit
+                // of a run of "count" clear bits, or else of the longest
+                // run of clear bits, and set the bits of the run.
                 // If no bits are clear, return -1.
+  int FindRun(int count);   // Return the # of the first bit of a run of
+                // "count" clear bits, and set the bits of the run.
+                // If there is no such run, return -1.
   int NumClear();   // Return the number of clear bits
 
   void Print();   // Print contents of bitmap
@@ -66,6 +81,8 @@ public:
   // write the bitmap to a file
   void FetchFrom(OpenFile *file);   // fetch contents from disk
   void WriteBack(OpenFile *file);   // write contents to disk
+  void WriteChanges(OpenFile *file);   // write to disk the parts changed
+                // since the last FetchFrom, WriteBack or WriteChanges
 
 private:
   int numBits;         //!< Number of bits in the bitmap
@@ -74,7 +91,20 @@ private:
                          multiple of the number of bits in
                          a word)
                        */
-  unsigned int *map;   //!< Bit storage
+  uint64_t *map;       //!< Bit storage
+  int numFull;         //!< Number of words of the summary
+  uint64_t *full;      //!< Summary, one bit set per word of map whose
+                       //!< bits are all set
+  int numClear;        //!< Number of clear bits
+  int cursor;          //!< Bit where the next Find starts
+  int numChunks;       //!< Number of chunks of BITMAP_CHUNK_WORDS words
+  bool *dirty;         //!< Chunks modified since the last write to disk
+
+  void Rebuild();   // Set the padding bits, the summary and numClear
+                    // from the contents of map
+  int NextClear(int from);   // # of the first clear bit from "from"
+  int NextSet(int from, int limit);   // # of the first set bit from
+                    // "from", or "limit" if there is none before it
 };
 
 #endif   // BITMAP_H
@@ -30,6 +30,12 @@
 
 #define power_of_two(size) (((size) & ((size) -1)) == 0)
 
+//! Names of the instruction costs in the configuration file, by class
+static const char *costNames[NUM_COST_CLASSES] = {
+    "CostALU",   "CostMulDiv",      "CostLoad",
+    "CostStore", "CostBranchTaken", "CostBranchNotTaken",
+    "CostJump",  "CostFP",          "CostSystem"};
+
 void
 fail(uint32_t numligne, char *name, char *ligne) {
   ligne[strlen(ligne) - 1] = '\0';
@@ -50,15 +56,47 @@ Config::Config(char *configname) {
   PageSize = 128;
   NumPhysPages = 20;
   MaxVirtPages = 1024;
+  TranslationTableMode = SingleLevel;
+  PageReplacement = REPLACEMENT_CLOCK;
+  WritebackBatch = 8;
+  LoadControl = 0;
+  FaultAround = 4;
+  SchedulingPolicy = SCHED_ROUND_ROBIN;
+  TimeSharing = false;
+  Quantum = TIMER_TIME;
+  AffinityLimit = 4;
+  Tickless = false;
+  ShortReads = false;
+  EventInput = false;
   UserStackSize = 8 * 1024;
   ProcessorFrequency = 100;
   MaxFileNameSize = 256;
   NbCopy = 0;
-  NumDirEntries = 10;
+  NumDirEntries = 16;
+  CacheSectors = 64;
+  CacheWriteBack = false;
+  ReadAheadSectors = 32;
+  JournalSectors = 0;
+  JournalCommitDelay = 1000000;
+  DiskScheduling = DISK_FIFO;
+  DiskModel = DISK_MODEL_HDD;
+  NumDisks = 1;
+  StripeSectors = 8;
+  SsdChannels = 4;
+  SsdQueueDepth = 8;
+  SsdReadLatency = 10000;
+  SsdProgramLatency = 40000;
+  DiskMapped = false;
+  strcpy(DiskOverlay, "");
   NumPortLoc = 32009;
   NumPortDist = 32009;
+  AciaPorts = 1;
+  AciaTransport = ACIA_TRANSPORT_UDP;
+  AciaNode = 0;
+  strcpy(AciaSwitch, "nachos.switch");
   PrintStat = false;
   FormatDisk = false;
+  BulkImport = false;
   ListDir = false;
   PrintFileSyst = false;
   Print = false;
@@ -66,6 +104,39 @@ Config::Config(char *configname) {
   MakeDir = false;
   RemoveDir = false;
   ACIA = ACIA_NONE;
+  TLBSize = 16;
+  SuperPagePages = 0;
+  NumHarts = 1;
+  HartWindow = 1000;
+  ParallelHarts = false;
+  BlockExecution = false;
+  CostModel = false;
+  FastForward = false;
+  DetailedStartPC = DetailedStopPC = 0;
+  TranslationThreshold = 0;
+  InstructionCost[COST_ALU] = 1;
+  InstructionCost[COST_MULDIV] = 4;
+  InstructionCost[COST_LOAD] = 2;
+  InstructionCost[COST_STORE] = 2;
+  InstructionCost[COST_BRANCH_TAKEN] = 3;
+  InstructionCost[COST_BRANCH_NOT_TAKEN] = 1;
+  InstructionCost[COST_JUMP] = 2;
+  InstructionCost[COST_FP] = 4;
+  InstructionCost[COST_SYSTEM] = 1;
+  MemCacheLines = 0;
+  MemCacheLineSize = 32;
+  MemCacheMissPenalty = 50;
+  BulkMemoryCost = 8;
+  Profile = false;
+  strcpy(ProfileFile, "nachos.prof");
+  Trace = false;
+  TraceEvents = 65536;
+  strcpy(TraceFile, "nachos.trace");
+  DiskSnapshotSave = DiskSnapshotRestore = false;
+  strcpy(DiskSnapshotFile, "nachos.snap");
+  StatsExport = STATS_EXPORT_NONE;
+  strcpy(StatsFile, "nachos.stats");
+  StatsInterval = 0;
   strcpy(ProgramToRun, "");
 
   uint32_t nblignes = 0;
@@ -199,6 +270,473 @@ Config::Config(char *configname) {
           continue;
         }
 
+        if (strcmp(commande, "TranslationMode") == 0) {
+          char translation_mode[MAXSTRLEN];
+          if (sscanf(ligne, " %s = %s ", commande, translation_mode) == 2) {
+            if (strcmp(translation_mode, "SingleLevel") == 0)
+              TranslationTableMode = SingleLevel;
+            else if (strcmp(translation_mode, "DualLevel") == 0)
+              TranslationTableMode = DualLevel;
+            else
+              fail(nblignes, configname, ligne);
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "PageReplacement") == 0) {
+          char policy[MAXSTRLEN];
+          if (sscanf(ligne, " %s = %s ", commande, policy) == 2) {
+            if (strcmp(policy, "Clock") == 0)
+              PageReplacement = REPLACEMENT_CLOCK;
+            else if (strcmp(policy, "EnhancedClock") == 0)
+              PageReplacement = REPLACEMENT_ENHANCED_CLOCK;
+            else if (strcmp(policy, "Aging") == 0)
+              PageReplacement = REPLACEMENT_AGING;
+            else
+              fail(nblignes, configname, ligne);
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "TimeSharing") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2) {
+            if (v == 0)
+              TimeSharing = false;
+            else
+              TimeSharing = true;
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "Quantum") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &Quantum) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "LoadControl") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &LoadControl) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "AffinityLimit") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &AffinityLimit) !=
+              2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "Tickless") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2) {
+            if (v == 0)
+              Tickless = false;
+            else
+              Tickless = true;
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "ShortReads") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2) {
+            if (v == 0)
+              ShortReads = false;
+            else
+              ShortReads = true;
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "EventInput") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            EventInput = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "Scheduler") == 0) {
+          char policy[MAXSTRLEN];
+          if (sscanf(ligne, " %s = %s ", commande, policy) == 2) {
+            if (strcmp(policy, "RoundRobin") == 0)
+              SchedulingPolicy = SCHED_ROUND_ROBIN;
+            else if (strcmp(policy, "MLFQ") == 0)
+              SchedulingPolicy = SCHED_MLFQ;
+            else
+              fail(nblignes, configname, ligne);
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "FaultAround") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &FaultAround) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DiskScheduler") == 0) {
+          char policy[MAXSTRLEN];
+          if (sscanf(ligne, " %s = %s ", commande, policy) == 2) {
+            if (strcmp(policy, "FIFO") == 0)
+              DiskScheduling = DISK_FIFO;
+            else if (strcmp(policy, "SSTF") == 0)
+              DiskScheduling = DISK_SSTF;
+            else if (strcmp(policy, "CLOOK") == 0)
+              DiskScheduling = DISK_CLOOK;
+            else
+              fail(nblignes, configname, ligne);
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DiskModel") == 0) {
+          char model[MAXSTRLEN];
+          if (sscanf(ligne, " %s = %s ", commande, model) == 2) {
+            if (strcmp(model, "HDD") == 0)
+              DiskModel = DISK_MODEL_HDD;
+            else if (strcmp(model, "SSD") == 0)
+              DiskModel = DISK_MODEL_SSD;
+            else
+              fail(nblignes, configname, ligne);
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "NumDisks") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &NumDisks) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "StripeSectors") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &StripeSectors) !=
+              2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "SsdChannels") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &SsdChannels) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "SsdQueueDepth") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &SsdQueueDepth) !=
+              2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "SsdReadLatency") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &SsdReadLatency) !=
+              2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "SsdProgramLatency") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande,
+                     &SsdProgramLatency) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DiskMapped") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2) {
+            if (v == 0)
+              DiskMapped = false;
+            else
+              DiskMapped = true;
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DiskOverlay") == 0) {
+          if (sscanf(ligne, " %s = %s ", commande, DiskOverlay) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "CacheSectors") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &CacheSectors) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "CacheWriteBack") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2) {
+            if (v == 0)
+              CacheWriteBack = false;
+            else
+              CacheWriteBack = true;
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "ReadAheadSectors") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande,
+                     &ReadAheadSectors) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "JournalSectors") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &JournalSectors) !=
+              2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "JournalCommitDelay") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande,
+                     &JournalCommitDelay) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "WritebackBatch") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &WritebackBatch) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "TLBSize") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &TLBSize) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "SuperPagePages") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &SuperPagePages) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "NumHarts") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &NumHarts) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "HartWindow") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &HartWindow) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "ParallelHarts") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            ParallelHarts = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "BlockExecution") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2) {
+            if (v == 0)
+              BlockExecution = false;
+            else
+              BlockExecution = true;
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "CostModel") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            CostModel = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        int cls;
+        for (cls = 0; cls < NUM_COST_CLASSES; cls++)
+          if (strcmp(commande, costNames[cls]) == 0)
+            break;
+        if (cls < NUM_COST_CLASSES) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande,
+                     &InstructionCost[cls]) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "MemCacheLines") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &MemCacheLines) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "MemCacheLineSize") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande,
+                     &MemCacheLineSize) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "MemCacheMissPenalty") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande,
+                     &MemCacheMissPenalty) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "FastForward") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            FastForward = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DetailedStartPC") == 0) {
+          if (sscanf(ligne, " %s = %" SCNx64 " ", commande,
+                     &DetailedStartPC) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DetailedStopPC") == 0) {
+          if (sscanf(ligne, " %s = %" SCNx64 " ", commande,
+                     &DetailedStopPC) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "TranslationThreshold") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande,
+                     &TranslationThreshold) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "BulkMemoryCost") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &BulkMemoryCost) !=
+              2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "Profile") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            Profile = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "ProfileFile") == 0) {
+          if (sscanf(ligne, " %s = %s ", commande, ProfileFile) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "Trace") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            Trace = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "TraceEvents") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &TraceEvents) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "TraceFile") == 0) {
+          if (sscanf(ligne, " %s = %s ", commande, TraceFile) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "BulkImport") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            BulkImport = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DiskSnapshotSave") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            DiskSnapshotSave = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DiskSnapshotRestore") == 0) {
+          uint32_t v;
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &v) == 2)
+            DiskSnapshotRestore = (v != 0);
+          else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "DiskSnapshotFile") == 0) {
+          if (sscanf(ligne, " %s = %s ", commande, DiskSnapshotFile) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "StatsExport") == 0) {
+          char format[MAXSTRLEN];
+          if (sscanf(ligne, " %s = %s ", commande, format) == 2) {
+            if (strcmp(format, "None") == 0)
+              StatsExport = STATS_EXPORT_NONE;
+            else if (strcmp(format, "JSON") == 0)
+              StatsExport = STATS_EXPORT_JSON;
+            else if (strcmp(format, "CSV") == 0)
+              StatsExport = STATS_EXPORT_CSV;
+            else
+              fail(nblignes, configname, ligne);
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "StatsFile") == 0) {
+          if (sscanf(ligne, " %s = %s ", commande, StatsFile) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "StatsInterval") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &StatsInterval) !=
+              2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
         if (strcmp(commande, "FileToCopy") == 0) {
           if (sscanf(ligne, " %s = %s %s", commande, ToCopyUnix[NbCopy],
                      ToCopyNachos[NbCopy]) == 3)
@@ -257,6 +795,8 @@ Config::Config(char *configname) {
               ACIA = ACIA_BUSY_WAITING;
             else if (strcmp(acia_mode, "Interrupt") == 0)
               ACIA = ACIA_INTERRUPT;
+            else if (strcmp(acia_mode, "Framed") == 0)
+              ACIA = ACIA_FRAMED;
             else
               fail(nblignes, configname, ligne);
           } else
@@ -276,6 +816,38 @@ Config::Config(char *configname) {
           continue;
         }
 
+        if (strcmp(commande, "AciaPorts") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &AciaPorts) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "AciaTransport") == 0) {
+          char transport[MAXSTRLEN];
+          if (sscanf(ligne, " %s = %s ", commande, transport) == 2) {
+            if (strcmp(transport, "UDP") == 0)
+              AciaTransport = ACIA_TRANSPORT_UDP;
+            else if (strcmp(transport, "Switch") == 0)
+              AciaTransport = ACIA_TRANSPORT_SWITCH;
+            else
+              fail(nblignes, configname, ligne);
+          } else
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "AciaNode") == 0) {
+          if (sscanf(ligne, " %s = %" PRIu32 " ", commande, &AciaNode) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
+        if (strcmp(commande, "AciaSwitch") == 0) {
+          if (sscanf(ligne, " %s = %s ", commande, AciaSwitch) != 2)
+            fail(nblignes, configname, ligne);
+          continue;
+        }
+
         // Autres variables -> non reconnues
         fail(nblignes, configname, commande);
       }
@@ -291,18 +863,131 @@ Config::Config(char *configname) {
     PageSize = SectorSize;
   }
 
+  if (DiskSnapshotRestore && FormatDisk) {
+    printf("Warning, restoring a disk snapshot, FormatDisk ignored\n");
+    FormatDisk = false;
+  }
+
+  if ((TimeSharing || Profile) && Quantum == 0) {
+    printf("Configuration error : Quantum should not be null, exiting\n");
+    exit(ERROR);
+  }
+
   // Check that sector size and page sizes are powers of two
   if (!power_of_two(SectorSize)) {
     printf(
         "Configuration error : SectorSize should be a power of two, exiting\n");
     exit(ERROR);
   }
+  if (!power_of_two(PageSize)) {
+    printf(
+        "Configuration error : PageSize should be a power of two, exiting\n");
+    exit(ERROR);
+  }
+
+  // Shift and mask used in place of divisions by the page size
+  PageShift = 0;
+  while ((1U << PageShift) < PageSize)
+    PageShift++;
+  PageMask = PageSize - 1;
+
+  // Check that the initial size of the directories is a power of two
+  if (!power_of_two(NumDirEntries)) {
+    printf("Configuration error : NumDirEntries should be a power of two, "
+           "exiting\n");
+    exit(ERROR);
+  }
+
+  // Check that the TLB size is a power of two
+  if (!power_of_two(TLBSize)) {
+    printf("Configuration error : TLBSize should be a power of two, exiting\n");
+    exit(ERROR);
+  }
+  if (SuperPagePages == 1 || !power_of_two(SuperPagePages) ||
+      SuperPagePages > NumPhysPages) {
+    printf("Configuration error : SuperPagePages should be a power of two, "
+           "at most NumPhysPages, exiting\n");
+    exit(ERROR);
+  }
+
+  // The journal holds at least a superblock and a transaction of a few
+  // blocks, and leaves room for the files
+  if (JournalSectors != 0 &&
+      (JournalSectors < 8 || JournalSectors > NUM_SECTORS / 4)) {
+    printf("Configuration error : JournalSectors should be 0 or between 8 "
+           "and a quarter of the disk, exiting\n");
+    exit(ERROR);
+  }
+
+  // Only the framed mode tells the frames of the ports apart
+  if (AciaPorts == 0 || AciaPorts > ACIA_MAX_PORTS ||
+      ((AciaPorts > 1 || AciaTransport == ACIA_TRANSPORT_SWITCH) &&
+       ACIA != ACIA_FRAMED && ACIA != ACIA_NONE) ||
+      (AciaTransport == ACIA_TRANSPORT_SWITCH && AciaNode >= AciaPorts)) {
+    printf("Configuration error : AciaPorts should be between 1 and %d, "
+           "several ports and the switch need the framed ACIA, and the node "
+           "should be one of the ports, exiting\n",
+           ACIA_MAX_PORTS);
+    exit(ERROR);
+  }
+
+  if (NumDisks == 0 || StripeSectors == 0 ||
+      StripeSectors > NUM_SECTORS / NumDisks) {
+    printf("Configuration error : NumDisks and StripeSectors should not be "
+           "null, and a stripe should fit on the disks, exiting\n");
+    exit(ERROR);
+  }
+
+  if (DiskModel == DISK_MODEL_SSD &&
+      (SsdChannels == 0 || SsdQueueDepth == 0 || SsdReadLatency == 0 ||
+       SsdProgramLatency == 0)) {
+    printf("Configuration error : SsdChannels, SsdQueueDepth, SsdReadLatency "
+           "and SsdProgramLatency should not be null, exiting\n");
+    exit(ERROR);
+  }
+
+  if (NumHarts == 0 || (NumHarts > 1 && HartWindow == 0)) {
+    printf("Configuration error : NumHarts and HartWindow should not be "
+           "null, exiting\n");
+    exit(ERROR);
+  }
+
+  // Check the geometry of the memory cache of the cost model
+  if (!power_of_two(MemCacheLines) || MemCacheLineSize == 0 ||
+      !power_of_two(MemCacheLineSize)) {
+    printf("Configuration error : MemCacheLines and MemCacheLineSize should "
+           "be powers of two, exiting\n");
+    exit(ERROR);
+  }
+
+  // The translated code is charged USER_TICK per instruction, like the
+  // block interpreter it replaces
+  if (TranslationThreshold != 0) {
+#ifndef NACHOS_DBT
+    printf("Configuration error : TranslationThreshold needs a kernel built "
+           "with DBT=1, exiting\n");
+    exit(ERROR);
+#endif
+    if (!BlockExecution || CostModel || MemCacheLines != 0) {
+      printf("Configuration error : TranslationThreshold needs "
+             "BlockExecution, without CostModel nor MemCacheLines, "
+             "exiting\n");
+      exit(ERROR);
+    }
+  }
+
+  if (Trace && (TraceEvents == 0 || !power_of_two(TraceEvents))) {
+    printf("Configuration error : TraceEvents should be a power of two, "
+           "exiting\n");
+    exit(ERROR);
+  }
 
   NumDirect = ((SectorSize - 4 * sizeof(uint32_t)) / sizeof(uint32_t));
   MagicNumber = 0x456789ab;
   MagicSize = sizeof(uint32_t);
   DiskSize = (MagicSize + (NUM_SECTORS * SectorSize));
-  DirectoryFileSize = (sizeof(DirectoryEntry) * NumDirEntries);
+  DirectoryFileSize =
+      (sizeof(DirectoryHeader) + sizeof(DirectoryEntry) * NumDirEntries);
   DEBUG('u', (char *) "End of reading of configuration file\n");
 }
 
@@ -31,10 +31,54 @@
 /* Default name of configuration file */
 #define CONFIGFILENAME "nachos.cfg"
 
+/* Page replacement policies */
+#define REPLACEMENT_CLOCK          0
+#define REPLACEMENT_ENHANCED_CLOCK 1
+#define REPLACEMENT_AGING          2
+
+/* Formats of the statistics export */
+#define STATS_EXPORT_NONE 0
+#define STATS_EXPORT_JSON 1
+#define STATS_EXPORT_CSV  2
+
+/* Scheduling policies */
+#define SCHED_ROUND_ROBIN 0
+#define SCHED_MLFQ        1
+
+/* Disk scheduling policies */
+#define DISK_FIFO  0
+#define DISK_SSTF  1
+#define DISK_CLOOK 2
+
+/* Timing models of the disks */
+#define DISK_MODEL_HDD 0
+#define DISK_MODEL_SSD 1
+
 /* Running modes of the ACIA */
 #define ACIA_NONE         0
 #define ACIA_BUSY_WAITING 1
 #define ACIA_INTERRUPT    2
+#define ACIA_FRAMED       3
+
+/* Transports of the frames of the ACIA ports */
+#define ACIA_TRANSPORT_UDP    0
+#define ACIA_TRANSPORT_SWITCH 1
+
+//! Largest number of ports of the ACIA
+#define ACIA_MAX_PORTS 64
+
+/* Instruction classes of the cost model, and their names in the
+   configuration file (see config.cc) */
+#define COST_ALU              0
+#define COST_MULDIV           1
+#define COST_LOAD             2
+#define COST_STORE            3
+#define COST_BRANCH_TAKEN     4
+#define COST_BRANCH_NOT_TAKEN 5
+#define COST_JUMP             6
+#define COST_FP               7
+#define COST_SYSTEM           8
+#define NUM_COST_CLASSES      9
 
 /*! \brief Defines Nachos hardware and software configuration
  *
@@ -48,6 +92,8 @@ class Config {
 public:
   // Hardware configuration
   uint32_t PageSize;       //!< Page size in bytes
+  uint32_t PageShift;      //!< log2(PageSize), computed from PageSize
+  uint32_t PageMask;       //!< PageSize - 1, computed from PageSize
   uint64_t NumPhysPages;   //!< Number of pages in the memory of the simulated
                            //!< MIPS machine
   uint32_t SectorSize;   //!< Disk sector size in bytes (should be equal to the
@@ -55,7 +101,49 @@ public:
   uint32_t ProcessorFrequency;   //!< Frequency of the processor (MHz) used for
                                  //!< having statistics
   uint32_t DiskSize;             //!< Total size of the disk (number of sectors)
+  bool DiskMapped;               //!< Map the disk images in memory (1) instead
+                                 //!< of accessing them with system calls (0)
+  char DiskOverlay[MAXSTRLEN];   //!< Suffix of the delta files of the disks
+                                 //!< (their images being left read-only),
+                                 //!< empty to write to the images
   uint8_t ACIA;   //!< Use ACIA if USE_ACIA, don't use it if ACIA_NONE
+  uint32_t TLBSize;      //!< Number of entries of the MMU TLB (power of
+                         //!< two, 0 to disable the TLB)
+  uint32_t SuperPagePages;   //!< Pages of a superpage (power of two, 0 to
+                             //!< disable the superpages)
+  uint32_t NumHarts;     //!< Number of harts (processors) of the machine
+  uint32_t HartWindow;   //!< Time window of the harts simulated in turn,
+                         //!< in nanoseconds
+  bool ParallelHarts;    //!< Run the user code of the harts on host
+                         //!< threads, a time window at a time
+  bool BlockExecution;   //!< Run user code basic block by basic block,
+                         //!< checking interrupts only between blocks
+  bool CostModel;        //!< Charge each instruction the cost of its
+                         //!< class (1) instead of USER_TICK (0)
+  bool FastForward;      //!< Start user code in fast-forward mode, with
+                         //!< coarse timing and no statistics
+  uint64_t DetailedStartPC;   //!< User pc switching to the detailed mode,
+                              //!< 0 for none
+  uint64_t DetailedStopPC;    //!< User pc switching back to fast-forward,
+                              //!< 0 for none
+  uint32_t TranslationThreshold;   //!< Runs of a basic block before it is
+                                   //!< translated into host code (kernel
+                                   //!< built with DBT=1), 0 to disable
+  uint32_t InstructionCost[NUM_COST_CLASSES];   //!< Cycles per instruction
+                                                //!< class (COST_*)
+  uint32_t MemCacheLines;      //!< Lines of the direct-mapped memory cache
+                               //!< of the cost model (0 to disable it)
+  uint32_t MemCacheLineSize;   //!< Size of a memory cache line in bytes
+  uint32_t MemCacheMissPenalty;   //!< Extra cycles of an access missing
+                                  //!< the memory cache
+  uint32_t BulkMemoryCost;   //!< Cycles per 64 bytes copied or set by the
+                             //!< MemCopy and MemFill system calls
+  bool Profile;   //!< Sample the program counter of user programs on
+                  //!< each timer interrupt
+  char ProfileFile[MAXSTRLEN];   //!< Host file receiving the profiles
+  bool Trace;   //!< Record kernel events in a ring buffer written at exit
+  uint32_t TraceEvents;        //!< Size of the trace ring buffer in events
+  char TraceFile[MAXSTRLEN];   //!< Host file receiving the trace
 
   // File system configuration
   uint32_t NumDirect;   //!< Number of data sectors storable in the first header
@@ -63,18 +151,66 @@ public:
   uint32_t MaxFileSize;       //!< Maximum length of a file
   uint32_t MaxFileNameSize;   //!< Maximum length of a file name (absolute, path
                               //!< included)
-  uint32_t NumDirEntries;     //!< Maximum number of files in a directory
+  uint32_t NumDirEntries;     //!< Initial number of entries of a directory
+                              //!< (a power of two, directories grow)
+  uint32_t CacheSectors;      //!< Number of sectors in the buffer cache
+                              //!< (0 to disable the cache)
+  bool CacheWriteBack;        //!< Write-back (1) or write-through (0) cache
+  uint32_t ReadAheadSectors;  //!< Maximum read-ahead window of a file, in
+                              //!< sectors (0 to disable read-ahead)
+  uint32_t JournalSectors;    //!< Sectors of the metadata journal, set up
+                              //!< when formatting (0 for no journal)
+  uint32_t JournalCommitDelay;  //!< Delay in nanoseconds between the first
+                                //!< update of a transaction and its commit
+  uint8_t DiskScheduling;     //!< Disk request scheduling policy (DISK_*)
+  uint8_t DiskModel;          //!< Timing model of the disks (DISK_MODEL_*)
+  uint32_t NumDisks;          //!< Disks striped in the volume of the file
+                              //!< system, and in the swap area
+  uint32_t StripeSectors;     //!< Sectors of a stripe unit of the volumes
+  uint32_t SsdChannels;       //!< Flash channels working in parallel
+  uint32_t SsdQueueDepth;     //!< Requests an SSD accepts at once
+  uint32_t SsdReadLatency;    //!< Time to read a flash page (a sector),
+                              //!< in nanoseconds
+  uint32_t SsdProgramLatency; //!< Time to program a flash page, in
+                              //!< nanoseconds
   uint32_t DirectoryFileSize;          //!< Length of a directory file
   uint32_t NumPortLoc;                 //!< Local ACIA's port number
   uint32_t NumPortDist;                //!< Distant ACIA's port number
   char TargetMachineName[MAXSTRLEN];   //!< The name of the target machine for
                                        //!< the ACIA
+  uint32_t AciaPorts;          //!< Ports of the ACIA, each one linked to
+                               //!< its own peer
+  uint8_t AciaTransport;       //!< Transport of the frames of the ports
+                               //!< (ACIA_TRANSPORT_*)
+  uint32_t AciaNode;           //!< Node of the machine on the switch, port
+                               //!< p being linked to node p
+  char AciaSwitch[MAXSTRLEN];  //!< Host file shared by the nodes of the
+                               //!< switch
 
   // Kernel (process and address space) configuration
   uint64_t
       MaxVirtPages;   //!< Maximum number of virtual pages in each address space
-  bool TimeSharing;   //!< Use the time sharing mode if true (1) - not
-                      //!< implemented in the base code
+  TranslationMode TranslationTableMode;   //!< Linear or two-level page tables
+  uint8_t PageReplacement;   //!< Page replacement policy (REPLACEMENT_*)
+  uint32_t FaultAround;   //!< Max number of pages loaded after a faulting
+                          //!< page (0 to disable fault-around)
+  uint32_t WritebackBatch;   //!< Max number of dirty pages cleaned at once by
+                             //!< the writeback daemon (0 to disable it)
+  uint32_t LoadControl;   //!< Interval between two checks of the page
+                          //!< fault frequency, in nanoseconds (0 to
+                          //!< disable the load control)
+  uint8_t SchedulingPolicy;   //!< Scheduling policy (SCHED_*)
+  bool TimeSharing;   //!< Use the time sharing mode if true (1)
+  uint32_t Quantum;   //!< Time slice in nanoseconds (time sharing mode)
+  uint32_t AffinityLimit;   //!< Max number of threads of the address
+                            //!< space of a hart dispatched in a row ahead
+                            //!< of older ready threads (0 to disable)
+  bool Tickless;      //!< Stop the timer while a single thread is runnable
+  bool ShortReads;    //!< Console reads return the number of chars
+                      //!< received (1) instead of the size asked (0)
+  bool EventInput;    //!< The console and the ACIA are watched by the
+                      //!< host instead of polled, an idle machine waits
+                      //!< for their input (1)
   uint32_t MagicNumber;     //!< 0x456789ab
   uint32_t MagicSize;       //!< Size of an integer
   uint32_t UserStackSize;   //!< Stack size of user threads in bytes
@@ -84,7 +220,18 @@ public:
   bool ListDir;         //!< List all the files and directories if true
   bool PrintFileSyst;   //!< Print all the files in the file system if true
   bool PrintStat;       //!< Print the statistics if true
+  bool DiskSnapshotSave;      //!< Save the disk once the boot actions are
+                              //!< done
+  bool DiskSnapshotRestore;   //!< Start from a saved disk instead of doing
+                              //!< the boot actions
+  char DiskSnapshotFile[MAXSTRLEN];   //!< Host file of the disk snapshot
+  uint8_t StatsExport;   //!< Format of the statistics export (STATS_EXPORT_*)
+  char StatsFile[MAXSTRLEN];   //!< Host file receiving the exported statistics
+  uint32_t StatsInterval;      //!< Cycles between two snapshots of the
+                               //!< statistics (0 for the final one only)
   bool FormatDisk;      //!< Format the disk if true
+  bool BulkImport;      //!< Copy the FileToCopy files directly to the disk
+                        //!< image instead of through the file system
   bool Print;           //!< Print  FileToPrint if true
   bool Remove;          //!< Remove FileToRemove if true
   bool MakeDir;         //!< Make DirToMake if true
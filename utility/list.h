@@ -29,6 +29,9 @@
 #include "kernel/copyright.h"
 #include "utility/utility.h"
 
+//! Number of list elements allocated at once by the element pool
+#define LIST_POOL_CHUNK 64
+
 /*!
   \brief definition of a "list element"
 
@@ -42,6 +45,12 @@
 
   Internal data structures kept public so that List operations can
   access them directly.
+
+  Elements are not given back to the system allocator: deleted
+  elements are kept in a free list (one per key type), and elements
+  are allocated by chunks of LIST_POOL_CHUNK, so that the lists used
+  by the scheduler and the synchronization objects do not call
+  malloc once warmed up.
 */
 template <class T> class ListElement {
 public:
@@ -67,8 +76,48 @@ public:
     key = sortKey;
     next = NULL;   // assume we'll put it at the end of the list
   }
+
+  //----------------------------------------------------------------------
+  // ListElement::operator new
+  /*! 	Take an element from the free list, refilled by a whole chunk
+    of elements when empty.
+    \param size is the size of an element
+  */
+  //----------------------------------------------------------------------
+  static void *operator new(size_t size) {
+    ASSERT(size == sizeof(ListElement<T>));
+    if (freeList == NULL) {
+      ListElement<T> *chunk = (ListElement<T> *) ::operator new(
+          LIST_POOL_CHUNK * sizeof(ListElement<T>));
+      for (int i = 0; i < LIST_POOL_CHUNK; i++) {
+        chunk[i].next = freeList;
+        freeList = &chunk[i];
+      }
+    }
+    ListElement<T> *element = freeList;
+    freeList = element->next;
+    return element;
+  }
+
+  //----------------------------------------------------------------------
+  // ListElement::operator delete
+  /*! 	Give an element back to the free list.
+    \param ptr is the element
+  */
+  //----------------------------------------------------------------------
+  static void operator delete(void *ptr) {
+    ListElement<T> *element = (ListElement<T> *) ptr;
+    element->next = freeList;
+    freeList = element;
+  }
+
+private:
+  //! Free elements of this type
+  static ListElement<T> *freeList;
 };
 
+template <class T> ListElement<T> *ListElement<T>::freeList = NULL;
+
 /*! \brief Definition of a generic single-linked "list"
 //
 // The following class defines a "list" -- a singly linked list of
@@ -302,6 +351,32 @@ public:
       this->Append(temp);
   }
 
+  //----------------------------------------------------------------------
+  // List::RemoveAfter
+  /*!      Remove the element following another one, keeping the order
+  //	of the other elements (unlike RemoveItem)
+  //
+  // \return
+  //	Pointer to removed item
+  //
+  // \param
+  //    prev: the element preceding the one to remove, NULL to remove
+  //	the first one
+  */
+  //----------------------------------------------------------------------
+  void *RemoveAfter(ListElement<T> *prev) {
+    if (prev == NULL)
+      return Remove();
+    ListElement<T> *element = prev->next;
+    ASSERT(element != NULL);
+    void *thing = element->item;
+    prev->next = element->next;
+    if (last == element)
+      last = prev;
+    delete element;
+    return thing;
+  }
+
   //----------------------------------------------------------------------
   // List::getFirst
   /*!      Return the first element of a list
@@ -326,6 +401,8 @@ class Thread;
 typedef List<Thread *> ListThread;   // List of thread control blocks
 class ProcessStat;
 typedef List<ProcessStat *> ListStats;   // List of process statistics classes
+class LockStat;
+typedef List<LockStat *> ListLockStats;   // List of lock statistics classes
 typedef List<Time> ListTime;             // List of wake-up times
 typedef List<uint64_t> ListInt;          // List of integers
 
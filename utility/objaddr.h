@@ -28,10 +28,19 @@
 #include "kernel/system.h"
 #include "utility/list.h"
 #include "utility/utility.h"
-#include <map>
+#include <vector>
 
 using namespace std;
 
+#define OBJ_FIRST_ID 3   //!< 0, 1 and 2 are used for file descriptors
+
+//! Bits of an identifier giving the slot of the object (plus
+//! OBJ_FIRST_ID), the other bits hold the generation of the slot
+#define OBJ_INDEX_BITS      16
+#define OBJ_INDEX_MASK      ((1 << OBJ_INDEX_BITS) - 1)
+#define OBJ_GENERATION_MASK 0x7fff   //!< Identifiers stay positive
+#define OBJ_MAX_OBJECTS     (OBJ_INDEX_MASK + 1 - OBJ_FIRST_ID)
+
 /*! \brief Definition of object identifiers
 //
 // The ObjId class defines a set of object identifiers.  By object, we
@@ -43,47 +52,84 @@ using namespace std;
 // A method allows to detect of an object corresponding to a given
 // identifier exists; this is used to check the parameters of system
 // calls.
+//
+// The objects are kept in a vector of slots, along with their type,
+// and an identifier is made of the index of its slot and of the
+// generation of the slot: looking an object up takes constant time.
+// The slot of a removed object is reused by the next object, with the
+// next generation, so that identifiers are not exhausted and a stale
+// identifier does not give the new object.
 */
 class ObjAddr {
 private:
-  int last_id;
-  map<const int32_t, void *> ids;
+  //! Slot of the table
+  struct slot {
+    void *ptr;             //!< The object, NULL if the slot is free
+    ObjectType type;       //!< Type of the object
+    int32_t generation;    //!< Incremented each time the slot is freed
+    int32_t next_free;     //!< Next free slot, -1 if none
+  };
+
+  vector<struct slot> slots;   //!< The slots, indexed by identifier
+  int32_t free_list;           //!< First free slot, -1 if none
+
+  //! Slot of an identifier, NULL if the identifier is not valid
+  struct slot *FindSlot(int32_t id) {
+    if (id < OBJ_FIRST_ID)
+      return NULL;
+    uint32_t index = (uint32_t) (id & OBJ_INDEX_MASK) - OBJ_FIRST_ID;
+    if (index >= slots.size())
+      return NULL;
+    struct slot *s = &slots[index];
+    if (s->ptr == NULL || s->generation != (id >> OBJ_INDEX_BITS))
+      return NULL;
+    return s;
+  }
 
 public:
-  ObjAddr() { last_id = 3; /* 0, 1 and 2 used for file descriptors */ }
-  ~ObjAddr() { ids.clear(); };
+  ObjAddr() { free_list = -1; }
+  ~ObjAddr() { slots.clear(); };
 
-  int32_t AddObject(void *ptr) {
-    int32_t res = last_id++;
-    ids[res] = ptr;
-    if (res < 0) {
-      printf("**** Nachos kernel panic, not enough object identifiers\n");
-      extern void Cleanup();
-      Cleanup();
+  //! Add an object of a given type, and return its identifier
+  int32_t AddObject(void *ptr, ObjectType type) {
+    int32_t index;
+    if (free_list != -1) {
+      index = free_list;
+      free_list = slots[index].next_free;
+    } else {
+      if (slots.size() == OBJ_MAX_OBJECTS) {
+        printf("**** Nachos kernel panic, not enough object identifiers\n");
+        extern void Cleanup();
+        Cleanup();
+      }
+      index = slots.size();
+      struct slot s = {NULL, INVALID_TYPE, 0, -1};
+      slots.push_back(s);
     }
-    return res;
+    slots[index].ptr = ptr;
+    slots[index].type = type;
+    return (slots[index].generation << OBJ_INDEX_BITS) | (index + OBJ_FIRST_ID);
   }
 
-  void *SearchObject(int32_t id) {
-    if (ids.find(id) == ids.end()) {
+  //! Object of an identifier, NULL if there is none or if it is not of
+  //! the given type
+  void *SearchObject(int32_t id, ObjectType type) {
+    struct slot *s = FindSlot(id);
+    if (s == NULL || s->type != type)
       return (void *) NULL;
-    }
-    return ids[id];
+    return s->ptr;
   }
 
-  void RemoveObject(int32_t id) { ids.erase(id); }
-
-  void RemoveObject(void *ptr) {
-    int32_t id = -1;
-    for (map<const int32_t, void *>::iterator it = ids.begin(); it != ids.end();
-         ++it) {
-      if (it->second == ptr) {
-        id = it->first;
-        break;
-      }
-    }
-    if (id != -1)
-      ids.erase(id);
+  //! Forget an object, its slot is reused by the next added object
+  void RemoveObject(int32_t id) {
+    struct slot *s = FindSlot(id);
+    if (s == NULL)
+      return;
+    s->ptr = NULL;
+    s->type = INVALID_TYPE;
+    s->generation = (s->generation + 1) & OBJ_GENERATION_MASK;
+    s->next_free = free_list;
+    free_list = s - &slots[0];
   }
 };
 
@@ -0,0 +1,120 @@
+/*! \file  slab.cc
+//  \brief Routines of the slab caches of kernel objects
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "utility/slab.h"
+
+//! Caches of the buffers of SlabAlloc, one per power of two from
+//! SLAB_MIN_BUFFER to SLAB_MAX_BUFFER
+static SlabCache bufferCaches[] = {
+    SlabCache(16),   SlabCache(32),    SlabCache(64),    SlabCache(128),
+    SlabCache(256),  SlabCache(512),   SlabCache(1024),  SlabCache(2048),
+    SlabCache(4096), SlabCache(8192),  SlabCache(16384), SlabCache(32768),
+    SlabCache(65536)};
+
+//----------------------------------------------------------------------
+// SlabCache::Alloc
+/*!	Take a free object. When the cache is empty, a slab of
+//	SLAB_SIZE bytes (or of 8 objects if larger) is cut into free
+//	objects first.
+//
+//	\return the object, uninitialized
+*/
+//----------------------------------------------------------------------
+void *
+SlabCache::Alloc() {
+  if (freeList == NULL) {
+    int count = SLAB_SIZE / size;
+    if (count < 8)
+      count = 8;
+    char *slab = (char *) ::operator new(count * size);
+    for (int i = count - 1; i >= 0; i--)
+      Free(slab + i * size);
+  }
+  FreeObject *object = freeList;
+  freeList = object->next;
+  return object;
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Free
+/*!	Give an object back to the cache: it is the next one allocated.
+//
+//	\param object the object
+*/
+//----------------------------------------------------------------------
+void
+SlabCache::Free(void *object) {
+  FreeObject *free = (FreeObject *) object;
+  free->next = freeList;
+  freeList = free;
+}
+
+//----------------------------------------------------------------------
+// SizeClass
+/*!	Give the cache of the buffers of a size.
+//
+//	\param size the size of the buffer
+//	\return the index in bufferCaches, -1 if too large for them
+*/
+//----------------------------------------------------------------------
+static int
+SizeClass(size_t size) {
+  if (size > SLAB_MAX_BUFFER)
+    return -1;
+  int c = 0;
+  for (size_t s = SLAB_MIN_BUFFER; s < size; s <<= 1)
+    c++;
+  return c;
+}
+
+//----------------------------------------------------------------------
+// SlabAlloc
+/*!	Allocate a buffer from the cache of the smallest power of two
+//	holding it, or from the host allocator if larger than
+//	SLAB_MAX_BUFFER.
+//
+//	\param size the size of the buffer in bytes
+//	\return the buffer, uninitialized
+*/
+//----------------------------------------------------------------------
+void *
+SlabAlloc(size_t size) {
+  int c = SizeClass(size);
+  if (c < 0)
+    return ::operator new(size);
+  return bufferCaches[c].Alloc();
+}
+
+//----------------------------------------------------------------------
+// SlabFree
+/*!	Free a buffer given by SlabAlloc.
+//
+//	\param buffer the buffer, NULL for none
+//	\param size the size it was allocated with
+*/
+//----------------------------------------------------------------------
+void
+SlabFree(void *buffer, size_t size) {
+  if (buffer == NULL)
+    return;
+  int c = SizeClass(size);
+  if (c < 0)
+    ::operator delete(buffer);
+  else
+    bufferCaches[c].Free(buffer);
+}
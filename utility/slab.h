@@ -0,0 +1,113 @@
+/*! \file slab.h
+    \brief Data structures of the slab caches of kernel objects
+
+        The file system creates and destroys kernel objects (file
+        headers, open files, directories, entries of the open file
+        table) and their buffers on every path lookup and open. Instead
+        of going to the host allocator each time, the freed objects
+        are kept in a cache per object size, refilled by slabs of
+        several objects at once, so that once warmed up the file
+        system does not call malloc.
+
+        A class gets its objects from a cache of its own by deriving
+        from Slab<class>. Buffers whose size is only known at run time
+        (tables of a directory, names...) come from caches of
+        power-of-two sizes, through SlabAlloc and SlabFree.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "kernel/copyright.h"
+#include "utility/utility.h"
+
+//! Bytes allocated at once to refill a cache (at least 8 objects)
+#define SLAB_SIZE 16384
+
+//! Smallest and largest buffers served by SlabAlloc, larger ones come
+//! from the host allocator
+#define SLAB_MIN_BUFFER 16
+#define SLAB_MAX_BUFFER 65536
+
+/*! \brief Defines a cache of free objects of one size
+//
+// The free objects are linked through their first bytes. The slabs
+// are never given back to the host allocator. The caches are not
+// locked: the kernel runs on a single host thread.
+*/
+class SlabCache {
+public:
+  //! Empty cache of objects of size bytes (constant initialization, so
+  //! that the caches can be used by static constructors)
+  constexpr SlabCache(size_t objectSize)
+      : size(objectSize < sizeof(void *) ? sizeof(void *) : objectSize),
+        freeList(NULL) {}
+
+  //! Take a free object, refilling the cache with a slab if empty
+  void *Alloc();
+
+  //! Give an object back to the cache
+  void Free(void *object);
+
+private:
+  //! A free object
+  struct FreeObject {
+    FreeObject *next;   //!< Next free object, NULL for the last one
+  };
+
+  size_t size;            //!< Size of the objects
+  FreeObject *freeList;   //!< Free objects, the last freed first
+};
+
+/*! \brief Base of the classes allocated from a cache of their own
+//
+// class FileHeader : public Slab<FileHeader> makes new and delete of a
+// FileHeader take and give back objects of the cache of the class.
+// The objects of a derived class, of a different size, are left to
+// the host allocator.
+*/
+template <class T> class Slab {
+public:
+  //! Take an object from the cache of the class
+  static void *operator new(size_t size) {
+    if (size != sizeof(T))
+      return ::operator new(size);
+    return cache.Alloc();
+  }
+
+  //! Give an object back to the cache of the class
+  static void operator delete(void *ptr, size_t size) {
+    if (size != sizeof(T))
+      ::operator delete(ptr);
+    else if (ptr != NULL)
+      cache.Free(ptr);
+  }
+
+private:
+  //! Free objects of the class
+  static SlabCache cache;
+};
+
+template <class T> SlabCache Slab<T>::cache(sizeof(T));
+
+//! Allocate a buffer of size bytes from the cache of its size class
+void *SlabAlloc(size_t size);
+
+//! Free a buffer given by SlabAlloc, size being the one asked for
+void SlabFree(void *buffer, size_t size);
+
+#endif   // SLAB_H
@@ -22,7 +22,9 @@
 
 #include "utility/stats.h"
 #include "kernel/copyright.h"
+#include "kernel/msgerror.h"
 #include "kernel/system.h"
+#include "machine/machine.h"
 
 //----------------------------------------------------------------------
 // Statistics::Statistics
@@ -32,7 +34,145 @@
 //----------------------------------------------------------------------
 Statistics::Statistics() {
   allStatistics = new ListStats;
+  allLocks = new ListLockStats;
   idleTicks = totalTicks = 0;
+  numEvictions = numWritebacks = 0;
+  numPrefetches = numPrefetchHits = 0;
+  numZeroedPages = numPrezeroedFaults = 0;
+  numSuspensions = 0;
+  numPromotions = numDemotions = 0;
+  numSharedMappings = numCowCopies = 0;
+  numCacheHits = numCacheMisses = 0;
+  numReadAheads = 0;
+  numJournalCommits = numJournalBlocks = numCheckpoints = 0;
+  numDentryHits = numDentryMisses = 0;
+  numFastForwarded = 0;
+  numTranslations = numTranslated = numTranslationInvalidations = 0;
+  for (int i = 0; i < MAX_SYSCALL_STATS; i++) {
+    syscallNames[i] = NULL;
+    numSyscalls[i] = syscallTicks[i] = 0;
+  }
+  numContextSwitches = numPreemptions = 0;
+  numSameSpaceSwitches = numCrossSpaceSwitches = 0;
+  numEmptyYields = 0;
+  readyThreads = maxReadyThreads = 0;
+  readyArea = readyChange = 0;
+
+  // Open the export file, snapshots are taken every StatsInterval
+  // cycles and once more at shutdown
+  exportFile = NULL;
+  nextSnapshot = (Time) -1;
+  if (g_cfg->StatsExport != STATS_EXPORT_NONE) {
+    exportFile = fopen(g_cfg->StatsFile, "w");
+    if (exportFile == NULL) {
+      printf("Cannot open statistics export file %s, exiting\n",
+             g_cfg->StatsFile);
+      exit(ERROR);
+    }
+    if (g_cfg->StatsExport == STATS_EXPORT_CSV)
+      fprintf(exportFile,
+              "ticks,process,instructions,user_ticks,system_ticks,"
+              "disk_reads,disk_writes,console_reads,console_writes,"
+              "memory_accesses,page_faults,tlb_hits,tlb_misses,"
+              "mem_cache_hits,mem_cache_misses,idle_ticks,"
+              "context_switches,preemptions,evictions,writebacks,"
+              "buffer_cache_hits,buffer_cache_misses,empty_yields,"
+              "ready_threads,ready_latency_count,ready_latency_ticks,"
+              "ready_latency_max\n");
+    if (g_cfg->StatsInterval != 0)
+      nextSnapshot = g_cfg->StatsInterval;
+  }
+}
+
+//----------------------------------------------------------------------
+// ExportName
+/*!     Writes a process name as a JSON string or a CSV field, quoting
+//      the characters that would end it
+//
+//      \param out export file
+//      \param name name to write
+*/
+//----------------------------------------------------------------------
+static void
+ExportName(FILE *out, const char *name) {
+  fputc('"', out);
+  for (const char *c = name; *c != '\0'; c++) {
+    if (*c == '"')
+      fputc(g_cfg->StatsExport == STATS_EXPORT_JSON ? '\\' : '"', out);
+    else if (*c == '\\' && g_cfg->StatsExport == STATS_EXPORT_JSON)
+      fputc('\\', out);
+    fputc(*c, out);
+  }
+  fputc('"', out);
+}
+
+//----------------------------------------------------------------------
+// Statistics::Snapshot
+/*!     Appends the current statistics of all processes and of the
+//      system to the export file: one JSON object per line (JSON) or
+//      one row per process (CSV). Periodic snapshots are taken from
+//      Interrupt::OneTick, the final one from Cleanup.
+//
+//      \param final true for the snapshot taken at shutdown
+*/
+//----------------------------------------------------------------------
+void
+Statistics::Snapshot(bool final) {
+  if (exportFile == NULL)
+    return;
+
+  if (g_cfg->StatsExport == STATS_EXPORT_JSON) {
+    fprintf(exportFile,
+            "{\"ticks\": %" PRIu64 ", \"final\": %s, \"idle_ticks\": %" PRIu64
+            ", \"context_switches\": %" PRIu64 ", \"preemptions\": %" PRIu64
+            ", \"evictions\": %" PRIu64 ", \"writebacks\": %" PRIu64
+            ", \"buffer_cache_hits\": %" PRIu64
+            ", \"buffer_cache_misses\": %" PRIu64
+            ", \"dentry_hits\": %" PRIu64 ", \"dentry_misses\": %" PRIu64
+            ", \"empty_yields\": %" PRIu64 ", \"ready_threads\": %d"
+            ", \"max_ready_threads\": %d, \"ready_area\": %" PRIu64
+            ", \"ready_latency\": ",
+            totalTicks, final ? "true" : "false", idleTicks,
+            numContextSwitches, numPreemptions, numEvictions, numWritebacks,
+            numCacheHits, numCacheMisses, numDentryHits, numDentryMisses,
+            numEmptyYields, readyThreads, maxReadyThreads, ReadyArea());
+    readyLatency.Export(exportFile);
+    fprintf(exportFile, ", \"sync\": [");
+    for (ListElement<LockStat *> *e = allLocks->getFirst(); e != NULL;
+         e = e->next) {
+      ((LockStat *) e->item)->Export(exportFile);
+      if (e->next != NULL)
+        fprintf(exportFile, ", ");
+    }
+    fprintf(exportFile, "], \"processes\": [");
+    for (ListElement<ProcessStat *> *e = allStatistics->getFirst(); e != NULL;
+         e = e->next) {
+      ((ProcessStat *) e->item)->Export(exportFile, totalTicks);
+      if (e->next != NULL)
+        fprintf(exportFile, ", ");
+    }
+    fprintf(exportFile, "]}\n");
+  } else {
+    for (ListElement<ProcessStat *> *e = allStatistics->getFirst(); e != NULL;
+         e = e->next) {
+      ProcessStat *s = (ProcessStat *) e->item;
+      LatencyHistogram *latency = s->getReadyLatency();
+      s->Export(exportFile, totalTicks);
+      fprintf(exportFile,
+              ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+              ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%d,%" PRIu64 ",%" PRIu64
+              ",%" PRIu64 "\n",
+              idleTicks, numContextSwitches, numPreemptions, numEvictions,
+              numWritebacks, numCacheHits, numCacheMisses, numEmptyYields,
+              readyThreads, latency->getCount(), latency->getTotal(),
+              latency->getLongest());
+    }
+  }
+  fflush(exportFile);
+
+  if (!final && g_cfg->StatsInterval != 0)
+    nextSnapshot =
+        (totalTicks / g_cfg->StatsInterval + 1) * g_cfg->StatsInterval;
 }
 
 //----------------------------------------------------------------------
@@ -69,6 +209,95 @@ Statistics::Print() {
          totalTicks, g_cfg->ProcessorFrequency,
          cycle_to_sec(totalTicks, g_cfg->ProcessorFrequency),
          cycle_to_nano(totalTicks, g_cfg->ProcessorFrequency));
+
+  const char *policy;
+  switch (g_cfg->PageReplacement) {
+  case REPLACEMENT_ENHANCED_CLOCK:
+    policy = "enhanced clock";
+    break;
+  case REPLACEMENT_AGING:
+    policy = "aging";
+    break;
+  default:
+    policy = "clock";
+    break;
+  }
+  printf("   Page replacement (%s) : \t%" PRIu64 " evictions, %" PRIu64
+         " writebacks\n",
+         policy, numEvictions, numWritebacks);
+  printf("   Fault-around : \t%" PRIu64 " pages prefetched, %" PRIu64
+         " referenced\n",
+         numPrefetches, numPrefetchHits);
+  printf("   Page zeroing : \t%" PRIu64 " pages zeroed while idle, %" PRIu64
+         " zero-fill faults without memset\n",
+         numZeroedPages, numPrezeroedFaults);
+  printf("   Load control : \t%" PRIu64 " processes suspended\n",
+         numSuspensions);
+  printf("   Superpages : \t%" PRIu64 " promotions, %" PRIu64
+         " demotions\n",
+         numPromotions, numDemotions);
+  printf("   Page sharing : \t%" PRIu64 " shared mappings, %" PRIu64
+         " copies on write\n",
+         numSharedMappings, numCowCopies);
+  uint64_t lookups = numCacheHits + numCacheMisses;
+  printf("   Buffer cache : \t%" PRIu64 " hits, %" PRIu64 " misses (%" PRIu64
+         "%% hit ratio)\n",
+         numCacheHits, numCacheMisses,
+         lookups ? numCacheHits * 100 / lookups : 0);
+  printf("   Read-ahead : \t%" PRIu64 " sectors\n", numReadAheads);
+  printf("   Journal : \t%" PRIu64 " commits, %" PRIu64 " sectors, %" PRIu64
+         " checkpoints\n",
+         numJournalCommits, numJournalBlocks, numCheckpoints);
+  lookups = numDentryHits + numDentryMisses;
+  printf("   Dentry cache : \t%" PRIu64 " hits, %" PRIu64 " misses (%" PRIu64
+         "%% hit ratio)\n",
+         numDentryHits, numDentryMisses,
+         lookups ? numDentryHits * 100 / lookups : 0);
+  if (numFastForwarded != 0)
+    printf("   Fast-forward : \t%" PRIu64 " instructions (not in the "
+           "process statistics)\n",
+           numFastForwarded);
+  if (numTranslations != 0)
+    printf("   Translation : \t%" PRIu64 " blocks, %" PRIu64
+           " instructions run translated, %" PRIu64 " pages invalidated\n",
+           numTranslations, numTranslated, numTranslationInvalidations);
+
+  printf("   Scheduler : \t\t%" PRIu64 " context switches (%" PRIu64
+         " voluntary, %" PRIu64 " preemptions), %" PRIu64
+         " yields without effect\n",
+         numContextSwitches,
+         numContextSwitches > numPreemptions
+             ? numContextSwitches - numPreemptions
+             : 0,
+         numPreemptions, numEmptyYields);
+  Time area = ReadyArea();
+  printf("   Ready queues : \t%" PRIu64 ".%02" PRIu64
+         " threads on average, %d at most\n",
+         totalTicks ? area / totalTicks : 0,
+         totalTicks ? area * 100 / totalTicks % 100 : 0, maxReadyThreads);
+  readyLatency.Print("Ready latency");
+  printf("   Address spaces : \t%" PRIu64 " switches within, %" PRIu64
+         " across (TLB flushed)\n",
+         numSameSpaceSwitches, numCrossSpaceSwitches);
+  if (g_machine->numHarts > 1)
+    for (int i = 0; i < g_machine->numHarts; i++)
+      printf("   Hart %d : \t\t%" PRIu64 " cycles idle (%" PRIu64 "%%)\n", i,
+             g_machine->harts[i].idleTicks,
+             totalTicks ? g_machine->harts[i].idleTicks * 100 / totalTicks
+                        : 0);
+
+  printf("   System calls : \n");
+  for (int i = 0; i < MAX_SYSCALL_STATS; i++)
+    if (numSyscalls[i] != 0)
+      printf("      %-16s %8" PRIu64 " calls, %10" PRIu64
+             " cycles (%" PRIu64 " per call)\n",
+             syscallNames[i], numSyscalls[i], syscallTicks[i],
+             syscallTicks[i] / numSyscalls[i]);
+
+  printf("   Synchronisation waits : \n");
+  for (ListElement<LockStat *> *e = allLocks->getFirst(); e != NULL;
+       e = e->next)
+    ((LockStat *) e->item)->Print();
 }
 
 ProcessStat *
@@ -78,6 +307,68 @@ Statistics::NewProcStat(char *name) {
   return procstat;
 }
 
+//----------------------------------------------------------------------
+// Statistics::NewLockStat
+/*!     Return the contention statistics of the synchronisation objects
+//      of a kind named name, creating them the first time such an
+//      object is built.
+//
+//      \param name name of the object
+//      \param kind kind of the object ("lock", "semaphore", "condition")
+*/
+//----------------------------------------------------------------------
+LockStat *
+Statistics::NewLockStat(char *name, const char *kind) {
+  for (ListElement<LockStat *> *e = allLocks->getFirst(); e != NULL;
+       e = e->next)
+    if (strcmp(((LockStat *) e->item)->getName(), name) == 0 &&
+        strcmp(((LockStat *) e->item)->getKind(), kind) == 0)
+      return (LockStat *) e->item;
+  LockStat *lockstat = new LockStat(name, kind);
+  allLocks->Append((void *) lockstat);
+  return lockstat;
+}
+
+//----------------------------------------------------------------------
+// Statistics::incrReadyLatency
+/*!     Count the time a thread spent in a ready queue, from the time
+//      it was made ready to the time it was dispatched.
+//
+//      \param owner statistics of the process of the thread, NULL for
+//      a thread of no process
+//      \param latency the time spent in the ready queue
+*/
+//----------------------------------------------------------------------
+void
+Statistics::incrReadyLatency(ProcessStat *owner, Time latency) {
+  readyLatency.Add(latency);
+  if (owner != NULL)
+    owner->getReadyLatency()->Add(latency);
+}
+
+//----------------------------------------------------------------------
+// Statistics::incrReadyThreads
+/*!     Account for a change of the number of threads in the ready
+//      queues, to give their average length over time. The harts are
+//      simulated in turn and the time may go back by less than a
+//      window when the next hart is simulated: a period seen twice is
+//      only counted once.
+//
+//      \param delta the threads added (1) or removed (-1)
+*/
+//----------------------------------------------------------------------
+void
+Statistics::incrReadyThreads(int delta) {
+  if (totalTicks > readyChange) {
+    readyArea += (totalTicks - readyChange) * readyThreads;
+    readyChange = totalTicks;
+  }
+  readyThreads += delta;
+  ASSERT(readyThreads >= 0);
+  if (readyThreads > maxReadyThreads)
+    maxReadyThreads = readyThreads;
+}
+
 //----------------------------------------------------------------------
 // Statistics::~Statistics
 //!    De-allocate all ProcessStats and the allStatistics list
@@ -91,6 +382,11 @@ Statistics::~Statistics() {
     delete s;
   }
   delete allStatistics;
+  while (!(allLocks->IsEmpty()))
+    delete (LockStat *) allLocks->Remove();
+  delete allLocks;
+  if (exportFile != NULL)
+    fclose(exportFile);
 }
 
 //----------------------------------------------------------------------
@@ -105,6 +401,10 @@ ProcessStat::ProcessStat(char *processName) {
   numInstruction = numDiskReads = numDiskWrites = 0;
   numConsoleCharsRead = numConsoleCharsWritten = 0;
   numMemoryAccess = numPageFaults = 0;
+  numTLBHits = numTLBMisses = 0;
+  for (int i = 0; i < NUM_COST_CLASSES; i++)
+    numInstrClass[i] = 0;
+  numMemCacheHits = numMemCacheMisses = 0;
   systemTicks = userTicks = 0;
 }
 
@@ -152,6 +452,39 @@ ProcessStat::incrMemoryAccess(void) {
   g_stats->incrTotalTicks(MEMORY_TICKS);
 }
 
+//----------------------------------------------------------------------
+// ProcessStat::incrMemoryAccesses
+/*!     Updates stats concerning a batch of memory accesses (process and
+//      system level)
+.
+//      \param count number of memory accesses
+*/
+//----------------------------------------------------------------------
+void
+ProcessStat::incrMemoryAccesses(uint64_t count) {
+  numMemoryAccess += count;
+  userTicks += count * MEMORY_TICKS;
+  g_stats->incrTotalTicks(count * MEMORY_TICKS);
+}
+
+//----------------------------------------------------------------------
+// ProcessStat::incrMemCache
+/*!     Updates stats concerning the memory cache of the cost model
+//      (process and system level): each miss costs MemCacheMissPenalty
+//      cycles on top of the memory access itself
+.
+//      \param hits number of accesses that hit the cache
+//      \param misses number of accesses that missed it
+*/
+//----------------------------------------------------------------------
+void
+ProcessStat::incrMemCache(uint64_t hits, uint64_t misses) {
+  numMemCacheHits += hits;
+  numMemCacheMisses += misses;
+  userTicks += misses * g_cfg->MemCacheMissPenalty;
+  g_stats->incrTotalTicks(misses * g_cfg->MemCacheMissPenalty);
+}
+
 //----------------------------------------------------------------------
 // ProcessStat::Print
 /*!     Prints per-process statistics
@@ -183,6 +516,192 @@ ProcessStat::Print(void) {
   printf("   Memory Management :  \t%" PRIu64 " accesses,  %" PRIu64
          " page faults\n",
          numMemoryAccess, numPageFaults);
+  printf("   TLB :  \t\t\t%" PRIu64 " hits,  %" PRIu64 " misses\n", numTLBHits,
+         numTLBMisses);
+  if (g_cfg->CostModel) {
+    static const char *classNames[NUM_COST_CLASSES] = {
+        "alu",  "mul/div", "load",   "store", "branch taken",
+        "branch not taken", "jump", "fp", "system"};
+    printf("   Instruction mix : \n");
+    for (int i = 0; i < NUM_COST_CLASSES; i++)
+      printf("      %-16s %10" PRIu64 " instructions, %12" PRIu64 " cycles\n",
+             classNames[i], numInstrClass[i],
+             numInstrClass[i] * g_cfg->InstructionCost[i]);
+  }
+  if (g_cfg->MemCacheLines != 0)
+    printf("   Memory cache :  \t\t%" PRIu64 " hits,  %" PRIu64 " misses\n",
+           numMemCacheHits, numMemCacheMisses);
+  if (readyLatency.getCount() != 0)
+    readyLatency.Print("Ready latency");
 
   printf("------------------------------------------------------------\n");
 }
+
+//----------------------------------------------------------------------
+// ProcessStat::Export
+/*!     Writes the per-process statistics in the format of the export:
+//      a JSON object, or the first fields of a CSV row (the system
+//      fields are appended by Statistics::Snapshot)
+.
+//      \param out export file
+//      \param now time of the snapshot
+*/
+//----------------------------------------------------------------------
+void
+ProcessStat::Export(FILE *out, Time now) {
+  if (g_cfg->StatsExport == STATS_EXPORT_JSON) {
+    fprintf(out, "{\"name\": ");
+    ExportName(out, name);
+    fprintf(out,
+            ", \"instructions\": %" PRIu64 ", \"user_ticks\": %" PRIu64
+            ", \"system_ticks\": %" PRIu64 ", \"disk_reads\": %" PRIu64
+            ", \"disk_writes\": %" PRIu64 ", \"console_reads\": %" PRIu64
+            ", \"console_writes\": %" PRIu64
+            ", \"memory_accesses\": %" PRIu64 ", \"page_faults\": %" PRIu64
+            ", \"tlb_hits\": %" PRIu64 ", \"tlb_misses\": %" PRIu64
+            ", \"mem_cache_hits\": %" PRIu64
+            ", \"mem_cache_misses\": %" PRIu64 ", \"ready_latency\": ",
+            numInstruction, userTicks, systemTicks, numDiskReads,
+            numDiskWrites, numConsoleCharsRead, numConsoleCharsWritten,
+            numMemoryAccess, numPageFaults, numTLBHits, numTLBMisses,
+            numMemCacheHits, numMemCacheMisses);
+    readyLatency.Export(out);
+    fprintf(out, "}");
+  } else {
+    fprintf(out, "%" PRIu64 ",", now);
+    ExportName(out, name);
+    fprintf(out,
+            ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+            ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+            ",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+            numInstruction, userTicks, systemTicks, numDiskReads,
+            numDiskWrites, numConsoleCharsRead, numConsoleCharsWritten,
+            numMemoryAccess, numPageFaults, numTLBHits, numTLBMisses,
+            numMemCacheHits, numMemCacheMisses);
+  }
+}
+
+//----------------------------------------------------------------------
+// LockStat::LockStat
+/*!     Initializes the contention statistics of the synchronisation
+//      objects of a name
+.
+//      \param lockName name of the objects
+//      \param lockKind kind of the objects
+*/
+//----------------------------------------------------------------------
+LockStat::LockStat(char *lockName, const char *lockKind) {
+  strncpy(name, lockName, MAXSTRLEN - 1);
+  name[MAXSTRLEN - 1] = '\0';
+  kind = lockKind;
+  numAcquires = numContended = 0;
+  waitTicks = 0;
+}
+
+//----------------------------------------------------------------------
+// LockStat::Print
+/*!     Prints the contention statistics of the synchronisation objects
+//      of a name
+.
+*/
+//----------------------------------------------------------------------
+void
+LockStat::Print(void) {
+  printf("      %-24s %-9s %" PRIu64 " acquires, %" PRIu64 " contended, %" PRIu64
+         " cycles waiting\n",
+         name, kind, numAcquires, numContended, waitTicks);
+}
+
+//----------------------------------------------------------------------
+// LockStat::Export
+/*!     Writes the contention statistics of the synchronisation objects
+//      of a name as a JSON object
+.
+//      \param out export file
+*/
+//----------------------------------------------------------------------
+void
+LockStat::Export(FILE *out) {
+  fprintf(out, "{\"name\": ");
+  ExportName(out, name);
+  fprintf(out,
+          ", \"kind\": \"%s\", \"acquires\": %" PRIu64
+          ", \"contended\": %" PRIu64 ", \"wait_ticks\": %" PRIu64 "}",
+          kind, numAcquires, numContended, waitTicks);
+}
+
+//----------------------------------------------------------------------
+// LatencyHistogram::LatencyHistogram
+//!     Initializes an empty histogram
+//----------------------------------------------------------------------
+LatencyHistogram::LatencyHistogram() {
+  for (int i = 0; i < LATENCY_BUCKETS; i++)
+    buckets[i] = 0;
+  count = 0;
+  total = longest = 0;
+}
+
+//----------------------------------------------------------------------
+// LatencyHistogram::Add
+/*!     Counts a latency in its bucket
+.
+//      \param latency the latency, in cycles
+*/
+//----------------------------------------------------------------------
+void
+LatencyHistogram::Add(Time latency) {
+  int bucket = latency == 0 ? 0 : 64 - __builtin_clzll(latency);
+  buckets[MIN(bucket, LATENCY_BUCKETS - 1)]++;
+  count++;
+  total += latency;
+  if (latency > longest)
+    longest = latency;
+}
+
+//----------------------------------------------------------------------
+// LatencyHistogram::Print
+/*!     Prints the number of latencies, their average, and the non-empty
+//      buckets
+.
+//      \param title what the latencies are
+*/
+//----------------------------------------------------------------------
+void
+LatencyHistogram::Print(const char *title) {
+  printf("   %s : \t%" PRIu64 " times, %" PRIu64 " cycles on average, %" PRIu64
+         " at most\n",
+         title, count, count ? total / count : 0, longest);
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    if (buckets[i] == 0)
+      continue;
+    char range[48];
+    if (i <= 1)
+      sprintf(range, "%d", i);
+    else if (i == LATENCY_BUCKETS - 1)
+      sprintf(range, ">= %" PRIu64, (uint64_t) 1 << (i - 1));
+    else
+      sprintf(range, "%" PRIu64 "-%" PRIu64, (uint64_t) 1 << (i - 1),
+              ((uint64_t) 1 << i) - 1);
+    printf("      %-24s %8" PRIu64 " (%" PRIu64 "%%)\n", range, buckets[i],
+           buckets[i] * 100 / count);
+  }
+}
+
+//----------------------------------------------------------------------
+// LatencyHistogram::Export
+/*!     Writes the histogram as a JSON object, giving the count of each
+//      bucket
+.
+//      \param out export file
+*/
+//----------------------------------------------------------------------
+void
+LatencyHistogram::Export(FILE *out) {
+  fprintf(out,
+          "{\"count\": %" PRIu64 ", \"total\": %" PRIu64
+          ", \"max\": %" PRIu64 ", \"buckets\": [",
+          count, total, longest);
+  for (int i = 0; i < LATENCY_BUCKETS; i++)
+    fprintf(out, i == 0 ? "%" PRIu64 : ", %" PRIu64, buckets[i]);
+  fprintf(out, "]}");
+}
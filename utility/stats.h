@@ -26,6 +26,7 @@
 #include "utility/config.h"
 #include "utility/list.h"
 #include "utility/utility.h"
+#include <stdio.h>
 
 /*! \brief Defines Nachos statistics that are kept at run-time
 
@@ -33,13 +34,88 @@
 */
 
 class ProcessStat;
+class LockStat;
+
+#define MAX_SYSCALL_STATS 64   //!< Number of system calls that can be counted
+#define LATENCY_BUCKETS 24     //!< Buckets of a latency histogram
+
+/*! \brief Defines a histogram of latencies, in powers of two of cycles
+//
+// Bucket 0 counts the latencies of 0 cycles, bucket i those from 2^(i-1)
+// to 2^i - 1 cycles, and the last bucket all the longer ones.
+*/
+
+class LatencyHistogram {
+private:
+  uint64_t buckets[LATENCY_BUCKETS];   //!< latencies per bucket
+  uint64_t count;                      //!< number of latencies
+  Time total;                          //!< sum of the latencies
+  Time longest;                        //!< longest latency
+public:
+  LatencyHistogram(); /* initialises everything to zero */
+  void Add(Time latency);
+  uint64_t getCount(void) { return count; }
+  Time getTotal(void) { return total; }
+  Time getLongest(void) { return longest; }
+  void Print(const char *title); /* prints the non-empty buckets */
+  void Export(FILE *out); /* writes the histogram as a JSON object */
+};
 
 class Statistics {
 private:
   ListStats *allStatistics;   //!< enables to keep  statistics of all processes
                               //!< when they are finished.
+  ListLockStats *allLocks;    //!< contention statistics, one per lock name
   Time totalTicks;            //!< Total time spent running Nachos
   Time idleTicks;             //!< Time spent idle (no thread to run)
+  uint64_t numEvictions;      //!< Pages evicted by the replacement policy
+  uint64_t numWritebacks;     //!< Evicted pages written to the swap area
+  uint64_t numPrefetches;     //!< Pages loaded by fault-around
+  uint64_t numPrefetchHits;   //!< Prefetched pages referenced afterwards
+  uint64_t numZeroedPages;      //!< Free pages zeroed while idle
+  uint64_t numPrezeroedFaults;  //!< Zero-fill faults given a zeroed page
+  uint64_t numSuspensions;      //!< Processes suspended by load control
+  uint64_t numPromotions;       //!< Regions mapped by a superpage
+  uint64_t numDemotions;        //!< Superpages split back into pages
+  uint64_t numSharedMappings;   //!< Pages mapped from another address space
+  uint64_t numCowCopies;        //!< Shared pages copied on a write
+  uint64_t numCacheHits;        //!< Sectors found in the buffer cache
+  uint64_t numCacheMisses;      //!< Sectors not found in the buffer cache
+  uint64_t numReadAheads;       //!< Sectors read ahead into the buffer cache
+  uint64_t numJournalCommits;   //!< Transactions committed to the journal
+  uint64_t numJournalBlocks;    //!< Metadata sectors committed to the journal
+  uint64_t numCheckpoints;      //!< Checkpoints of the journal
+  uint64_t numDentryHits;       //!< Names found in the dentry cache
+  uint64_t numDentryMisses;     //!< Names not found in the dentry cache
+  uint64_t numFastForwarded;    //!< User instructions run in fast-forward
+  uint64_t numTranslations;     //!< Blocks translated into host code
+  uint64_t numTranslated;       //!< User instructions run as host code
+  uint64_t numTranslationInvalidations; //!< Pages whose translations
+                                        //!< were dropped
+  const char *syscallNames[MAX_SYSCALL_STATS];  //!< Names of the system calls
+  uint64_t numSyscalls[MAX_SYSCALL_STATS];      //!< Invocations per system call
+  Time syscallTicks[MAX_SYSCALL_STATS];         //!< Time spent per system call
+  uint64_t numContextSwitches;   //!< Switches between two different threads
+  uint64_t numPreemptions;       //!< Threads preempted at the end of a quantum
+  uint64_t numSameSpaceSwitches;    //!< Switches keeping the address space
+  uint64_t numCrossSpaceSwitches;   //!< Switches flushing the TLB
+  uint64_t numEmptyYields;       //!< Yields with no other thread to run
+  LatencyHistogram readyLatency; //!< Time spent by the threads in the
+                                 //!< ready queues before running
+  int readyThreads;              //!< Threads in the ready queues
+  int maxReadyThreads;           //!< Most threads in the ready queues
+  Time readyArea;                //!< Sum over time of readyThreads (in
+                                 //!< thread-cycles)
+  Time readyChange;              //!< Time readyThreads last changed
+
+  //! readyArea up to the current time
+  Time ReadyArea(void) {
+    return readyArea +
+           (totalTicks > readyChange ? (totalTicks - readyChange) * readyThreads
+                                     : 0);
+  }
+  FILE *exportFile;              //!< Host file of the statistics export
+  Time nextSnapshot;             //!< Time of the next periodic snapshot
 
 public:
   Statistics();    // initialyses everything to zero
@@ -49,13 +125,64 @@ public:
                    and return a pointer on it. It is called by the
                    method which create a new process */
 
+  LockStat *NewLockStat(char *name, const char *kind); /* return the
+                   LockStat shared by the synchronisation objects of
+                   that name and kind, created on first use. It is
+                   called by the constructors of Lock, Semaphore and
+                   Condition */
+
   void Print(); /* prints collected statistics, including
                     process statistics
                 */
+  void Snapshot(bool final); /* appends the current statistics to
+                    the export file (StatsExport) */
+  bool SnapshotDue(void) { return totalTicks >= nextSnapshot; }
   void incrTotalTicks(Time val) { totalTicks += val; }
   void setTotalTicks(Time val) { totalTicks = val; }
   Time getTotalTicks(void) { return totalTicks; }
   void incrIdleTicks(Time val) { idleTicks += val; }
+  void incrEvictions(void) { numEvictions++; }
+  void incrWritebacks(void) { numWritebacks++; }
+  void incrPrefetches(void) { numPrefetches++; }
+  void incrPrefetchHits(void) { numPrefetchHits++; }
+  void incrZeroedPages(void) { numZeroedPages++; }
+  void incrPrezeroedFaults(void) { numPrezeroedFaults++; }
+  void incrSuspensions(void) { numSuspensions++; }
+  void incrPromotions(void) { numPromotions++; }
+  void incrDemotions(void) { numDemotions++; }
+  void incrSharedMappings(void) { numSharedMappings++; }
+  void incrCowCopies(void) { numCowCopies++; }
+  void incrCacheHits(void) { numCacheHits++; }
+  void incrCacheMisses(void) { numCacheMisses++; }
+  void incrReadAheads(int n) { numReadAheads += n; }
+  void incrJournalCommits(int n) {
+    numJournalCommits++;
+    numJournalBlocks += n;
+  }
+  void incrCheckpoints(void) { numCheckpoints++; }
+  void incrDentryHits(void) { numDentryHits++; }
+  void incrDentryMisses(void) { numDentryMisses++; }
+  void incrFastForwarded(uint64_t n) { numFastForwarded += n; }
+  void incrTranslations(void) { numTranslations++; }
+  void incrTranslatedInstructions(uint64_t n) { numTranslated += n; }
+  void incrTranslationInvalidations(void) { numTranslationInvalidations++; }
+  void incrSyscall(int num, const char *name) {
+    syscallNames[num] = name;
+    numSyscalls[num]++;
+  }
+  void incrSyscallTicks(int num, Time val) { syscallTicks[num] += val; }
+  void incrContextSwitches(void) { numContextSwitches++; }
+  void incrPreemptions(void) { numPreemptions++; }
+  void incrEmptyYields(void) { numEmptyYields++; }
+  void incrReadyLatency(ProcessStat *owner, Time latency);
+  void incrReadyThreads(int delta); /* called as threads enter and
+                   leave the ready queues */
+  void incrSpaceSwitches(bool cross) {
+    if (cross)
+      numCrossSpaceSwitches++;
+    else
+      numSameSpaceSwitches++;
+  }
 };
 
 /*! \brief Defines statistics that concern a particular process
@@ -81,6 +208,14 @@ private:
 
   uint64_t numMemoryAccess;   //!< number of Memory accesses
   uint64_t numPageFaults;     //!< number of virtual memory page faults
+  uint64_t numTLBHits;        //!< number of translations found in the TLB
+  uint64_t numTLBMisses;      //!< number of translations missed in the TLB
+  uint64_t numInstrClass[NUM_COST_CLASSES];   //!< instructions per class of
+                                              //!< the cost model
+  uint64_t numMemCacheHits;     //!< accesses hitting the memory cache
+  uint64_t numMemCacheMisses;   //!< accesses missing the memory cache
+  LatencyHistogram readyLatency;   //!< time spent by the threads of the
+                                   //!< process in the ready queues
 public:
   ProcessStat(char *name); /* initialises everything to zero and
                                 initialises the name of the process */
@@ -89,14 +224,57 @@ public:
   Time getUserTime(void) { return userTicks; }
   Time getSystemTime(void) { return systemTicks; }
   void incrMemoryAccess(void);
+  void incrMemoryAccesses(uint64_t count);
   void incrPageFault(void) { numPageFaults++; }
+  uint64_t getPageFaults(void) { return numPageFaults; }
+  void incrTLBHit(void) { numTLBHits++; }
+  void incrTLBMiss(void) { numTLBMisses++; }
+  void incrTLBHits(uint64_t count) { numTLBHits += count; }
+  void incrTLBMisses(uint64_t count) { numTLBMisses += count; }
   void incrNumCharWritten(void) { numConsoleCharsWritten++; }
   void incrNumCharRead(void) { numConsoleCharsRead++; }
   void incrNumDiskReads(void) { numDiskReads++; }
   void incrNumDiskWrites(void) { numDiskWrites++; }
   void incrNumInstruction(void) { numInstruction++; }
+  void incrNumInstructions(uint64_t count) { numInstruction += count; }
+  void incrInstrClass(int cls, uint64_t count) { numInstrClass[cls] += count; }
+  void incrMemCache(uint64_t hits, uint64_t misses);
+  LatencyHistogram *getReadyLatency(void) { return &readyLatency; }
   int getNumInstruction(void) { return numInstruction; }
   void Print(void);
+  void Export(FILE *out, Time now); /* writes the statistics as one
+                   JSON object or one CSV row (StatsExport) */
+};
+
+/*! \brief Defines contention statistics of the synchronisation objects
+// of a given name
+//
+// The objects of a kind (lock, semaphore or condition) created with the
+// same name (e.g. the locks of the open files) share their statistics,
+// so that a convoy on one kind of lock shows up in a single line. For a
+// semaphore, an acquire is a P and it is contended when it blocks; every
+// Wait of a condition blocks.
+*/
+
+class LockStat {
+private:
+  char name[MAXSTRLEN];   //!< name of the objects
+  const char *kind;       //!< kind of the objects
+  uint64_t numAcquires;   //!< number of Acquire calls
+  uint64_t numContended;  //!< number of Acquire calls that had to wait
+  Time waitTicks;         //!< total time spent waiting for the objects
+public:
+  LockStat(char *name, const char *kind); /* initialises everything to
+                             zero and initialises the name of the objects */
+  char *getName(void) { return name; }
+  const char *getKind(void) { return kind; }
+  void incrAcquires(void) { numAcquires++; }
+  void incrContended(Time wait) {
+    numContended++;
+    waitTicks += wait;
+  }
+  void Print(void);
+  void Export(FILE *out); /* writes the statistics as a JSON object */
 };
 
 // Constants used to reflect the relative time an operation would
@@ -112,6 +290,8 @@ public:
 #define CONSOLE_TIME  1000    //!< time to read or write one character
 #define CHECK_TIME    1000    //!< time between two checks of reception register
 #define SEND_TIME     1000    //!< time to send a char via the ACIA object
+#define RETRANSMIT_TIME 100000   //!< time before unacknowledged ACIA frames are sent again
+#define INPUT_POLL_TIME 100000   //!< time between two polls of the inputs (EventInput mode)
 #define TIMER_TIME    10000   //!< interval between time interrupts
 
 #endif   // STATS_H
@@ -0,0 +1,237 @@
+/*! \file trace.cc
+//  \brief Routines of the event trace of the kernel
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "utility/trace.h"
+#include "kernel/msgerror.h"
+#include "utility/config.h"
+#include <string.h>
+
+//! Initial number of named tracks
+#define TRACE_INITIAL_TRACKS 64
+
+//! Largest track number (tracks are stored on 16 bits)
+#define TRACE_MAX_TRACKS 0xffff
+
+//! Names of the interrupt types in the trace (see IntType)
+static const char *traceIntNames[] = {"timer",        "disk",
+                                      "console write", "console read",
+                                      "ACIA receive", "ACIA send"};
+
+//----------------------------------------------------------------------
+// Trace::Trace
+/*!     Allocate an empty trace. Track 0 gathers the events of the
+//      threads that do not have a track of their own.
+//
+//      \param numEvents size of the ring buffer, a power of two
+*/
+//----------------------------------------------------------------------
+Trace::Trace(uint32_t numEvents) {
+  events = new TraceEvent[numEvents];
+  mask = numEvents - 1;
+  next = 0;
+  maxTracks = TRACE_INITIAL_TRACKS;
+  trackNames = new char *[maxTracks];
+  trackNames[0] = strdup("kernel");
+  numTracks = 1;
+}
+
+//----------------------------------------------------------------------
+// Trace::~Trace
+//!     De-allocate the trace
+//----------------------------------------------------------------------
+Trace::~Trace() {
+  delete[] events;
+  for (uint32_t i = 0; i < numTracks; i++)
+    free(trackNames[i]);
+  delete[] trackNames;
+}
+
+//----------------------------------------------------------------------
+// Trace::NewTrack
+/*!     Create a new track for a thread or a device. The name is copied,
+//      the trace outlives the threads it records.
+//
+//      \param name name of the track
+//      \return the number of the track (0 once all the tracks are used)
+*/
+//----------------------------------------------------------------------
+uint16_t
+Trace::NewTrack(const char *name) {
+  if (numTracks > TRACE_MAX_TRACKS)
+    return 0;
+  if (numTracks == maxTracks) {
+    char **larger = new char *[2 * maxTracks];
+    memcpy(larger, trackNames, maxTracks * sizeof(char *));
+    delete[] trackNames;
+    trackNames = larger;
+    maxTracks *= 2;
+  }
+  trackNames[numTracks] = strdup(name);
+  return numTracks++;
+}
+
+//----------------------------------------------------------------------
+// WriteName
+/*!     Write a name as a JSON string
+//
+//      \param out the trace file
+//      \param name the name
+*/
+//----------------------------------------------------------------------
+static void
+WriteName(FILE *out, const char *name) {
+  fputc('"', out);
+  for (const char *c = name; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\')
+      fputc('\\', out);
+    fputc(*c, out);
+  }
+  fputc('"', out);
+}
+
+//----------------------------------------------------------------------
+// TraceTime
+/*!     Convert a simulated time to the microseconds of the trace
+//      event format (the processor frequency is in MHz)
+//
+//      \param time time in cycles
+*/
+//----------------------------------------------------------------------
+static double
+TraceTime(Time time) {
+  return (double) time / g_cfg->ProcessorFrequency;
+}
+
+//----------------------------------------------------------------------
+// Trace::Write
+/*!     Write the events of the buffer, oldest first, in the trace
+//      event format of Chrome and Perfetto. The time a thread holds
+//      the CPU is shown as a slice on its track, from one context
+//      switch to the next; disk requests are slices on the track of the
+//      disk; the other events are instants.
+//
+//      \param fileName host file receiving the trace
+*/
+//----------------------------------------------------------------------
+void
+Trace::Write(const char *fileName) {
+  FILE *out = fopen(fileName, "w");
+  if (out == NULL) {
+    printf("Cannot open trace file %s\n", fileName);
+    return;
+  }
+
+  fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  for (uint32_t i = 0; i < numTracks; i++) {
+    fprintf(out,
+            "{\"ph\": \"M\", \"pid\": 1, \"tid\": %" PRIu32
+            ", \"name\": \"thread_name\", \"args\": {\"name\": ",
+            i);
+    WriteName(out, trackNames[i]);
+    fprintf(out, "}},\n");
+  }
+
+  uint64_t first = next > mask ? next - mask - 1 : 0;
+  int32_t running = -1;   // track holding the CPU, unknown before the
+                          // first context switch
+  Time since = first < next ? events[first & mask].time : 0;
+  for (uint64_t i = first; i < next; i++) {
+    TraceEvent *e = &events[i & mask];
+    double ts = TraceTime(e->time);
+    switch (e->type) {
+    case TRACE_SWITCH:
+      if (running < 0)
+        running = e->arg;
+      fprintf(out,
+              "{\"ph\": \"X\", \"pid\": 1, \"tid\": %" PRId32
+              ", \"ts\": %.3f, \"dur\": %.3f, \"name\": \"running\"},\n",
+              running, TraceTime(since), ts - TraceTime(since));
+      running = e->track;
+      since = e->time;
+      break;
+    case TRACE_SEM_WAIT:
+      fprintf(out,
+              "{\"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %u"
+              ", \"ts\": %.3f, \"name\": \"P blocks\", "
+              "\"args\": {\"semaphore\": \"0x%" PRIx64 "\"}},\n",
+              e->track, ts, e->data);
+      break;
+    case TRACE_SEM_WAKE:
+      fprintf(out,
+              "{\"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %u"
+              ", \"ts\": %.3f, \"name\": \"V wakes\", "
+              "\"args\": {\"semaphore\": \"0x%" PRIx64
+              "\", \"thread\": ",
+              e->track, ts, e->data);
+      WriteName(out, trackNames[e->arg]);
+      fprintf(out, "}},\n");
+      break;
+    case TRACE_DISK_ISSUE:
+      fprintf(out,
+              "{\"ph\": \"B\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f"
+              ", \"name\": \"%s\", \"args\": {\"sector\": %" PRIu64
+              ", \"sectors\": %" PRIu32 "}},\n",
+              e->track, ts, (e->arg & TRACE_DISK_WRITE) ? "write" : "read",
+              e->data, e->arg & ~TRACE_DISK_WRITE);
+      break;
+    case TRACE_DISK_DONE:
+      fprintf(out,
+              "{\"ph\": \"E\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f},\n",
+              e->track, ts);
+      break;
+    case TRACE_PAGE_FAULT:
+      fprintf(out,
+              "{\"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %u"
+              ", \"ts\": %.3f, \"name\": \"page fault\", "
+              "\"args\": {\"vpn\": %" PRIu64 "}},\n",
+              e->track, ts, e->data);
+      break;
+    case TRACE_EVICTION:
+      fprintf(out,
+              "{\"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %u"
+              ", \"ts\": %.3f, \"name\": \"eviction\", "
+              "\"args\": {\"ppn\": %" PRIu64 "}},\n",
+              e->track, ts, e->data);
+      break;
+    case TRACE_INTERRUPT:
+      fprintf(out,
+              "{\"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %u"
+              ", \"ts\": %.3f, \"name\": \"%s interrupt\"},\n",
+              e->track, ts, traceIntNames[e->arg]);
+      break;
+    }
+  }
+
+  // Close the slice of the thread that was running at the end, the
+  // last element has no trailing comma
+  if (running < 0)
+    running = 0;
+  Time end = g_stats->getTotalTicks();
+  fprintf(out,
+          "{\"ph\": \"X\", \"pid\": 1, \"tid\": %" PRId32
+          ", \"ts\": %.3f, \"dur\": %.3f, \"name\": \"running\"}\n",
+          running, TraceTime(since), TraceTime(end) - TraceTime(since));
+  fprintf(out, "]}\n");
+  fclose(out);
+
+  if (next > mask + 1)
+    printf("Trace: %" PRIu64 " events recorded, the %" PRIu64
+           " oldest were overwritten\n",
+           next, next - mask - 1);
+}
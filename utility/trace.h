@@ -0,0 +1,106 @@
+/*! \file trace.h
+    \brief Data structures for the event trace of the kernel
+
+        When tracing is enabled (Trace = 1 in the configuration), the
+        hot paths of the kernel record compact events stamped with the
+        simulated time in a fixed-size ring buffer: context switches,
+        semaphore waits and wake-ups, disk requests and their
+        completion, page faults, evictions and interrupts. Recording
+        an event only fills a few words, so the trace can be left on;
+        when the buffer is full the oldest events are overwritten.
+
+        At exit, the buffer is written to TraceFile in the trace event
+        format of Chrome and Perfetto (JSON, one track per thread and
+        per disk).
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "kernel/system.h"
+#include "utility/stats.h"
+#include "utility/utility.h"
+
+/*! Kinds of trace events */
+enum TraceType {
+  TRACE_SWITCH,       //!< track starts running, arg is the previous track
+  TRACE_SEM_WAIT,     //!< track blocks in P, data is the semaphore
+  TRACE_SEM_WAKE,     //!< track wakes up arg in V, data is the semaphore
+  TRACE_DISK_ISSUE,   //!< disk track starts a request, arg is the number
+                      //!< of sectors (TRACE_DISK_WRITE set for a write),
+                      //!< data the first sector
+  TRACE_DISK_DONE,    //!< disk track completes its request
+  TRACE_PAGE_FAULT,   //!< track faults, data is the virtual page
+  TRACE_EVICTION,     //!< track evicts a page, data is the physical page
+  TRACE_INTERRUPT     //!< interrupt of type arg (IntType) is handled
+};
+
+#define TRACE_DISK_WRITE 0x80000000   //!< Write flag of TRACE_DISK_ISSUE
+
+/*! One event of the trace (24 bytes) */
+struct TraceEvent {
+  Time time;        //!< simulated time of the event
+  uint16_t type;    //!< kind of event (TraceType)
+  uint16_t track;   //!< thread or disk that generated the event
+  uint32_t arg;     //!< argument, depends on the type
+  uint64_t data;    //!< argument, depends on the type
+};
+
+/*! \brief Ring buffer of trace events
+ */
+class Trace {
+public:
+  Trace(uint32_t numEvents);   // Allocate a buffer of numEvents events
+                               // (a power of two)
+  ~Trace();
+
+  //! Record an event, overwriting the oldest one if the buffer is full
+  void Record(TraceType type, uint16_t track, uint32_t arg, uint64_t data) {
+    TraceEvent *e = &events[next++ & mask];
+    e->time = g_stats->getTotalTicks();
+    e->type = type;
+    e->track = track;
+    e->arg = arg;
+    e->data = data;
+  }
+
+  uint16_t NewTrack(const char *name);   // Name a new track (thread, disk)
+
+  void Write(const char *fileName);   // Write the trace in Chrome trace
+                                      // event format
+
+private:
+  TraceEvent *events;   //!< the ring buffer
+  uint64_t mask;        //!< size of the buffer minus one
+  uint64_t next;        //!< number of events recorded so far
+  char **trackNames;    //!< name of each track
+  uint32_t numTracks;   //!< number of tracks created
+  uint32_t maxTracks;   //!< size of trackNames
+};
+
+//! Record an event if tracing is enabled
+#define TRACE(type, track, arg, data)                                          \
+  do {                                                                         \
+    if (g_trace != NULL)                                                       \
+      g_trace->Record(type, track, arg, data);                                 \
+  } while (0)
+
+//! Track of a new thread or device (0 if tracing is disabled)
+#define TRACE_TRACK(name) (g_trace != NULL ? g_trace->NewTrack(name) : 0)
+
+#endif   // TRACE_H
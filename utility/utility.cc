@@ -86,6 +86,7 @@ DebugInit(char *flagList) {
  */
 //----------------------------------------------------------------------
 
+#ifndef NACHOS_RELEASE
 bool
 DebugIsEnabled(char flag) {
   if (enableFlags != NULL)
@@ -114,3 +115,4 @@ DEBUG(char flag, char *format, ...) {
 
   va_end(ap);
 }
+#endif   // NACHOS_RELEASE
@@ -78,6 +78,17 @@ extern void DEBUG(char flag, char *format, ...);   // Print debug message
 
 extern void DumpMem(char *addr, int len);   // Prints a mem area in hex format
 
+// In a release build (make RELEASE=1) the debugging routines are
+// compiled out: no flag is ever tested and the arguments of DEBUG are
+// not even evaluated (they are only kept in dead code, so that the
+// variables computed for the traces are still considered as used).
+#ifdef NACHOS_RELEASE
+inline void
+DebugIgnore(char flag, const char *format, ...) {}
+#define DebugIsEnabled(flag) false
+#define DEBUG(flag, ...)     (false ? DebugIgnore(flag, __VA_ARGS__) : (void) 0)
+#endif
+
 //----------------------------------------------------------------------
 // ASSERT
 /*!     If condition is false,  print a message and dump core.
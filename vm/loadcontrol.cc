@@ -0,0 +1,209 @@
+/*! \file loadcontrol.cc
+//  \brief Routines of the load control of the virtual memory
+//
+//      Page fault frequency load control: at each check, the page
+//      faults of each process since the previous check and its
+//      referenced resident pages give an estimate of its working set.
+//      While the page faults are frequent and the working sets of the
+//      running processes exceed the physical memory, the process with
+//      the largest working set is suspended, so that the others stop
+//      thrashing and run to completion sooner: throughput is favoured
+//      over fairness. The oldest suspended process is resumed once its
+//      working set fits with the ones of the running processes, or as
+//      soon as they stop faulting often: they then have the memory
+//      they need, and the pages they do not use can go to the
+//      suspended process.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "vm/loadcontrol.h"
+#include "kernel/process.h"
+#include "kernel/system.h"
+#include "kernel/thread.h"
+#include "machine/interrupt.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+#include "vm/physMem.h"
+
+//----------------------------------------------------------------------
+// LoadController::LoadController
+/*!	Build a controller with no suspended process, the first check
+//	taking place after one interval.
+*/
+//----------------------------------------------------------------------
+LoadController::LoadController() {
+  nextCheck = nano_to_cycles(g_cfg->LoadControl, g_cfg->ProcessorFrequency);
+  epoch = 0;
+  timer.armed = false;
+}
+
+//----------------------------------------------------------------------
+// LoadController::~LoadController
+/*!	De-allocate the list of the suspended processes.
+*/
+//----------------------------------------------------------------------
+LoadController::~LoadController() {
+  while (suspended.Remove() != NULL)
+    ;
+}
+
+//----------------------------------------------------------------------
+// LoadCheck
+/*!	Handler of the kernel timer of the load controller.
+//
+//	\param arg the load controller
+*/
+//----------------------------------------------------------------------
+static void
+LoadCheck(int64_t arg) {
+  ((LoadController *) arg)->Wakeup();
+}
+
+//----------------------------------------------------------------------
+// LoadController::Check
+/*!	Estimate the working sets of the processes if a check is due,
+//	then suspend the process with the largest one if the processes
+//	thrash, or resume the oldest suspended process if it fits in
+//	memory with the running ones. At most one process is suspended
+//	or resumed per check.
+//
+//	\return true if the process of the current thread was suspended
+*/
+//----------------------------------------------------------------------
+bool
+LoadController::Check() {
+  if (g_cfg->LoadControl == 0 || g_stats->getTotalTicks() < nextCheck)
+    return false;
+  IntStatus oldLevel = g_machine->interrupt->SetStatus(INTERRUPTS_OFF);
+  nextCheck = g_stats->getTotalTicks() +
+              nano_to_cycles(g_cfg->LoadControl, g_cfg->ProcessorFrequency);
+  epoch++;
+
+  // Visit each process once, through its threads
+  uint64_t faults = 0;
+  uint64_t demand = 0;
+  int active = 0;
+  Process *largest = NULL;
+  for (ListElement<Thread *> *e = g_alive->getFirst(); e != NULL;
+       e = e->next) {
+    Process *process = ((Thread *) e->item)->GetProcessOwner();
+    if (process == NULL || process->addrspace == NULL ||
+        process->loadEpoch == epoch)
+      continue;
+    process->loadEpoch = epoch;
+
+    uint64_t newFaults = process->stat->getPageFaults() - process->loadFaults;
+    process->loadFaults += newFaults;
+    if (process->suspended)
+      continue;   // its estimate is the one of its suspension
+    process->workingSet =
+        g_physical_mem_manager->ReferencedFrames(process->addrspace) +
+        newFaults;
+    if (process->workingSet == 0)
+      continue;   // uses no memory (kernel threads only, or blocked)
+    faults += newFaults;
+    demand += process->workingSet;
+    active++;
+    if (largest == NULL || process->workingSet > largest->workingSet)
+      largest = process;
+  }
+
+  bool yield = false;
+  if (active >= 2 && faults >= LOAD_THRASH_FAULTS &&
+      demand > g_cfg->NumPhysPages) {
+    Suspend(largest);
+    yield = (largest == g_current_thread->GetProcessOwner());
+  } else if (!suspended.IsEmpty()) {
+    Process *oldest = (Process *) suspended.getFirst()->item;
+    if (demand + oldest->workingSet <= g_cfg->NumPhysPages ||
+        faults < LOAD_THRASH_FAULTS / 2)
+      Resume(oldest);
+  }
+
+  // Check again even if nothing runs, not to leave a process suspended
+  if (!suspended.IsEmpty() && !timer.armed)
+    g_timer_wheel->Add(&timer, nextCheck, LoadCheck, (int64_t) this);
+  g_machine->interrupt->SetStatus(oldLevel);
+  return yield;
+}
+
+//----------------------------------------------------------------------
+// LoadController::Wakeup
+/*!	Check run by the kernel timer of the controller, armed while a
+//	process is suspended, with interrupts disabled.
+*/
+//----------------------------------------------------------------------
+void
+LoadController::Wakeup() {
+  if (Check() && g_machine->GetStatus() != IDLE_MODE)
+    g_machine->interrupt->YieldOnReturn();
+  if (!suspended.IsEmpty() && !timer.armed)
+    g_timer_wheel->Add(&timer, nextCheck, LoadCheck, (int64_t) this);
+}
+
+//----------------------------------------------------------------------
+// LoadController::Forget
+/*!	Remove a deleted process from the suspended ones. Its frames are
+//	released: the oldest suspended process is resumed without waiting
+//	for the next check.
+//
+//	\param process the process
+*/
+//----------------------------------------------------------------------
+void
+LoadController::Forget(Process *process) {
+  if (process->suspended)
+    Resume(process);
+  else if (!suspended.IsEmpty())
+    Resume((Process *) suspended.getFirst()->item);
+}
+
+//----------------------------------------------------------------------
+// LoadController::Suspend
+/*!	Suspend a process: the scheduler leaves its threads in the ready
+//	queues (see Scheduler::DequeueAffine).
+//
+//	\param process the process
+*/
+//----------------------------------------------------------------------
+void
+LoadController::Suspend(Process *process) {
+  DEBUG('v', (char *) "Load control suspends %s (working set %" PRIu32
+        " pages)\n", process->getName(), process->workingSet);
+  process->suspended = true;
+  suspended.Append((void *) process);
+  g_stats->incrSuspensions();
+}
+
+//----------------------------------------------------------------------
+// LoadController::Resume
+/*!	Resume a suspended process.
+//
+//	\param process the process, suspended
+*/
+//----------------------------------------------------------------------
+void
+LoadController::Resume(Process *process) {
+  DEBUG('v', (char *) "Load control resumes %s\n", process->getName());
+
+  // Remove it keeping the order of the others
+  ListElement<Process *> *prev = NULL;
+  for (ListElement<Process *> *e = suspended.getFirst(); e->item != process;
+       e = e->next)
+    prev = e;
+  suspended.RemoveAfter(prev);
+  process->suspended = false;
+}
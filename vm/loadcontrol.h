@@ -0,0 +1,86 @@
+/*! \file loadcontrol.h
+   \brief Data structures for the load control of the virtual memory
+
+        When the working sets of the processes do not fit together in
+        physical memory, the global page replacement takes the pages of
+        every process in turn and they all thrash. The load controller
+        watches the page fault frequency of the processes, estimates
+        their working sets, and suspends processes until the others fit
+        in memory, resuming them as memory becomes available. A
+        suspended process keeps its pages, which are reclaimed by the
+        page replacement as the other processes need them.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef LOADCONTROL_H
+#define LOADCONTROL_H
+
+#include "kernel/copyright.h"
+#include "kernel/timerwheel.h"
+#include "utility/list.h"
+#include "utility/utility.h"
+
+class Process;
+
+//! Page faults per check interval, over all the processes, above which
+//! the memory is considered overcommitted. Below half of it, the
+//! running processes have the memory they need, and a suspended
+//! process is resumed
+#define LOAD_THRASH_FAULTS 16
+
+/*! \brief Defines the load controller
+//
+// The controller runs every g_cfg->LoadControl nanoseconds, from the
+// timer interrupt or a page fault, and from a kernel timer while a
+// process is suspended. The working set of a process is estimated as
+// its resident pages referenced since the clock hand last went by,
+// plus the pages it faulted on during the interval.
+*/
+class LoadController {
+public:
+  //! Build a controller with no suspended process
+  LoadController();
+
+  //! De-allocate the list of suspended processes
+  ~LoadController();
+
+  //! Check the fault frequency if a check is due, suspending or
+  //! resuming a process. Return true if the current thread has to
+  //! give up the CPU, its process being suspended
+  bool Check();
+
+  //! Check run by the kernel timer, while a process is suspended
+  void Wakeup();
+
+  //! Forget a deleted process, resuming another one in its memory
+  void Forget(Process *process);
+
+private:
+  //! Keep the threads of a process off the harts
+  void Suspend(Process *process);
+
+  //! Let the threads of a process run again
+  void Resume(Process *process);
+
+  List<Process *> suspended;   //!< Suspended processes, oldest first
+  KernelTimer timer;           //!< Next check while a process is suspended
+  Time nextCheck;              //!< Time of the next check
+  uint64_t epoch;              //!< Number of the current check
+};
+
+#endif   // LOADCONTROL_H
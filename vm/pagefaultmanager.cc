@@ -19,10 +19,14 @@ Routines for the page fault managerPage Fault Manager
 #include "vm/pagefaultmanager.h"
 #include "kernel/msgerror.h"
 #include "kernel/thread.h"
+#include "vm/loadcontrol.h"
 #include "vm/physMem.h"
+#include "vm/shm.h"
 #include "vm/swapManager.h"
 
-PageFaultManager::PageFaultManager() {}
+PageFaultManager::PageFaultManager() {
+  window = g_cfg->FaultAround;
+}
 
 // PageFaultManager::~PageFaultManager()
 /*! Nothing for now
@@ -48,7 +52,329 @@ PageFaultManager::~PageFaultManager() {}
 */
 ExceptionType
 PageFaultManager::PageFault(uint64_t virtualPage) {
-  printf("**** Warning: page fault manager is not implemented yet\n");
-  exit(ERROR);
-  return ((ExceptionType) 0);
+  AddrSpace *addrspace = g_current_thread->GetProcessOwner()->addrspace;
+  TranslationTable *tt = addrspace->translationTable;
+
+  // The faults may show that the processes thrash, this one being
+  // suspended. It waits before getting the page, which the running
+  // processes would evict before the access is retried
+  if (g_load_control->Check())
+    g_current_thread->Yield();
+
+  // Wait if the page is being loaded or saved by another thread
+  while (tt->getBitIo(virtualPage))
+    g_current_thread->Yield();
+
+  // The page may have been loaded meanwhile
+  if (tt->getBitValid(virtualPage))
+    return NO_EXCEPTION;
+  tt->setBitIo(virtualPage);
+
+  // Get the page contents, evicting a page if there is no free page
+  bool loaded;
+  uint64_t pp = ObtainPage(addrspace, virtualPage, true, &loaded);
+  MapPage(addrspace, virtualPage, pp);
+
+  // Neighbouring pages are likely to fault right afterwards
+  FaultAround(addrspace, virtualPage);
+
+  return NO_EXCEPTION;
+}
+
+// uint64_t SharedKey(AddrSpace *addrspace, uint64_t virtualPage)
+/*!
+//	Identify the page of the executable file backing a virtual page,
+//      which may be shared by all the processes running this file.
+//
+//	\return the sector of the header of the file in the 32 high
+//        bits, the offset of the page in the file in the 32 low bits
+*/
+static uint64_t
+SharedKey(AddrSpace *addrspace, uint64_t virtualPage) {
+  OpenFile *exec_file = g_current_thread->GetProcessOwner()->exec_file;
+  return ((uint64_t) exec_file->GetSector() << 32) |
+         addrspace->translationTable->getAddrDisk(virtualPage);
+}
+
+// uint64_t ObtainPage(AddrSpace *addrspace, uint64_t virtualPage,
+//                     bool evict, bool *loaded)
+/*!
+//	Get a physical page holding the contents of a virtual page. A
+//      page of the executable file that is already in memory (loaded by
+//      another process running the same file) is shared, as is a page
+//      of a shared memory segment in memory; otherwise a physical page
+//      is allocated and loaded (see LoadPage), and made available for
+//      sharing when it comes from the executable file or a segment.
+//
+//	\param addrspace the address space the page belongs to
+//	\param virtualPage the virtual page (bit io set by the caller)
+//	\param evict true to evict a page when there is no free page
+//	\param loaded set to true if the page was loaded, false if shared
+//	\return the physical page, locked, or INVALID_PAGE if there is no
+//        free page and evict is false
+*/
+uint64_t
+PageFaultManager::ObtainPage(AddrSpace *addrspace, uint64_t virtualPage,
+                             bool evict, bool *loaded) {
+  TranslationTable *tt = addrspace->translationTable;
+  // Only the pages of the executable file are shared, the pages of a
+  // mapped file are written back to it
+  bool from_file =
+      !tt->getBitSwap(virtualPage) &&
+      tt->getAddrDisk(virtualPage) != (uint32_t) INVALID_SECTOR &&
+      addrspace->findMappedFile(virtualPage << g_cfg->PageShift) == NULL;
+  int index;
+  ShmSegment *segment = addrspace->FindSegment(virtualPage, &index);
+  uint64_t key = 0;
+  uint64_t pp;
+
+  if (from_file || segment != NULL) {
+    key = segment != NULL ? segment->Key(index)
+                          : SharedKey(addrspace, virtualPage);
+    pp = g_physical_mem_manager->ShareFrame(key, addrspace, virtualPage);
+    if (pp != (uint64_t) INVALID_PAGE) {
+      DEBUG('v', (char *) "Sharing virtual page %" PRIu64 " (physical page %"
+            PRIu64 ")\n", virtualPage, pp);
+      *loaded = false;
+      return pp;
+    }
+  }
+
+  // An anonymous page never saved is zero-filled, preferably with a
+  // page zeroed in advance
+  bool zero = !tt->getBitSwap(virtualPage) &&
+              tt->getAddrDisk(virtualPage) == (uint32_t) INVALID_SECTOR;
+  bool zeroed;
+  pp = INVALID_PAGE;
+  if (g_cfg->SuperPagePages != 0 && segment == NULL)
+    pp = g_physical_mem_manager->FindSuperPageFrame(addrspace, virtualPage,
+                                                     &zeroed);
+  if (pp == (uint64_t) INVALID_PAGE)
+    pp = g_physical_mem_manager->FindFreePage(zero, &zeroed);
+  if (pp == (uint64_t) INVALID_PAGE) {
+    if (!evict)
+      return INVALID_PAGE;
+    pp = g_physical_mem_manager->EvictPage();
+    zeroed = false;
+  }
+  g_physical_mem_manager->SetTPREntry(pp, virtualPage, addrspace, true);
+  if (from_file || segment != NULL)
+    g_physical_mem_manager->RegisterSharedFrame(pp, key);
+
+  LoadPage(addrspace, virtualPage, pp, zeroed);
+  *loaded = true;
+  return pp;
+}
+
+// void MapPage(AddrSpace *addrspace, uint64_t virtualPage, uint64_t pp)
+/*!
+//	Map a virtual page on a (locked) physical page obtained by
+//      ObtainPage, then unlock it. A page that may be shared (page of
+//      the executable file) is mapped read-only; if it is writable, its
+//      bit cow is set so that the first write gives it a private copy
+//      (see CopyOnWrite). The region of the page becomes a superpage
+//      once all its pages are mapped (see TranslationTable::Promote).
+*/
+void
+PageFaultManager::MapPage(AddrSpace *addrspace, uint64_t virtualPage,
+                          uint64_t pp) {
+  TranslationTable *tt = addrspace->translationTable;
+
+  if (!tt->getBitSwap(virtualPage) &&
+      tt->getAddrDisk(virtualPage) != (uint32_t) INVALID_SECTOR &&
+      tt->getBitWriteAllowed(virtualPage) &&
+      addrspace->findMappedFile(virtualPage << g_cfg->PageShift) == NULL) {
+    tt->clearBitWriteAllowed(virtualPage);
+    tt->setBitCow(virtualPage);
+  }
+  tt->setPhysicalPage(virtualPage, pp);
+  tt->clearBitM(virtualPage);
+  tt->setBitValid(virtualPage);
+  tt->clearBitIo(virtualPage);
+  g_physical_mem_manager->UnlockPage(pp);
+  tt->Promote(virtualPage);
+}
+
+// ExceptionType CopyOnWrite(uint64_t virtualPage)
+/*!
+//	This method is called by the Memory Management Unit on a write to
+//      a page whose bit cow is set. The page gets a private copy when
+//      other address spaces share its physical page, or simply becomes
+//      private when it is the last to map it, and is made writable.
+//
+//	\param virtualPage the virtual page subject to the write
+//	\return the exception (generally the NO_EXCEPTION constant)
+*/
+ExceptionType
+PageFaultManager::CopyOnWrite(uint64_t virtualPage) {
+  AddrSpace *addrspace = g_current_thread->GetProcessOwner()->addrspace;
+  TranslationTable *tt = addrspace->translationTable;
+
+  // The page has to be in memory first
+  while (!tt->getBitValid(virtualPage) || tt->getBitIo(virtualPage)) {
+    ExceptionType e = PageFault(virtualPage);
+    if (e != NO_EXCEPTION)
+      return e;
+  }
+  if (!tt->getBitCow(virtualPage))
+    return NO_EXCEPTION;
+  tt->setBitIo(virtualPage);
+
+  // Lock the shared page, so that it is not evicted while being copied
+  uint64_t shared_pp = tt->getPhysicalPage(virtualPage);
+  g_physical_mem_manager->LockPage(shared_pp);
+
+  if (g_physical_mem_manager->DropSharer(shared_pp, addrspace)) {
+    // Other address spaces map the page: copy it in a new page
+    bool zeroed;
+    uint64_t pp = g_physical_mem_manager->FindFreePage(false, &zeroed);
+    if (pp == (uint64_t) INVALID_PAGE)
+      pp = g_physical_mem_manager->EvictPage();
+    g_physical_mem_manager->SetTPREntry(pp, virtualPage, addrspace, true);
+    memmove(&(g_machine->mainMemory[pp << g_cfg->PageShift]),
+            &(g_machine->mainMemory[shared_pp << g_cfg->PageShift]),
+            g_cfg->PageSize);
+    tt->setPhysicalPage(virtualPage, pp);
+    tt->setBitValid(virtualPage);
+    g_physical_mem_manager->UnlockPage(pp);
+    g_stats->incrCowCopies();
+  } else {
+    // Last mapping of the page: it simply becomes private
+    g_physical_mem_manager->MakePrivate(shared_pp);
+  }
+  g_physical_mem_manager->UnlockPage(shared_pp);
+
+  tt->clearBitCow(virtualPage);
+  tt->setBitWriteAllowed(virtualPage);
+  tt->clearBitIo(virtualPage);
+  tt->Promote(virtualPage);
+  return NO_EXCEPTION;
+}
+
+// void LoadPage(AddrSpace *addrspace, uint64_t virtualPage, uint64_t pp,
+//               bool zeroed)
+/*!
+//	Fill a physical page with the contents of a virtual page: from its
+//      shared memory segment, from the swap area if it has been saved
+//      there, from the executable file on its first touch, or with
+//      zeroes for an anonymous page.
+//
+//	\param addrspace the address space the page belongs to
+//	\param virtualPage the virtual page to load
+//	\param pp the physical page receiving the contents
+//	\param zeroed true if the physical page already holds zeroes
+*/
+void
+PageFaultManager::LoadPage(AddrSpace *addrspace, uint64_t virtualPage,
+                           uint64_t pp, bool zeroed) {
+  TranslationTable *tt = addrspace->translationTable;
+  int index;
+  ShmSegment *segment = addrspace->FindSegment(virtualPage, &index);
+
+  if (segment != NULL) {
+    DEBUG('v', (char *) "Loading virtual page %" PRIu64 " from segment %d\n",
+          virtualPage, (int) segment->id);
+    segment->LoadPage(index, pp, zeroed);
+  } else if (tt->getBitSwap(virtualPage)) {
+    // The page has been saved in the swap area
+    DEBUG('v', (char *) "Loading virtual page %" PRIu64 " from swap\n",
+          virtualPage);
+    g_swap_manager->GetPageSwap(tt->getAddrDisk(virtualPage), pp);
+  } else if (tt->getAddrDisk(virtualPage) != (uint32_t) INVALID_SECTOR) {
+    // Page with an image in a mapped file (each time it is loaded), or
+    // in the executable file (first touch only)
+    OpenFile *file =
+        addrspace->findMappedFile(virtualPage << g_cfg->PageShift);
+    int size = g_cfg->PageSize;
+    if (file != NULL) {
+      DEBUG('v', (char *) "Loading virtual page %" PRIu64
+            " from mapped file\n", virtualPage);
+    } else {
+      DEBUG('v', (char *) "Loading virtual page %" PRIu64
+            " from executable\n", virtualPage);
+      file = g_current_thread->GetProcessOwner()->exec_file;
+      size = addrspace->ExecPageBytes(virtualPage);
+    }
+    if (!zeroed)
+      memset(&(g_machine->mainMemory[pp << g_cfg->PageShift]), 0,
+             g_cfg->PageSize);
+    file->ReadAt((char *) &(g_machine->mainMemory[pp << g_cfg->PageShift]),
+                 size, tt->getAddrDisk(virtualPage));
+  } else {
+    // Anonymous page (bss, stack) never saved: fill it with zeroes
+    DEBUG('v', (char *) "Zero-filling virtual page %" PRIu64 "\n",
+          virtualPage);
+    if (zeroed)
+      g_stats->incrPrezeroedFaults();
+    else
+      memset(&(g_machine->mainMemory[pp << g_cfg->PageShift]), 0,
+             g_cfg->PageSize);
+  }
+}
+
+// void FaultAround(AddrSpace *addrspace, uint64_t virtualPage)
+/*!
+//	Load the virtual pages following a faulting page, as long as they
+//      are not resident and have contents on disk (swap area or
+//      executable file). Only free physical pages are used: no page is
+//      evicted for a speculative load. The number of pages loaded
+//      adapts to how many prefetched pages were actually referenced
+//      (see PrefetchUsed and PrefetchWasted).
+//
+//	\param addrspace the address space of the faulting thread
+//	\param virtualPage the virtual page that caused the fault
+*/
+void
+PageFaultManager::FaultAround(AddrSpace *addrspace, uint64_t virtualPage) {
+  TranslationTable *tt = addrspace->translationTable;
+
+  for (uint64_t vp = virtualPage + 1;
+       vp <= virtualPage + window && vp < g_cfg->MaxVirtPages; vp++) {
+    if (tt->getBitValid(vp) || tt->getBitIo(vp))
+      break;
+    if (!tt->getBitSwap(vp) &&
+        tt->getAddrDisk(vp) == (uint32_t) INVALID_SECTOR)
+      break;
+
+    tt->setBitIo(vp);
+    bool loaded;
+    uint64_t pp = ObtainPage(addrspace, vp, false, &loaded);
+    if (pp == (uint64_t) INVALID_PAGE) {
+      tt->clearBitIo(vp);
+      break;
+    }
+
+    // Map the page, unreferenced so as to know if it is used
+    tt->clearBitU(vp);
+    if (loaded) {
+      g_physical_mem_manager->MarkPrefetched(pp);
+      g_stats->incrPrefetches();
+    }
+    MapPage(addrspace, vp, pp);
+  }
+}
+
+// void PrefetchUsed()
+/*!
+//	A prefetched page has been referenced: widen the fault-around
+//      window, up to FaultAround pages.
+*/
+void
+PageFaultManager::PrefetchUsed() {
+  g_stats->incrPrefetchHits();
+  if (window < g_cfg->FaultAround)
+    window++;
+}
+
+// void PrefetchWasted()
+/*!
+//	A prefetched page has been evicted without being referenced:
+//      halve the fault-around window (keeping at least one page so
+//      that its accuracy is still measured).
+*/
+void
+PageFaultManager::PrefetchWasted() {
+  window /= 2;
+  if (window == 0 && g_cfg->FaultAround > 0)
+    window = 1;
 }
@@ -24,6 +24,8 @@
 
 #include "machine/machine.h"
 
+class AddrSpace;
+
 /*! \brief Defines the page fault manager
    This object manages the page fault of the simulated MIPS processor 
    for the Nachos kernel.
@@ -36,6 +38,29 @@ public:
   ~PageFaultManager();
  
   ExceptionType PageFault(uint64_t virtualPage); //!< Page faut handler
+
+  ExceptionType CopyOnWrite(uint64_t virtualPage);   //!< Write to a page with
+                                                     //!< bit cow set
+
+  void PrefetchUsed();     //!< A prefetched page has been referenced
+  void PrefetchWasted();   //!< A prefetched page was evicted untouched
+
+private:
+  //! Get a physical page (shared or loaded) for a virtual page
+  uint64_t ObtainPage(AddrSpace *addrspace, uint64_t virtualPage, bool evict,
+                      bool *loaded);
+
+  //! Map a virtual page on a physical page obtained by ObtainPage
+  void MapPage(AddrSpace *addrspace, uint64_t virtualPage, uint64_t pp);
+
+  //! Fill a physical page with the contents of a virtual page
+  void LoadPage(AddrSpace *addrspace, uint64_t virtualPage, uint64_t pp,
+                bool zeroed);
+
+  //! Load the pages following a faulting page
+  void FaultAround(AddrSpace *addrspace, uint64_t virtualPage);
+
+  uint32_t window;   //!< Number of pages currently loaded around a fault
 };
 
 #endif // PFM_H
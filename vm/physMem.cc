@@ -20,13 +20,17 @@
 
 #include "vm/physMem.h"
 #include "kernel/msgerror.h"
+#include "vm/pagefaultmanager.h"
+#include "vm/shm.h"
+#include "utility/trace.h"
 #include <unistd.h>
 
 //-----------------------------------------------------------------
 // PhysicalMemManager::PhysicalMemManager
 //
 /*! Constructor. It simply clears all the page flags and inserts them in the
-// free_page_list to indicate that the physical pages are free
+// free page lists to indicate that the physical pages are free (the
+// main memory is zeroed when the machine starts)
 */
 //-----------------------------------------------------------------
 PhysicalMemManager::PhysicalMemManager() {
@@ -38,15 +42,32 @@ PhysicalMemManager::PhysicalMemManager() {
     tpr[i].free = true;
     tpr[i].locked = false;
     tpr[i].owner = NULL;
-    free_page_list.Append((void *) i);
+    tpr[i].age = 0;
+    tpr[i].prefetched = false;
+    tpr[i].refcount = 0;
+    tpr[i].shared = false;
+    tpr[i].sharers = NULL;
+    tpr[i].ownerLink = NULL;
+    zeroed_page_list.Append((void *) i);
   }
   i_clock = -1;
+
+  writeback_thread = NULL;
+  writeback_sem = new Semaphore((char *) "writeback", 0);
+  writeback_pending = false;
 }
 
 PhysicalMemManager::~PhysicalMemManager() {
-  // Empty free page list
-  while (!free_page_list.IsEmpty())
-    free_page_list.Remove();
+  // Empty free page lists
+  while (!zeroed_page_list.IsEmpty())
+    zeroed_page_list.Remove();
+  while (!dirty_page_list.IsEmpty())
+    dirty_page_list.Remove();
+
+  // The writeback thread is still blocked on its semaphore, it is
+  // deleted with the other threads: the semaphore must outlive it
+  if (writeback_thread == NULL)
+    delete writeback_sem;
 
   // Delete physical page table
   delete[] tpr;
@@ -56,8 +77,8 @@ PhysicalMemManager::~PhysicalMemManager() {
 // PhysicalMemManager::FreePhysicalPage
 //
 /*! This method releases an unused physical page by adding
-//  it in the free_page_list. Sets up all data structures
-//  accordingly
+//  it in the list of the free pages to zero (see ZeroFreePages). Sets
+//  up all data structures accordingly
 //
 //  \param num_page is the number of the real page to free
 */
@@ -68,15 +89,23 @@ PhysicalMemManager::FreePhysicalPage(uint64_t num_page) {
   // Check that the page is not already free
   ASSERT(!tpr[num_page].free);
 
+  // A page of a file can no longer be shared
+  ASSERT(tpr[num_page].sharers == NULL);
+  if (tpr[num_page].shared)
+    MakePrivate(num_page);
+
   // Update the physical page table entry
   tpr[num_page].free = true;
   tpr[num_page].locked = false;
+  tpr[num_page].refcount = 0;
+  UnlinkFrame(num_page);
   if (tpr[num_page].owner->translationTable != NULL)
     tpr[num_page].owner->translationTable->clearBitValid(
         tpr[num_page].virtualPage);
+  g_machine->mmu->InvalidateDecodedPage(num_page);
 
   // Insert the page in the free list
-  free_page_list.Prepend((void *) num_page);
+  dirty_page_list.Prepend((void *) num_page);
 }
 
 //-----------------------------------------------------------------
@@ -99,6 +128,24 @@ PhysicalMemManager::UnlockPage(uint64_t num_page) {
   tpr[num_page].locked = false;
 }
 
+//-----------------------------------------------------------------
+// PhysicalMemManager::LockPage
+//
+/*! This method locks the used page numPage, so that it cannot be
+//  evicted, waiting for it to be unlocked if another thread holds it.
+//
+//  \param num_page is the number of the real page to lock
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::LockPage(uint64_t num_page) {
+  ASSERT(num_page < g_cfg->NumPhysPages);
+  while (tpr[num_page].locked)
+    g_current_thread->Yield();
+  ASSERT(tpr[num_page].free == false);
+  tpr[num_page].locked = true;
+}
+
 //-----------------------------------------------------------------
 // PhysicalMemManager::SetTPREntry
 //
@@ -117,6 +164,12 @@ void PhysicalMemManager::SetTPREntry(uint64_t pp, uint64_t virtualpage,AddrSpace
   tpr[pp].virtualPage = virtualpage;
   tpr[pp].owner = owner;
   tpr[pp].locked = locked;
+  tpr[pp].age = 0;
+  tpr[pp].prefetched = false;
+  ASSERT(tpr[pp].sharers == NULL);
+  tpr[pp].refcount = 1;
+  tpr[pp].shared = false;
+  LinkFrame(pp);
 }
 
 //-----------------------------------------------------------------
@@ -125,23 +178,32 @@ void PhysicalMemManager::SetTPREntry(uint64_t pp, uint64_t virtualpage,AddrSpace
 /*! This method returns a new physical page number, if it finds one
 //  free. If not, return INVALID_PAGE. Does not run the clock algorithm.
 //
+//  The pages zeroed in advance are kept for the pages to be filled
+//  with zeroes, the others first take the pages not zeroed yet.
+//
+//  \param zero: true if the page is to be filled with zeroes
+//  \param zeroed: set to true if the page returned holds zeroes
 //  \return A new free physical page number.
 */
 //-----------------------------------------------------------------
 uint64_t
-PhysicalMemManager::FindFreePage() {
+PhysicalMemManager::FindFreePage(bool zero, bool *zeroed) {
   uint64_t page;
 
-  // Check that the free list is not empty
-  if (free_page_list.IsEmpty()) {
+  // Check that the free lists are not empty
+  if (zeroed_page_list.IsEmpty() && dirty_page_list.IsEmpty()) {
     return INVALID_PAGE;
   }
 
   // Update statistics
   g_current_thread->GetProcessOwner()->stat->incrMemoryAccess();
 
-  // Get a page from the free list
-  page = (int64_t) free_page_list.Remove();
+  // Get a page from the free list of the right kind if possible
+  ListInt *list = zero ? &zeroed_page_list : &dirty_page_list;
+  if (list->IsEmpty())
+    list = zero ? &dirty_page_list : &zeroed_page_list;
+  *zeroed = (list == &zeroed_page_list);
+  page = (int64_t) list->Remove();
 
   // Check that the page is really free
   ASSERT(tpr[page].free);
@@ -149,23 +211,736 @@ PhysicalMemManager::FindFreePage() {
   // Update the physical page table
   tpr[page].free = false;
 
+  // The page is about to receive new contents
+  g_machine->mmu->InvalidateDecodedPage(page);
+
+  return page;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::FindSuperPageFrame
+//
+/*! This method returns the free physical page at the place of a
+//  virtual page in the aligned region of g_cfg->SuperPagePages pages
+//  holding it, so that the region can be promoted to a superpage once
+//  all its pages are in memory (see TranslationTable::Promote). The
+//  place is given by the pages of the region already in memory, or by
+//  a block of free pages if there is none.
+//
+//  \param owner: the address space of the page
+//  \param virtualPage: the virtual page
+//  \param zeroed: set to true if the page returned holds zeroes
+//  \return A new free physical page number, INVALID_PAGE if the page
+//  at the place of the virtual page is not free.
+*/
+//-----------------------------------------------------------------
+uint64_t
+PhysicalMemManager::FindSuperPageFrame(AddrSpace *owner, uint64_t virtualPage,
+                                       bool *zeroed) {
+  TranslationTable *tt = owner->translationTable;
+  uint64_t pages = g_cfg->SuperPagePages;
+  uint64_t first = virtualPage & ~(pages - 1);
+  if (first + pages > (uint64_t) tt->getMaxNumPages())
+    return INVALID_PAGE;
+
+  // The first page of the region in memory gives the place of the others
+  uint64_t base = (uint64_t) INVALID_PAGE;
+  for (uint64_t i = 0; i < pages; i++)
+    if (first + i != virtualPage && tt->getBitValid(first + i)) {
+      uint64_t pp = tt->getPhysicalPage(first + i);
+      if (pp < i || ((pp - i) & (pages - 1)) != 0)
+        return INVALID_PAGE;
+      base = pp - i;
+      break;
+    }
+
+  // Otherwise the region starts a block of free pages
+  for (uint64_t b = 0;
+       base == (uint64_t) INVALID_PAGE && b + pages <= g_cfg->NumPhysPages;
+       b += pages) {
+    uint64_t i = 0;
+    while (i < pages && tpr[b + i].free)
+      i++;
+    if (i == pages)
+      base = b;
+  }
+  if (base == (uint64_t) INVALID_PAGE)
+    return INVALID_PAGE;
+
+  uint64_t page = base + (virtualPage - first);
+  if (!tpr[page].free || !TakeFreePage(page, zeroed))
+    return INVALID_PAGE;
+
+  // Update statistics
+  g_current_thread->GetProcessOwner()->stat->incrMemoryAccess();
+
+  tpr[page].free = false;
+  g_machine->mmu->InvalidateDecodedPage(page);
   return page;
 }
 
+//-----------------------------------------------------------------
+// PhysicalMemManager::TakeFreePage
+//
+/*! This method removes a given page from the free page list holding it.
+//
+//  \param numPage: the free physical page
+//  \param zeroed: set to true if the page holds zeroes
+//  \return true if the page has been found in a free list
+*/
+//-----------------------------------------------------------------
+bool
+PhysicalMemManager::TakeFreePage(uint64_t numPage, bool *zeroed) {
+  ListInt *lists[2] = {&zeroed_page_list, &dirty_page_list};
+  for (int l = 0; l < 2; l++) {
+    ListElement<uint64_t> *prev = NULL;
+    for (ListElement<uint64_t> *e = lists[l]->getFirst(); e != NULL;
+         e = e->next) {
+      if ((uint64_t) e->item == numPage) {
+        lists[l]->RemoveAfter(prev);
+        *zeroed = (l == 0);
+        return true;
+      }
+      prev = e;
+    }
+  }
+  return false;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::ZeroFreePages
+//
+/*! This method fills free pages with zeroes in advance, so that the
+//  faults on pages to be zero-filled find them ready. Called when the
+//  machine is idle (see Interrupt::Idle).
+//
+//  \param count: maximum number of pages to zero
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::ZeroFreePages(int count) {
+  for (int n = 0; n < count && !dirty_page_list.IsEmpty(); n++) {
+    uint64_t page = (int64_t) dirty_page_list.Remove();
+    ASSERT(tpr[page].free);
+    memset(&(g_machine->mainMemory[page << g_cfg->PageShift]), 0,
+           g_cfg->PageSize);
+    zeroed_page_list.Append((void *) page);
+    g_stats->incrZeroedPages();
+  }
+}
+
 //-----------------------------------------------------------------
 // PhysicalMemManager::EvictPage
 //
-/*! This method implements page replacement, using the well-known
-//  clock algorithm.
+/*! This method implements page replacement. The victim page is chosen
+//  by the policy selected in the configuration file (the well-known
+//  clock algorithm by default), then saved to the swap area if it has
+//  no up-to-date copy there or in the executable file.
+//
+//  The returned page is locked and still marked as used: the caller
+//  sets its new owner with SetTPREntry and unlocks it once loaded.
 //
 //  \return A new free physical page number.
 */
 //-----------------------------------------------------------------
 uint64_t
 PhysicalMemManager::EvictPage() {
-  printf("**** Warning: page replacement algorithm is not implemented yet\n");
-  exit(ERROR);
-  return (0);
+  uint64_t victim;
+
+  // Choose the victim page, waiting for pages to be unlocked if they
+  // are all locked
+  while (true) {
+    switch (g_cfg->PageReplacement) {
+    case REPLACEMENT_ENHANCED_CLOCK:
+      victim = EnhancedClockVictim();
+      break;
+    case REPLACEMENT_AGING:
+      victim = AgingVictim();
+      break;
+    default:
+      victim = ClockVictim();
+      break;
+    }
+    if (victim != (uint64_t) INVALID_PAGE)
+      break;
+    g_current_thread->Yield();
+  }
+
+  ASSERT(!tpr[victim].free);
+  tpr[victim].locked = true;
+  g_stats->incrEvictions();
+  TRACE(TRACE_EVICTION, g_current_thread->GetTraceTrack(), 0, victim);
+
+  // Memory is full: let the writeback thread clean the next victims
+  // while we are saving this one
+  WakeWriteback();
+
+  // A prefetched page evicted before being referenced was loaded for
+  // nothing
+  if (tpr[victim].prefetched) {
+    tpr[victim].prefetched = false;
+    g_page_fault_manager->PrefetchWasted();
+  }
+
+  AddrSpace *owner = tpr[victim].owner;
+  uint64_t virtualPage = tpr[victim].virtualPage;
+  TranslationTable *tt = owner->translationTable;
+
+  // The page no longer belongs to its owner, which releases it no more
+  UnlinkFrame(victim);
+
+  DEBUG('v', (char *) "Evicting virtual page %" PRIu64 " (physical page %" PRIu64
+        ")\n", virtualPage, victim);
+
+  // Unmap the page first, so that the owner faults (and waits on the io
+  // bit) instead of modifying the page while it is being saved
+  tt->setBitIo(virtualPage);
+  tt->clearBitValid(virtualPage);
+
+  // A shared page is unmapped from the other address spaces too, they
+  // will fault and load it again. A page of a file is never modified,
+  // a page of a segment is modified if it is through one mapping
+  int index;
+  ShmSegment *segment = owner->FindSegment(virtualPage, &index);
+  bool modified = tt->getBitM(virtualPage);
+  if (tpr[victim].shared) {
+    while (tpr[victim].sharers != NULL) {
+      struct sharer_c *sharer = tpr[victim].sharers;
+      TranslationTable *other = sharer->owner->translationTable;
+      if (other->getBitM(sharer->virtualPage))
+        modified = true;
+      other->clearBitValid(sharer->virtualPage);
+      tpr[victim].sharers = sharer->next;
+      UnlinkSharer(sharer);
+      delete sharer;
+    }
+    tpr[victim].refcount = 1;
+    // A page of a segment is withdrawn once saved: the address spaces
+    // faulting on it meanwhile wait for it (see ShareFrame), then load
+    // the saved copy
+    if (segment == NULL)
+      MakePrivate(victim);
+  }
+
+  // A page of a segment goes back to the segment when it has been
+  // modified. A page of a mapped file goes back to the file when it
+  // has been modified, and is loaded from it again on the next fault.
+  // Otherwise, save the page when it has been modified, or when it has
+  // no copy on disk at all (anonymous page never swapped out)
+  if (segment != NULL) {
+    if (modified) {
+      segment->SavePage(index, victim);
+      g_stats->incrWritebacks();
+    }
+    tt->clearBitM(virtualPage);
+    MakePrivate(victim);
+  } else if (owner->findMappedFile(virtualPage << g_cfg->PageShift) != NULL) {
+    if (tt->getBitM(virtualPage)) {
+      tt->clearBitM(virtualPage);
+      owner->WriteMappedPage(virtualPage, victim);
+      g_stats->incrWritebacks();
+    }
+  } else if (tt->getBitM(virtualPage) ||
+      (!tt->getBitSwap(virtualPage) &&
+       tt->getAddrDisk(virtualPage) == (uint32_t) INVALID_SECTOR)) {
+    uint32_t sector;
+    if (tt->getBitSwap(virtualPage))
+      sector = tt->getAddrDisk(virtualPage);
+    else {
+      // Keep the pages of an address space contiguous in the swap area
+      sector = g_swap_manager->AllocSwapSector(owner->swapHint);
+      if (sector == (uint32_t) INVALID_SECTOR) {
+        printf("Error: swap area full, cannot evict page\n");
+        exit(ERROR);
+      }
+      owner->swapHint = sector + 1;
+      owner->swapSlots.push_back(sector);
+    }
+    g_swap_manager->PutPageSwap(sector, victim);
+    tt->setAddrDisk(virtualPage, sector);
+    tt->setBitSwap(virtualPage);
+    tt->clearBitM(virtualPage);
+    g_stats->incrWritebacks();
+  }
+  tt->clearBitIo(virtualPage);
+
+  // The page is about to receive new contents
+  g_machine->mmu->InvalidateDecodedPage(victim);
+
+  return victim;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::RegisterSharedFrame
+//
+/*! Make a page holding a page of a file available for sharing: the
+//  other address spaces faulting on the same page of the same file
+//  will map it instead of loading their own copy. Called before the
+//  page is loaded, while it is locked, so that concurrent faults wait
+//  for its contents.
+//
+//  \param num_page is the number of the real page
+//  \param key identifies the page of the file (see SharedKey)
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::RegisterSharedFrame(uint64_t num_page, uint64_t key) {
+  ASSERT(tpr[num_page].locked && !tpr[num_page].shared);
+  if (shared_frames.find(key) != shared_frames.end())
+    return;
+  shared_frames[key] = num_page;
+  tpr[num_page].shared = true;
+  tpr[num_page].key = key;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::ShareFrame
+//
+/*! Look for a page holding a given page of a file or of a segment
+//  and add an address space to its mappings, waiting if the page is
+//  being loaded or saved.
+//
+//  \param key identifies the page of the file or of the segment
+//  \param owner address space mapping the page
+//  \param virtualPage virtual page of owner mapping it
+//  \return the physical page, locked (the caller maps it then
+//  unlocks it), or INVALID_PAGE if the page of the file is not in
+//  memory
+*/
+//-----------------------------------------------------------------
+uint64_t
+PhysicalMemManager::ShareFrame(uint64_t key, AddrSpace *owner,
+                               uint64_t virtualPage) {
+  while (true) {
+    std::map<uint64_t, uint64_t>::iterator it = shared_frames.find(key);
+    if (it == shared_frames.end())
+      return INVALID_PAGE;
+
+    uint64_t pp = it->second;
+    if (!tpr[pp].locked) {
+      struct sharer_c *sharer = new struct sharer_c;
+      sharer->owner = owner;
+      sharer->page = pp;
+      sharer->virtualPage = virtualPage;
+      sharer->next = tpr[pp].sharers;
+      tpr[pp].sharers = sharer;
+      LinkSharer(sharer);
+      tpr[pp].refcount++;
+      tpr[pp].locked = true;
+      g_stats->incrSharedMappings();
+      return pp;
+    }
+    g_current_thread->Yield();
+  }
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::DropSharer
+//
+/*! Remove an address space from the mappings of a shared page, unless
+//  it is the last one (the page is then left untouched).
+//
+//  \param num_page is the number of the real page
+//  \param owner address space mapping the page
+//  \return true if the mapping was removed, false if owner is the only
+//  address space mapping the page
+*/
+//-----------------------------------------------------------------
+bool
+PhysicalMemManager::DropSharer(uint64_t num_page, AddrSpace *owner) {
+  if (tpr[num_page].refcount <= 1) {
+    ASSERT(tpr[num_page].owner == owner);
+    return false;
+  }
+
+  struct sharer_c **link = &tpr[num_page].sharers;
+  uint64_t virtualPage;
+  if (tpr[num_page].owner == owner) {
+    // The first other address space becomes the owner of the page
+    virtualPage = tpr[num_page].virtualPage;
+    UnlinkFrame(num_page);
+    tpr[num_page].owner = (*link)->owner;
+    tpr[num_page].virtualPage = (*link)->virtualPage;
+    LinkFrame(num_page);
+  } else {
+    while ((*link)->owner != owner)
+      link = &(*link)->next;
+    virtualPage = (*link)->virtualPage;
+  }
+  struct sharer_c *sharer = *link;
+  *link = sharer->next;
+  UnlinkSharer(sharer);
+  delete sharer;
+  tpr[num_page].refcount--;
+
+  // A modification of a page of a segment through the mapping removed
+  // must still be saved
+  TranslationTable *tt = owner->translationTable;
+  if (tt->getBitM(virtualPage))
+    tpr[num_page].owner->translationTable->setBitM(tpr[num_page].virtualPage);
+  tt->clearBitValid(virtualPage);
+  return true;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::MakePrivate
+//
+/*! Withdraw a page from sharing: later faults on the same page of the
+//  file will load a new copy.
+//
+//  \param num_page is the number of the real page
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::MakePrivate(uint64_t num_page) {
+  if (!tpr[num_page].shared)
+    return;
+  ASSERT(tpr[num_page].refcount <= 1);
+  shared_frames.erase(tpr[num_page].key);
+  tpr[num_page].shared = false;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::ReleasePage
+//
+/*! Remove the mapping of a page by an address space, freeing the page
+//  when no other address space maps it. Called when the address space
+//  is deleted.
+//
+//  \param num_page is the number of the real page
+//  \param owner address space mapping the page
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::ReleasePage(uint64_t num_page, AddrSpace *owner) {
+  if (!DropSharer(num_page, owner))
+    FreePhysicalPage(num_page);
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::DetachSegmentPage
+//
+/*! Remove the mapping of a page of a shared memory segment by an
+//  address space detaching the segment. The last mapping of the page
+//  saves it in the segment when it has been modified and other address
+//  spaces still hold the segment, then frees it. Called by the last
+//  thread of the process, which can wait for the disk.
+//
+//  \param num_page is the number of the real page, locked
+//  \param owner address space mapping the page
+//  \param segment the segment
+//  \param index the page in the segment
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::DetachSegmentPage(uint64_t num_page, AddrSpace *owner,
+                                      ShmSegment *segment, int index) {
+  ASSERT(tpr[num_page].locked);
+  if (DropSharer(num_page, owner)) {
+    UnlockPage(num_page);
+    return;
+  }
+  TranslationTable *tt = owner->translationTable;
+  if (segment->refs > 1 && tt->getBitM(tpr[num_page].virtualPage)) {
+    segment->SavePage(index, num_page);
+    g_stats->incrWritebacks();
+  }
+  FreePhysicalPage(num_page);
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::ReleaseAddrSpace
+//
+/*! Release everything an address space holds when it is deleted: its
+//  mappings of the pages of other address spaces, the pages it owns
+//  (freed unless other address spaces share them) and its sectors of
+//  the swap area, in a single update of the free sector map. Only the
+//  pages and sectors actually allocated are visited, whatever the size
+//  of the address space.
+//
+//  \param owner the address space
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::ReleaseAddrSpace(AddrSpace *owner) {
+  while (owner->sharedFrames != NULL)
+    DropSharer(owner->sharedFrames->page, owner);
+  while (owner->residentFrames != (uint64_t) INVALID_PAGE)
+    ReleasePage(owner->residentFrames, owner);
+
+  if (!owner->swapSlots.empty())
+    g_swap_manager->ReleaseSwapSectors(&owner->swapSlots[0],
+                                       owner->swapSlots.size());
+  owner->swapSlots.clear();
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::ReferencedFrames
+//
+/*! Count the pages owned by an address space that were referenced
+//  since the clock hand last cleared their bit U (estimate of its
+//  working set, see LoadController)
+//
+//  \param owner the address space
+//  \return the number of pages
+*/
+//-----------------------------------------------------------------
+uint32_t
+PhysicalMemManager::ReferencedFrames(AddrSpace *owner) {
+  uint32_t count = 0;
+  for (uint64_t pp = owner->residentFrames; pp != (uint64_t) INVALID_PAGE;
+       pp = tpr[pp].ownerNext)
+    if (owner->translationTable->getBitU(tpr[pp].virtualPage))
+      count++;
+  return count;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::LinkFrame
+//
+/*! Add a page to the list of the pages of its owner
+//
+//  \param num_page is the number of the real page, in no list
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::LinkFrame(uint64_t num_page) {
+  AddrSpace *owner = tpr[num_page].owner;
+
+  ASSERT(tpr[num_page].ownerLink == NULL);
+  tpr[num_page].ownerNext = owner->residentFrames;
+  if (owner->residentFrames != (uint64_t) INVALID_PAGE)
+    tpr[owner->residentFrames].ownerLink = &tpr[num_page].ownerNext;
+  owner->residentFrames = num_page;
+  tpr[num_page].ownerLink = &owner->residentFrames;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::UnlinkFrame
+//
+/*! Remove a page from the list of the pages of its owner, if it is
+//  in it
+//
+//  \param num_page is the number of the real page
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::UnlinkFrame(uint64_t num_page) {
+  if (tpr[num_page].ownerLink == NULL)
+    return;
+  uint64_t next = tpr[num_page].ownerNext;
+  *tpr[num_page].ownerLink = next;
+  if (next != (uint64_t) INVALID_PAGE)
+    tpr[next].ownerLink = tpr[num_page].ownerLink;
+  tpr[num_page].ownerLink = NULL;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::LinkSharer
+//
+/*! Add a mapping of a shared page to the list of its address space
+//
+//  \param sharer the mapping
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::LinkSharer(struct sharer_c *sharer) {
+  AddrSpace *owner = sharer->owner;
+
+  sharer->spaceNext = owner->sharedFrames;
+  if (owner->sharedFrames != NULL)
+    owner->sharedFrames->spaceLink = &sharer->spaceNext;
+  owner->sharedFrames = sharer;
+  sharer->spaceLink = &owner->sharedFrames;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::UnlinkSharer
+//
+/*! Remove a mapping of a shared page from the list of its address
+//  space
+//
+//  \param sharer the mapping
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::UnlinkSharer(struct sharer_c *sharer) {
+  *sharer->spaceLink = sharer->spaceNext;
+  if (sharer->spaceNext != NULL)
+    sharer->spaceNext->spaceLink = sharer->spaceLink;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::PageReferenced
+//
+/*! \return true if the bit U of the page is set in one of the address
+//  spaces mapping it
+//
+//  \param num_page is the number of the real page
+*/
+//-----------------------------------------------------------------
+bool
+PhysicalMemManager::PageReferenced(uint64_t num_page) {
+  uint64_t vp = tpr[num_page].virtualPage;
+
+  if (tpr[num_page].owner->translationTable->getBitU(vp))
+    return true;
+  for (struct sharer_c *sharer = tpr[num_page].sharers; sharer != NULL;
+       sharer = sharer->next)
+    if (sharer->owner->translationTable->getBitU(sharer->virtualPage))
+      return true;
+  return false;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::ClearReferenced
+//
+/*! Clear the bit U of the page in all the address spaces mapping it
+//
+//  \param num_page is the number of the real page
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::ClearReferenced(uint64_t num_page) {
+  uint64_t vp = tpr[num_page].virtualPage;
+
+  tpr[num_page].owner->translationTable->clearBitU(vp);
+  for (struct sharer_c *sharer = tpr[num_page].sharers; sharer != NULL;
+       sharer = sharer->next)
+    sharer->owner->translationTable->clearBitU(sharer->virtualPage);
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::MarkPrefetched
+//
+/*! Record that a page has been loaded by fault-around, before being
+//  referenced by its owner.
+//
+//  \param num_page is the number of the real page
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::MarkPrefetched(uint64_t num_page) {
+  ASSERT(!tpr[num_page].free);
+  tpr[num_page].prefetched = true;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::CheckPrefetched
+//
+/*! Called by the replacement policies before they look at (and clear)
+//  the bit U of a page: a prefetched page whose bit U is set has been
+//  referenced, so fault-around was right to load it.
+//
+//  \param num_page is the number of the real page
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::CheckPrefetched(uint64_t num_page) {
+  if (!tpr[num_page].prefetched)
+    return;
+  if (PageReferenced(num_page)) {
+    tpr[num_page].prefetched = false;
+    g_page_fault_manager->PrefetchUsed();
+  }
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::ClockVictim
+//
+/*! Clock (second chance) algorithm: advance the clock hand, giving a
+//  second chance to referenced pages (bit U set, cleared on the way),
+//  and stop on the first unreferenced page.
+//
+//  \return The victim physical page, or INVALID_PAGE if all pages are
+//  locked.
+*/
+//-----------------------------------------------------------------
+uint64_t
+PhysicalMemManager::ClockVictim() {
+  // Two turns are enough to find a page with bit U cleared
+  for (uint64_t n = 0; n < 2 * g_cfg->NumPhysPages; n++) {
+    i_clock = (i_clock + 1) % g_cfg->NumPhysPages;
+    if (tpr[i_clock].free || tpr[i_clock].locked)
+      continue;
+    CheckPrefetched(i_clock);
+    if (PageReferenced(i_clock))
+      ClearReferenced(i_clock);
+    else
+      return i_clock;
+  }
+  return INVALID_PAGE;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::EnhancedClockVictim
+//
+/*! Enhanced second chance algorithm: pages are ranked in four classes
+//  (U,M) = (0,0) < (0,1) < (1,0) < (1,1) and the clock hand looks for
+//  a page of the lowest class, to avoid evicting dirty pages that
+//  would have to be written to swap.
+//    - first turn: look for (0,0) without changing anything,
+//    - second turn: look for (0,1), clearing the U bits on the way,
+//    - both turns are repeated once, all U bits being then cleared.
+//
+//  \return The victim physical page, or INVALID_PAGE if all pages are
+//  locked.
+*/
+//-----------------------------------------------------------------
+uint64_t
+PhysicalMemManager::EnhancedClockVictim() {
+  for (int turn = 0; turn < 4; turn++) {
+    bool want_dirty = (turn % 2 == 1);
+    for (uint64_t n = 0; n < g_cfg->NumPhysPages; n++) {
+      i_clock = (i_clock + 1) % g_cfg->NumPhysPages;
+      if (tpr[i_clock].free || tpr[i_clock].locked)
+        continue;
+      CheckPrefetched(i_clock);
+      TranslationTable *tt = tpr[i_clock].owner->translationTable;
+      uint64_t vp = tpr[i_clock].virtualPage;
+      if (!PageReferenced(i_clock) && tt->getBitM(vp) == want_dirty)
+        return i_clock;
+      if (want_dirty)
+        ClearReferenced(i_clock);
+    }
+  }
+  return INVALID_PAGE;
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::AgingVictim
+//
+/*! Aging algorithm (approximate LRU): at each eviction, the age
+//  counter of every used page is shifted right and its bit U is
+//  moved in the most significant bit, then cleared. The page with
+//  the smallest counter (least recently used) is chosen, ties being
+//  broken in clock order.
+//
+//  \return The victim physical page, or INVALID_PAGE if all pages are
+//  locked.
+*/
+//-----------------------------------------------------------------
+uint64_t
+PhysicalMemManager::AgingVictim() {
+  uint64_t victim = INVALID_PAGE;
+
+  for (uint64_t n = 0; n < g_cfg->NumPhysPages; n++) {
+    i_clock = (i_clock + 1) % g_cfg->NumPhysPages;
+    if (tpr[i_clock].free)
+      continue;
+    CheckPrefetched(i_clock);
+    tpr[i_clock].age =
+        (tpr[i_clock].age >> 1) | (PageReferenced(i_clock) ? 0x80 : 0);
+    ClearReferenced(i_clock);
+    if (!tpr[i_clock].locked &&
+        (victim == (uint64_t) INVALID_PAGE || tpr[i_clock].age < tpr[victim].age))
+      victim = i_clock;
+  }
+
+  // Next search starts after the victim
+  if (victim != (uint64_t) INVALID_PAGE)
+    i_clock = victim;
+  return victim;
 }
 
 //-----------------------------------------------------------------
@@ -195,3 +970,165 @@ PhysicalMemManager::Print(void) {
                : 0);
   }
 }
+
+//-----------------------------------------------------------------
+// WritebackDaemon
+//
+/*! Entry point of the writeback thread (C++ does not allow a pointer
+//  to a member function).
+*/
+//-----------------------------------------------------------------
+static void
+WritebackDaemon(int64_t arg) {
+  ((PhysicalMemManager *) arg)->RunWritebackDaemon();
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::StartWritebackDaemon
+//
+/*! Create the kernel thread that saves dirty pages to the swap area
+//  in the background, so that page replacement mostly finds clean
+//  victims and does not wait for a disk write. Does nothing when the
+//  daemon is disabled (WritebackBatch = 0).
+//
+//  \param owner process the writeback thread is attached to
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::StartWritebackDaemon(Process *owner) {
+  if (g_cfg->WritebackBatch == 0)
+    return;
+
+  writeback_thread = new Thread((char *) "writeback");
+  if (writeback_thread->StartKernel(owner, WritebackDaemon, (int64_t) this) !=
+      NO_ERROR) {
+    fprintf(stderr, "Nachos boot error: cannot start writeback thread\n");
+    exit(ERROR);
+  }
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::WakeWriteback
+//
+/*! Wake up the writeback thread, unless it has already been signaled
+//  and has not run yet.
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::WakeWriteback() {
+  if (writeback_thread == NULL || writeback_pending)
+    return;
+  writeback_pending = true;
+  writeback_sem->V();
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::RunWritebackDaemon
+//
+/*! Body of the writeback thread: wait to be signaled by page
+//  replacement, then clean a batch of dirty pages.
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::RunWritebackDaemon() {
+  while (true) {
+    writeback_sem->P();
+    writeback_pending = false;
+    WritebackPages();
+  }
+}
+
+//-----------------------------------------------------------------
+// PhysicalMemManager::WritebackPages
+//
+/*! Save to the swap area up to WritebackBatch dirty pages (bit M set),
+//  scanning from the clock hand, i.e., the pages that will be
+//  considered next for replacement. The pages stay mapped: they are
+//  only locked during the write so that they cannot be evicted, and
+//  their M bit is cleared before the write so that a modification
+//  made meanwhile keeps them dirty.
+//
+//  The pages lacking a swap sector receive one next to the previous
+//  pages of their address space, and the batch is written in sector
+//  order (see SwapManager::PutPagesSwap).
+*/
+//-----------------------------------------------------------------
+void
+PhysicalMemManager::WritebackPages() {
+  uint32_t batchSize = g_cfg->WritebackBatch;
+  uint64_t *pages = new uint64_t[batchSize];
+  uint32_t *sectors = new uint32_t[batchSize];
+  bool *allocated = new bool[batchSize];
+  AddrSpace **owners = new AddrSpace *[batchSize];
+  uint64_t *virtualPages = new uint64_t[batchSize];
+  uint32_t n = 0;
+
+  // Collect the dirty pages ahead of the clock hand
+  uint64_t pp = i_clock;
+  for (uint64_t scanned = 0; scanned < g_cfg->NumPhysPages && n < batchSize;
+       scanned++) {
+    pp = (pp + 1) % g_cfg->NumPhysPages;
+    if (tpr[pp].free || tpr[pp].locked)
+      continue;
+    TranslationTable *tt = tpr[pp].owner->translationTable;
+    uint64_t vp = tpr[pp].virtualPage;
+    if (!tt->getBitValid(vp) || !tt->getBitM(vp))
+      continue;
+    // The pages of mapped files are written back to the files instead,
+    // and the pages of segments saved in the segments when evicted
+    int index;
+    if (tpr[pp].owner->findMappedFile(vp << g_cfg->PageShift) != NULL ||
+        tpr[pp].owner->FindSegment(vp, &index) != NULL)
+      continue;
+
+    tpr[pp].locked = true;
+    tt->clearBitM(vp);
+    pages[n] = pp;
+    owners[n] = tpr[pp].owner;
+    virtualPages[n] = vp;
+    allocated[n] = !tt->getBitSwap(vp);
+    if (allocated[n]) {
+      sectors[n] = g_swap_manager->AllocSwapSector(owners[n]->swapHint);
+      if (sectors[n] != (uint32_t) INVALID_SECTOR)
+        owners[n]->swapHint = sectors[n] + 1;
+    } else
+      sectors[n] = tt->getAddrDisk(vp);
+    n++;
+  }
+
+  if (n > 0) {
+    DEBUG('v', (char *) "Writeback of %" PRIu32 " dirty pages\n", n);
+    g_swap_manager->PutPagesSwap(sectors, pages, n);
+  }
+
+  for (uint32_t i = 0; i < n; i++) {
+    pp = pages[i];
+
+    // The owner may have released the page while we were writing it
+    if (tpr[pp].free || tpr[pp].owner != owners[i] ||
+        tpr[pp].virtualPage != virtualPages[i]) {
+      if (allocated[i] && sectors[i] != (uint32_t) INVALID_SECTOR)
+        g_swap_manager->ReleasePageSwap(sectors[i]);
+      continue;
+    }
+
+    TranslationTable *tt = owners[i]->translationTable;
+    if (sectors[i] == (uint32_t) INVALID_SECTOR) {
+      // Swap area full, the page is still dirty
+      tt->setBitM(virtualPages[i]);
+    } else {
+      tt->setAddrDisk(virtualPages[i], sectors[i]);
+      tt->setBitSwap(virtualPages[i]);
+      if (allocated[i])
+        owners[i]->swapSlots.push_back(sectors[i]);
+      g_stats->incrWritebacks();
+    }
+    tpr[pp].locked = false;
+  }
+
+  delete[] pages;
+  delete[] sectors;
+  delete[] allocated;
+  delete[] owners;
+  delete[] virtualPages;
+}
@@ -24,6 +24,7 @@
 #define __MEM_H
 
 class PhysicalMemManager;
+class ShmSegment;
 
 #include "kernel/addrspace.h"
 #include "kernel/synch.h"
@@ -32,6 +33,19 @@ class PhysicalMemManager;
 #include "machine/machine.h"
 #include "utility/list.h"
 #include "vm/swapManager.h"
+#include <map>
+
+/*! \brief Mapping of a shared page by an address space, besides its
+  owner */
+struct sharer_c {
+  AddrSpace *owner;   //!< Address space mapping the page
+  uint64_t page;      //!< The physical page
+  uint64_t virtualPage;          //!< Virtual page of owner mapping it
+  struct sharer_c *next;         //!< Next mapping of the same page
+  struct sharer_c *spaceNext;    //!< Next shared page of owner
+  struct sharer_c **spaceLink;   //!< Link to this mapping in the list of
+                                 //!< owner (AddrSpace::sharedFrames)
+};
 
 //-----------------------------------------------------------------
 /*! \brief Implements the physical page management.
@@ -55,16 +69,66 @@ public:
   void FreePhysicalPage(uint64_t numPage);   //!< Frees the page and deletes the
                                              //!< existing page mapping
   void UnlockPage(uint64_t numPage);         //!< Unlock physical page
+  void LockPage(uint64_t numPage);           //!< Lock physical page
   void Print(void);                          //!< Print the contents of a page
 
-  uint64_t FindFreePage();   //!< Return a free page if there is one
+  uint64_t FindFreePage(bool zero, bool *zeroed);   //!< Return a free page
+                                                   //!< if there is one
+  uint64_t FindSuperPageFrame(AddrSpace *owner, uint64_t virtualPage,
+                              bool *zeroed);   //!< Return the free page
+                                               //!< making the region of a
+                                               //!< page a superpage
+  void ZeroFreePages(int count);   //!< Zero free pages in advance (idle)
   uint64_t EvictPage();      //!< Return a free page when there is none
 
   // Update the physical page table
   void SetTPREntry(uint64_t pp, uint64_t virtualpage, AddrSpace *owner,
                    bool locked);
 
+  void StartWritebackDaemon(Process *owner);   //!< Start the thread cleaning
+                                               //!< dirty pages
+  void RunWritebackDaemon();   //!< Body of the writeback thread
+  void WritebackPages();       //!< Save a batch of dirty pages to the swap
+                               //!< area, ahead of the clock hand
+  void MarkPrefetched(uint64_t numPage);   //!< Page loaded by fault-around
+
+  // Sharing of the pages of files between address spaces
+  void RegisterSharedFrame(uint64_t numPage, uint64_t key);
+  uint64_t ShareFrame(uint64_t key, AddrSpace *owner, uint64_t virtualPage);
+  bool DropSharer(uint64_t numPage, AddrSpace *owner);
+  void MakePrivate(uint64_t numPage);
+  void ReleasePage(uint64_t numPage, AddrSpace *owner);   //!< Remove a
+                                                          //!< mapping of
+                                                          //!< the page
+  void DetachSegmentPage(uint64_t numPage, AddrSpace *owner,
+                         ShmSegment *segment, int index);   //!< Remove a
+                                                           //!< mapping of a
+                                                           //!< page of a
+                                                           //!< segment
+  void ReleaseAddrSpace(AddrSpace *owner);   //!< Release all the pages and
+                                             //!< swap sectors of an
+                                             //!< address space
+  uint32_t ReferencedFrames(AddrSpace *owner);   //!< Pages of an address
+                                                 //!< space with bit U set
+
 private:
+  uint64_t ClockVictim();           //!< Victim chosen by the clock algorithm
+  uint64_t EnhancedClockVictim();   //!< Victim chosen using the U and M bits
+  uint64_t AgingVictim();           //!< Victim with the oldest age counter
+  void WakeWriteback();   //!< Signal memory pressure to the writeback thread
+  void CheckPrefetched(uint64_t numPage);   //!< Report a used prefetched page
+  bool TakeFreePage(uint64_t numPage, bool *zeroed);   //!< Remove a page
+                                                       //!< from the free
+                                                       //!< lists
+  bool PageReferenced(uint64_t numPage);    //!< Bit U set in a mapping
+  void ClearReferenced(uint64_t numPage);   //!< Clear bit U in all mappings
+
+  // Lists of the pages of the address spaces
+  void LinkFrame(uint64_t numPage);     //!< Add a page to its owner's
+  void UnlinkFrame(uint64_t numPage);   //!< Remove a page from its owner's
+  void LinkSharer(struct sharer_c *sharer);
+  void UnlinkSharer(struct sharer_c *sharer);
+
   /*! \brief Describes the allocation of physical pages. Bits U
     (used/referenced) and M (modified/dirty) are in the page table entry and are
     directly set by the MMU hardware */
@@ -75,14 +139,40 @@ private:
     uint64_t virtualPage;   //!< Number of the virtualPage which references this
                             //!< real page
     AddrSpace *owner;       //!< Address space of the owner process
+    uint8_t age;            //!< Aging counter (REPLACEMENT_AGING policy)
+    bool prefetched;        //!< Loaded by fault-around and not referenced
+                            //!< since
+    uint32_t refcount;      //!< Number of address spaces mapping the page
+    bool shared;            //!< true if the page holds a page of a file
+                            //!< or of a shared memory segment, available
+                            //!< for sharing
+    uint64_t key;           //!< Page of the file or of the segment (if
+                            //!< shared)
+    struct sharer_c *sharers;   //!< Address spaces mapping the page, besides
+                                //!< owner (at virtualPage for a file, at
+                                //!< any page for a segment)
+    uint64_t ownerNext;         //!< Next page of owner
+    uint64_t *ownerLink;        //!< Link to this page in the list of owner
+                                //!< (NULL if not in it)
   };
 
   struct tpr_c *tpr;   //!< RealPage Array to know the state of each real page
 
-  ListInt free_page_list;   //!< List of available (unused) real page numbers
+  ListInt zeroed_page_list;   //!< Available (unused) real page numbers,
+                              //!< filled with zeroes
+  ListInt dirty_page_list;    //!< Available real page numbers holding the
+                              //!< contents of their last use
+
+  std::map<uint64_t, uint64_t> shared_frames;   //!< Shared pages, indexed by
+                                                //!< page of file or of
+                                                //!< segment
 
   uint64_t i_clock;   //!< Index for clock_algorithm
 
+  Thread *writeback_thread;   //!< Dirty page writeback thread (NULL if none)
+  Semaphore *writeback_sem;   //!< The writeback thread waits on it
+  bool writeback_pending;     //!< true if the writeback thread was signaled
+
   friend class AddrSpace;   //!< Direct access to page table for programm
                             //!< loading
 };
@@ -0,0 +1,123 @@
+/*! \file shm.cc
+//  \brief Routines of the shared memory segments
+//
+//      The physical pages of a segment are found by their key among
+//      the shared pages, the segment only keeps the copies of its
+//      pages evicted from memory.
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+*/
+
+#include "vm/shm.h"
+#include "kernel/msgerror.h"
+#include "kernel/system.h"
+#include "machine/machine.h"
+#include "utility/config.h"
+#include "utility/stats.h"
+#include "vm/swapManager.h"
+
+//----------------------------------------------------------------------
+// ShmSegment::ShmSegment
+/*!	Create a segment, held by the address space creating it, with
+//	no page saved yet.
+//
+//	\param size the size of the segment, in pages
+*/
+//----------------------------------------------------------------------
+ShmSegment::ShmSegment(int size) {
+  numPages = size;
+  refs = 1;
+  sectors = new uint32_t[numPages];
+  for (int i = 0; i < numPages; i++)
+    sectors[i] = INVALID_SECTOR;
+  id = g_object_addrs->AddObject(this, SHM_TYPE);
+}
+
+//----------------------------------------------------------------------
+// ShmSegment::~ShmSegment
+/*!	Delete a segment no address space holds anymore, releasing the
+//	sectors of its saved pages at once.
+*/
+//----------------------------------------------------------------------
+ShmSegment::~ShmSegment() {
+  int count = 0;
+  for (int i = 0; i < numPages; i++)
+    if (sectors[i] != (uint32_t) INVALID_SECTOR)
+      sectors[count++] = sectors[i];
+  if (count > 0)
+    g_swap_manager->ReleaseSwapSectors(sectors, count);
+  delete[] sectors;
+}
+
+//----------------------------------------------------------------------
+// ShmSegment::Release
+/*!	Count one address space less holding the segment. After the last
+//	one, no process can attach it anymore and it is deleted.
+*/
+//----------------------------------------------------------------------
+void
+ShmSegment::Release() {
+  ASSERT(refs > 0);
+  if (--refs > 0)
+    return;
+  DEBUG('a', (char *) "Shared memory segment %d deleted\n", (int) id);
+  g_object_addrs->RemoveObject(id);
+  delete this;
+}
+
+//----------------------------------------------------------------------
+// ShmSegment::LoadPage
+/*!	Fill a physical page with a page of the segment: its copy in the
+//	swap area, or zeroes if it was never saved.
+//
+//	\param index the page in the segment
+//	\param pp the physical page
+//	\param zeroed true if the physical page already holds zeroes
+*/
+//----------------------------------------------------------------------
+void
+ShmSegment::LoadPage(int index, uint64_t pp, bool zeroed) {
+  if (sectors[index] != (uint32_t) INVALID_SECTOR)
+    g_swap_manager->GetPageSwap(sectors[index], pp);
+  else if (zeroed)
+    g_stats->incrPrezeroedFaults();
+  else
+    memset(&(g_machine->mainMemory[pp << g_cfg->PageShift]), 0,
+           g_cfg->PageSize);
+}
+
+//----------------------------------------------------------------------
+// ShmSegment::SavePage
+/*!	Save a modified page of the segment in the swap area, next to
+//	the previous page of the segment if possible.
+//
+//	\param index the page in the segment
+//	\param pp the physical page holding it, locked
+*/
+//----------------------------------------------------------------------
+void
+ShmSegment::SavePage(int index, uint64_t pp) {
+  if (sectors[index] == (uint32_t) INVALID_SECTOR) {
+    uint32_t hint = INVALID_SECTOR;
+    if (index > 0 && sectors[index - 1] != (uint32_t) INVALID_SECTOR)
+      hint = sectors[index - 1] + 1;
+    sectors[index] = g_swap_manager->AllocSwapSector(hint);
+    if (sectors[index] == (uint32_t) INVALID_SECTOR) {
+      printf("Error: swap area full, cannot evict page\n");
+      exit(ERROR);
+    }
+  }
+  g_swap_manager->PutPageSwap(sectors[index], pp);
+}
@@ -0,0 +1,79 @@
+/*! \file shm.h
+    \brief Data structures for the shared memory segments
+
+        A segment is a set of zero-filled pages which the processes
+        attaching it map in their address spaces, at an address chosen
+        in each one: the processes then share the same physical pages
+        (see PhysicalMemManager::ShareFrame), whatever the pages they
+        write to. A page of a segment is saved in the segment when it
+        is evicted, not in the swap pages of an address space, so that
+        any process attaching the segment loads it back.
+
+ * -----------------------------------------------------
+ * This file is part of the Nachos-RiscV distribution
+ * Copyright (c) 2022 University of Rennes 1.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details
+ * (see see <http://www.gnu.org/licenses/>).
+ * -----------------------------------------------------
+
+*/
+
+#ifndef SHM_H
+#define SHM_H
+
+#include "kernel/copyright.h"
+#include "utility/utility.h"
+
+//! Keys of the pages of segments among the shared physical pages,
+//! apart from the pages of files (see SharedKey)
+#define SHM_KEY (1ULL << 63)
+
+/*! \brief Defines a shared memory segment
+//
+// The segment is held by the address space which created it and by
+// the address spaces attaching it, and deleted once none of them
+// holds it (see AddrSpace::DetachSegments).
+*/
+class ShmSegment {
+public:
+  //! Create a segment of numPages zero-filled pages, registered in
+  //! the object table
+  ShmSegment(int size);
+
+  //! Delete a segment, releasing its swap sectors
+  ~ShmSegment();
+
+  //! Count one more address space holding the segment
+  void Hold() { refs++; }
+
+  //! Count one address space less, deleting the segment after the last
+  void Release();
+
+  //! Key of a page among the shared physical pages
+  uint64_t Key(int index) { return SHM_KEY | ((uint64_t) id << 32) | index; }
+
+  //! Fill a physical page with the contents of a page of the segment
+  void LoadPage(int index, uint64_t pp, bool zeroed);
+
+  //! Save a physical page holding a page of the segment
+  void SavePage(int index, uint64_t pp);
+
+  int32_t id;     //!< Identifier in the object table
+  int numPages;   //!< Size of the segment, in pages
+  int refs;       //!< Address spaces holding the segment
+
+private:
+  //! Sector of the swap area of each page, INVALID_SECTOR while the
+  //! page has never been saved (it is then zero-filled)
+  uint32_t *sectors;
+};
+
+#endif   // SHM_H
@@ -19,47 +19,151 @@
 */
 //-----------------------------------------------------------------
 
+#include <algorithm>
 #include <unistd.h>
 
 #include "drivers/drvDisk.h"
 #include "kernel/msgerror.h"
 #include "kernel/thread.h"
-#include "utility/bitmap.h"
 #include "vm/swapManager.h"
 
+#define WORD_BITS 64
+#define NUM_FREE_WORDS (divRoundUp(NUM_SECTORS, WORD_BITS))
+#define NUM_SUMMARY_WORDS (divRoundUp(NUM_FREE_WORDS, WORD_BITS))
+
 //-----------------------------------------------------------------
 /**
  * Initializes the swapping area
  *
- * Initialize the page_flags bitmap to specify that the sectors
+ * Initialize the free sector map to specify that the sectors
  * of the swapping area are free
  */
 //-----------------------------------------------------------------
 SwapManager::SwapManager() {
 
-  swap_disk = new DriverDisk((char *) "sem swap disk",
-                             (char *) "lock swap disk", g_machine->diskSwap);
-  page_flags = new BitMap(NUM_SECTORS);
+  swap_disk = new DriverDisk((char *) "swap disk", g_machine->swapDisks,
+                             g_cfg->NumDisks);
+  free_map = new uint64_t[NUM_FREE_WORDS];
+  free_summary = new uint64_t[NUM_SUMMARY_WORDS];
+  for (uint32_t w = 0; w < NUM_FREE_WORDS; w++)
+    free_map[w] = 0;
+  for (uint32_t w = 0; w < NUM_SUMMARY_WORDS; w++)
+    free_summary[w] = 0;
+  num_free = 0;
+  for (uint32_t i = 0; i < NUM_SECTORS; i++)
+    MarkFree(i);
+  next_fit = 0;
 }
 
 //-----------------------------------------------------------------
 /**
  * De-allocate the swapping area
  *
- * De-allocate the page_flags bitmap
+ * De-allocate the free sector map
  */
 //-----------------------------------------------------------------
 SwapManager::~SwapManager() {
 
-  delete page_flags;
+  delete[] free_map;
+  delete[] free_summary;
   delete swap_disk;
 }
 
+//-----------------------------------------------------------------
+/** Mark a sector as used in the free map
+ *
+ *  \param sector: the sector number, supposed to be free
+ */
+//-----------------------------------------------------------------
+void
+SwapManager::MarkUsed(uint32_t sector) {
+  uint32_t w = sector / WORD_BITS;
+
+  ASSERT(free_map[w] & (1ULL << (sector % WORD_BITS)));
+  free_map[w] &= ~(1ULL << (sector % WORD_BITS));
+  if (free_map[w] == 0)
+    free_summary[w / WORD_BITS] &= ~(1ULL << (w % WORD_BITS));
+  num_free--;
+}
+
+//-----------------------------------------------------------------
+/** Mark a sector as free in the free map
+ *
+ *  \param sector: the sector number, supposed to be used
+ */
+//-----------------------------------------------------------------
+void
+SwapManager::MarkFree(uint32_t sector) {
+  uint32_t w = sector / WORD_BITS;
+
+  ASSERT(!(free_map[w] & (1ULL << (sector % WORD_BITS))));
+  free_map[w] |= 1ULL << (sector % WORD_BITS);
+  free_summary[w / WORD_BITS] |= 1ULL << (w % WORD_BITS);
+  num_free++;
+}
+
+//-----------------------------------------------------------------
+/** Returns the first word index >= w of free_map having a free
+ * sector, wrapping around at the end of the map. There must be at
+ * least one free sector.
+ *
+ *  \param w: index of the first word to consider
+ */
+//-----------------------------------------------------------------
+uint32_t
+SwapManager::NextFreeWord(uint32_t w) {
+  ASSERT(num_free > 0);
+  if (w >= NUM_FREE_WORDS)
+    w = 0;
+
+  // Summary words from w to the end, then from the beginning
+  uint32_t s = w / WORD_BITS;
+  uint64_t bits = free_summary[s] & (~0ULL << (w % WORD_BITS));
+  for (uint32_t n = 0; n <= NUM_SUMMARY_WORDS; n++) {
+    if (bits != 0)
+      return s * WORD_BITS + __builtin_ctzll(bits);
+    s = (s + 1) % NUM_SUMMARY_WORDS;
+    bits = free_summary[s];
+  }
+  ASSERT(false);
+  return 0;
+}
+
+//-----------------------------------------------------------------
+/** Allocate a free sector in the swap area, the first one found
+ *  from the hint (wrapping around at the end of the area).
+ *
+ *  \param hint: preferred sector (INVALID_SECTOR for no preference)
+ *  \return the allocated sector, or INVALID_SECTOR if the swap area
+ *  is full
+ */
+//-----------------------------------------------------------------
+uint32_t
+SwapManager::AllocSwapSector(uint32_t hint) {
+  if (num_free == 0)
+    return INVALID_SECTOR;
+  if (hint >= NUM_SECTORS)
+    hint = next_fit;
+
+  // Free sectors after the hint in its own word
+  uint32_t w = hint / WORD_BITS;
+  uint64_t bits = free_map[w] & (~0ULL << (hint % WORD_BITS));
+  if (bits == 0) {
+    w = NextFreeWord(w + 1);
+    bits = free_map[w];
+  }
+  uint32_t sector = w * WORD_BITS + __builtin_ctzll(bits);
+
+  MarkUsed(sector);
+  next_fit = (sector + 1) % NUM_SECTORS;
+  return sector;
+}
+
 //-----------------------------------------------------------------
 /** Returns the number of a free sector in the swap area
  *
- * This method scans the allocation bitmap page_flags to decide which
- * page is used
+ * This method allocates the first free sector from the next fit
+ * position
  *
  * \return Number of free sector in the swap area, or ERROR of
  * there is no free sector available
@@ -67,23 +171,57 @@ SwapManager::~SwapManager() {
 //-----------------------------------------------------------------
 uint64_t
 SwapManager::GetFreeSwapSector() {
+  uint32_t sector = AllocSwapSector(INVALID_SECTOR);
 
-  // Scan the page allocation bitmap
-  for (int i = 0; i < NUM_SECTORS; i++) {
-    if (!page_flags->Test(i)) {
-      // the page #i is free
-      page_flags->Mark(i);
-      return i;
+  if (sector == (uint32_t) INVALID_SECTOR)
+    return ERROR;
+  return sector;
+}
+
+//-----------------------------------------------------------------
+/** Returns the first sector of a run of count free contiguous
+ * sectors in the swap area, and marks them as used
+ *
+ * Full words of the free map are skipped using the summary.
+ *
+ * \return First sector of the run, or INVALID_SECTOR if there is no
+ * such run
+ */
+//-----------------------------------------------------------------
+uint64_t
+SwapManager::GetFreeSwapRun(int count) {
+  if (count <= 0 || (uint32_t) count > num_free)
+    return INVALID_SECTOR;
+
+  uint32_t start = 0;
+  int length = 0;
+  uint32_t i = 0;
+  while (i < NUM_SECTORS) {
+    uint32_t w = i / WORD_BITS;
+    if (i % WORD_BITS == 0 && free_map[w] == 0) {
+      // Word without free sector: the run is broken
+      length = 0;
+      i += WORD_BITS;
+      continue;
     }
+    if (free_map[w] & (1ULL << (i % WORD_BITS))) {
+      if (length == 0)
+        start = i;
+      if (++length == count) {
+        for (uint32_t j = start; j < start + count; j++)
+          MarkUsed(j);
+        return start;
+      }
+    } else
+      length = 0;
+    i++;
   }
-
-  // There is no available page, return ERROR
-  return ERROR;
+  return INVALID_SECTOR;
 }
 
 //-----------------------------------------------------------------
 /** This method frees an unused page in the swap area by modifying the
- * page allocation bitmap. This method is called when exiting a
+ * free sector map. This method is called when exiting a
  * process to de-allocate its swap area
  *
  *  \param disk_addr: the sector number to free
@@ -94,8 +232,35 @@ SwapManager::ReleasePageSwap(uint32_t disk_addr) {
 
   DEBUG('v', (char *) "Swap page %" PRIu32 " released for thread \"%s\"\n",
         disk_addr, g_current_thread->GetName());
-  // clear the #num_sector bit of page_flags
-  page_flags->Clear(disk_addr);
+  MarkFree(disk_addr);
+}
+
+//-----------------------------------------------------------------
+/** This method frees a set of sectors of the swap area at once: the
+ * sectors are sorted so that each word of the free sector map, and of
+ * its summary, is updated once.
+ *
+ *  \param sectors: the sector numbers to free (sorted in place)
+ *  \param count: number of sectors
+ */
+//-----------------------------------------------------------------
+void
+SwapManager::ReleaseSwapSectors(uint32_t *sectors, int count) {
+  DEBUG('v', (char *) "%d swap pages released for thread \"%s\"\n", count,
+        g_current_thread->GetName());
+  std::sort(sectors, sectors + count);
+
+  int i = 0;
+  while (i < count) {
+    uint32_t w = sectors[i] / WORD_BITS;
+    uint64_t bits = 0;
+    for (; i < count && sectors[i] / WORD_BITS == w; i++)
+      bits |= 1ULL << (sectors[i] % WORD_BITS);
+    ASSERT((free_map[w] & bits) == 0);
+    free_map[w] |= bits;
+    free_summary[w / WORD_BITS] |= 1ULL << (w % WORD_BITS);
+    num_free += __builtin_popcountll(bits);
+  }
 }
 
 //-----------------------------------------------------------------
@@ -111,7 +276,7 @@ SwapManager::GetPageSwap(uint32_t disk_addr, uint64_t pp) {
 
   DEBUG('v', (char *) "Reading swap page %" PRIu32 " for \"%s\"\n", disk_addr,
         g_current_thread->GetName());
-  swap_disk->ReadSector(disk_addr, (char*) &(g_machine->mainMemory[pp * g_cfg->PageSize]));
+  swap_disk->ReadSector(disk_addr, (char*) &(g_machine->mainMemory[pp << g_cfg->PageShift]));
 }
 
 //-----------------------------------------------------------------
@@ -132,7 +297,7 @@ SwapManager::PutPageSwap(uint32_t disk_addr, uint64_t pp) {
   if (disk_addr != (uint32_t) INVALID_SECTOR) {
     DEBUG('v', (char *) "Writing swap page %" PRIu32 " for \"%s\"\n", disk_addr,
           g_current_thread->GetName());
-    swap_disk->WriteSector(disk_addr, (char *)&(g_machine->mainMemory[pp * g_cfg->PageSize]));
+    swap_disk->WriteSector(disk_addr, (char *)&(g_machine->mainMemory[pp << g_cfg->PageShift]));
     return disk_addr;
   } else {
     uint64_t newsect = GetFreeSwapSector();
@@ -141,12 +306,80 @@ SwapManager::PutPageSwap(uint32_t disk_addr, uint64_t pp) {
     } else {
       DEBUG('v', (char *) "Writing swap page %" PRIu32 " for \"%s\"\n", newsect,
             g_current_thread->GetName());
-      swap_disk->WriteSector(newsect, (char *)&(g_machine->mainMemory[pp * g_cfg->PageSize]));
+      swap_disk->WriteSector(newsect, (char *)&(g_machine->mainMemory[pp << g_cfg->PageShift]));
       return newsect;
     }
   }
 }
 
+//-----------------------------------------------------------------
+/** This method puts a batch of pages into the swapping area. The
+ *  entries of sectors set to INVALID_SECTOR receive a free sector,
+ *  taken from a single contiguous run when possible, and the pages
+ *  are written in increasing sector order, so that the disk head
+ *  sweeps the swap area once for the whole batch.
+ *
+ *  \param sectors: disk addresses in the swap area (updated)
+ *  \param pps: numbers of the physical pages in the machine memory
+ *  \param count: number of pages in the batch
+ */
+//-----------------------------------------------------------------
+void
+SwapManager::PutPagesSwap(uint32_t *sectors, uint64_t *pps, int count) {
+  int missing = 0;
+
+  // Allocate the missing sectors, contiguously if possible
+  for (int i = 0; i < count; i++)
+    if (sectors[i] == (uint32_t) INVALID_SECTOR)
+      missing++;
+  if (missing > 0) {
+    uint64_t next = GetFreeSwapRun(missing);
+    for (int i = 0; i < count; i++) {
+      if (sectors[i] != (uint32_t) INVALID_SECTOR)
+        continue;
+      if (next != (uint64_t) INVALID_SECTOR)
+        sectors[i] = next++;
+      else
+        sectors[i] = GetFreeSwapSector();
+    }
+  }
+
+  // Write the pages by increasing sector number, each run of
+  // consecutive sectors with a single disk request
+  uint32_t last = 0;
+  bool first = true;
+  uint32_t runStart = 0;
+  int runLength = 0;
+  char *run[count];
+  for (int n = 0; n < count; n++) {
+    int best = -1;
+    for (int i = 0; i < count; i++) {
+      if (sectors[i] == (uint32_t) INVALID_SECTOR)
+        continue;
+      if (!first && sectors[i] <= last)
+        continue;
+      if (best == -1 || sectors[i] < sectors[best])
+        best = i;
+    }
+    if (best == -1)
+      break;
+    DEBUG('v', (char *) "Writing swap page %" PRIu32 " for \"%s\"\n",
+          sectors[best], g_current_thread->GetName());
+    if (runLength > 0 && sectors[best] != runStart + runLength) {
+      swap_disk->WriteSectors(runStart, runLength, run);
+      runLength = 0;
+    }
+    if (runLength == 0)
+      runStart = sectors[best];
+    run[runLength++] =
+        (char *) &(g_machine->mainMemory[pps[best] << g_cfg->PageShift]);
+    last = sectors[best];
+    first = false;
+  }
+  if (runLength > 0)
+    swap_disk->WriteSectors(runStart, runLength, run);
+}
+
 //-----------------------------------------------------------------
 /** This method gives to the DriverDisk for the swap area */
 //-----------------------------------------------------------------
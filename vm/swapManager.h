@@ -29,7 +29,6 @@
 // Forward declarations
 class BackingStore;
 class DriverDisk;
-class BitMap;
 class OpenFile;
 
 //-----------------------------------------------------------------
@@ -50,7 +49,7 @@ public:
   /**
    * Initializes the swapping area
    *
-   * Initialize the page_flags bitmap to specify that the sectors
+   * Initialize the free sector map to specify that the sectors
    * of the swapping area are free
    */
   SwapManager();
@@ -58,7 +57,7 @@ public:
   /**
    * De-allocate the swapping area
    *
-   * De-allocate the page_flags bitmap
+   * De-allocate the free sector map
    */
   ~SwapManager();
 
@@ -80,6 +79,30 @@ public:
    */
   uint64_t PutPageSwap(uint32_t disk_addr, uint64_t pp);
 
+  /** Allocate a free sector in the swap area, the first one found
+   *  from the hint (wrapping around at the end of the area). Costs a
+   *  few word operations, however full the swap area is.
+   *
+   *  \param hint: preferred sector, usually the one following the last
+   *  sector allocated to the same address space (INVALID_SECTOR for
+   *  no preference)
+   *  \return the allocated sector, or INVALID_SECTOR if the swap area
+   *  is full
+   */
+  uint32_t AllocSwapSector(uint32_t hint);
+
+  /** This method puts a batch of pages into the swapping area. The
+   *  entries of sectors set to INVALID_SECTOR receive a free sector,
+   *  taken from a single contiguous run when possible, and the pages
+   *  are written in increasing sector order. An entry stays at
+   *  INVALID_SECTOR (page not written) when the swap area is full.
+   *
+   *  \param sectors: disk addresses in the swap area (updated)
+   *  \param pps: numbers of the physical pages in the machine memory
+   *  \param count: number of pages in the batch
+   */
+  void PutPagesSwap(uint32_t *sectors, uint64_t *pps, int count);
+
   /** This method frees an unused page in the swap area by modifying the
    * page allocation bitmap. This method is called when exiting a
    * process to de-allocate its swap area
@@ -88,6 +111,15 @@ public:
    */
   void ReleasePageSwap(uint32_t num_sector);
 
+  /** This method frees a set of sectors of the swap area at once, each
+   * word of the free sector map being updated once. This method is
+   * called when deleting an address space.
+   *
+   *  \param sectors: the sector numbers to free (sorted in place)
+   *  \param count: number of sectors
+   */
+  void ReleaseSwapSectors(uint32_t *sectors, int count);
+
   /** This method gives access to the swapdisk's driver */
   DriverDisk *GetSwapDisk();
 
@@ -95,18 +127,43 @@ private:
   /** Disk containing the swap area */
   DriverDisk *swap_disk;
 
-  /** Bitmap used to know if sectors in the swap area are free or busy */
-  BitMap *page_flags;
+  /** Two-level map of the free sectors of the swap area: bit i of
+   * free_map is set if sector i is free, and bit w of free_summary is
+   * set if word w of free_map has a free sector */
+  uint64_t *free_map;
+  uint64_t *free_summary;
+
+  /** Number of free sectors */
+  uint32_t num_free;
+
+  /** Sector where searches without hint start (next fit) */
+  uint32_t next_fit;
+
+  /** Mark a sector as used or free in the free map */
+  void MarkUsed(uint32_t sector);
+  void MarkFree(uint32_t sector);
+
+  /** Returns the first word index >= w (with wrap-around) of free_map
+   * having a free sector, found using free_summary */
+  uint32_t NextFreeWord(uint32_t w);
 
   /** Returns the number of a free page in the swap area
    *
-   * This method scans the allocation bitmap page_flags to decide which
-   * page is used
+   * This method allocates the first free sector from the next fit
+   * position
    *
    * \return Number of free sector in the swap area, or ERROR of
    * there is no free sector available
    */
   uint64_t GetFreeSwapSector();
+
+  /** Returns the first sector of a run of count free contiguous
+   * sectors in the swap area, and marks them as used
+   *
+   * \return First sector of the run, or INVALID_SECTOR if there is no
+   * such run
+   */
+  uint64_t GetFreeSwapRun(int count);
 };
 
 #endif   // __SWAPMGR_H